@@ -0,0 +1,563 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    methods.ck
+
+Abstract:
+
+    This module implements a set of Chalk microbenchmarks that stress method
+    dispatch. Each benchmark runs a tight loop of method calls and reports
+    the elapsed time. Usage: chalk methods.ck [iterations]
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Chalk
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+from app import argv;
+import _time;
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+var DEFAULT_ITERATIONS = 1000000;
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+class Counter {
+    var _value;
+
+    function
+    __init (
+        )
+
+    {
+
+        _value = 0;
+        return this;
+    }
+
+    function
+    add (
+        amount
+        )
+
+    {
+
+        _value += amount;
+        return _value;
+    }
+
+    function
+    value (
+        )
+
+    {
+
+        return _value;
+    }
+}
+
+class Shape {
+    function
+    area (
+        )
+
+    {
+
+        return 0;
+    }
+
+    function
+    scaledArea (
+        scale
+        )
+
+    {
+
+        return this.area() * scale;
+    }
+}
+
+class Square is Shape {
+    function
+    area (
+        )
+
+    {
+
+        return 4;
+    }
+}
+
+class Rectangle is Shape {
+    function
+    area (
+        )
+
+    {
+
+        return 6;
+    }
+}
+
+class Triangle is Shape {
+    function
+    area (
+        )
+
+    {
+
+        return 3;
+    }
+}
+
+class Circle is Shape {
+    function
+    area (
+        )
+
+    {
+
+        return 12;
+    }
+}
+
+class Hexagon is Shape {
+    function
+    area (
+        )
+
+    {
+
+        return 24;
+    }
+}
+
+class Octagon is Shape {
+    function
+    area (
+        )
+
+    {
+
+        return 48;
+    }
+}
+
+class LoudSquare is Square {
+    function
+    area (
+        )
+
+    {
+
+        return super.area() + 1;
+    }
+}
+
+class Wide {
+    function
+    sum (
+        a,
+        b,
+        c,
+        d,
+        e,
+        f,
+        g,
+        h,
+        i,
+        j
+        )
+
+    {
+
+        return a + j;
+    }
+}
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+function
+_now (
+    );
+
+function
+_report (
+    name,
+    iterations,
+    start
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+function
+benchMonomorphic (
+    iterations
+    )
+
+/*++
+
+Routine Description:
+
+    This routine calls the same method on the same class over and over.
+
+Arguments:
+
+    iterations - Supplies the number of calls to make.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var counter = Counter();
+    var index;
+    var start = _now();
+
+    for (index = 0; index < iterations; index += 1) {
+        counter.add(1);
+    }
+
+    _report("monomorphic", iterations, start);
+    return;
+}
+
+function
+benchPolymorphic (
+    iterations
+    )
+
+/*++
+
+Routine Description:
+
+    This routine calls a method from a single call site on receivers of a
+    few different classes.
+
+Arguments:
+
+    iterations - Supplies the number of calls to make.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var index;
+    var shapes = [Square(), Rectangle(), Triangle()];
+    var start = _now();
+    var total = 0;
+
+    for (index = 0; index < iterations; index += 1) {
+        total += shapes[index % 3].area();
+    }
+
+    _report("polymorphic", iterations, start);
+    return;
+}
+
+function
+benchMegamorphic (
+    iterations
+    )
+
+/*++
+
+Routine Description:
+
+    This routine calls a method from a single call site on receivers of more
+    classes than a call site cache can hold.
+
+Arguments:
+
+    iterations - Supplies the number of calls to make.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var index;
+    var shapes = [Square(),
+                  Rectangle(),
+                  Triangle(),
+                  Circle(),
+                  Hexagon(),
+                  Octagon()];
+
+    var start = _now();
+    var total = 0;
+
+    for (index = 0; index < iterations; index += 1) {
+        total += shapes[index % 6].area();
+    }
+
+    _report("megamorphic", iterations, start);
+    return;
+}
+
+function
+benchInherited (
+    iterations
+    )
+
+/*++
+
+Routine Description:
+
+    This routine calls a method inherited from a superclass, which in turn
+    calls a method on itself.
+
+Arguments:
+
+    iterations - Supplies the number of calls to make.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var index;
+    var shape = Circle();
+    var start = _now();
+    var total = 0;
+
+    for (index = 0; index < iterations; index += 1) {
+        total += shape.scaledArea(2);
+    }
+
+    _report("inherited", iterations, start);
+    return;
+}
+
+function
+benchSuper (
+    iterations
+    )
+
+/*++
+
+Routine Description:
+
+    This routine calls a method that calls up into its superclass.
+
+Arguments:
+
+    iterations - Supplies the number of calls to make.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var index;
+    var shape = LoudSquare();
+    var start = _now();
+    var total = 0;
+
+    for (index = 0; index < iterations; index += 1) {
+        total += shape.area();
+    }
+
+    _report("super", iterations, start);
+    return;
+}
+
+function
+benchManyArguments (
+    iterations
+    )
+
+/*++
+
+Routine Description:
+
+    This routine calls a method with more arguments than fit in the short
+    call opcodes.
+
+Arguments:
+
+    iterations - Supplies the number of calls to make.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var index;
+    var start = _now();
+    var total = 0;
+    var wide = Wide();
+
+    for (index = 0; index < iterations; index += 1) {
+        total += wide.sum(1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+    }
+
+    _report("many arguments", iterations, start);
+    return;
+}
+
+function
+main (
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the entry point into the method call benchmarks.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    0 always.
+
+--*/
+
+{
+
+    var iterations = DEFAULT_ITERATIONS;
+
+    if (argv.length() > 1) {
+        iterations = Int.fromString(argv[1]);
+    }
+
+    benchMonomorphic(iterations);
+    benchPolymorphic(iterations);
+    benchMegamorphic(iterations);
+    benchInherited(iterations);
+    benchSuper(iterations);
+    benchManyArguments(iterations);
+    return 0;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+function
+_now (
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the current monotonic time in microseconds.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the current time in microseconds.
+
+--*/
+
+{
+
+    var time = (_time.clock_gettime)(_time.CLOCK_MONOTONIC);
+
+    return (time[0] * 1000000) + (time[1] / 1000);
+}
+
+function
+_report (
+    name,
+    iterations,
+    start
+    )
+
+/*++
+
+Routine Description:
+
+    This routine prints the results of a benchmark.
+
+Arguments:
+
+    name - Supplies the name of the benchmark.
+
+    iterations - Supplies the number of iterations that were run.
+
+    start - Supplies the start time of the benchmark in microseconds.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var elapsed = _now() - start;
+    var rate = 0;
+
+    if (elapsed > 0) {
+        rate = (iterations * 1000) / elapsed;
+    }
+
+    Core.print("%-16s %10d calls %10d us %8d calls/ms" %
+               [name, iterations, elapsed, rate]);
+
+    return;
+}
+
+//
+// Run the benchmarks now that all the functions are defined.
+//
+
+main();
+
@@ -89,6 +89,7 @@ const CK_API_TYPE CkApiObjectTypes[CkObjectTypeCount] = {
     CkTypeData,     // CkObjectForeign
     CkTypeObject,   // CkObjectFunction
     CkTypeObject,   // CkObjectInstance
+    CkTypeInteger,  // CkObjectInteger
     CkTypeList,     // CkObjectList
     CkTypeObject,   // CkObjectModule
     CkTypeObject,   // CkObjectRange
@@ -680,27 +681,22 @@ Return Value:
     PCK_VALUE Value;
 
     Value = CkpGetStackIndex(Vm, StackIndex);
-    switch (Value->Type) {
-    case CkValueNull:
+    if (CK_IS_NULL(*Value)) {
         return CkTypeNull;
 
-    case CkValueInteger:
+    } else if (CK_IS_SMALL_INTEGER(*Value)) {
         return CkTypeInteger;
 
-    case CkValueObject:
+    } else if (CK_IS_OBJECT(*Value)) {
         Object = CK_AS_OBJECT(*Value);
 
         CK_ASSERT(Object->Type < CkObjectTypeCount);
 
         return CkApiObjectTypes[Object->Type];
-
-    default:
-
-        CK_ASSERT(FALSE);
-
-        break;
     }
 
+    CK_ASSERT(FALSE);
+
     return CkTypeInvalid;
 }
 
@@ -772,7 +768,7 @@ Return Value:
 
     CK_ASSERT(CK_CAN_PUSH(Fiber, 1));
 
-    CK_INT_VALUE(Value, Integer);
+    Value = CkpIntegerCreate(Vm, Integer);
     CK_PUSH(Fiber, Value);
     return;
 }
@@ -1531,7 +1527,7 @@ Return Value:
     //
 
     while (Index < Dict->Capacity) {
-        if (!CK_IS_UNDEFINED(Dict->Entries[Index].Key)) {
+        if (Dict->Hashes[Index] != 0) {
             CK_INT_VALUE(*Iterator, Index);
             CK_PUSH(Fiber, Dict->Entries[Index].Key);
             CK_PUSH(Fiber, Dict->Entries[Index].Value);
@@ -1709,7 +1705,9 @@ Return Value:
     List = CK_AS_LIST(*ListValue);
     Value = *(Fiber->StackTop - 1);
     if (ListIndex == List->Elements.Count) {
+        Index = List->Elements.Count;
         CkpArrayAppend(Vm, &(List->Elements), Value);
+        CK_LIST_WRITE_BARRIER(Vm, List, Index);
 
     } else if ((ListIndex < List->Elements.Count) ||
                (-ListIndex <= (INTN)List->Elements.Count)) {
@@ -1720,6 +1718,7 @@ Return Value:
         CK_ASSERT(Index < List->Elements.Count);
 
         List->Elements.Data[Index] = Value;
+        CK_LIST_WRITE_BARRIER(Vm, List, Index);
     }
 
     Fiber->StackTop -= 1;
@@ -2083,6 +2082,7 @@ Return Value:
         goto BindMethodEnd;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Class->Module->Header));
     NameValue = Class->Module->Strings.List.Data[Symbol];
     CkpBindMethod(Vm, Class, NameValue, Closure);
 
@@ -2169,6 +2169,7 @@ Return Value:
 {
 
     PCK_FIBER Fiber;
+    PCK_OBJECT Receiver;
     PCK_VALUE Value;
 
     Fiber = Vm->Fiber;
@@ -2182,6 +2183,8 @@ Return Value:
     }
 
     *Value = CK_POP(Fiber);
+    Receiver = CK_AS_OBJECT(Fiber->Frames[Fiber->FrameCount - 1].StackStart[0]);
+    CK_WRITE_BARRIER(Vm, Receiver);
     return;
 }
 
@@ -2297,6 +2300,7 @@ Return Value:
     Value = CkpFindModuleVariable(Vm, Module, Name, TRUE);
     if (Value != NULL) {
         *Value = CK_POP(Fiber);
+        CK_WRITE_BARRIER(Vm, &(Module->Header));
 
     } else {
         Fiber->StackTop -= 1;
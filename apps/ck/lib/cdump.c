@@ -49,7 +49,7 @@ Module Name:
 // Define the current freeze file format version.
 //
 
-#define CK_FREEZE_VERSION 1
+#define CK_FREEZE_VERSION 2
 
 //
 // ------------------------------------------------------ Data Type Definitions
@@ -111,6 +111,12 @@ CkpFreezeFunction (
     PCK_FUNCTION Function
     );
 
+BOOL
+CkpThawHeader (
+    PCSTR *Contents,
+    PUINTN Size
+    );
+
 PCSTR
 CkpThawElement (
     PCSTR *Contents,
@@ -165,6 +171,7 @@ BOOL
 CkpThawList (
     PCK_VM Vm,
     PCK_MODULE Module,
+    PCK_OBJECT Owner,
     PCSTR *Contents,
     PUINTN Size,
     PCK_VALUE_ARRAY List
@@ -347,50 +354,13 @@ Return Value:
 
     PCK_MODULE CoreModule;
     CK_INTEGER CoreVariableCount;
-    CK_INTEGER Integer;
-    INT Match;
     PCSTR Name;
     UINTN NameSize;
     BOOL Result;
     PCK_STRING String;
 
     CoreVariableCount = 0;
-    if (Size < sizeof(CkModuleFreezeSignature)) {
-        return FALSE;
-    }
-
-    Match = CkCompareMemory(Contents,
-                            CkModuleFreezeSignature,
-                            sizeof(CkModuleFreezeSignature));
-
-    if (Match != 0) {
-        return FALSE;
-    }
-
-    Contents += sizeof(CkModuleFreezeSignature);
-    Size -= sizeof(CkModuleFreezeSignature);
-    if ((Size < 1) || (*Contents != '{')) {
-        return FALSE;
-    }
-
-    Contents += 1;
-    Size -= 1;
-
-    //
-    // Version needs to be first.
-    //
-
-    Name = CkpThawElement(&Contents, &Size, &NameSize);
-    if ((Name == NULL) ||
-        (NameSize != 7) ||
-        (CkCompareMemory(Name, "Version", 7) != 0)) {
-
-        return FALSE;
-    }
-
-    if ((!CkpThawInteger(&Contents, &Size, &Integer)) ||
-        (Integer != CK_FREEZE_VERSION)) {
-
+    if (CkpThawHeader(&Contents, &Size) == FALSE) {
         return FALSE;
     }
 
@@ -470,10 +440,13 @@ Return Value:
                                     &Size,
                                     &(Module->Closure));
 
+            CK_WRITE_BARRIER(Vm, &(Module->Header));
+
         } else if ((NameSize == 4) &&
                    (CkCompareMemory(Name, "Path", 4) == 0)) {
 
             Module->Path = CkpThawString(Vm, &Contents, &Size);
+            CK_WRITE_BARRIER(Vm, &(Module->Header));
 
         } else if ((NameSize == 17) &&
                    (CkCompareMemory(Name, "CoreVariableCount", 17) == 0)) {
@@ -511,6 +484,40 @@ Return Value:
     return Result;
 }
 
+BOOL
+CkpModuleIsFrozenCurrent (
+    PCSTR Contents,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the given contents are a frozen module
+    written in the current freeze format. Objects left behind by a different
+    version of Chalk cannot be thawed.
+
+Arguments:
+
+    Contents - Supplies the frozen module contents.
+
+    Size - Supplies the frozen module size in bytes.
+
+Return Value:
+
+    TRUE if the contents are a frozen module of the current version.
+
+    FALSE if the contents are not a frozen module, or are from a different
+    version.
+
+--*/
+
+{
+
+    return CkpThawHeader(&Contents, &Size);
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -547,16 +554,13 @@ Return Value:
 
     PCK_OBJECT Object;
 
-    switch (Value.Type) {
-    case CkValueNull:
+    if (CK_IS_NULL(Value)) {
         CkpFreezeAdd(Vm, String, "null", 4);
-        break;
 
-    case CkValueInteger:
+    } else if (CK_IS_INTEGER(Value)) {
         CkpFreezeInteger(Vm, String, CK_AS_INTEGER(Value));
-        break;
 
-    case CkValueObject:
+    } else if (CK_IS_OBJECT(Value)) {
         Object = CK_AS_OBJECT(Value);
         switch (Object->Type) {
         case CkObjectString:
@@ -574,13 +578,9 @@ Return Value:
             break;
         }
 
-        break;
-
-    default:
+    } else {
 
         CK_ASSERT(FALSE);
-
-        break;
     }
 
     return;
@@ -845,6 +845,8 @@ Return Value:
     CkpFreezeInteger(Vm, String, Function->MaxStack);
     CkpFreezeAdd(Vm, String, "\nUpvalueCount: ", 15);
     CkpFreezeInteger(Vm, String, Function->UpvalueCount);
+    CkpFreezeAdd(Vm, String, "\nCallSites: ", 12);
+    CkpFreezeInteger(Vm, String, Function->CallSiteCount);
     CkpFreezeAdd(Vm, String, "\nArity: ", 8);
     CkpFreezeInteger(Vm, String, Function->Arity);
     CkpFreezeAdd(Vm, String, "\nName: ", 7);
@@ -861,6 +863,88 @@ Return Value:
     return;
 }
 
+BOOL
+CkpThawHeader (
+    PCSTR *Contents,
+    PUINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine thaws the signature and version at the start of a frozen
+    module.
+
+Arguments:
+
+    Contents - Supplies a pointer that on input contains the frozen module
+        contents. On output, this will be advanced past the header.
+
+    Size - Supplies a pointer that on input contains the remaining size of the
+        contents. This will be updated on output.
+
+Return Value:
+
+    TRUE if the header is valid and matches the current freeze version.
+
+    FALSE if the header is invalid or from a different version.
+
+--*/
+
+{
+
+    PCSTR Buffer;
+    CK_INTEGER Integer;
+    PCSTR Name;
+    UINTN NameSize;
+    UINTN Remaining;
+
+    Buffer = *Contents;
+    Remaining = *Size;
+    if (Remaining < sizeof(CkModuleFreezeSignature)) {
+        return FALSE;
+    }
+
+    if (CkCompareMemory(Buffer,
+                        CkModuleFreezeSignature,
+                        sizeof(CkModuleFreezeSignature)) != 0) {
+
+        return FALSE;
+    }
+
+    Buffer += sizeof(CkModuleFreezeSignature);
+    Remaining -= sizeof(CkModuleFreezeSignature);
+    if ((Remaining < 1) || (*Buffer != '{')) {
+        return FALSE;
+    }
+
+    Buffer += 1;
+    Remaining -= 1;
+
+    //
+    // Version needs to be first.
+    //
+
+    Name = CkpThawElement(&Buffer, &Remaining, &NameSize);
+    if ((Name == NULL) ||
+        (NameSize != 7) ||
+        (CkCompareMemory(Name, "Version", 7) != 0)) {
+
+        return FALSE;
+    }
+
+    if ((!CkpThawInteger(&Buffer, &Remaining, &Integer)) ||
+        (Integer != CK_FREEZE_VERSION)) {
+
+        return FALSE;
+    }
+
+    *Contents = Buffer;
+    *Size = Remaining;
+    return TRUE;
+}
+
 PCSTR
 CkpThawElement (
     PCSTR *Contents,
@@ -1017,7 +1101,10 @@ Return Value:
     case 'i':
         Result = CkpThawInteger(Contents, Size, &Integer);
         if (Result != FALSE) {
-            CK_INT_VALUE(*Value, Integer);
+            *Value = CkpIntegerCreate(Vm, Integer);
+            if (CK_IS_NULL(*Value)) {
+                Result = FALSE;
+            }
         }
 
         break;
@@ -1184,6 +1271,8 @@ Return Value:
         return FALSE;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Module->Header));
+
     CkpPopRoot(Vm);
     Result = TRUE;
     *Contents += 2;
@@ -1202,6 +1291,7 @@ Return Value:
 
             Result = CkpThawList(Vm,
                                  Module,
+                                 &(Function->Header),
                                  Contents,
                                  Size,
                                  &(Function->Constants));
@@ -1218,6 +1308,12 @@ Return Value:
             Result = CkpThawInteger(Contents, Size, &Integer);
             Function->UpvalueCount = Integer;
 
+        } else if ((NameSize == 9) &&
+                   (CkCompareMemory(Name, "CallSites", 9) == 0)) {
+
+            Result = CkpThawInteger(Contents, Size, &Integer);
+            Function->CallSiteCount = Integer;
+
         } else if ((NameSize == 5) &&
                    (CkCompareMemory(Name, "Arity", 5) == 0)) {
 
@@ -1232,6 +1328,8 @@ Return Value:
                 Result = FALSE;
             }
 
+            CK_WRITE_BARRIER(Vm, &(Function->Header));
+
         } else if ((NameSize == 9) &&
                    (CkCompareMemory(Name, "FirstLine", 9) == 0)) {
 
@@ -1372,22 +1470,37 @@ Return Value:
 {
 
     UINTN Index;
+    CK_VALUE Key;
     UINTN StartIndex;
     CK_VALUE Value;
 
     StartIndex = Table->List.Count;
-    if (!CkpThawList(Vm, Module, Contents, Size, &(Table->List))) {
+    if (!CkpThawList(Vm,
+                     Module,
+                     &(Module->Header),
+                     Contents,
+                     Size,
+                     &(Table->List))) {
+
         return FALSE;
     }
 
     //
     // Also insert all the elements in the list into the dictionary in case
-    // more compilation occurs.
+    // more compilation occurs. Swap in the canonical copy of each string so
+    // that the list holds the same key object that the dictionary stores.
     //
 
     for (Index = StartIndex; Index < Table->List.Count; Index += 1) {
+        Key = Table->List.Data[Index];
+        if (CK_IS_STRING(Key)) {
+            CK_OBJECT_VALUE(Key, CkpStringIntern(Vm, CK_AS_STRING(Key)));
+            Table->List.Data[Index] = Key;
+            CK_WRITE_BARRIER(Vm, &(Module->Header));
+        }
+
         CK_INT_VALUE(Value, Index);
-        CkpDictSet(Vm, Table->Dict, Table->List.Data[Index], Value);
+        CkpDictSet(Vm, Table->Dict, Key, Value);
     }
 
     if (Table->Dict->Count != Table->List.Count) {
@@ -1401,6 +1514,7 @@ BOOL
 CkpThawList (
     PCK_VM Vm,
     PCK_MODULE Module,
+    PCK_OBJECT Owner,
     PCSTR *Contents,
     PUINTN Size,
     PCK_VALUE_ARRAY List
@@ -1418,6 +1532,8 @@ Routine Description:
 
     Module - Supplies a pointer to the module being thawed.
 
+    Owner - Supplies a pointer to the object containing the list.
+
     Contents - Supplies a pointer that on input points to the element to read.
         This is updated on output.
 
@@ -1473,6 +1589,7 @@ Return Value:
         //
 
         CkpArrayAppend(Vm, List, Value);
+        CK_WRITE_BARRIER(Vm, Owner);
         if (Index != Count - 1) {
             if ((*Size <= 2) || (**Contents != ',')) {
                 return FALSE;
@@ -64,6 +64,13 @@ Module Name:
 
 #define CK_MAX_JUMP 0x10000
 
+//
+// Define the maximum number of method call sites in a single function. The
+// call site index is stored as a two byte instruction argument.
+//
+
+#define CK_MAX_CALL_SITES 0x10000
+
 //
 // Define the compiler flags.
 //
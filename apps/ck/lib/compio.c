@@ -56,6 +56,11 @@ CkpGetInstructionSize (
     UINTN Ip
     );
 
+VOID
+CkpEmitCallSite (
+    PCK_COMPILER Compiler
+    );
+
 VOID
 CkpEmitLineNumberInformation (
     PCK_COMPILER Compiler,
@@ -204,16 +209,16 @@ UCHAR CkCompilerOperandSizes[CkOpcodeCount] = {
     1, // CkOpLoadField
     1, // CkOpStoreField
     0, // CkOpPop
-    2, // CkOpCall0
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2,
-    2, // CkOpCall8
-    3, // CkOpCall
+    4, // CkOpCall0
+    4,
+    4,
+    4,
+    4,
+    4,
+    4,
+    4,
+    4, // CkOpCall8
+    5, // CkOpCall
     1, // CkOpIndirectCall
     4, // CkOpSuperCall0
     4,
@@ -649,6 +654,7 @@ Return Value:
     Symbol = CkpGetSignatureSymbol(Compiler, Signature);
     if (Signature->Arity <= 8) {
         CkpEmitShortOp(Compiler, Op + Signature->Arity, Symbol);
+        CkpEmitCallSite(Compiler);
 
     } else {
         if (Op == CkOpCall0) {
@@ -666,6 +672,7 @@ Return Value:
         Compiler->StackSlots -= Signature->Arity;
         CkpEmitByteOp(Compiler, Op, Signature->Arity);
         CkpEmitShort(Compiler, Symbol);
+        CkpEmitCallSite(Compiler);
     }
 
     return;
@@ -713,6 +720,7 @@ Return Value:
     Symbol = CkpGetMethodSymbol(Compiler, Name, Length);
     if (ArgumentCount <= 8) {
         CkpEmitShortOp(Compiler, CkOpCall0 + ArgumentCount, Symbol);
+        CkpEmitCallSite(Compiler);
 
     } else {
         if (ArgumentCount >= MAX_UCHAR) {
@@ -722,6 +730,7 @@ Return Value:
 
         CkpEmitByteOp(Compiler, CkOpCall, ArgumentCount);
         CkpEmitShort(Compiler, Symbol);
+        CkpEmitCallSite(Compiler);
 
         //
         // Manually track the stack usage since the instruction itself doesn't
@@ -1209,7 +1218,12 @@ Return Value:
         CkpCompileError(Compiler, Token, "Integer too large");
     }
 
-    CK_INT_VALUE(CkValue, Value);
+    CkValue = CkpIntegerCreate(Compiler->Parser->Vm, Value);
+    if (CK_IS_NULL(CkValue)) {
+        CkpCompileError(Compiler, Token, "Allocation failure");
+        return CK_ZERO_VALUE;
+    }
+
     return CkValue;
 }
 
@@ -1378,6 +1392,43 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+VOID
+CkpEmitCallSite (
+    PCK_COMPILER Compiler
+    )
+
+/*++
+
+Routine Description:
+
+    This routine emits the call site index that follows the symbol of a call
+    instruction, and reserves an inline cache slot for it in the function.
+
+Arguments:
+
+    Compiler - Supplies a pointer to the compiler.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PCK_FUNCTION Function;
+
+    Function = Compiler->Function;
+    if (Function->CallSiteCount >= CK_MAX_CALL_SITES) {
+        CkpCompileError(Compiler, NULL, "Too many method calls in function");
+        return;
+    }
+
+    CkpEmitShort(Compiler, Function->CallSiteCount);
+    Function->CallSiteCount += 1;
+    return;
+}
+
 UINTN
 CkpGetInstructionSize (
     PUCHAR ByteCode,
@@ -261,6 +261,9 @@ Return Value:
                                   Name,
                                   Length);
 
+    CK_WRITE_BARRIER(Compiler->Parser->Vm,
+                     &(Compiler->Function->Module->Header));
+
     return Symbol;
 }
 
@@ -883,6 +886,9 @@ Return Value:
                        &(Compiler->Function->Constants),
                        Constant);
 
+        CK_WRITE_BARRIER(Compiler->Parser->Vm,
+                         &(Compiler->Function->Header));
+
         if (CK_IS_OBJECT(Constant)) {
             CkpPopRoot(Compiler->Parser->Vm);
         }
@@ -935,6 +941,9 @@ Return Value:
                                       &(Compiler->Function->Module->Strings),
                                       Constant);
 
+    CK_WRITE_BARRIER(Compiler->Parser->Vm,
+                     &(Compiler->Function->Module->Header));
+
     if (Index >= CK_MAX_CONSTANTS) {
         CkpCompileError(Compiler, NULL, "Too many string constants");
         Index = -1;
@@ -318,6 +318,7 @@ Return Value:
     CK_ERROR_TYPE Error;
     PCK_OBJECT Object;
     PCK_CLASS ObjectMeta;
+    ULONG Pass;
     UINTN Size;
     CK_VALUE Value;
 
@@ -373,6 +374,9 @@ Return Value:
     Classes->Object->Header.Class = ObjectMeta;
     ObjectMeta->Header.Class = Classes->Class;
     Classes->Class->Header.Class = Classes->Class;
+    CK_WRITE_BARRIER(Vm, &(Classes->Object->Header));
+    CK_WRITE_BARRIER(Vm, &(ObjectMeta->Header));
+    CK_WRITE_BARRIER(Vm, &(Classes->Class->Header));
     CkpBindSuperclass(Vm, ObjectMeta, Classes->Class);
 
     //
@@ -440,28 +444,37 @@ Return Value:
 
     //
     // Patch up any of the core objects that may have been created before their
-    // associated classes existed.
+    // associated classes existed. Some of them may already have been promoted
+    // to the old generation.
     //
 
-    Object = Vm->FirstObject;
-    while (Object != NULL) {
-        if (Object->Type == CkObjectString) {
-            Object->Class = Classes->String;
+    for (Pass = 0; Pass < 2; Pass += 1) {
+        Object = Vm->FirstObject;
+        if (Pass != 0) {
+            Object = Vm->OldObjects;
+        }
 
-        } else if (Object->Type == CkObjectClosure) {
-            Object->Class = Classes->Function;
+        while (Object != NULL) {
+            if (Object->Type == CkObjectString) {
+                Object->Class = Classes->String;
 
-        } else if (Object->Type == CkObjectDict) {
-            Object->Class = Classes->Dict;
+            } else if (Object->Type == CkObjectClosure) {
+                Object->Class = Classes->Function;
 
-        } else if (Object->Type == CkObjectFiber) {
-            Object->Class = Classes->Fiber;
-        }
+            } else if (Object->Type == CkObjectDict) {
+                Object->Class = Classes->Dict;
+
+            } else if (Object->Type == CkObjectFiber) {
+                Object->Class = Classes->Fiber;
+            }
 
-        Object = Object->Next;
+            CK_WRITE_BARRIER(Vm, Object);
+            Object = Object->Next;
+        }
     }
 
     CoreModule->Header.Class = Classes->Module;
+    CK_WRITE_BARRIER(Vm, &(CoreModule->Header));
 
     //
     // Set some flags on the special builtin classes.
@@ -782,6 +795,8 @@ Return Value:
         return;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Module->Header));
+
     NameString = Module->Strings.List.Data[Index];
     Closure = CkpClosureCreatePrimitive(Vm,
                                         Function,
@@ -1177,6 +1192,7 @@ Return Value:
         }
 
         CK_OBJECT_VALUE(Instance->Fields[0], Dict);
+        CK_WRITE_BARRIER(Vm, &(Instance->Header));
 
     } else {
         Dict = CK_AS_DICT(Instance->Fields[0]);
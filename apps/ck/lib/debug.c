@@ -147,6 +147,7 @@ PSTR CkObjectTypeNames[CkObjectTypeCount] = {
     "Foreign",
     "Function",
     "Instance",
+    "Integer",
     "List",
     "Module",
     "Range",
@@ -518,6 +519,12 @@ Return Value:
                      CK_AS_STRING(Function->Module->Strings.List.Data[Symbol]);
 
         CkpDebugPrint(Vm, "%s", StringObject->Value);
+        if ((Op != CkOpMethod) && (Op != CkOpStaticMethod)) {
+            Symbol = CK_READ16(ByteCode + Offset);
+            Offset += 2;
+            CkpDebugPrint(Vm, " #%d", Symbol);
+        }
+
         break;
 
     case CkOpIndirectCall:
@@ -754,25 +761,20 @@ Return Value:
 
 {
 
-    switch (Value.Type) {
-    case CkValueNull:
+    if (CK_IS_NULL(Value)) {
         CkpDebugPrint(Vm, "null");
-        break;
 
-    case CkValueInteger:
+    } else if (CK_IS_INTEGER(Value)) {
         CkpDebugPrint(Vm, "%lld", CK_AS_INTEGER(Value));
-        break;
 
-    case CkValueObject:
+    } else if (CK_IS_OBJECT(Value)) {
         CkpDumpObject(Vm, CK_AS_OBJECT(Value));
-        break;
 
-    default:
+    } else {
 
         CK_ASSERT(FALSE);
 
         CkpDebugPrint(Vm, "<invalid object>");
-        break;
     }
 
     return;
@@ -829,6 +831,10 @@ Return Value:
         CkpDebugPrint(Vm, "\"%s\"", ((PCK_STRING)Object)->Value);
         break;
 
+    case CkObjectInteger:
+        CkpDebugPrint(Vm, "%lld", ((PCK_BOXED_INTEGER)Object)->Value);
+        break;
+
     case CkObjectClass:
         Class = (PCK_CLASS)Object;
         CkpDebugPrint(Vm, "Class(");
@@ -62,6 +62,21 @@ Module Name:
 
 #define DICT_MIN_CAPACITY 16
 
+//
+// Define the bit set in every stored hash, so that a stored hash of zero can
+// mark an empty slot.
+//
+
+#define DICT_HASH_OCCUPIED 0x80000000
+
+//
+// This macro returns the distance the entry at the given slot is from its
+// ideal slot, given its stored hash and the capacity mask.
+//
+
+#define DICT_DISTANCE(_Hash, _Slot, _Mask) \
+    (((_Slot) - ((_Hash) & (_Mask))) & (_Mask))
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -158,11 +173,19 @@ CkpDictResize (
 BOOL
 CkpDictAddEntry (
     PCK_DICT_ENTRY Entries,
+    PULONG Hashes,
     UINTN Capacity,
+    ULONG Hash,
     CK_VALUE Key,
     CK_VALUE Value
     );
 
+VOID
+CkpDictRemoveEntry (
+    PCK_DICT Dict,
+    UINTN Slot
+    );
+
 ULONG
 CkpHashValue (
     CK_VALUE Value
@@ -235,6 +258,7 @@ Return Value:
     Dict->Count = 0;
     Dict->Capacity = 0;
     Dict->Entries = NULL;
+    Dict->Hashes = NULL;
     return Dict;
 }
 
@@ -308,8 +332,19 @@ Return Value:
 
 {
 
+    PCK_DICT_ENTRY Entry;
+    ULONG Hash;
     UINTN NewCapacity;
 
+    //
+    // Canonicalize string keys through the intern table so that later
+    // lookups with interned strings usually match on the pointer alone.
+    //
+
+    if (CK_IS_STRING(Key)) {
+        CK_OBJECT_VALUE(Key, CkpStringIntern(Vm, CK_AS_STRING(Key)));
+    }
+
     if ((Dict->Count + 1) > (Dict->Capacity * DICT_LOAD_FACTOR / 1024)) {
         NewCapacity = Dict->Capacity * DICT_GROW_FACTOR;
         if (NewCapacity < DICT_MIN_CAPACITY) {
@@ -334,10 +369,34 @@ Return Value:
         }
     }
 
-    if (CkpDictAddEntry(Dict->Entries, Dict->Capacity, Key, Value) != FALSE) {
-        Dict->Count += 1;
+    //
+    // If the dictionary is completely full because growing it failed, only
+    // replace existing entries. Robin Hood insertion into a full table would
+    // push some other entry out.
+    //
+
+    if (Dict->Count == Dict->Capacity) {
+        Entry = CkpDictFindEntry(Dict, Key);
+        if (Entry == NULL) {
+            return;
+        }
+
+        Entry->Value = Value;
+
+    } else {
+        Hash = CkpHashValue(Key) | DICT_HASH_OCCUPIED;
+        if (CkpDictAddEntry(Dict->Entries,
+                            Dict->Hashes,
+                            Dict->Capacity,
+                            Hash,
+                            Key,
+                            Value) != FALSE) {
+
+            Dict->Count += 1;
+        }
     }
 
+    CK_WRITE_BARRIER(Vm, &(Dict->Header));
     return;
 }
 
@@ -380,17 +439,8 @@ Return Value:
         return CK_NULL_VALUE;
     }
 
-    //
-    // Remove the entry from the dictionary. Set it to true, which marks it as
-    // a deleted slot (as opposed to an empty slot). When searching for a key,
-    // the search must continue through a deleted slot, but can stop if an
-    // empty slot is found.
-    //
-
     Value = Entry->Value;
-    Entry->Key = CK_UNDEFINED_VALUE;
-    Entry->Value = CK_TRUE_VALUE;
-    Dict->Count -= 1;
+    CkpDictRemoveEntry(Dict, Entry - Dict->Entries);
     if ((Dict->Capacity > DICT_MIN_CAPACITY) &&
         (Dict->Count <
          (Dict->Capacity / DICT_SHRINK_FACTOR * DICT_LOAD_FACTOR / 1024))) {
@@ -448,6 +498,10 @@ Return Value:
 
 {
 
+    if (Dict->Hashes != NULL) {
+        CkZero(Dict->Hashes, Dict->Capacity * sizeof(ULONG));
+    }
+
     Dict->Count = 0;
     return;
 }
@@ -488,13 +542,11 @@ Return Value:
 
     CK_ASSERT(Source != Destination);
 
-    Entry = Source->Entries;
     for (Index = 0; Index < Source->Capacity; Index += 1) {
-        if (!CK_IS_UNDEFINED(Entry->Key)) {
+        if (Source->Hashes[Index] != 0) {
+            Entry = &(Source->Entries[Index]);
             CkpDictSet(Vm, Destination, Entry->Key, Entry->Value);
         }
-
-        Entry += 1;
     }
 
     return;
@@ -845,7 +897,6 @@ Return Value:
 {
 
     PCK_DICT Dict;
-    PCK_DICT_ENTRY Entry;
     UINTN Index;
     PCK_LIST List;
     UINTN ListIndex;
@@ -861,14 +912,11 @@ Return Value:
     //
 
     ListIndex = 0;
-    Entry = Dict->Entries;
     for (Index = 0; Index < Dict->Capacity; Index += 1) {
-        if (!CK_IS_UNDEFINED(Entry->Key)) {
-            List->Elements.Data[ListIndex] = Entry->Key;
+        if (Dict->Hashes[Index] != 0) {
+            List->Elements.Data[ListIndex] = Dict->Entries[Index].Key;
             ListIndex += 1;
         }
-
-        Entry += 1;
     }
 
     CK_ASSERT(ListIndex == Dict->Count);
@@ -937,7 +985,7 @@ Return Value:
     //
 
     while (Index < Dict->Capacity) {
-        if (!CK_IS_UNDEFINED(Dict->Entries[Index].Key)) {
+        if (Dict->Hashes[Index] != 0) {
             CK_INT_VALUE(Arguments[0], Index);
             return TRUE;
         }
@@ -988,12 +1036,13 @@ Return Value:
         return FALSE;
     }
 
-    Entry = &(Dict->Entries[Index]);
-    if (CK_IS_UNDEFINED(Entry->Key)) {
+    if (Dict->Hashes[Index] == 0) {
         CkpRuntimeError(Vm, "LookupError", "Dict changed while iterating");
         return FALSE;
     }
 
+    Entry = &(Dict->Entries[Index]);
+
     Arguments[0] = Entry->Key;
     return TRUE;
 }
@@ -1035,14 +1084,24 @@ Return Value:
         return FALSE;
     }
 
-    CkpPushRoot(Vm, &(NewDict->Header));
-    CkpDictResize(Vm, NewDict, Dict->Capacity);
-    if (NewDict->Capacity == Dict->Capacity) {
-        CkCopy(NewDict->Entries,
-               Dict->Entries,
-               sizeof(CK_DICT_ENTRY) * NewDict->Capacity);
+    //
+    // With the same capacity, every entry lands in the same slot, so the
+    // entries and hashes can be copied wholesale. Resizing may have triggered
+    // a collection that aged the new dictionary, so note the write.
+    //
 
-        NewDict->Count = Dict->Count;
+    CkpPushRoot(Vm, &(NewDict->Header));
+    if (Dict->Capacity != 0) {
+        CkpDictResize(Vm, NewDict, Dict->Capacity);
+        if (NewDict->Capacity == Dict->Capacity) {
+            CkCopy(NewDict->Entries,
+                   Dict->Entries,
+                   (sizeof(CK_DICT_ENTRY) + sizeof(ULONG)) *
+                   NewDict->Capacity);
+
+            NewDict->Count = Dict->Count;
+            CK_WRITE_BARRIER(Vm, &(NewDict->Header));
+        }
     }
 
     CkpPopRoot(Vm);
@@ -1083,41 +1142,43 @@ Return Value:
 
 {
 
-    PCK_DICT_ENTRY Entry;
-    UINTN Index;
-    UINTN Loop;
+    UINTN Distance;
+    ULONG Hash;
+    UINTN Mask;
+    UINTN Slot;
+    ULONG SlotHash;
 
     if (Dict->Count == 0) {
         return NULL;
     }
 
-    Index = CkpHashValue(Key) % Dict->Capacity;
+    Hash = CkpHashValue(Key) | DICT_HASH_OCCUPIED;
+    Mask = Dict->Capacity - 1;
+    Slot = Hash & Mask;
 
     //
-    // Loop looking for the entry, using open entry linear search on collision.
-    // Although there should always be empty slots in the dictionary, some
-    // badly timed allocation failures on resize could result in a full dict.
+    // Walk forward from the ideal slot. Entries are kept ordered by their
+    // distance from home, so the search can stop at the first empty slot or
+    // at an entry that is closer to home than the key would be. Only compare
+    // keys whose full hash matches. The loop is bounded in case badly timed
+    // allocation failures left the table full.
     //
 
-    for (Loop = 0; Loop < Dict->Capacity; Loop += 1) {
-        Entry = &(Dict->Entries[Index]);
-        if (CK_IS_UNDEFINED(Entry->Key)) {
-            if (CK_IS_UNDEFINED(Entry->Value)) {
-                break;
-            }
+    for (Distance = 0; Distance < Dict->Capacity; Distance += 1) {
+        SlotHash = Dict->Hashes[Slot];
+        if ((SlotHash == 0) ||
+            (DICT_DISTANCE(SlotHash, Slot, Mask) < Distance)) {
 
-        } else if (CkpAreValuesEqual(Entry->Key, Key) != FALSE) {
-            return Entry;
+            break;
         }
 
-        //
-        // Move to the next address linearly. Avoid the divide.
-        //
+        if ((SlotHash == Hash) &&
+            (CkpAreValuesEqual(Dict->Entries[Slot].Key, Key) != FALSE)) {
 
-        Index += 1;
-        if (Index == Dict->Capacity) {
-            Index = 0;
+            return &(Dict->Entries[Slot]);
         }
+
+        Slot = (Slot + 1) & Mask;
     }
 
     return NULL;
@@ -1142,7 +1203,8 @@ Routine Description:
 
     Dict - Supplies a pointer to the dictionary to resize.
 
-    NewCapacity - Supplies the new capacity of the dictionary.
+    NewCapacity - Supplies the new capacity of the dictionary, which must be a
+        power of two.
 
 Return Value:
 
@@ -1154,35 +1216,41 @@ Return Value:
 
     UINTN Index;
     PCK_DICT_ENTRY NewEntries;
+    PULONG NewHashes;
     PCK_DICT_ENTRY OldEntry;
 
     CK_ASSERT(NewCapacity >= Dict->Count);
+    CK_ASSERT((NewCapacity != 0) && ((NewCapacity & (NewCapacity - 1)) == 0));
+
+    //
+    // The hashes live in the same allocation, right after the entries.
+    //
+
+    NewEntries = CkAllocate(Vm,
+                            NewCapacity *
+                            (sizeof(CK_DICT_ENTRY) + sizeof(ULONG)));
 
-    NewEntries = CkAllocate(Vm, NewCapacity * sizeof(CK_DICT_ENTRY));
     if (NewEntries == NULL) {
         return;
     }
 
-    //
-    // Zero the entries, which also happens to set all the keys to undefined.
-    //
-
-    CkZero(NewEntries, NewCapacity * sizeof(CK_DICT_ENTRY));
+    NewHashes = (PULONG)(NewEntries + NewCapacity);
+    CkZero(NewHashes, NewCapacity * sizeof(ULONG));
 
     //
-    // Re-add all the old entries.
+    // Re-add all the old entries, reusing their saved hashes.
     //
 
-    OldEntry = Dict->Entries;
     for (Index = 0; Index < Dict->Capacity; Index += 1) {
-        if (!CK_IS_UNDEFINED(OldEntry->Key)) {
+        if (Dict->Hashes[Index] != 0) {
+            OldEntry = &(Dict->Entries[Index]);
             CkpDictAddEntry(NewEntries,
+                            NewHashes,
                             NewCapacity,
+                            Dict->Hashes[Index],
                             OldEntry->Key,
                             OldEntry->Value);
         }
-
-        OldEntry += 1;
     }
 
     //
@@ -1194,6 +1262,7 @@ Return Value:
     }
 
     Dict->Entries = NewEntries;
+    Dict->Hashes = NewHashes;
     Dict->Capacity = NewCapacity;
     return;
 }
@@ -1201,7 +1270,9 @@ Return Value:
 BOOL
 CkpDictAddEntry (
     PCK_DICT_ENTRY Entries,
+    PULONG Hashes,
     UINTN Capacity,
+    ULONG Hash,
     CK_VALUE Key,
     CK_VALUE Value
     )
@@ -1210,14 +1281,20 @@ CkpDictAddEntry (
 
 Routine Description:
 
-    This routine sets the value for the given key in a dictionary.
+    This routine sets the value for the given key in a dictionary. Entries
+    further from their ideal slot take over slots from entries closer to
+    theirs as the probe goes along, which keeps probe lengths even.
 
 Arguments:
 
     Entries - Supplies a pointer to the entries array.
 
+    Hashes - Supplies a pointer to the stored hash array.
+
     Capacity - Supplies the size of the entries array.
 
+    Hash - Supplies the hash of the key, with the occupied bit set.
+
     Key - Supplies the key to set the value for.
 
     Value - Supplies the value to set.
@@ -1232,11 +1309,20 @@ Return Value:
 
 {
 
+    BOOL Displaced;
+    UINTN Distance;
     PCK_DICT_ENTRY Entry;
-    UINTN Index;
+    UINTN ExistingDistance;
     UINTN Loop;
+    UINTN Mask;
+    UINTN Slot;
+    ULONG SlotHash;
+    CK_DICT_ENTRY Swap;
 
-    Index = CkpHashValue(Key) % Capacity;
+    Mask = Capacity - 1;
+    Slot = Hash & Mask;
+    Distance = 0;
+    Displaced = FALSE;
 
     //
     // Don't do this infinitely in the case that all recent resize attempts
@@ -1244,21 +1330,43 @@ Return Value:
     //
 
     for (Loop = 0; Loop < Capacity; Loop += 1) {
-        Entry = Entries + Index;
-        if (CK_IS_UNDEFINED(Entry->Key)) {
+        Entry = Entries + Slot;
+        SlotHash = Hashes[Slot];
+        if (SlotHash == 0) {
+            Hashes[Slot] = Hash;
             Entry->Key = Key;
             Entry->Value = Value;
             return TRUE;
+        }
+
+        //
+        // Once the original key has taken a slot, the entry being carried is
+        // one that was already in the table, so it can't match anything.
+        //
+
+        if ((Displaced == FALSE) &&
+            (SlotHash == Hash) &&
+            (CkpAreValuesEqual(Entry->Key, Key) != FALSE)) {
 
-        } else if (CkpAreValuesEqual(Entry->Key, Key) != FALSE) {
             Entry->Value = Value;
             return FALSE;
         }
 
-        Index += 1;
-        if (Index == Capacity) {
-            Index = 0;
+        ExistingDistance = DICT_DISTANCE(SlotHash, Slot, Mask);
+        if (ExistingDistance < Distance) {
+            Hashes[Slot] = Hash;
+            Hash = SlotHash;
+            Swap = *Entry;
+            Entry->Key = Key;
+            Entry->Value = Value;
+            Key = Swap.Key;
+            Value = Swap.Value;
+            Distance = ExistingDistance;
+            Displaced = TRUE;
         }
+
+        Slot = (Slot + 1) & Mask;
+        Distance += 1;
     }
 
     //
@@ -1269,6 +1377,59 @@ Return Value:
     return FALSE;
 }
 
+VOID
+CkpDictRemoveEntry (
+    PCK_DICT Dict,
+    UINTN Slot
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes the entry at the given slot from a dictionary. The
+    entries after it are shifted back until one is found that is already in
+    its ideal slot, so no deleted markers are ever needed.
+
+Arguments:
+
+    Dict - Supplies a pointer to the dictionary.
+
+    Slot - Supplies the index of the occupied slot to remove.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Mask;
+    UINTN Next;
+    ULONG NextHash;
+
+    CK_ASSERT(Dict->Hashes[Slot] != 0);
+
+    Mask = Dict->Capacity - 1;
+    Next = (Slot + 1) & Mask;
+    while (TRUE) {
+        NextHash = Dict->Hashes[Next];
+        if ((NextHash == 0) || (DICT_DISTANCE(NextHash, Next, Mask) == 0)) {
+            break;
+        }
+
+        Dict->Hashes[Slot] = NextHash;
+        Dict->Entries[Slot] = Dict->Entries[Next];
+        Slot = Next;
+        Next = (Next + 1) & Mask;
+    }
+
+    Dict->Hashes[Slot] = 0;
+    Dict->Count -= 1;
+    return;
+}
+
 ULONG
 CkpHashValue (
     CK_VALUE Value
@@ -1292,23 +1453,21 @@ Return Value:
 
 {
 
-    switch (Value.Type) {
-    case CkValueNull:
+    if (CK_IS_NULL(Value)) {
         return 0;
 
     //
     // Just truncate the 64 bit value to 32 bits. XORing the two halves is a
     // possibility, but 1) is more work, and 2) causes -1ULL to alias with 0.
+    // Boxed integers hash by value so they match any other box of the same
+    // integer.
     //
 
-    case CkValueInteger:
+    } else if (CK_IS_INTEGER(Value)) {
         return (ULONG)(CK_AS_INTEGER(Value));
 
-    case CkValueObject:
+    } else if (CK_IS_OBJECT(Value)) {
         return CkpHashObject(CK_AS_OBJECT(Value));
-
-    default:
-        break;
     }
 
     return 0;
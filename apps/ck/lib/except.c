@@ -252,6 +252,7 @@ Return Value:
             Fiber->Error = Exception;
             Fiber->FrameCount = 0;
             Fiber->StackTop = Fiber->Stack;
+            CK_WRITE_BARRIER(Vm, &(Fiber->Header));
             Fiber = Fiber->Caller;
             if (Fiber == NULL) {
                 break;
@@ -293,6 +294,7 @@ Return Value:
                          "Exceptions cannot be raised across foreign "
                          "functions");
 
+                CK_WRITE_BARRIER(Vm, &(Fiber->Header));
                 Vm->Fiber = NULL;
                 goto RaiseExceptionEnd;
             }
@@ -386,6 +388,7 @@ Return Value:
                 Fiber->Error = CkNullValue;
                 CkpCallFunction(Vm, Vm->UnhandledException, 2);
                 Fiber->Error = CK_POP(Fiber);
+                CK_WRITE_BARRIER(Vm, &(Fiber->Header));
 
             } else {
                 CkpError(Vm,
@@ -480,6 +483,7 @@ Return Value:
         ArgumentsList->Elements.Data[0] =
                                       CkpStringCreate(Vm, Description, Length);
 
+        CK_LIST_WRITE_BARRIER(Vm, ArgumentsList, 0);
     }
 
     //
@@ -653,6 +657,7 @@ Return Value:
         }
 
         CK_OBJECT_VALUE(Instance->Fields[0], Dict);
+        CK_WRITE_BARRIER(Vm, &(Instance->Header));
     }
 
     Dict = CK_AS_DICT(Instance->Fields[0]);
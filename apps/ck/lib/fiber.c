@@ -587,6 +587,7 @@ Return Value:
 {
 
     Vm->Fiber->Error = Arguments[1];
+    CK_WRITE_BARRIER(Vm, &(Vm->Fiber->Header));
 
     //
     // If the caller passed null, then don't actually abort.
@@ -849,6 +850,7 @@ Return Value:
         return FALSE;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Vm->Fiber->Header));
     Vm->Fiber = NULL;
     return FALSE;
 }
@@ -1006,6 +1008,7 @@ Return Value:
         return FALSE;
     }
 
+    CK_WRITE_BARRIER(Vm, &(CurrentFiber->Header));
     Vm->Fiber = CurrentFiber->Caller;
     CurrentFiber->Caller = NULL;
     if (Vm->Fiber != NULL) {
@@ -1143,6 +1146,8 @@ Return Value:
         Fiber->StackTop[-1] = Arguments[1];
     }
 
+    CK_WRITE_BARRIER(Vm, &(Vm->Fiber->Header));
+    CK_WRITE_BARRIER(Vm, &(Fiber->Header));
     Vm->Fiber = Fiber;
     return;
 }
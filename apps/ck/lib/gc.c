@@ -37,11 +37,36 @@ Module Name:
 #include <minoca/lib/yy.h>
 #include "lang.h"
 #include "compsup.h"
+#include "vmsys.h"
 
 //
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the number of bytes each incremental marking slice traces for every
+// byte that can be allocated in the nursery between slices. This needs to be
+// comfortably above one so that marking finishes before the program allocates
+// too much.
+//
+
+#define CK_GC_MARK_RATE 4
+
+//
+// Define the number of bytes each marking slice traces when stressing the
+// garbage collector, and how many young collections go by between starting
+// collections of the whole heap.
+//
+
+#define CK_GC_STRESS_SLICE 256
+#define CK_GC_STRESS_MAJOR_INTERVAL 64
+
+//
+// Define the initial capacity of the remembered set.
+//
+
+#define CK_GC_INITIAL_REMEMBERED 64
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -50,6 +75,70 @@ Module Name:
 // ----------------------------------------------- Internal Function Prototypes
 //
 
+VOID
+CkpCollectGarbageStep (
+    PCK_VM Vm
+    );
+
+VOID
+CkpCollectYoungGeneration (
+    PCK_VM Vm
+    );
+
+VOID
+CkpStartMarking (
+    PCK_VM Vm
+    );
+
+VOID
+CkpFinishMarking (
+    PCK_VM Vm
+    );
+
+VOID
+CkpInitializeKissList (
+    PCK_VM Vm
+    );
+
+VOID
+CkpResetKisses (
+    PCK_VM Vm
+    );
+
+VOID
+CkpClearRememberedSet (
+    PCK_VM Vm
+    );
+
+VOID
+CkpRecordPause (
+    PCK_VM Vm,
+    ULONGLONG Start
+    );
+
+VOID
+CkpKissRoots (
+    PCK_VM Vm
+    );
+
+VOID
+CkpKissRoot (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    );
+
+VOID
+CkpRekissObject (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    );
+
+VOID
+CkpKissRememberedObject (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    );
+
 VOID
 CkpKissCompiler (
     PCK_VM Vm,
@@ -68,15 +157,23 @@ CkpKissObject (
     PCK_OBJECT Object
     );
 
-VOID
+BOOL
 CkpDeeplyKiss (
     PCK_VM Vm,
-    PCK_OBJECT Head
+    UINTN Budget
     );
 
 VOID
+CkpKissComponents (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    );
+
+ULONG
 CkpCollectUnkissedObjects (
-    PCK_VM Vm
+    PCK_VM Vm,
+    PCK_OBJECT *List,
+    BOOL Promote
     );
 
 VOID
@@ -121,6 +218,12 @@ CkpKissInstance (
     PCK_INSTANCE Instance
     );
 
+VOID
+CkpKissInteger (
+    PCK_VM Vm,
+    PCK_BOXED_INTEGER Integer
+    );
+
 VOID
 CkpKissList (
     PCK_VM Vm,
@@ -157,117 +260,805 @@ CkpKissValueArray (
     PCK_VALUE_ARRAY Array
     );
 
-//
-// -------------------------------------------------------------------- Globals
-//
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+CK_API
+VOID
+CkCollectGarbage (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs a full garbage collection on the given Chalk
+    instance, freeing up unused dynamic memory as appropriate. Any incremental
+    collection already in progress is finished.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONGLONG Start;
+
+    Start = CkpGetMicroseconds();
+
+    //
+    // Finish off a collection that's already marking, unless the remembered
+    // set overflowed during it, in which case the marking so far can't be
+    // trusted.
+    //
+
+    if ((Vm->GcPhase != CkGcMarking) || (Vm->RememberedOverflow != FALSE)) {
+        CkpStartMarking(Vm);
+    }
+
+    CkpFinishMarking(Vm);
+    CkpRecordPause(Vm, Start);
+    return;
+}
+
+CK_API
+VOID
+CkGetGarbageStatistics (
+    PCK_VM Vm,
+    PCK_GC_STATISTICS Statistics
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns statistics about the garbage collector.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Statistics - Supplies a pointer where the statistics will be returned.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    CkCopy(Statistics, &(Vm->GcStatistics), sizeof(CK_GC_STATISTICS));
+    Statistics->OldBytes = Vm->OldBytes;
+    Statistics->NurseryBytes = Vm->NurseryBytes;
+    return;
+}
+
+VOID
+CkpPushRoot (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pushes the given object onto a temporary stack to ensure that
+    it will not be garbage collected.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Object - Supplies a pointer to the object to push.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    CK_ASSERT(Object != NULL);
+    CK_ASSERT(Vm->WorkingObjectCount < CK_MAX_WORKING_OBJECTS);
+
+    Vm->WorkingObjects[Vm->WorkingObjectCount] = Object;
+    Vm->WorkingObjectCount += 1;
+    return;
+}
+
+VOID
+CkpPopRoot (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pops the top working object off of the temporary stack used to
+    ensure that certain objects are not garbage collected.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    CK_ASSERT(Vm->WorkingObjectCount != 0);
+
+    Vm->WorkingObjectCount -= 1;
+    return;
+}
+
+VOID
+CkpRememberObject (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds an old object that was just written to onto the
+    remembered set, so that the next collection traces it again. This is the
+    slow path of the write barrier. Use the CK_WRITE_BARRIER macro instead of
+    calling this directly.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Object - Supplies a pointer to the object that was modified.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN NewCapacity;
+    PCK_OBJECT *NewRemembered;
+
+    CK_ASSERT((Object->Flags & (CK_OBJECT_OLD | CK_OBJECT_REMEMBERED)) ==
+              CK_OBJECT_OLD);
+
+    //
+    // Expand the array if needed. This can't go through the Chalk allocator,
+    // since that might start a collection in the middle of a store. If the
+    // allocation fails, the object is simply not remembered, and the next
+    // collection traces everything instead.
+    //
+
+    if (Vm->RememberedCount == Vm->RememberedCapacity) {
+        NewCapacity = Vm->RememberedCapacity * 2;
+        if (NewCapacity == 0) {
+            NewCapacity = CK_GC_INITIAL_REMEMBERED;
+        }
+
+        NewRemembered = CkRawReallocate(Vm,
+                                        Vm->Remembered,
+                                        NewCapacity * sizeof(PCK_OBJECT));
+
+        if (NewRemembered == NULL) {
+            Vm->RememberedOverflow = TRUE;
+            return;
+        }
+
+        Vm->Remembered = NewRemembered;
+        Vm->RememberedCapacity = NewCapacity;
+    }
+
+    //
+    // Assume the whole list changed. The list write barrier narrows this down.
+    //
+
+    if (Object->Type == CkObjectList) {
+        ((PCK_LIST)Object)->Dirty = 0;
+    }
+
+    Object->Flags |= CK_OBJECT_REMEMBERED;
+    Vm->Remembered[Vm->RememberedCount] = Object;
+    Vm->RememberedCount += 1;
+    return;
+}
+
+PVOID
+CkpReallocate (
+    PCK_VM Vm,
+    PVOID Memory,
+    UINTN OldSize,
+    UINTN NewSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs a Chalk dynamic memory operation.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Memory - Supplies an optional pointer to the memory to resize or free.
+
+    OldSize - Supplies the optional previous size of the allocation.
+
+    NewSize - Supplies the new size of the allocation. Set this to 0 to free
+        the memory.
+
+Return Value:
+
+    Returns a pointer to the newly allocated or reallocated memory on success.
+
+    NULL on allocation failure or for free operations.
+
+--*/
+
+{
+
+    PVOID Allocation;
+
+    //
+    // Add the new bytes to the total count. Ignore frees, since those get
+    // handled during garbage collection.
+    //
+
+    Vm->BytesAllocated += NewSize - OldSize;
+
+    //
+    // Potentially perform a step of garbage collection once the nursery fills
+    // up.
+    //
+
+    if (NewSize > OldSize) {
+        Vm->NurseryBytes += NewSize - OldSize;
+        if ((Vm->NurseryBytes >= Vm->Configuration.NurserySize) ||
+            (CK_VM_FLAG_SET(Vm, CK_CONFIGURATION_GC_STRESS))) {
+
+            CkpCollectGarbageStep(Vm);
+        }
+    }
+
+    Allocation = CkRawReallocate(Vm, Memory, NewSize);
+    if ((Allocation == NULL) && (NewSize != 0)) {
+
+        //
+        // If there's already a memory exception in progress, then this is
+        // serious. Call the emergency function.
+        //
+
+        if (Vm->MemoryException != 0) {
+            CkpError(Vm, CkErrorNoMemory, "Allocation failure");
+
+        } else {
+            Vm->MemoryException += 1;
+            CkpRuntimeError(Vm, "MemoryError", "Allocation failure");
+            Vm->MemoryException -= 1;
+        }
+    }
+
+    return Allocation;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+CkpCollectGarbageStep (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs the garbage collection work owed once the nursery
+    fills up. This is either a collection of the young generation, or a slice
+    of incremental marking of the whole heap.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Budget;
+    ULONGLONG Start;
+    BOOL Stress;
+
+    Start = CkpGetMicroseconds();
+    Stress = CK_VM_FLAG_SET(Vm, CK_CONFIGURATION_GC_STRESS);
+
+    //
+    // If the remembered set couldn't keep up, then there's no way to know
+    // which old objects point at young ones. Collect everything.
+    //
+
+    if (Vm->RememberedOverflow != FALSE) {
+        CkpStartMarking(Vm);
+        CkpFinishMarking(Vm);
+
+    //
+    // While the whole heap is being marked, young objects are left alone
+    // until the end. Mark a bit more of the heap, and finish up if that
+    // was the last of it.
+    //
+
+    } else if (Vm->GcPhase == CkGcMarking) {
+        Budget = Vm->Configuration.NurserySize * CK_GC_MARK_RATE;
+        if (Stress != FALSE) {
+            Budget = CK_GC_STRESS_SLICE;
+        }
+
+        Vm->GcStatistics.MarkSlices += 1;
+        if (CkpDeeplyKiss(Vm, Budget) != FALSE) {
+            CkpFinishMarking(Vm);
+        }
+
+    //
+    // Otherwise collect the nursery, and start marking the whole heap if the
+    // old generation has grown enough.
+    //
+
+    } else {
+        CkpCollectYoungGeneration(Vm);
+        if ((Vm->OldBytes >= Vm->NextGarbageCollection) ||
+            ((Stress != FALSE) &&
+             ((Vm->GcStatistics.MinorCollections %
+               CK_GC_STRESS_MAJOR_INTERVAL) == 0))) {
+
+            CkpStartMarking(Vm);
+        }
+    }
+
+    Vm->NurseryBytes = 0;
+    CkpRecordPause(Vm, Start);
+    return;
+}
+
+VOID
+CkpCollectYoungGeneration (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine collects the young generation. Old objects are assumed to be
+    alive, and are only traced if they're roots or have been written to since
+    the last collection. Every young object that survives is promoted to the
+    old generation.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG DestroyCount;
+    UINTN Index;
+
+    CK_ASSERT(Vm->GcPhase == CkGcIdle);
+
+    Vm->GcPhase = CkGcMinor;
+    Vm->MarkedBytes = 0;
+    CkpInitializeKissList(Vm);
+    CkpKissRoots(Vm);
+    for (Index = 0; Index < Vm->RememberedCount; Index += 1) {
+        CkpKissRememberedObject(Vm, Vm->Remembered[Index]);
+    }
+
+    CkpDeeplyKiss(Vm, MAX_UINTN);
+    CkpClearRememberedSet(Vm);
+    DestroyCount = CkpCollectUnkissedObjects(Vm, &(Vm->FirstObject), TRUE);
+
+    //
+    // Everything that was counted got promoted.
+    //
+
+    Vm->OldBytes += Vm->MarkedBytes;
+    Vm->BytesAllocated = Vm->OldBytes;
+    Vm->GcStatistics.MinorCollections += 1;
+    Vm->GcStatistics.BytesPromoted += Vm->MarkedBytes;
+    Vm->GcStatistics.ObjectsFreed += DestroyCount;
+    Vm->GcPhase = CkGcIdle;
+    return;
+}
+
+VOID
+CkpStartMarking (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts a collection of the whole heap by kissing the roots.
+    The rest of the marking is done in slices as the program runs. If marking
+    was already in progress, it is thrown away and started over.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Vm->GcPhase == CkGcMarking) {
+        CkpResetKisses(Vm);
+    }
+
+    CK_ASSERT(Vm->GcPhase != CkGcMinor);
+
+    //
+    // Whatever was remembered is irrelevant now, as all objects are going to
+    // be traced. From here on, the remembered set collects old objects that
+    // change behind the marker's back.
+    //
+
+    CkpClearRememberedSet(Vm);
+    Vm->GcPhase = CkGcMarking;
+    Vm->MarkedBytes = 0;
+    CkpInitializeKissList(Vm);
+    CkpKissRoots(Vm);
+    return;
+}
+
+VOID
+CkpFinishMarking (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finishes a collection of the whole heap. Everything that
+    might have changed since it was traced is traced again, the remaining
+    marking is done, and everything that was not kissed is destroyed. The
+    survivors from the nursery are promoted.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG DestroyCount;
+    UINTN Hysteresis;
+    UINTN Index;
+    UINTN Minimum;
+    UINTN NextThreshold;
+    PCK_OBJECT Object;
+
+    CK_ASSERT(Vm->GcPhase == CkGcMarking);
+
+    Vm->GcPhase = CkGcFinishing;
+
+    //
+    // The roots, any old objects written to during marking, and all young
+    // objects (which don't have a write barrier) may have picked up
+    // references to objects that haven't been kissed. Go over them again.
+    // Objects not yet kissed will be traced fresh if they turn out to be
+    // reachable.
+    //
+
+    CkpKissRoots(Vm);
+    for (Index = 0; Index < Vm->RememberedCount; Index += 1) {
+        Object = Vm->Remembered[Index];
+        if (Object->NextKiss != NULL) {
+            CkpKissRememberedObject(Vm, Object);
+        }
+    }
+
+    Object = Vm->FirstObject;
+    while (Object != NULL) {
+        if (Object->NextKiss != NULL) {
+            CkpRekissObject(Vm, Object);
+        }
+
+        Object = Object->Next;
+    }
+
+    CkpDeeplyKiss(Vm, MAX_UINTN);
+    CkpClearRememberedSet(Vm);
+    DestroyCount = CkpCollectUnkissedObjects(Vm, &(Vm->OldObjects), FALSE);
+    DestroyCount += CkpCollectUnkissedObjects(Vm, &(Vm->FirstObject), TRUE);
+
+    //
+    // Reset the number of bytes allocated to what the kiss functions counted.
+    // This avoids the extra work of having to determine the size of objects
+    // being freed. The tradeoff is that the bytes allocated won't count
+    // non-object allocations, so it will be a bit low.
+    //
+
+    Vm->OldBytes = Vm->MarkedBytes;
+    Vm->BytesAllocated = Vm->OldBytes;
+    Vm->GcStatistics.MajorCollections += 1;
+    Vm->GcStatistics.ObjectsFreed += DestroyCount;
+    Vm->GcPhase = CkGcIdle;
+
+    //
+    // Determine the old generation size at which to start the next whole heap
+    // collection, expressed as an additional percentage growth. Except rather
+    // than using percent 100 exactly, use 1024 to avoid the divide. It looks
+    // nearly the same as percent times 10.
+    //
+
+    Hysteresis = Vm->OldBytes * Vm->Configuration.HeapGrowthPercent / 1024;
+    NextThreshold = Vm->OldBytes + Hysteresis;
+
+    //
+    // Avoid ratcheting down the threshold little by little. Go down by the
+    // same chunk as going up.
+    //
+
+    if (NextThreshold < Vm->NextGarbageCollection) {
+        if (Vm->OldBytes > Hysteresis) {
+            Minimum = Vm->OldBytes - Hysteresis;
+            if (NextThreshold > Minimum) {
+                NextThreshold = Vm->NextGarbageCollection;
+            }
+        }
+    }
+
+    if (NextThreshold < Vm->Configuration.MinimumHeapSize) {
+        NextThreshold = Vm->Configuration.MinimumHeapSize;
+    }
+
+    Vm->NextGarbageCollection = NextThreshold;
+    return;
+}
+
+VOID
+CkpInitializeKissList (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sets up an empty kiss list.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    //
+    // Make the list a circle so that the last object added does not have a
+    // non-null pointer.
+    //
+
+    Vm->KissHead.Type = CkObjectInvalid;
+    Vm->KissHead.Flags = 0;
+    Vm->KissHead.Next = NULL;
+    Vm->KissHead.NextKiss = &(Vm->KissHead);
+    Vm->KissList = &(Vm->KissHead);
+    Vm->KissScan = &(Vm->KissHead);
+    return;
+}
+
+VOID
+CkpResetKisses (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine throws away the kisses handed out by a collection that is
+    being abandoned.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PCK_OBJECT Next;
+    PCK_OBJECT Object;
+
+    Object = Vm->KissHead.NextKiss;
+    while (Object != &(Vm->KissHead)) {
+        Next = Object->NextKiss;
+        Object->NextKiss = NULL;
+        Object = Next;
+    }
+
+    CkpInitializeKissList(Vm);
+    Vm->GcPhase = CkGcIdle;
+    return;
+}
+
+VOID
+CkpClearRememberedSet (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine empties the remembered set.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Index;
+
+    for (Index = 0; Index < Vm->RememberedCount; Index += 1) {
+        Vm->Remembered[Index]->Flags &= ~CK_OBJECT_REMEMBERED;
+    }
 
-//
-// ------------------------------------------------------------------ Functions
-//
+    Vm->RememberedCount = 0;
+    Vm->RememberedOverflow = FALSE;
+    return;
+}
 
-CK_API
 VOID
-CkCollectGarbage (
-    PCK_VM Vm
+CkpRecordPause (
+    PCK_VM Vm,
+    ULONGLONG Start
     )
 
 /*++
 
 Routine Description:
 
-    This routine performs garbage collection on the given Chalk instance,
-    freeing up unused dynamic memory as appropriate.
+    This routine adds a garbage collection pause to the statistics.
 
 Arguments:
 
     Vm - Supplies a pointer to the virtual machine.
 
-Return Value:
+    Start - Supplies the time counter value when the pause began.
 
-    Returns a pointer to the newly allocated or reallocated memory on success.
+Return Value:
 
-    NULL on allocation failure or for free operations.
+    None.
 
 --*/
 
 {
 
-    UINTN Hysteresis;
-    UINTN Index;
-    CK_OBJECT KissHead;
-    UINTN Minimum;
-    UINTN NextThreshold;
+    ULONG Bucket;
+    ULONGLONG Pause;
+    PCK_GC_STATISTICS Statistics;
 
-    //
-    // Reset the number of bytes allocated, and have the kiss functions count
-    // their allocations. This avoids the extra work of having to determine
-    // the size of objects being freed. The tradeoff is that the bytes
-    // allocated won't count non-object allocations, so it will be a bit low.
-    //
+    Pause = CkpGetMicroseconds() - Start;
+    Statistics = &(Vm->GcStatistics);
+    Statistics->TotalPause += Pause;
+    if (Pause > Statistics->MaxPause) {
+        Statistics->MaxPause = Pause;
+    }
 
-    Vm->BytesAllocated = 0;
-    Vm->GarbageRuns += 1;
-    Vm->GarbageFreed = 0;
+    Bucket = 0;
+    while ((Bucket < CK_GC_PAUSE_BUCKETS - 1) && (Pause >= (1ULL << Bucket))) {
+        Bucket += 1;
+    }
 
-    //
-    // Set up the head of the kiss list. Make it a circle so that the last
-    // object added does not have a non-null pointer.
-    //
+    Statistics->PauseHistogram[Bucket] += 1;
+    return;
+}
 
-    KissHead.Type = CkObjectInvalid;
-    KissHead.Next = NULL;
-    KissHead.NextKiss = &KissHead;
-    Vm->KissList = &KissHead;
-    CkpKissObject(Vm, &(Vm->Modules->Header));
-    CkpKissObject(Vm, &(Vm->ModulePath->Header));
-    for (Index = 0; Index < Vm->WorkingObjectCount; Index += 1) {
-        CkpKissObject(Vm, Vm->WorkingObjects[Index]);
-    }
+VOID
+CkpKissRoots (
+    PCK_VM Vm
+    )
 
-    CkpKissObject(Vm, &(Vm->Fiber->Header));
-    if (Vm->Compiler != NULL) {
-        CkpKissCompiler(Vm, Vm->Compiler);
-    }
+/*++
 
-    CkpKissObject(Vm, &(Vm->UnhandledException->Header));
-    CkpDeeplyKiss(Vm, &KissHead);
-    CkpCollectUnkissedObjects(Vm);
+Routine Description:
 
-    //
-    // Determine the next garbage collection time, expressed as an additional
-    // percentage growth. Except rather than using percent 100 exactly, use
-    // 1024 to avoid the divide. It looks nearly the same as percent times 10.
-    //
+    This routine kisses the objects the virtual machine refers to directly.
 
-    Hysteresis = Vm->BytesAllocated * Vm->Configuration.HeapGrowthPercent /
-                 1024;
+Arguments:
 
-    NextThreshold = Vm->BytesAllocated + Hysteresis;
+    Vm - Supplies a pointer to the virtual machine.
 
-    //
-    // Avoid ratcheting down the threshold little by little. Go down by the
-    // same chunk as going up.
-    //
+Return Value:
 
-    if (NextThreshold < Vm->NextGarbageCollection) {
-        if (Vm->BytesAllocated > Hysteresis) {
-            Minimum = Vm->BytesAllocated - Hysteresis;
-            if (NextThreshold > Minimum) {
-                NextThreshold = Vm->NextGarbageCollection;
-            }
-        }
+    None.
+
+--*/
+
+{
+
+    UINTN Index;
+
+    CkpKissRoot(Vm, &(Vm->Modules->Header));
+    CkpKissRoot(Vm, &(Vm->ModulePath->Header));
+    for (Index = 0; Index < Vm->WorkingObjectCount; Index += 1) {
+        CkpKissRoot(Vm, Vm->WorkingObjects[Index]);
     }
 
-    if (NextThreshold < Vm->Configuration.MinimumHeapSize) {
-        NextThreshold = Vm->Configuration.MinimumHeapSize;
+    CkpKissRoot(Vm, &(Vm->Fiber->Header));
+    if (Vm->Compiler != NULL) {
+        CkpKissCompiler(Vm, Vm->Compiler);
     }
 
-    Vm->NextGarbageCollection = NextThreshold;
+    CkpKissRoot(Vm, &(Vm->UnhandledException->Header));
     return;
 }
 
 VOID
-CkpPushRoot (
+CkpKissRoot (
     PCK_VM Vm,
     PCK_OBJECT Object
     )
@@ -276,14 +1067,16 @@ CkpPushRoot (
 
 Routine Description:
 
-    This routine pushes the given object onto a temporary stack to ensure that
-    it will not be garbage collected.
+    This routine kisses a root object. Roots are changed without going through
+    the write barrier (the running fiber's stack being the prime example), so
+    their components are kissed even if the object itself is old or has been
+    traced already.
 
 Arguments:
 
     Vm - Supplies a pointer to the virtual machine.
 
-    Object - Supplies a pointer to the object to push.
+    Object - Supplies an optional pointer to the root object.
 
 Return Value:
 
@@ -293,30 +1086,43 @@ Return Value:
 
 {
 
-    CK_ASSERT(Object != NULL);
-    CK_ASSERT(Vm->WorkingObjectCount < CK_MAX_WORKING_OBJECTS);
+    if (Object == NULL) {
+        return;
+    }
+
+    if ((Object->NextKiss != NULL) ||
+        ((Vm->GcPhase == CkGcMinor) &&
+         ((Object->Flags & CK_OBJECT_OLD) != 0))) {
+
+        CkpRekissObject(Vm, Object);
+
+    } else {
+        CkpKissObject(Vm, Object);
+    }
 
-    Vm->WorkingObjects[Vm->WorkingObjectCount] = Object;
-    Vm->WorkingObjectCount += 1;
     return;
 }
 
 VOID
-CkpPopRoot (
-    PCK_VM Vm
+CkpRekissObject (
+    PCK_VM Vm,
+    PCK_OBJECT Object
     )
 
 /*++
 
 Routine Description:
 
-    This routine pops the top working object off of the temporary stack used to
-    ensure that certain objects are not garbage collected.
+    This routine kisses the components of an object that has already been
+    accounted for, either because it was traced earlier in this collection or
+    because it's in the old generation.
 
 Arguments:
 
     Vm - Supplies a pointer to the virtual machine.
 
+    Object - Supplies a pointer to the object.
+
 Return Value:
 
     None.
@@ -325,92 +1131,62 @@ Return Value:
 
 {
 
-    CK_ASSERT(Vm->WorkingObjectCount != 0);
+    UINTN MarkedBytes;
 
-    Vm->WorkingObjectCount -= 1;
+    //
+    // Don't count the object's bytes a second time.
+    //
+
+    MarkedBytes = Vm->MarkedBytes;
+    CkpKissComponents(Vm, Object);
+    Vm->MarkedBytes = MarkedBytes;
     return;
 }
 
-PVOID
-CkpReallocate (
+VOID
+CkpKissRememberedObject (
     PCK_VM Vm,
-    PVOID Memory,
-    UINTN OldSize,
-    UINTN NewSize
+    PCK_OBJECT Object
     )
 
 /*++
 
 Routine Description:
 
-    This routine performs a Chalk dynamic memory operation.
+    This routine kisses the components of an object on the remembered set.
+    For lists, only the elements at or above the lowest index written to are
+    kissed.
 
 Arguments:
 
     Vm - Supplies a pointer to the virtual machine.
 
-    Memory - Supplies an optional pointer to the memory to resize or free.
-
-    OldSize - Supplies the optional previous size of the allocation.
-
-    NewSize - Supplies the new size of the allocation. Set this to 0 to free
-        the memory.
+    Object - Supplies a pointer to the remembered object.
 
 Return Value:
 
-    Returns a pointer to the newly allocated or reallocated memory on success.
-
-    NULL on allocation failure or for free operations.
+    None.
 
 --*/
 
 {
 
-    PVOID Allocation;
-
-    //
-    // Add the new bytes to the total count. Ignore frees, since those get
-    // handled during garbage collection.
-    //
-
-    Vm->BytesAllocated += NewSize - OldSize;
-
-    //
-    // Potentially perform garbage collection.
-    //
-
-    if ((NewSize > 0) &&
-        ((Vm->BytesAllocated >= Vm->NextGarbageCollection) ||
-         (CK_VM_FLAG_SET(Vm, CK_CONFIGURATION_GC_STRESS)))) {
+    UINTN Index;
+    PCK_LIST List;
 
-        CkCollectGarbage(Vm);
+    if (Object->Type != CkObjectList) {
+        CkpRekissObject(Vm, Object);
+        return;
     }
 
-    Allocation = CkRawReallocate(Vm, Memory, NewSize);
-    if ((Allocation == NULL) && (NewSize != 0)) {
-
-        //
-        // If there's already a memory exception in progress, then this is
-        // serious. Call the emergency function.
-        //
-
-        if (Vm->MemoryException != 0) {
-            CkpError(Vm, CkErrorNoMemory, "Allocation failure");
-
-        } else {
-            Vm->MemoryException += 1;
-            CkpRuntimeError(Vm, "MemoryError", "Allocation failure");
-            Vm->MemoryException -= 1;
-        }
+    List = (PCK_LIST)Object;
+    for (Index = List->Dirty; Index < List->Elements.Count; Index += 1) {
+        CkpKissValue(Vm, List->Elements.Data[Index]);
     }
 
-    return Allocation;
+    return;
 }
 
-//
-// --------------------------------------------------------- Internal Functions
-//
-
 VOID
 CkpKissCompiler (
     PCK_VM Vm,
@@ -422,7 +1198,8 @@ CkpKissCompiler (
 Routine Description:
 
     This routine kisses a compiler, preventing its components from being
-    garbage collected.
+    garbage collected. The functions being compiled are modified without
+    going through the write barrier, so they're treated as roots.
 
 Arguments:
 
@@ -443,7 +1220,7 @@ Return Value:
     //
 
     if (Compiler->Parser != NULL) {
-        CkpKissObject(Vm, &(Compiler->Parser->Module->Header));
+        CkpKissRoot(Vm, &(Compiler->Parser->Module->Header));
     }
 
     //
@@ -451,10 +1228,10 @@ Return Value:
     //
 
     while (Compiler != NULL) {
-        CkpKissObject(Vm, &(Compiler->Function->Header));
+        CkpKissRoot(Vm, &(Compiler->Function->Header));
         if (Compiler->EnclosingClass != NULL) {
             CkpKissValueArray(Vm, &(Compiler->EnclosingClass->Fields.List));
-            CkpKissObject(Vm, &(Compiler->EnclosingClass->Fields.Dict->Header));
+            CkpKissRoot(Vm, &(Compiler->EnclosingClass->Fields.Dict->Header));
         }
 
         //
@@ -463,7 +1240,7 @@ Return Value:
         // allocated.
         //
 
-        Vm->BytesAllocated += (Compiler->LocalCapacity * sizeof(CK_LOCAL)) +
+        Vm->MarkedBytes += (Compiler->LocalCapacity * sizeof(CK_LOCAL)) +
                               (Compiler->UpvalueCapacity *
                                sizeof(CK_COMPILER_UPVALUE));
 
@@ -538,6 +1315,16 @@ Return Value:
 
     if ((Object != NULL) && (Object->NextKiss == NULL)) {
 
+        //
+        // Old objects are assumed alive when collecting the young generation.
+        //
+
+        if ((Vm->GcPhase == CkGcMinor) &&
+            ((Object->Flags & CK_OBJECT_OLD) != 0)) {
+
+            return;
+        }
+
         //
         // Wire the object in after the end of the list, and make it the new
         // end.
@@ -552,123 +1339,183 @@ Return Value:
     return;
 }
 
-VOID
+BOOL
 CkpDeeplyKiss (
     PCK_VM Vm,
-    PCK_OBJECT Head
+    UINTN Budget
     )
 
 /*++
 
 Routine Description:
 
-    This routine performs a depth first traversal of the objects on the kiss
-    list, kissing each of their components recursively.
+    This routine performs a breadth first traversal of the objects on the kiss
+    list, kissing each of their components. The traversal picks up where the
+    last call left off.
 
 Arguments:
 
     Vm - Supplies a pointer to the virtual machine.
 
-    Head - Supplies a pointer to a dummy object representing the head of the
-        kiss list. This object itself is not kissed.
+    Budget - Supplies the number of bytes of objects to trace before
+        returning. Supply MAX_UINTN to drain the kiss list completely.
 
 Return Value:
 
-    None.
+    TRUE if the kiss list has been drained.
+
+    FALSE if there are objects left to trace.
 
 --*/
 
 {
 
+    PCK_OBJECT Head;
     PCK_OBJECT Object;
+    UINTN Start;
 
     //
     // Loop through all the objects on the kiss list. Kissing these objects
     // may cause more to get added to the end of the list.
     //
 
-    Object = Head->NextKiss;
+    Head = &(Vm->KissHead);
+    Start = Vm->MarkedBytes;
+    Object = Vm->KissScan->NextKiss;
     while (Object != Head) {
-        switch (Object->Type) {
-        case CkObjectClass:
-            CkpKissClass(Vm, (PCK_CLASS)Object);
+        CkpKissComponents(Vm, Object);
+        Vm->KissScan = Object;
+        if (Vm->MarkedBytes - Start >= Budget) {
             break;
+        }
 
-        case CkObjectClosure:
-            CkpKissClosure(Vm, (PCK_CLOSURE)Object);
-            break;
+        Object = Object->NextKiss;
+    }
 
-        case CkObjectFiber:
-            CkpKissFiber(Vm, (PCK_FIBER)Object);
-            break;
+    if (Vm->KissScan->NextKiss == Head) {
+        return TRUE;
+    }
 
-        case CkObjectFunction:
-            CkpKissFunction(Vm, (PCK_FUNCTION)Object);
-            break;
+    return FALSE;
+}
 
-        case CkObjectForeign:
-            CkpKissForeignData(Vm, (PCK_FOREIGN_DATA)Object);
-            break;
+VOID
+CkpKissComponents (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    )
 
-        case CkObjectInstance:
-            CkpKissInstance(Vm, (PCK_INSTANCE)Object);
-            break;
+/*++
 
-        case CkObjectList:
-            CkpKissList(Vm, (PCK_LIST)Object);
-            break;
+Routine Description:
 
-        case CkObjectDict:
-            CkpKissDict(Vm, (PCK_DICT)Object);
-            break;
+    This routine kisses everything an object refers to, and adds the object's
+    size to the marked byte count.
 
-        case CkObjectModule:
-            CkpKissModule(Vm, (PCK_MODULE)Object);
-            break;
+Arguments:
 
-        case CkObjectRange:
-            CkpKissRange(Vm, (PCK_RANGE)Object);
-            break;
+    Vm - Supplies a pointer to the virtual machine.
 
-        case CkObjectString:
-            CkpKissString(Vm, (PCK_STRING)Object);
-            break;
+    Object - Supplies a pointer to the object whose components should be
+        kissed.
 
-        case CkObjectUpvalue:
-            CkpKissUpvalue(Vm, (PCK_UPVALUE)Object);
-            break;
+Return Value:
 
-        default:
+    None.
 
-            CK_ASSERT(FALSE);
+--*/
 
-            break;
-        }
+{
 
-        Object = Object->NextKiss;
+    switch (Object->Type) {
+    case CkObjectClass:
+        CkpKissClass(Vm, (PCK_CLASS)Object);
+        break;
+
+    case CkObjectClosure:
+        CkpKissClosure(Vm, (PCK_CLOSURE)Object);
+        break;
+
+    case CkObjectFiber:
+        CkpKissFiber(Vm, (PCK_FIBER)Object);
+        break;
+
+    case CkObjectFunction:
+        CkpKissFunction(Vm, (PCK_FUNCTION)Object);
+        break;
+
+    case CkObjectForeign:
+        CkpKissForeignData(Vm, (PCK_FOREIGN_DATA)Object);
+        break;
+
+    case CkObjectInstance:
+        CkpKissInstance(Vm, (PCK_INSTANCE)Object);
+        break;
+
+    case CkObjectInteger:
+        CkpKissInteger(Vm, (PCK_BOXED_INTEGER)Object);
+        break;
+
+    case CkObjectList:
+        CkpKissList(Vm, (PCK_LIST)Object);
+        break;
+
+    case CkObjectDict:
+        CkpKissDict(Vm, (PCK_DICT)Object);
+        break;
+
+    case CkObjectModule:
+        CkpKissModule(Vm, (PCK_MODULE)Object);
+        break;
+
+    case CkObjectRange:
+        CkpKissRange(Vm, (PCK_RANGE)Object);
+        break;
+
+    case CkObjectString:
+        CkpKissString(Vm, (PCK_STRING)Object);
+        break;
+
+    case CkObjectUpvalue:
+        CkpKissUpvalue(Vm, (PCK_UPVALUE)Object);
+        break;
+
+    default:
+
+        CK_ASSERT(FALSE);
+
+        break;
     }
 
     return;
 }
 
-VOID
+ULONG
 CkpCollectUnkissedObjects (
-    PCK_VM Vm
+    PCK_VM Vm,
+    PCK_OBJECT *List,
+    BOOL Promote
     )
 
 /*++
 
 Routine Description:
 
-    This routine garbage collects any objects that have not been kissed.
+    This routine garbage collects any objects on the given list that have not
+    been kissed.
 
 Arguments:
 
     Vm - Supplies a pointer to the virtual machine.
 
+    List - Supplies a pointer to the head of the object list to sweep.
+
+    Promote - Supplies a boolean indicating whether or not to move the
+        surviving objects onto the old generation list.
+
 Return Value:
 
-    None.
+    Returns the number of objects destroyed.
 
 --*/
 
@@ -677,9 +1524,10 @@ Return Value:
     PCK_OBJECT DeadAndAlone;
     ULONG DestroyCount;
     PCK_OBJECT *Object;
+    PCK_OBJECT Survivor;
 
     DestroyCount = 0;
-    Object = &(Vm->FirstObject);
+    Object = List;
     while (*Object != NULL) {
 
         //
@@ -695,12 +1543,22 @@ Return Value:
                   (Vm->Class.Class->Flags == 0));
 
         //
-        // If the object has been kissed, then reset it for next time.
+        // If the object has been kissed, then reset it for next time. Move
+        // it to the old generation if it's graduating.
         //
 
         if ((*Object)->NextKiss != NULL) {
             (*Object)->NextKiss = NULL;
-            Object = &((*Object)->Next);
+            if (Promote != FALSE) {
+                Survivor = *Object;
+                *Object = Survivor->Next;
+                Survivor->Flags |= CK_OBJECT_OLD;
+                Survivor->Next = Vm->OldObjects;
+                Vm->OldObjects = Survivor;
+
+            } else {
+                Object = &((*Object)->Next);
+            }
 
         //
         // The object was never kissed. No one loves it, and it serves no
@@ -715,14 +1573,13 @@ Return Value:
         }
     }
 
-    Vm->GarbageFreed = DestroyCount;
     if ((CK_VM_FLAG_SET(Vm, CK_CONFIGURATION_GC_STRESS)) &&
         (DestroyCount != 0)) {
 
         CkpDebugPrint(Vm, "%d objects destroyed\n", DestroyCount);
     }
 
-    return;
+    return DestroyCount;
 }
 
 VOID
@@ -757,7 +1614,7 @@ Return Value:
     CkpKissObject(Vm, &(Class->Methods->Header));
     CkpKissObject(Vm, &(Class->Name->Header));
     CkpKissObject(Vm, &(Class->Module->Header));
-    Vm->BytesAllocated += sizeof(CK_CLASS);
+    Vm->MarkedBytes += sizeof(CK_CLASS);
     return;
 }
 
@@ -819,7 +1676,7 @@ Return Value:
         break;
     }
 
-    Vm->BytesAllocated += sizeof(CK_CLOSURE) +
+    Vm->MarkedBytes += sizeof(CK_CLOSURE) +
                           (UpvalueCount * sizeof(PCK_UPVALUE));
 
     return;
@@ -856,15 +1713,16 @@ Return Value:
     UINTN Index;
 
     for (Index = 0; Index < Dict->Capacity; Index += 1) {
-        Entry = &(Dict->Entries[Index]);
-        if (!CK_IS_UNDEFINED(Entry->Key)) {
+        if (Dict->Hashes[Index] != 0) {
+            Entry = &(Dict->Entries[Index]);
             CkpKissValue(Vm, Entry->Key);
             CkpKissValue(Vm, Entry->Value);
         }
     }
 
-    Vm->BytesAllocated += sizeof(CK_DICT) +
-                          (Dict->Capacity * sizeof(CK_DICT_ENTRY));
+    Vm->MarkedBytes += sizeof(CK_DICT) +
+                       (Dict->Capacity *
+                        (sizeof(CK_DICT_ENTRY) + sizeof(ULONG)));
 
     return;
 }
@@ -930,7 +1788,7 @@ Return Value:
 
     CkpKissObject(Vm, &(Fiber->Caller->Header));
     CkpKissValue(Vm, Fiber->Error);
-    Vm->BytesAllocated += sizeof(CK_FIBER) +
+    Vm->MarkedBytes += sizeof(CK_FIBER) +
                           (Fiber->FrameCapacity * sizeof(CK_CALL_FRAME)) +
                           (Fiber->TryCapacity * sizeof(CK_TRY_BLOCK)) +
                           (Fiber->StackCapacity * sizeof(CK_VALUE));
@@ -965,7 +1823,7 @@ Return Value:
 
 {
 
-    Vm->BytesAllocated += sizeof(CK_FOREIGN_DATA);
+    Vm->MarkedBytes += sizeof(CK_FOREIGN_DATA);
     return;
 }
 
@@ -999,11 +1857,21 @@ Return Value:
     CkpKissValueArray(Vm, &(Function->Constants));
     CkpKissObject(Vm, &(Function->Module->Header));
     CkpKissObject(Vm, &(Function->Debug.Name->Header));
-    Vm->BytesAllocated += sizeof(CK_FUNCTION) +
+    Vm->MarkedBytes += sizeof(CK_FUNCTION) +
                           (sizeof(UCHAR) * Function->Code.Capacity) +
                           (sizeof(UCHAR) *
                            Function->Debug.LineProgram.Capacity);
 
+    //
+    // The inline caches are not kissed. They only ever point at classes and
+    // closures that are kept alive elsewhere, and are invalidated when those
+    // might go away.
+    //
+
+    if (Function->CallCaches != NULL) {
+        Vm->MarkedBytes += sizeof(CK_CALL_CACHE) * Function->CallSiteCount;
+    }
+
     return;
 }
 
@@ -1043,7 +1911,37 @@ Return Value:
         CkpKissValue(Vm, Instance->Fields[Index]);
     }
 
-    Vm->BytesAllocated += sizeof(CK_INSTANCE) + (Count * sizeof(CK_VALUE));
+    Vm->MarkedBytes += sizeof(CK_INSTANCE) + (Count * sizeof(CK_VALUE));
+    return;
+}
+
+VOID
+CkpKissInteger (
+    PCK_VM Vm,
+    PCK_BOXED_INTEGER Integer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine kisses a boxed integer object.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Integer - Supplies a pointer to the boxed integer.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    Vm->MarkedBytes += sizeof(CK_BOXED_INTEGER);
     return;
 }
 
@@ -1075,7 +1973,7 @@ Return Value:
 {
 
     CkpKissValueArray(Vm, &(List->Elements));
-    Vm->BytesAllocated += sizeof(CK_LIST);
+    Vm->MarkedBytes += sizeof(CK_LIST);
     return;
 }
 
@@ -1114,7 +2012,7 @@ Return Value:
     CkpKissObject(Vm, &(Module->Name->Header));
     CkpKissObject(Vm, &(Module->Path->Header));
     CkpKissObject(Vm, &(Module->Closure->Header));
-    Vm->BytesAllocated = sizeof(CK_MODULE);
+    Vm->MarkedBytes += sizeof(CK_MODULE);
     return;
 }
 
@@ -1145,7 +2043,7 @@ Return Value:
 
 {
 
-    Vm->BytesAllocated += sizeof(CK_RANGE);
+    Vm->MarkedBytes += sizeof(CK_RANGE);
     return;
 }
 
@@ -1176,7 +2074,7 @@ Return Value:
 
 {
 
-    Vm->BytesAllocated += sizeof(CK_STRING) + String->Length + 1;
+    Vm->MarkedBytes += sizeof(CK_STRING) + String->Length + 1;
     return;
 }
 
@@ -1208,7 +2106,7 @@ Return Value:
 {
 
     CkpKissValue(Vm, Upvalue->Closed);
-    Vm->BytesAllocated += sizeof(CK_UPVALUE);
+    Vm->MarkedBytes += sizeof(CK_UPVALUE);
     return;
 }
 
@@ -1248,7 +2146,7 @@ Return Value:
         CkpKissValue(Vm, Array->Data[Index]);
     }
 
-    Vm->BytesAllocated += Array->Capacity * sizeof(CK_VALUE);
+    Vm->MarkedBytes += Array->Capacity * sizeof(CK_VALUE);
     return;
 }
 
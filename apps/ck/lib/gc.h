@@ -26,6 +26,45 @@ Module Name:
 // ------------------------------------------------------------------- Includes
 //
 
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro must be invoked after storing a value into an object. It records
+// old objects that may now point at young objects, and objects that may have
+// changed behind an incremental collection that has already traced them.
+//
+
+#define CK_WRITE_BARRIER(_Vm, _Object)                                  \
+    {                                                                   \
+        if (((_Object)->Flags &                                         \
+             (CK_OBJECT_OLD | CK_OBJECT_REMEMBERED)) == CK_OBJECT_OLD) { \
+                                                                        \
+            CkpRememberObject((_Vm), (_Object));                        \
+        }                                                               \
+    }
+
+//
+// This macro is the write barrier for a list element. It should be used
+// instead of the regular write barrier for stores into (or moves within) a
+// list's elements, so that the collector only has to look at the part of a
+// large list that actually changed.
+//
+
+#define CK_LIST_WRITE_BARRIER(_Vm, _List, _Index)                      \
+    {                                                                   \
+        if (((_List)->Header.Flags & CK_OBJECT_REMEMBERED) != 0) {      \
+            if ((_Index) < (_List)->Dirty) {                            \
+                (_List)->Dirty = (_Index);                              \
+            }                                                           \
+                                                                        \
+        } else if (((_List)->Header.Flags & CK_OBJECT_OLD) != 0) {      \
+            CkpRememberObject((_Vm), &((_List)->Header));               \
+            (_List)->Dirty = (_Index);                                  \
+        }                                                               \
+    }
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -89,6 +128,33 @@ Return Value:
 
 --*/
 
+VOID
+CkpRememberObject (
+    PCK_VM Vm,
+    PCK_OBJECT Object
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds an old object that was just written to onto the
+    remembered set, so that the next collection traces it again. This is the
+    slow path of the write barrier. Use the CK_WRITE_BARRIER macro instead of
+    calling this directly.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Object - Supplies a pointer to the object that was modified.
+
+Return Value:
+
+    None.
+
+--*/
+
 PVOID
 CkpReallocate (
     PCK_VM Vm,
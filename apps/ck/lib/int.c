@@ -323,6 +323,54 @@ CK_PRIMITIVE_DESCRIPTION CkRangePrimitives[] = {
 // ------------------------------------------------------------------ Functions
 //
 
+CK_VALUE
+CkpIntegerCreate (
+    PCK_VM Vm,
+    CK_INTEGER Integer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates an integer value. Integers that fit are encoded
+    directly in the value, larger ones are boxed in a new object.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Integer - Supplies the integer value.
+
+Return Value:
+
+    Returns the integer value on success.
+
+    CK_NULL_VALUE on allocation failure.
+
+--*/
+
+{
+
+    PCK_BOXED_INTEGER Box;
+    CK_VALUE Value;
+
+    if (CK_INTEGER_FITS(Integer)) {
+        CK_INT_VALUE(Value, Integer);
+        return Value;
+    }
+
+    Box = CkAllocate(Vm, sizeof(CK_BOXED_INTEGER));
+    if (Box == NULL) {
+        return CkNullValue;
+    }
+
+    CkpInitializeObject(Vm, &(Box->Header), CkObjectInteger, Vm->Class.Int);
+    Box->Value = Integer;
+    CK_OBJECT_VALUE(Value, Box);
+    return Value;
+}
+
 CK_VALUE
 CkpRangeCreate (
     PCK_VM Vm,
@@ -418,7 +466,7 @@ Return Value:
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0], Integer);
+    Arguments[0] = CkpIntegerCreate(Vm, Integer);
     return TRUE;
 }
 
@@ -450,13 +498,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) + CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) + CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -489,13 +539,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer.");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) - CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) - CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -528,13 +580,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) * CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) * CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -567,13 +621,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) / CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) / CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -606,13 +662,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) % CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) % CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -645,13 +703,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) & CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) & CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -684,13 +744,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) | CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) | CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -723,13 +785,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) ^ CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) ^ CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -762,13 +826,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) << CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) << CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -801,13 +867,15 @@ Return Value:
 
 {
 
+    CK_INTEGER Result;
+
     if (!CK_IS_INTEGER(Arguments[1])) {
         CkpRuntimeError(Vm, "TypeError", "Expected an integer");
         return FALSE;
     }
 
-    CK_INT_VALUE(Arguments[0],
-                 CK_AS_INTEGER(Arguments[0]) >> CK_AS_INTEGER(Arguments[1]));
+    Result = CK_AS_INTEGER(Arguments[0]) >> CK_AS_INTEGER(Arguments[1]);
+    Arguments[0] = CkpIntegerCreate(Vm, Result);
 
     return TRUE;
 }
@@ -1168,7 +1236,7 @@ Return Value:
 
 {
 
-    CK_INT_VALUE(Arguments[0], -CK_AS_INTEGER(Arguments[0]));
+    Arguments[0] = CkpIntegerCreate(Vm, -CK_AS_INTEGER(Arguments[0]));
     return TRUE;
 }
 
@@ -1232,7 +1300,7 @@ Return Value:
 
 {
 
-    CK_INT_VALUE(Arguments[0], ~CK_AS_INTEGER(Arguments[0]));
+    Arguments[0] = CkpIntegerCreate(Vm, ~CK_AS_INTEGER(Arguments[0]));
     return TRUE;
 }
 
@@ -1264,7 +1332,7 @@ Return Value:
 
 {
 
-    CK_INT_VALUE(Arguments[0], CK_AS_INTEGER(Arguments[0]) + 1);
+    Arguments[0] = CkpIntegerCreate(Vm, CK_AS_INTEGER(Arguments[0]) + 1);
     return TRUE;
 }
 
@@ -1296,7 +1364,7 @@ Return Value:
 
 {
 
-    CK_INT_VALUE(Arguments[0], CK_AS_INTEGER(Arguments[0]) - 1);
+    Arguments[0] = CkpIntegerCreate(Vm, CK_AS_INTEGER(Arguments[0]) - 1);
     return TRUE;
 }
 
@@ -1416,7 +1484,7 @@ Return Value:
     PCK_RANGE Range;
 
     Range = CK_AS_RANGE(Arguments[0]);
-    CK_INT_VALUE(Arguments[0], Range->From);
+    Arguments[0] = CkpIntegerCreate(Vm, Range->From);
     return TRUE;
 }
 
@@ -1452,7 +1520,7 @@ Return Value:
     PCK_RANGE Range;
 
     Range = CK_AS_RANGE(Arguments[0]);
-    CK_INT_VALUE(Arguments[0], Range->To);
+    Arguments[0] = CkpIntegerCreate(Vm, Range->To);
     return TRUE;
 }
 
@@ -1488,10 +1556,10 @@ Return Value:
 
     Range = CK_AS_RANGE(Arguments[0]);
     if (Range->From < Range->To) {
-        CK_INT_VALUE(Arguments[0], Range->From);
+        Arguments[0] = CkpIntegerCreate(Vm, Range->From);
 
     } else {
-        CK_INT_VALUE(Arguments[0], Range->To);
+        Arguments[0] = CkpIntegerCreate(Vm, Range->To);
     }
 
     return TRUE;
@@ -1529,10 +1597,10 @@ Return Value:
 
     Range = CK_AS_RANGE(Arguments[0]);
     if (Range->From > Range->To) {
-        CK_INT_VALUE(Arguments[0], Range->From);
+        Arguments[0] = CkpIntegerCreate(Vm, Range->From);
 
     } else {
-        CK_INT_VALUE(Arguments[0], Range->To);
+        Arguments[0] = CkpIntegerCreate(Vm, Range->To);
     }
 
     return TRUE;
@@ -1615,7 +1683,7 @@ Return Value:
     //
 
     if (CK_IS_NULL(Arguments[1])) {
-        CK_INT_VALUE(Arguments[0], Range->From);
+        Arguments[0] = CkpIntegerCreate(Vm, Range->From);
         return TRUE;
     }
 
@@ -1654,7 +1722,7 @@ Return Value:
         return TRUE;
     }
 
-    CK_INT_VALUE(Arguments[0], Integer);
+    Arguments[0] = CkpIntegerCreate(Vm, Integer);
     return TRUE;
 }
 
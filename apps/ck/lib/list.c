@@ -199,6 +199,7 @@ Return Value:
     List->Elements.Data = Array;
     List->Elements.Count = ElementCount;
     List->Elements.Capacity = ElementCount;
+    List->Dirty = 0;
     return List;
 }
 
@@ -296,6 +297,7 @@ Return Value:
     }
 
     List->Elements.Data[Index] = Element;
+    CK_LIST_WRITE_BARRIER(Vm, List, Index);
     return;
 }
 
@@ -353,6 +355,18 @@ Return Value:
         List->Elements.Data[MoveIndex] = List->Elements.Data[MoveIndex + 1];
     }
 
+    //
+    // Shifting elements down doesn't add anything new to the list, but it can
+    // move a recently stored element below the part of the list the garbage
+    // collector knows to look at.
+    //
+
+    if (((List->Header.Flags & CK_OBJECT_REMEMBERED) != 0) &&
+        (Index < List->Dirty)) {
+
+        List->Dirty = Index;
+    }
+
     //
     // Potentially shrink the list if it's gotten too small.
     //
@@ -415,6 +429,8 @@ Return Value:
 
 {
 
+    UINTN Start;
+
     if (Destination == NULL) {
         Destination = CkpListCreate(Vm, Source->Elements.Count);
         if (Destination == NULL) {
@@ -428,11 +444,13 @@ Return Value:
         return Destination;
     }
 
+    Start = Destination->Elements.Count;
     CkpFillArray(Vm,
                  &(Destination->Elements),
                  Source->Elements.Data,
                  Source->Elements.Count);
 
+    CK_LIST_WRITE_BARRIER(Vm, Destination, Start);
     return Destination;
 }
 
@@ -1004,6 +1022,7 @@ Return Value:
     }
 
     List->Elements.Data[Index] = Arguments[2];
+    CK_LIST_WRITE_BARRIER(Vm, List, Index);
     Arguments[0] = Arguments[2];
     return TRUE;
 }
@@ -440,6 +440,7 @@ Return Value:
         }
 
         Module->Closure = Closure;
+        CK_WRITE_BARRIER(Vm, &(Module->Header));
     }
 
     Module->CompiledVariableCount = Module->VariableNames.List.Count;
@@ -534,6 +535,7 @@ Return Value:
     }
 
     Module->Closure = Closure;
+    CK_WRITE_BARRIER(Vm, &(Module->Header));
     return Module;
 }
 
@@ -673,6 +675,7 @@ Return Value:
     }
 
     CkpInitializeArray(&(Module->Variables));
+    CK_WRITE_BARRIER(Vm, &(Module->Header));
 
 ModuleCreateEnd:
     CkpPopRoot(Vm);
@@ -821,6 +824,7 @@ Return Value:
     }
 
     Fiber->Caller = Vm->Fiber;
+    CK_WRITE_BARRIER(Vm, &(Vm->Fiber->Header));
     Vm->Fiber = Fiber;
 
     //
@@ -1108,6 +1112,7 @@ Return Value:
     }
 
     *Variable = Arguments[2];
+    CK_WRITE_BARRIER(Vm, &(Module->Header));
     Arguments[0] = Arguments[2];
     return TRUE;
 }
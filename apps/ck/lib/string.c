@@ -37,6 +37,27 @@ Module Name:
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the longest string that gets interned automatically when created.
+// Longer strings are only interned when used as dictionary keys.
+//
+
+#define CK_STRING_INTERN_LENGTH 32
+
+//
+// Define the initial size of the string intern table.
+//
+
+#define CK_STRING_INTERN_MIN_CAPACITY 256
+
+//
+// This macro returns the distance an interned string at the given slot is
+// from its ideal slot.
+//
+
+#define CK_INTERN_DISTANCE(_Hash, _Slot, _Mask) \
+    (((_Slot) - ((_Hash) & (_Mask))) & (_Mask))
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -211,6 +232,25 @@ CkpStringSliceBytes (
     UINTN Count
     );
 
+PCK_STRING
+CkpStringFindInterned (
+    PCK_VM Vm,
+    PCK_STRING Key
+    );
+
+BOOL
+CkpStringResizeInternTable (
+    PCK_VM Vm,
+    UINTN NewCapacity
+    );
+
+VOID
+CkpStringInsertInterned (
+    PCK_STRING *Table,
+    UINTN Mask,
+    PCK_STRING String
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -279,7 +319,9 @@ Routine Description:
 
 Return Value:
 
-    Returns the new string value on success.
+    Returns the new string value on success. Short strings may come back as
+    an existing interned string with the same contents, so the caller must not
+    modify the result.
 
     CK_NULL_VALUE on allocation failure.
 
@@ -287,9 +329,28 @@ Return Value:
 
 {
 
+    BOOL Intern;
+    PCK_STRING Interned;
+    CK_STRING Key;
     PCK_STRING String;
     CK_VALUE Value;
 
+    //
+    // Short strings are looked up in the intern table first, so that common
+    // identifiers and keys share a single object.
+    //
+
+    Intern = FALSE;
+    if ((Text != NULL) && (Length <= CK_STRING_INTERN_LENGTH)) {
+        Intern = TRUE;
+        CkpStringFake(&Key, Text, Length);
+        Interned = CkpStringFindInterned(Vm, &Key);
+        if (Interned != NULL) {
+            CK_OBJECT_VALUE(Value, Interned);
+            return Value;
+        }
+    }
+
     String = CkpStringAllocate(Vm, Length);
     if (String == NULL) {
         return CK_NULL_VALUE;
@@ -299,7 +360,14 @@ Return Value:
         memcpy((PSTR)(String->Value), Text, Length);
     }
 
-    CkpStringHash(String);
+    if (Intern != FALSE) {
+        String->Hash = Key.Hash;
+        String = CkpStringIntern(Vm, String);
+
+    } else {
+        CkpStringHash(String);
+    }
+
     CK_OBJECT_VALUE(Value, String);
     return Value;
 }
@@ -1067,6 +1135,7 @@ Return Value:
     FakeStringObject->Header.Type = CkObjectString;
     FakeStringObject->Header.Next = NULL;
     FakeStringObject->Header.Class = NULL;
+    FakeStringObject->Header.Flags = 0;
     FakeStringObject->Length = Length;
     FakeStringObject->Value = String;
     CkpStringHash(FakeStringObject);
@@ -1074,6 +1143,138 @@ Return Value:
     return Value;
 }
 
+PCK_STRING
+CkpStringIntern (
+    PCK_VM Vm,
+    PCK_STRING String
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the canonical copy of the given string from the
+    intern table, adding the given string to the table if no string with the
+    same contents is there yet.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    String - Supplies a pointer to the string to intern. The string must
+        already be hashed.
+
+Return Value:
+
+    Returns a pointer to the interned string with the same contents.
+
+    Returns the original string if it could not be added to the table due to
+    allocation failure.
+
+--*/
+
+{
+
+    PCK_STRING Interned;
+    UINTN NewCapacity;
+
+    if ((String->Header.Flags & CK_OBJECT_INTERNED) != 0) {
+        return String;
+    }
+
+    Interned = CkpStringFindInterned(Vm, String);
+    if (Interned != NULL) {
+        return Interned;
+    }
+
+    //
+    // Keep the table at most three quarters full so that probe sequences stay
+    // short. The table is allocated outside the garbage collector, so growing
+    // it never kicks off a collection.
+    //
+
+    if ((Vm->InternCount + 1) > (Vm->InternCapacity / 4 * 3)) {
+        NewCapacity = Vm->InternCapacity * 2;
+        if (NewCapacity < CK_STRING_INTERN_MIN_CAPACITY) {
+            NewCapacity = CK_STRING_INTERN_MIN_CAPACITY;
+        }
+
+        if (CkpStringResizeInternTable(Vm, NewCapacity) == FALSE) {
+            return String;
+        }
+    }
+
+    String->Header.Flags |= CK_OBJECT_INTERNED;
+    CkpStringInsertInterned(Vm->InternTable, Vm->InternCapacity - 1, String);
+    Vm->InternCount += 1;
+    return String;
+}
+
+VOID
+CkpStringUnintern (
+    PCK_VM Vm,
+    PCK_STRING String
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes an interned string from the intern table. This is
+    called when the string is being destroyed.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    String - Supplies a pointer to the interned string.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Mask;
+    UINTN Next;
+    UINTN Slot;
+    PCK_STRING *Table;
+
+    CK_ASSERT((String->Header.Flags & CK_OBJECT_INTERNED) != 0);
+    CK_ASSERT(Vm->InternCount != 0);
+
+    Table = Vm->InternTable;
+    Mask = Vm->InternCapacity - 1;
+    Slot = String->Hash & Mask;
+    while (Table[Slot] != String) {
+
+        CK_ASSERT(Table[Slot] != NULL);
+
+        Slot = (Slot + 1) & Mask;
+    }
+
+    //
+    // Shift the following entries back a slot until one is found that is
+    // already in its ideal position. This keeps the table free of tombstones.
+    //
+
+    Next = (Slot + 1) & Mask;
+    while ((Table[Next] != NULL) &&
+           (CK_INTERN_DISTANCE(Table[Next]->Hash, Next, Mask) != 0)) {
+
+        Table[Slot] = Table[Next];
+        Slot = Next;
+        Next = (Next + 1) & Mask;
+    }
+
+    Table[Slot] = NULL;
+    Vm->InternCount -= 1;
+    String->Header.Flags &= ~CK_OBJECT_INTERNED;
+    return;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -1657,19 +1858,27 @@ Return Value:
     PCK_STRING Source;
     PSTR String;
 
+    //
+    // Allocate the copy directly rather than creating it from the source
+    // text, since short created strings may be shared through the intern
+    // table and must not be modified.
+    //
+
     Source = CK_AS_STRING(Arguments[0]);
-    Arguments[0] = CkpStringCreate(Vm, Source->Value, Source->Length);
-    if (CK_IS_NULL(Arguments[0])) {
+    Copy = CkpStringAllocate(Vm, Source->Length);
+    if (Copy == NULL) {
+        Arguments[0] = CkNullValue;
         return TRUE;
     }
 
-    Copy = CK_AS_STRING(Arguments[0]);
     String = (PSTR)(Copy->Value);
     for (Index = 0; Index < Copy->Length; Index += 1) {
-        *String = tolower(*String);
+        *String = tolower(Source->Value[Index]);
         String += 1;
     }
 
+    CkpStringHash(Copy);
+    CK_OBJECT_VALUE(Arguments[0], Copy);
     return TRUE;
 }
 
@@ -1707,19 +1916,27 @@ Return Value:
     PCK_STRING Source;
     PSTR String;
 
+    //
+    // Allocate the copy directly rather than creating it from the source
+    // text, since short created strings may be shared through the intern
+    // table and must not be modified.
+    //
+
     Source = CK_AS_STRING(Arguments[0]);
-    Arguments[0] = CkpStringCreate(Vm, Source->Value, Source->Length);
-    if (CK_IS_NULL(Arguments[0])) {
+    Copy = CkpStringAllocate(Vm, Source->Length);
+    if (Copy == NULL) {
+        Arguments[0] = CkNullValue;
         return TRUE;
     }
 
-    Copy = CK_AS_STRING(Arguments[0]);
     String = (PSTR)(Copy->Value);
     for (Index = 0; Index < Copy->Length; Index += 1) {
-        *String = toupper(*String);
+        *String = toupper(Source->Value[Index]);
         String += 1;
     }
 
+    CkpStringHash(Copy);
+    CK_OBJECT_VALUE(Arguments[0], Copy);
     return TRUE;
 }
 
@@ -2955,3 +3172,186 @@ Return Value:
     return CkpStringCreate(Vm, Source->Value + Start, Count);
 }
 
+PCK_STRING
+CkpStringFindInterned (
+    PCK_VM Vm,
+    PCK_STRING Key
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up a string in the intern table.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Key - Supplies a pointer to the hashed string to look for. This may be a
+        fake string.
+
+Return Value:
+
+    Returns a pointer to the interned string with the same contents on success.
+
+    NULL if no such string is interned.
+
+--*/
+
+{
+
+    UINTN Distance;
+    PCK_STRING Entry;
+    UINTN Mask;
+    UINTN Slot;
+
+    if (Vm->InternCount == 0) {
+        return NULL;
+    }
+
+    Mask = Vm->InternCapacity - 1;
+    Slot = Key->Hash & Mask;
+    Distance = 0;
+
+    //
+    // The table is never full, so the probe always hits an empty slot or an
+    // entry closer to home than the key would be, both of which end the
+    // search.
+    //
+
+    while (TRUE) {
+        Entry = Vm->InternTable[Slot];
+        if ((Entry == NULL) ||
+            (CK_INTERN_DISTANCE(Entry->Hash, Slot, Mask) < Distance)) {
+
+            break;
+        }
+
+        if ((Entry->Hash == Key->Hash) &&
+            (Entry->Length == Key->Length) &&
+            (CkCompareMemory(Entry->Value, Key->Value, Key->Length) == 0)) {
+
+            return Entry;
+        }
+
+        Slot = (Slot + 1) & Mask;
+        Distance += 1;
+    }
+
+    return NULL;
+}
+
+BOOL
+CkpStringResizeInternTable (
+    PCK_VM Vm,
+    UINTN NewCapacity
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resizes the string intern table.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    NewCapacity - Supplies the new number of slots, which must be a power of
+        two.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on allocation failure. The old table is left intact.
+
+--*/
+
+{
+
+    UINTN Index;
+    PCK_STRING *NewTable;
+
+    CK_ASSERT((NewCapacity & (NewCapacity - 1)) == 0);
+    CK_ASSERT(NewCapacity > Vm->InternCount);
+
+    NewTable = CkRawReallocate(Vm, NULL, NewCapacity * sizeof(PCK_STRING));
+    if (NewTable == NULL) {
+        return FALSE;
+    }
+
+    CkZero(NewTable, NewCapacity * sizeof(PCK_STRING));
+    for (Index = 0; Index < Vm->InternCapacity; Index += 1) {
+        if (Vm->InternTable[Index] != NULL) {
+            CkpStringInsertInterned(NewTable,
+                                    NewCapacity - 1,
+                                    Vm->InternTable[Index]);
+        }
+    }
+
+    if (Vm->InternTable != NULL) {
+        CkRawFree(Vm, Vm->InternTable);
+    }
+
+    Vm->InternTable = NewTable;
+    Vm->InternCapacity = NewCapacity;
+    return TRUE;
+}
+
+VOID
+CkpStringInsertInterned (
+    PCK_STRING *Table,
+    UINTN Mask,
+    PCK_STRING String
+    )
+
+/*++
+
+Routine Description:
+
+    This routine inserts a string into an intern table that is known not to
+    already contain a string with the same contents, and has at least one free
+    slot. Strings that are further from their ideal slot take the place of
+    strings closer to theirs as the probe goes along.
+
+Arguments:
+
+    Table - Supplies a pointer to the intern table.
+
+    Mask - Supplies the number of slots in the table minus one.
+
+    String - Supplies a pointer to the string to insert.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Distance;
+    UINTN ExistingDistance;
+    PCK_STRING Swap;
+    UINTN Slot;
+
+    Slot = String->Hash & Mask;
+    Distance = 0;
+    while (Table[Slot] != NULL) {
+        ExistingDistance = CK_INTERN_DISTANCE(Table[Slot]->Hash, Slot, Mask);
+        if (ExistingDistance < Distance) {
+            Swap = Table[Slot];
+            Table[Slot] = String;
+            String = Swap;
+            Distance = ExistingDistance;
+        }
+
+        Slot = (Slot + 1) & Mask;
+        Distance += 1;
+    }
+
+    Table[Slot] = String;
+    return;
+}
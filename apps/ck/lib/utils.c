@@ -211,6 +211,17 @@ Return Value:
         return CK_AS_INTEGER(Index);
     }
 
+    //
+    // Put the canonical copy of the string in both the dictionary and the
+    // list. The dictionary interns its keys, so handing it a duplicate would
+    // leave the list as the only reference to a string that the dictionary
+    // did not keep, and growing the list could then collect it.
+    //
+
+    if (CK_IS_STRING(String)) {
+        CK_OBJECT_VALUE(String, CkpStringIntern(Vm, CK_AS_STRING(String)));
+    }
+
     CK_INT_VALUE(Index, StringTable->List.Count);
     CkpDictSet(Vm, StringTable->Dict, String, Index);
     CkpArrayAppend(Vm, &(StringTable->List), String);
@@ -259,6 +270,11 @@ Return Value:
         return -1;
     }
 
+    //
+    // Add the canonical copy of the string, as above.
+    //
+
+    CK_OBJECT_VALUE(String, CkpStringIntern(Vm, CK_AS_STRING(String)));
     CK_INT_VALUE(Index, StringTable->List.Count);
     CkpDictSet(Vm, StringTable->Dict, String, Index);
     CkpArrayAppend(Vm, &(StringTable->List), String);
@@ -48,10 +48,10 @@ Module Name:
 // -------------------------------------------------------------------- Globals
 //
 
-const CK_VALUE CkNullValue = {CkValueNull, {0}};
-const CK_VALUE CkUndefinedValue = {CkValueUndefined, {0}};
-const CK_VALUE CkZeroValue = {CkValueInteger, {0}};
-const CK_VALUE CkOneValue = {CkValueInteger, {1}};
+const CK_VALUE CkNullValue = {CK_VALUE_NULL_BITS};
+const CK_VALUE CkUndefinedValue = {CK_VALUE_UNDEFINED_BITS};
+const CK_VALUE CkZeroValue = {(0 << 1) | CK_VALUE_INTEGER_TAG};
+const CK_VALUE CkOneValue = {(1 << 1) | CK_VALUE_INTEGER_TAG};
 
 //
 // ------------------------------------------------------------------ Functions
@@ -319,6 +319,10 @@ Return Value:
         CkpClearArray(Vm, &(Function->Constants));
         CkpClearArray(Vm, &(Function->Code));
         CkpClearArray(Vm, &(Function->Debug.LineProgram));
+        if (Function->CallCaches != NULL) {
+            CkFree(Vm, Function->CallCaches);
+        }
+
         break;
 
     case CkObjectForeign:
@@ -339,18 +343,28 @@ Return Value:
         break;
 
     case CkObjectDict:
-        CkFree(Vm, ((PCK_DICT)Object)->Entries);
+        if (((PCK_DICT)Object)->Entries != NULL) {
+            CkFree(Vm, ((PCK_DICT)Object)->Entries);
+        }
+
         break;
 
     case CkObjectModule:
         CkpModuleDestroy(Vm, (PCK_MODULE)Object);
         break;
 
+    case CkObjectString:
+        if ((Object->Flags & CK_OBJECT_INTERNED) != 0) {
+            CkpStringUnintern(Vm, (PCK_STRING)Object);
+        }
+
+        break;
+
     case CkObjectClass:
     case CkObjectClosure:
     case CkObjectInstance:
+    case CkObjectInteger:
     case CkObjectRange:
-    case CkObjectString:
     case CkObjectUpvalue:
         break;
 
@@ -398,6 +412,7 @@ Return Value:
 {
 
     Object->Type = Type;
+    Object->Flags = 0;
     Object->NextKiss = NULL;
     Object->Class = Class;
     Object->Next = Vm->FirstObject;
@@ -468,7 +483,18 @@ Return Value:
 
         break;
 
+    //
+    // There is only ever one interned string with given contents, so two
+    // different interned strings are never equal.
+    //
+
     case CkObjectString:
+        if ((LeftObject->Flags & RightObject->Flags &
+             CK_OBJECT_INTERNED) != 0) {
+
+            break;
+        }
+
         LeftString = (PCK_STRING)LeftObject;
         RightString = (PCK_STRING)RightObject;
         if ((LeftString->Hash == RightString->Hash) &&
@@ -520,18 +546,20 @@ Return Value:
 
 {
 
-    if (Left.Type != Right.Type) {
-        return FALSE;
+    if (Left.Bits == Right.Bits) {
+        return TRUE;
     }
 
-    if (Left.Type == CkValueInteger) {
-        return Left.U.Integer == Right.U.Integer;
+    //
+    // Integers are always encoded the same way, so the only way for two
+    // different encodings to be the same value is with two boxed integers.
+    //
 
-    } else if (Left.Type == CkValueNull) {
-        return TRUE;
+    if ((CK_IS_BOXED_INTEGER(Left)) && (CK_IS_BOXED_INTEGER(Right))) {
+        return CK_AS_INTEGER(Left) == CK_AS_INTEGER(Right);
     }
 
-    return Left.U.Object == Right.U.Object;
+    return FALSE;
 }
 
 BOOL
@@ -559,22 +587,16 @@ Return Value:
 
 {
 
-    switch (Value.Type) {
-    case CkValueNull:
-    case CkValueUndefined:
-        return FALSE;
+    //
+    // Boxed integers are never zero, so like other objects they are always
+    // true.
+    //
 
-    case CkValueInteger:
+    if (CK_IS_SMALL_INTEGER(Value)) {
         return CK_AS_INTEGER(Value) != 0;
 
-    case CkValueObject:
-        break;
-
-    default:
-
-        CK_ASSERT(FALSE);
-
-        break;
+    } else if ((CK_IS_NULL(Value)) || (CK_IS_UNDEFINED(Value))) {
+        return FALSE;
     }
 
     return TRUE;
@@ -608,24 +630,18 @@ Return Value:
 
 {
 
-    switch (Value.Type) {
-    case CkValueNull:
-        return Vm->Class.Null;
-
-    case CkValueInteger:
+    if (CK_IS_SMALL_INTEGER(Value)) {
         return Vm->Class.Int;
 
-    case CkValueObject:
+    } else if (CK_IS_OBJECT(Value)) {
         return CK_AS_OBJECT(Value)->Class;
 
-    case CkValueUndefined:
-    default:
-
-        CK_ASSERT(FALSE);
-
-        break;
+    } else if (CK_IS_NULL(Value)) {
+        return Vm->Class.Null;
     }
 
+    CK_ASSERT(FALSE);
+
     return NULL;
 }
 
@@ -682,6 +698,14 @@ Return Value:
         return NULL;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Class->Header));
+
+    //
+    // A new class may occupy the memory of a freed one, so invalidate any
+    // inline caches that might still refer to the old class.
+    //
+
+    Vm->MethodEpoch += 1;
     return Class;
 }
 
@@ -722,6 +746,7 @@ Return Value:
 
     CK_OBJECT_VALUE(Value, Closure);
     CkpDictSet(Vm, Class->Methods, Signature, Value);
+    Vm->MethodEpoch += 1;
 
     //
     // Bind the closure to the class, so that when it's run it knows 1) where
@@ -729,6 +754,7 @@ Return Value:
     //
 
     Closure->Class = Class;
+    CK_WRITE_BARRIER(Vm, &(Closure->Header));
     return;
 }
 
@@ -763,12 +789,14 @@ Return Value:
 
     Class->Super = Super;
     Class->SuperFieldCount = Super->FieldCount;
+    CK_WRITE_BARRIER(Vm, &(Class->Header));
 
     //
     // Copy all the methods in the superclass to this class.
     //
 
     CkpDictCombine(Vm, Class->Methods, Super->Methods);
+    Vm->MethodEpoch += 1;
     return;
 }
 
@@ -31,16 +31,27 @@ Module Name:
 
 //
 // These macros evaluates to non-zero if the given value is of the named type.
+// Integers too big to be encoded directly are boxed in an object, so they
+// are both integers and objects.
 //
 
-#define CK_IS_OBJECT(_Value) ((_Value).Type == CkValueObject)
-#define CK_IS_NULL(_Value) ((_Value).Type == CkValueNull)
-#define CK_IS_INTEGER(_Value) ((_Value).Type == CkValueInteger)
-#define CK_IS_UNDEFINED(_Value) ((_Value).Type == CkValueUndefined)
+#define CK_IS_OBJECT(_Value)                        \
+    ((((_Value).Bits & CK_VALUE_TAG_MASK) == 0) &&  \
+     ((_Value).Bits != CK_VALUE_UNDEFINED_BITS))
+
+#define CK_IS_NULL(_Value) ((_Value).Bits == CK_VALUE_NULL_BITS)
+#define CK_IS_UNDEFINED(_Value) ((_Value).Bits == CK_VALUE_UNDEFINED_BITS)
+#define CK_IS_SMALL_INTEGER(_Value) \
+    (((_Value).Bits & CK_VALUE_INTEGER_TAG) != 0)
+
+#define CK_IS_INTEGER(_Value) \
+    ((CK_IS_SMALL_INTEGER(_Value)) || (CK_IS_BOXED_INTEGER(_Value)))
 
 #define CK_IS_OBJECT_TYPE(_Value, _Type) \
     ((CK_IS_OBJECT(_Value)) && (CK_AS_OBJECT(_Value)->Type == (_Type)))
 
+#define CK_IS_BOXED_INTEGER(_Value) CK_IS_OBJECT_TYPE(_Value, CkObjectInteger)
+
 #define CK_IS_CLASS(_Value) CK_IS_OBJECT_TYPE(_Value, CkObjectClass)
 #define CK_IS_CLOSURE(_Value) CK_IS_OBJECT_TYPE(_Value, CkObjectClosure)
 #define CK_IS_FIBER(_Value) CK_IS_OBJECT_TYPE(_Value, CkObjectFiber)
@@ -58,8 +69,11 @@ Module Name:
 // This macro evaluates to the object pointer within a given value.
 //
 
-#define CK_AS_OBJECT(_Value) ((_Value).U.Object)
-#define CK_AS_INTEGER(_Value) ((_Value).U.Integer)
+#define CK_AS_OBJECT(_Value) ((PCK_OBJECT)(UINTN)((_Value).Bits))
+#define CK_AS_INTEGER(_Value)                               \
+    ((CK_IS_SMALL_INTEGER(_Value)) ?                        \
+     ((CK_INTEGER)((_Value).Bits) >> 1) :                   \
+     (((PCK_BOXED_INTEGER)CK_AS_OBJECT(_Value))->Value))
 
 #define CK_AS_CLASS(_Value) ((PCK_CLASS)CK_AS_OBJECT(_Value))
 #define CK_AS_CLOSURE(_Value) ((PCK_CLOSURE)CK_AS_OBJECT(_Value))
@@ -75,19 +89,29 @@ Module Name:
 #define CK_AS_UPVALUE(_Value) ((PCK_UPVALUE)CK_AS_OBJECT(_Value))
 
 //
-// These macros initialize a value with the given object or primitive.
+// This macro evaluates to non-zero if the given integer can be encoded
+// directly in a value without being boxed.
+//
+
+#define CK_INTEGER_FITS(_Integer) \
+    (((_Integer) >= CK_SMALL_INT_MIN) && ((_Integer) <= CK_SMALL_INT_MAX))
+
+//
+// These macros initialize a value with the given object or primitive. The
+// integer macro can only be used for integers known to fit in a small
+// integer, like sizes, indices, and booleans. Use CkpIntegerCreate for
+// arbitrary integers.
 //
 
-#define CK_OBJECT_VALUE(_Value, _Object)            \
-    {                                               \
-        (_Value).Type = CkValueObject;              \
-        (_Value).U.Object = (PCK_OBJECT)(_Object);  \
+#define CK_OBJECT_VALUE(_Value, _Object)                \
+    {                                                   \
+        (_Value).Bits = (ULONGLONG)(UINTN)(_Object);    \
     }
 
-#define CK_INT_VALUE(_Value, _Integer)      \
-    {                                       \
-        (_Value).Type = CkValueInteger;     \
-        (_Value).U.Integer = (_Integer);    \
+#define CK_INT_VALUE(_Value, _Integer)                              \
+    {                                                               \
+        (_Value).Bits = ((ULONGLONG)(CK_INTEGER)(_Integer) << 1) |  \
+                        CK_VALUE_INTEGER_TAG;                       \
     }
 
 //
@@ -105,6 +129,39 @@ Module Name:
 #define CK_FALSE_VALUE CK_ZERO_VALUE
 #define CK_TRUE_VALUE CK_ONE_VALUE
 
+//
+// Define the value encoding. Values are a single 64-bit word. If the lowest
+// bit is set, the upper 63 bits are a signed integer. Otherwise, if the low
+// two bits are clear the value is a pointer to an object, except that zero is
+// the undefined value. Null is encoded as a special non-pointer constant.
+// Objects are always at least four byte aligned.
+//
+
+#define CK_VALUE_INTEGER_TAG 0x1ULL
+#define CK_VALUE_TAG_MASK 0x3ULL
+#define CK_VALUE_UNDEFINED_BITS 0x0ULL
+#define CK_VALUE_NULL_BITS 0x2ULL
+
+//
+// Define the range of integers that can be encoded directly in a value.
+// Integers outside this range are boxed.
+//
+
+#define CK_SMALL_INT_MAX 0x3FFFFFFFFFFFFFFFLL
+#define CK_SMALL_INT_MIN (-CK_SMALL_INT_MAX - 1)
+
+//
+// Define object garbage collection flags. Old objects have survived a
+// collection of the young generation. Remembered objects are old objects
+// that have been written to since the last collection, and so might point at
+// objects that haven't been traced. Interned strings live in the VM's string
+// intern table, and are the only string with their contents in that table.
+//
+
+#define CK_OBJECT_OLD 0x00000001
+#define CK_OBJECT_REMEMBERED 0x00000002
+#define CK_OBJECT_INTERNED 0x00000004
+
 //
 // Define the class special behavior flags.
 //
@@ -113,11 +170,19 @@ Module Name:
 #define CK_CLASS_SPECIAL_CREATION 0x00000002
 #define CK_CLASS_FOREIGN 0x00000004
 
+//
+// Define the number of receiver classes each call site remembers before
+// evicting the oldest one.
+//
+
+#define CK_CALL_CACHE_ENTRIES 4
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
 typedef struct _CK_CLASS CK_CLASS, *PCK_CLASS;
+typedef struct _CK_CLOSURE CK_CLOSURE, *PCK_CLOSURE;
 typedef struct _CK_FIBER CK_FIBER, *PCK_FIBER;
 typedef struct _CK_OBJECT CK_OBJECT, *PCK_OBJECT;
 typedef struct _CK_UPVALUE CK_UPVALUE, *PCK_UPVALUE;
@@ -137,6 +202,7 @@ typedef enum _CK_OBJECT_TYPE {
     CkObjectForeign,
     CkObjectFunction,
     CkObjectInstance,
+    CkObjectInteger,
     CkObjectList,
     CkObjectModule,
     CkObjectRange,
@@ -145,13 +211,6 @@ typedef enum _CK_OBJECT_TYPE {
     CkObjectTypeCount
 } CK_OBJECT_TYPE, *PCK_OBJECT_TYPE;
 
-typedef enum _CK_VALUE_TYPE {
-    CkValueUndefined,
-    CkValueNull,
-    CkValueInteger,
-    CkValueObject
-} CK_VALUE_TYPE, *PCK_VALUE_TYPE;
-
 typedef enum _CK_CLOSURE_TYPE {
     CkClosureInvalid,
     CkClosurePrimitive,
@@ -273,11 +332,14 @@ Structure Description:
     Type - Stores the type of the object, which defines the parent type this
         structure is embedded in.
 
+    Flags - Stores garbage collection flags for the object. See CK_OBJECT_*
+        definitions.
+
     NextKiss - Stores a pointer to the next object in the list of kissed
         objects (objects that will not get garbage collected this time).
 
-    Next - Stores a pointer to the next object in the global list of all
-        objects.
+    Next - Stores a pointer to the next object in the list of objects of the
+        same generation.
 
     Class - Stores a pointer to the class this object belongs to.
 
@@ -285,6 +347,7 @@ Structure Description:
 
 struct _CK_OBJECT {
     CK_OBJECT_TYPE Type;
+    ULONG Flags;
     PCK_OBJECT NextKiss;
     PCK_OBJECT Next;
     PCK_CLASS Class;
@@ -298,26 +361,38 @@ Structure Description:
 
 Members:
 
-    Type - Stores the object type. The really basic types like null and
-        integers are encoded directly in the value. Most everything else is a
-        pointer to an object.
-
-    U - Stores the union of either the directly encoded value, or the pointer
-        to the object.
+    Bits - Stores the encoded value. The really basic types like null and
+        most integers are encoded directly in the value. Everything else is a
+        pointer to an object. See CK_VALUE_* definitions for the encoding.
 
 --*/
 
 struct _CK_VALUE {
-    CK_VALUE_TYPE Type;
-    union {
-        CK_INTEGER Integer;
-        PCK_OBJECT Object;
-    } U;
-
+    ULONGLONG Bits;
 };
 
 /*++
 
+Structure Description:
+
+    This structure contains an integer that is too large to be encoded
+    directly in a value.
+
+Members:
+
+    Header - Stores the object header.
+
+    Value - Stores the integer value.
+
+--*/
+
+typedef struct _CK_BOXED_INTEGER {
+    CK_OBJECT Header;
+    CK_INTEGER Value;
+} CK_BOXED_INTEGER, *PCK_BOXED_INTEGER;
+
+/*++
+
 Structure Description:
 
     This structure contains the official object form of a string.
@@ -395,7 +470,9 @@ typedef struct _CK_DICT_ENTRY {
 
 Structure Description:
 
-    This structure encapsulates a hash table dictionary.
+    This structure encapsulates a hash table dictionary. The table uses Robin
+    Hood linear probing, and the hash of each key is stored in a separate array
+    so that probes can skip most key comparisons.
 
 Members:
 
@@ -403,10 +480,15 @@ Structure Description:
 
     Count - Stores the number of values in the dictionary.
 
-    Capacity - Stores the size of the entries array.
+    Capacity - Stores the size of the entries array. This is always zero or a
+        power of two.
 
     Entries - Stores a pointer to the entries.
 
+    Hashes - Stores a pointer to the array of key hashes, parallel to the
+        entries array. A hash of zero marks an empty slot. This array is part
+        of the same allocation as the entries.
+
 --*/
 
 typedef struct _CK_DICT {
@@ -414,6 +496,7 @@ typedef struct _CK_DICT {
     UINTN Count;
     UINTN Capacity;
     PCK_DICT_ENTRY Entries;
+    PULONG Hashes;
 } CK_DICT, *PCK_DICT;
 
 /*++
@@ -462,6 +545,32 @@ typedef struct _CK_FUNCTION_DEBUG {
 
 /*++
 
+Structure Description:
+
+    This structure defines the inline method cache for a single call site. It
+    remembers the methods found for the last few receiver classes seen at the
+    site, so that calls on those classes skip the method dictionary lookup.
+
+Members:
+
+    Epoch - Stores the VM method epoch the entries were filled in under. If
+        any class's methods have changed since, the entries are discarded.
+
+    Classes - Stores the receiver classes in the order they were added. Unused
+        entries are NULL.
+
+    Methods - Stores the method found for each class in the classes array.
+
+--*/
+
+typedef struct _CK_CALL_CACHE {
+    UINTN Epoch;
+    PCK_CLASS Classes[CK_CALL_CACHE_ENTRIES];
+    PCK_CLOSURE Methods[CK_CALL_CACHE_ENTRIES];
+} CK_CALL_CACHE, *PCK_CALL_CACHE;
+
+/*++
+
 Structure Description:
 
     This structure defines a function object.
@@ -485,6 +594,12 @@ Structure Description:
     Debug - Stores a pointer to the debug information, which translates
         bytecode back to line numbers.
 
+    CallSiteCount - Stores the number of method call sites in the bytecode.
+        Each call instruction carries the index of its site.
+
+    CallCaches - Stores a pointer to the array of inline caches, one per call
+        site. This is allocated the first time the function makes a call.
+
 --*/
 
 typedef struct _CK_FUNCTION {
@@ -496,6 +611,8 @@ typedef struct _CK_FUNCTION {
     CK_SYMBOL_INDEX UpvalueCount;
     CK_ARITY Arity;
     CK_FUNCTION_DEBUG Debug;
+    CK_SYMBOL_INDEX CallSiteCount;
+    PCK_CALL_CACHE CallCaches;
 } CK_FUNCTION, *PCK_FUNCTION;
 
 /*++
@@ -604,13 +721,13 @@ Structure Description:
 
 --*/
 
-typedef struct _CK_CLOSURE {
+struct _CK_CLOSURE {
     CK_OBJECT Header;
     CK_CLOSURE_TYPE Type;
     CK_CLOSURE_UNION U;
     PCK_CLASS Class;
     PCK_UPVALUE *Upvalues;
-} CK_CLOSURE, *PCK_CLOSURE;
+};
 
 /*++
 
@@ -736,11 +853,17 @@ Structure Description:
 
     Elements - Stores the array of elements.
 
+    Dirty - Stores the lowest element index written to since the list was put
+        on the remembered set. Elements below this index have not changed, so
+        the garbage collector doesn't need to look at them again. This is only
+        valid while the list is remembered.
+
 --*/
 
 typedef struct _CK_LIST {
     CK_OBJECT Header;
     CK_VALUE_ARRAY Elements;
+    UINTN Dirty;
 } CK_LIST, *PCK_LIST;
 
 /*++
@@ -2017,6 +2140,61 @@ Return Value:
 
 --*/
 
+PCK_STRING
+CkpStringIntern (
+    PCK_VM Vm,
+    PCK_STRING String
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the canonical copy of the given string from the
+    intern table, adding the given string to the table if no string with the
+    same contents is there yet.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    String - Supplies a pointer to the string to intern. The string must
+        already be hashed.
+
+Return Value:
+
+    Returns a pointer to the interned string with the same contents.
+
+    Returns the original string if it could not be added to the table due to
+    allocation failure.
+
+--*/
+
+VOID
+CkpStringUnintern (
+    PCK_VM Vm,
+    PCK_STRING String
+    );
+
+/*++
+
+Routine Description:
+
+    This routine removes an interned string from the intern table. This is
+    called when the string is being destroyed.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    String - Supplies a pointer to the interned string.
+
+Return Value:
+
+    None.
+
+--*/
+
 CK_VALUE
 CkpStringFake (
     PCK_STRING FakeStringObject,
@@ -2188,6 +2366,33 @@ Return Value:
 // Integer and range functions
 //
 
+CK_VALUE
+CkpIntegerCreate (
+    PCK_VM Vm,
+    CK_INTEGER Integer
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates an integer value. Integers that fit are encoded
+    directly in the value, larger ones are boxed in a new object.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Integer - Supplies the integer value.
+
+Return Value:
+
+    Returns the integer value on success.
+
+    CK_NULL_VALUE on allocation failure.
+
+--*/
+
 CK_VALUE
 CkpRangeCreate (
     PCK_VM Vm,
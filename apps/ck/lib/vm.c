@@ -295,6 +295,7 @@ CkpCaptureUpvalue (
 
 VOID
 CkpCloseUpvalues (
+    PCK_VM Vm,
     PCK_FIBER Fiber,
     PCK_VALUE Last
     );
@@ -307,6 +308,16 @@ CkpValidateSuperclass (
     CK_SYMBOL_INDEX FieldCount
     );
 
+BOOL
+CkpCallCachedMethod (
+    PCK_VM Vm,
+    PCK_FUNCTION Function,
+    PCK_CLASS Class,
+    CK_SYMBOL_INDEX Symbol,
+    ULONG CallSite,
+    CK_ARITY Arity
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -399,6 +410,10 @@ Return Value:
         Vm->Configuration.Reallocate = Reallocate;
     }
 
+    if (Vm->Configuration.NurserySize == 0) {
+        Vm->Configuration.NurserySize = Default->NurserySize;
+    }
+
     Vm->NextGarbageCollection = Vm->Configuration.InitialHeapSize;
     Vm->Modules = CkpDictCreate(Vm);
     if (Vm->Modules == NULL) {
@@ -466,6 +481,25 @@ Return Value:
     }
 
     Vm->FirstObject = NULL;
+    Object = Vm->OldObjects;
+    while (Object != NULL) {
+        Next = Object->Next;
+        CkpDestroyObject(Vm, Object);
+        Object = Next;
+    }
+
+    Vm->OldObjects = NULL;
+    if (Vm->Remembered != NULL) {
+        CkRawFree(Vm, Vm->Remembered);
+        Vm->Remembered = NULL;
+    }
+
+    CK_ASSERT(Vm->InternCount == 0);
+
+    if (Vm->InternTable != NULL) {
+        CkRawFree(Vm, Vm->InternTable);
+        Vm->InternTable = NULL;
+    }
 
     //
     // Null out the reallocate function to catch double frees.
@@ -593,6 +627,7 @@ Return Value:
         return -2;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Module->Header));
     return Symbol;
 }
 
@@ -676,6 +711,7 @@ Return Value:
         Symbol = -1;
     }
 
+    CK_WRITE_BARRIER(Vm, &(Module->Header));
     if (CK_IS_OBJECT(Value)) {
         CkpPopRoot(Vm);
     }
@@ -739,6 +775,8 @@ Return Value:
             CkpArrayAppend(Vm, &(Module->Variables), Value);
         }
 
+        CK_WRITE_BARRIER(Vm, &(Module->Header));
+
     } else {
         Symbol = CkpStringTableFind(&(Module->VariableNames), Name, NameSize);
     }
@@ -876,6 +914,7 @@ Return Value:
 
     PCK_VALUE Arguments;
     CK_ARITY Arity;
+    USHORT CallSite;
     PCK_CLASS Class;
     PCK_CLOSURE Closure;
     UCHAR Field;
@@ -901,6 +940,10 @@ Return Value:
     CK_ASSERT((Vm->Fiber == NULL) || (Vm->Fiber->FrameCount == 0) ||
               (Vm->Fiber == Fiber));
 
+    if (Vm->Fiber != NULL) {
+        CK_WRITE_BARRIER(Vm, &(Vm->Fiber->Header));
+    }
+
     Vm->Fiber = Fiber;
     CKI_LOAD_FRAME();
 
@@ -995,6 +1038,7 @@ Return Value:
 
         Upvalue = Frame->Closure->Upvalues[Local];
         *(Upvalue->Value) = CKI_STACK_TOP();
+        CK_WRITE_BARRIER(Vm, &(Upvalue->Header));
         CKI_DISPATCH();
 
     CKI_CASE(CkOpLoadModuleVariable):
@@ -1011,6 +1055,7 @@ Return Value:
         CK_ASSERT(Symbol < Function->Module->Variables.Count);
 
         Function->Module->Variables.Data[Symbol] = CKI_STACK_TOP();
+        CK_WRITE_BARRIER(Vm, &(Function->Module->Header));
         CKI_DISPATCH();
 
     CKI_CASE(CkOpLoadFieldThis):
@@ -1039,6 +1084,7 @@ Return Value:
         CK_ASSERT(Symbol < Instance->Header.Class->FieldCount);
 
         Instance->Fields[Symbol] = CKI_STACK_TOP();
+        CK_WRITE_BARRIER(Vm, &(Instance->Header));
         CKI_DISPATCH();
 
     CKI_CASE(CkOpLoadField):
@@ -1067,6 +1113,7 @@ Return Value:
         CK_ASSERT(Symbol < Instance->Header.Class->FieldCount);
 
         Instance->Fields[Symbol] = CKI_STACK_TOP();
+        CK_WRITE_BARRIER(Vm, &(Instance->Header));
         CKI_DISPATCH();
 
     CKI_CASE(CkOpPop):
@@ -1084,11 +1131,11 @@ Return Value:
     CKI_CASE(CkOpCall8):
         Arity = Instruction - CkOpCall0 + 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_SHORT(CallSite);
         Arguments = Fiber->StackTop - Arity;
         Class = CkpGetClass(Vm, Arguments[0]);
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CallSite, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1096,11 +1143,11 @@ Return Value:
         CKI_READ_ARITY(Arity);
         Arity += 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_SHORT(CallSite);
         Arguments = Fiber->StackTop - Arity;
         Class = CkpGetClass(Vm, Arguments[0]);
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CallSite, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1115,11 +1162,11 @@ Return Value:
     CKI_CASE(CkOpSuperCall8):
         Arity = Instruction - CkOpSuperCall0 + 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_SHORT(CallSite);
         Arguments = Fiber->StackTop - Arity;
         Class = Frame->Closure->Class->Super;
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CallSite, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1127,11 +1174,11 @@ Return Value:
         CKI_READ_ARITY(Arity);
         Arity += 1;
         CKI_READ_SYMBOL(Symbol);
+        CKI_READ_SHORT(CallSite);
         Arguments = Fiber->StackTop - Arity;
         Class = Frame->Closure->Class->Super;
-        MethodName = Function->Module->Strings.List.Data[Symbol];
         CKI_STORE_FRAME();
-        CkpCallMethod(Vm, Class, MethodName, Arity);
+        CkpCallCachedMethod(Vm, Function, Class, Symbol, CallSite, Arity);
         CKI_LOAD_FIBER();
         CKI_DISPATCH();
 
@@ -1210,7 +1257,7 @@ Return Value:
         CKI_DISPATCH();
 
     CKI_CASE(CkOpCloseUpvalue):
-        CkpCloseUpvalues(Fiber, Fiber->StackTop - 1);
+        CkpCloseUpvalues(Vm, Fiber, Fiber->StackTop - 1);
         CKI_DISPATCH();
 
     CKI_CASE(CkOpReturn):
@@ -1221,7 +1268,7 @@ Return Value:
 
         Fiber->FrameCount -= 1;
         Fiber->TryCount = Frame->TryCount;
-        CkpCloseUpvalues(Fiber, Stack);
+        CkpCloseUpvalues(Vm, Fiber, Stack);
 
         //
         // Handle the fiber completing. Either return the value to the C caller,
@@ -1244,6 +1291,7 @@ Return Value:
 
             NextFiber = Fiber->Caller;
             Fiber->Caller = NULL;
+            CK_WRITE_BARRIER(Vm, &(Fiber->Header));
             Fiber = NextFiber;
             Vm->Fiber = NextFiber;
             Vm->ForeignCalls -= NextFiber->ForeignCalls;
@@ -1319,6 +1367,8 @@ Return Value:
             }
         }
 
+        CK_WRITE_BARRIER(Vm, &(Closure->Header));
+
         Function = Frame->Closure->U.Block.Function;
         CKI_DISPATCH();
 
@@ -1861,6 +1911,7 @@ Return Value:
 
 VOID
 CkpCloseUpvalues (
+    PCK_VM Vm,
     PCK_FIBER Fiber,
     PCK_VALUE Last
     )
@@ -1875,6 +1926,8 @@ Routine Description:
 
 Arguments:
 
+    Vm - Supplies a pointer to the virtual machine.
+
     Fiber - Supplies a pointer to the current fiber.
 
     Last - Supplies the soon-to-be new top of the stack.
@@ -1902,6 +1955,7 @@ Return Value:
         Upvalue->Closed = *(Upvalue->Value);
         Upvalue->Value = &(Upvalue->Closed);
         Fiber->OpenUpvalues = Upvalue->Next;
+        CK_WRITE_BARRIER(Vm, &(Upvalue->Header));
     }
 
     return;
@@ -1984,3 +2038,126 @@ Return Value:
     return TRUE;
 }
 
+BOOL
+CkpCallCachedMethod (
+    PCK_VM Vm,
+    PCK_FUNCTION Function,
+    PCK_CLASS Class,
+    CK_SYMBOL_INDEX Symbol,
+    ULONG CallSite,
+    CK_ARITY Arity
+    )
+
+/*++
+
+Routine Description:
+
+    This routine invokes a class instance method for execution from a call
+    site in bytecode. The call site's inline cache is consulted first, and
+    the method dictionary is only searched if the receiver class has not been
+    seen at this site since the last change to any class's methods.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Function - Supplies a pointer to the function containing the call.
+
+    Class - Supplies a pointer to the class to look the method up in.
+
+    Symbol - Supplies the index of the method name in the module strings.
+
+    CallSite - Supplies the call site index encoded in the call instruction.
+
+    Arity - Supplies the number of arguments the method was called with in
+        code (plus one for the receiver).
+
+Return Value:
+
+    TRUE if a new frame was pushed onto the stack and needs to be run by the
+    interpreter.
+
+    FALSE if the call completed already (primitive and foreign functions fit
+    this category).
+
+--*/
+
+{
+
+    PCK_CALL_CACHE Cache;
+    PCK_CLOSURE Closure;
+    ULONG Index;
+    CK_VALUE Method;
+    CK_VALUE MethodName;
+
+    MethodName = Function->Module->Strings.List.Data[Symbol];
+    if (CallSite >= Function->CallSiteCount) {
+
+        CK_ASSERT(FALSE);
+
+        return CkpCallMethod(Vm, Class, MethodName, Arity);
+    }
+
+    //
+    // Allocate the caches for the whole function on its first call. If that
+    // fails, just do the call the slow way.
+    //
+
+    if (Function->CallCaches == NULL) {
+        Cache = CkAllocate(Vm, sizeof(CK_CALL_CACHE) * Function->CallSiteCount);
+        if (Cache == NULL) {
+            return CkpCallMethod(Vm, Class, MethodName, Arity);
+        }
+
+        CkZero(Cache, sizeof(CK_CALL_CACHE) * Function->CallSiteCount);
+        Function->CallCaches = Cache;
+    }
+
+    Cache = &(Function->CallCaches[CallSite]);
+    if (Cache->Epoch == Vm->MethodEpoch) {
+        for (Index = 0; Index < CK_CALL_CACHE_ENTRIES; Index += 1) {
+            if (Cache->Classes[Index] == Class) {
+                return CkpCallFunction(Vm, Cache->Methods[Index], Arity);
+            }
+
+            if (Cache->Classes[Index] == NULL) {
+                break;
+            }
+        }
+
+    } else {
+        CkZero(Cache, sizeof(CK_CALL_CACHE));
+        Cache->Epoch = Vm->MethodEpoch;
+        Index = 0;
+    }
+
+    //
+    // Let the normal path handle the error if the method doesn't exist.
+    //
+
+    Method = CkpDictGet(Class->Methods, MethodName);
+    if (CK_IS_UNDEFINED(Method)) {
+        return CkpCallMethod(Vm, Class, MethodName, Arity);
+    }
+
+    Closure = CK_AS_CLOSURE(Method);
+
+    //
+    // Fill the next free entry, or evict the oldest entry if the site is
+    // already full.
+    //
+
+    if (Index == CK_CALL_CACHE_ENTRIES) {
+        for (Index = 1; Index < CK_CALL_CACHE_ENTRIES; Index += 1) {
+            Cache->Classes[Index - 1] = Cache->Classes[Index];
+            Cache->Methods[Index - 1] = Cache->Methods[Index];
+        }
+
+        Index = CK_CALL_CACHE_ENTRIES - 1;
+    }
+
+    Cache->Classes[Index] = Class;
+    Cache->Methods[Index] = Closure;
+    return CkpCallFunction(Vm, Closure, Arity);
+}
+
@@ -150,14 +150,16 @@ Enumeration Description:
     CkOpCall0 - Invokes the method with the symbol specified by the next
         instruction word. The opcode number describes the number of arguments
         that have already been pushed (not including the receiver). Subsequent
-        opcodes code for 1-7 arguments, respectively.
+        opcodes code for 1-7 arguments, respectively. The instruction word
+        after the symbol is the index of the call site's inline cache. All
+        call and super call opcodes carry this call site index.
 
     CkOpCall8 - Invokes the method with the symbol specified by the next
         instruction word, with 8 arguments.
 
     CkOpCall - Invokes the method with the number of arguments specified by the
         next instruction byte. The symbol is specified by the subsequent
-        instruction word.
+        instruction word, followed by the call site index.
 
     CkOpIndirectCall - Invokes the method with the number of arguments
         specified by the next instruction byte. The method to call is pushed
@@ -172,7 +174,7 @@ Enumeration Description:
 
     CkOpSuperCall - Invokes a method on the superclass with the number of
         arguments in the next instruction byte. The subsequent instruction word
-        specifies the symbol to invoke.
+        specifies the symbol to invoke, followed by the call site index.
 
     CkOpJump - Moves the instruction pointer forward by the number of bytes
         specified in the following instruction word.
@@ -306,6 +308,34 @@ typedef enum _CK_OPCODE {
 
 /*++
 
+Enumeration Description:
+
+    This enumeration describes the states of the garbage collector.
+
+Values:
+
+    CkGcIdle - Indicates no collection is in progress.
+
+    CkGcMinor - Indicates the young generation is being collected. Old
+        objects are assumed to be alive and are not traced.
+
+    CkGcMarking - Indicates the whole heap is being marked incrementally. The
+        program runs between marking slices.
+
+    CkGcFinishing - Indicates the final pause of a whole heap collection is
+        in progress.
+
+--*/
+
+typedef enum _CK_GC_PHASE {
+    CkGcIdle,
+    CkGcMinor,
+    CkGcMarking,
+    CkGcFinishing
+} CK_GC_PHASE, *PCK_GC_PHASE;
+
+/*++
+
 Structure Description:
 
     This structure contains pointers to the builtin classes.
@@ -380,22 +410,60 @@ Structure Description:
         memory that's been allocated since then. This number does not include
         memory that has been freed since the last garbage collection.
 
-    NextGarbageCollection - Stores the size that the allocated bytes have to
-        get to in order to trigger the next garbage collection.
+    NextGarbageCollection - Stores the size that the old generation has to
+        get to in order to start the next collection of the whole heap.
+
+    OldBytes - Stores the approximate number of bytes in the old generation.
+        This is exact after a full collection, and grows by the number of
+        bytes promoted by each young collection.
+
+    NurseryBytes - Stores the number of bytes allocated since the last young
+        collection or incremental marking slice.
+
+    MarkedBytes - Stores the number of bytes counted by the kiss functions
+        during the current collection.
+
+    GcPhase - Stores the current state of the garbage collector.
+
+    GcStatistics - Stores the garbage collection statistics.
 
-    GarbageRuns - Stores the number of times the garbage collector has run.
+    FirstObject - Stores a pointer to the first object in the singly linked
+        list of young objects. New objects are added here.
 
-    GarbageFreed - Stores the number of objects freed during the most recent
-        garbage collection run.
+    OldObjects - Stores a pointer to the first object in the singly linked
+        list of objects that have survived a collection.
 
-    FirstObject - Stores a pointer to the first object in the massive singly
-        linked list of all living objects. This is the list that the garbage
-        collector traverses.
+    KissHead - Stores the dummy head of the list of kissed objects.
 
     KissList - Stores the tail of the list of objects that have been kissed.
         The list is circular to ensure that the last object has a non-null
         next pointer.
 
+    KissScan - Stores a pointer to the last kissed object whose components
+        have been kissed. Everything after this on the kiss list still needs
+        to be traced.
+
+    Remembered - Stores an array of old objects that have been written to
+        since the last collection.
+
+    RememberedCount - Stores the number of valid entries in the remembered
+        array.
+
+    RememberedCapacity - Stores the maximum number of entries in the
+        remembered array before it has to be reallocated.
+
+    RememberedOverflow - Stores a boolean indicating that the remembered array
+        could not be expanded, and so the next collection must trace the whole
+        heap from scratch.
+
+    InternTable - Stores the weak table of interned strings. Strings in this
+        table are not kept alive by it, and remove themselves when destroyed.
+
+    InternCount - Stores the number of strings in the intern table.
+
+    InternCapacity - Stores the number of slots in the intern table. This is
+        always zero or a power of two.
+
     WorkingObjects - Stores a fixed stack of objects that should not be
         garbage collected but who are not necessarily linked anywhere else.
 
@@ -422,6 +490,10 @@ Structure Description:
     Context - Stores an opaque user context pointer that can be used by whoever
         is integrating the Chalk library.
 
+    MethodEpoch - Stores a counter that is incremented whenever the methods of
+        any class change. Inline call caches filled in under an older epoch
+        are discarded.
+
 --*/
 
 struct _CK_VM {
@@ -430,10 +502,23 @@ struct _CK_VM {
     PCK_DICT Modules;
     UINTN BytesAllocated;
     UINTN NextGarbageCollection;
-    ULONG GarbageRuns;
-    ULONG GarbageFreed;
+    UINTN OldBytes;
+    UINTN NurseryBytes;
+    UINTN MarkedBytes;
+    CK_GC_PHASE GcPhase;
+    CK_GC_STATISTICS GcStatistics;
     PCK_OBJECT FirstObject;
+    PCK_OBJECT OldObjects;
+    CK_OBJECT KissHead;
     PCK_OBJECT KissList;
+    PCK_OBJECT KissScan;
+    PCK_OBJECT *Remembered;
+    UINTN RememberedCount;
+    UINTN RememberedCapacity;
+    BOOL RememberedOverflow;
+    PCK_STRING *InternTable;
+    UINTN InternCount;
+    UINTN InternCapacity;
     PCK_OBJECT WorkingObjects[CK_MAX_WORKING_OBJECTS];
     ULONG WorkingObjectCount;
     PCK_COMPILER Compiler;
@@ -443,6 +528,7 @@ struct _CK_VM {
     INT MemoryException;
     PCK_CLOSURE UnhandledException;
     PVOID Context;
+    UINTN MethodEpoch;
 };
 
 //
@@ -1047,3 +1133,32 @@ Return Value:
 
 --*/
 
+BOOL
+CkpModuleIsFrozenCurrent (
+    PCSTR Contents,
+    UINTN Size
+    );
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the given contents are a frozen module
+    written in the current freeze format. Objects left behind by a different
+    version of Chalk cannot be thawed.
+
+Arguments:
+
+    Contents - Supplies the frozen module contents.
+
+    Size - Supplies the frozen module size in bytes.
+
+Return Value:
+
+    TRUE if the contents are a frozen module of the current version.
+
+    FALSE if the contents are not a frozen module, or are from a different
+    version.
+
+--*/
+
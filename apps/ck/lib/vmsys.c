@@ -36,6 +36,7 @@ Module Name:
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "chalkp.h"
@@ -51,6 +52,7 @@ Module Name:
 
 #define CK_INITIAL_HEAP_DEFAULT (1024 * 1024 * 10)
 #define CK_MINIMUM_HEAP_DEFAULT (1024 * 1024)
+#define CK_NURSERY_DEFAULT (1024 * 512)
 #define CK_HEAP_GROWTH_DEFAULT 512
 
 //
@@ -145,6 +147,7 @@ CK_CONFIGURATION CkDefaultConfiguration = {
     CkpDefaultUnhandledException,
     CK_INITIAL_HEAP_DEFAULT,
     CK_MINIMUM_HEAP_DEFAULT,
+    CK_NURSERY_DEFAULT,
     CK_HEAP_GROWTH_DEFAULT,
     0
 };
@@ -544,6 +547,33 @@ Return Value:
     return;
 }
 
+ULONGLONG
+CkpGetMicroseconds (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a time counter used to measure garbage collection
+    pauses. Only the difference between two readings is meaningful.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the processor time used so far, in microseconds.
+
+--*/
+
+{
+
+    return (ULONGLONG)clock() * 1000000ULL / CLOCKS_PER_SEC;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -584,6 +614,7 @@ Return Value:
     FILE *File;
     off_t FileSize;
     CK_LOAD_MODULE_RESULT LoadStatus;
+    BOOL ObjectOpened;
     CHAR ObjectPath[PATH_MAX];
     INT ObjectPathLength;
     struct stat ObjectStat;
@@ -595,6 +626,7 @@ Return Value:
 
     File = NULL;
     LoadStatus = CkLoadModuleStaticError;
+    ObjectOpened = FALSE;
 
     //
     // Get the full path to the source file.
@@ -696,6 +728,7 @@ Return Value:
         if (File != NULL) {
             FileSize = ObjectStat.st_size;
             PathLength = ObjectPathLength;
+            ObjectOpened = TRUE;
         }
 
     }
@@ -721,6 +754,34 @@ Return Value:
                                FileSize,
                                ModuleData);
 
+    //
+    // An object frozen by a different version of Chalk can't be thawed. Load
+    // the source instead, whose compiled form will replace the stale object.
+    //
+
+    if ((LoadStatus == CkLoadModuleSource) &&
+        (ObjectOpened != FALSE) &&
+        (SourceStatus == 0) &&
+        (!CkpModuleIsFrozenCurrent(ModuleData->Source.Text,
+                                   ModuleData->Source.Length))) {
+
+        CkFree(Vm, ModuleData->Source.Text);
+        CkFree(Vm, ModuleData->Source.Path);
+        fclose(File);
+        File = fopen(Path, "rb");
+        if (File == NULL) {
+            LoadStatus = CkLoadModuleStaticError;
+            goto LoadSourceFileEnd;
+        }
+
+        LoadStatus = CkpReadSource(Vm,
+                                   Path,
+                                   strlen(Path),
+                                   File,
+                                   Stat.st_size,
+                                   ModuleData);
+    }
+
 LoadSourceFileEnd:
     if (LoadStatus == CkLoadModuleStaticError) {
         if ((errno == ENOENT) || (errno == EACCES) || (errno == EPERM)) {
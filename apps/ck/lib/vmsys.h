@@ -45,6 +45,28 @@ extern PCSTR CkSharedLibraryExtension;
 // -------------------------------------------------------- Function Prototypes
 //
 
+ULONGLONG
+CkpGetMicroseconds (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns a time counter used to measure garbage collection
+    pauses. Only the difference between two readings is meaningful.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the processor time used so far, in microseconds.
+
+--*/
+
 PVOID
 CkpLoadLibrary (
     PSTR BinaryName
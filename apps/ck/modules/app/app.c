@@ -73,6 +73,11 @@ CkpAppSetExecName (
     PCSTR Argument0
     );
 
+VOID
+CkpAppGcStats (
+    PCK_VM Vm
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -91,6 +96,11 @@ PSTR *CkAppArgv;
 
 PCSTR CkAppExecName = "";
 
+CK_VARIABLE_DESCRIPTION CkAppModuleValues[] = {
+    {CkTypeFunction, "gcStats", CkpAppGcStats, 0},
+    {CkTypeInvalid, NULL, NULL, 0}
+};
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -176,6 +186,7 @@ Return Value:
     CkSetVariable(Vm, 0, "argv");
     CkPushString(Vm, CkAppExecName, strlen(CkAppExecName));
     CkSetVariable(Vm, 0, "execName");
+    CkDeclareVariables(Vm, 0, CkAppModuleValues);
     return;
 }
 
@@ -378,3 +389,73 @@ Return Value:
     return;
 }
 
+VOID
+CkpAppGcStats (
+    PCK_VM Vm
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a dictionary of garbage collector statistics. Pause
+    times are in microseconds of processor time, and the pauses list is a
+    histogram where element N counts the pauses shorter than 2^N
+    microseconds (but not shorter than 2^(N-1)).
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+Return Value:
+
+    None. The dictionary is returned in the return value slot.
+
+--*/
+
+{
+
+    UINTN Index;
+    CK_GC_STATISTICS Statistics;
+
+    CkGetGarbageStatistics(Vm, &Statistics);
+    CkPushDict(Vm);
+    CkPushString(Vm, "minor", 5);
+    CkPushInteger(Vm, Statistics.MinorCollections);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "major", 5);
+    CkPushInteger(Vm, Statistics.MajorCollections);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "slices", 6);
+    CkPushInteger(Vm, Statistics.MarkSlices);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "promoted", 8);
+    CkPushInteger(Vm, Statistics.BytesPromoted);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "freed", 5);
+    CkPushInteger(Vm, Statistics.ObjectsFreed);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "oldBytes", 8);
+    CkPushInteger(Vm, Statistics.OldBytes);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "nurseryBytes", 12);
+    CkPushInteger(Vm, Statistics.NurseryBytes);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "pauseTotal", 10);
+    CkPushInteger(Vm, Statistics.TotalPause);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "pauseMax", 8);
+    CkPushInteger(Vm, Statistics.MaxPause);
+    CkDictSet(Vm, -3);
+    CkPushString(Vm, "pauses", 6);
+    CkPushList(Vm);
+    for (Index = 0; Index < CK_GC_PAUSE_BUCKETS; Index += 1) {
+        CkPushInteger(Vm, Statistics.PauseHistogram[Index]);
+        CkListSet(Vm, -2, Index);
+    }
+
+    CkDictSet(Vm, -3);
+    CkStackReplace(Vm, 0);
+    return;
+}
+
@@ -63,6 +63,7 @@ function build() {
         "cmdtab.c",
         "coff.c",
         "consio.c",
+        "crashdmp.c",
         "dbgapi.c",
         "dbgdwarf.c",
         "dbgeval.c",
@@ -213,6 +213,56 @@ Return Value:
 
 --*/
 
+INT
+DbgrExportProfilerStackData (
+    PSTACK_DATA_ENTRY Root
+    );
+
+/*++
+
+Routine Description:
+
+    This routine writes profiler stack data out in folded stack format, one
+    line per unique call stack followed by the number of samples that ended
+    there. This is the input format consumed by flame graph tools. The data
+    is written to the file named by the current export request.
+
+Arguments:
+
+    Root - Supplies a pointer to the root of the profiler stack data tree.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error code on failure.
+
+--*/
+
+PSTR
+DbgrGetProfilerStackEntrySymbol (
+    PSTACK_DATA_ENTRY Entry
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the symbol string for a profiler stack entry,
+    resolving it if this is the first time the entry has been displayed.
+
+Arguments:
+
+    Entry - Supplies a pointer to the stack entry.
+
+Return Value:
+
+    Returns a pointer to the symbol string, which is owned by the entry.
+
+    NULL for the root of the tree or if the address could not be resolved.
+
+--*/
+
 VOID
 DbgrProfilerStackEntrySelected (
     PSTACK_DATA_ENTRY Root
@@ -0,0 +1,1613 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    crashdmp.c
+
+Abstract:
+
+    This module implements support for debugging crash dump files written by
+    the kernel. A kernel dump is opened as a stopped debug target: registers
+    come from the saved context of the crashing processor, and memory reads
+    are served from the compressed page records, translating virtual
+    addresses through the page tables saved in the dump.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Debug Client
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "dbgrtl.h"
+#include <minoca/debug/spproto.h>
+#include <minoca/lib/im.h>
+#include <minoca/debug/dbgext.h>
+#include <minoca/kernel/crashdmp.h>
+#include "symbols.h"
+#include "dbgapi.h"
+#include "dbgrprof.h"
+#include "dbgrcomm.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the largest page size a dump is believed to have been written with.
+//
+
+#define CRASH_DUMP_MAX_PAGE_SIZE 0x10000
+
+//
+// Define the bits of the page table entries walked to translate virtual
+// addresses. x86 uses two level 32-bit tables with optional 4MB pages, x64
+// uses four level tables with optional 1GB and 2MB pages, and ARM uses the
+// short descriptor format with sections, large pages, and small pages.
+//
+
+#define CRASH_X86_PTE_PRESENT 0x00000001
+#define CRASH_X86_PTE_LARGE 0x00000080
+#define CRASH_X86_PTE_ADDRESS_MASK 0xFFFFF000
+#define CRASH_X86_LARGE_PAGE_MASK 0x003FFFFF
+#define CRASH_X86_PDE_SHIFT 22
+#define CRASH_X86_PTE_SHIFT 12
+#define CRASH_X86_PT_MASK 0x3FF
+
+#define CRASH_X64_PTE_PRESENT 0x00000001ULL
+#define CRASH_X64_PTE_LARGE 0x00000080ULL
+#define CRASH_X64_PTE_ADDRESS_MASK 0x000FFFFFFFFFF000ULL
+#define CRASH_X64_PML4E_SHIFT 39
+#define CRASH_X64_PT_SHIFT_STEP 9
+#define CRASH_X64_PT_MASK 0x1FF
+#define CRASH_X64_LEVELS 4
+
+#define CRASH_ARM_TTBR_ADDRESS_MASK 0xFFFFC000
+#define CRASH_ARM_L1_SHIFT 20
+#define CRASH_ARM_L1_TYPE_MASK 0x3
+#define CRASH_ARM_L1_TYPE_COARSE 0x1
+#define CRASH_ARM_L1_TYPE_SECTION 0x2
+#define CRASH_ARM_L1_SUPERSECTION 0x00040000
+#define CRASH_ARM_L1_COARSE_ADDRESS_MASK 0xFFFFFC00
+#define CRASH_ARM_SECTION_ADDRESS_MASK 0xFFF00000
+#define CRASH_ARM_SECTION_OFFSET_MASK 0x000FFFFF
+#define CRASH_ARM_SUPERSECTION_ADDRESS_MASK 0xFF000000
+#define CRASH_ARM_SUPERSECTION_OFFSET_MASK 0x00FFFFFF
+#define CRASH_ARM_L2_SHIFT 12
+#define CRASH_ARM_L2_MASK 0xFF
+#define CRASH_ARM_L2_TYPE_MASK 0x3
+#define CRASH_ARM_L2_TYPE_LARGE 0x1
+#define CRASH_ARM_LARGE_PAGE_ADDRESS_MASK 0xFFFF0000
+#define CRASH_ARM_LARGE_PAGE_OFFSET_MASK 0x0000FFFF
+#define CRASH_ARM_SMALL_PAGE_ADDRESS_MASK 0xFFFFF000
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure defines the location of one page of physical memory within
+    a kernel crash dump file.
+
+Members:
+
+    PhysicalAddress - Stores the physical address of the page.
+
+    FileOffset - Stores the offset of the page data from the beginning of the
+        file.
+
+    Size - Stores the size of the page data in the file, in bytes.
+
+    Flags - Stores the page record flags. See CRASH_DUMP_PAGE_FLAG_* for
+        definitions.
+
+--*/
+
+typedef struct _CRASH_DUMP_PAGE {
+    ULONGLONG PhysicalAddress;
+    ULONGLONG FileOffset;
+    ULONG Size;
+    ULONG Flags;
+} CRASH_DUMP_PAGE, *PCRASH_DUMP_PAGE;
+
+/*++
+
+Structure Description:
+
+    This structure defines the state of an open crash dump debug target.
+
+Members:
+
+    File - Stores the open crash dump file.
+
+    Header - Stores the validated crash dump header.
+
+    HeaderRegion - Stores the start of the file, holding the header, the
+        version strings, and the crash dump context.
+
+    HeaderRegionSize - Stores the number of valid bytes in the header region.
+
+    DumpContext - Stores a pointer within the header region to the state of
+        the crashing processor.
+
+    ModuleList - Stores a pointer within the header region to the loaded
+        module list that follows the crash dump context.
+
+    ModuleListSize - Stores the size of the module list and its entries, in
+        bytes.
+
+    Pages - Stores the array of pages in the dump, sorted by physical address.
+
+    PageCount - Stores the number of elements in the pages array.
+
+    Data - Stores a buffer used to read compressed page data.
+
+    Page - Stores the buffer holding the most recently decompressed page.
+
+    CachedPage - Stores a pointer to the page whose contents are in the page
+        buffer, or NULL if the page buffer is empty.
+
+--*/
+
+typedef struct _CRASH_DUMP_TARGET {
+    FILE *File;
+    CRASH_DUMP_HEADER Header;
+    PUCHAR HeaderRegion;
+    ULONG HeaderRegionSize;
+    PCRASH_DUMP_CONTEXT DumpContext;
+    PMODULE_LIST_HEADER ModuleList;
+    ULONG ModuleListSize;
+    PCRASH_DUMP_PAGE Pages;
+    ULONGLONG PageCount;
+    PUCHAR Data;
+    PUCHAR Page;
+    PCRASH_DUMP_PAGE CachedPage;
+} CRASH_DUMP_TARGET, *PCRASH_DUMP_TARGET;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+INT
+DbgrpIndexCrashDumpPages (
+    PCRASH_DUMP_TARGET Target
+    );
+
+INT
+DbgrpLoadCrashDumpContext (
+    PDEBUGGER_CONTEXT Context,
+    PCRASH_DUMP_TARGET Target
+    );
+
+int
+DbgrpCompareCrashDumpPages (
+    const void *LeftPointer,
+    const void *RightPointer
+    );
+
+PUCHAR
+DbgrpGetCrashDumpPage (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG PhysicalAddress
+    );
+
+BOOL
+DbgrpReadCrashDumpPhysical (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG PhysicalAddress,
+    PVOID Buffer,
+    ULONG Size
+    );
+
+BOOL
+DbgrpTranslateCrashDumpAddress (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    );
+
+BOOL
+DbgrpTranslateX86Address (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    );
+
+BOOL
+DbgrpTranslateX64Address (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    );
+
+BOOL
+DbgrpTranslateArmAddress (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    );
+
+PSTR
+DbgrpGetCrashDumpString (
+    PUCHAR HeaderRegion,
+    ULONG HeaderRegionSize,
+    ULONGLONG Offset
+    );
+
+USHORT
+DbgrpCrashDumpChecksum (
+    PVOID Data,
+    ULONG DataSize
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the open crash dump target.
+//
+
+CRASH_DUMP_TARGET DbgCrashDump;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+INT
+DbgrOpenCrashDump (
+    PDEBUGGER_CONTEXT Context,
+    PSTR Path
+    )
+
+/*++
+
+Routine Description:
+
+    This routine opens a kernel crash dump file as the debug target. The
+    debugger must already be initialized for a crash dump connection.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Path - Supplies the path to the crash dump file.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
+{
+
+    PSTR BuildString;
+    USHORT Checksum;
+    PCRASH_DUMP_HEADER Header;
+    ULONGLONG HeaderRegionSize;
+    PSTR ProductName;
+    INT Result;
+    USHORT SavedChecksum;
+    PCRASH_DUMP_TARGET Target;
+
+    assert(Context->ConnectionType == DebugConnectionCrashDump);
+
+    Target = &DbgCrashDump;
+    Header = &(Target->Header);
+    memset(Target, 0, sizeof(CRASH_DUMP_TARGET));
+    Target->File = fopen(Path, "rb");
+    if (Target->File == NULL) {
+        Result = errno;
+        DbgOut("Error: Failed to open crash dump %s: %s.\n",
+               Path,
+               strerror(Result));
+
+        return Result;
+    }
+
+    if ((fread(Header, sizeof(CRASH_DUMP_HEADER), 1, Target->File) != 1) ||
+        (Header->Signature != CRASH_DUMP_SIGNATURE)) {
+
+        DbgOut("Error: %s is not a crash dump.\n", Path);
+        Result = EINVAL;
+        goto OpenCrashDumpEnd;
+    }
+
+    //
+    // The checksum was computed with the checksum field zeroed.
+    //
+
+    SavedChecksum = Header->HeaderChecksum;
+    Header->HeaderChecksum = 0;
+    Checksum = DbgrpCrashDumpChecksum(Header, sizeof(CRASH_DUMP_HEADER));
+    Header->HeaderChecksum = SavedChecksum;
+    if (Checksum != SavedChecksum) {
+        DbgOut("Error: Crash dump header checksum mismatch: expected 0x%x, "
+               "calculated 0x%x.\n",
+               SavedChecksum,
+               Checksum);
+
+        Result = EINVAL;
+        goto OpenCrashDumpEnd;
+    }
+
+    if ((Header->PageSize == 0) ||
+        (Header->PageSize > CRASH_DUMP_MAX_PAGE_SIZE) ||
+        ((Header->PageSize & (Header->PageSize - 1)) != 0)) {
+
+        DbgOut("Error: Invalid page size 0x%x.\n", Header->PageSize);
+        Result = EINVAL;
+        goto OpenCrashDumpEnd;
+    }
+
+    //
+    // The kernel writes the header, version strings, and context into the
+    // first page of the file.
+    //
+
+    HeaderRegionSize = Header->DumpSize;
+    if (Header->Type == CrashDumpKernel) {
+        HeaderRegionSize = Header->MemoryOffset;
+    }
+
+    if (HeaderRegionSize > Header->PageSize) {
+        HeaderRegionSize = Header->PageSize;
+    }
+
+    Target->HeaderRegion = malloc(Header->PageSize);
+    if (Target->HeaderRegion == NULL) {
+        Result = ENOMEM;
+        goto OpenCrashDumpEnd;
+    }
+
+    memset(Target->HeaderRegion, 0, Header->PageSize);
+    if (fseeko(Target->File, 0, SEEK_SET) != 0) {
+        Result = errno;
+        goto OpenCrashDumpEnd;
+    }
+
+    Target->HeaderRegionSize = fread(Target->HeaderRegion,
+                                     1,
+                                     HeaderRegionSize,
+                                     Target->File);
+
+    ProductName = DbgrpGetCrashDumpString(Target->HeaderRegion,
+                                          Target->HeaderRegionSize,
+                                          Header->ProductNameOffset);
+
+    BuildString = DbgrpGetCrashDumpString(Target->HeaderRegion,
+                                          Target->HeaderRegionSize,
+                                          Header->BuildStringOffset);
+
+    DbgOut("Crash dump %s\nSystem Version %d.%d.%d.%I64d %s %s\n",
+           Path,
+           Header->MajorVersion,
+           Header->MinorVersion,
+           Header->Revision,
+           Header->SerialVersion,
+           ProductName,
+           BuildString);
+
+    DbgOut("*** Fatal System Error ***\n"
+           "Error Code: 0x%x\n"
+           "Parameter1: 0x%08I64x\n"
+           "Parameter2: 0x%08I64x\n"
+           "Parameter3: 0x%08I64x\n"
+           "Parameter4: 0x%08I64x\n",
+           Header->CrashCode,
+           Header->Parameter1,
+           Header->Parameter2,
+           Header->Parameter3,
+           Header->Parameter4);
+
+    switch (Header->Type) {
+    case CrashDumpMinimal:
+        DbgOut("Error: Minimal dump, %I64d bytes. It holds no memory to "
+               "debug.\n",
+               Header->DumpSize);
+
+        Result = EINVAL;
+        break;
+
+    case CrashDumpKernel:
+        Result = DbgrpIndexCrashDumpPages(Target);
+        break;
+
+    default:
+        DbgOut("Error: Unknown crash dump type %d.\n", Header->Type);
+        Result = EINVAL;
+        break;
+    }
+
+    if (Result != 0) {
+        goto OpenCrashDumpEnd;
+    }
+
+    Result = DbgrpLoadCrashDumpContext(Context, Target);
+    if (Result != 0) {
+        goto OpenCrashDumpEnd;
+    }
+
+    Target->Data = malloc(Header->PageSize);
+    Target->Page = malloc(Header->PageSize);
+    if ((Target->Data == NULL) || (Target->Page == NULL)) {
+        Result = ENOMEM;
+        goto OpenCrashDumpEnd;
+    }
+
+    Result = 0;
+
+OpenCrashDumpEnd:
+    if (Result != 0) {
+        DbgpCrashDumpClose();
+    }
+
+    return Result;
+}
+
+VOID
+DbgpCrashDumpClose (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine closes the crash dump target, if one is open.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PCRASH_DUMP_TARGET Target;
+
+    Target = &DbgCrashDump;
+    if (Target->File != NULL) {
+        fclose(Target->File);
+    }
+
+    if (Target->HeaderRegion != NULL) {
+        free(Target->HeaderRegion);
+    }
+
+    if (Target->Pages != NULL) {
+        free(Target->Pages);
+    }
+
+    if (Target->Data != NULL) {
+        free(Target->Data);
+    }
+
+    if (Target->Page != NULL) {
+        free(Target->Page);
+    }
+
+    memset(Target, 0, sizeof(CRASH_DUMP_TARGET));
+    return;
+}
+
+BOOL
+DbgpCrashDumpWaitForEvent (
+    PDEBUGGER_EVENT Event
+    )
+
+/*++
+
+Routine Description:
+
+    This routine gets an event from the crash dump. The dump always reports
+    the break of the crashing processor.
+
+Arguments:
+
+    Event - Supplies a pointer where the event details will be returned.
+
+Return Value:
+
+    Returns TRUE if successful, or FALSE if there was an error.
+
+--*/
+
+{
+
+    PCRASH_DUMP_TARGET Target;
+
+    Target = &DbgCrashDump;
+    if (Target->DumpContext == NULL) {
+        DbgOut("Error: No crash dump is open.\n");
+        return FALSE;
+    }
+
+    Event->Type = DebuggerEventBreak;
+    memcpy(&(Event->BreakNotification),
+           &(Target->DumpContext->BreakNotification),
+           sizeof(BREAK_NOTIFICATION));
+
+    return TRUE;
+}
+
+BOOL
+DbgpCrashDumpGetSpecialRegisters (
+    PSPECIAL_REGISTERS_UNION SpecialRegisters
+    )
+
+/*++
+
+Routine Description:
+
+    This routine gets the special registers of the crashing processor.
+
+Arguments:
+
+    SpecialRegisters - Supplies a pointer where the registers will be returned
+        on success.
+
+Return Value:
+
+    Returns TRUE if successful, or FALSE if there was an error.
+
+--*/
+
+{
+
+    PCRASH_DUMP_TARGET Target;
+
+    Target = &DbgCrashDump;
+    if (Target->DumpContext == NULL) {
+        return FALSE;
+    }
+
+    memcpy(SpecialRegisters,
+           &(Target->DumpContext->SpecialRegisters),
+           sizeof(SPECIAL_REGISTERS_UNION));
+
+    return TRUE;
+}
+
+BOOL
+DbgpCrashDumpGetLoadedModuleList (
+    PMODULE_LIST_HEADER *ModuleList
+    )
+
+/*++
+
+Routine Description:
+
+    This routine retrieves the list of binaries loaded when the system
+    crashed.
+
+Arguments:
+
+    ModuleList - Supplies a pointer where a pointer to the loaded module header
+        and subsequent array of entries will be returned. It is the caller's
+        responsibility to free this allocated memory when finished.
+
+Return Value:
+
+    Returns TRUE on success, or FALSE on failure.
+
+--*/
+
+{
+
+    PMODULE_LIST_HEADER List;
+    PCRASH_DUMP_TARGET Target;
+
+    *ModuleList = NULL;
+    Target = &DbgCrashDump;
+    if (Target->ModuleList == NULL) {
+        return FALSE;
+    }
+
+    List = malloc(Target->ModuleListSize);
+    if (List == NULL) {
+        DbgOut("Error: Failed to allocate %d bytes for module list.\n",
+               Target->ModuleListSize);
+
+        return FALSE;
+    }
+
+    memcpy(List, Target->ModuleList, Target->ModuleListSize);
+    *ModuleList = List;
+    return TRUE;
+}
+
+BOOL
+DbgpCrashDumpReadMemory (
+    BOOL VirtualMemory,
+    ULONGLONG Address,
+    PVOID Buffer,
+    ULONG BufferSize,
+    PULONG BytesCompleted
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads memory out of the crash dump. Virtual addresses are
+    translated through the page tables of the crashing processor. The read
+    stops short at the first page that is not mapped or not in the dump.
+
+Arguments:
+
+    VirtualMemory - Supplies a flag indicating whether the address is virtual
+        or physical.
+
+    Address - Supplies the address to read from.
+
+    Buffer - Supplies a pointer where the memory contents will be returned.
+
+    BufferSize - Supplies the number of bytes to read.
+
+    BytesCompleted - Supplies a pointer that receives the number of bytes that
+        were actually read.
+
+Return Value:
+
+    Returns TRUE on success, or FALSE on failure.
+
+--*/
+
+{
+
+    ULONG ChunkSize;
+    PUCHAR Page;
+    ULONG PageOffset;
+    ULONG PageSize;
+    ULONGLONG PhysicalAddress;
+    PCRASH_DUMP_TARGET Target;
+
+    *BytesCompleted = 0;
+    Target = &DbgCrashDump;
+    if (Target->DumpContext == NULL) {
+        return FALSE;
+    }
+
+    PageSize = Target->Header.PageSize;
+    while (BufferSize != 0) {
+        PhysicalAddress = Address;
+        if (VirtualMemory != FALSE) {
+            if (DbgrpTranslateCrashDumpAddress(Target,
+                                               Address,
+                                               &PhysicalAddress) == FALSE) {
+
+                break;
+            }
+        }
+
+        PageOffset = PhysicalAddress & (PageSize - 1);
+        ChunkSize = PageSize - PageOffset;
+        if (ChunkSize > BufferSize) {
+            ChunkSize = BufferSize;
+        }
+
+        Page = DbgrpGetCrashDumpPage(Target, PhysicalAddress - PageOffset);
+        if (Page == NULL) {
+            break;
+        }
+
+        memcpy(Buffer, Page + PageOffset, ChunkSize);
+        Buffer += ChunkSize;
+        BufferSize -= ChunkSize;
+        Address += ChunkSize;
+        *BytesCompleted += ChunkSize;
+    }
+
+    return TRUE;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+INT
+DbgrpIndexCrashDumpPages (
+    PCRASH_DUMP_TARGET Target
+    )
+
+/*++
+
+Routine Description:
+
+    This routine walks the page records in a kernel crash dump, building the
+    index used to find each physical page.
+
+Arguments:
+
+    Target - Supplies a pointer to the crash dump target, with a validated
+        header.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
+{
+
+    ULONGLONG CompressedPages;
+    PCRASH_DUMP_HEADER Header;
+    ULONGLONG HighestAddress;
+    PCRASH_DUMP_PAGE Page;
+    ULONGLONG PageIndex;
+    CRASH_DUMP_PAGE_HEADER Record;
+    ULONGLONG StreamOffset;
+
+    Header = &(Target->Header);
+    DbgOut("Kernel dump, %I64d pages in %I64d bytes%s.\n",
+           Header->PageCount,
+           Header->MemorySize,
+           ((Header->Flags & CRASH_DUMP_FLAG_TRUNCATED) != 0) ?
+           " (truncated)" : "");
+
+    if ((Header->PageCount == 0) ||
+        (Header->PageCount > Header->MemorySize /
+                             sizeof(CRASH_DUMP_PAGE_HEADER))) {
+
+        DbgOut("Error: Invalid page count %I64d.\n", Header->PageCount);
+        return EINVAL;
+    }
+
+    Target->Pages = malloc(Header->PageCount * sizeof(CRASH_DUMP_PAGE));
+    if (Target->Pages == NULL) {
+        return ENOMEM;
+    }
+
+    if (fseeko(Target->File, Header->MemoryOffset, SEEK_SET) != 0) {
+        return errno;
+    }
+
+    CompressedPages = 0;
+    HighestAddress = 0;
+    StreamOffset = 0;
+    for (PageIndex = 0; PageIndex < Header->PageCount; PageIndex += 1) {
+        if ((StreamOffset + sizeof(CRASH_DUMP_PAGE_HEADER) >
+             Header->MemorySize) ||
+            (fread(&Record, sizeof(Record), 1, Target->File) != 1)) {
+
+            DbgOut("Error: Page record %I64d is cut off.\n", PageIndex);
+            return EINVAL;
+        }
+
+        StreamOffset += sizeof(CRASH_DUMP_PAGE_HEADER);
+        if ((Record.Size == 0) ||
+            (Record.Size > Header->PageSize) ||
+            (StreamOffset + Record.Size > Header->MemorySize) ||
+            ((Record.PhysicalAddress & (Header->PageSize - 1)) != 0) ||
+            (((Record.Flags & CRASH_DUMP_PAGE_FLAG_COMPRESSED) == 0) &&
+             (Record.Size != Header->PageSize))) {
+
+            DbgOut("Error: Page record %I64d at 0x%I64x has bad size 0x%x.\n",
+                   PageIndex,
+                   Record.PhysicalAddress,
+                   Record.Size);
+
+            return EINVAL;
+        }
+
+        Page = &(Target->Pages[PageIndex]);
+        Page->PhysicalAddress = Record.PhysicalAddress;
+        Page->FileOffset = Header->MemoryOffset + StreamOffset;
+        Page->Size = Record.Size;
+        Page->Flags = Record.Flags;
+        if (fseeko(Target->File, Record.Size, SEEK_CUR) != 0) {
+            return errno;
+        }
+
+        StreamOffset += Record.Size;
+        if ((Record.Flags & CRASH_DUMP_PAGE_FLAG_COMPRESSED) != 0) {
+            CompressedPages += 1;
+        }
+
+        if (Record.PhysicalAddress > HighestAddress) {
+            HighestAddress = Record.PhysicalAddress;
+        }
+    }
+
+    Target->PageCount = Header->PageCount;
+    qsort(Target->Pages,
+          Target->PageCount,
+          sizeof(CRASH_DUMP_PAGE),
+          DbgrpCompareCrashDumpPages);
+
+    DbgOut("%I64d pages (%I64d compressed), %I64dkB of memory. "
+           "Highest page 0x%I64x.\n",
+           Header->PageCount,
+           CompressedPages,
+           (Header->PageCount * Header->PageSize) / 1024,
+           HighestAddress);
+
+    return 0;
+}
+
+INT
+DbgrpLoadCrashDumpContext (
+    PDEBUGGER_CONTEXT Context,
+    PCRASH_DUMP_TARGET Target
+    )
+
+/*++
+
+Routine Description:
+
+    This routine validates the saved state of the crashing processor and the
+    loaded module list following it.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Target - Supplies a pointer to the crash dump target.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
+{
+
+    PSTR Architecture;
+    PCRASH_DUMP_CONTEXT DumpContext;
+    ULONG EntrySize;
+    PCRASH_DUMP_HEADER Header;
+    PLOADED_MODULE_ENTRY ModuleEntry;
+    ULONG ModuleIndex;
+    ULONG Offset;
+
+    Header = &(Target->Header);
+    if ((Header->ContextOffset < sizeof(CRASH_DUMP_HEADER)) ||
+        (Header->ContextOffset > Target->HeaderRegionSize) ||
+        (Header->ContextSize <
+         sizeof(CRASH_DUMP_CONTEXT) + sizeof(MODULE_LIST_HEADER)) ||
+        (Header->ContextSize >
+         Target->HeaderRegionSize - Header->ContextOffset)) {
+
+        DbgOut("Error: The crash dump has no processor context.\n");
+        return EINVAL;
+    }
+
+    DumpContext = (PCRASH_DUMP_CONTEXT)(Target->HeaderRegion +
+                                        Header->ContextOffset);
+
+    switch (DumpContext->MachineType) {
+    case MACHINE_TYPE_X86:
+        Architecture = "x86";
+        break;
+
+    case MACHINE_TYPE_ARM:
+        Architecture = "ARM";
+        break;
+
+    case MACHINE_TYPE_X64:
+        Architecture = "x64";
+        break;
+
+    default:
+        DbgOut("Error: Unknown crash dump machine type %d.\n",
+               DumpContext->MachineType);
+
+        return EINVAL;
+    }
+
+    //
+    // Only keep the module entries that lie entirely within the context.
+    //
+
+    Target->ModuleList = (PMODULE_LIST_HEADER)(DumpContext + 1);
+    Offset = sizeof(MODULE_LIST_HEADER);
+    for (ModuleIndex = 0;
+         ModuleIndex < Target->ModuleList->ModuleCount;
+         ModuleIndex += 1) {
+
+        ModuleEntry = (PLOADED_MODULE_ENTRY)((PUCHAR)Target->ModuleList +
+                                             Offset);
+
+        if (sizeof(CRASH_DUMP_CONTEXT) + Offset + sizeof(LOADED_MODULE_ENTRY) >
+            Header->ContextSize) {
+
+            break;
+        }
+
+        EntrySize = ModuleEntry->StructureSize;
+        if ((EntrySize < sizeof(LOADED_MODULE_ENTRY)) ||
+            (sizeof(CRASH_DUMP_CONTEXT) + Offset + EntrySize >
+             Header->ContextSize) ||
+            (((PUCHAR)ModuleEntry)[EntrySize - 1] != '\0')) {
+
+            break;
+        }
+
+        Offset += EntrySize;
+    }
+
+    if (ModuleIndex != Target->ModuleList->ModuleCount) {
+        DbgOut("Warning: Only %d of %d loaded modules are valid.\n",
+               ModuleIndex,
+               Target->ModuleList->ModuleCount);
+
+        Target->ModuleList->ModuleCount = ModuleIndex;
+    }
+
+    Target->ModuleListSize = Offset;
+    Target->DumpContext = DumpContext;
+    Context->MachineType = DumpContext->MachineType;
+    DbgOut("Crashed on processor %d of %d (%s), %d modules loaded.\n",
+           DumpContext->BreakNotification.ProcessorOrThreadNumber,
+           DumpContext->BreakNotification.ProcessorOrThreadCount,
+           Architecture,
+           Target->ModuleList->ModuleCount);
+
+    return 0;
+}
+
+int
+DbgrpCompareCrashDumpPages (
+    const void *LeftPointer,
+    const void *RightPointer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares the physical addresses of two crash dump pages.
+
+Arguments:
+
+    LeftPointer - Supplies a pointer to the left crash dump page.
+
+    RightPointer - Supplies a pointer to the right crash dump page.
+
+Return Value:
+
+    < 0 if the left page is lower than the right.
+
+    0 if the two pages have the same address.
+
+    > 0 if the left page is higher than the right.
+
+--*/
+
+{
+
+    const CRASH_DUMP_PAGE *Left;
+    const CRASH_DUMP_PAGE *Right;
+
+    Left = LeftPointer;
+    Right = RightPointer;
+    if (Left->PhysicalAddress < Right->PhysicalAddress) {
+        return -1;
+    }
+
+    if (Left->PhysicalAddress > Right->PhysicalAddress) {
+        return 1;
+    }
+
+    return 0;
+}
+
+PUCHAR
+DbgrpGetCrashDumpPage (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG PhysicalAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the contents of one physical page in the dump,
+    reading and decompressing it if it is not the cached page.
+
+Arguments:
+
+    Target - Supplies a pointer to the crash dump target.
+
+    PhysicalAddress - Supplies the page aligned physical address of the page.
+
+Return Value:
+
+    Returns a pointer to the page contents, valid until the next page is
+    fetched.
+
+    NULL if the page is not in the dump or could not be read.
+
+--*/
+
+{
+
+    ULONG DecompressedSize;
+    ULONGLONG Maximum;
+    ULONGLONG Middle;
+    ULONGLONG Minimum;
+    PCRASH_DUMP_PAGE Page;
+
+    if ((Target->CachedPage != NULL) &&
+        (Target->CachedPage->PhysicalAddress == PhysicalAddress)) {
+
+        return Target->Page;
+    }
+
+    //
+    // Binary search for the page.
+    //
+
+    Page = NULL;
+    Minimum = 0;
+    Maximum = Target->PageCount;
+    while (Minimum < Maximum) {
+        Middle = Minimum + ((Maximum - Minimum) / 2);
+        if (Target->Pages[Middle].PhysicalAddress == PhysicalAddress) {
+            Page = &(Target->Pages[Middle]);
+            break;
+
+        } else if (Target->Pages[Middle].PhysicalAddress < PhysicalAddress) {
+            Minimum = Middle + 1;
+
+        } else {
+            Maximum = Middle;
+        }
+    }
+
+    if (Page == NULL) {
+        return NULL;
+    }
+
+    Target->CachedPage = NULL;
+    if ((fseeko(Target->File, Page->FileOffset, SEEK_SET) != 0) ||
+        (fread(Target->Data, 1, Page->Size, Target->File) != Page->Size)) {
+
+        DbgOut("Error: Failed to read page 0x%I64x from the crash dump.\n",
+               PhysicalAddress);
+
+        return NULL;
+    }
+
+    if ((Page->Flags & CRASH_DUMP_PAGE_FLAG_COMPRESSED) != 0) {
+        if ((RtlLzDecompress(Target->Data,
+                             Page->Size,
+                             Target->Page,
+                             Target->Header.PageSize,
+                             &DecompressedSize) == FALSE) ||
+            (DecompressedSize != Target->Header.PageSize)) {
+
+            DbgOut("Error: Page 0x%I64x failed to decompress.\n",
+                   PhysicalAddress);
+
+            return NULL;
+        }
+
+    } else {
+        memcpy(Target->Page, Target->Data, Page->Size);
+    }
+
+    Target->CachedPage = Page;
+    return Target->Page;
+}
+
+BOOL
+DbgrpReadCrashDumpPhysical (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG PhysicalAddress,
+    PVOID Buffer,
+    ULONG Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads a small naturally aligned value, such as a page table
+    entry, out of physical memory in the dump.
+
+Arguments:
+
+    Target - Supplies a pointer to the crash dump target.
+
+    PhysicalAddress - Supplies the physical address to read.
+
+    Buffer - Supplies a pointer where the value will be returned.
+
+    Size - Supplies the number of bytes to read. The read must not cross a
+        page boundary.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the page is not in the dump.
+
+--*/
+
+{
+
+    PUCHAR Page;
+    ULONG PageOffset;
+
+    PageOffset = PhysicalAddress & (Target->Header.PageSize - 1);
+
+    assert(PageOffset + Size <= Target->Header.PageSize);
+
+    Page = DbgrpGetCrashDumpPage(Target, PhysicalAddress - PageOffset);
+    if (Page == NULL) {
+        return FALSE;
+    }
+
+    memcpy(Buffer, Page + PageOffset, Size);
+    return TRUE;
+}
+
+BOOL
+DbgrpTranslateCrashDumpAddress (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine translates a virtual address to a physical address using the
+    page tables of the crashing processor.
+
+Arguments:
+
+    Target - Supplies a pointer to the crash dump target.
+
+    VirtualAddress - Supplies the virtual address to translate.
+
+    PhysicalAddress - Supplies a pointer where the physical address will be
+        returned on success.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the address is not mapped or the page tables are not in the dump.
+
+--*/
+
+{
+
+    BOOL Result;
+
+    switch (Target->DumpContext->MachineType) {
+    case MACHINE_TYPE_X86:
+        Result = DbgrpTranslateX86Address(Target,
+                                          VirtualAddress,
+                                          PhysicalAddress);
+
+        break;
+
+    case MACHINE_TYPE_X64:
+        Result = DbgrpTranslateX64Address(Target,
+                                          VirtualAddress,
+                                          PhysicalAddress);
+
+        break;
+
+    case MACHINE_TYPE_ARM:
+        Result = DbgrpTranslateArmAddress(Target,
+                                          VirtualAddress,
+                                          PhysicalAddress);
+
+        break;
+
+    default:
+
+        assert(FALSE);
+
+        Result = FALSE;
+        break;
+    }
+
+    return Result;
+}
+
+BOOL
+DbgrpTranslateX86Address (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine translates a virtual address by walking the two level x86
+    page tables rooted at CR3.
+
+Arguments:
+
+    Target - Supplies a pointer to the crash dump target.
+
+    VirtualAddress - Supplies the virtual address to translate.
+
+    PhysicalAddress - Supplies a pointer where the physical address will be
+        returned on success.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the address is not mapped or the page tables are not in the dump.
+
+--*/
+
+{
+
+    ULONG Address;
+    ULONG Directory;
+    ULONG DirectoryEntry;
+    ULONG TableEntry;
+    ULONG TableIndex;
+
+    if (VirtualAddress > MAX_ULONG) {
+        return FALSE;
+    }
+
+    Address = (ULONG)VirtualAddress;
+    Directory = (ULONG)Target->DumpContext->SpecialRegisters.Ia.Cr3 &
+                CRASH_X86_PTE_ADDRESS_MASK;
+
+    TableIndex = Address >> CRASH_X86_PDE_SHIFT;
+    if ((DbgrpReadCrashDumpPhysical(Target,
+                                    Directory + (TableIndex * sizeof(ULONG)),
+                                    &DirectoryEntry,
+                                    sizeof(ULONG)) == FALSE) ||
+        ((DirectoryEntry & CRASH_X86_PTE_PRESENT) == 0)) {
+
+        return FALSE;
+    }
+
+    if ((DirectoryEntry & CRASH_X86_PTE_LARGE) != 0) {
+        *PhysicalAddress = (DirectoryEntry & ~CRASH_X86_LARGE_PAGE_MASK) |
+                           (Address & CRASH_X86_LARGE_PAGE_MASK);
+
+        return TRUE;
+    }
+
+    TableIndex = (Address >> CRASH_X86_PTE_SHIFT) & CRASH_X86_PT_MASK;
+    if ((DbgrpReadCrashDumpPhysical(
+                         Target,
+                         (DirectoryEntry & CRASH_X86_PTE_ADDRESS_MASK) +
+                         (TableIndex * sizeof(ULONG)),
+                         &TableEntry,
+                         sizeof(ULONG)) == FALSE) ||
+        ((TableEntry & CRASH_X86_PTE_PRESENT) == 0)) {
+
+        return FALSE;
+    }
+
+    *PhysicalAddress = (TableEntry & CRASH_X86_PTE_ADDRESS_MASK) |
+                       (Address & ~CRASH_X86_PTE_ADDRESS_MASK);
+
+    return TRUE;
+}
+
+BOOL
+DbgrpTranslateX64Address (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine translates a virtual address by walking the four level x64
+    page tables rooted at CR3.
+
+Arguments:
+
+    Target - Supplies a pointer to the crash dump target.
+
+    VirtualAddress - Supplies the virtual address to translate.
+
+    PhysicalAddress - Supplies a pointer where the physical address will be
+        returned on success.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the address is not mapped or the page tables are not in the dump.
+
+--*/
+
+{
+
+    ULONGLONG Entry;
+    ULONG Level;
+    ULONGLONG OffsetMask;
+    ULONG Shift;
+    ULONGLONG Table;
+    ULONG TableIndex;
+
+    Table = Target->DumpContext->SpecialRegisters.Ia.Cr3 &
+            CRASH_X64_PTE_ADDRESS_MASK;
+
+    Shift = CRASH_X64_PML4E_SHIFT;
+    for (Level = 0; Level < CRASH_X64_LEVELS; Level += 1) {
+        TableIndex = (VirtualAddress >> Shift) & CRASH_X64_PT_MASK;
+        if ((DbgrpReadCrashDumpPhysical(
+                                      Target,
+                                      Table + (TableIndex * sizeof(ULONGLONG)),
+                                      &Entry,
+                                      sizeof(ULONGLONG)) == FALSE) ||
+            ((Entry & CRASH_X64_PTE_PRESENT) == 0)) {
+
+            return FALSE;
+        }
+
+        //
+        // The PDPT and PD levels may map 1GB and 2MB pages directly. The last
+        // level always maps a page.
+        //
+
+        OffsetMask = (1ULL << Shift) - 1;
+        if ((Level == CRASH_X64_LEVELS - 1) ||
+            ((Level != 0) && ((Entry & CRASH_X64_PTE_LARGE) != 0))) {
+
+            *PhysicalAddress = (Entry & CRASH_X64_PTE_ADDRESS_MASK &
+                                ~OffsetMask) |
+                               (VirtualAddress & OffsetMask);
+
+            return TRUE;
+        }
+
+        Table = Entry & CRASH_X64_PTE_ADDRESS_MASK;
+        Shift -= CRASH_X64_PT_SHIFT_STEP;
+    }
+
+    return FALSE;
+}
+
+BOOL
+DbgrpTranslateArmAddress (
+    PCRASH_DUMP_TARGET Target,
+    ULONGLONG VirtualAddress,
+    PULONGLONG PhysicalAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine translates a virtual address by walking the ARM short
+    descriptor translation tables rooted at TTBR0. The kernel runs with a
+    TTBCR of zero, so TTBR0 covers the whole address space.
+
+Arguments:
+
+    Target - Supplies a pointer to the crash dump target.
+
+    VirtualAddress - Supplies the virtual address to translate.
+
+    PhysicalAddress - Supplies a pointer where the physical address will be
+        returned on success.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the address is not mapped or the page tables are not in the dump.
+
+--*/
+
+{
+
+    ULONG Address;
+    ULONG FirstLevelEntry;
+    ULONG SecondLevelEntry;
+    ULONG SecondLevelIndex;
+    ULONG Table;
+
+    if (VirtualAddress > MAX_ULONG) {
+        return FALSE;
+    }
+
+    Address = (ULONG)VirtualAddress;
+    Table = (ULONG)Target->DumpContext->SpecialRegisters.Arm.Ttbr0 &
+            CRASH_ARM_TTBR_ADDRESS_MASK;
+
+    if (DbgrpReadCrashDumpPhysical(
+                        Target,
+                        Table +
+                        ((Address >> CRASH_ARM_L1_SHIFT) * sizeof(ULONG)),
+                        &FirstLevelEntry,
+                        sizeof(ULONG)) == FALSE) {
+
+        return FALSE;
+    }
+
+    switch (FirstLevelEntry & CRASH_ARM_L1_TYPE_MASK) {
+    case CRASH_ARM_L1_TYPE_SECTION:
+        if ((FirstLevelEntry & CRASH_ARM_L1_SUPERSECTION) != 0) {
+            *PhysicalAddress =
+                      (FirstLevelEntry & CRASH_ARM_SUPERSECTION_ADDRESS_MASK) |
+                      (Address & CRASH_ARM_SUPERSECTION_OFFSET_MASK);
+
+        } else {
+            *PhysicalAddress =
+                           (FirstLevelEntry & CRASH_ARM_SECTION_ADDRESS_MASK) |
+                           (Address & CRASH_ARM_SECTION_OFFSET_MASK);
+        }
+
+        return TRUE;
+
+    case CRASH_ARM_L1_TYPE_COARSE:
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    SecondLevelIndex = (Address >> CRASH_ARM_L2_SHIFT) & CRASH_ARM_L2_MASK;
+    if (DbgrpReadCrashDumpPhysical(
+                      Target,
+                      (FirstLevelEntry & CRASH_ARM_L1_COARSE_ADDRESS_MASK) +
+                      (SecondLevelIndex * sizeof(ULONG)),
+                      &SecondLevelEntry,
+                      sizeof(ULONG)) == FALSE) {
+
+        return FALSE;
+    }
+
+    if ((SecondLevelEntry & CRASH_ARM_L2_TYPE_MASK) == 0) {
+        return FALSE;
+    }
+
+    if ((SecondLevelEntry & CRASH_ARM_L2_TYPE_MASK) ==
+        CRASH_ARM_L2_TYPE_LARGE) {
+
+        *PhysicalAddress =
+                      (SecondLevelEntry & CRASH_ARM_LARGE_PAGE_ADDRESS_MASK) |
+                      (Address & CRASH_ARM_LARGE_PAGE_OFFSET_MASK);
+
+    } else {
+        *PhysicalAddress =
+                      (SecondLevelEntry & CRASH_ARM_SMALL_PAGE_ADDRESS_MASK) |
+                      (Address & ~CRASH_ARM_SMALL_PAGE_ADDRESS_MASK);
+    }
+
+    return TRUE;
+}
+
+PSTR
+DbgrpGetCrashDumpString (
+    PUCHAR HeaderRegion,
+    ULONG HeaderRegionSize,
+    ULONGLONG Offset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a string stored after the crash dump header, making
+    sure it's terminated within the region read.
+
+Arguments:
+
+    HeaderRegion - Supplies a pointer to the start of the file.
+
+    HeaderRegionSize - Supplies the number of valid bytes at the start of the
+        file.
+
+    Offset - Supplies the offset of the string from the start of the file.
+
+Return Value:
+
+    Returns a pointer to the string, or an empty string if it is not present
+    or is invalid.
+
+--*/
+
+{
+
+    if ((Offset < sizeof(CRASH_DUMP_HEADER)) ||
+        (Offset >= HeaderRegionSize) ||
+        (memchr(HeaderRegion + Offset, '\0', HeaderRegionSize - Offset) ==
+         NULL)) {
+
+        return "";
+    }
+
+    return (PSTR)(HeaderRegion + Offset);
+}
+
+USHORT
+DbgrpCrashDumpChecksum (
+    PVOID Data,
+    ULONG DataSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine calculates the one's complement checksum of a data buffer,
+    the same way the kernel does when writing the crash dump header.
+
+Arguments:
+
+    Data - Supplies a pointer to the data on which to calculate the checksum.
+
+    DataSize - Supplies the size of the data, in bytes.
+
+Return Value:
+
+    Returns the one's complement checksum of the data.
+
+--*/
+
+{
+
+    ULONG ShortIndex;
+    PUSHORT ShortPointer;
+    ULONG Sum;
+
+    Sum = 0;
+    ShortPointer = (PUSHORT)Data;
+    for (ShortIndex = 0;
+         ShortIndex < DataSize / sizeof(USHORT);
+         ShortIndex += 1) {
+
+        Sum += ShortPointer[ShortIndex];
+    }
+
+    if ((DataSize & 0x1) != 0) {
+        Sum += *((PUCHAR)&(ShortPointer[ShortIndex]));
+    }
+
+    while ((Sum >> (sizeof(USHORT) * BITS_PER_BYTE)) != 0) {
+        Sum = (Sum & 0xFFFF) + (Sum >> (sizeof(USHORT) * BITS_PER_BYTE));
+    }
+
+    return (USHORT)~Sum;
+}
+
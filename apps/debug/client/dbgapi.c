@@ -291,6 +291,10 @@ Return Value:
 
 {
 
+    if (ConnectionType == DebugConnectionCrashDump) {
+        DbgpCrashDumpClose();
+    }
+
     return;
 }
 
@@ -484,6 +488,10 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         Result = DbgpUserContinue(SignalToDeliver);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        DbgOut("Error: A crash dump cannot be resumed.\n");
+        Result = FALSE;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -577,6 +585,10 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         Result = DbgpUserSetRegisters(Registers);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        DbgOut("Error: A crash dump cannot be modified.\n");
+        Result = FALSE;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -629,6 +641,9 @@ Return Value:
         DbgOut("Special registers cannot be accessed in user mode.\n");
         Result = FALSE;
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        Result = DbgpCrashDumpGetSpecialRegisters(SpecialRegisters);
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -682,6 +697,10 @@ Return Value:
         DbgOut("Special registers cannot be accessed in user mode.\n");
         Result = FALSE;
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        DbgOut("Error: A crash dump cannot be modified.\n");
+        Result = FALSE;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -734,6 +753,10 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         Result = DbgpUserSingleStep(SignalToDeliver);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        DbgOut("Error: A crash dump cannot be resumed.\n");
+        Result = FALSE;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -783,6 +806,9 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         Result = DbgpUserWaitForEvent(&(Context->CurrentEvent));
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        Result = DbgpCrashDumpWaitForEvent(&(Context->CurrentEvent));
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -839,6 +865,10 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         Result = DbgpUserRangeStep(RangeStep, SignalToDeliver);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        DbgOut("Error: A crash dump cannot be resumed.\n");
+        Result = FALSE;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -905,6 +935,13 @@ Return Value:
             goto SwitchProcessorsEnd;
         }
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        DbgOut("Error: The crash dump only holds the state of processor %d.\n",
+               Context->CurrentEvent.BreakNotification.ProcessorOrThreadNumber);
+
+        Result = EINVAL;
+        goto SwitchProcessorsEnd;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = EINVAL;
@@ -988,6 +1025,19 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         Result = DbgpUserGetThreadList(ThreadCount, ThreadIds);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        Processors = malloc(sizeof(ULONG));
+        if (Processors == NULL) {
+            return ENOMEM;
+        }
+
+        *Processors =
+               Context->CurrentEvent.BreakNotification.ProcessorOrThreadNumber;
+
+        *ThreadCount = 1;
+        *ThreadIds = Processors;
+        Result = TRUE;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -1041,6 +1091,9 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         Result = DbgpUserGetLoadedModuleList(ModuleList);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        Result = DbgpCrashDumpGetLoadedModuleList(ModuleList);
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -1086,6 +1139,12 @@ Return Value:
     } else if (Context->ConnectionType == DebugConnectionUser) {
         DbgpUserRequestBreakIn();
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+
+        //
+        // A crash dump never runs, so there is nothing to break in to.
+        //
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
     }
@@ -1154,6 +1213,13 @@ Return Value:
                                          BytesToRead,
                                          BytesRead);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        Result = DbgpCrashDumpReadMemory(VirtualMemory,
+                                         Address,
+                                         Buffer,
+                                         BytesToRead,
+                                         BytesRead);
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -1226,6 +1292,10 @@ Return Value:
                                          BytesToWrite,
                                          BytesWritten);
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        DbgOut("Error: A crash dump cannot be modified.\n");
+        Result = FALSE;
+
     } else {
         DbgOut("Error: Unknown connection type %d.\n", Context->ConnectionType);
         Result = FALSE;
@@ -1278,7 +1348,9 @@ Return Value:
             Result = 0;
         }
 
-    } else if (Context->ConnectionType == DebugConnectionUser) {
+    } else if ((Context->ConnectionType == DebugConnectionUser) ||
+               (Context->ConnectionType == DebugConnectionCrashDump)) {
+
         DbgOut("Reboot is only supported on kernel debug targets.\n");
         Result = ENODEV;
 
@@ -55,6 +55,7 @@ typedef enum _DEBUG_CONNECTION_TYPE {
     DebugConnectionKernel,
     DebugConnectionUser,
     DebugConnectionRemote,
+    DebugConnectionCrashDump,
 } DEBUG_CONNECTION_TYPE, *PDEBUG_CONNECTION_TYPE;
 
 typedef enum _DEBUGGER_EVENT_TYPE {
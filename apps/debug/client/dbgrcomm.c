@@ -4554,6 +4554,16 @@ Return Value:
                 }
             }
 
+        } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+            Count =
+                Context->CurrentEvent.BreakNotification.ProcessorOrThreadCount;
+
+            DbgOut("The crash dump holds processor %d of %d.\n",
+                   Ids[0],
+                   Count);
+
+            Result = 0;
+
         } else {
             DbgOut("Error: Unknown connection type %d.\n",
                     Context->ConnectionType);
@@ -337,6 +337,21 @@ Structure Description:
     CommandLineBaseListHead - Stores a pointer to the base line memory list
         list when running command line commands.
 
+    SymbolCache - Stores an array of hash buckets caching the symbol strings
+        of profiled stack addresses.
+
+    SymbolCacheSize - Stores the number of buckets in the symbol cache. This
+        is always a power of two.
+
+    SymbolCacheCount - Stores the number of entries in the symbol cache.
+
+    SymbolCacheSignature - Stores the module list signature at the time the
+        symbol cache was populated. The cache is discarded if the loaded
+        modules change.
+
+    FoldedStackPath - Stores the path of the file to export folded stacks to
+        while servicing an export request.
+
 --*/
 
 typedef struct _DEBUGGER_PROFILING_DATA {
@@ -348,6 +363,11 @@ typedef struct _DEBUGGER_PROFILING_DATA {
     PSTACK_DATA_ENTRY CommandLineStackRoot;
     PLIST_ENTRY CommandLinePoolListHead;
     PLIST_ENTRY CommandLineBaseListHead;
+    PPROFILER_SYMBOL_ENTRY *SymbolCache;
+    ULONG SymbolCacheSize;
+    ULONG SymbolCacheCount;
+    ULONGLONG SymbolCacheSignature;
+    PSTR FoldedStackPath;
 } DEBUGGER_PROFILING_DATA, *PDEBUGGER_PROFILING_DATA;
 
 /*++
@@ -976,6 +996,159 @@ Return Value:
 
 --*/
 
+INT
+DbgrOpenCrashDump (
+    PDEBUGGER_CONTEXT Context,
+    PSTR Path
+    );
+
+/*++
+
+Routine Description:
+
+    This routine opens a kernel crash dump file as the debug target. The
+    debugger must already be initialized for a crash dump connection.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Path - Supplies the path to the crash dump file.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
+VOID
+DbgpCrashDumpClose (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine closes the crash dump target, if one is open.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+BOOL
+DbgpCrashDumpWaitForEvent (
+    PDEBUGGER_EVENT Event
+    );
+
+/*++
+
+Routine Description:
+
+    This routine gets an event from the crash dump. The dump always reports
+    the break of the crashing processor.
+
+Arguments:
+
+    Event - Supplies a pointer where the event details will be returned.
+
+Return Value:
+
+    Returns TRUE if successful, or FALSE if there was an error.
+
+--*/
+
+BOOL
+DbgpCrashDumpGetSpecialRegisters (
+    PSPECIAL_REGISTERS_UNION SpecialRegisters
+    );
+
+/*++
+
+Routine Description:
+
+    This routine gets the special registers of the crashing processor.
+
+Arguments:
+
+    SpecialRegisters - Supplies a pointer where the registers will be returned
+        on success.
+
+Return Value:
+
+    Returns TRUE if successful, or FALSE if there was an error.
+
+--*/
+
+BOOL
+DbgpCrashDumpGetLoadedModuleList (
+    PMODULE_LIST_HEADER *ModuleList
+    );
+
+/*++
+
+Routine Description:
+
+    This routine retrieves the list of binaries loaded when the system
+    crashed.
+
+Arguments:
+
+    ModuleList - Supplies a pointer where a pointer to the loaded module header
+        and subsequent array of entries will be returned. It is the caller's
+        responsibility to free this allocated memory when finished.
+
+Return Value:
+
+    Returns TRUE on success, or FALSE on failure.
+
+--*/
+
+BOOL
+DbgpCrashDumpReadMemory (
+    BOOL VirtualMemory,
+    ULONGLONG Address,
+    PVOID Buffer,
+    ULONG BufferSize,
+    PULONG BytesCompleted
+    );
+
+/*++
+
+Routine Description:
+
+    This routine reads memory out of the crash dump. Virtual addresses are
+    translated through the page tables of the crashing processor. The read
+    stops short at the first page that is not mapped or not in the dump.
+
+Arguments:
+
+    VirtualMemory - Supplies a flag indicating whether the address is virtual
+        or physical.
+
+    Address - Supplies the address to read from.
+
+    Buffer - Supplies a pointer where the memory contents will be returned.
+
+    BufferSize - Supplies the number of bytes to read.
+
+    BytesCompleted - Supplies a pointer that receives the number of bytes that
+        were actually read.
+
+Return Value:
+
+    Returns TRUE on success, or FALSE on failure.
+
+--*/
+
 INT
 DbgrConnect (
     PDEBUGGER_CONTEXT Context
@@ -64,6 +64,22 @@ Module Name:
 
 #define PROFILER_DATA_FLAGS_MEMORY_SENTINEL 0x1
 
+//
+// Define the initial number of hash buckets used to index a stack entry's
+// children, and the initial size of the profiler symbol cache.
+//
+
+#define STACK_DATA_INITIAL_CHILD_BUCKETS 8
+#define PROFILER_SYMBOL_CACHE_INITIAL_BUCKETS 256
+
+//
+// This macro hashes a stack address into a bucket of a table whose size is a
+// power of two.
+//
+
+#define PROFILER_HASH_ADDRESS(_Address, _TableSize) \
+    ((ULONG)(((_Address) * 0x9E3779B97F4A7C15ULL) >> 32) & ((_TableSize) - 1))
+
 #define PROFILER_USAGE                                                         \
     "Usage: profiler <type> [options...]\n"                                    \
     "Valid Types:\n"                                                           \
@@ -91,6 +107,8 @@ Module Name:
     "          hits that a stack entry must achieve to be printed out in \n"   \
     "          the dump. This is useful for limiting results to only those \n" \
     "          that dominate the sampling.\n"                                  \
+    "  folded <file> - Write the stack profiling data to the given file in \n"\
+    "          folded stack format, suitable for generating flame graphs.\n"  \
     "  help  - Display this help.\n\n"
 
 #define MEMORY_PROFILER_USAGE                                                  \
@@ -122,17 +140,60 @@ Module Name:
 
 PSTACK_DATA_ENTRY
 DbgrpCreateStackEntry (
-    PDEBUGGER_CONTEXT Context,
+    PSTACK_DATA_ENTRY Parent,
+    ULONGLONG Address
+    );
+
+PSTACK_DATA_ENTRY
+DbgrpFindStackEntry (
     PSTACK_DATA_ENTRY Parent,
     ULONGLONG Address
     );
 
+VOID
+DbgrpGrowStackChildTable (
+    PSTACK_DATA_ENTRY Parent
+    );
+
 VOID
 DbgrpInsertStackData (
     PSTACK_DATA_ENTRY Parent,
     PSTACK_DATA_ENTRY Child
     );
 
+VOID
+DbgrpPromoteStackData (
+    PSTACK_DATA_ENTRY Parent,
+    PSTACK_DATA_ENTRY Child
+    );
+
+PPROFILER_SYMBOL_ENTRY
+DbgrpLookupProfilerSymbol (
+    PDEBUGGER_CONTEXT Context,
+    ULONGLONG Address
+    );
+
+VOID
+DbgrpDestroyProfilerSymbolCache (
+    PDEBUGGER_CONTEXT Context
+    );
+
+PSTR
+DbgrpGetProfilerFrameName (
+    PDEBUGGER_CONTEXT Context,
+    PSTACK_DATA_ENTRY Entry
+    );
+
+INT
+DbgrpWriteFoldedStacks (
+    PDEBUGGER_CONTEXT Context,
+    FILE *File,
+    PSTACK_DATA_ENTRY Entry,
+    PSTR **Frames,
+    PULONG FrameCapacity,
+    ULONG Depth
+    );
+
 VOID
 DbgrpPrintProfilerStackData (
     PSTACK_DATA_ENTRY Root,
@@ -270,6 +331,7 @@ Return Value:
 
     DbgrpDestroyThreadProfiling(Context);
     DbgrDestroyProfilerStackData(Context->ProfilingData.CommandLineStackRoot);
+    DbgrpDestroyProfilerSymbolCache(Context);
     DbgrDestroyProfilerMemoryData(
                                Context->ProfilingData.CommandLinePoolListHead);
 
@@ -634,6 +696,7 @@ Return Value:
         case ProfilerDataTypeStack:
             DbgrDestroyProfilerStackData(ProfilingData->CommandLineStackRoot);
             Context->ProfilingData.CommandLineStackRoot = NULL;
+            DbgrpDestroyProfilerSymbolCache(Context);
             break;
 
         default:
@@ -645,6 +708,30 @@ Return Value:
 
         break;
 
+    case ProfilerDisplayExportFolded:
+        switch (DataType) {
+        case ProfilerDataTypeStack:
+            Result = DbgrGetProfilerStackData(
+                                       &(ProfilingData->CommandLineStackRoot));
+
+            if (Result == FALSE) {
+                DbgOut("Error: There is no valid stack data to export.\n");
+                return;
+            }
+
+            DbgrExportProfilerStackData(ProfilingData->CommandLineStackRoot);
+            break;
+
+        default:
+            DbgOut("Error: invalid profiler type %d for the 'folded' "
+                   "command.\n",
+                   DataType);
+
+            break;
+        }
+
+        break;
+
     case ProfilerDisplayStartDelta:
         switch (DataType) {
 
@@ -776,8 +863,6 @@ Return Value:
     BOOL Result;
     PSTACK_DATA_ENTRY Root;
     ULONG RoutineCount;
-    PSTACK_DATA_ENTRY StackData;
-    PLIST_ENTRY StackEntry;
     ULONG StackLength;
     LIST_ENTRY StackListHead;
 
@@ -793,9 +878,7 @@ Return Value:
     //
 
     if (*StackTreeRoot == NULL) {
-        AllocatedRoot = DbgrpCreateStackEntry(DbgrProfilerGlobalContext,
-                                              NULL,
-                                              0);
+        AllocatedRoot = DbgrpCreateStackEntry(NULL, 0);
 
         if (AllocatedRoot == NULL) {
             Result = FALSE;
@@ -886,33 +969,16 @@ Return Value:
             }
 
             //
-            // Look up the call site in the parent's list of children.
-            //
-
-            CurrentEntry = NULL;
-            StackEntry = Parent->Children.Next;
-            while (StackEntry != &(Parent->Children)) {
-                StackData = LIST_VALUE(StackEntry,
-                                       STACK_DATA_ENTRY,
-                                       SiblingEntry);
-
-                if (StackData->Address == Address) {
-                    CurrentEntry = StackData;
-                    break;
-                }
-
-                StackEntry = StackEntry->Next;
-            }
-
-            //
-            // If there was no match, create a new entry. If this fails,
-            // just exit returning failure.
+            // Look up the call site in the parent's index of children. If
+            // there was no match, create a new entry. If this fails, just exit
+            // returning failure. Symbols are not resolved here, as this loop
+            // needs to keep up with the target; they are looked up when the
+            // entry is first displayed.
             //
 
+            CurrentEntry = DbgrpFindStackEntry(Parent, Address);
             if (CurrentEntry == NULL) {
-                CurrentEntry = DbgrpCreateStackEntry(DbgrProfilerGlobalContext,
-                                                     Parent,
-                                                     Address);
+                CurrentEntry = DbgrpCreateStackEntry(Parent, Address);
 
                 if (CurrentEntry == NULL) {
                     DbgOut("Error: Failed to create stack entry.\n");
@@ -922,13 +988,12 @@ Return Value:
             }
 
             //
-            // Account for this match on the current entry, remove it, and
-            // then insert it back into the stack in order.
+            // Account for this match on the current entry, and move it up
+            // among its siblings to keep them in order.
             //
 
             CurrentEntry->Count += 1;
-            LIST_REMOVE(&(CurrentEntry->SiblingEntry));
-            DbgrpInsertStackData(Parent, CurrentEntry);
+            DbgrpPromoteStackData(Parent, CurrentEntry);
 
             //
             // Move down the stack.
@@ -990,6 +1055,7 @@ Return Value:
 {
 
     PLIST_ENTRY CurrentEntry;
+    PSTACK_DATA_ENTRY *Previous;
     PSTACK_DATA_ENTRY StackData;
 
     if (Root == NULL) {
@@ -1007,13 +1073,33 @@ Return Value:
     }
 
     //
-    // Now destroy the current root.
+    // Now destroy the current root, unlinking it from its parent's index.
     //
 
     if (Root->SiblingEntry.Next != NULL) {
         LIST_REMOVE(&(Root->SiblingEntry));
     }
 
+    if ((Root->Parent != NULL) && (Root->Parent->ChildTable != NULL)) {
+        Previous = &(Root->Parent->ChildTable[
+                PROFILER_HASH_ADDRESS(Root->Address,
+                                      Root->Parent->ChildTableSize)]);
+
+        while (*Previous != NULL) {
+            if (*Previous == Root) {
+                *Previous = Root->HashNext;
+                Root->Parent->ChildCount -= 1;
+                break;
+            }
+
+            Previous = &((*Previous)->HashNext);
+        }
+    }
+
+    if (Root->ChildTable != NULL) {
+        free(Root->ChildTable);
+    }
+
     if (Root->AddressSymbol != NULL) {
         free(Root->AddressSymbol);
     }
@@ -1053,6 +1139,136 @@ Return Value:
     return;
 }
 
+INT
+DbgrExportProfilerStackData (
+    PSTACK_DATA_ENTRY Root
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes profiler stack data out in folded stack format, one
+    line per unique call stack followed by the number of samples that ended
+    there. This is the input format consumed by flame graph tools. The data
+    is written to the file named by the current export request.
+
+Arguments:
+
+    Root - Supplies a pointer to the root of the profiler stack data tree.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error code on failure.
+
+--*/
+
+{
+
+    PDEBUGGER_CONTEXT Context;
+    FILE *File;
+    ULONG FrameCapacity;
+    PSTR *Frames;
+    PSTR Path;
+    INT Result;
+
+    Context = DbgrProfilerGlobalContext;
+    Path = Context->ProfilingData.FoldedStackPath;
+
+    assert(Path != NULL);
+
+    if ((Root == NULL) || (Root->Count == 0)) {
+        DbgOut("Error: There is no valid stack data to export.\n");
+        return ENOENT;
+    }
+
+    File = fopen(Path, "w");
+    if (File == NULL) {
+        Result = errno;
+        DbgOut("Error: Failed to open %s: %s.\n", Path, strerror(Result));
+        return Result;
+    }
+
+    Frames = NULL;
+    FrameCapacity = 0;
+    Result = DbgrpWriteFoldedStacks(Context,
+                                    File,
+                                    Root,
+                                    &Frames,
+                                    &FrameCapacity,
+                                    0);
+
+    if (Frames != NULL) {
+        free(Frames);
+    }
+
+    if ((fclose(File) != 0) && (Result == 0)) {
+        Result = errno;
+    }
+
+    if (Result != 0) {
+        DbgOut("Error: Failed to write folded stacks to %s: %s.\n",
+               Path,
+               strerror(Result));
+
+        return Result;
+    }
+
+    DbgOut("Wrote %d stack samples to %s.\n", Root->Count, Path);
+    return 0;
+}
+
+PSTR
+DbgrGetProfilerStackEntrySymbol (
+    PSTACK_DATA_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the symbol string for a profiler stack entry,
+    resolving it if this is the first time the entry has been displayed.
+
+Arguments:
+
+    Entry - Supplies a pointer to the stack entry.
+
+Return Value:
+
+    Returns a pointer to the symbol string, which is owned by the entry.
+
+    NULL for the root of the tree or if the address could not be resolved.
+
+--*/
+
+{
+
+    PPROFILER_SYMBOL_ENTRY CacheEntry;
+
+    if (Entry->Parent == NULL) {
+        return NULL;
+    }
+
+    //
+    // Each entry gets its own copy of the string so that the cache can be
+    // thrown away if the loaded modules change.
+    //
+
+    if (Entry->AddressSymbol == NULL) {
+        CacheEntry = DbgrpLookupProfilerSymbol(DbgrProfilerGlobalContext,
+                                               Entry->Address);
+
+        if (CacheEntry != NULL) {
+            Entry->AddressSymbol = strdup(CacheEntry->Symbol);
+        }
+    }
+
+    return Entry->AddressSymbol;
+}
+
 VOID
 DbgrProfilerStackEntrySelected (
     PSTACK_DATA_ENTRY Root
@@ -1945,7 +2161,6 @@ Return Value:
 
 PSTACK_DATA_ENTRY
 DbgrpCreateStackEntry (
-    PDEBUGGER_CONTEXT Context,
     PSTACK_DATA_ENTRY Parent,
     ULONGLONG Address
     )
@@ -1955,18 +2170,14 @@ DbgrpCreateStackEntry (
 Routine Description:
 
     This routine creates a stack entry and inserts it into the parent's list of
-    children.
+    children and its child index.
 
 Arguments:
 
-    Context - Supplies a pointer to the application context.
-
     Parent - Supplies a pointer to the stack entry's parent.
 
     Address - Supplies the call site address for this stack entry.
 
-    ReturnAddress - Supplies the return address for this stack entry.
-
 Return Value:
 
     Returns a pointer to a stack entry on success, or NULL on failure.
@@ -1975,13 +2186,9 @@ Return Value:
 
 {
 
-    PSTR AddressSymbol;
-    BOOL Result;
+    ULONG Bucket;
     PSTACK_DATA_ENTRY StackData;
 
-    AddressSymbol = NULL;
-    Result = FALSE;
-
     //
     // Allocate a new stack data entry and begin filling it in.
     //
@@ -1991,7 +2198,7 @@ Return Value:
         DbgOut("Error: Failed to allocate %d bytes.\n",
                sizeof(STACK_DATA_ENTRY));
 
-        goto CreateStackDataEntryEnd;
+        return NULL;
     }
 
     RtlZeroMemory(StackData, sizeof(STACK_DATA_ENTRY));
@@ -2002,54 +2209,158 @@ Return Value:
 
     assert(StackData->Count == 0);
     assert(StackData->UiHandle == NULL);
+    assert(StackData->AddressSymbol == NULL);
 
     //
     // If the parent is NULL, then this is the root. Just exit.
     //
 
     if (Parent == NULL) {
-
-        assert(StackData->AddressSymbol == NULL);
-
-        Result = TRUE;
-        goto CreateStackDataEntryEnd;
+        return StackData;
     }
 
     //
-    // Get the name for the stack data entry.
+    // Make sure the parent's index has room for another child. Failing to
+    // grow an existing table is fine, the chains just get longer.
     //
 
-    AddressSymbol = DbgGetAddressSymbol(Context, Address, NULL);
-    if (AddressSymbol == NULL) {
-        DbgOut("Error: failed to get symbol for address 0x%I64x.\n", Address);
-        goto CreateStackDataEntryEnd;
+    if ((Parent->ChildTable == NULL) ||
+        (Parent->ChildCount >= Parent->ChildTableSize)) {
+
+        DbgrpGrowStackChildTable(Parent);
+        if (Parent->ChildTable == NULL) {
+            free(StackData);
+            return NULL;
+        }
     }
 
-    StackData->AddressSymbol = AddressSymbol;
+    Bucket = PROFILER_HASH_ADDRESS(Address, Parent->ChildTableSize);
+    StackData->HashNext = Parent->ChildTable[Bucket];
+    Parent->ChildTable[Bucket] = StackData;
+    Parent->ChildCount += 1;
 
     //
     // Insert this new stack entry into the parent's list of children in order.
     //
 
-    if (Parent != NULL) {
-        DbgrpInsertStackData(Parent, StackData);
+    DbgrpInsertStackData(Parent, StackData);
+    return StackData;
+}
+
+PSTACK_DATA_ENTRY
+DbgrpFindStackEntry (
+    PSTACK_DATA_ENTRY Parent,
+    ULONGLONG Address
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up the child of the given stack entry with the given
+    call site address.
+
+Arguments:
+
+    Parent - Supplies a pointer to the parent stack entry.
+
+    Address - Supplies the call site address to search for.
+
+Return Value:
+
+    Returns a pointer to the child stack entry on success.
+
+    NULL if the parent has no child with the given address.
+
+--*/
+
+{
+
+    PSTACK_DATA_ENTRY StackData;
+
+    if (Parent->ChildTable == NULL) {
+        return NULL;
     }
 
-    Result = TRUE;
+    StackData = Parent->ChildTable[PROFILER_HASH_ADDRESS(
+                                                    Address,
+                                                    Parent->ChildTableSize)];
 
-CreateStackDataEntryEnd:
-    if (Result == FALSE) {
-        if (StackData != NULL) {
-            free(StackData);
-            StackData = NULL;
+    while (StackData != NULL) {
+        if (StackData->Address == Address) {
+            return StackData;
         }
 
-        if (AddressSymbol != NULL) {
-            free(AddressSymbol);
-        }
+        StackData = StackData->HashNext;
     }
 
-    return StackData;
+    return NULL;
+}
+
+VOID
+DbgrpGrowStackChildTable (
+    PSTACK_DATA_ENTRY Parent
+    )
+
+/*++
+
+Routine Description:
+
+    This routine doubles the size of a stack entry's child index, or creates
+    the index if the entry has no children yet. On allocation failure the
+    existing index is left untouched.
+
+Arguments:
+
+    Parent - Supplies a pointer to the stack entry whose index should grow.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    PLIST_ENTRY CurrentEntry;
+    PSTACK_DATA_ENTRY *NewTable;
+    ULONG NewTableSize;
+    PSTACK_DATA_ENTRY StackData;
+
+    NewTableSize = Parent->ChildTableSize * 2;
+    if (NewTableSize == 0) {
+        NewTableSize = STACK_DATA_INITIAL_CHILD_BUCKETS;
+    }
+
+    NewTable = calloc(NewTableSize, sizeof(PSTACK_DATA_ENTRY));
+    if (NewTable == NULL) {
+        DbgOut("Error: Failed to allocate %d bytes.\n",
+               NewTableSize * sizeof(PSTACK_DATA_ENTRY));
+
+        return;
+    }
+
+    //
+    // Every child is on the sibling list, so rehash them from there.
+    //
+
+    CurrentEntry = Parent->Children.Next;
+    while (CurrentEntry != &(Parent->Children)) {
+        StackData = LIST_VALUE(CurrentEntry, STACK_DATA_ENTRY, SiblingEntry);
+        Bucket = PROFILER_HASH_ADDRESS(StackData->Address, NewTableSize);
+        StackData->HashNext = NewTable[Bucket];
+        NewTable[Bucket] = StackData;
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    if (Parent->ChildTable != NULL) {
+        free(Parent->ChildTable);
+    }
+
+    Parent->ChildTable = NewTable;
+    Parent->ChildTableSize = NewTableSize;
+    return;
 }
 
 VOID
@@ -2113,6 +2424,431 @@ Return Value:
     return;
 }
 
+VOID
+DbgrpPromoteStackData (
+    PSTACK_DATA_ENTRY Parent,
+    PSTACK_DATA_ENTRY Child
+    )
+
+/*++
+
+Routine Description:
+
+    This routine restores the ordering of the parent's list of children after
+    the given child's count has been incremented. Since the count only ever
+    grows, the child can only move towards the front of the list.
+
+Arguments:
+
+    Parent - Supplies a pointer to the parent stack entry.
+
+    Child - Supplies a pointer to the stack entry whose count just changed.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY PreviousEntry;
+    PSTACK_DATA_ENTRY StackData;
+
+    PreviousEntry = Child->SiblingEntry.Previous;
+    while (PreviousEntry != &(Parent->Children)) {
+        StackData = LIST_VALUE(PreviousEntry, STACK_DATA_ENTRY, SiblingEntry);
+        if ((StackData->Count > Child->Count) ||
+            ((StackData->Count == Child->Count) &&
+             (StackData->Address < Child->Address))) {
+
+            break;
+        }
+
+        PreviousEntry = PreviousEntry->Previous;
+    }
+
+    if (PreviousEntry != Child->SiblingEntry.Previous) {
+        LIST_REMOVE(&(Child->SiblingEntry));
+        INSERT_AFTER(&(Child->SiblingEntry), PreviousEntry);
+    }
+
+    return;
+}
+
+PPROFILER_SYMBOL_ENTRY
+DbgrpLookupProfilerSymbol (
+    PDEBUGGER_CONTEXT Context,
+    ULONGLONG Address
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the cached symbol information for the given stack
+    address, resolving the address and adding it to the cache if this is the
+    first time it has been seen. The cache is discarded whenever the loaded
+    module list changes.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Address - Supplies the address to look up.
+
+Return Value:
+
+    Returns a pointer to the symbol cache entry on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    PPROFILER_SYMBOL_ENTRY Entry;
+    PFUNCTION_SYMBOL Function;
+    ULONG Index;
+    PDEBUGGER_MODULE Module;
+    ULONG NameSize;
+    PPROFILER_SYMBOL_ENTRY *NewCache;
+    ULONG NewCacheSize;
+    PPROFILER_SYMBOL_ENTRY Next;
+    PDEBUGGER_PROFILING_DATA ProfilingData;
+
+    ProfilingData = &(Context->ProfilingData);
+    if ((ProfilingData->SymbolCache != NULL) &&
+        (ProfilingData->SymbolCacheSignature !=
+         Context->ModuleList.Signature)) {
+
+        DbgrpDestroyProfilerSymbolCache(Context);
+    }
+
+    if (ProfilingData->SymbolCache == NULL) {
+        ProfilingData->SymbolCache =
+                          calloc(PROFILER_SYMBOL_CACHE_INITIAL_BUCKETS,
+                                 sizeof(PPROFILER_SYMBOL_ENTRY));
+
+        if (ProfilingData->SymbolCache == NULL) {
+            return NULL;
+        }
+
+        ProfilingData->SymbolCacheSize = PROFILER_SYMBOL_CACHE_INITIAL_BUCKETS;
+        ProfilingData->SymbolCacheCount = 0;
+        ProfilingData->SymbolCacheSignature = Context->ModuleList.Signature;
+    }
+
+    Bucket = PROFILER_HASH_ADDRESS(Address, ProfilingData->SymbolCacheSize);
+    Entry = ProfilingData->SymbolCache[Bucket];
+    while (Entry != NULL) {
+        if (Entry->Address == Address) {
+            return Entry;
+        }
+
+        Entry = Entry->Next;
+    }
+
+    //
+    // This address has not been seen before. Resolve it.
+    //
+
+    Entry = malloc(sizeof(PROFILER_SYMBOL_ENTRY));
+    if (Entry == NULL) {
+        return NULL;
+    }
+
+    RtlZeroMemory(Entry, sizeof(PROFILER_SYMBOL_ENTRY));
+    Entry->Address = Address;
+    Entry->Symbol = DbgGetAddressSymbol(Context, Address, &Function);
+    if (Entry->Symbol == NULL) {
+        DbgOut("Error: failed to get symbol for address 0x%I64x.\n", Address);
+        free(Entry);
+        return NULL;
+    }
+
+    //
+    // Folded stacks are aggregated by function, so also save the function
+    // name without the offset.
+    //
+
+    if ((Function != NULL) && (Function->Name != NULL)) {
+        Module = DbgpFindModuleFromAddress(Context, Address, NULL);
+        if (Module != NULL) {
+            NameSize = RtlStringLength(Module->ModuleName) +
+                       RtlStringLength(Function->Name) +
+                       (sizeof(CHAR) * 2);
+
+            Entry->FrameName = malloc(NameSize);
+            if (Entry->FrameName != NULL) {
+                snprintf(Entry->FrameName,
+                         NameSize,
+                         "%s!%s",
+                         Module->ModuleName,
+                         Function->Name);
+            }
+        }
+    }
+
+    //
+    // Double the number of buckets if the cache is getting full. If that
+    // fails, just live with longer chains.
+    //
+
+    if (ProfilingData->SymbolCacheCount >= ProfilingData->SymbolCacheSize) {
+        NewCacheSize = ProfilingData->SymbolCacheSize * 2;
+        NewCache = calloc(NewCacheSize, sizeof(PPROFILER_SYMBOL_ENTRY));
+        if (NewCache != NULL) {
+            for (Index = 0; Index < ProfilingData->SymbolCacheSize; Index += 1) {
+                Next = ProfilingData->SymbolCache[Index];
+                while (Next != NULL) {
+                    Bucket = PROFILER_HASH_ADDRESS(Next->Address, NewCacheSize);
+                    ProfilingData->SymbolCache[Index] = Next->Next;
+                    Next->Next = NewCache[Bucket];
+                    NewCache[Bucket] = Next;
+                    Next = ProfilingData->SymbolCache[Index];
+                }
+            }
+
+            free(ProfilingData->SymbolCache);
+            ProfilingData->SymbolCache = NewCache;
+            ProfilingData->SymbolCacheSize = NewCacheSize;
+        }
+
+        Bucket = PROFILER_HASH_ADDRESS(Address, ProfilingData->SymbolCacheSize);
+    }
+
+    Entry->Next = ProfilingData->SymbolCache[Bucket];
+    ProfilingData->SymbolCache[Bucket] = Entry;
+    ProfilingData->SymbolCacheCount += 1;
+    return Entry;
+}
+
+VOID
+DbgrpDestroyProfilerSymbolCache (
+    PDEBUGGER_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys the profiler's cache of resolved stack addresses.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPROFILER_SYMBOL_ENTRY Entry;
+    ULONG Index;
+    PDEBUGGER_PROFILING_DATA ProfilingData;
+
+    ProfilingData = &(Context->ProfilingData);
+    if (ProfilingData->SymbolCache == NULL) {
+        return;
+    }
+
+    for (Index = 0; Index < ProfilingData->SymbolCacheSize; Index += 1) {
+        while (ProfilingData->SymbolCache[Index] != NULL) {
+            Entry = ProfilingData->SymbolCache[Index];
+            ProfilingData->SymbolCache[Index] = Entry->Next;
+            if (Entry->FrameName != NULL) {
+                free(Entry->FrameName);
+            }
+
+            free(Entry->Symbol);
+            free(Entry);
+        }
+    }
+
+    free(ProfilingData->SymbolCache);
+    ProfilingData->SymbolCache = NULL;
+    ProfilingData->SymbolCacheSize = 0;
+    ProfilingData->SymbolCacheCount = 0;
+    return;
+}
+
+PSTR
+DbgrpGetProfilerFrameName (
+    PDEBUGGER_CONTEXT Context,
+    PSTACK_DATA_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the name to use for a stack entry in folded stack
+    output. This is the module and function name if the address falls in a
+    function, or the full symbol string otherwise.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Entry - Supplies a pointer to the stack entry.
+
+Return Value:
+
+    Returns a pointer to the frame name, which is owned by the symbol cache.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PPROFILER_SYMBOL_ENTRY CacheEntry;
+
+    CacheEntry = DbgrpLookupProfilerSymbol(Context, Entry->Address);
+    if (CacheEntry == NULL) {
+        return NULL;
+    }
+
+    if (CacheEntry->FrameName != NULL) {
+        return CacheEntry->FrameName;
+    }
+
+    return CacheEntry->Symbol;
+}
+
+INT
+DbgrpWriteFoldedStacks (
+    PDEBUGGER_CONTEXT Context,
+    FILE *File,
+    PSTACK_DATA_ENTRY Entry,
+    PSTR **Frames,
+    PULONG FrameCapacity,
+    ULONG Depth
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the folded stack lines for the given stack entry and
+    all of its descendants.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    File - Supplies the file to write to.
+
+    Entry - Supplies a pointer to the stack entry to write.
+
+    Frames - Supplies a pointer to an array of frame names from the root down
+        to the given entry's parent. This array may be reallocated.
+
+    FrameCapacity - Supplies a pointer to the number of elements allocated in
+        the frame array. This will be updated if the array is reallocated.
+
+    Depth - Supplies the number of valid frames in the frame array.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error code on failure.
+
+--*/
+
+{
+
+    ULONG ChildCount;
+    PLIST_ENTRY CurrentEntry;
+    PSTR FrameName;
+    ULONG Index;
+    PSTR *NewFrames;
+    ULONG NewCapacity;
+    INT Result;
+    PSTACK_DATA_ENTRY StackData;
+
+    //
+    // Push this entry's name onto the frame array. The root has no frame.
+    //
+
+    if (Entry->Parent != NULL) {
+        if (Depth >= *FrameCapacity) {
+            NewCapacity = *FrameCapacity * 2;
+            if (NewCapacity == 0) {
+                NewCapacity = 32;
+            }
+
+            NewFrames = realloc(*Frames, NewCapacity * sizeof(PSTR));
+            if (NewFrames == NULL) {
+                return ENOMEM;
+            }
+
+            *Frames = NewFrames;
+            *FrameCapacity = NewCapacity;
+        }
+
+        FrameName = DbgrpGetProfilerFrameName(Context, Entry);
+        if (FrameName == NULL) {
+            return ENOMEM;
+        }
+
+        (*Frames)[Depth] = FrameName;
+        Depth += 1;
+    }
+
+    //
+    // Recurse into the children, tallying up the samples that went further
+    // down the stack.
+    //
+
+    ChildCount = 0;
+    CurrentEntry = Entry->Children.Next;
+    while (CurrentEntry != &(Entry->Children)) {
+        StackData = LIST_VALUE(CurrentEntry, STACK_DATA_ENTRY, SiblingEntry);
+        ChildCount += StackData->Count;
+        Result = DbgrpWriteFoldedStacks(Context,
+                                        File,
+                                        StackData,
+                                        Frames,
+                                        FrameCapacity,
+                                        Depth);
+
+        if (Result != 0) {
+            return Result;
+        }
+
+        CurrentEntry = CurrentEntry->Next;
+    }
+
+    //
+    // Any samples left over ended in this entry. Write out the stack leading
+    // here along with that count.
+    //
+
+    if ((Depth != 0) && (Entry->Count > ChildCount)) {
+        for (Index = 0; Index < Depth; Index += 1) {
+            if (Index != 0) {
+                fputc(';', File);
+            }
+
+            fputs((*Frames)[Index], File);
+        }
+
+        fprintf(File, " %u\n", Entry->Count - ChildCount);
+        if (ferror(File) != 0) {
+            return EIO;
+        }
+    }
+
+    return 0;
+}
+
 VOID
 DbgrpPrintProfilerStackData (
     PSTACK_DATA_ENTRY Root,
@@ -2204,11 +2940,14 @@ Return Value:
         // Print the stack entry's information.
         //
 
-        if (StackData->AddressSymbol == NULL) {
+        if (StackData->Parent == NULL) {
             FunctionString = "Root";
 
         } else {
-            FunctionString = StackData->AddressSymbol;
+            FunctionString = DbgrGetProfilerStackEntrySymbol(StackData);
+            if (FunctionString == NULL) {
+                FunctionString = "<unknown>";
+            }
         }
 
         DbgOut("%s: %d%%, %d\n", FunctionString, Percent, StackData->Count);
@@ -2490,6 +3229,13 @@ Return Value:
             return EINVAL;
         }
 
+    } else if (strcasecmp(Arguments[1], "folded") == 0) {
+        DisplayRequest = ProfilerDisplayExportFolded;
+        if (ArgumentCount < 3) {
+            DbgOut("Error: Output file argument expected.\n");
+            return EINVAL;
+        }
+
     } else if (strcasecmp(Arguments[1], "help") == 0) {
         DbgOut(STACK_PROFILER_USAGE);
         return 0;
@@ -2500,10 +3246,19 @@ Return Value:
         return EINVAL;
     }
 
+    //
+    // The export path is only borrowed for the duration of the request.
+    //
+
+    if (DisplayRequest == ProfilerDisplayExportFolded) {
+        Context->ProfilingData.FoldedStackPath = Arguments[2];
+    }
+
     UiDisplayProfilerData(ProfilerDataTypeStack,
                           DisplayRequest,
                           (ULONG)Threshold);
 
+    Context->ProfilingData.FoldedStackPath = NULL;
     return 0;
 }
 
@@ -65,6 +65,10 @@ Enumeration Description:
     ProfilerDisplayStopDelta - Indicates that the profiler display should stop
         only displaying the deltas in data.
 
+    ProfilerDisplayExportFolded - Indicates that the collected data should be
+        written out in folded stack format to the file named in the profiling
+        data's folded stack path.
+
 --*/
 
 typedef enum _PROFILER_DISPLAY_REQUEST {
@@ -75,7 +79,8 @@ typedef enum _PROFILER_DISPLAY_REQUEST {
     ProfilerDisplayStop,
     ProfilerDisplayClear,
     ProfilerDisplayStartDelta,
-    ProfilerDisplayStopDelta
+    ProfilerDisplayStopDelta,
+    ProfilerDisplayExportFolded
 } PROFILER_DISPLAY_REQUEST, *PPROFILER_DISPLAY_REQUEST;
 
 /*++
@@ -95,9 +100,23 @@ Structure Description:
     Address - Stores the current address for this stack entry.
 
     AddressSymbol - Stores a string representation of the stack entry's address.
+        This is resolved lazily the first time the entry is displayed.
 
     Count - Stores the number of times that the address has been encountered.
 
+    UiHandle - Stores the handle of the UI element displaying this entry.
+
+    HashNext - Stores a pointer to the next entry in the parent's child hash
+        bucket.
+
+    ChildTable - Stores an array of hash buckets indexing the children by
+        address. This is allocated when the first child is added.
+
+    ChildTableSize - Stores the number of buckets in the child table. This is
+        always a power of two.
+
+    ChildCount - Stores the number of children in the child table.
+
 --*/
 
 typedef struct _STACK_DATA_ENTRY STACK_DATA_ENTRY, *PSTACK_DATA_ENTRY;
@@ -109,6 +128,40 @@ struct _STACK_DATA_ENTRY {
     PSTR AddressSymbol;
     ULONG Count;
     HANDLE UiHandle;
+    PSTACK_DATA_ENTRY HashNext;
+    PSTACK_DATA_ENTRY *ChildTable;
+    ULONG ChildTableSize;
+    ULONG ChildCount;
+};
+
+/*++
+
+Structure Description:
+
+    This structure defines an entry in the profiler's cache of resolved stack
+    addresses.
+
+Members:
+
+    Next - Stores a pointer to the next entry in the hash bucket.
+
+    Address - Stores the address that was resolved.
+
+    Symbol - Stores the full symbol string for the address, including the
+        offset into the function.
+
+    FrameName - Stores the name of the function containing the address, used
+        when exporting folded stacks. This is created on demand.
+
+--*/
+
+typedef struct _PROFILER_SYMBOL_ENTRY PROFILER_SYMBOL_ENTRY;
+typedef PROFILER_SYMBOL_ENTRY *PPROFILER_SYMBOL_ENTRY;
+struct _PROFILER_SYMBOL_ENTRY {
+    PPROFILER_SYMBOL_ENTRY Next;
+    ULONGLONG Address;
+    PSTR Symbol;
+    PSTR FrameName;
 };
 
 /*++
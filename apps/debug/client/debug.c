@@ -73,12 +73,15 @@ Module Name:
 #define DEBUGGER_USAGE                                                         \
     "Usage: debug [-i] [-s <path>...] [-e <path>...] "                         \
     "[-k <connection>] [-b <baud_rate>] [-r remote:port] \n"                   \
-    "[-- <child_parameters...>]\n\n"        \
+    "[-c <dump_file>] [-- <child_parameters...>]\n\n"                          \
     "The Minoca debugger facilitates debugging, tracing, and profiling of \n"  \
     "user mode programs and remote kernels. Options are:\n"                    \
     "  -b, --baud-rate=<baud_rate> -- Specify the baud rate for kernel \n"     \
     "      serial port connections. If not specified, the default is \n"       \
     "      115200bps.\n"                                                       \
+    "  -c, --crash-dump=<dump_file> -- Debug a kernel crash dump file. \n"     \
+    "      The state of the crashing processor and the memory saved in the \n" \
+    "      dump can be examined, but the target cannot be resumed.\n"          \
     "  -i, --initial-break -- Request an initial breakpoint upon connection.\n"\
     "  -e, --extension=<path> -- Load the debugger extension at the given \n"  \
     "      path. This can also be done at runtime using the load command.\n"   \
@@ -107,7 +110,7 @@ Module Name:
     "      arguments of the child process to launch and attach to. \n"         \
     "      Debugging a child process is incompatible with the -k option.\n\n"
 
-#define DEBUG_SHORT_OPTIONS "b:e:ik:r:R:s:S:"
+#define DEBUG_SHORT_OPTIONS "b:c:e:ik:r:R:s:S:"
 
 //
 // -------------------------------------------------------------------- Globals
@@ -115,6 +118,7 @@ Module Name:
 
 struct option DbgrLongOptions[] = {
     {"baud-rate", required_argument, 0, 'b'},
+    {"crash-dump", required_argument, 0, 'c'},
     {"extension", required_argument, 0, 'e'},
     {"initial-break", no_argument, 0, 'i'},
     {"kernel", required_argument, 0, 'k'},
@@ -187,6 +191,7 @@ Return Value:
     PDEBUGGER_COMMAND_ENTRY CommandEntry;
     DEBUG_CONNECTION_TYPE ConnectionType;
     DEBUGGER_CONTEXT Context;
+    PSTR CrashDumpPath;
     BOOL ExtensionsInitialized;
     ULONG HistoryIndex;
     INT Option;
@@ -201,6 +206,7 @@ Return Value:
     BaudRate = DEBUGGER_DEFAULT_BAUD_RATE;
     ConnectionType = DebugConnectionInvalid;
     Channel = NULL;
+    CrashDumpPath = NULL;
     ExtensionsInitialized = FALSE;
     RemoteAddress = NULL;
     ReverseRemote = FALSE;
@@ -292,6 +298,19 @@ Return Value:
 
             break;
 
+        case 'c':
+            if (ConnectionType != DebugConnectionInvalid) {
+                DbgOut("Error: -c conflicts with a previously specified "
+                       "connection type.\n");
+
+                Result = EINVAL;
+                goto MainEnd;
+            }
+
+            CrashDumpPath = optarg;
+            ConnectionType = DebugConnectionCrashDump;
+            break;
+
         case 'e':
             Result = DbgLoadExtension(&Context, optarg);
             if (Result != 0) {
@@ -490,6 +509,20 @@ Return Value:
             goto MainEnd;
         }
 
+    //
+    // For crash dumps, open the file. The first wait reports the break of the
+    // crashing processor.
+    //
+
+    } else if (ConnectionType == DebugConnectionCrashDump) {
+
+        assert(CrashDumpPath != NULL);
+
+        Result = DbgrOpenCrashDump(&Context, CrashDumpPath);
+        if (Result != 0) {
+            goto MainEnd;
+        }
+
     } else {
 
         assert(ConnectionType == DebugConnectionRemote);
@@ -1045,6 +1078,9 @@ Return Value:
             sprintf(Prompt, "kd>");
         }
 
+    } else if (Context->ConnectionType == DebugConnectionCrashDump) {
+        sprintf(Prompt, "dump>");
+
     } else {
 
         assert(Context->ConnectionType == DebugConnectionUser);
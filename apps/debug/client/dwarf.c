@@ -89,11 +89,48 @@ DwarfpCheckRange (
     PVOID Ranges
     );
 
+BOOL
+DwarfDemandLoadSymbols (
+    PDEBUG_SYMBOLS Symbols,
+    PULONGLONG Address
+    );
+
+BOOL
+DwarfpIsAddressInRangeList (
+    PDWARF_COMPILATION_UNIT Unit,
+    PVOID Ranges,
+    ULONGLONG Address
+    );
+
+BOOL
+DwarfpIsAddressInUnit (
+    PDWARF_COMPILATION_UNIT Unit,
+    ULONGLONG Address
+    );
+
 INT
 DwarfpProcessDebugInfo (
     PDWARF_CONTEXT Context
     );
 
+INT
+DwarfpScanCompilationUnit (
+    PDWARF_CONTEXT Context,
+    PDWARF_COMPILATION_UNIT Unit
+    );
+
+INT
+DwarfpLoadUnitSymbols (
+    PDWARF_CONTEXT Context,
+    PDWARF_COMPILATION_UNIT Unit
+    );
+
+VOID
+DwarfpReadUnitAddresses (
+    PDWARF_CONTEXT Context,
+    PDWARF_DIE Die
+    );
+
 INT
 DwarfpProcessCompilationUnit (
     PDWARF_CONTEXT Context,
@@ -194,7 +231,8 @@ DEBUG_SYMBOL_INTERFACE DwarfSymbolInterface = {
     DwarfStackUnwind,
     DwarfReadDataSymbol,
     DwarfGetAddressOfDataSymbol,
-    DwarfpCheckRange
+    DwarfpCheckRange,
+    DwarfDemandLoadSymbols
 };
 
 //
@@ -951,6 +989,120 @@ Return Value:
 
 --*/
 
+{
+
+    return DwarfpIsAddressInRangeList(Source->SymbolContext, Ranges, Address);
+}
+
+BOOL
+DwarfDemandLoadSymbols (
+    PDEBUG_SYMBOLS Symbols,
+    PULONGLONG Address
+    )
+
+/*++
+
+Routine Description:
+
+    This routine loads the symbols for any compilation units covering the
+    given address that have not been loaded yet. If no compilation unit claims
+    the address (it may be a data address, for instance), or no address is
+    supplied, all remaining compilation units are loaded.
+
+Arguments:
+
+    Symbols - Supplies a pointer to the debug symbols.
+
+    Address - Supplies an optional pointer to the debased address being
+        looked up. Supply NULL to load all remaining symbols.
+
+Return Value:
+
+    TRUE if new symbols were added to the module.
+
+    FALSE if nothing new was loaded.
+
+--*/
+
+{
+
+    BOOL Claimed;
+    PDWARF_CONTEXT Context;
+    PLIST_ENTRY CurrentEntry;
+    BOOL Loaded;
+    PDWARF_COMPILATION_UNIT Unit;
+
+    Context = Symbols->SymbolContext;
+    if (Context->PendingUnitCount == 0) {
+        return FALSE;
+    }
+
+    Loaded = FALSE;
+    if (Address != NULL) {
+        Claimed = FALSE;
+        CurrentEntry = Context->UnitList.Next;
+        while (CurrentEntry != &(Context->UnitList)) {
+            Unit = LIST_VALUE(CurrentEntry, DWARF_COMPILATION_UNIT, ListEntry);
+            CurrentEntry = CurrentEntry->Next;
+            if (DwarfpIsAddressInUnit(Unit, *Address) == FALSE) {
+                continue;
+            }
+
+            Claimed = TRUE;
+            if ((Unit->Flags & DWARF_UNIT_LOADED) == 0) {
+                DwarfpLoadUnitSymbols(Context, Unit);
+                Loaded = TRUE;
+            }
+        }
+
+        if (Claimed != FALSE) {
+            return Loaded;
+        }
+    }
+
+    CurrentEntry = Context->UnitList.Next;
+    while (CurrentEntry != &(Context->UnitList)) {
+        Unit = LIST_VALUE(CurrentEntry, DWARF_COMPILATION_UNIT, ListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        if ((Unit->Flags & DWARF_UNIT_LOADED) == 0) {
+            DwarfpLoadUnitSymbols(Context, Unit);
+            Loaded = TRUE;
+        }
+    }
+
+    return Loaded;
+}
+
+BOOL
+DwarfpIsAddressInRangeList (
+    PDWARF_COMPILATION_UNIT Unit,
+    PVOID Ranges,
+    ULONGLONG Address
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the given address is within a range list.
+
+Arguments:
+
+    Unit - Supplies a pointer to the compilation unit the range list belongs
+        to.
+
+    Ranges - Supplies a pointer to the range list within .debug_ranges.
+
+    Address - Supplies the address to query.
+
+Return Value:
+
+    TRUE if the address is within the range list.
+
+    FALSE if the address is not within the range list.
+
+--*/
+
 {
 
     ULONGLONG Base;
@@ -958,10 +1110,8 @@ Return Value:
     BOOL Is64Bit;
     ULONGLONG RangeEnd;
     ULONGLONG RangeStart;
-    PDWARF_COMPILATION_UNIT Unit;
 
     Bytes = Ranges;
-    Unit = Source->SymbolContext;
     Is64Bit = Unit->Is64Bit;
     Base = Unit->LowPc;
     while (TRUE) {
@@ -991,6 +1141,46 @@ Return Value:
     return FALSE;
 }
 
+BOOL
+DwarfpIsAddressInUnit (
+    PDWARF_COMPILATION_UNIT Unit,
+    ULONGLONG Address
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the given address falls within the code
+    covered by a compilation unit.
+
+Arguments:
+
+    Unit - Supplies a pointer to the compilation unit.
+
+    Address - Supplies the address to query.
+
+Return Value:
+
+    TRUE if the compilation unit covers the address.
+
+    FALSE if the compilation unit does not cover the address.
+
+--*/
+
+{
+
+    if (Unit->Ranges != NULL) {
+        return DwarfpIsAddressInRangeList(Unit, Unit->Ranges, Address);
+    }
+
+    if ((Address >= Unit->LowPc) && (Address < Unit->HighPc)) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 PSOURCE_FILE_SYMBOL
 DwarfpFindSource (
     PDWARF_CONTEXT Context,
@@ -1116,7 +1306,11 @@ DwarfpProcessDebugInfo (
 
 Routine Description:
 
-    This routine processes the .debug_info section of DWARF symbols.
+    This routine processes the .debug_info section of DWARF symbols. Unless
+    the context asks for everything to be loaded up front, this only indexes
+    the compilation units and the addresses they cover. The DIEs and line
+    numbers of each unit are turned into symbols when a query first needs
+    them.
 
 Arguments:
 
@@ -1133,9 +1327,7 @@ Return Value:
 {
 
     PUCHAR Bytes;
-    PDWARF_DIE Die;
     PUCHAR InfoStart;
-    DWARF_LOADING_CONTEXT LoadState;
     ULONGLONG Size;
     INT Status;
     PDWARF_COMPILATION_UNIT Unit;
@@ -1144,12 +1336,9 @@ Return Value:
     InfoStart = Bytes;
     Size = Context->Sections.Info.Size;
     Status = 0;
-    Unit = NULL;
-    memset(&LoadState, 0, sizeof(DWARF_LOADING_CONTEXT));
-    Context->LoadingContext = &LoadState;
 
     //
-    // Load up and visit all the compilation units.
+    // Read the headers of all the compilation units.
     //
 
     while (Size != 0) {
@@ -1174,38 +1363,146 @@ Return Value:
                         Unit->Dies - InfoStart);
         }
 
-        Status = DwarfpLoadCompilationUnit(Context, Unit);
-        if (Status != 0) {
-            goto ProcessDebugInfoEnd;
-        }
+        INSERT_BEFORE(&(Unit->ListEntry), &(Context->UnitList));
+        Context->PendingUnitCount += 1;
 
         //
-        // Now visit the compilation unit now that the DIE tree has been formed.
+        // Either load the whole unit now, or just peek at the compile unit
+        // DIE to find out what addresses it covers.
         //
 
-        Status = DwarfpProcessCompilationUnit(Context, Unit);
-        if (Status != 0) {
-            DWARF_ERROR("DWARF: Failed to process compilation unit.\n");
-            goto ProcessDebugInfoEnd;
-        }
+        if ((Context->Flags & DWARF_CONTEXT_LOAD_ALL) != 0) {
+            Status = DwarfpLoadUnitSymbols(Context, Unit);
 
-        while (!LIST_EMPTY(&(Unit->DieList))) {
-            Die = LIST_VALUE(Unit->DieList.Next, DWARF_DIE, ListEntry);
-            LIST_REMOVE(&(Die->ListEntry));
-            Die->ListEntry.Next = NULL;
-            DwarfpDestroyDie(Context, Die);
+        } else {
+            Status = DwarfpScanCompilationUnit(Context, Unit);
         }
 
-        INSERT_BEFORE(&(Unit->ListEntry), &(Context->UnitList));
-        Unit = NULL;
+        if (Status != 0) {
+            goto ProcessDebugInfoEnd;
+        }
     }
 
     Status = 0;
 
 ProcessDebugInfoEnd:
+    return Status;
+}
+
+INT
+DwarfpScanCompilationUnit (
+    PDWARF_CONTEXT Context,
+    PDWARF_COMPILATION_UNIT Unit
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads just the compile unit DIE of a compilation unit to
+    determine the range of addresses the unit covers.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Unit - Supplies a pointer to the compilation unit to scan.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
+{
+
+    PDWARF_DIE Die;
+    DWARF_LOADING_CONTEXT LoadState;
+    INT Status;
+
+    Status = DwarfpLoadCompilationUnitDie(Context, Unit, &Die);
+    if (Status != 0) {
+        DWARF_ERROR("DWARF: Failed to scan compilation unit.\n");
+        return Status;
+    }
+
+    if (Die->Tag == DwarfTagCompileUnit) {
+        memset(&LoadState, 0, sizeof(DWARF_LOADING_CONTEXT));
+        LoadState.CurrentUnit = Unit;
+        Context->LoadingContext = &LoadState;
+        DwarfpReadUnitAddresses(Context, Die);
+        Context->LoadingContext = NULL;
+    }
+
+    DwarfpDestroyDie(Context, Die);
+    return 0;
+}
+
+INT
+DwarfpLoadUnitSymbols (
+    PDWARF_CONTEXT Context,
+    PDWARF_COMPILATION_UNIT Unit
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads in the DIE tree for a compilation unit, turns it into
+    symbols, and then frees the DIE tree. A unit is only ever loaded once,
+    even if loading fails.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Unit - Supplies a pointer to the compilation unit to load.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
+{
+
+    PDWARF_DIE Die;
+    DWARF_LOADING_CONTEXT LoadState;
+    INT Status;
+
+    assert((Unit->Flags & DWARF_UNIT_LOADED) == 0);
+    assert(Context->PendingUnitCount != 0);
+
+    Unit->Flags |= DWARF_UNIT_LOADED;
+    Context->PendingUnitCount -= 1;
+    memset(&LoadState, 0, sizeof(DWARF_LOADING_CONTEXT));
+    Context->LoadingContext = &LoadState;
+    Status = DwarfpLoadCompilationUnit(Context, Unit);
+    if (Status != 0) {
+        goto LoadUnitSymbolsEnd;
+    }
+
+    //
+    // Now visit the compilation unit now that the DIE tree has been formed.
+    //
+
+    Status = DwarfpProcessCompilationUnit(Context, Unit);
+    if (Status != 0) {
+        DWARF_ERROR("DWARF: Failed to process compilation unit.\n");
+        goto LoadUnitSymbolsEnd;
+    }
+
+LoadUnitSymbolsEnd:
     Context->LoadingContext = NULL;
-    if (Unit != NULL) {
-        DwarfpDestroyCompilationUnit(Context, Unit);
+    while (!LIST_EMPTY(&(Unit->DieList))) {
+        Die = LIST_VALUE(Unit->DieList.Next, DWARF_DIE, ListEntry);
+        LIST_REMOVE(&(Die->ListEntry));
+        Die->ListEntry.Next = NULL;
+        DwarfpDestroyDie(Context, Die);
     }
 
     return Status;
@@ -1443,7 +1740,6 @@ Return Value:
 {
 
     PDWARF_LOADING_CONTEXT LoadingContext;
-    BOOL Result;
     PSOURCE_FILE_SYMBOL SourceFile;
     INT Status;
     PDWARF_COMPILATION_UNIT Unit;
@@ -1463,44 +1759,16 @@ Return Value:
     SourceFile->SymbolContext = Unit;
 
     //
-    // Get the starting PC for the compilation unit. There might not be one
+    // Get the address range of the compilation unit. There might not be one
     // if this compilation unit has no code (only data).
     //
 
-    Result = DwarfpGetAddressAttribute(Context,
-                                       Die,
-                                       DwarfAtLowPc,
-                                       &(Unit->LowPc));
-
-    if (Result != FALSE) {
+    DwarfpReadUnitAddresses(Context, Die);
+    if ((Unit->Flags & DWARF_UNIT_HAS_LOW_PC) != 0) {
         SourceFile->StartAddress = Unit->LowPc;
-        Unit->HighPc = Unit->LowPc + 1;
-        Result = DwarfpGetAddressAttribute(Context,
-                                           Die,
-                                           DwarfAtHighPc,
-                                           &(Unit->HighPc));
-
-        if (Result == FALSE) {
-
-            //
-            // DWARF4 also allows constant forms for high PC, in which case
-            // it's an offset from low PC.
-            //
-
-            Result = DwarfpGetIntegerAttribute(Context,
-                                               Die,
-                                               DwarfAtHighPc,
-                                               &(Unit->HighPc));
-
-            if (Result != FALSE) {
-                Unit->HighPc += Unit->LowPc;
-            }
-        }
-
         SourceFile->EndAddress = Unit->HighPc;
     }
 
-    Unit->Ranges = DwarfpGetRangeList(Context, Die, DwarfAtRanges);
     if (Unit->Ranges != NULL) {
         DwarfpGetRangeSpan(Context,
                            Unit->Ranges,
@@ -1538,6 +1806,77 @@ Return Value:
     return Status;
 }
 
+VOID
+DwarfpReadUnitAddresses (
+    PDWARF_CONTEXT Context,
+    PDWARF_DIE Die
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads the low PC, high PC, and range list attributes of a
+    compile unit DIE into the current compilation unit.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Die - Supplies a pointer to the compile unit DIE.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PDWARF_LOADING_CONTEXT LoadingContext;
+    BOOL Result;
+    PDWARF_COMPILATION_UNIT Unit;
+
+    LoadingContext = Context->LoadingContext;
+    Unit = LoadingContext->CurrentUnit;
+    Unit->Flags &= ~DWARF_UNIT_HAS_LOW_PC;
+    Unit->LowPc = 0;
+    Unit->HighPc = 0;
+    Result = DwarfpGetAddressAttribute(Context,
+                                       Die,
+                                       DwarfAtLowPc,
+                                       &(Unit->LowPc));
+
+    if (Result != FALSE) {
+        Unit->Flags |= DWARF_UNIT_HAS_LOW_PC;
+        Unit->HighPc = Unit->LowPc + 1;
+        Result = DwarfpGetAddressAttribute(Context,
+                                           Die,
+                                           DwarfAtHighPc,
+                                           &(Unit->HighPc));
+
+        if (Result == FALSE) {
+
+            //
+            // DWARF4 also allows constant forms for high PC, in which case
+            // it's an offset from low PC.
+            //
+
+            Result = DwarfpGetIntegerAttribute(Context,
+                                               Die,
+                                               DwarfAtHighPc,
+                                               &(Unit->HighPc));
+
+            if (Result != FALSE) {
+                Unit->HighPc += Unit->LowPc;
+            }
+        }
+    }
+
+    Unit->Ranges = DwarfpGetRangeList(Context, Die, DwarfAtRanges);
+    return;
+}
+
 INT
 DwarfpProcessBaseType (
     PDWARF_CONTEXT Context,
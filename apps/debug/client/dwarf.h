@@ -63,6 +63,13 @@ Module Name:
 
 #define DWARF_CONTEXT_VERBOSE_UNWINDING 0x00000010
 
+//
+// Set this flag to load the symbols for every compilation unit up front,
+// rather than waiting until a query needs them.
+//
+
+#define DWARF_CONTEXT_LOAD_ALL 0x00000020
+
 //
 // Define the maximum currently implemented depth of the stack. Bump this up if
 // applications seem to be heavily using the DWARF expression stack.
@@ -660,6 +667,9 @@ Structure Description:
     LoadingContext - Stores a pointer to internal state used during the load of
         the module. This is of type DWARF_LOADING_CONTEXT.
 
+    PendingUnitCount - Stores the number of compilation units whose symbols
+        have not yet been loaded.
+
 --*/
 
 typedef struct _DWARF_CONTEXT {
@@ -670,6 +680,7 @@ typedef struct _DWARF_CONTEXT {
     LIST_ENTRY UnitList;
     PLIST_ENTRY SourcesHead;
     PVOID LoadingContext;
+    UINTN PendingUnitCount;
 } DWARF_CONTEXT, *PDWARF_CONTEXT;
 
 //
@@ -81,6 +81,19 @@ Module Name:
 
 #define DWARF_DIE_HAS_CHILDREN 0x00000001
 
+//
+// This flag is set if the compile unit DIE has a low PC attribute.
+//
+
+#define DWARF_UNIT_HAS_LOW_PC 0x00000001
+
+//
+// This flag is set once the DIEs and line numbers of a compilation unit have
+// been turned into symbols (or have failed to).
+//
+
+#define DWARF_UNIT_LOADED 0x00000002
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -136,6 +149,8 @@ Structure Description:
     Ranges - Stores the ranges for the compilation unit if the compilation
         unit convers a non-contiguous region.
 
+    Flags - Stores a bitfield of flags. See DWARF_UNIT_* definitions.
+
 --*/
 
 struct _DWARF_COMPILATION_UNIT {
@@ -152,6 +167,7 @@ struct _DWARF_COMPILATION_UNIT {
     ULONGLONG LowPc;
     ULONGLONG HighPc;
     PVOID Ranges;
+    ULONG Flags;
 };
 
 /*++
@@ -576,6 +592,37 @@ Return Value:
 
 --*/
 
+INT
+DwarfpLoadCompilationUnitDie (
+    PDWARF_CONTEXT Context,
+    PDWARF_COMPILATION_UNIT Unit,
+    PDWARF_DIE *Die
+    );
+
+/*++
+
+Routine Description:
+
+    This routine reads only the top level DIE of a DWARF compilation unit,
+    without any of its children.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Unit - Supplies a pointer to the compilation unit.
+
+    Die - Supplies a pointer where a pointer to the DIE will be returned on
+        success. The caller is responsible for destroying it.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
 VOID
 DwarfpDestroyCompilationUnit (
     PDWARF_CONTEXT Context,
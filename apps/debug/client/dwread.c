@@ -565,6 +565,118 @@ Return Value:
     return Status;
 }
 
+INT
+DwarfpLoadCompilationUnitDie (
+    PDWARF_CONTEXT Context,
+    PDWARF_COMPILATION_UNIT Unit,
+    PDWARF_DIE *Die
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads only the top level DIE of a DWARF compilation unit,
+    without any of its children.
+
+Arguments:
+
+    Context - Supplies a pointer to the application context.
+
+    Unit - Supplies a pointer to the compilation unit.
+
+    Die - Supplies a pointer where a pointer to the DIE will be returned on
+        success. The caller is responsible for destroying it.
+
+Return Value:
+
+    0 on success.
+
+    Returns an error number on failure.
+
+--*/
+
+{
+
+    DWARF_LEB128 AbbreviationNumber;
+    PUCHAR *Abbreviations;
+    UINTN AbbreviationsCount;
+    UINTN AllocationSize;
+    PUCHAR DieBytes;
+    UINTN MaxAttributes;
+    PDWARF_DIE NewDie;
+    INT Status;
+
+    Abbreviations = NULL;
+    NewDie = NULL;
+    Status = DwarfpIndexAbbreviations(Context,
+                                      Unit->AbbreviationOffset,
+                                      &Abbreviations,
+                                      &AbbreviationsCount,
+                                      &MaxAttributes);
+
+    if (Status != 0) {
+        goto LoadCompilationUnitDieEnd;
+    }
+
+    DieBytes = Unit->Dies;
+    if (DieBytes >= Unit->DiesEnd) {
+        Status = ENOENT;
+        goto LoadCompilationUnitDieEnd;
+    }
+
+    AllocationSize = sizeof(DWARF_DIE) +
+                     (MaxAttributes * sizeof(DWARF_ATTRIBUTE_VALUE));
+
+    NewDie = malloc(AllocationSize);
+    if (NewDie == NULL) {
+        Status = errno;
+        goto LoadCompilationUnitDieEnd;
+    }
+
+    memset(NewDie, 0, AllocationSize);
+    INITIALIZE_LIST_HEAD(&(NewDie->ChildList));
+    NewDie->Capacity = MaxAttributes;
+    NewDie->Attributes = (PDWARF_ATTRIBUTE_VALUE)(NewDie + 1);
+    NewDie->Start = DieBytes;
+    AbbreviationNumber = DwarfpReadLeb128(&DieBytes);
+    NewDie->AbbreviationNumber = AbbreviationNumber;
+    if ((AbbreviationNumber == 0) ||
+        (AbbreviationNumber >= AbbreviationsCount) ||
+        (Abbreviations[AbbreviationNumber] == NULL)) {
+
+        DWARF_ERROR("DWARF: Bad abbreviation number %I64d\n",
+                    AbbreviationNumber);
+
+        Status = EINVAL;
+        goto LoadCompilationUnitDieEnd;
+    }
+
+    Status = DwarfpReadDie(Context,
+                           Unit,
+                           &DieBytes,
+                           Abbreviations[AbbreviationNumber],
+                           NewDie);
+
+    if (Status != 0) {
+        DWARF_ERROR("DWARF: Invalid DIE.\n");
+        goto LoadCompilationUnitDieEnd;
+    }
+
+LoadCompilationUnitDieEnd:
+    if (Abbreviations != NULL) {
+        free(Abbreviations);
+    }
+
+    if ((Status != 0) && (NewDie != NULL)) {
+        DwarfpDestroyDie(Context, NewDie);
+        NewDie = NULL;
+    }
+
+    *Die = NewDie;
+    return Status;
+}
+
 VOID
 DwarfpDestroyCompilationUnit (
     PDWARF_CONTEXT Context,
@@ -41,6 +41,7 @@ Module Name:
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -52,6 +53,154 @@ Module Name:
 
 #define MAX_RELATION_TYPE_DEPTH 50
 
+//
+// Define the minimum number of buckets in a symbol name hash table, and the
+// value that terminates a hash chain.
+//
+
+#define SYMBOL_NAME_TABLE_MIN_BUCKETS 64
+#define SYMBOL_NAME_TABLE_END MAX_ULONG
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores a single entry in an address-sorted symbol table.
+
+Members:
+
+    Start - Stores the starting address of the symbol, inclusive.
+
+    End - Stores the ending address of the symbol, exclusive.
+
+    MaxEnd - Stores the largest ending address of this entry and all entries
+        before it in the table. This bounds how far back a search has to look
+        for symbols whose ranges overlap a given address.
+
+    Ordinal - Stores the position of the symbol in the module's symbol lists.
+        When several symbols contain an address, the one with the lowest
+        ordinal is the one a linear walk of the lists would have found.
+
+    Symbol - Stores a pointer to the function, source line, or data symbol.
+
+--*/
+
+typedef struct _SYMBOL_ADDRESS_ENTRY {
+    ULONGLONG Start;
+    ULONGLONG End;
+    ULONGLONG MaxEnd;
+    ULONG Ordinal;
+    PVOID Symbol;
+} SYMBOL_ADDRESS_ENTRY, *PSYMBOL_ADDRESS_ENTRY;
+
+/*++
+
+Structure Description:
+
+    This structure stores an array of symbols sorted by starting address.
+
+Members:
+
+    Entries - Stores a pointer to the array of entries.
+
+    Count - Stores the number of valid entries in the array.
+
+--*/
+
+typedef struct _SYMBOL_ADDRESS_TABLE {
+    PSYMBOL_ADDRESS_ENTRY Entries;
+    ULONG Count;
+} SYMBOL_ADDRESS_TABLE, *PSYMBOL_ADDRESS_TABLE;
+
+/*++
+
+Structure Description:
+
+    This structure stores a single entry in a symbol name hash table.
+
+Members:
+
+    Hash - Stores the case-insensitive hash of the symbol name.
+
+    Next - Stores the index of the next entry in the same hash chain, or
+        SYMBOL_NAME_TABLE_END.
+
+    Name - Stores a pointer to the symbol name.
+
+    Symbol - Stores a pointer to the function, data, or type symbol.
+
+--*/
+
+typedef struct _SYMBOL_NAME_ENTRY {
+    ULONG Hash;
+    ULONG Next;
+    PSTR Name;
+    PVOID Symbol;
+} SYMBOL_NAME_ENTRY, *PSYMBOL_NAME_ENTRY;
+
+/*++
+
+Structure Description:
+
+    This structure stores a chained hash table of symbol names. Entries are
+    kept in symbol list order, and each chain is linked in ascending order, so
+    the first match in a chain is the one a linear walk would have found.
+
+Members:
+
+    Buckets - Stores a pointer to the array of chain heads, each of which is
+        an index into the entries array.
+
+    BucketCount - Stores the number of buckets. This is always a power of two.
+
+    Entries - Stores a pointer to the array of entries.
+
+    Count - Stores the number of valid entries in the array.
+
+--*/
+
+typedef struct _SYMBOL_NAME_TABLE {
+    PULONG Buckets;
+    ULONG BucketCount;
+    PSYMBOL_NAME_ENTRY Entries;
+    ULONG Count;
+} SYMBOL_NAME_TABLE, *PSYMBOL_NAME_TABLE;
+
+/*++
+
+Structure Description:
+
+    This structure stores the lookup indexes for a loaded module.
+
+Members:
+
+    Functions - Stores the top level functions sorted by start address.
+
+    Lines - Stores the source lines sorted by start address.
+
+    Data - Stores the data symbols with absolute addresses sorted by address.
+
+    FunctionNames - Stores the hash table of top level function names.
+
+    DataNames - Stores the hash table of data symbol names.
+
+    TypeNames - Stores the hash table of type names.
+
+--*/
+
+struct _DEBUG_SYMBOL_INDEX {
+    SYMBOL_ADDRESS_TABLE Functions;
+    SYMBOL_ADDRESS_TABLE Lines;
+    SYMBOL_ADDRESS_TABLE Data;
+    SYMBOL_NAME_TABLE FunctionNames;
+    SYMBOL_NAME_TABLE DataNames;
+    SYMBOL_NAME_TABLE TypeNames;
+};
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -69,9 +218,82 @@ DbgpStringMatch (
     PSTR PossibleMatch
     );
 
-//
-// ------------------------------------------------------ Data Type Definitions
-//
+VOID
+DbgpDemandLoadSymbols (
+    PDEBUG_SYMBOLS Module,
+    PULONGLONG Address
+    );
+
+PDEBUG_SYMBOL_INDEX
+DbgpGetSymbolIndex (
+    PDEBUG_SYMBOLS Module
+    );
+
+PDEBUG_SYMBOL_INDEX
+DbgpBuildSymbolIndex (
+    PDEBUG_SYMBOLS Module
+    );
+
+VOID
+DbgpDestroySymbolIndex (
+    PDEBUG_SYMBOL_INDEX Index
+    );
+
+BOOL
+DbgpAllocateSymbolTables (
+    PSYMBOL_ADDRESS_TABLE AddressTable,
+    PSYMBOL_NAME_TABLE NameTable,
+    ULONG Count
+    );
+
+VOID
+DbgpAddAddressEntry (
+    PSYMBOL_ADDRESS_TABLE Table,
+    ULONGLONG Start,
+    ULONGLONG End,
+    PVOID Symbol
+    );
+
+VOID
+DbgpAddNameEntry (
+    PSYMBOL_NAME_TABLE Table,
+    PSTR Name,
+    PVOID Symbol
+    );
+
+VOID
+DbgpSortAddressTable (
+    PSYMBOL_ADDRESS_TABLE Table
+    );
+
+BOOL
+DbgpHashNameTable (
+    PSYMBOL_NAME_TABLE Table
+    );
+
+int
+DbgpCompareAddressEntries (
+    const void *LeftPointer,
+    const void *RightPointer
+    );
+
+PSYMBOL_ADDRESS_ENTRY
+DbgpSearchAddressTable (
+    PSYMBOL_ADDRESS_TABLE Table,
+    ULONGLONG Address,
+    PSYMBOL_ADDRESS_ENTRY Previous
+    );
+
+PVOID
+DbgpSearchNameTable (
+    PSYMBOL_NAME_TABLE Table,
+    PSTR Query
+    );
+
+ULONG
+DbgpHashSymbolName (
+    PSTR Name
+    );
 
 //
 // -------------------------------------------------------------------- Globals
@@ -369,6 +591,15 @@ Return Value:
         LoadFunction += 1;
     }
 
+    //
+    // The symbol libraries are done adding symbols now, so lookups are free
+    // to build their indexes over them.
+    //
+
+    if ((Status == 0) && (Symbols != NULL) && (*Symbols != NULL)) {
+        (*Symbols)->Flags |= DEBUG_SYMBOLS_INDEXABLE;
+    }
+
     return Status;
 }
 
@@ -397,6 +628,11 @@ Return Value:
 
 {
 
+    if (Symbols->Index != NULL) {
+        DbgpDestroySymbolIndex(Symbols->Index);
+        Symbols->Index = NULL;
+    }
+
     Symbols->Interface->Unload(Symbols);
     return;
 }
@@ -1207,6 +1443,9 @@ Return Value:
     PSOURCE_LINE_SYMBOL CurrentLine;
     PSOURCE_FILE_SYMBOL CurrentSource;
     PLIST_ENTRY CurrentSourceEntry;
+    PSYMBOL_ADDRESS_ENTRY Entry;
+    PSYMBOL_ADDRESS_ENTRY Found;
+    PDEBUG_SYMBOL_INDEX Index;
 
     //
     // Parameter checking.
@@ -1216,6 +1455,32 @@ Return Value:
         return NULL;
     }
 
+    DbgpDemandLoadSymbols(Module, &Address);
+
+    //
+    // Use the address index if it's available. Of all the lines containing
+    // the address, return the one earliest in the lists.
+    //
+
+    Index = DbgpGetSymbolIndex(Module);
+    if (Index != NULL) {
+        Found = NULL;
+        Entry = DbgpSearchAddressTable(&(Index->Lines), Address, NULL);
+        while (Entry != NULL) {
+            if ((Found == NULL) || (Entry->Ordinal < Found->Ordinal)) {
+                Found = Entry;
+            }
+
+            Entry = DbgpSearchAddressTable(&(Index->Lines), Address, Entry);
+        }
+
+        if (Found == NULL) {
+            return NULL;
+        }
+
+        return Found->Symbol;
+    }
+
     //
     // Begin searching. Loop over all source files in the module.
     //
@@ -1441,6 +1706,7 @@ Return Value:
     PSOURCE_FILE_SYMBOL CurrentSource;
     PLIST_ENTRY CurrentSourceEntry;
     PTYPE_SYMBOL CurrentType;
+    PDEBUG_SYMBOL_INDEX Index;
 
     //
     // Parameter checking.
@@ -1450,6 +1716,30 @@ Return Value:
         return NULL;
     }
 
+    DbgpDemandLoadSymbols(Module, NULL);
+
+    //
+    // New searches for names without wildcards can go straight to the hash
+    // table.
+    //
+
+    if (((Input->Variety != SymbolResultType) ||
+         (Input->U.TypeResult == NULL)) &&
+        (strchr(Query, '*') == NULL)) {
+
+        Index = DbgpGetSymbolIndex(Module);
+        if (Index != NULL) {
+            CurrentType = DbgpSearchNameTable(&(Index->TypeNames), Query);
+            if (CurrentType == NULL) {
+                return NULL;
+            }
+
+            Input->Variety = SymbolResultType;
+            Input->U.TypeResult = CurrentType;
+            return Input;
+        }
+    }
+
     //
     // Initialize the search variables based on the input parameter.
     //
@@ -1557,6 +1847,9 @@ Return Value:
     PLIST_ENTRY CurrentEntry;
     PSOURCE_FILE_SYMBOL CurrentSource;
     PLIST_ENTRY CurrentSourceEntry;
+    PSYMBOL_ADDRESS_ENTRY Entry;
+    PSYMBOL_ADDRESS_ENTRY Found;
+    PDEBUG_SYMBOL_INDEX Index;
 
     //
     // Parameter checking.
@@ -1570,6 +1863,57 @@ Return Value:
         return NULL;
     }
 
+    if (Address != (INTN)NULL) {
+        DbgpDemandLoadSymbols(Module, &Address);
+
+    } else {
+        DbgpDemandLoadSymbols(Module, NULL);
+    }
+
+    //
+    // New searches by address or by a name without wildcards can use the
+    // indexes.
+    //
+
+    Index = NULL;
+    if ((Input->Variety != SymbolResultData) ||
+        (Input->U.DataResult == NULL)) {
+
+        if ((Address != (INTN)NULL) || (strchr(Query, '*') == NULL)) {
+            Index = DbgpGetSymbolIndex(Module);
+        }
+    }
+
+    if (Index != NULL) {
+        if (Address != (INTN)NULL) {
+            Found = NULL;
+            Entry = DbgpSearchAddressTable(&(Index->Data), Address, NULL);
+            while (Entry != NULL) {
+                if ((Found == NULL) || (Entry->Ordinal < Found->Ordinal)) {
+                    Found = Entry;
+                }
+
+                Entry = DbgpSearchAddressTable(&(Index->Data), Address, Entry);
+            }
+
+            CurrentData = NULL;
+            if (Found != NULL) {
+                CurrentData = Found->Symbol;
+            }
+
+        } else {
+            CurrentData = DbgpSearchNameTable(&(Index->DataNames), Query);
+        }
+
+        if (CurrentData == NULL) {
+            return NULL;
+        }
+
+        Input->Variety = SymbolResultData;
+        Input->U.DataResult = CurrentData;
+        return Input;
+    }
+
     //
     // Initialize the search variables based on the input parameter.
     //
@@ -1700,6 +2044,10 @@ Return Value:
     PFUNCTION_SYMBOL CurrentFunction;
     PSOURCE_FILE_SYMBOL CurrentSource;
     PLIST_ENTRY CurrentSourceEntry;
+    PSYMBOL_ADDRESS_ENTRY Entry;
+    PSYMBOL_ADDRESS_ENTRY Found;
+    PDEBUG_SYMBOL_INDEX Index;
+    PFUNCTION_SYMBOL Match;
 
     //
     // Parameter checking.
@@ -1713,6 +2061,71 @@ Return Value:
         return NULL;
     }
 
+    if (Address != (INTN)NULL) {
+        DbgpDemandLoadSymbols(Module, &Address);
+
+    } else {
+        DbgpDemandLoadSymbols(Module, NULL);
+    }
+
+    //
+    // New searches by address or by a name without wildcards can use the
+    // indexes.
+    //
+
+    Index = NULL;
+    if ((Input->Variety != SymbolResultFunction) ||
+        (Input->U.FunctionResult == NULL)) {
+
+        if ((Address != (INTN)NULL) || (strchr(Query, '*') == NULL)) {
+            Index = DbgpGetSymbolIndex(Module);
+        }
+    }
+
+    if (Index != NULL) {
+        CurrentFunction = NULL;
+        if (Address != (INTN)NULL) {
+
+            //
+            // Several functions may span the address, and some of those may
+            // have discontiguous ranges that don't actually cover it. Find
+            // the earliest one in the lists that really contains the address,
+            // and dig out its deepest inline function.
+            //
+
+            Found = NULL;
+            Entry = DbgpSearchAddressTable(&(Index->Functions), Address, NULL);
+            while (Entry != NULL) {
+                if ((Found == NULL) || (Entry->Ordinal < Found->Ordinal)) {
+                    Match = DbgpMatchFunctionAddress(Module,
+                                                     Address,
+                                                     Entry->Symbol);
+
+                    if (Match != NULL) {
+                        Found = Entry;
+                        CurrentFunction = Match;
+                    }
+                }
+
+                Entry = DbgpSearchAddressTable(&(Index->Functions),
+                                               Address,
+                                               Entry);
+            }
+
+        } else {
+            CurrentFunction = DbgpSearchNameTable(&(Index->FunctionNames),
+                                                  Query);
+        }
+
+        if (CurrentFunction == NULL) {
+            return NULL;
+        }
+
+        Input->Variety = SymbolResultFunction;
+        Input->U.FunctionResult = CurrentFunction;
+        return Input;
+    }
+
     //
     // Initialize the search variables based on the input parameter.
     //
@@ -2112,3 +2525,829 @@ Return Value:
     return FALSE;
 }
 
+
+VOID
+DbgpDemandLoadSymbols (
+    PDEBUG_SYMBOLS Module,
+    PULONGLONG Address
+    )
+
+/*++
+
+Routine Description:
+
+    This routine asks the symbol library to load any symbols it has deferred
+    that a search is about to need. If new symbols show up, the module's
+    lookup indexes are thrown away so they get rebuilt to include them.
+
+Arguments:
+
+    Module - Supplies a pointer to the module.
+
+    Address - Supplies an optional pointer to the address being searched for.
+        Supply NULL if the search needs all symbols, such as a search by name.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PSYMBOLS_DEMAND_LOAD DemandLoad;
+
+    DemandLoad = Module->Interface->DemandLoad;
+    if (DemandLoad == NULL) {
+        return;
+    }
+
+    if ((DemandLoad(Module, Address) != FALSE) && (Module->Index != NULL)) {
+        DbgpDestroySymbolIndex(Module->Index);
+        Module->Index = NULL;
+    }
+
+    return;
+}
+
+PDEBUG_SYMBOL_INDEX
+DbgpGetSymbolIndex (
+    PDEBUG_SYMBOLS Module
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the lookup indexes for a module, building them if
+    this is the first search that needs them.
+
+Arguments:
+
+    Module - Supplies a pointer to the module.
+
+Return Value:
+
+    Returns a pointer to the module's indexes on success.
+
+    NULL if the module is still being loaded, or the indexes could not be
+    built. The caller should walk the symbol lists instead.
+
+--*/
+
+{
+
+    if (Module->Index != NULL) {
+        return Module->Index;
+    }
+
+    if (((Module->Flags & DEBUG_SYMBOLS_INDEXABLE) == 0) ||
+        ((Module->Flags & DEBUG_SYMBOLS_INDEX_FAILED) != 0)) {
+
+        return NULL;
+    }
+
+    Module->Index = DbgpBuildSymbolIndex(Module);
+    if (Module->Index == NULL) {
+        Module->Flags |= DEBUG_SYMBOLS_INDEX_FAILED;
+    }
+
+    return Module->Index;
+}
+
+PDEBUG_SYMBOL_INDEX
+DbgpBuildSymbolIndex (
+    PDEBUG_SYMBOLS Module
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds the address-sorted and name-hashed lookup indexes over
+    the symbols in a module.
+
+Arguments:
+
+    Module - Supplies a pointer to the module.
+
+Return Value:
+
+    Returns a pointer to the new indexes on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PDATA_SYMBOL CurrentData;
+    PLIST_ENTRY CurrentEntry;
+    PFUNCTION_SYMBOL CurrentFunction;
+    PSOURCE_LINE_SYMBOL CurrentLine;
+    PSOURCE_FILE_SYMBOL CurrentSource;
+    PLIST_ENTRY CurrentSourceEntry;
+    PTYPE_SYMBOL CurrentType;
+    ULONG DataCount;
+    ULONG FunctionCount;
+    PDEBUG_SYMBOL_INDEX Index;
+    ULONG LineCount;
+    BOOL Result;
+    ULONG TypeCount;
+
+    Index = malloc(sizeof(DEBUG_SYMBOL_INDEX));
+    if (Index == NULL) {
+        return NULL;
+    }
+
+    memset(Index, 0, sizeof(DEBUG_SYMBOL_INDEX));
+
+    //
+    // Count up the symbols so the tables can be allocated in one go.
+    //
+
+    DataCount = 0;
+    FunctionCount = 0;
+    LineCount = 0;
+    TypeCount = 0;
+    CurrentSourceEntry = Module->SourcesHead.Next;
+    while (CurrentSourceEntry != &(Module->SourcesHead)) {
+        CurrentSource = LIST_VALUE(CurrentSourceEntry,
+                                   SOURCE_FILE_SYMBOL,
+                                   ListEntry);
+
+        CurrentEntry = CurrentSource->TypesHead.Next;
+        while (CurrentEntry != &(CurrentSource->TypesHead)) {
+            TypeCount += 1;
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentEntry = CurrentSource->DataSymbolsHead.Next;
+        while (CurrentEntry != &(CurrentSource->DataSymbolsHead)) {
+            DataCount += 1;
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentEntry = CurrentSource->FunctionsHead.Next;
+        while (CurrentEntry != &(CurrentSource->FunctionsHead)) {
+            FunctionCount += 1;
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentEntry = CurrentSource->SourceLinesHead.Next;
+        while (CurrentEntry != &(CurrentSource->SourceLinesHead)) {
+            LineCount += 1;
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentSourceEntry = CurrentSourceEntry->Next;
+    }
+
+    Result = DbgpAllocateSymbolTables(&(Index->Functions),
+                                      &(Index->FunctionNames),
+                                      FunctionCount);
+
+    if (Result == FALSE) {
+        goto BuildSymbolIndexEnd;
+    }
+
+    Result = DbgpAllocateSymbolTables(&(Index->Lines), NULL, LineCount);
+    if (Result == FALSE) {
+        goto BuildSymbolIndexEnd;
+    }
+
+    Result = DbgpAllocateSymbolTables(&(Index->Data),
+                                      &(Index->DataNames),
+                                      DataCount);
+
+    if (Result == FALSE) {
+        goto BuildSymbolIndexEnd;
+    }
+
+    Result = DbgpAllocateSymbolTables(NULL, &(Index->TypeNames), TypeCount);
+    if (Result == FALSE) {
+        goto BuildSymbolIndexEnd;
+    }
+
+    //
+    // Fill in the tables in list order, which is the order a linear search
+    // would have visited the symbols in.
+    //
+
+    CurrentSourceEntry = Module->SourcesHead.Next;
+    while (CurrentSourceEntry != &(Module->SourcesHead)) {
+        CurrentSource = LIST_VALUE(CurrentSourceEntry,
+                                   SOURCE_FILE_SYMBOL,
+                                   ListEntry);
+
+        CurrentEntry = CurrentSource->TypesHead.Next;
+        while (CurrentEntry != &(CurrentSource->TypesHead)) {
+            CurrentType = LIST_VALUE(CurrentEntry, TYPE_SYMBOL, ListEntry);
+            DbgpAddNameEntry(&(Index->TypeNames),
+                             CurrentType->Name,
+                             CurrentType);
+
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentEntry = CurrentSource->DataSymbolsHead.Next;
+        while (CurrentEntry != &(CurrentSource->DataSymbolsHead)) {
+            CurrentData = LIST_VALUE(CurrentEntry, DATA_SYMBOL, ListEntry);
+            DbgpAddNameEntry(&(Index->DataNames),
+                             CurrentData->Name,
+                             CurrentData);
+
+            if (CurrentData->LocationType == DataLocationAbsoluteAddress) {
+                DbgpAddAddressEntry(&(Index->Data),
+                                    CurrentData->Location.Address,
+                                    CurrentData->Location.Address + 1,
+                                    CurrentData);
+            }
+
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentEntry = CurrentSource->FunctionsHead.Next;
+        while (CurrentEntry != &(CurrentSource->FunctionsHead)) {
+            CurrentFunction = LIST_VALUE(CurrentEntry,
+                                         FUNCTION_SYMBOL,
+                                         ListEntry);
+
+            DbgpAddNameEntry(&(Index->FunctionNames),
+                             CurrentFunction->Name,
+                             CurrentFunction);
+
+            DbgpAddAddressEntry(&(Index->Functions),
+                                CurrentFunction->StartAddress,
+                                CurrentFunction->EndAddress,
+                                CurrentFunction);
+
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentEntry = CurrentSource->SourceLinesHead.Next;
+        while (CurrentEntry != &(CurrentSource->SourceLinesHead)) {
+            CurrentLine = LIST_VALUE(CurrentEntry,
+                                     SOURCE_LINE_SYMBOL,
+                                     ListEntry);
+
+            DbgpAddAddressEntry(&(Index->Lines),
+                                CurrentLine->Start,
+                                CurrentLine->End,
+                                CurrentLine);
+
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        CurrentSourceEntry = CurrentSourceEntry->Next;
+    }
+
+    DbgpSortAddressTable(&(Index->Functions));
+    DbgpSortAddressTable(&(Index->Lines));
+    DbgpSortAddressTable(&(Index->Data));
+    Result = DbgpHashNameTable(&(Index->FunctionNames));
+    if (Result == FALSE) {
+        goto BuildSymbolIndexEnd;
+    }
+
+    Result = DbgpHashNameTable(&(Index->DataNames));
+    if (Result == FALSE) {
+        goto BuildSymbolIndexEnd;
+    }
+
+    Result = DbgpHashNameTable(&(Index->TypeNames));
+
+BuildSymbolIndexEnd:
+    if (Result == FALSE) {
+        DbgpDestroySymbolIndex(Index);
+        Index = NULL;
+    }
+
+    return Index;
+}
+
+VOID
+DbgpDestroySymbolIndex (
+    PDEBUG_SYMBOL_INDEX Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees a module's lookup indexes.
+
+Arguments:
+
+    Index - Supplies a pointer to the indexes to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    free(Index->Functions.Entries);
+    free(Index->Lines.Entries);
+    free(Index->Data.Entries);
+    free(Index->FunctionNames.Buckets);
+    free(Index->FunctionNames.Entries);
+    free(Index->DataNames.Buckets);
+    free(Index->DataNames.Entries);
+    free(Index->TypeNames.Buckets);
+    free(Index->TypeNames.Entries);
+    free(Index);
+    return;
+}
+
+BOOL
+DbgpAllocateSymbolTables (
+    PSYMBOL_ADDRESS_TABLE AddressTable,
+    PSYMBOL_NAME_TABLE NameTable,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates the entry arrays for an address table and a name
+    table.
+
+Arguments:
+
+    AddressTable - Supplies an optional pointer to the address table to
+        allocate entries for.
+
+    NameTable - Supplies an optional pointer to the name table to allocate
+        entries for.
+
+    Count - Supplies the maximum number of entries that will be added to each
+        table.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on allocation failure.
+
+--*/
+
+{
+
+    if (Count == 0) {
+        return TRUE;
+    }
+
+    if (AddressTable != NULL) {
+        AddressTable->Entries = malloc(sizeof(SYMBOL_ADDRESS_ENTRY) * Count);
+        if (AddressTable->Entries == NULL) {
+            return FALSE;
+        }
+    }
+
+    if (NameTable != NULL) {
+        NameTable->Entries = malloc(sizeof(SYMBOL_NAME_ENTRY) * Count);
+        if (NameTable->Entries == NULL) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+VOID
+DbgpAddAddressEntry (
+    PSYMBOL_ADDRESS_TABLE Table,
+    ULONGLONG Start,
+    ULONGLONG End,
+    PVOID Symbol
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a symbol to the end of an unsorted address table.
+    Symbols with empty ranges can never be found, and are skipped.
+
+Arguments:
+
+    Table - Supplies a pointer to the address table.
+
+    Start - Supplies the starting address of the symbol, inclusive.
+
+    End - Supplies the ending address of the symbol, exclusive.
+
+    Symbol - Supplies a pointer to the symbol.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PSYMBOL_ADDRESS_ENTRY Entry;
+
+    if (Start >= End) {
+        return;
+    }
+
+    Entry = &(Table->Entries[Table->Count]);
+    Entry->Start = Start;
+    Entry->End = End;
+    Entry->MaxEnd = End;
+    Entry->Ordinal = Table->Count;
+    Entry->Symbol = Symbol;
+    Table->Count += 1;
+    return;
+}
+
+VOID
+DbgpAddNameEntry (
+    PSYMBOL_NAME_TABLE Table,
+    PSTR Name,
+    PVOID Symbol
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a symbol to the end of a name table. Symbols without
+    names are skipped.
+
+Arguments:
+
+    Table - Supplies a pointer to the name table.
+
+    Name - Supplies a pointer to the symbol name.
+
+    Symbol - Supplies a pointer to the symbol.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PSYMBOL_NAME_ENTRY Entry;
+
+    if (Name == NULL) {
+        return;
+    }
+
+    Entry = &(Table->Entries[Table->Count]);
+    Entry->Hash = DbgpHashSymbolName(Name);
+    Entry->Next = SYMBOL_NAME_TABLE_END;
+    Entry->Name = Name;
+    Entry->Symbol = Symbol;
+    Table->Count += 1;
+    return;
+}
+
+VOID
+DbgpSortAddressTable (
+    PSYMBOL_ADDRESS_TABLE Table
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sorts an address table by starting address and computes the
+    running maximum ending address used to bound searches.
+
+Arguments:
+
+    Table - Supplies a pointer to the address table.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG EntryIndex;
+    ULONGLONG MaxEnd;
+
+    if (Table->Count == 0) {
+        return;
+    }
+
+    qsort(Table->Entries,
+          Table->Count,
+          sizeof(SYMBOL_ADDRESS_ENTRY),
+          DbgpCompareAddressEntries);
+
+    MaxEnd = 0;
+    for (EntryIndex = 0; EntryIndex < Table->Count; EntryIndex += 1) {
+        if (Table->Entries[EntryIndex].End > MaxEnd) {
+            MaxEnd = Table->Entries[EntryIndex].End;
+        }
+
+        Table->Entries[EntryIndex].MaxEnd = MaxEnd;
+    }
+
+    return;
+}
+
+BOOL
+DbgpHashNameTable (
+    PSYMBOL_NAME_TABLE Table
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates the buckets for a name table and links its entries
+    into their hash chains.
+
+Arguments:
+
+    Table - Supplies a pointer to the name table.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on allocation failure.
+
+--*/
+
+{
+
+    ULONG Bucket;
+    ULONG BucketCount;
+    ULONG EntryIndex;
+
+    if (Table->Count == 0) {
+        return TRUE;
+    }
+
+    BucketCount = SYMBOL_NAME_TABLE_MIN_BUCKETS;
+    while (BucketCount < Table->Count) {
+        BucketCount <<= 1;
+    }
+
+    Table->Buckets = malloc(sizeof(ULONG) * BucketCount);
+    if (Table->Buckets == NULL) {
+        return FALSE;
+    }
+
+    memset(Table->Buckets, 0xFF, sizeof(ULONG) * BucketCount);
+    Table->BucketCount = BucketCount;
+
+    //
+    // Push the entries on backwards so that each chain ends up in list order.
+    //
+
+    EntryIndex = Table->Count;
+    while (EntryIndex != 0) {
+        EntryIndex -= 1;
+        Bucket = Table->Entries[EntryIndex].Hash & (BucketCount - 1);
+        Table->Entries[EntryIndex].Next = Table->Buckets[Bucket];
+        Table->Buckets[Bucket] = EntryIndex;
+    }
+
+    return TRUE;
+}
+
+int
+DbgpCompareAddressEntries (
+    const void *LeftPointer,
+    const void *RightPointer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares two address table entries by starting address, and
+    then by ordinal.
+
+Arguments:
+
+    LeftPointer - Supplies a pointer to the left entry.
+
+    RightPointer - Supplies a pointer to the right entry.
+
+Return Value:
+
+    -1 if the left entry sorts before the right.
+
+    0 if the entries are equal.
+
+    1 if the left entry sorts after the right.
+
+--*/
+
+{
+
+    PSYMBOL_ADDRESS_ENTRY Left;
+    PSYMBOL_ADDRESS_ENTRY Right;
+
+    Left = (PSYMBOL_ADDRESS_ENTRY)LeftPointer;
+    Right = (PSYMBOL_ADDRESS_ENTRY)RightPointer;
+    if (Left->Start < Right->Start) {
+        return -1;
+    }
+
+    if (Left->Start > Right->Start) {
+        return 1;
+    }
+
+    if (Left->Ordinal < Right->Ordinal) {
+        return -1;
+    }
+
+    if (Left->Ordinal > Right->Ordinal) {
+        return 1;
+    }
+
+    return 0;
+}
+
+PSYMBOL_ADDRESS_ENTRY
+DbgpSearchAddressTable (
+    PSYMBOL_ADDRESS_TABLE Table,
+    ULONGLONG Address,
+    PSYMBOL_ADDRESS_ENTRY Previous
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds entries in an address table whose ranges contain the
+    given address. Entries are returned in descending order of start address.
+
+Arguments:
+
+    Table - Supplies a pointer to the sorted address table.
+
+    Address - Supplies the address to search for.
+
+    Previous - Supplies an optional pointer to the entry returned by the
+        previous call, to continue the search. Supply NULL to start a new
+        search.
+
+Return Value:
+
+    Returns a pointer to the next entry containing the address.
+
+    NULL if there are no more entries containing the address.
+
+--*/
+
+{
+
+    PSYMBOL_ADDRESS_ENTRY Entry;
+    ULONG High;
+    ULONG Low;
+    ULONG Middle;
+
+    //
+    // Binary search for the first entry starting beyond the address.
+    //
+
+    if (Previous == NULL) {
+        Low = 0;
+        High = Table->Count;
+        while (Low < High) {
+            Middle = Low + ((High - Low) / 2);
+            if (Table->Entries[Middle].Start <= Address) {
+                Low = Middle + 1;
+
+            } else {
+                High = Middle;
+            }
+        }
+
+    } else {
+        Low = Previous - Table->Entries;
+    }
+
+    //
+    // Walk backwards over entries that start at or before the address. Once
+    // every earlier entry ends at or before the address, there's nothing
+    // left to find.
+    //
+
+    while (Low != 0) {
+        Low -= 1;
+        Entry = &(Table->Entries[Low]);
+        if (Entry->MaxEnd <= Address) {
+            break;
+        }
+
+        if (Entry->End > Address) {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+PVOID
+DbgpSearchNameTable (
+    PSYMBOL_NAME_TABLE Table,
+    PSTR Query
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up a symbol by name in a name table. The comparison is
+    case insensitive, and the query must not contain wildcards.
+
+Arguments:
+
+    Table - Supplies a pointer to the name table.
+
+    Query - Supplies the name to search for.
+
+Return Value:
+
+    Returns a pointer to the first symbol in list order with the given name.
+
+    NULL if no symbol has the given name.
+
+--*/
+
+{
+
+    PSYMBOL_NAME_ENTRY Entry;
+    ULONG EntryIndex;
+    ULONG Hash;
+
+    if (Table->BucketCount == 0) {
+        return NULL;
+    }
+
+    Hash = DbgpHashSymbolName(Query);
+    EntryIndex = Table->Buckets[Hash & (Table->BucketCount - 1)];
+    while (EntryIndex != SYMBOL_NAME_TABLE_END) {
+        Entry = &(Table->Entries[EntryIndex]);
+        if ((Entry->Hash == Hash) &&
+            (DbgpStringMatch(Query, Entry->Name) != FALSE)) {
+
+            return Entry->Symbol;
+        }
+
+        EntryIndex = Entry->Next;
+    }
+
+    return NULL;
+}
+
+ULONG
+DbgpHashSymbolName (
+    PSTR Name
+    )
+
+/*++
+
+Routine Description:
+
+    This routine computes a case-insensitive hash of a symbol name, to match
+    the case-insensitive comparison done by the string matching routine.
+
+Arguments:
+
+    Name - Supplies a pointer to the name to hash.
+
+Return Value:
+
+    Returns the hash of the name.
+
+--*/
+
+{
+
+    UCHAR Character;
+    ULONG Hash;
+
+    Hash = 2166136261UL;
+    while (*Name != '\0') {
+        Character = *Name;
+        if ((Character >= 'A') && (Character <= 'Z')) {
+            Character = Character - 'A' + 'a';
+        }
+
+        Hash = (Hash ^ Character) * 16777619UL;
+        Name += 1;
+    }
+
+    return Hash;
+}
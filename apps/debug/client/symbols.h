@@ -28,6 +28,20 @@ Module Name:
 
 #define MAX_RANGE_STRING 32
 
+//
+// This flag is set once a symbol library has finished loading the symbols for
+// a module, at which point its lookup indexes may be built on demand.
+//
+
+#define DEBUG_SYMBOLS_INDEXABLE 0x00000001
+
+//
+// This flag is set if building the lookup indexes failed, in which case
+// searches fall back to walking the symbol lists.
+//
+
+#define DEBUG_SYMBOLS_INDEX_FAILED 0x00000002
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -38,6 +52,7 @@ typedef struct _DEBUG_SYMBOLS DEBUG_SYMBOLS, *PDEBUG_SYMBOLS;
 typedef struct _DATA_SYMBOL DATA_SYMBOL, *PDATA_SYMBOL;
 typedef struct _SOURCE_FILE_SYMBOL SOURCE_FILE_SYMBOL, *PSOURCE_FILE_SYMBOL;
 typedef struct _FUNCTION_SYMBOL FUNCTION_SYMBOL, *PFUNCTION_SYMBOL;
+typedef struct _DEBUG_SYMBOL_INDEX DEBUG_SYMBOL_INDEX, *PDEBUG_SYMBOL_INDEX;
 
 typedef enum _DATA_TYPE_TYPE {
     DataTypeInvalid,
@@ -515,6 +530,35 @@ Return Value:
 
 --*/
 
+typedef
+BOOL
+(*PSYMBOLS_DEMAND_LOAD) (
+    PDEBUG_SYMBOLS Symbols,
+    PULONGLONG Address
+    );
+
+/*++
+
+Routine Description:
+
+    This routine loads any symbols covering the given address that the symbol
+    library deferred loading.
+
+Arguments:
+
+    Symbols - Supplies a pointer to the debug symbols.
+
+    Address - Supplies an optional pointer to the debased address being
+        looked up. Supply NULL to load all remaining symbols.
+
+Return Value:
+
+    TRUE if new symbols were added to the module.
+
+    FALSE if nothing new was loaded.
+
+--*/
+
 /*++
 
 Structure Description:
@@ -541,6 +585,9 @@ Structure Description:
         an address is within a given discontiguous range for a function or
         module.
 
+    DemandLoad - Stores an optional pointer to a function used to load
+        symbols the library put off loading until they were needed.
+
 --*/
 
 typedef struct _DEBUG_SYMBOL_INTERFACE {
@@ -550,6 +597,7 @@ typedef struct _DEBUG_SYMBOL_INTERFACE {
     PSYMBOLS_READ_DATA_SYMBOL ReadDataSymbol;
     PSYMBOLS_GET_ADDRESS_OF_DATA_SYMBOL GetAddressOfDataSymbol;
     PSYMBOLS_CHECK_RANGE CheckRange;
+    PSYMBOLS_DEMAND_LOAD DemandLoad;
 } DEBUG_SYMBOL_INTERFACE, *PDEBUG_SYMBOL_INTERFACE;
 
 /*++
@@ -600,6 +648,12 @@ Structure Description:
         which set of registers to access when the symbol library needs to do
         accesses.
 
+    Flags - Stores a bitfield of flags. See DEBUG_SYMBOLS_* definitions.
+
+    Index - Stores an optional pointer to the address-sorted and name-hashed
+        lookup indexes for this module. These are built the first time a
+        search needs them, and freed when the symbols are unloaded.
+
 --*/
 
 struct _DEBUG_SYMBOLS {
@@ -612,6 +666,8 @@ struct _DEBUG_SYMBOLS {
     PDEBUG_SYMBOL_INTERFACE Interface;
     PVOID HostContext;
     PVOID RegistersContext;
+    ULONG Flags;
+    PDEBUG_SYMBOL_INDEX Index;
 };
 
 /*++
@@ -1653,6 +1653,22 @@ Return Value:
 
         break;
 
+    //
+    // Pull in the latest stack data and write it out to a file.
+    //
+
+    case ProfilerDisplayExportFolded:
+
+        assert(DataType == ProfilerDataTypeStack);
+
+        AcquireDebuggerLock(StackTreeLock);
+        if (DbgrGetProfilerStackData(&StackTreeRoot) != FALSE) {
+            DbgrExportProfilerStackData(StackTreeRoot);
+        }
+
+        ReleaseDebuggerLock(StackTreeLock);
+        break;
+
     case ProfilerDisplayStartDelta:
 
         //
@@ -4780,7 +4796,10 @@ Return Value:
         FunctionString = CALL_STACK_TREE_ROOT_STRING;
 
     } else {
-        FunctionString = Root->AddressSymbol;
+        FunctionString = DbgrGetProfilerStackEntrySymbol(Root);
+        if (FunctionString == NULL) {
+            return;
+        }
     }
 
     //
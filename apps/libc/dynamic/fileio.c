@@ -127,6 +127,13 @@ ClpAsPrintWriteCharacter (
     PPRINT_FORMAT_CONTEXT Context
     );
 
+BOOL
+ClpAsPrintWriteString (
+    PCSTR String,
+    ULONG Size,
+    PPRINT_FORMAT_CONTEXT Context
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -282,6 +289,7 @@ Return Value:
     ULONG Flags;
     off_t Length;
     FILE_CONTROL_PARAMETERS_UNION Parameters;
+    int PipeSize;
     int ReturnValue;
     int SetFlags;
     struct stat Stat;
@@ -451,6 +459,21 @@ Return Value:
         FileControlCommand = FileControlCommandCloseFrom;
         break;
 
+    case F_GETPIPE_SZ:
+        FileControlCommand = FileControlCommandGetPipeSize;
+        break;
+
+    case F_SETPIPE_SZ:
+        FileControlCommand = FileControlCommandSetPipeSize;
+        PipeSize = va_arg(ArgumentList, int);
+        if (PipeSize < 0) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto fcntlEnd;
+        }
+
+        Parameters.PipeSize = PipeSize;
+        break;
+
     default:
         Status = STATUS_INVALID_PARAMETER;
         goto fcntlEnd;
@@ -618,6 +641,11 @@ Return Value:
         ReturnValue = 0;
         break;
 
+    case F_GETPIPE_SZ:
+    case F_SETPIPE_SZ:
+        ReturnValue = Parameters.PipeSize;
+        break;
+
     default:
 
         assert(FALSE);
@@ -635,6 +663,167 @@ Return Value:
     return ReturnValue;
 }
 
+LIBC_API
+int
+posix_fadvise (
+    int FileDescriptor,
+    off_t Offset,
+    off_t Length,
+    int Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine advises the system about how a region of an open file is
+    going to be accessed.
+
+Arguments:
+
+    FileDescriptor - Supplies the file descriptor to advise about.
+
+    Offset - Supplies the offset of the start of the region.
+
+    Length - Supplies the size of the region in bytes. Supply zero to cover
+        everything through the end of the file.
+
+    Advice - Supplies the expected access pattern. See POSIX_FADV_*
+        definitions.
+
+Return Value:
+
+    Returns 0 on success.
+
+    Returns an error number on failure. The errno variable is not set.
+
+--*/
+
+{
+
+    FILE_ADVICE FileAdvice;
+    ULONGLONG Size;
+    KSTATUS Status;
+
+    if ((Offset < 0) || (Length < 0)) {
+        return EINVAL;
+    }
+
+    switch (Advice) {
+    case POSIX_FADV_NORMAL:
+        FileAdvice = FileAdviceNormal;
+        break;
+
+    case POSIX_FADV_RANDOM:
+        FileAdvice = FileAdviceRandom;
+        break;
+
+    case POSIX_FADV_SEQUENTIAL:
+        FileAdvice = FileAdviceSequential;
+        break;
+
+    case POSIX_FADV_WILLNEED:
+        FileAdvice = FileAdviceWillNeed;
+        break;
+
+    case POSIX_FADV_DONTNEED:
+        FileAdvice = FileAdviceDontNeed;
+        break;
+
+    case POSIX_FADV_NOREUSE:
+        FileAdvice = FileAdviceNoReuse;
+        break;
+
+    default:
+        return EINVAL;
+    }
+
+    Size = Length;
+    if (Length == 0) {
+        Size = -1ULL;
+    }
+
+    Status = OsAdviseFile((HANDLE)(UINTN)FileDescriptor,
+                          Offset,
+                          Size,
+                          FileAdvice);
+
+    if (!KSUCCESS(Status)) {
+        if (Status == STATUS_INVALID_HANDLE) {
+            return EBADF;
+        }
+
+        return ClConvertKstatusToErrorNumber(Status);
+    }
+
+    return 0;
+}
+
+LIBC_API
+ssize_t
+tee (
+    int Source,
+    int Destination,
+    size_t Size,
+    unsigned int Flags
+    )
+
+/*++
+
+Routine Description:
+
+    This routine duplicates up to the given number of bytes from one pipe to
+    another without consuming them from the source.
+
+Arguments:
+
+    Source - Supplies the file descriptor of the read end of the source pipe.
+
+    Destination - Supplies the file descriptor of the write end of the
+        destination pipe.
+
+    Size - Supplies the maximum number of bytes to duplicate.
+
+    Flags - Supplies a bitfield of flags. See SPLICE_F_* definitions.
+
+Return Value:
+
+    Returns the number of bytes duplicated on success. Zero indicates the
+    source pipe is empty and has no writers.
+
+    -1 on error, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    ULONG SpliceFlags;
+    KSTATUS Status;
+
+    SpliceFlags = 0;
+    if ((Flags & SPLICE_F_NONBLOCK) != 0) {
+        SpliceFlags |= SYS_SPLICE_FLAG_NON_BLOCKING;
+    }
+
+    if (Size > SSIZE_MAX) {
+        Size = SSIZE_MAX;
+    }
+
+    Status = OsTeePipe((HANDLE)(UINTN)Source,
+                       (HANDLE)(UINTN)Destination,
+                       Size,
+                       SpliceFlags,
+                       &BytesCompleted);
+
+    if (!KSUCCESS(Status)) {
+        errno = ClConvertKstatusToErrorNumber(Status);
+        return -1;
+    }
+
+    return (ssize_t)BytesCompleted;
+}
+
 LIBC_API
 int
 close (
@@ -2597,6 +2786,7 @@ Return Value:
     memset(&PrintContext, 0, sizeof(PRINT_FORMAT_CONTEXT));
     PrintContext.Context = &AsContext;
     PrintContext.WriteCharacter = ClpAsPrintWriteCharacter;
+    PrintContext.WriteString = ClpAsPrintWriteString;
     RtlInitializeMultibyteState(&(PrintContext.State),
                                 CharacterEncodingDefault);
 
@@ -3590,3 +3780,71 @@ Return Value:
     return TRUE;
 }
 
+BOOL
+ClpAsPrintWriteString (
+    PCSTR String,
+    ULONG Size,
+    PPRINT_FORMAT_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes a run of characters to the output during a
+    printf-style formatting operation.
+
+Arguments:
+
+    String - Supplies a pointer to the characters to be written.
+
+    Size - Supplies the number of characters to write.
+
+    Context - Supplies a pointer to the printf-context.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    PASPRINT_CONTEXT AsContext;
+    PSTR NewBuffer;
+    UINTN NewCapacity;
+
+    AsContext = Context->Context;
+
+    //
+    // Reallocate the buffer if needed, leaving room for the terminator.
+    //
+
+    if (AsContext->Size + Size >= AsContext->Capacity) {
+        NewCapacity = AsContext->Capacity;
+        while ((NewCapacity != 0) && (AsContext->Size + Size >= NewCapacity)) {
+            NewCapacity *= 2;
+        }
+
+        NewBuffer = NULL;
+        if (NewCapacity > AsContext->Capacity) {
+            NewBuffer = realloc(AsContext->Buffer, NewCapacity);
+        }
+
+        if (NewBuffer == NULL) {
+            free(AsContext->Buffer);
+            AsContext->Buffer = NULL;
+            return FALSE;
+        }
+
+        AsContext->Buffer = NewBuffer;
+        AsContext->Capacity = NewCapacity;
+    }
+
+    memcpy(AsContext->Buffer + AsContext->Size, String, Size);
+    AsContext->Size += Size;
+    return TRUE;
+}
+
@@ -359,6 +359,124 @@ Return Value:
     return 0;
 }
 
+LIBC_API
+int
+madvise (
+    void *Address,
+    size_t Length,
+    int Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine advises the system about how a region of the current
+    process' memory is going to be accessed.
+
+Arguments:
+
+    Address - Supplies the page aligned start of the region.
+
+    Length - Supplies the size, in bytes, of the region.
+
+    Advice - Supplies the expected access pattern. See MADV_* definitions.
+
+Return Value:
+
+    Returns 0 on success.
+
+    -1 on failure. The errno variable will be set to indicate the error.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    //
+    // The MADV_* values line up with the kernel's memory advice values.
+    //
+
+    if ((Advice < MADV_NORMAL) || (Advice > MADV_FREE)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    Status = OsAdviseMemory(Address, Length, (MEMORY_ADVICE)Advice);
+    if (!KSUCCESS(Status)) {
+        errno = ClConvertKstatusToErrorNumber(Status);
+        if (Status == STATUS_INVALID_ADDRESS_RANGE) {
+            errno = ENOMEM;
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
+LIBC_API
+int
+posix_madvise (
+    void *Address,
+    size_t Length,
+    int Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine advises the system about how a region of the current
+    process' memory is going to be accessed.
+
+Arguments:
+
+    Address - Supplies the page aligned start of the region.
+
+    Length - Supplies the size, in bytes, of the region.
+
+    Advice - Supplies the expected access pattern. See POSIX_MADV_*
+        definitions.
+
+Return Value:
+
+    Returns 0 on success.
+
+    Returns an error number on failure. The errno variable is not set.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    if ((Advice < POSIX_MADV_NORMAL) || (Advice > POSIX_MADV_DONTNEED)) {
+        return EINVAL;
+    }
+
+    //
+    // Unlike madvise, the POSIX flavor of don't need must not throw away
+    // data, so treat it as a plain hint.
+    //
+
+    if (Advice == POSIX_MADV_DONTNEED) {
+        return 0;
+    }
+
+    Status = OsAdviseMemory(Address, Length, (MEMORY_ADVICE)Advice);
+    if (!KSUCCESS(Status)) {
+        if (Status == STATUS_INVALID_ADDRESS_RANGE) {
+            return ENOMEM;
+        }
+
+        return ClConvertKstatusToErrorNumber(Status);
+    }
+
+    return 0;
+}
+
 LIBC_API
 int
 shm_open (
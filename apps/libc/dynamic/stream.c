@@ -118,6 +118,13 @@ ClpFileFormatWriteCharacter (
     PPRINT_FORMAT_CONTEXT Context
     );
 
+BOOL
+ClpFileFormatWriteString (
+    PCSTR String,
+    ULONG Size,
+    PPRINT_FORMAT_CONTEXT Context
+    );
+
 INT
 ClpConvertStreamModeStringToOpenFlags (
     PSTR ModeString,
@@ -3103,6 +3110,7 @@ Return Value:
     memset(&PrintContext, 0, sizeof(PRINT_FORMAT_CONTEXT));
     PrintContext.Context = &StreamContext;
     PrintContext.WriteCharacter = ClpFileFormatWriteCharacter;
+    PrintContext.WriteString = ClpFileFormatWriteString;
     RtlInitializeMultibyteState(&(PrintContext.State),
                                 CharacterEncodingDefault);
 
@@ -3658,6 +3666,98 @@ Return Value:
     return TRUE;
 }
 
+BOOL
+ClpFileFormatWriteString (
+    PCSTR String,
+    ULONG Size,
+    PPRINT_FORMAT_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes a run of characters to the output during a
+    printf-style formatting operation.
+
+Arguments:
+
+    String - Supplies a pointer to the characters to be written.
+
+    Size - Supplies the number of characters to write.
+
+    Context - Supplies a pointer to the printf-context.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    ULONG CharactersWritten;
+    ULONG CopySize;
+    PSTREAM_PRINT_CONTEXT StreamContext;
+
+    StreamContext = Context->Context;
+
+    //
+    // If the stream is buffered in any way, then pass the whole run on to the
+    // stream.
+    //
+
+    if (StreamContext->Stream->BufferMode != _IONBF) {
+        ORIENT_STREAM(StreamContext->Stream, FILE_FLAG_BYTE_ORIENTED);
+        CharactersWritten = fwrite_unlocked(String,
+                                            1,
+                                            Size,
+                                            StreamContext->Stream);
+
+        if (CharactersWritten != Size) {
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    //
+    // The stream is unbuffered, so fill up the local buffer, writing it out
+    // each time it fills.
+    //
+
+    while (Size != 0) {
+        CopySize = STREAM_PRINT_BUFFER_SIZE - StreamContext->BufferNextIndex;
+        if (CopySize > Size) {
+            CopySize = Size;
+        }
+
+        memcpy(StreamContext->Buffer + StreamContext->BufferNextIndex,
+               String,
+               CopySize);
+
+        StreamContext->BufferNextIndex += CopySize;
+        String += CopySize;
+        Size -= CopySize;
+        if (StreamContext->BufferNextIndex == STREAM_PRINT_BUFFER_SIZE) {
+            StreamContext->BufferNextIndex = 0;
+            CharactersWritten = fwrite_unlocked(StreamContext->Buffer,
+                                                1,
+                                                STREAM_PRINT_BUFFER_SIZE,
+                                                StreamContext->Stream);
+
+            StreamContext->CharactersWritten += CharactersWritten;
+            if (CharactersWritten != STREAM_PRINT_BUFFER_SIZE) {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
 INT
 ClpConvertStreamModeStringToOpenFlags (
     PSTR ModeString,
@@ -32,6 +32,7 @@ Module Name:
 #include "libcp.h"
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
@@ -189,6 +190,73 @@ Return Value:
     return (ssize_t)BytesCompleted;
 }
 
+LIBC_API
+ssize_t
+vmsplice (
+    int FileDescriptor,
+    const struct iovec *IoVector,
+    unsigned long IoVectorCount,
+    unsigned int Flags
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds user memory to a pipe. Whole, page aligned pages are
+    handed to the pipe without being copied, so the caller must not modify
+    them until the data has been read from the pipe. Partial pages are copied.
+
+Arguments:
+
+    FileDescriptor - Supplies the file descriptor of the write end of a pipe.
+
+    IoVector - Supplies a pointer to an array of I/O vectors describing the
+        memory to add.
+
+    IoVectorCount - Supplies the number of elements in the I/O vector array.
+
+    Flags - Supplies a bitfield of flags. See SPLICE_F_* definitions.
+
+Return Value:
+
+    Returns the number of bytes added to the pipe on success.
+
+    -1 on error, and errno will be set to contain more information.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    ULONG SpliceFlags;
+    KSTATUS Status;
+
+    SpliceFlags = 0;
+    if ((Flags & SPLICE_F_NONBLOCK) != 0) {
+        SpliceFlags |= SYS_SPLICE_FLAG_NON_BLOCKING;
+    }
+
+    if ((Flags & SPLICE_F_GIFT) != 0) {
+        SpliceFlags |= SYS_SPLICE_FLAG_GIFT;
+    }
+
+    Status = OsSpliceMemory((HANDLE)(INTN)FileDescriptor,
+                            (PIO_VECTOR)IoVector,
+                            IoVectorCount,
+                            SpliceFlags,
+                            &BytesCompleted);
+
+    if (!KSUCCESS(Status)) {
+        errno = ClConvertKstatusToErrorNumber(Status);
+        if (BytesCompleted == 0) {
+            BytesCompleted = -1;
+        }
+    }
+
+    return (ssize_t)BytesCompleted;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
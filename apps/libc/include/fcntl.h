@@ -111,6 +111,18 @@ extern "C" {
 
 #define F_CLOSEM 11
 
+//
+// Set the capacity of a pipe, returning the actual capacity.
+//
+
+#define F_SETPIPE_SZ 12
+
+//
+// Get the capacity of a pipe.
+//
+
+#define F_GETPIPE_SZ 13
+
 //
 // There's no need for 64-bit versions, since off_t is always 64 bits.
 //
@@ -333,6 +345,78 @@ extern "C" {
 
 #define AT_REMOVEDIR 0x00000008
 
+//
+// Define file advice values, used to hint at how a region of a file is going
+// to be accessed.
+//
+
+//
+// The region has no special access pattern. This is the default.
+//
+
+#define POSIX_FADV_NORMAL 0
+
+//
+// The region will be accessed in random order, so read-ahead is not helpful.
+//
+
+#define POSIX_FADV_RANDOM 1
+
+//
+// The region will be accessed sequentially, so aggressive read-ahead is
+// helpful.
+//
+
+#define POSIX_FADV_SEQUENTIAL 2
+
+//
+// The region will be accessed soon, so start reading it into the cache now.
+//
+
+#define POSIX_FADV_WILLNEED 3
+
+//
+// The region will not be accessed soon, so its clean cached data can be
+// released.
+//
+
+#define POSIX_FADV_DONTNEED 4
+
+//
+// The region will only be accessed once.
+//
+
+#define POSIX_FADV_NOREUSE 5
+
+//
+// Define flags for the vmsplice and tee functions.
+//
+
+//
+// This flag is accepted for compatibility and ignored.
+//
+
+#define SPLICE_F_MOVE 0x00000001
+
+//
+// Set this flag to avoid blocking on the pipe.
+//
+
+#define SPLICE_F_NONBLOCK 0x00000002
+
+//
+// This flag is accepted for compatibility and ignored.
+//
+
+#define SPLICE_F_MORE 0x00000004
+
+//
+// Set this flag to indicate the caller is giving up the pages to the pipe.
+// Pages are never stolen, so this is currently treated as a hint.
+//
+
+#define SPLICE_F_GIFT 0x00000008
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -369,6 +453,8 @@ struct flock {
     short l_whence;
 };
 
+struct iovec;
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -479,6 +565,114 @@ Return Value:
 
 --*/
 
+LIBC_API
+int
+posix_fadvise (
+    int FileDescriptor,
+    off_t Offset,
+    off_t Length,
+    int Advice
+    );
+
+/*++
+
+Routine Description:
+
+    This routine advises the system about how a region of an open file is
+    going to be accessed.
+
+Arguments:
+
+    FileDescriptor - Supplies the file descriptor to advise about.
+
+    Offset - Supplies the offset of the start of the region.
+
+    Length - Supplies the size of the region in bytes. Supply zero to cover
+        everything through the end of the file.
+
+    Advice - Supplies the expected access pattern. See POSIX_FADV_*
+        definitions.
+
+Return Value:
+
+    Returns 0 on success.
+
+    Returns an error number on failure. The errno variable is not set.
+
+--*/
+
+LIBC_API
+ssize_t
+vmsplice (
+    int FileDescriptor,
+    const struct iovec *IoVector,
+    unsigned long IoVectorCount,
+    unsigned int Flags
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds user memory to a pipe. Whole, page aligned pages are
+    handed to the pipe without being copied, so the caller must not modify
+    them until the data has been read from the pipe. Partial pages are copied.
+
+Arguments:
+
+    FileDescriptor - Supplies the file descriptor of the write end of a pipe.
+
+    IoVector - Supplies a pointer to an array of I/O vectors describing the
+        memory to add.
+
+    IoVectorCount - Supplies the number of elements in the I/O vector array.
+
+    Flags - Supplies a bitfield of flags. See SPLICE_F_* definitions.
+
+Return Value:
+
+    Returns the number of bytes added to the pipe on success.
+
+    -1 on error, and errno will be set to contain more information.
+
+--*/
+
+LIBC_API
+ssize_t
+tee (
+    int Source,
+    int Destination,
+    size_t Size,
+    unsigned int Flags
+    );
+
+/*++
+
+Routine Description:
+
+    This routine duplicates up to the given number of bytes from one pipe to
+    another without consuming them from the source.
+
+Arguments:
+
+    Source - Supplies the file descriptor of the read end of the source pipe.
+
+    Destination - Supplies the file descriptor of the write end of the
+        destination pipe.
+
+    Size - Supplies the maximum number of bytes to duplicate.
+
+    Flags - Supplies a bitfield of flags. See SPLICE_F_* definitions.
+
+Return Value:
+
+    Returns the number of bytes duplicated on success. Zero indicates the
+    source pipe is empty and has no writers.
+
+    -1 on error, and errno will be set to contain more information.
+
+--*/
+
 #ifdef __cplusplus
 
 }
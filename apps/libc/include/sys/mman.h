@@ -126,6 +126,62 @@ extern "C" {
 
 #define MS_INVALIDATE 0x0004
 
+//
+// Define memory advice values, used to hint at how a region of memory is
+// going to be accessed.
+//
+
+//
+// The region has no special access pattern. This is the default.
+//
+
+#define MADV_NORMAL 0
+
+//
+// The region will be accessed in random order, so reading around faults is
+// not helpful.
+//
+
+#define MADV_RANDOM 1
+
+//
+// The region will be accessed sequentially, so aggressive read-ahead is
+// helpful.
+//
+
+#define MADV_SEQUENTIAL 2
+
+//
+// The region will be accessed soon, so start bringing it in now.
+//
+
+#define MADV_WILLNEED 3
+
+//
+// The region will not be accessed soon. Its pages can be released. The next
+// access to private anonymous memory gets zeroed pages, and the next access
+// to a private file mapping gets the file contents again.
+//
+
+#define MADV_DONTNEED 4
+
+//
+// The contents of the private anonymous region are no longer needed and the
+// pages can be reclaimed.
+//
+
+#define MADV_FREE 5
+
+//
+// Define the POSIX versions of the memory advice values.
+//
+
+#define POSIX_MADV_NORMAL MADV_NORMAL
+#define POSIX_MADV_RANDOM MADV_RANDOM
+#define POSIX_MADV_SEQUENTIAL MADV_SEQUENTIAL
+#define POSIX_MADV_WILLNEED MADV_WILLNEED
+#define POSIX_MADV_DONTNEED MADV_DONTNEED
+
 //
 // Define the value used to indicate a failed mapping.
 //
@@ -283,6 +339,69 @@ Return Value:
 
 --*/
 
+LIBC_API
+int
+madvise (
+    void *Address,
+    size_t Length,
+    int Advice
+    );
+
+/*++
+
+Routine Description:
+
+    This routine advises the system about how a region of the current
+    process' memory is going to be accessed.
+
+Arguments:
+
+    Address - Supplies the page aligned start of the region.
+
+    Length - Supplies the size, in bytes, of the region.
+
+    Advice - Supplies the expected access pattern. See MADV_* definitions.
+
+Return Value:
+
+    Returns 0 on success.
+
+    -1 on failure. The errno variable will be set to indicate the error.
+
+--*/
+
+LIBC_API
+int
+posix_madvise (
+    void *Address,
+    size_t Length,
+    int Advice
+    );
+
+/*++
+
+Routine Description:
+
+    This routine advises the system about how a region of the current
+    process' memory is going to be accessed.
+
+Arguments:
+
+    Address - Supplies the page aligned start of the region.
+
+    Length - Supplies the size, in bytes, of the region.
+
+    Advice - Supplies the expected access pattern. See POSIX_MADV_*
+        definitions.
+
+Return Value:
+
+    Returns 0 on success.
+
+    Returns an error number on failure. The errno variable is not set.
+
+--*/
+
 LIBC_API
 int
 shm_open (
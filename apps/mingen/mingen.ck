@@ -30,12 +30,15 @@ Module Name:
 // ------------------------------------------------------------------- Includes
 //
 
+from _time import clock_gettime, CLOCK_REALTIME;
 from app import argv;
+from io import open;
+from json import dumps, loads;
 from make import buildMakefile;
 from ninja import buildNinja;
 from getopt import gnuGetopt;
 import os;
-from os import getcwd;
+from os import getcwd, getenv, stat, OsError;
 
 //
 // --------------------------------------------------------------------- Macros
@@ -48,6 +51,13 @@ from os import getcwd;
 var VERSION_MAJOR = 2;
 var VERSION_MINOR = 0;
 
+//
+// Define the version of the build cache format. Bump this whenever the layout
+// of the cache file changes.
+//
+
+var CACHE_VERSION = 1;
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -161,13 +171,77 @@ _printTarget (
     target
     );
 
+function
+_trackedGetenv (
+    name
+    );
+
+function
+_getCachePath (
+    );
+
+function
+_getCacheKey (
+    );
+
+function
+_loadCache (
+    );
+
+function
+_saveCache (
+    entries
+    );
+
+function
+_cacheModule (
+    name,
+    module,
+    entries
+    );
+
+function
+_getModuleSources (
+    module
+    );
+
+function
+_scanImports (
+    path
+    );
+
+function
+_getSourceSignature (
+    path
+    );
+
+function
+_areSourcesCurrent (
+    sources
+    );
+
+function
+_selectReusableChunks (
+    );
+
+function
+_getTime (
+    );
+
+function
+_endPhase (
+    name,
+    start
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
 
-var shortOptions = "B:De:F:ghi:no:O:uvV";
+var shortOptions = "B:CDe:F:ghi:no:O:tuvV";
 var longOptions = [
     "build-os=",
+    "no-cache",
     "expr=",
     "debug",
     "format=",
@@ -176,6 +250,7 @@ var longOptions = [
     "dry-run",
     "output=",
     "output-file=",
+    "time",
     "help",
     "unanchored",
     "verbose",
@@ -189,6 +264,8 @@ var usage =
     "file for only those targets will be built. Otherwise, the build file \n"
     "is created for the whole project. Options are:\n"
     "  -B, --build-os=os,machine -- Set the build OS and build machine.\n"
+    "  -C, --no-cache -- Evaluate every build file from scratch rather than \n"
+    "      reusing results cached from the previous run.\n"
     "  -e, --expr=var=val -- Set a custom build option.\n"
     "      This can be specified multiple times.\n"
     "  -D, --debug -- Print lots of information during execution.\n"
@@ -202,6 +279,7 @@ var usage =
     "  -o, --output=build_dir -- Set the given directory as the build \n"
     "      output directory.\n"
     "  -O, --output-file=file -- Set the output file name.\n"
+    "  -t, --time -- Print how long each phase of generation takes.\n"
     "  -u, --unanchored -- Leave the input and output directories blank in \n"
     "      the final build file. They must be specified manually later.\n"
     "  -v, --verbose -- Print more information during processing.\n"
@@ -211,12 +289,14 @@ var usage =
 var config = {
     "build_os": os.system,
     "build_machine": os.machine,
+    "cache": true,
     "debug": false,
     "format": null,
     "generator": true,
     "input": null,
     "output": null,
     "output_file": null,
+    "timing": false,
     "unanchored": false,
     "verbose": false,
     "build_module_name": "build",
@@ -236,6 +316,19 @@ var pools = {};
 var buildDirectories = {};
 var scripts = {};
 
+//
+// Store the build cache loaded from the previous run, the cache being built
+// up for this run, the set of modules whose entries came from the cache, and
+// every environment variable read by the build files along with its value.
+//
+
+var oldCache;
+var newCache = {"modules": {}};
+var reusedModules = {};
+var environmentReads = {};
+var moduleSources = {};
+var sourceSignatures = {};
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -270,6 +363,7 @@ Return Value:
     var currentDirectory = getcwd().replace("\\", "/", -1);
     var entries = {};
     var name;
+    var phaseStart = _getTime();
     var value;
 
     //
@@ -287,6 +381,9 @@ Return Value:
                 config.build_machine = value[1];
             }
 
+        } else if ((name == "-C") || (name == "--no-cache")) {
+            config.cache = false;
+
         } else if ((name == "-e") || (name == "--expr")) {
             value = value.split("=", 1);
             if (value.length() == 2) {
@@ -327,6 +424,9 @@ Return Value:
         } else if ((name == "-O") || (name == "--output-file")) {
             config.output_file = value;
 
+        } else if ((name == "-t") || (name == "--time")) {
+            config.timing = true;
+
         } else if ((name == "-u") || (name == "--unanchored")) {
             config.unanchored = true;
 
@@ -358,10 +458,27 @@ Return Value:
         Core.print("Module search path: " + Core.modulePath().__str());
     }
 
+    //
+    // Route environment lookups made by the build files through a wrapper
+    // that remembers them, since a cached build file result is only valid if
+    // the environment it saw is unchanged.
+    //
+
+    os.getenv = _trackedGetenv;
+    phaseStart = _endPhase("startup", phaseStart);
     _loadProjectRoot();
     config.format ?= "make";
+    _loadCache();
+    phaseStart = _endPhase("load root", phaseStart);
     _processEntries();
+    phaseStart = _endPhase("load and process modules", phaseStart);
+    if (config.timing) {
+        Core.print("mingen: %d modules, %d reused from cache" %
+                   [modules.length(), reusedModules.length()]);
+    }
+
     _selectTargets();
+    phaseStart = _endPhase("select targets", phaseStart);
     if (config.verbose) {
         _printAllEntries();
     }
@@ -372,6 +489,8 @@ Return Value:
     entries.pools = pools;
     entries.buildDirectories = buildDirectories;
     entries.scripts = scripts;
+    entries.reusableChunks = _selectReusableChunks();
+    entries.chunks = {};
     if (config.format == "make") {
         buildMakefile(config, entries);
 
@@ -379,6 +498,12 @@ Return Value:
         buildNinja(config, entries);
     }
 
+    phaseStart = _endPhase("write output", phaseStart);
+    if (config.format != "none") {
+        _saveCache(entries);
+        phaseStart = _endPhase("save cache", phaseStart);
+    }
+
     if (config.verbose) {
         Core.print("Done");
     }
@@ -563,6 +688,7 @@ Return Value:
     var entries;
     var fullName;
     var module;
+    var record;
     var scriptFile;
 
     module = modules.get(name);
@@ -571,13 +697,33 @@ Return Value:
     }
 
     fullName = name.replace("/", ".", -1) + "." + config.build_module_name;
+    scriptFile = fullName.replace(".", "/", -1) + ".ck";
+
+    //
+    // If neither the build file nor anything it imports has changed since
+    // the last run, use the entries it returned then instead of running it.
+    //
+
+    if (oldCache) {
+        record = oldCache.modules.get(name);
+        if ((record) && (_areSourcesCurrent(record.sources))) {
+            newCache.modules[name] = record;
+            reusedModules[name] = true;
+            scripts[scriptFile] = true;
+            modules[name] = record;
+            entries = loads(record.entries);
+            _validateEntries(name, entries);
+            return record;
+        }
+    }
+
     module = Core.importModule(fullName);
     module.run();
-    scriptFile = fullName.replace(".", "/", -1) + ".ck";
     scripts[scriptFile] = true;
     modules[name] = module;
     build = module.build;
     entries = build();
+    _cacheModule(name, module, entries);
     _validateEntries(name, entries);
     return module;
 }
@@ -1453,3 +1599,636 @@ Return Value:
     return;
 }
 
+function
+_trackedGetenv (
+    name
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stands in for os.getenv while build files are loaded. It
+    records each variable looked up so that cached results can be thrown out
+    when the environment changes.
+
+Arguments:
+
+    name - Supplies the name of the environment variable to get.
+
+Return Value:
+
+    Returns the value of the environment variable, or null if it is not set.
+
+--*/
+
+{
+
+    var value = getenv(name);
+
+    environmentReads[name] = value;
+    return value;
+}
+
+function
+_getCachePath (
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the path of the build cache file, which sits next to
+    the generated build file.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the path to the cache file.
+
+--*/
+
+{
+
+    var path;
+
+    if (config.output_file) {
+        path = config.output_file + ".cache";
+
+    } else {
+        path = config.output + "/mingen.cache";
+    }
+
+    return path.template({config.input_variable: config.input}, 0);
+}
+
+function
+_getCacheKey (
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a string capturing all the configuration that can
+    change what the build files return or how the output is written. A cache
+    saved under a different key is ignored entirely.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the cache key string.
+
+--*/
+
+{
+
+    var key = [
+        CACHE_VERSION,
+        VERSION_MAJOR,
+        VERSION_MINOR,
+        config.build_os,
+        config.build_machine,
+        config.cmdvars,
+        config.input,
+        config.output,
+        config.output_file,
+        config.build_module_name,
+        config.format,
+        config.targets,
+        config.unanchored
+    ];
+
+    return dumps(key, 0);
+}
+
+function
+_loadCache (
+    )
+
+/*++
+
+Routine Description:
+
+    This routine loads the build cache saved by the previous run, if there is
+    one and it still applies.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var data;
+    var environment;
+    var file;
+
+    if ((!config.cache) || (config.format == "none")) {
+        return;
+    }
+
+    try {
+        file = open(_getCachePath(), "r");
+        data = loads(file.readall());
+        file.close();
+
+    } except Exception {
+        return;
+    }
+
+    if ((!(data is Dict)) || (data.get("key") != _getCacheKey())) {
+        if (config.verbose) {
+            Core.print("Ignoring build cache from a different configuration");
+        }
+
+        return;
+    }
+
+    environment = data.environment;
+    for (name in environment) {
+        if (getenv(name) != environment[name]) {
+            if (config.verbose) {
+                Core.print("Ignoring build cache since %s changed" % name);
+            }
+
+            return;
+        }
+    }
+
+    //
+    // Carry the old environment reads forward, since the build files reused
+    // from the cache won't run again to record them.
+    //
+
+    for (name in environment) {
+        environmentReads[name] = environment[name];
+    }
+
+    oldCache = data;
+    return;
+}
+
+function
+_saveCache (
+    entries
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes out the build cache for the next run.
+
+Arguments:
+
+    entries - Supplies the entries dictionary handed to the output generator,
+        which contains the output chunks to save.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var data;
+    var file;
+
+    if (!config.cache) {
+        return;
+    }
+
+    data = {
+        "key": _getCacheKey(),
+        "environment": environmentReads,
+        "modules": newCache.modules,
+        "chunks": entries.chunks
+    };
+
+    try {
+        file = open(_getCachePath(), "w");
+        file.write(dumps(data, 0));
+        file.close();
+
+    } except OsError {
+        if (config.verbose) {
+            Core.print("Failed to write build cache %s" % _getCachePath());
+        }
+    }
+
+    return;
+}
+
+function
+_cacheModule (
+    name,
+    module,
+    entries
+    )
+
+/*++
+
+Routine Description:
+
+    This routine saves the entries returned by a build file into the cache
+    being assembled for the next run. Entries are saved before validation,
+    since validating them resolves references to other modules.
+
+Arguments:
+
+    name - Supplies the name of the module.
+
+    module - Supplies the module object that was run.
+
+    entries - Supplies the raw entries returned by the module's build function.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    var text;
+
+    if (!config.cache) {
+        return;
+    }
+
+    //
+    // Build files that return values that can't be saved (like functions)
+    // are simply run every time.
+    //
+
+    try {
+        text = dumps(entries, 0);
+
+    } except TypeError {
+        return;
+    }
+
+    newCache.modules[name] = {
+        "entries": text,
+        "sources": _getModuleSources(module)
+    };
+
+    return;
+}
+
+function
+_getModuleSources (
+    module
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the set of project source files the given module
+    depends on: its own source plus that of every project module it imports,
+    recursively.
+
+Arguments:
+
+    module - Supplies the module object.
+
+Return Value:
+
+    Returns a dictionary of source paths to their signatures.
+
+--*/
+
+{
+
+    var imported;
+    var importedSources;
+    var loaded;
+    var path;
+    var sources;
+
+    sources = moduleSources.get(module.name());
+    if (sources != null) {
+        return sources;
+    }
+
+    //
+    // Save the dictionary before recursing so that import cycles terminate.
+    //
+
+    sources = {};
+    moduleSources[module.name()] = sources;
+    path = module.path();
+    if ((module.isForeign()) || (!path)) {
+        return sources;
+    }
+
+    sources[path] = _getSourceSignature(path);
+    loaded = Core.modules();
+    for (name in _scanImports(path)) {
+        imported = loaded.get(name);
+        if ((!imported) || (imported.isForeign())) {
+            continue;
+        }
+
+        path = imported.path();
+        if ((!path) || (!path.startsWith(config.input))) {
+            continue;
+        }
+
+        importedSources = _getModuleSources(imported);
+        for (source in importedSources) {
+            sources[source] = importedSources[source];
+        }
+    }
+
+    return sources;
+}
+
+function
+_scanImports (
+    path
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the names of the modules imported at the top level of
+    the given source file.
+
+Arguments:
+
+    path - Supplies the path of the source file.
+
+Return Value:
+
+    Returns a list of module names.
+
+--*/
+
+{
+
+    var file;
+    var result = [];
+    var text;
+    var words;
+
+    try {
+        file = open(path, "r");
+        text = file.readall();
+        file.close();
+
+    } except OsError {
+        return result;
+    }
+
+    for (line in text.split("\n", -1)) {
+        if ((line.startsWith("from ")) || (line.startsWith("import "))) {
+            words = line.split(" ", -1);
+            if (words.length() >= 2) {
+                result.append(words[1].replace(";", "", -1));
+            }
+        }
+    }
+
+    return result;
+}
+
+function
+_getSourceSignature (
+    path
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a signature for a source file that changes whenever
+    the file does.
+
+Arguments:
+
+    path - Supplies the path of the source file.
+
+Return Value:
+
+    Returns a list of the modification time, size, and inode number of the
+    file.
+
+    null if the file could not be examined.
+
+--*/
+
+{
+
+    var info;
+    var signature;
+
+    if (sourceSignatures.containsKey(path)) {
+        return sourceSignatures[path];
+    }
+
+    try {
+        info = stat(path);
+        signature = [info.st_mtime, info.st_size, info.st_ino];
+
+    } except OsError {
+        signature = null;
+    }
+
+    sourceSignatures[path] = signature;
+    return signature;
+}
+
+function
+_areSourcesCurrent (
+    sources
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether all of the given sources are unchanged.
+
+Arguments:
+
+    sources - Supplies a dictionary of source paths to their signatures as
+        saved in the cache.
+
+Return Value:
+
+    Returns true if every source still has the same signature.
+
+    Returns false if any source changed or disappeared.
+
+--*/
+
+{
+
+    var current;
+    var index;
+    var saved;
+
+    for (path in sources) {
+        current = _getSourceSignature(path);
+        saved = sources[path];
+        if ((current == null) || (saved == null) ||
+            (current.length() != saved.length())) {
+
+            return false;
+        }
+
+        for (index = 0; index < current.length(); index += 1) {
+            if (current[index] != saved[index]) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+function
+_selectReusableChunks (
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines which modules' sections of the previous output
+    can be copied forward as is. A section can be reused if the module came
+    from the cache and so did every module its targets refer to.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a dictionary of module names to saved output chunks.
+
+--*/
+
+{
+
+    var chunks;
+    var dirty = {};
+    var inputs;
+    var result = {};
+
+    //
+    // Selecting specific targets changes which targets are active based on
+    // the targets that depend on them, so only reuse output for full builds.
+    //
+
+    if ((!oldCache) || (config.targets.length() != 0)) {
+        return result;
+    }
+
+    for (target in targetsList) {
+        if (!reusedModules.get(target.module)) {
+            dirty[target.module] = true;
+            continue;
+        }
+
+        for (inputs in [target.inputs, target.implicit, target.orderonly]) {
+            for (input in inputs) {
+                if ((input is Dict) && (!reusedModules.get(input.module))) {
+                    dirty[target.module] = true;
+                }
+            }
+        }
+    }
+
+    chunks = oldCache.get("chunks");
+    if (!(chunks is Dict)) {
+        return result;
+    }
+
+    for (module in chunks) {
+        if ((reusedModules.get(module)) && (!dirty.get(module))) {
+            result[module] = chunks[module];
+        }
+    }
+
+    return result;
+}
+
+function
+_getTime (
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the current time in milliseconds.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a millisecond count.
+
+--*/
+
+{
+
+    var now = clock_gettime(CLOCK_REALTIME);
+
+    return (now[0] * 1000) + (now[1] / 1000000);
+}
+
+function
+_endPhase (
+    name,
+    start
+    )
+
+/*++
+
+Routine Description:
+
+    This routine prints how long a phase of generation took if timing output
+    was requested.
+
+Arguments:
+
+    name - Supplies the name of the phase that just completed.
+
+    start - Supplies the time the phase started, in milliseconds.
+
+Return Value:
+
+    Returns the current time, which is the start of the next phase.
+
+--*/
+
+{
+
+    var now = _getTime();
+
+    if (config.timing) {
+        Core.print("mingen: %s: %d ms" % [name, now - start]);
+    }
+
+    return now;
+}
@@ -120,6 +120,93 @@ var _ninjaLineContinuation = " $\n        ";
 // ------------------------------------------------------------------ Functions
 //
 
+class NinjaChunkWriter {
+    var _file;
+    var _parts;
+
+    function
+    __init (
+        file
+        )
+
+    /*++
+
+    Routine Description:
+
+        This routine initializes a writer that passes output through to the
+        given file while also saving a copy of it.
+
+    Arguments:
+
+        file - Supplies the file to write to.
+
+    Return Value:
+
+        Returns the object.
+
+    --*/
+
+    {
+
+        _file = file;
+        _parts = [];
+        return this;
+    }
+
+    function
+    write (
+        text
+        )
+
+    /*++
+
+    Routine Description:
+
+        This routine writes text to the file and saves a copy.
+
+    Arguments:
+
+        text - Supplies the text to write.
+
+    Return Value:
+
+        None.
+
+    --*/
+
+    {
+
+        _file.write(text);
+        _parts.append(text);
+        return;
+    }
+
+    function
+    text (
+        )
+
+    /*++
+
+    Routine Description:
+
+        This routine returns everything written so far.
+
+    Arguments:
+
+        None.
+
+    Return Value:
+
+        Returns the saved text as a single string.
+
+    --*/
+
+    {
+
+        return "".join(_parts);
+    }
+}
+
 class NinjaVariableTransformer {
     function
     __get (
@@ -201,7 +288,9 @@ Routine Description:
     config - Supplies the application configuration
 
     entries - Supplies a dictionary containing the tools, targets, pools, and
-        build directories.
+        build directories. Its reusableChunks member holds previously written
+        target sections that can be copied as is, indexed by module, and the
+        sections written this time are saved in its chunks member.
 
 Return Value:
 
@@ -213,16 +302,23 @@ Return Value:
 
 {
 
+    var chunk;
+    var chunks = entries.get("chunks");
     var file;
     var module;
     var ninjaPath;
+    var output;
     var pools;
     var pool;
+    var reusableChunks = entries.get("reusableChunks");
     var skippedNewline = false;
     var targetsList = entries.targetsList;
     var tools;
     var totalInputs;
 
+    chunks ?= {};
+    reusableChunks ?= {};
+
     if (config.output_file) {
         ninjaPath = config.output_file;
 
@@ -314,7 +410,9 @@ Return Value:
     file.write("\n");
 
     //
-    // Loop over and print every active target.
+    // Loop over and print every active target. The targets for each module
+    // are written as a unit, and a module's section from the last run is
+    // copied over directly when none of the inputs to it have changed.
     //
 
     targetsList = entries.targetsList;
@@ -324,37 +422,55 @@ Return Value:
         }
 
         if (target.module != module) {
+            if (output) {
+                chunks[module] = [output.text(), skippedNewline];
+            }
+
             module = target.module;
             if (skippedNewline) {
                 file.write("\n");
             }
 
+            chunk = reusableChunks.get(module);
+            if (chunk) {
+                file.write(chunk[0]);
+                skippedNewline = chunk[1];
+                chunks[module] = chunk;
+                output = null;
+                continue;
+            }
+
+            output = NinjaChunkWriter(file);
             if (module == "") {
-                file.write("# Define root targets\n");
+                output.write("# Define root targets\n");
 
             } else {
-                file.write("# Define targets for %s\n" % module);
+                output.write("# Define targets for %s\n" % module);
             }
         }
 
-        file.write("build ");
-        _ninjaPrintTargetFile(file, config, target);
-        file.write(": %s " % target.tool);
-        _ninjaPrintInputs(file, config, target.inputs);
+        if (!output) {
+            continue;
+        }
+
+        output.write("build ");
+        _ninjaPrintTargetFile(output, config, target);
+        output.write(": %s " % target.tool);
+        _ninjaPrintInputs(output, config, target.inputs);
         if (target.implicit.length()) {
-            file.write(_ninjaLineContinuation + " | ");
-            _ninjaPrintInputs(file, config, target.implicit);
+            output.write(_ninjaLineContinuation + " | ");
+            _ninjaPrintInputs(output, config, target.implicit);
         }
 
         if (target.orderonly.length()) {
-            file.write(_ninjaLineContinuation + " || ");
-            _ninjaPrintInputs(file, config, target.orderonly);
+            output.write(_ninjaLineContinuation + " || ");
+            _ninjaPrintInputs(output, config, target.orderonly);
         }
 
-        file.write("\n");
-        _ninjaPrintConfig(file, config, target.config, target);
+        output.write("\n");
+        _ninjaPrintConfig(output, config, target.config, target);
         if (target.get("pool")) {
-            file.write("    pool = %s\n" % target.pool);
+            output.write("    pool = %s\n" % target.pool);
         }
 
         //
@@ -370,11 +486,17 @@ Return Value:
             (target.config.length()) ||
             (target.get("pool"))) {
 
-            file.write("\n");
+            output.write("\n");
             skippedNewline = false;
         }
     }
 
+    if (output) {
+        chunks[module] = [output.text(), skippedNewline];
+    }
+
+    entries.chunks = chunks;
+
     if (config.generator) {
         _ninjaPrintRebuildRule(file, config, entries.scripts);
     }
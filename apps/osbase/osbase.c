@@ -526,6 +526,50 @@ Return Value:
     return OsSystemCall(SystemCallFlush, &Parameters);
 }
 
+OS_API
+KSTATUS
+OsAdviseFile (
+    HANDLE Handle,
+    IO_OFFSET Offset,
+    ULONGLONG Size,
+    FILE_ADVICE Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine supplies a hint about how a region of an open file is going
+    to be accessed, so that caching and read-ahead can be tuned accordingly.
+
+Arguments:
+
+    Handle - Supplies an open I/O handle.
+
+    Offset - Supplies the file offset where the region starts.
+
+    Size - Supplies the size of the region in bytes. Supply -1 to cover
+        through the end of the file.
+
+    Advice - Supplies the access pattern hint.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    SYSTEM_CALL_ADVISE_FILE Parameters;
+
+    Parameters.Handle = Handle;
+    Parameters.Offset = Offset;
+    Parameters.Size = Size;
+    Parameters.Advice = Advice;
+    return OsSystemCall(SystemCallAdviseFile, &Parameters);
+}
+
 OS_API
 KSTATUS
 OsCreatePipe (
@@ -594,6 +638,118 @@ Return Value:
     return Status;
 }
 
+OS_API
+KSTATUS
+OsSpliceMemory (
+    HANDLE Handle,
+    PIO_VECTOR VectorArray,
+    UINTN VectorCount,
+    ULONG Flags,
+    PUINTN BytesCompleted
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds user memory to a pipe. Whole, page aligned pages are
+    handed to the pipe without being copied, so they must not be modified
+    until the data has been read out of the other end.
+
+Arguments:
+
+    Handle - Supplies a handle to the write end of a pipe.
+
+    VectorArray - Supplies an array of I/O vector structures describing the
+        memory to add.
+
+    VectorCount - Supplies the number of elements in the vector array.
+
+    Flags - Supplies a bitfield of flags. See SYS_SPLICE_FLAG_* definitions.
+
+    BytesCompleted - Supplies a pointer where the number of bytes added to the
+        pipe will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    SYSTEM_CALL_SPLICE_MEMORY Parameters;
+    INTN Result;
+
+    Parameters.Handle = Handle;
+    Parameters.VectorArray = VectorArray;
+    Parameters.VectorCount = VectorCount;
+    Parameters.Flags = Flags;
+    Result = OsSystemCall(SystemCallSpliceMemory, &Parameters);
+    if (Result < 0) {
+        *BytesCompleted = 0;
+        return Result;
+    }
+
+    *BytesCompleted = (UINTN)Result;
+    return STATUS_SUCCESS;
+}
+
+OS_API
+KSTATUS
+OsTeePipe (
+    HANDLE Source,
+    HANDLE Destination,
+    UINTN Size,
+    ULONG Flags,
+    PUINTN BytesCompleted
+    )
+
+/*++
+
+Routine Description:
+
+    This routine duplicates the unread contents of one pipe onto the end of
+    another without consuming them from the source.
+
+Arguments:
+
+    Source - Supplies a handle to the read end of the pipe to copy from.
+
+    Destination - Supplies a handle to the write end of the pipe to copy to.
+
+    Size - Supplies the maximum number of bytes to duplicate.
+
+    Flags - Supplies a bitfield of flags. See SYS_SPLICE_FLAG_* definitions.
+
+    BytesCompleted - Supplies a pointer where the number of bytes duplicated
+        will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    SYSTEM_CALL_TEE_PIPE Parameters;
+    INTN Result;
+
+    Parameters.Source = Source;
+    Parameters.Destination = Destination;
+    Parameters.Size = Size;
+    Parameters.Flags = Flags;
+    Result = OsSystemCall(SystemCallTeePipe, &Parameters);
+    if (Result < 0) {
+        *BytesCompleted = 0;
+        return Result;
+    }
+
+    *BytesCompleted = (UINTN)Result;
+    return STATUS_SUCCESS;
+}
+
 OS_API
 VOID
 OsExitThread (
@@ -2874,6 +3030,46 @@ Return Value:
     return OsSystemCall(SystemCallFlushMemory, &Parameters);
 }
 
+OS_API
+KSTATUS
+OsAdviseMemory (
+    PVOID Address,
+    UINTN Size,
+    MEMORY_ADVICE Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine supplies a hint about how a region of the current process'
+    mapped memory is going to be accessed. Depending on the hint, pages may
+    be prefetched or discarded.
+
+Arguments:
+
+    Address - Supplies the page aligned starting address of the region.
+
+    Size - Supplies the size of the region in bytes.
+
+    Advice - Supplies the access pattern hint.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    SYSTEM_CALL_ADVISE_MEMORY Parameters;
+
+    Parameters.Address = Address;
+    Parameters.Size = Size;
+    Parameters.Advice = Advice;
+    return OsSystemCall(SystemCallAdviseMemory, &Parameters);
+}
+
 OS_API
 KSTATUS
 OsSetThreadIdentity (
@@ -133,9 +133,13 @@ if ((arch == "x86") || (arch == "x64")) {
         "e1000.drv",
         "i8042.drv",
         "intelhda.drv",
+        "nvme.drv",
         "rtl81xx.drv",
         "uhci.drv",
         "pcnet32.drv",
+        "virtblk.drv",
+        "virtio.drv",
+        "virtnet.drv",
     ];
 
 } else if ((arch == "armv7") || (arch == "armv6")) {
@@ -165,7 +169,10 @@ if ((arch == "x86") || (arch == "x64")) {
         "usbcomp.drv",
         "usbhub.drv",
         "usbmass.drv",
+        "nvme.drv",
         "sd.drv",
+        "virtblk.drv",
+        "virtio.drv",
     ];
 }
 
@@ -741,6 +748,7 @@ if ((plat == "install-x86") || (plat == "install-x64")) {
         "net80211.drv",
         "netcore.drv",
         "null.drv",
+        "nvme.drv",
         "onering.drv",
         "part.drv",
         "pci.drv",
@@ -766,6 +774,9 @@ if ((plat == "install-x86") || (plat == "install-x64")) {
         "usbmouse.drv",
         "usrinput.drv",
         "videocon.drv",
+        "virtblk.drv",
+        "virtio.drv",
+        "virtnet.drv",
     ];
 
     Files += [
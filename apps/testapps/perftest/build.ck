@@ -44,12 +44,15 @@ function build() {
         "exec.c",
         "fork.c",
         "malloc.c",
+        "memacc.c",
         "mmap.c",
         "mutex.c",
         "open.c",
+        "pathwalk.c",
         "perfsup.c",
         "perftest.c",
         "pipeio.c",
+        "printf.c",
         "pthread.c",
         "read.c",
         "rename.c",
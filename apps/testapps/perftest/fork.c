@@ -30,9 +30,11 @@ Module Name:
 // ------------------------------------------------------------------- Includes
 //
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 
 #include "perftest.h"
@@ -41,6 +43,18 @@ Module Name:
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the size of the resident set built up before the large fork tests.
+//
+
+#define PT_FORK_LARGE_BUFFER_SIZE (1024 * 1024 * 1024)
+
+//
+// Define the stride used to touch each page of the large fork buffer.
+//
+
+#define PT_FORK_LARGE_TOUCH_STRIDE 4096
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -84,14 +98,62 @@ Return Value:
 
 {
 
+    char *Arguments[FORK_EXEC_CHILD_ARGUMENT_COUNT + 1];
+    char *Buffer;
     pid_t Child;
+    size_t Index;
     unsigned long long Iterations;
     int Status;
 
+    Buffer = NULL;
     Iterations = 0;
     Result->Type = PtResultIterations;
     Result->Status = 0;
 
+    //
+    // The large variants fork from a process with a big private, dirty
+    // anonymous mapping, which is where the cost of copying the address space
+    // shows up.
+    //
+
+    switch (Test->TestType) {
+    case PtTestFork:
+        break;
+
+    case PtTestForkLarge:
+    case PtTestForkExecLarge:
+        Buffer = mmap(NULL,
+                      PT_FORK_LARGE_BUFFER_SIZE,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0);
+
+        if (Buffer == MAP_FAILED) {
+            Result->Status = errno;
+            Buffer = NULL;
+            goto MainEnd;
+        }
+
+        for (Index = 0;
+             Index < PT_FORK_LARGE_BUFFER_SIZE;
+             Index += PT_FORK_LARGE_TOUCH_STRIDE) {
+
+            Buffer[Index] = (char)Index;
+        }
+
+        break;
+
+    default:
+        fprintf(stderr, "Unknown fork test type %d\n", Test->TestType);
+        Result->Status = EINVAL;
+        goto MainEnd;
+    }
+
+    Arguments[0] = PtProgramPath;
+    Arguments[1] = FORK_EXEC_LARGE_TEST_NAME;
+    Arguments[2] = NULL;
+
     //
     // Start the test. This snaps resource usage and starts the clock ticking.
     //
@@ -105,7 +167,8 @@ Return Value:
     //
     // Measure the performance of the fork() C library routine by counting the
     // number of times a forked child can be waited on during the given
-    // duration. The child, in this case, exits immediately.
+    // duration. The child, in this case, exits immediately, or executes a
+    // copy of this program that exits immediately.
     //
 
     while (PtIsTimedTestRunning() != 0) {
@@ -115,6 +178,11 @@ Return Value:
             break;
 
         } else if (Child == 0) {
+            if (Test->TestType == PtTestForkExecLarge) {
+                execv(PtProgramPath, Arguments);
+                exit(errno);
+            }
+
             exit(0);
 
         } else {
@@ -143,6 +211,10 @@ Return Value:
     }
 
 MainEnd:
+    if (Buffer != NULL) {
+        munmap(Buffer, PT_FORK_LARGE_BUFFER_SIZE);
+    }
+
     Result->Data.Iterations = Iterations;
     return;
 }
@@ -0,0 +1,197 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    memacc.c
+
+Abstract:
+
+    This module implements the memory access performance benchmark test,
+    which reads randomly across a large anonymous mapping to stress address
+    translation.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    User
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "perftest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the size of the buffer to read from. This is far larger than any
+// TLB can cover with small pages.
+//
+
+#define PT_MEMORY_ACCESS_BUFFER_SIZE (256 * 1024 * 1024)
+
+//
+// Define the number of reads performed between checks of the test timer.
+//
+
+#define PT_MEMORY_ACCESS_BATCH_SIZE 4096
+
+//
+// Define the stride used to touch each page of the buffer up front.
+//
+
+#define PT_MEMORY_ACCESS_TOUCH_STRIDE 4096
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the sum of every value read so the reads cannot be optimized away.
+//
+
+volatile unsigned long MemoryAccessSink;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+void
+MemoryAccessMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs the memory access performance benchmark test.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    unsigned long *Buffer;
+    size_t ElementCount;
+    size_t Index;
+    unsigned long long Iterations;
+    uint32_t Random;
+    int Status;
+    unsigned long Sum;
+
+    Iterations = 0;
+    Result->Type = PtResultIterations;
+    Result->Status = 0;
+    Buffer = mmap(NULL,
+                  PT_MEMORY_ACCESS_BUFFER_SIZE,
+                  PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS,
+                  -1,
+                  0);
+
+    if (Buffer == MAP_FAILED) {
+        Result->Status = errno;
+        Buffer = NULL;
+        goto MainEnd;
+    }
+
+    //
+    // Fault in the whole buffer in order, which gives the kernel the chance
+    // to build up large pages, and keeps page faults out of the timed loop.
+    //
+
+    for (Index = 0;
+         Index < PT_MEMORY_ACCESS_BUFFER_SIZE;
+         Index += PT_MEMORY_ACCESS_TOUCH_STRIDE) {
+
+        *((char *)Buffer + Index) = (char)Index;
+    }
+
+    //
+    // Start the test. This snaps resource usage and starts the clock ticking.
+    //
+
+    Status = PtStartTimedTest(Test->Duration);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    //
+    // Read from random locations using a cheap xorshift generator so that the
+    // cost is dominated by the memory accesses themselves.
+    //
+
+    ElementCount = PT_MEMORY_ACCESS_BUFFER_SIZE / sizeof(unsigned long);
+    Random = (uint32_t)rand() | 1;
+    Sum = 0;
+    while (PtIsTimedTestRunning() != 0) {
+        for (Index = 0; Index < PT_MEMORY_ACCESS_BATCH_SIZE; Index += 1) {
+            Random ^= Random << 13;
+            Random ^= Random >> 17;
+            Random ^= Random << 5;
+            Sum += Buffer[Random % ElementCount];
+        }
+
+        Iterations += PT_MEMORY_ACCESS_BATCH_SIZE;
+    }
+
+    MemoryAccessSink = Sum;
+    Status = PtFinishTimedTest(Result);
+    if ((Status != 0) && (Result->Status == 0)) {
+        Result->Status = errno;
+    }
+
+MainEnd:
+    if (Buffer != NULL) {
+        munmap(Buffer, PT_MEMORY_ACCESS_BUFFER_SIZE);
+    }
+
+    Result->Data.Iterations = Iterations;
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
@@ -0,0 +1,285 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    pathwalk.c
+
+Abstract:
+
+    This module implements the path walk performance benchmark test, which
+    stresses path lookup through deep and wide directory trees.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    User
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "perftest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the number of nested directories above the wide leaf directory, and
+// the number of files created in that leaf directory.
+//
+
+#define PT_PATH_WALK_DEPTH 8
+#define PT_PATH_WALK_FILE_COUNT 4096
+
+#define PT_PATH_WALK_PATH_LENGTH 256
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+void
+PathWalkCleanup (
+    char *Path,
+    int DirectoryCount,
+    int FileCount
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+void
+PathWalkMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs the path walk performance benchmark test.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    int DirectoryCount;
+    int FileCount;
+    int FileDescriptor;
+    unsigned long long Iterations;
+    char Path[PT_PATH_WALK_PATH_LENGTH];
+    size_t PathLength;
+    pid_t ProcessId;
+    struct stat Stat;
+    int Status;
+
+    DirectoryCount = 0;
+    FileCount = 0;
+    Iterations = 0;
+    Result->Type = PtResultIterations;
+    Result->Status = 0;
+
+    //
+    // Build a process safe chain of nested directories.
+    //
+
+    ProcessId = getpid();
+    Status = snprintf(Path, sizeof(Path), "pathwalk_%d", ProcessId);
+    if (Status < 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    while (DirectoryCount < PT_PATH_WALK_DEPTH) {
+        if (DirectoryCount != 0) {
+            PathLength = strlen(Path);
+            Status = snprintf(Path + PathLength,
+                              sizeof(Path) - PathLength,
+                              "/level%d",
+                              DirectoryCount);
+
+            if (Status < 0) {
+                Result->Status = errno;
+                goto MainEnd;
+            }
+        }
+
+        Status = mkdir(Path, S_IRWXU);
+        if (Status != 0) {
+            Result->Status = errno;
+            goto MainEnd;
+        }
+
+        DirectoryCount += 1;
+    }
+
+    //
+    // Fill the deepest directory with files.
+    //
+
+    PathLength = strlen(Path);
+    while (FileCount < PT_PATH_WALK_FILE_COUNT) {
+        snprintf(Path + PathLength,
+                 sizeof(Path) - PathLength,
+                 "/file%d",
+                 FileCount);
+
+        FileDescriptor = creat(Path, S_IRUSR | S_IWUSR);
+        if (FileDescriptor < 0) {
+            Result->Status = errno;
+            Path[PathLength] = '\0';
+            goto MainEnd;
+        }
+
+        close(FileDescriptor);
+        FileCount += 1;
+    }
+
+    Path[PathLength] = '\0';
+
+    //
+    // Start the test. This snaps resource usage and starts the clock ticking.
+    //
+
+    Status = PtStartTimedTest(Test->Duration);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    //
+    // Measure how many full path lookups can be made through the directory
+    // chain down to random files in the wide directory.
+    //
+
+    while (PtIsTimedTestRunning() != 0) {
+        snprintf(Path + PathLength,
+                 sizeof(Path) - PathLength,
+                 "/file%d",
+                 rand() % PT_PATH_WALK_FILE_COUNT);
+
+        Status = stat(Path, &Stat);
+        if (Status != 0) {
+            Result->Status = errno;
+            break;
+        }
+
+        Iterations += 1;
+    }
+
+    Path[PathLength] = '\0';
+    Status = PtFinishTimedTest(Result);
+    if ((Status != 0) && (Result->Status == 0)) {
+        Result->Status = errno;
+    }
+
+MainEnd:
+    PathWalkCleanup(Path, DirectoryCount, FileCount);
+    Result->Data.Iterations = Iterations;
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+void
+PathWalkCleanup (
+    char *Path,
+    int DirectoryCount,
+    int FileCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes the files and directories created by the path walk
+    test.
+
+Arguments:
+
+    Path - Supplies a pointer to the path of the deepest directory created.
+        This buffer is modified.
+
+    DirectoryCount - Supplies the number of nested directories created.
+
+    FileCount - Supplies the number of files created in the deepest directory.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    int FileIndex;
+    size_t PathLength;
+    char *Slash;
+
+    PathLength = strlen(Path);
+    for (FileIndex = 0; FileIndex < FileCount; FileIndex += 1) {
+        snprintf(Path + PathLength,
+                 PT_PATH_WALK_PATH_LENGTH - PathLength,
+                 "/file%d",
+                 FileIndex);
+
+        remove(Path);
+    }
+
+    Path[PathLength] = '\0';
+    while (DirectoryCount > 0) {
+        rmdir(Path);
+        Slash = strrchr(Path, '/');
+        if (Slash != NULL) {
+            *Slash = '\0';
+        }
+
+        DirectoryCount -= 1;
+    }
+
+    return;
+}
+
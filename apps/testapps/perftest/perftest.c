@@ -413,6 +413,62 @@ PT_TEST_INFORMATION PerformanceTests[PtTestTypeCount] = {
      PtTestSignalRestart,
      PtResultIterations,
      SIGNAL_RESTART_DEFAULT_DURATION},
+
+    {PATH_WALK_TEST_NAME,
+     PATH_WALK_TEST_DESCRIPTION,
+     PathWalkMain,
+     PtTestPathWalk,
+     PtResultIterations,
+     PATH_WALK_TEST_DEFAULT_DURATION},
+
+    {MEMORY_ACCESS_TEST_NAME,
+     MEMORY_ACCESS_TEST_DESCRIPTION,
+     MemoryAccessMain,
+     PtTestMemoryAccess,
+     PtResultIterations,
+     MEMORY_ACCESS_TEST_DEFAULT_DURATION},
+
+    {FORK_LARGE_TEST_NAME,
+     FORK_LARGE_TEST_DESCRIPTION,
+     ForkMain,
+     PtTestForkLarge,
+     PtResultIterations,
+     FORK_LARGE_TEST_DEFAULT_DURATION},
+
+    {FORK_EXEC_LARGE_TEST_NAME,
+     FORK_EXEC_LARGE_TEST_DESCRIPTION,
+     ForkMain,
+     PtTestForkExecLarge,
+     PtResultIterations,
+     FORK_EXEC_LARGE_TEST_DEFAULT_DURATION},
+
+    {PIPE_IO_LARGE_TEST_NAME,
+     PIPE_IO_LARGE_TEST_DESCRIPTION,
+     PipeIoMain,
+     PtTestPipeIoLarge,
+     PtResultIterations,
+     PIPE_IO_LARGE_TEST_DEFAULT_DURATION},
+
+    {PIPE_SPLICE_TEST_NAME,
+     PIPE_SPLICE_TEST_DESCRIPTION,
+     PipeIoMain,
+     PtTestPipeSplice,
+     PtResultIterations,
+     PIPE_SPLICE_TEST_DEFAULT_DURATION},
+
+    {PRINTF_TEST_NAME,
+     PRINTF_TEST_DESCRIPTION,
+     PrintfMain,
+     PtTestPrintf,
+     PtResultBytes,
+     PRINTF_TEST_DEFAULT_DURATION},
+
+    {SNPRINTF_TEST_NAME,
+     SNPRINTF_TEST_DESCRIPTION,
+     PrintfMain,
+     PtTestSnprintf,
+     PtResultBytes,
+     SNPRINTF_TEST_DEFAULT_DURATION},
 };
 
 //
@@ -498,6 +554,16 @@ Return Value:
         return ExecLoop(ArgumentCount, Arguments);
     }
 
+    //
+    // The child of the fork and exec test just exits.
+    //
+
+    if ((ArgumentCount == FORK_EXEC_CHILD_ARGUMENT_COUNT) &&
+        (strcasecmp(Arguments[1], FORK_EXEC_LARGE_TEST_NAME) == 0)) {
+
+        return 0;
+    }
+
     Duration = 0;
     Failures = 0;
     ProcessCount = PT_DEFAULT_PROCESS_COUNT;
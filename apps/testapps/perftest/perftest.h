@@ -145,6 +145,38 @@ Module Name:
 #define SIGNAL_RESTART_DESCRIPTION \
     "Benchmarks how many system call restarts can be made."
 
+#define PATH_WALK_TEST_NAME "path_walk"
+#define PATH_WALK_TEST_DESCRIPTION \
+    "Benchmarks stat() through a deep path into a wide directory."
+
+#define MEMORY_ACCESS_TEST_NAME "mem_access"
+#define MEMORY_ACCESS_TEST_DESCRIPTION \
+    "Benchmarks random reads across a large anonymous mapping."
+
+#define FORK_LARGE_TEST_NAME "fork_large"
+#define FORK_LARGE_TEST_DESCRIPTION \
+    "Benchmarks fork() from a process with a large resident set."
+
+#define FORK_EXEC_LARGE_TEST_NAME "fork_exec_large"
+#define FORK_EXEC_LARGE_TEST_DESCRIPTION \
+    "Benchmarks fork() and exec() from a process with a large resident set."
+
+#define PIPE_IO_LARGE_TEST_NAME "pipe_io_large"
+#define PIPE_IO_LARGE_TEST_DESCRIPTION \
+    "Benchmarks 64KB pipe I/O through an enlarged pipe."
+
+#define PIPE_SPLICE_TEST_NAME "pipe_vmsplice"
+#define PIPE_SPLICE_TEST_DESCRIPTION \
+    "Benchmarks vmsplice() of 64KB page aligned buffers into a pipe."
+
+#define PRINTF_TEST_NAME "printf"
+#define PRINTF_TEST_DESCRIPTION \
+    "Benchmarks fprintf() throughput to a fully buffered stream."
+
+#define SNPRINTF_TEST_NAME "snprintf"
+#define SNPRINTF_TEST_DESCRIPTION \
+    "Benchmarks snprintf() throughput into a string buffer."
+
 //
 // Default test durations, in seconds.
 //
@@ -180,6 +212,14 @@ Module Name:
 #define SIGNAL_IGNORED_DEFAULT_DURATION 30
 #define SIGNAL_HANDLED_DEFAULT_DURATION 30
 #define SIGNAL_RESTART_DEFAULT_DURATION 30
+#define PATH_WALK_TEST_DEFAULT_DURATION 30
+#define MEMORY_ACCESS_TEST_DEFAULT_DURATION 30
+#define FORK_LARGE_TEST_DEFAULT_DURATION 30
+#define FORK_EXEC_LARGE_TEST_DEFAULT_DURATION 30
+#define PIPE_IO_LARGE_TEST_DEFAULT_DURATION 30
+#define PIPE_SPLICE_TEST_DEFAULT_DURATION 30
+#define PRINTF_TEST_DEFAULT_DURATION 30
+#define SNPRINTF_TEST_DEFAULT_DURATION 30
 
 //
 // Define the number of variables supplied to an iteration of the execute test
@@ -188,6 +228,13 @@ Module Name:
 
 #define EXEC_LOOP_ARGUMENT_COUNT 5
 
+//
+// Define the number of arguments supplied to the child of the fork and exec
+// test, which exits immediately.
+//
+
+#define FORK_EXEC_CHILD_ARGUMENT_COUNT 2
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -225,6 +272,14 @@ typedef enum _PT_TEST_TYPE {
     PtTestSignalIgnored,
     PtTestSignalHandled,
     PtTestSignalRestart,
+    PtTestPathWalk,
+    PtTestMemoryAccess,
+    PtTestForkLarge,
+    PtTestForkExecLarge,
+    PtTestPipeIoLarge,
+    PtTestPipeSplice,
+    PtTestPrintf,
+    PtTestSnprintf,
     PtTestTypeCount
 } PT_TEST_TYPE, *PPT_TEST_TYPE;
 
@@ -731,7 +786,7 @@ PipeIoMain (
 
 Routine Description:
 
-    This routine performs the pipe I/O performance benchmark test.
+    This routine performs the pipe I/O performance benchmark tests.
 
 Arguments:
 
@@ -1021,3 +1076,78 @@ Return Value:
 
 --*/
 
+void
+PathWalkMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    );
+
+/*++
+
+Routine Description:
+
+    This routine performs the path walk performance benchmark test.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+void
+MemoryAccessMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    );
+
+/*++
+
+Routine Description:
+
+    This routine performs the memory access performance benchmark test.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+void
+PrintfMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    );
+
+/*++
+
+Routine Description:
+
+    This routine performs the printf performance benchmark tests.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
@@ -31,7 +31,11 @@ Module Name:
 
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "perftest.h"
@@ -42,6 +46,14 @@ Module Name:
 
 #define PT_PIPE_IO_BUFFER_SIZE 4096
 
+//
+// Define the chunk size and pipe capacity used by the large and splice
+// variants.
+//
+
+#define PT_PIPE_IO_LARGE_BUFFER_SIZE (64 * 1024)
+#define PT_PIPE_IO_LARGE_PIPE_SIZE (1024 * 1024)
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -68,7 +80,7 @@ PipeIoMain (
 
 Routine Description:
 
-    This routine performs the pipe I/O performance benchmark test.
+    This routine performs the pipe I/O performance benchmark tests.
 
 Arguments:
 
@@ -86,27 +98,57 @@ Return Value:
 {
 
     char *Buffer;
+    size_t BufferSize;
     ssize_t BytesCompleted;
     unsigned long long Iterations;
     int PipeCreated;
     int PipeDescriptors[2];
+    char *ReadBuffer;
     int Status;
+    struct iovec Vector;
 
+    Buffer = NULL;
     Iterations = 0;
     PipeCreated = 0;
     Result->Type = PtResultIterations;
     Result->Status = 0;
+    switch (Test->TestType) {
+    case PtTestPipeIo:
+        BufferSize = PT_PIPE_IO_BUFFER_SIZE;
+        break;
+
+    case PtTestPipeIoLarge:
+    case PtTestPipeSplice:
+        BufferSize = PT_PIPE_IO_LARGE_BUFFER_SIZE;
+        break;
+
+    default:
+        fprintf(stderr, "Unknown pipe test type %d\n", Test->TestType);
+        Result->Status = EINVAL;
+        goto MainEnd;
+    }
 
     //
-    // Allocate a scratch buffer to use for reads and writes.
+    // Allocate page aligned scratch buffers to use for writes and reads. The
+    // splice variant hands the write buffer's pages to the pipe, so reads
+    // need to land somewhere else.
     //
 
-    Buffer = malloc(PT_PIPE_IO_BUFFER_SIZE);
-    if (Buffer == NULL) {
-        Result->Status = ENOMEM;
+    Buffer = mmap(NULL,
+                  BufferSize * 2,
+                  PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS,
+                  -1,
+                  0);
+
+    if (Buffer == MAP_FAILED) {
+        Result->Status = errno;
+        Buffer = NULL;
         goto MainEnd;
     }
 
+    ReadBuffer = Buffer + BufferSize;
+
     //
     // Create the pipe.
     //
@@ -118,6 +160,16 @@ Return Value:
     }
 
     PipeCreated = 1;
+    if (Test->TestType != PtTestPipeIo) {
+        Status = fcntl(PipeDescriptors[1],
+                       F_SETPIPE_SZ,
+                       PT_PIPE_IO_LARGE_PIPE_SIZE);
+
+        if (Status < 0) {
+            Result->Status = errno;
+            goto MainEnd;
+        }
+    }
 
     //
     // Start the test. This snaps resource usage and starts the clock ticking.
@@ -136,13 +188,18 @@ Return Value:
 
     while (PtIsTimedTestRunning() != 0) {
         do {
-            BytesCompleted = write(PipeDescriptors[1],
-                                   Buffer,
-                                   PT_PIPE_IO_BUFFER_SIZE);
+            if (Test->TestType == PtTestPipeSplice) {
+                Vector.iov_base = Buffer;
+                Vector.iov_len = BufferSize;
+                BytesCompleted = vmsplice(PipeDescriptors[1], &Vector, 1, 0);
+
+            } else {
+                BytesCompleted = write(PipeDescriptors[1], Buffer, BufferSize);
+            }
 
         } while ((BytesCompleted < 0) && (errno == EINTR));
 
-        if (BytesCompleted != PT_PIPE_IO_BUFFER_SIZE) {
+        if (BytesCompleted != BufferSize) {
             if (errno == 0) {
                 errno = EIO;
             }
@@ -152,13 +209,11 @@ Return Value:
         }
 
         do {
-            BytesCompleted = read(PipeDescriptors[0],
-                                  Buffer,
-                                  PT_PIPE_IO_BUFFER_SIZE);
+            BytesCompleted = read(PipeDescriptors[0], ReadBuffer, BufferSize);
 
         } while ((BytesCompleted < 0) && (errno == EINTR));
 
-        if (BytesCompleted != PT_PIPE_IO_BUFFER_SIZE) {
+        if (BytesCompleted != BufferSize) {
             if (errno == 0) {
                 errno = EIO;
             }
@@ -182,7 +237,7 @@ Return Value:
     }
 
     if (Buffer != NULL) {
-        free(Buffer);
+        munmap(Buffer, BufferSize * 2);
     }
 
     Result->Data.Iterations = Iterations;
@@ -0,0 +1,226 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    printf.c
+
+Abstract:
+
+    This module implements the printf performance benchmark tests, which
+    measure formatted output throughput to a buffered stream and to a string.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    User
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "perftest.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the size of the string buffer formatted into by the snprintf test.
+//
+
+#define PT_PRINTF_BUFFER_SIZE 256
+
+#define PT_PRINTF_COMPONENT_COUNT \
+    (sizeof(PrintfComponents) / sizeof(PrintfComponents[0]))
+
+//
+// Define the format used for each line, which resembles a typical log line
+// with a mix of literal text, strings, padded fields, and integers.
+//
+
+#define PT_PRINTF_FORMAT \
+    "%s [%5d] %-12s: request %08x from %s took %llu us (%d/%d) %s\n"
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// Store the component names cycled through by each line printed.
+//
+
+char *PrintfComponents[] = {
+    "scheduler",
+    "io",
+    "net",
+    "memory manager",
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+void
+PrintfMain (
+    PPT_TEST_INFORMATION Test,
+    PPT_TEST_RESULT Result
+    )
+
+/*++
+
+Routine Description:
+
+    This routine performs the printf performance benchmark tests.
+
+Arguments:
+
+    Test - Supplies a pointer to the performance test being executed.
+
+    Result - Supplies a pointer to a performance test result structure that
+        receives the tests results.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    char Buffer[PT_PRINTF_BUFFER_SIZE];
+    char *Component;
+    unsigned long long Iterations;
+    FILE *Stream;
+    int Status;
+    unsigned long long TotalBytes;
+
+    Iterations = 0;
+    Stream = NULL;
+    TotalBytes = 0;
+    Result->Type = PtResultBytes;
+    Result->Status = 0;
+    switch (Test->TestType) {
+    case PtTestPrintf:
+
+        //
+        // Print to a fully buffered stream whose output goes nowhere, so that
+        // the formatting rather than the device dominates.
+        //
+
+        Stream = fopen("/dev/null", "w");
+        if (Stream == NULL) {
+            Result->Status = errno;
+            goto MainEnd;
+        }
+
+        Status = setvbuf(Stream, NULL, _IOFBF, BUFSIZ);
+        if (Status != 0) {
+            Result->Status = errno;
+            goto MainEnd;
+        }
+
+        break;
+
+    case PtTestSnprintf:
+        break;
+
+    default:
+        fprintf(stderr, "Unknown printf test type %d\n", Test->TestType);
+        Result->Status = EINVAL;
+        goto MainEnd;
+    }
+
+    //
+    // Start the test. This snaps resource usage and starts the clock ticking.
+    //
+
+    Status = PtStartTimedTest(Test->Duration);
+    if (Status != 0) {
+        Result->Status = errno;
+        goto MainEnd;
+    }
+
+    //
+    // Measure how many bytes of formatted output can be produced.
+    //
+
+    while (PtIsTimedTestRunning() != 0) {
+        Component = PrintfComponents[Iterations % PT_PRINTF_COMPONENT_COUNT];
+        if (Stream != NULL) {
+            Status = fprintf(Stream,
+                             PT_PRINTF_FORMAT,
+                             "2026-10-19 12:34:56",
+                             (int)(Iterations % 65536),
+                             Component,
+                             (unsigned int)Iterations,
+                             "192.168.0.1",
+                             Iterations * 7,
+                             (int)(Iterations % 100),
+                             100,
+                             "ok");
+
+        } else {
+            Status = snprintf(Buffer,
+                              sizeof(Buffer),
+                              PT_PRINTF_FORMAT,
+                              "2026-10-19 12:34:56",
+                              (int)(Iterations % 65536),
+                              Component,
+                              (unsigned int)Iterations,
+                              "192.168.0.1",
+                              Iterations * 7,
+                              (int)(Iterations % 100),
+                              100,
+                              "ok");
+        }
+
+        if (Status < 0) {
+            Result->Status = errno;
+            break;
+        }
+
+        TotalBytes += Status;
+        Iterations += 1;
+    }
+
+    Status = PtFinishTimedTest(Result);
+    if ((Status != 0) && (Result->Status == 0)) {
+        Result->Status = errno;
+    }
+
+MainEnd:
+    if (Stream != NULL) {
+        fclose(Stream);
+    }
+
+    Result->Data.Bytes = TotalBytes;
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
@@ -252,6 +252,15 @@ Return Value:
                  MmStatistics.PageSize) / _1MB;
 
     printf("Non-Paged Physical Memory: %I64dMB\n", Megabytes);
+    if (MmStatistics.LargePageSize != 0) {
+        printf("Large Pages (%lukB): %lu\n",
+               MmStatistics.LargePageSize / 1024,
+               MmStatistics.LargePages);
+
+        printf("    Promotions: %lu\n", MmStatistics.LargePagePromotions);
+        printf("    Splits: %lu\n", MmStatistics.LargePageSplits);
+    }
+
     printf("Non Paged Pool:\n");
     printf("    Size: %ld\n", MmStatistics.NonPagedPool.TotalHeapSize);
     printf("    Maximum Size: %ld\n", MmStatistics.NonPagedPool.MaxHeapSize);
@@ -303,6 +312,14 @@ Return Value:
     printf("Page Cache Size: %lldMB\n", Megabytes);
     Megabytes = (IoCache.DirtyPageCount * MmStatistics.PageSize) / _1MB;
     printf("Dirty Page Cache Size: %lldMB\n", Megabytes);
+    Megabytes = (IoCache.ActivePageCount * MmStatistics.PageSize) / _1MB;
+    printf("Active Page Cache Size: %lldMB\n", Megabytes);
+    Megabytes = (IoCache.InactivePageCount * MmStatistics.PageSize) / _1MB;
+    printf("Inactive Page Cache Size: %lldMB\n", Megabytes);
+    printf("Page Cache Promotions: %lu, Demotions: %lu\n",
+           IoCache.PromotionCount,
+           IoCache.DemotionCount);
+
     return ReturnValue;
 }
 
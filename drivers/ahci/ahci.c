@@ -31,6 +31,7 @@ Module Name:
 //
 
 #include <minoca/kernel/driver.h>
+#include <minoca/devinfo/block.h>
 #include <minoca/storage/ata.h>
 #include "ahci.h"
 
@@ -141,6 +142,7 @@ AhcipStartPort (
 //
 
 PDRIVER AhciDriver = NULL;
+UUID AhciBlockQueueStatisticsUuid = BLOCK_QUEUE_STATISTICS_UUID;
 
 DRIVER_FUNCTION_TABLE AhciDriverFunctionTable = {
     DRIVER_FUNCTION_TABLE_VERSION,
@@ -544,7 +546,7 @@ Return Value:
         }
 
         CompleteIrp = FALSE;
-        Status = AhcipEnqueueIrp(Device, Irp);
+        Status = IoQueueBlockIrp(Device->BlockQueue, Irp);
         if (!KSUCCESS(Status)) {
             IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
             CompleteIrp = TRUE;
@@ -747,6 +749,15 @@ Return Value:
             //
 
             AhcipProcessPortRemoval(Port, FALSE);
+            if (Port->BlockQueue != NULL) {
+                IoRegisterDeviceInformation(Irp->Device,
+                                            &AhciBlockQueueStatisticsUuid,
+                                            FALSE);
+
+                IoDestroyBlockQueue(Port->BlockQueue);
+                Port->BlockQueue = NULL;
+            }
+
             IoCompleteIrp(AhciDriver, Irp, STATUS_SUCCESS);
             break;
 
@@ -861,6 +872,10 @@ Return Value:
     //
 
     case IrpMinorSystemControlDeviceInformation:
+        if (Device->BlockQueue != NULL) {
+            IoHandleBlockQueueDeviceInformation(Device->BlockQueue, Irp);
+        }
+
         break;
 
     //
@@ -1278,6 +1293,7 @@ Return Value:
 
 {
 
+    BLOCK_QUEUE_PARAMETERS BlockQueueParameters;
     KSTATUS Status;
 
     Status = PmDeviceAddReference(Irp->Device);
@@ -1294,6 +1310,55 @@ Return Value:
         }
     }
 
+    //
+    // Put a block queue in front of the command slots so that reads and
+    // writes get merged and scheduled. Merge no further than one command can
+    // carry: the sector count limit of the addressing mode, and the PRDT.
+    //
+
+    if (Port->BlockQueue == NULL) {
+        RtlZeroMemory(&BlockQueueParameters, sizeof(BLOCK_QUEUE_PARAMETERS));
+        BlockQueueParameters.Version = BLOCK_QUEUE_PARAMETERS_VERSION;
+        BlockQueueParameters.Driver = AhciDriver;
+        BlockQueueParameters.Context = Port;
+        BlockQueueParameters.StartRequest = AhcipStartBlockRequest;
+        BlockQueueParameters.BlockSize = ATA_SECTOR_SIZE;
+        BlockQueueParameters.MaxTransferSize = ATA_MAX_LBA28_SECTOR_COUNT *
+                                               ATA_SECTOR_SIZE;
+
+        if ((Port->Flags & AHCI_PORT_LBA48) != 0) {
+            BlockQueueParameters.MaxTransferSize = ATA_MAX_LBA48_SECTOR_COUNT *
+                                                   ATA_SECTOR_SIZE;
+        }
+
+        BlockQueueParameters.MaxSegments = AHCI_PRDT_COUNT;
+        BlockQueueParameters.MaxDepth = 1;
+        if ((Port->Flags & AHCI_PORT_NATIVE_COMMAND_QUEUING) != 0) {
+            BlockQueueParameters.MaxDepth =
+                                    RtlCountSetBits32(Port->CommandMask);
+        }
+
+        Port->BlockQueue = IoCreateBlockQueue(&BlockQueueParameters);
+        if (Port->BlockQueue == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto StartPortEnd;
+        }
+
+        //
+        // Publish the block queue statistics.
+        //
+
+        Status = IoRegisterDeviceInformation(Irp->Device,
+                                             &AhciBlockQueueStatisticsUuid,
+                                             TRUE);
+
+        if (!KSUCCESS(Status)) {
+            IoDestroyBlockQueue(Port->BlockQueue);
+            Port->BlockQueue = NULL;
+            goto StartPortEnd;
+        }
+    }
+
 StartPortEnd:
     PmDeviceReleaseReference(Irp->Device);
     IoCompleteIrp(AhciDriver, Irp, Status);
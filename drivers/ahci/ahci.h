@@ -152,6 +152,13 @@ Module Name:
 
 #define AHCI_PORT_NATIVE_COMMAND_QUEUING 0x00000002
 
+//
+// This bit is set while the port's device is being torn down. No new block
+// requests are started once it is set.
+//
+
+#define AHCI_PORT_REMOVED 0x00000004
+
 //
 // Host capabilities register bits.
 //
@@ -966,13 +973,17 @@ Structure Description:
 
     IoSize - Supplies the current I/O size in flight.
 
-    Irp - Supplies a pointer to the IRP.
+    Irp - Supplies a pointer to the IRP, for cache flushes.
+
+    BlockRequest - Supplies a pointer to the block queue request, for reads
+        and writes.
 
 --*/
 
 typedef struct _AHCI_COMMAND_STATE {
     UINTN IoSize;
     PIRP Irp;
+    PBLOCK_REQUEST BlockRequest;
 } AHCI_COMMAND_STATE, *PAHCI_COMMAND_STATE;
 
 /*++
@@ -1038,7 +1049,11 @@ Structure Description:
 
     Table0Physical - Stores the physical address of the slot zero command table.
 
-    IrpQueue - Stores the queue of IRPs that have not yet been started.
+    IrpQueue - Stores the queue of synchronize IRPs that have not yet been
+        started.
+
+    BlockQueue - Stores a pointer to the block queue that merges and
+        schedules reads and writes before they reach the command slots.
 
 --*/
 
@@ -1062,6 +1077,7 @@ typedef struct _AHCI_PORT {
     KSPIN_LOCK DpcLock;
     ULONGLONG TotalSectors;
     LIST_ENTRY IrpQueue;
+    PBLOCK_QUEUE BlockQueue;
 } AHCI_PORT, *PAHCI_PORT;
 
 /*++
@@ -1259,13 +1275,15 @@ AhcipEnqueueIrp (
 
 Routine Description:
 
-    This routine begins I/O on a fresh IRP.
+    This routine begins a cache flush for a synchronize IRP, or queues it if
+    all the command slots are busy. Reads and writes go through the block
+    queue instead.
 
 Arguments:
 
     Port - Supplies a pointer to the port.
 
-    Irp - Supplies a pointer to the read/write IRP.
+    Irp - Supplies a pointer to the synchronize IRP.
 
 Return Value:
 
@@ -1275,6 +1293,36 @@ Return Value:
 
 --*/
 
+KSTATUS
+AhcipStartBlockRequest (
+    PVOID Context,
+    PBLOCK_REQUEST Request
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called by the block queue to hand a read or write request
+    to the port.
+
+Arguments:
+
+    Context - Supplies the context pointer given when the block queue was
+        created. In this case, this points to the port.
+
+    Request - Supplies a pointer to the request to start.
+
+Return Value:
+
+    STATUS_SUCCESS if the request was submitted.
+
+    STATUS_RESOURCE_IN_USE if all the command slots are busy.
+
+    STATUS_NO_SUCH_DEVICE if the device is gone.
+
+--*/
+
 VOID
 AhcipProcessPortRemoval (
     PAHCI_PORT Port,
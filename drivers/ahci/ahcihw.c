@@ -73,7 +73,7 @@ AhcipBeginNextIrp (
 VOID
 AhcipPerformDmaIo (
     PAHCI_PORT Port,
-    PIRP Irp,
+    PBLOCK_REQUEST Request,
     LONG HeaderIndex
     );
 
@@ -718,13 +718,15 @@ AhcipEnqueueIrp (
 
 Routine Description:
 
-    This routine begins I/O on a fresh IRP.
+    This routine begins a cache flush for a synchronize IRP, or queues it if
+    all the command slots are busy. Reads and writes go through the block
+    queue instead.
 
 Arguments:
 
     Port - Supplies a pointer to the port.
 
-    Irp - Supplies a pointer to the read/write IRP.
+    Irp - Supplies a pointer to the synchronize IRP.
 
 Return Value:
 
@@ -740,6 +742,9 @@ Return Value:
     RUNLEVEL OldRunLevel;
     KSTATUS Status;
 
+    ASSERT((Irp->MajorCode == IrpMajorSystemControl) &&
+           (Irp->MinorCode == IrpMinorSystemControlSynchronize));
+
     IoPendIrp(AhciDriver, Irp);
 
     //
@@ -773,32 +778,81 @@ Return Value:
         goto EnqueueIrpEnd;
     }
 
-    ASSERT(Port->CommandState[HeaderIndex].Irp == NULL);
+    ASSERT((Port->CommandState[HeaderIndex].Irp == NULL) &&
+           (Port->CommandState[HeaderIndex].BlockRequest == NULL));
 
     Port->CommandState[HeaderIndex].Irp = Irp;
-    if (Irp->MajorCode == IrpMajorIo) {
-        AhcipPerformDmaIo(Port, Irp, HeaderIndex);
+    AhcipExecuteCacheFlush(Port, HeaderIndex);
+    Status = STATUS_SUCCESS;
 
-    } else if (Irp->MajorCode == IrpMajorSystemControl) {
+EnqueueIrpEnd:
+    KeReleaseSpinLock(&(Port->DpcLock));
+    KeLowerRunLevel(OldRunLevel);
+    return Status;
+}
 
-        ASSERT(Irp->MinorCode == IrpMinorSystemControlSynchronize);
+KSTATUS
+AhcipStartBlockRequest (
+    PVOID Context,
+    PBLOCK_REQUEST Request
+    )
 
-        AhcipExecuteCacheFlush(Port, HeaderIndex);
+/*++
 
-    } else {
+Routine Description:
 
-        ASSERT(FALSE);
+    This routine is called by the block queue to hand a read or write request
+    to the port.
 
-        Status = STATUS_NOT_SUPPORTED;
-        AhcipFreeCommand(Port, HeaderIndex);
-        goto EnqueueIrpEnd;
+Arguments:
+
+    Context - Supplies the context pointer given when the block queue was
+        created. In this case, this points to the port.
+
+    Request - Supplies a pointer to the request to start.
+
+Return Value:
+
+    STATUS_SUCCESS if the request was submitted.
+
+    STATUS_RESOURCE_IN_USE if all the command slots are busy.
+
+    STATUS_NO_SUCH_DEVICE if the device is gone.
+
+--*/
+
+{
+
+    LONG HeaderIndex;
+    PAHCI_PORT Port;
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelDispatch);
+
+    Port = Context;
+    KeAcquireSpinLock(&(Port->DpcLock));
+    if ((Port->OsDevice == NULL) ||
+        ((Port->Flags & AHCI_PORT_REMOVED) != 0)) {
+
+        Status = STATUS_NO_SUCH_DEVICE;
+        goto StartBlockRequestEnd;
+    }
+
+    HeaderIndex = AhcipAllocateCommand(Port);
+    if (HeaderIndex < 0) {
+        Status = STATUS_RESOURCE_IN_USE;
+        goto StartBlockRequestEnd;
     }
 
+    ASSERT((Port->CommandState[HeaderIndex].Irp == NULL) &&
+           (Port->CommandState[HeaderIndex].BlockRequest == NULL));
+
+    Port->CommandState[HeaderIndex].BlockRequest = Request;
+    AhcipPerformDmaIo(Port, Request, HeaderIndex);
     Status = STATUS_SUCCESS;
 
-EnqueueIrpEnd:
+StartBlockRequestEnd:
     KeReleaseSpinLock(&(Port->DpcLock));
-    KeLowerRunLevel(OldRunLevel);
     return Status;
 }
 
@@ -833,6 +887,7 @@ Return Value:
 {
 
     ULONG Bit;
+    PBLOCK_REQUEST BlockRequest;
     PIRP Irp;
     RUNLEVEL OldRunLevel;
     ULONG Pending;
@@ -843,6 +898,8 @@ Return Value:
         AhcipStopPort(Port);
     }
 
+    Port->Flags |= AHCI_PORT_REMOVED;
+
     //
     // Clear out all pending commands.
     //
@@ -854,9 +911,17 @@ Return Value:
             continue;
         }
 
+        BlockRequest = Port->CommandState[Bit].BlockRequest;
         Irp = Port->CommandState[Bit].Irp;
+        Port->CommandState[Bit].BlockRequest = NULL;
         Port->CommandState[Bit].Irp = NULL;
-        IoCompleteIrp(AhciDriver, Irp, STATUS_NO_SUCH_DEVICE);
+        if (BlockRequest != NULL) {
+            IoCompleteBlockRequest(BlockRequest, STATUS_NO_SUCH_DEVICE);
+
+        } else if (Irp != NULL) {
+            IoCompleteIrp(AhciDriver, Irp, STATUS_NO_SUCH_DEVICE);
+        }
+
         Pending &= ~(1 << Bit);
         if (Pending == 0) {
             break;
@@ -873,6 +938,20 @@ Return Value:
         IoCompleteIrp(AhciDriver, Irp, STATUS_NO_SUCH_DEVICE);
     }
 
+    KeReleaseSpinLock(&(Port->DpcLock));
+
+    //
+    // Run the block queue dry. With the port marked removed, every request
+    // still waiting in it is failed rather than started. This has to happen
+    // before the OS device goes away, as the completions travel back up
+    // through the dispatch routine.
+    //
+
+    if (Port->BlockQueue != NULL) {
+        IoRunBlockQueue(Port->BlockQueue);
+    }
+
+    KeAcquireSpinLock(&(Port->DpcLock));
     Port->OsDevice = NULL;
     Port->TotalSectors = 0;
     Port->Flags = 0;
@@ -909,6 +988,7 @@ Return Value:
 {
 
     LONG Bit;
+    PBLOCK_REQUEST BlockRequest;
     BOOL CommandInUse;
     BOOL CompleteIrp;
     ULONG Finished;
@@ -916,6 +996,7 @@ Return Value:
     UINTN IoSize;
     PIRP Irp;
     ULONG NewPending;
+    BOOL RunBlockQueue;
     KSTATUS Status;
     ULONG TaskFile;
 
@@ -980,6 +1061,7 @@ Return Value:
     }
 
     Port->PendingCommands = NewPending;
+    RunBlockQueue = FALSE;
 
     //
     // Loop over all the commands that have finished.
@@ -990,6 +1072,7 @@ Return Value:
             continue;
         }
 
+        BlockRequest = Port->CommandState[Bit].BlockRequest;
         Irp = Port->CommandState[Bit].Irp;
         IoSize = Port->CommandState[Bit].IoSize;
         Port->CommandState[Bit].IoSize = 0;
@@ -997,75 +1080,73 @@ Return Value:
         CompleteIrp = FALSE;
 
         //
-        // If there was no IRP, assume things are being handled manually. This
-        // happens during the IDENTIFY command.
+        // If there was no IRP or request, assume things are being handled
+        // manually. This happens during the IDENTIFY command.
         //
 
-        if (Irp == NULL) {
+        if ((Irp == NULL) && (BlockRequest == NULL)) {
             CommandInUse = TRUE;
 
-        } else if (KSUCCESS(Status)) {
+        } else if ((KSUCCESS(Status)) && (BlockRequest != NULL)) {
 
             ASSERT(Port->Commands[Bit].Size == IoSize);
 
-            if (Irp->MajorCode == IrpMajorIo) {
-                Irp->U.ReadWrite.IoBytesCompleted += IoSize;
-                Irp->U.ReadWrite.NewIoOffset += IoSize;
-            }
+            BlockRequest->IoBytesCompleted += IoSize;
 
             //
-            // If this isn't an I/O request, just complete it.
+            // If this is a synchronized write, then send a cache flush
+            // command along with it. Use the IoSize as a hint as to whether
+            // or not the cache flush part has already gone around.
             //
 
-            if (Irp->MajorCode == IrpMajorIo) {
-
-                //
-                // If this is a synchronized write, then send a cache flush
-                // command along with it. Use the IoSize as a hint as to
-                // whether or not the cache flush part has already gone around.
-                //
+            if ((BlockRequest->MinorCode == IrpMinorIoWrite) &&
+                ((BlockRequest->IoFlags & IO_FLAG_DATA_SYNCHRONIZED) != 0) &&
+                (BlockRequest->IoBytesCompleted >=
+                 BlockRequest->IoSizeInBytes) &&
+                (IoSize != 0)) {
 
-                if ((Irp->MinorCode == IrpMinorIoWrite) &&
-                    ((Irp->U.ReadWrite.IoFlags &
-                      IO_FLAG_DATA_SYNCHRONIZED) != 0) &&
-                    (Irp->U.ReadWrite.IoBytesCompleted >=
-                     Irp->U.ReadWrite.IoSizeInBytes) &&
-                    (IoSize != 0)) {
+                AhcipExecuteCacheFlush(Port, Bit);
+                CommandInUse = TRUE;
 
-                    AhcipExecuteCacheFlush(Port, Bit);
-                    CommandInUse = TRUE;
-
-                //
-                // If the IRP is not finished, queue up the next part. The
-                // command table will be in use then.
-                //
-
-                } else if (Irp->U.ReadWrite.IoBytesCompleted <
-                           Irp->U.ReadWrite.IoSizeInBytes) {
-
-                    AhcipPerformDmaIo(Port, Irp, Bit);
-                    CommandInUse = TRUE;
+            //
+            // If the request is not finished, queue up the next part. The
+            // command table will be in use then.
+            //
 
-                //
-                // The IRP completed all its I/O.
-                //
+            } else if (BlockRequest->IoBytesCompleted <
+                       BlockRequest->IoSizeInBytes) {
 
-                } else {
-                    CompleteIrp = TRUE;
-                }
+                AhcipPerformDmaIo(Port, BlockRequest, Bit);
+                CommandInUse = TRUE;
 
             //
-            // Non I/O IRPs like flush just complete.
+            // The request completed all its I/O.
             //
 
             } else {
                 CompleteIrp = TRUE;
             }
+
+        //
+        // Non I/O IRPs like flush just complete. So does anything that hit
+        // an error.
+        //
+
+        } else {
+            CompleteIrp = TRUE;
         }
 
         if (CompleteIrp != FALSE) {
-            Port->CommandState[Bit].Irp = NULL;
-            IoCompleteIrp(AhciDriver, Irp, Status);
+            if (BlockRequest != NULL) {
+                Port->CommandState[Bit].BlockRequest = NULL;
+                IoCompleteBlockRequest(BlockRequest, Status);
+
+            } else {
+                Port->CommandState[Bit].Irp = NULL;
+                IoCompleteIrp(AhciDriver, Irp, Status);
+            }
+
+            RunBlockQueue = TRUE;
         }
 
         //
@@ -1084,6 +1165,15 @@ Return Value:
     }
 
     KeReleaseSpinLock(&(Port->DpcLock));
+
+    //
+    // Feed the block queue into any command slots that just freed up.
+    //
+
+    if (RunBlockQueue != FALSE) {
+        IoRunBlockQueue(Port->BlockQueue);
+    }
+
     return;
 }
 
@@ -1240,8 +1330,8 @@ AhcipBeginNextIrp (
 
 Routine Description:
 
-    This routine begins processing for the next queued I/O IRP given a
-    command index and table already (reused from the previous command). If
+    This routine begins processing for the next queued synchronize IRP given
+    a command index and table already (reused from the previous command). If
     there is no work left to do, the command is freed. The port lock must be
     held.
 
@@ -1268,15 +1358,11 @@ Return Value:
         Irp = LIST_VALUE(Port->IrpQueue.Next, IRP, ListEntry);
         LIST_REMOVE(&(Irp->ListEntry));
         Port->CommandState[HeaderIndex].Irp = Irp;
-        if (Irp->MajorCode == IrpMajorIo) {
-            AhcipPerformDmaIo(Port, Irp, HeaderIndex);
-
-        } else if (Irp->MajorCode == IrpMajorSystemControl) {
 
-            ASSERT(Irp->MinorCode == IrpMinorSystemControlSynchronize);
+        ASSERT((Irp->MajorCode == IrpMajorSystemControl) &&
+               (Irp->MinorCode == IrpMinorSystemControlSynchronize));
 
-            AhcipExecuteCacheFlush(Port, HeaderIndex);
-        }
+        AhcipExecuteCacheFlush(Port, HeaderIndex);
 
     } else {
         Port->CommandState[HeaderIndex].Irp = NULL;
@@ -1289,7 +1375,7 @@ Return Value:
 VOID
 AhcipPerformDmaIo (
     PAHCI_PORT Port,
-    PIRP Irp,
+    PBLOCK_REQUEST Request,
     LONG HeaderIndex
     )
 
@@ -1297,13 +1383,14 @@ AhcipPerformDmaIo (
 
 Routine Description:
 
-    This routine fills out and executes a DMA I/O command.
+    This routine fills out and executes a DMA I/O command for the next piece
+    of a block queue request.
 
 Arguments:
 
     Port - Supplies a pointer to the port.
 
-    Irp - Supplies a pointer to the read/write IRP.
+    Request - Supplies a pointer to the block queue request.
 
     HeaderIndex - Supplies the header index to use. The header had better be
         pointing at the command table already.
@@ -1340,13 +1427,12 @@ Return Value:
     UINTN TransferSizeRemaining;
     BOOL Write;
 
-    IoBuffer = Irp->U.ReadWrite.IoBuffer;
-    BytesPreviouslyCompleted = Irp->U.ReadWrite.IoBytesCompleted;
-    BytesToComplete = Irp->U.ReadWrite.IoSizeInBytes;
-    IoOffset = Irp->U.ReadWrite.NewIoOffset;
+    IoBuffer = Request->IoBuffer;
+    BytesPreviouslyCompleted = Request->IoBytesCompleted;
+    BytesToComplete = Request->IoSizeInBytes;
+    IoOffset = Request->IoOffset + BytesPreviouslyCompleted;
 
     ASSERT(BytesPreviouslyCompleted < BytesToComplete);
-    ASSERT(IoOffset == (Irp->U.ReadWrite.IoOffset + BytesPreviouslyCompleted));
     ASSERT(IS_ALIGNED(IoOffset, ATA_SECTOR_SIZE) != FALSE);
     ASSERT(IS_ALIGNED(BytesToComplete, ATA_SECTOR_SIZE) != FALSE);
 
@@ -1364,14 +1450,10 @@ Return Value:
         TransferSize = MaxTransferSize;
     }
 
-    if (TransferSize == 0) {
-        AhcipFreeCommand(Port, HeaderIndex);
-        IoCompleteIrp(AhciDriver, Irp, STATUS_SUCCESS);
-        return;
-    }
+    ASSERT(TransferSize != 0);
 
     Write = FALSE;
-    if (Irp->MinorCode == IrpMinorIoWrite) {
+    if (Request->MinorCode == IrpMinorIoWrite) {
         Write = TRUE;
     }
 
@@ -30,6 +30,7 @@ Module Name:
 //
 
 #include <minoca/kernel/driver.h>
+#include <minoca/devinfo/block.h>
 #include <minoca/intrface/disk.h>
 #include <minoca/intrface/pci.h>
 #include <minoca/storage/ata.h>
@@ -81,7 +82,7 @@ Return Value:
 // ----------------------------------------------- Internal Function Prototypes
 //
 
-VOID
+BOOL
 AtapServiceInterruptForChannel (
     PATA_CHANNEL Channel,
     ULONG PendingBits
@@ -187,9 +188,15 @@ AtapIdentifyDevice (
     PATA_CHILD Device
     );
 
+KSTATUS
+AtapStartBlockRequest (
+    PVOID Context,
+    PBLOCK_REQUEST Request
+    );
+
 KSTATUS
 AtapPerformDmaIo (
-    PIRP Irp,
+    PBLOCK_REQUEST Request,
     PATA_CHILD Device,
     BOOL HaveDpcLock
     );
@@ -207,6 +214,22 @@ AtapSynchronizeDevice (
     PATA_CHILD Device
     );
 
+VOID
+AtapAcquireChannel (
+    PATA_CHILD Device
+    );
+
+VOID
+AtapReleaseChannel (
+    PATA_CHILD Device
+    );
+
+VOID
+AtapRunChannelQueues (
+    PATA_CONTROLLER Controller,
+    PATA_CHANNEL Channel
+    );
+
 KSTATUS
 AtapBlockRead (
     PVOID DiskToken,
@@ -305,6 +328,7 @@ AtapProcessPciConfigInterfaceChangeNotification (
 PDRIVER AtaDriver = NULL;
 UUID AtaPciConfigurationInterfaceUuid = UUID_PCI_CONFIG_ACCESS;
 UUID AtaDiskInterfaceUuid = UUID_DISK_INTERFACE;
+UUID AtaBlockQueueStatisticsUuid = BLOCK_QUEUE_STATISTICS_UUID;
 
 DISK_INTERFACE AtaDiskInterfaceTemplate = {
     DISK_INTERFACE_VERSION,
@@ -460,6 +484,12 @@ Return Value:
             goto AddDeviceEnd;
         }
 
+        Controller->Channel[Index].IdleEvent = KeCreateEvent(NULL);
+        if (Controller->Channel[Index].IdleEvent == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto AddDeviceEnd;
+        }
+
         Controller->Channel[Index].SelectedDevice = 0xFF;
         Controller->Channel[Index].Prdt = Prdt;
         Controller->Channel[Index].PrdtPhysicalAddress = PrdtPhysical;
@@ -495,6 +525,10 @@ Return Value:
                 if (Controller->Channel[Index].Lock != NULL) {
                     KeDestroyQueuedLock(Controller->Channel[Index].Lock);
                 }
+
+                if (Controller->Channel[Index].IdleEvent != NULL) {
+                    KeDestroyEvent(Controller->Channel[Index].IdleEvent);
+                }
             }
 
             if (Controller->PrdtIoBuffer != NULL) {
@@ -749,20 +783,12 @@ Return Value:
     }
 
     //
-    // If the IRP is on the way up, then clean up after the DMA as this IRP is
-    // still sitting in the channel. An IRP going up is already complete.
+    // If the IRP is on the way up, then clean up after the DMA. An IRP going
+    // up is already complete.
     //
 
     if (Irp->Direction == IrpUp) {
         CompleteIrp = FALSE;
-
-        ASSERT(Irp == Device->Channel->Irp);
-        ASSERT(Device == Device->Channel->OwningChild);
-        ASSERT(KeIsQueuedLockHeld(Device->Channel->Lock) != FALSE);
-
-        Device->Channel->OwningChild = NULL;
-        Device->Channel->Irp = NULL;
-        KeReleaseQueuedLock(Device->Channel->Lock);
         PmDeviceReleaseReference(Device->OsDevice);
         Status = IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
         if (!KSUCCESS(Status)) {
@@ -777,9 +803,9 @@ Return Value:
         Irp->U.ReadWrite.NewIoOffset = Irp->U.ReadWrite.IoOffset;
 
         //
-        // Before acquiring the channel's lock and starting the DMA, prepare
-        // the I/O context for ATA (i.e. it must use physical addresses that
-        // are less than 4GB and be sector size aligned).
+        // Before queuing the DMA, prepare the I/O context for ATA (i.e. it
+        // must use physical addresses that are less than 4GB and be sector
+        // size aligned).
         //
 
         Status = IoPrepareReadWriteIrp(&(Irp->U.ReadWrite),
@@ -793,19 +819,13 @@ Return Value:
         }
 
         //
-        // Fire off the DMA. If this succeeds, it will have pended the IRP.
-        // Return with the lock held.
+        // Hand the IRP to the block queue, which pends it and starts the DMA
+        // once the channel is free.
         //
 
-        KeAcquireQueuedLock(Device->Channel->Lock);
-        Device->Channel->Irp = Irp;
-        Device->Channel->OwningChild = Device;
         CompleteIrp = FALSE;
-        Status = AtapPerformDmaIo(Irp, Device, FALSE);
+        Status = IoQueueBlockIrp(Device->BlockQueue, Irp);
         if (!KSUCCESS(Status)) {
-            Device->Channel->OwningChild = NULL;
-            Device->Channel->Irp = NULL;
-            KeReleaseQueuedLock(Device->Channel->Lock);
             IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
             CompleteIrp = TRUE;
         }
@@ -973,6 +993,8 @@ Return Value:
 
     UCHAR BusMasterMask;
     PATA_CONTROLLER Device;
+    BOOL Idle[ATA_CABLE_COUNT];
+    ULONG Index;
     ULONG PendingBits;
 
     Device = (PATA_CONTROLLER)Context;
@@ -987,6 +1009,8 @@ Return Value:
     }
 
     KeAcquireSpinLock(&(Device->DpcLock));
+    Idle[0] = FALSE;
+    Idle[1] = FALSE;
 
     //
     // Handle the primary controller.
@@ -994,8 +1018,8 @@ Return Value:
 
     BusMasterMask = IDE_STATUS_ERROR | IDE_STATUS_INTERRUPT;
     if ((PendingBits & BusMasterMask) != 0) {
-        AtapServiceInterruptForChannel(&(Device->Channel[0]),
-                                       PendingBits & BusMasterMask);
+        Idle[0] = AtapServiceInterruptForChannel(&(Device->Channel[0]),
+                                                 PendingBits & BusMasterMask);
     }
 
     //
@@ -1004,11 +1028,22 @@ Return Value:
 
     PendingBits >>= 8;
     if ((PendingBits & BusMasterMask) != 0) {
-        AtapServiceInterruptForChannel(&(Device->Channel[1]),
-                                       PendingBits & BusMasterMask);
+        Idle[1] = AtapServiceInterruptForChannel(&(Device->Channel[1]),
+                                                 PendingBits & BusMasterMask);
     }
 
     KeReleaseSpinLock(&(Device->DpcLock));
+
+    //
+    // Start the next queued requests on any channel that just freed up.
+    //
+
+    for (Index = 0; Index < ATA_CABLE_COUNT; Index += 1) {
+        if (Idle[Index] != FALSE) {
+            AtapRunChannelQueues(Device, &(Device->Channel[Index]));
+        }
+    }
+
     return InterruptStatusClaimed;
 }
 
@@ -1016,7 +1051,7 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
-VOID
+BOOL
 AtapServiceInterruptForChannel (
     PATA_CHANNEL Channel,
     ULONG PendingBits
@@ -1026,7 +1061,8 @@ AtapServiceInterruptForChannel (
 
 Routine Description:
 
-    This routine services an interrupt for a given ATA channel.
+    This routine services an interrupt for a given ATA channel. This routine
+    assumes the controller's DPC lock is held.
 
 Arguments:
 
@@ -1036,91 +1072,90 @@ Routine Description:
 
 Return Value:
 
-    None.
+    TRUE if the block request running on the channel finished, leaving the
+    channel free for the next one.
+
+    FALSE if the channel is still busy or had nothing running.
 
 --*/
 
 {
 
-    BOOL CompleteIrp;
+    BOOL CompleteRequest;
     UINTN IoSize;
-    PIRP Irp;
+    PBLOCK_REQUEST Request;
     KSTATUS Status;
     UCHAR StatusRegister;
 
-    Irp = Channel->Irp;
-    if ((Irp != NULL) && (PendingBits != 0) && (Channel->IoSize != 0)) {
-        IoSize = Channel->IoSize;
-        Channel->IoSize = 0;
-        Status = STATUS_SUCCESS;
-        CompleteIrp = FALSE;
-        StatusRegister = AtapReadRegister(Channel, AtaRegisterStatus);
-        if (((PendingBits & IDE_STATUS_ERROR) != 0) ||
-            ((StatusRegister & ATA_STATUS_ERROR_MASK) != 0)) {
-
-            RtlDebugPrint("ATA: I/O Error: Status 0x%x, BMStatus 0x%x.\n",
-                          StatusRegister,
-                          PendingBits);
-
-            Status = STATUS_DEVICE_IO_ERROR;
-            CompleteIrp = FALSE;
+    Request = Channel->BlockRequest;
+    if ((Request == NULL) || (PendingBits == 0) || (Channel->IoSize == 0)) {
+        return FALSE;
+    }
 
-        } else if ((PendingBits & IDE_STATUS_INTERRUPT) != 0) {
-            CompleteIrp = TRUE;
+    IoSize = Channel->IoSize;
+    Channel->IoSize = 0;
+    Status = STATUS_SUCCESS;
+    CompleteRequest = FALSE;
+    StatusRegister = AtapReadRegister(Channel, AtaRegisterStatus);
+    if (((PendingBits & IDE_STATUS_ERROR) != 0) ||
+        ((StatusRegister & ATA_STATUS_ERROR_MASK) != 0)) {
 
-            ASSERT(Irp->MajorCode == IrpMajorIo);
+        RtlDebugPrint("ATA: I/O Error: Status 0x%x, BMStatus 0x%x.\n",
+                      StatusRegister,
+                      PendingBits);
 
-            Irp->U.ReadWrite.IoBytesCompleted += IoSize;
-            Irp->U.ReadWrite.NewIoOffset += IoSize;
+        Status = STATUS_DEVICE_IO_ERROR;
+        CompleteRequest = TRUE;
 
-            ASSERT(Irp->U.ReadWrite.IoBytesCompleted <=
-                   Irp->U.ReadWrite.IoSizeInBytes);
+    } else if ((PendingBits & IDE_STATUS_INTERRUPT) != 0) {
+        CompleteRequest = TRUE;
+        Request->IoBytesCompleted += IoSize;
 
-            if (Irp->U.ReadWrite.IoBytesCompleted !=
-                Irp->U.ReadWrite.IoSizeInBytes) {
+        ASSERT(Request->IoBytesCompleted <= Request->IoSizeInBytes);
 
-                Status = AtapPerformDmaIo(Irp, Channel->OwningChild, TRUE);
-                if (KSUCCESS(Status)) {
-                    CompleteIrp = FALSE;
-                }
+        if (Request->IoBytesCompleted != Request->IoSizeInBytes) {
+            Status = AtapPerformDmaIo(Request, Channel->OwningChild, TRUE);
+            if (KSUCCESS(Status)) {
+                CompleteRequest = FALSE;
             }
         }
+    }
 
-        if (CompleteIrp != FALSE) {
-
-            //
-            // If this is a synchronized write, then send a cache flush
-            // command along with it.
-            //
+    if (CompleteRequest == FALSE) {
+        return FALSE;
+    }
 
-            if ((Status == STATUS_SUCCESS) &&
-                (Irp->MinorCode == IrpMinorIoWrite) &&
-                ((Irp->U.ReadWrite.IoFlags & IO_FLAG_DATA_SYNCHRONIZED) != 0)) {
+    //
+    // If this is a synchronized write, then send a cache flush command along
+    // with it.
+    //
 
-                Status = AtapExecuteCacheFlush(Channel->OwningChild, FALSE);
+    if ((Status == STATUS_SUCCESS) &&
+        (Request->MinorCode == IrpMinorIoWrite) &&
+        ((Request->IoFlags & IO_FLAG_DATA_SYNCHRONIZED) != 0)) {
 
-                ASSERT(KSUCCESS(Status));
-            }
+        Status = AtapExecuteCacheFlush(Channel->OwningChild, FALSE);
 
-            //
-            // If successful, the I/O should be completed fully.
-            //
+        ASSERT(KSUCCESS(Status));
+    }
 
-            ASSERT((!KSUCCESS(Status)) ||
-                   (Irp->U.ReadWrite.IoBytesCompleted ==
-                    Irp->U.ReadWrite.IoSizeInBytes));
+    //
+    // If successful, the I/O should be completed fully.
+    //
 
-            //
-            // Complete the IRP but do not release the lock as the channel is
-            // cleaned up by this driver after the IRP is reversed to the up
-            // direction. This allows it to perform said clean up at low level.
-            //
+    ASSERT((!KSUCCESS(Status)) ||
+           (Request->IoBytesCompleted == Request->IoSizeInBytes));
 
-            IoCompleteIrp(AtaDriver, Irp, Status);
-        }
-    }
+    //
+    // Free up the channel, letting anyone waiting to claim it in, and then
+    // complete the request.
+    //
 
-    return;
+    Channel->BlockRequest = NULL;
+    Channel->OwningChild = NULL;
+    KeSignalEvent(Channel->IdleEvent, SignalOptionSignalAll);
+    IoCompleteBlockRequest(Request, Status);
+    return TRUE;
 }
 
 VOID
@@ -1214,6 +1249,7 @@ Return Value:
 
 {
 
+    BLOCK_QUEUE_PARAMETERS BlockQueueParameters;
     KSTATUS Status;
 
     if (Irp->Direction == IrpDown) {
@@ -1248,6 +1284,59 @@ Return Value:
                 }
             }
 
+            //
+            // Put a block queue in front of the channel so that DMA reads and
+            // writes get merged and scheduled while the channel is busy.
+            // Merge no further than one command can carry: the sector count
+            // limit of the addressing mode, and the PRDT.
+            //
+
+            if ((KSUCCESS(Status)) &&
+                (Child->DmaSupported != FALSE) &&
+                (Child->BlockQueue == NULL)) {
+
+                RtlZeroMemory(&BlockQueueParameters,
+                              sizeof(BLOCK_QUEUE_PARAMETERS));
+
+                BlockQueueParameters.Version = BLOCK_QUEUE_PARAMETERS_VERSION;
+                BlockQueueParameters.Driver = AtaDriver;
+                BlockQueueParameters.Context = Child;
+                BlockQueueParameters.StartRequest = AtapStartBlockRequest;
+                BlockQueueParameters.BlockSize = ATA_SECTOR_SIZE;
+                BlockQueueParameters.MaxTransferSize =
+                                ATA_MAX_LBA28_SECTOR_COUNT * ATA_SECTOR_SIZE;
+
+                if (Child->Lba48Supported != FALSE) {
+                    BlockQueueParameters.MaxTransferSize =
+                                ATA_MAX_LBA48_SECTOR_COUNT * ATA_SECTOR_SIZE;
+                }
+
+                BlockQueueParameters.MaxSegments =
+                                        ATA_PRDT_DISK_SIZE / sizeof(ATA_PRDT);
+
+                BlockQueueParameters.MaxDepth = 1;
+                Child->BlockQueue = IoCreateBlockQueue(&BlockQueueParameters);
+                if (Child->BlockQueue == NULL) {
+                    Status = STATUS_INSUFFICIENT_RESOURCES;
+
+                } else {
+
+                    //
+                    // Publish the block queue statistics.
+                    //
+
+                    Status = IoRegisterDeviceInformation(
+                                                 Irp->Device,
+                                                 &AtaBlockQueueStatisticsUuid,
+                                                 TRUE);
+
+                    if (!KSUCCESS(Status)) {
+                        IoDestroyBlockQueue(Child->BlockQueue);
+                        Child->BlockQueue = NULL;
+                    }
+                }
+            }
+
             IoCompleteIrp(AtaDriver, Irp, Status);
             break;
 
@@ -1371,6 +1460,10 @@ Return Value:
     //
 
     case IrpMinorSystemControlDeviceInformation:
+        if (Device->BlockQueue != NULL) {
+            IoHandleBlockQueueDeviceInformation(Device->BlockQueue, Irp);
+        }
+
         break;
 
     //
@@ -2217,9 +2310,68 @@ Return Value:
     return Status;
 }
 
+KSTATUS
+AtapStartBlockRequest (
+    PVOID Context,
+    PBLOCK_REQUEST Request
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called by the block queue to hand a read or write request
+    to the device's channel.
+
+Arguments:
+
+    Context - Supplies the context pointer given when the block queue was
+        created. In this case, this points to the ATA child device.
+
+    Request - Supplies a pointer to the request to start.
+
+Return Value:
+
+    STATUS_SUCCESS if the DMA was started.
+
+    STATUS_RESOURCE_IN_USE if the channel is busy with other I/O.
+
+    Other error codes if the device could not be selected.
+
+--*/
+
+{
+
+    PATA_CHANNEL Channel;
+    PATA_CHILD Device;
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelDispatch);
+
+    Device = Context;
+    Channel = Device->Channel;
+    KeAcquireSpinLock(&(Device->Controller->DpcLock));
+    if ((Channel->BlockRequest != NULL) || (Channel->Claimed != FALSE)) {
+        Status = STATUS_RESOURCE_IN_USE;
+        goto StartBlockRequestEnd;
+    }
+
+    Channel->BlockRequest = Request;
+    Channel->OwningChild = Device;
+    Status = AtapPerformDmaIo(Request, Device, TRUE);
+    if (!KSUCCESS(Status)) {
+        Channel->BlockRequest = NULL;
+        Channel->OwningChild = NULL;
+    }
+
+StartBlockRequestEnd:
+    KeReleaseSpinLock(&(Device->Controller->DpcLock));
+    return Status;
+}
+
 KSTATUS
 AtapPerformDmaIo (
-    PIRP Irp,
+    PBLOCK_REQUEST Request,
     PATA_CHILD Device,
     BOOL HaveDpcLock
     )
@@ -2228,12 +2380,12 @@ AtapPerformDmaIo (
 
 Routine Description:
 
-    This routine starts a DMA-based I/O transfer. This routine assumes the
-    channel lock is already held.
+    This routine starts the next DMA-based I/O transfer of a block request.
+    This routine assumes the request already owns the channel.
 
 Arguments:
 
-    Irp - Supplies a pointer to the I/O request packet.
+    Request - Supplies a pointer to the block request.
 
     Device - Supplies a pointer to the ATA child device.
 
@@ -2274,23 +2426,22 @@ Return Value:
     UINTN TransferSizeRemaining;
     BOOL Write;
 
-    ASSERT(Device->Channel->Irp == Irp);
+    ASSERT(Device->Channel->BlockRequest == Request);
     ASSERT(Device->Channel->OwningChild == Device);
-    ASSERT(Irp->U.ReadWrite.IoBuffer != NULL);
+    ASSERT(Request->IoBuffer != NULL);
 
-    IoBuffer = Irp->U.ReadWrite.IoBuffer;
-    BytesPreviouslyCompleted = Irp->U.ReadWrite.IoBytesCompleted;
-    BytesToComplete = Irp->U.ReadWrite.IoSizeInBytes;
-    IoOffset = Irp->U.ReadWrite.NewIoOffset;
+    IoBuffer = Request->IoBuffer;
+    BytesPreviouslyCompleted = Request->IoBytesCompleted;
+    BytesToComplete = Request->IoSizeInBytes;
+    IoOffset = Request->IoOffset + BytesPreviouslyCompleted;
 
     ASSERT(BytesPreviouslyCompleted < BytesToComplete);
-    ASSERT(IoOffset == (Irp->U.ReadWrite.IoOffset + BytesPreviouslyCompleted));
     ASSERT(Device->Channel->BusMasterBase != (USHORT)-1);
     ASSERT(IS_ALIGNED(IoOffset, ATA_SECTOR_SIZE) != FALSE);
     ASSERT(IS_ALIGNED(BytesToComplete, ATA_SECTOR_SIZE) != FALSE);
 
     Write = FALSE;
-    if (Irp->MinorCode == IrpMinorIoWrite) {
+    if (Request->MinorCode == IrpMinorIoWrite) {
         Write = TRUE;
     }
 
@@ -2482,14 +2633,6 @@ Return Value:
         DmaCommand |= ATA_BUS_MASTER_COMMAND_DMA_READ;
     }
 
-    //
-    // If this is the first set of DMA for the IRP, pend it.
-    //
-
-    if (BytesPreviouslyCompleted == 0) {
-        IoPendIrp(AtaDriver, Irp);
-    }
-
     AtapWriteRegister(Device->Channel,
                       AtaRegisterBusMasterStatus,
                       IDE_STATUS_INTERRUPT | IDE_STATUS_ERROR);
@@ -2713,7 +2856,7 @@ Return Value:
     RUNLEVEL OldRunLevel;
     KSTATUS Status;
 
-    KeAcquireQueuedLock(Device->Channel->Lock);
+    AtapAcquireChannel(Device);
     OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
     KeAcquireSpinLock(&(Device->Controller->DpcLock));
     Status = AtapSelectDevice(Device, FALSE);
@@ -2723,10 +2866,146 @@ Return Value:
 
     KeReleaseSpinLock(&(Device->Controller->DpcLock));
     KeLowerRunLevel(OldRunLevel);
-    KeReleaseQueuedLock(Device->Channel->Lock);
+    AtapReleaseChannel(Device);
     return Status;
 }
 
+VOID
+AtapAcquireChannel (
+    PATA_CHILD Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine claims a device's channel for a polled command. It keeps new
+    DMA from starting and waits for any DMA already running on the channel to
+    finish. This routine must be called at low level.
+
+Arguments:
+
+    Device - Supplies a pointer to the device whose channel to claim.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PATA_CHANNEL Channel;
+    PATA_CONTROLLER Controller;
+    RUNLEVEL OldRunLevel;
+
+    Channel = Device->Channel;
+    Controller = Device->Controller;
+    KeAcquireQueuedLock(Channel->Lock);
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Controller->DpcLock));
+
+    ASSERT(Channel->Claimed == FALSE);
+
+    Channel->Claimed = TRUE;
+    while (Channel->BlockRequest != NULL) {
+        KeSignalEvent(Channel->IdleEvent, SignalOptionUnsignal);
+        KeReleaseSpinLock(&(Controller->DpcLock));
+        KeLowerRunLevel(OldRunLevel);
+        KeWaitForEvent(Channel->IdleEvent, FALSE, WAIT_TIME_INDEFINITE);
+        OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+        KeAcquireSpinLock(&(Controller->DpcLock));
+    }
+
+    KeReleaseSpinLock(&(Controller->DpcLock));
+    KeLowerRunLevel(OldRunLevel);
+    return;
+}
+
+VOID
+AtapReleaseChannel (
+    PATA_CHILD Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine releases a channel claimed for a polled command and gets
+    any DMA that queued up in the meantime moving.
+
+Arguments:
+
+    Device - Supplies a pointer to the device whose channel to release.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PATA_CHANNEL Channel;
+    PATA_CONTROLLER Controller;
+    RUNLEVEL OldRunLevel;
+
+    Channel = Device->Channel;
+    Controller = Device->Controller;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Controller->DpcLock));
+
+    ASSERT(Channel->Claimed != FALSE);
+
+    Channel->Claimed = FALSE;
+    KeReleaseSpinLock(&(Controller->DpcLock));
+    KeLowerRunLevel(OldRunLevel);
+    KeReleaseQueuedLock(Channel->Lock);
+    AtapRunChannelQueues(Controller, Channel);
+    return;
+}
+
+VOID
+AtapRunChannelQueues (
+    PATA_CONTROLLER Controller,
+    PATA_CHANNEL Channel
+    )
+
+/*++
+
+Routine Description:
+
+    This routine runs the block queues of both devices on a channel, since
+    either may have been held back while the channel was busy. This routine
+    must not be called with the DPC lock held.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Channel - Supplies a pointer to the channel that became free.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PATA_CHILD Child;
+    ULONG Index;
+
+    for (Index = 0; Index < ATA_CHILD_COUNT; Index += 1) {
+        Child = &(Controller->ChildContexts[Index]);
+        if ((Child->Channel == Channel) && (Child->BlockQueue != NULL)) {
+            IoRunBlockQueue(Child->BlockQueue);
+        }
+    }
+
+    return;
+}
+
 KSTATUS
 AtapBlockRead (
     PVOID DiskToken,
@@ -3032,7 +3311,7 @@ Return Value:
     QueryTimeCounter = ATA_GET_TIME_FUNCTION(CriticalMode);
     OldRunLevel = RunLevelCount;
     if (CriticalMode == FALSE) {
-        KeAcquireQueuedLock(Channel->Lock);
+        AtapAcquireChannel(Device);
         OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
         KeAcquireSpinLock(&(Device->Controller->DpcLock));
     }
@@ -3219,7 +3498,7 @@ Return Value:
     if (CriticalMode == FALSE) {
         KeReleaseSpinLock(&(Device->Controller->DpcLock));
         KeLowerRunLevel(OldRunLevel);
-        KeReleaseQueuedLock(Channel->Lock);
+        AtapReleaseChannel(Device);
     }
 
     return Status;
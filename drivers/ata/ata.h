@@ -276,13 +276,25 @@ Structure Description:
 
     SelectedDevice - Stores the currently selected device.
 
-    Lock - Stores a pointer to the lock used to synchronize this channel.
+    Lock - Stores a pointer to the lock used to synchronize polled commands
+        on this channel.
 
-    Irp - Stores a pointer to the I/O IRP actively running on the channel.
+    BlockRequest - Stores a pointer to the block request whose DMA is actively
+        running on the channel. This is protected by the controller's DPC
+        lock.
+
+    Claimed - Stores a boolean indicating whether the holder of the channel
+        lock has claimed the channel for a polled command. No new DMA is
+        started while the channel is claimed. This is protected by the
+        controller's DPC lock.
+
+    IdleEvent - Stores a pointer to an event signaled when the active DMA
+        finishes.
 
     IoSize - Stores the size of this I/O operation.
 
-    OwningChild - Stores a pointer to the child that has the channel locked.
+    OwningChild - Stores a pointer to the child whose DMA is running on the
+        channel.
 
     Prdt - Stores a pointer to the array of Physical Region Descriptor Table
         entries.
@@ -298,7 +310,9 @@ typedef struct _ATA_CHANNEL {
     UCHAR InterruptDisable;
     UCHAR SelectedDevice;
     PQUEUED_LOCK Lock;
-    PIRP Irp;
+    PBLOCK_REQUEST BlockRequest;
+    BOOL Claimed;
+    PKEVENT IdleEvent;
     UINTN IoSize;
     PATA_CHILD OwningChild;
     PATA_PRDT Prdt;
@@ -335,6 +349,9 @@ Structure Description:
 
     DiskInterface - Stores the disk interface.
 
+    BlockQueue - Stores a pointer to the block queue that merges and
+        schedules DMA reads and writes to the device.
+
 --*/
 
 struct _ATA_CHILD {
@@ -347,6 +364,7 @@ struct _ATA_CHILD {
     BOOL Lba48Supported;
     ULONGLONG TotalSectors;
     DISK_INTERFACE DiskInterface;
+    PBLOCK_QUEUE BlockQueue;
 };
 
 /*++
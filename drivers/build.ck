@@ -42,6 +42,7 @@ function build() {
         "drivers/input:input_drivers",
         "drivers/net:net_drivers",
         "drivers/null:null",
+        "drivers/nvme:nvme",
         "drivers/part:part",
         "drivers/pci:pci",
         "drivers/plat:platform_drivers",
@@ -51,7 +52,8 @@ function build() {
         "drivers/special:special",
         "drivers/term/ser16550:ser16550",
         "drivers/usb:usb_drivers",
-        "drivers/videocon:videocon"
+        "drivers/videocon:videocon",
+        "drivers/virtio:virtio_drivers"
     ];
 
     if ((arch == "armv7") || (arch == "armv6")) {
@@ -0,0 +1,49 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    NVMe
+
+Abstract:
+
+    This module implements the driver for NVMe storage controllers.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+from menv import driver;
+
+function build() {
+    var drv;
+    var entries;
+    var name = "nvme";
+    var sources;
+
+    sources = [
+        "nvme.c",
+        "nvmehw.c"
+    ];
+
+    drv = {
+        "label": name,
+        "inputs": sources,
+    };
+
+    entries = driver(drv);
+    return entries;
+}
+
@@ -0,0 +1,2259 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    nvme.c
+
+Abstract:
+
+    This module implements the NVM Express (NVMe) storage controller driver.
+    Each active namespace is exposed as a disk, and I/O is spread across a
+    submission and completion queue pair per processor, each with its own
+    MSI-X vector.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/driver.h>
+#include "nvme.h"
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro returns the command identifier for a slot.
+//
+
+#define NVME_SLOT_COMMAND_ID(_Queue, _Slot) \
+    ((USHORT)((_Slot) - (_Queue)->Slots))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+NvmeAddDevice (
+    PVOID Driver,
+    PCSTR DeviceId,
+    PCSTR ClassId,
+    PCSTR CompatibleIds,
+    PVOID DeviceToken
+    );
+
+VOID
+NvmeDispatchStateChange (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+NvmeDispatchOpen (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+NvmeDispatchClose (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+NvmeDispatchIo (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+NvmeDispatchSystemControl (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+NvmepDispatchControllerStateChange (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    );
+
+VOID
+NvmepDispatchDiskStateChange (
+    PIRP Irp,
+    PNVME_DISK Disk
+    );
+
+VOID
+NvmepDispatchDiskSystemControl (
+    PIRP Irp,
+    PNVME_DISK Disk
+    );
+
+KSTATUS
+NvmepProcessResourceRequirements (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    );
+
+KSTATUS
+NvmepStartController (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    );
+
+KSTATUS
+NvmepConnectInterrupts (
+    PNVME_CONTROLLER Controller
+    );
+
+VOID
+NvmepDisconnectInterrupts (
+    PNVME_CONTROLLER Controller
+    );
+
+VOID
+NvmepEnumerateChildren (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    );
+
+KSTATUS
+NvmepEnqueueIrp (
+    PNVME_CONTROLLER Controller,
+    PIRP Irp
+    );
+
+VOID
+NvmepBeginNextIrp (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot
+    );
+
+BOOL
+NvmepStartIrp (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PIRP Irp
+    );
+
+PNVME_DISK
+NvmepGetIrpDisk (
+    PNVME_CONTROLLER Controller,
+    PIRP Irp
+    );
+
+KSTATUS
+NvmepSubmitReadWrite (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PNVME_DISK Disk,
+    PIRP Irp
+    );
+
+VOID
+NvmepSubmitFlush (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PNVME_DISK Disk
+    );
+
+VOID
+NvmepSubmitDiscard (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PNVME_DISK Disk,
+    PIRP Irp
+    );
+
+KSTATUS
+NvmepConvertCompletionStatus (
+    USHORT CompletionStatus
+    );
+
+VOID
+NvmepProcessPciMsiInterfaceChangeNotification (
+    PVOID Context,
+    PDEVICE Device,
+    PVOID InterfaceBuffer,
+    ULONG InterfaceBufferSize,
+    BOOL Arrival
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+PDRIVER NvmeDriver = NULL;
+UUID NvmePciMsiInterfaceUuid = UUID_PCI_MESSAGE_SIGNALED_INTERRUPTS;
+
+DRIVER_FUNCTION_TABLE NvmeDriverFunctionTable = {
+    DRIVER_FUNCTION_TABLE_VERSION,
+    NULL,
+    NvmeAddDevice,
+    NULL,
+    NULL,
+    NvmeDispatchStateChange,
+    NvmeDispatchOpen,
+    NvmeDispatchClose,
+    NvmeDispatchIo,
+    NvmeDispatchSystemControl,
+    NULL
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+__USED
+KSTATUS
+DriverEntry (
+    PDRIVER Driver
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the entry point for the NVMe driver. It registers its
+    other dispatch functions, and performs driver-wide initialization.
+
+Arguments:
+
+    Driver - Supplies a pointer to the driver object.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    Failure code on error.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    NvmeDriver = Driver;
+    Status = IoRegisterDriverFunctions(Driver, &NvmeDriverFunctionTable);
+    return Status;
+}
+
+KSTATUS
+NvmeAddDevice (
+    PVOID Driver,
+    PCSTR DeviceId,
+    PCSTR ClassId,
+    PCSTR CompatibleIds,
+    PVOID DeviceToken
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a device is detected for which the NVMe
+    driver acts as the function driver. The driver will attach itself to the
+    stack.
+
+Arguments:
+
+    Driver - Supplies a pointer to the driver being called.
+
+    DeviceId - Supplies a pointer to a string with the device ID.
+
+    ClassId - Supplies a pointer to a string containing the device's class ID.
+
+    CompatibleIds - Supplies a pointer to a string containing device IDs
+        that would be compatible with this device.
+
+    DeviceToken - Supplies an opaque token that the driver can use to identify
+        the device in the system. This token should be used when attaching to
+        the stack.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    Failure code if the driver was unsuccessful in attaching itself.
+
+--*/
+
+{
+
+    PNVME_CONTROLLER Controller;
+    ULONG Index;
+    KSTATUS Status;
+
+    Controller = MmAllocateNonPagedPool(sizeof(NVME_CONTROLLER),
+                                        NVME_ALLOCATION_TAG);
+
+    if (Controller == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto AddDeviceEnd;
+    }
+
+    RtlZeroMemory(Controller, sizeof(NVME_CONTROLLER));
+    Controller->Type = NvmeContextController;
+    Controller->OsDevice = DeviceToken;
+    Controller->InterruptLine = INVALID_INTERRUPT_LINE;
+    for (Index = 0; Index < NVME_MAX_IO_QUEUES; Index += 1) {
+        Controller->InterruptVectors[Index] = INVALID_INTERRUPT_VECTOR;
+        Controller->InterruptHandles[Index] = INVALID_HANDLE;
+    }
+
+    Status = IoAttachDriverToDevice(Driver, DeviceToken, Controller);
+    if (!KSUCCESS(Status)) {
+        goto AddDeviceEnd;
+    }
+
+AddDeviceEnd:
+    if (!KSUCCESS(Status)) {
+        if (Controller != NULL) {
+            MmFreeNonPagedPool(Controller);
+        }
+    }
+
+    return Status;
+}
+
+VOID
+NvmeDispatchStateChange (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles State Change IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNVME_CONTROLLER Controller;
+
+    Controller = DeviceContext;
+    switch (Controller->Type) {
+    case NvmeContextController:
+        NvmepDispatchControllerStateChange(Irp, Controller);
+        break;
+
+    case NvmeContextDisk:
+        NvmepDispatchDiskStateChange(Irp, (PNVME_DISK)Controller);
+        break;
+
+    default:
+
+        ASSERT(FALSE);
+
+        IoCompleteIrp(NvmeDriver, Irp, STATUS_INVALID_CONFIGURATION);
+        break;
+    }
+
+    return;
+}
+
+VOID
+NvmeDispatchOpen (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles Open IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNVME_DISK Disk;
+
+    //
+    // Only the disks can be opened or closed.
+    //
+
+    Disk = (PNVME_DISK)DeviceContext;
+    if (Disk->Type != NvmeContextDisk) {
+        return;
+    }
+
+    Irp->U.Open.DeviceContext = Disk;
+    IoCompleteIrp(NvmeDriver, Irp, STATUS_SUCCESS);
+    return;
+}
+
+VOID
+NvmeDispatchClose (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles Close IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNVME_DISK Disk;
+
+    Disk = (PNVME_DISK)DeviceContext;
+    if (Disk->Type != NvmeContextDisk) {
+        return;
+    }
+
+    IoCompleteIrp(NvmeDriver, Irp, STATUS_SUCCESS);
+    return;
+}
+
+VOID
+NvmeDispatchIo (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles I/O IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    BOOL CompleteIrp;
+    PNVME_DISK Disk;
+    ULONG IrpReadWriteFlags;
+    BOOL PmReferenceAdded;
+    KSTATUS Status;
+
+    Disk = (PNVME_DISK)Irp->U.ReadWrite.DeviceContext;
+    if (Disk->Type != NvmeContextDisk) {
+        return;
+    }
+
+    CompleteIrp = TRUE;
+
+    //
+    // If this IRP is on the way down, always add a power management reference.
+    //
+
+    PmReferenceAdded = FALSE;
+    if (Irp->Direction == IrpDown) {
+        Status = PmDeviceAddReference(Disk->OsDevice);
+        if (!KSUCCESS(Status)) {
+            goto DispatchIoEnd;
+        }
+
+        PmReferenceAdded = TRUE;
+    }
+
+    IrpReadWriteFlags = IRP_READ_WRITE_FLAG_DMA;
+    if (Irp->MinorCode == IrpMinorIoWrite) {
+        IrpReadWriteFlags |= IRP_READ_WRITE_FLAG_WRITE;
+    }
+
+    //
+    // If the IRP is on the way up, then clean up after the DMA. An IRP going
+    // up is already complete.
+    //
+
+    if (Irp->Direction == IrpUp) {
+        CompleteIrp = FALSE;
+        PmDeviceReleaseReference(Disk->OsDevice);
+        Status = IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
+        if (!KSUCCESS(Status)) {
+            IoUpdateIrpStatus(Irp, Status);
+        }
+
+    } else {
+        Irp->U.ReadWrite.NewIoOffset = Irp->U.ReadWrite.IoOffset;
+        Status = IoPrepareReadWriteIrp(&(Irp->U.ReadWrite),
+                                       Disk->BlockSize,
+                                       0,
+                                       MAX_ULONGLONG,
+                                       IrpReadWriteFlags);
+
+        if (!KSUCCESS(Status)) {
+            goto DispatchIoEnd;
+        }
+
+        CompleteIrp = FALSE;
+        Status = NvmepEnqueueIrp(Disk->Controller, Irp);
+        if (!KSUCCESS(Status)) {
+            IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
+            CompleteIrp = TRUE;
+        }
+    }
+
+DispatchIoEnd:
+    if (CompleteIrp != FALSE) {
+        if (PmReferenceAdded != FALSE) {
+            PmDeviceReleaseReference(Disk->OsDevice);
+        }
+
+        IoCompleteIrp(NvmeDriver, Irp, Status);
+    }
+
+    return;
+}
+
+VOID
+NvmeDispatchSystemControl (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles System Control IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNVME_DISK Disk;
+
+    ASSERT(Irp->MajorCode == IrpMajorSystemControl);
+
+    Disk = (PNVME_DISK)DeviceContext;
+    if (Disk->Type == NvmeContextDisk) {
+        NvmepDispatchDiskSystemControl(Irp, Disk);
+    }
+
+    return;
+}
+
+VOID
+NvmepCompleteSlot (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    USHORT CompletionStatus
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles a command the controller has finished. It either
+    continues the IRP with the next piece, or completes it and moves on to the
+    next queued IRP. The queue lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Slot - Supplies a pointer to the finished slot.
+
+    CompletionStatus - Supplies the status field of the completion entry,
+        without the phase bit.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNVME_CONTROLLER Controller;
+    PSYSTEM_CONTROL_DISCARD Discard;
+    PNVME_DISK Disk;
+    PIRP Irp;
+    UINTN IoSize;
+    KSTATUS Status;
+
+    ASSERT(KeIsSpinLockHeld(&(Queue->Lock)) != FALSE);
+
+    Controller = Queue->Controller;
+    Irp = Slot->Irp;
+    IoSize = Slot->IoSize;
+    Slot->IoSize = 0;
+
+    ASSERT(Irp != NULL);
+
+    Status = NvmepConvertCompletionStatus(CompletionStatus);
+    if (KSUCCESS(Status)) {
+        Disk = NvmepGetIrpDisk(Controller, Irp);
+        if (Irp->MajorCode == IrpMajorIo) {
+            Irp->U.ReadWrite.IoBytesCompleted += IoSize;
+            Irp->U.ReadWrite.NewIoOffset += IoSize;
+
+            //
+            // If this is a synchronized write, then send a flush along with
+            // it. Use the I/O size as a hint as to whether or not the flush
+            // part has already gone around.
+            //
+
+            if ((Irp->MinorCode == IrpMinorIoWrite) &&
+                ((Irp->U.ReadWrite.IoFlags & IO_FLAG_DATA_SYNCHRONIZED) != 0) &&
+                (Irp->U.ReadWrite.IoBytesCompleted >=
+                 Irp->U.ReadWrite.IoSizeInBytes) &&
+                (IoSize != 0) &&
+                ((Controller->Flags & NVME_CONTROLLER_FLAG_WRITE_CACHE) != 0)) {
+
+                NvmepSubmitFlush(Queue, Slot, Disk);
+                return;
+
+            } else if (Irp->U.ReadWrite.IoBytesCompleted <
+                       Irp->U.ReadWrite.IoSizeInBytes) {
+
+                Status = NvmepSubmitReadWrite(Queue, Slot, Disk, Irp);
+                if (KSUCCESS(Status)) {
+                    return;
+                }
+            }
+
+        } else if (Irp->MinorCode == IrpMinorSystemControlDiscard) {
+            Discard = Irp->U.SystemControl.SystemContext;
+            Slot->DiscardCompleted += Slot->DiscardBlocks;
+            Slot->DiscardBlocks = 0;
+            if (Slot->DiscardCompleted < Discard->BlockCount) {
+                NvmepSubmitDiscard(Queue, Slot, Disk, Irp);
+                return;
+            }
+        }
+    }
+
+    Slot->Irp = NULL;
+    IoCompleteIrp(NvmeDriver, Irp, Status);
+    NvmepBeginNextIrp(Queue, Slot);
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+NvmepDispatchControllerStateChange (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles state change IRPs for an NVMe controller.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Controller - Supplies a pointer to the controller context.
+
+Return Value:
+
+    None. The routine completes the IRP if appropriate.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    if (Irp->Direction == IrpUp) {
+        if (!KSUCCESS(IoGetIrpStatus(Irp))) {
+            return;
+        }
+
+        switch (Irp->MinorCode) {
+        case IrpMinorQueryResources:
+            Status = NvmepProcessResourceRequirements(Irp, Controller);
+            if (!KSUCCESS(Status)) {
+                IoCompleteIrp(NvmeDriver, Irp, Status);
+            }
+
+            break;
+
+        case IrpMinorStartDevice:
+            Status = NvmepStartController(Irp, Controller);
+            if (!KSUCCESS(Status)) {
+                IoCompleteIrp(NvmeDriver, Irp, Status);
+            }
+
+            break;
+
+        case IrpMinorQueryChildren:
+            NvmepEnumerateChildren(Irp, Controller);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return;
+}
+
+VOID
+NvmepDispatchDiskStateChange (
+    PIRP Irp,
+    PNVME_DISK Disk
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles state change IRPs for an NVMe namespace disk.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Disk - Supplies a pointer to the disk.
+
+Return Value:
+
+    None. The routine completes the IRP if appropriate.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    if (Irp->Direction == IrpDown) {
+        switch (Irp->MinorCode) {
+        case IrpMinorStartDevice:
+
+            ASSERT(Disk->OsDevice == Irp->Device);
+
+            Status = PmInitialize(Irp->Device);
+            IoCompleteIrp(NvmeDriver, Irp, Status);
+            break;
+
+        case IrpMinorQueryResources:
+        case IrpMinorQueryChildren:
+        case IrpMinorIdle:
+        case IrpMinorSuspend:
+        case IrpMinorResume:
+        case IrpMinorRemoveDevice:
+            IoCompleteIrp(NvmeDriver, Irp, STATUS_SUCCESS);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return;
+}
+
+VOID
+NvmepDispatchDiskSystemControl (
+    PIRP Irp,
+    PNVME_DISK Disk
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles System Control IRPs for an NVMe namespace disk.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Disk - Supplies a pointer to the disk.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONGLONG BlockCount;
+    ULONG BlockSize;
+    PVOID Context;
+    PSYSTEM_CONTROL_DISCARD Discard;
+    PSYSTEM_CONTROL_FILE_OPERATION FileOperation;
+    PSYSTEM_CONTROL_LOOKUP Lookup;
+    PFILE_PROPERTIES Properties;
+    ULONGLONG PropertiesFileSize;
+    KSTATUS Status;
+
+    Context = Irp->U.SystemControl.SystemContext;
+    BlockSize = Disk->BlockSize;
+    BlockCount = Disk->BlockCount;
+    if (Irp->Direction == IrpUp) {
+
+        ASSERT((Irp->MinorCode == IrpMinorSystemControlSynchronize) ||
+               (Irp->MinorCode == IrpMinorSystemControlDiscard));
+
+        PmDeviceReleaseReference(Disk->OsDevice);
+        return;
+    }
+
+    switch (Irp->MinorCode) {
+    case IrpMinorSystemControlLookup:
+        Lookup = (PSYSTEM_CONTROL_LOOKUP)Context;
+        Status = STATUS_PATH_NOT_FOUND;
+        if (Lookup->Root != FALSE) {
+
+            //
+            // Enable opening of the root as a single file.
+            //
+
+            Properties = Lookup->Properties;
+            Properties->FileId = 0;
+            Properties->Type = IoObjectBlockDevice;
+            Properties->HardLinkCount = 1;
+            Properties->BlockSize = BlockSize;
+            Properties->BlockCount = BlockCount;
+            Properties->Size = BlockCount * BlockSize;
+            Status = STATUS_SUCCESS;
+        }
+
+        IoCompleteIrp(NvmeDriver, Irp, Status);
+        break;
+
+    //
+    // Writes to the disk's properties are not allowed. Fail if the data
+    // has changed.
+    //
+
+    case IrpMinorSystemControlWriteFileProperties:
+        FileOperation = (PSYSTEM_CONTROL_FILE_OPERATION)Context;
+        Properties = FileOperation->FileProperties;
+        PropertiesFileSize = Properties->Size;
+        if ((Properties->FileId != 0) ||
+            (Properties->Type != IoObjectBlockDevice) ||
+            (Properties->HardLinkCount != 1) ||
+            (Properties->BlockSize != BlockSize) ||
+            (Properties->BlockCount != BlockCount) ||
+            (PropertiesFileSize != (BlockCount * BlockSize))) {
+
+            Status = STATUS_NOT_SUPPORTED;
+
+        } else {
+            Status = STATUS_SUCCESS;
+        }
+
+        IoCompleteIrp(NvmeDriver, Irp, Status);
+        break;
+
+    case IrpMinorSystemControlTruncate:
+        IoCompleteIrp(NvmeDriver, Irp, STATUS_NOT_SUPPORTED);
+        break;
+
+    case IrpMinorSystemControlDeviceInformation:
+        break;
+
+    //
+    // Send a dataset management deallocate to the device for discards, if it
+    // supports them.
+    //
+
+    case IrpMinorSystemControlDiscard:
+        Discard = (PSYSTEM_CONTROL_DISCARD)Context;
+        if ((Disk->Controller->Flags &
+             NVME_CONTROLLER_FLAG_DATASET_MANAGEMENT) == 0) {
+
+            IoCompleteIrp(NvmeDriver, Irp, STATUS_NOT_SUPPORTED);
+            break;
+        }
+
+        if ((Discard->BlockAddress >= BlockCount) ||
+            (Discard->BlockCount > BlockCount - Discard->BlockAddress)) {
+
+            IoCompleteIrp(NvmeDriver, Irp, STATUS_OUT_OF_BOUNDS);
+            break;
+        }
+
+        if (Discard->BlockCount == 0) {
+            IoCompleteIrp(NvmeDriver, Irp, STATUS_SUCCESS);
+            break;
+        }
+
+        //
+        // Fall through to queue the request.
+        //
+
+    //
+    // Send a flush to the device upon getting a synchronize request.
+    //
+
+    case IrpMinorSystemControlSynchronize:
+        Status = PmDeviceAddReference(Disk->OsDevice);
+        if (!KSUCCESS(Status)) {
+            IoCompleteIrp(NvmeDriver, Irp, Status);
+            break;
+        }
+
+        Status = NvmepEnqueueIrp(Disk->Controller, Irp);
+        if (!KSUCCESS(Status)) {
+            PmDeviceReleaseReference(Disk->OsDevice);
+            IoCompleteIrp(NvmeDriver, Irp, Status);
+        }
+
+        break;
+
+    default:
+
+        ASSERT(FALSE);
+
+        break;
+    }
+
+    return;
+}
+
+KSTATUS
+NvmepProcessResourceRequirements (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine filters the resource requirements for an NVMe controller. It
+    asks for an MSI-X vector per processor if MSI-X is available, with a
+    fallback to a single legacy interrupt vector.
+
+Arguments:
+
+    Irp - Supplies a pointer to the query resources IRP.
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PRESOURCE_CONFIGURATION_LIST ConfigurationList;
+    ULONGLONG EdgeTriggered;
+    PRESOURCE_REQUIREMENT FirstVector;
+    ULONG Index;
+    ULONGLONG LineCharacteristics;
+    PCI_MSI_INFORMATION MsiInformation;
+    PINTERFACE_PCI_MSI MsiInterface;
+    PRESOURCE_REQUIREMENT NextRequirement;
+    PRESOURCE_REQUIREMENT Requirement;
+    PRESOURCE_REQUIREMENT_LIST RequirementList;
+    KSTATUS Status;
+    ULONGLONG VectorCharacteristics;
+    ULONG VectorCount;
+    PRESOURCE_REQUIREMENT VectorRequirement;
+    RESOURCE_REQUIREMENT VectorTemplate;
+
+    ASSERT((Irp->MajorCode == IrpMajorStateChange) &&
+           (Irp->MinorCode == IrpMinorQueryResources));
+
+    //
+    // Register for the PCI MSI interface. If it is ever going to show up, it
+    // is already there.
+    //
+
+    if ((Controller->Flags & NVME_CONTROLLER_FLAG_PCI_MSI_REGISTERED) == 0) {
+        Status = IoRegisterForInterfaceNotifications(
+                                 &NvmePciMsiInterfaceUuid,
+                                 NvmepProcessPciMsiInterfaceChangeNotification,
+                                 Irp->Device,
+                                 Controller,
+                                 TRUE);
+
+        if (!KSUCCESS(Status)) {
+            goto ProcessResourceRequirementsEnd;
+        }
+
+        Controller->Flags |= NVME_CONTROLLER_FLAG_PCI_MSI_REGISTERED;
+    }
+
+    RtlZeroMemory(&VectorTemplate, sizeof(RESOURCE_REQUIREMENT));
+    VectorTemplate.Type = ResourceTypeInterruptVector;
+    VectorTemplate.Minimum = 0;
+    VectorTemplate.Maximum = -1;
+    VectorTemplate.Length = 1;
+    ConfigurationList = Irp->U.QueryResources.ResourceRequirements;
+
+    //
+    // Ask for a vector per processor, clipped to the size of the device's
+    // MSI-X table.
+    //
+
+    VectorCount = 0;
+    if ((Controller->Flags & NVME_CONTROLLER_FLAG_PCI_MSI_AVAILABLE) != 0) {
+        VectorCount = KeGetActiveProcessorCount();
+        if (VectorCount > NVME_MAX_IO_QUEUES) {
+            VectorCount = NVME_MAX_IO_QUEUES;
+        }
+
+        MsiInterface = &(Controller->PciMsiInterface);
+        RtlZeroMemory(&MsiInformation, sizeof(PCI_MSI_INFORMATION));
+        MsiInformation.Version = PCI_MSI_INTERFACE_INFORMATION_VERSION;
+        MsiInformation.MsiType = PciMsiTypeExtended;
+        Status = MsiInterface->GetSetInformation(MsiInterface->DeviceToken,
+                                                 &MsiInformation,
+                                                 FALSE);
+
+        if ((!KSUCCESS(Status)) || (MsiInformation.MaxVectorCount == 0)) {
+            VectorCount = 0;
+
+        } else if (VectorCount > MsiInformation.MaxVectorCount) {
+            VectorCount = MsiInformation.MaxVectorCount;
+        }
+    }
+
+    //
+    // Without MSI-X, stick with a vector for each legacy line.
+    //
+
+    if (VectorCount == 0) {
+        Status = IoCreateAndAddInterruptVectorsForLines(ConfigurationList,
+                                                        &VectorTemplate);
+
+        goto ProcessResourceRequirementsEnd;
+    }
+
+    //
+    // Create the MSI-X vectors for every configuration. The first one gets
+    // alternatives for each legacy line, in case the MSI vectors cannot be
+    // satisfied.
+    //
+
+    RequirementList = IoGetNextResourceConfiguration(ConfigurationList, NULL);
+    while (RequirementList != NULL) {
+        FirstVector = NULL;
+        for (Index = 0; Index < VectorCount; Index += 1) {
+            VectorTemplate.Characteristics = INTERRUPT_VECTOR_EDGE_TRIGGERED;
+            VectorTemplate.OwningRequirement = NULL;
+            Status = IoCreateAndAddResourceRequirement(&VectorTemplate,
+                                                       RequirementList,
+                                                       &VectorRequirement);
+
+            if (!KSUCCESS(Status)) {
+                goto ProcessResourceRequirementsEnd;
+            }
+
+            if (FirstVector == NULL) {
+                FirstVector = VectorRequirement;
+            }
+        }
+
+        Requirement = IoGetNextResourceRequirement(RequirementList, NULL);
+        while (Requirement != NULL) {
+            NextRequirement = IoGetNextResourceRequirement(RequirementList,
+                                                           Requirement);
+
+            if (Requirement->Type != ResourceTypeInterruptLine) {
+                Requirement = NextRequirement;
+                continue;
+            }
+
+            VectorCharacteristics = 0;
+            LineCharacteristics = Requirement->Characteristics;
+            if ((LineCharacteristics & INTERRUPT_LINE_ACTIVE_LOW) != 0) {
+                VectorCharacteristics |= INTERRUPT_VECTOR_ACTIVE_LOW;
+            }
+
+            if ((LineCharacteristics & INTERRUPT_LINE_ACTIVE_HIGH) != 0) {
+                VectorCharacteristics |= INTERRUPT_VECTOR_ACTIVE_HIGH;
+            }
+
+            EdgeTriggered = LineCharacteristics & INTERRUPT_LINE_EDGE_TRIGGERED;
+            if (EdgeTriggered != 0) {
+                VectorCharacteristics |= INTERRUPT_VECTOR_EDGE_TRIGGERED;
+            }
+
+            VectorTemplate.Characteristics = VectorCharacteristics;
+            VectorTemplate.OwningRequirement = Requirement;
+            Status = IoCreateAndAddResourceRequirementAlternative(
+                                                            &VectorTemplate,
+                                                            FirstVector);
+
+            if (!KSUCCESS(Status)) {
+                goto ProcessResourceRequirementsEnd;
+            }
+
+            Requirement = NextRequirement;
+        }
+
+        RequirementList = IoGetNextResourceConfiguration(ConfigurationList,
+                                                         RequirementList);
+    }
+
+    Controller->Flags |= NVME_CONTROLLER_FLAG_MSI_X_REQUESTED;
+    Status = STATUS_SUCCESS;
+
+ProcessResourceRequirementsEnd:
+    return Status;
+}
+
+KSTATUS
+NvmepStartController (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts an NVMe controller: it maps the registers, brings up
+    the admin queue, identifies the namespaces, and creates the I/O queues.
+
+Arguments:
+
+    Irp - Supplies a pointer to the start IRP.
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PRESOURCE_ALLOCATION Allocation;
+    PRESOURCE_ALLOCATION_LIST AllocationList;
+    ULONG AlignmentOffset;
+    PRESOURCE_ALLOCATION ControllerBase;
+    PHYSICAL_ADDRESS EndAddress;
+    BOOL LegacyFound;
+    PRESOURCE_ALLOCATION LineAllocation;
+    ULONG MsiCount;
+    ULONGLONG MsiVectors[NVME_MAX_IO_QUEUES];
+    ULONG PageSize;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    ULONG QueueCount;
+    ULONG Size;
+    KSTATUS Status;
+    PVOID VirtualAddress;
+
+    Status = PmInitialize(Irp->Device);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // The queues survive across restarts.
+    //
+
+    if (Controller->IoQueues != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    Status = PmDeviceAddReference(Irp->Device);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // Loop through the allocated resources to get the register space and the
+    // interrupt vectors. A vector with an owning line is a legacy interrupt.
+    //
+
+    ControllerBase = NULL;
+    MsiCount = 0;
+    LegacyFound = FALSE;
+    AllocationList = Irp->U.StartDevice.ProcessorLocalResources;
+    Allocation = IoGetNextResourceAllocation(AllocationList, NULL);
+    while (Allocation != NULL) {
+        if (Allocation->Type == ResourceTypeInterruptVector) {
+            LineAllocation = Allocation->OwningAllocation;
+            if (LineAllocation == NULL) {
+                if (MsiCount < NVME_MAX_IO_QUEUES) {
+                    MsiVectors[MsiCount] = Allocation->Allocation;
+                    MsiCount += 1;
+                }
+
+            } else if (LegacyFound == FALSE) {
+
+                ASSERT(LineAllocation->Type == ResourceTypeInterruptLine);
+
+                LegacyFound = TRUE;
+                Controller->InterruptLine = LineAllocation->Allocation;
+                Controller->InterruptVectors[0] = Allocation->Allocation;
+            }
+
+        //
+        // The registers live in the first memory BAR.
+        //
+
+        } else if ((Allocation->Type == ResourceTypePhysicalAddressSpace) &&
+                   (ControllerBase == NULL)) {
+
+            ControllerBase = Allocation;
+        }
+
+        Allocation = IoGetNextResourceAllocation(AllocationList, Allocation);
+    }
+
+    //
+    // Prefer MSI-X if all the vectors came back without lines.
+    //
+
+    if (LegacyFound != FALSE) {
+        Controller->InterruptVectorCount = 1;
+        Controller->Flags &= ~NVME_CONTROLLER_FLAG_MSI_X_ENABLED;
+
+    } else if (MsiCount != 0) {
+
+        ASSERT((Controller->Flags & NVME_CONTROLLER_FLAG_MSI_X_REQUESTED) != 0);
+
+        Controller->InterruptLine = INVALID_INTERRUPT_LINE;
+        RtlCopyMemory(Controller->InterruptVectors,
+                      MsiVectors,
+                      MsiCount * sizeof(ULONGLONG));
+
+        Controller->InterruptVectorCount = MsiCount;
+        Controller->Flags |= NVME_CONTROLLER_FLAG_MSI_X_ENABLED;
+
+    } else {
+        ControllerBase = NULL;
+    }
+
+    if (ControllerBase == NULL) {
+        RtlDebugPrint("NVMe: Missing resources.\n");
+        Status = STATUS_INVALID_CONFIGURATION;
+        goto StartControllerEnd;
+    }
+
+    if (Controller->ControllerBase == NULL) {
+
+        //
+        // Page align the mapping request.
+        //
+
+        PageSize = MmPageSize();
+        PhysicalAddress = ControllerBase->Allocation;
+        EndAddress = PhysicalAddress + ControllerBase->Length;
+        PhysicalAddress = ALIGN_RANGE_DOWN(PhysicalAddress, PageSize);
+        AlignmentOffset = ControllerBase->Allocation - PhysicalAddress;
+        EndAddress = ALIGN_RANGE_UP(EndAddress, PageSize);
+        Size = (ULONG)(EndAddress - PhysicalAddress);
+        VirtualAddress = MmMapPhysicalAddress(PhysicalAddress,
+                                              Size,
+                                              TRUE,
+                                              FALSE,
+                                              TRUE);
+
+        if (VirtualAddress == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto StartControllerEnd;
+        }
+
+        Controller->ControllerBase = VirtualAddress + AlignmentOffset;
+        Controller->ControllerBaseSize = Size;
+    }
+
+    Status = NvmepResetController(Controller);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    //
+    // Use a queue pair per processor, as far as the vectors stretch. Legacy
+    // interrupts get a single queue pair.
+    //
+
+    QueueCount = Controller->InterruptVectorCount;
+    if (QueueCount > KeGetActiveProcessorCount()) {
+        QueueCount = KeGetActiveProcessorCount();
+    }
+
+    Status = NvmepAllocateIoQueues(Controller, QueueCount);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    Status = NvmepIdentifyNamespaces(Controller);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    Status = NvmepConnectInterrupts(Controller);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    Status = NvmepCreateIoQueues(Controller);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+StartControllerEnd:
+    if (!KSUCCESS(Status)) {
+        NvmepDisconnectInterrupts(Controller);
+        NvmepDisableController(Controller);
+    }
+
+    PmDeviceReleaseReference(Irp->Device);
+    return Status;
+}
+
+KSTATUS
+NvmepConnectInterrupts (
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine connects an interrupt for each I/O queue pair. With MSI-X,
+    each queue's vector is aimed at the processor that submits to it.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    IO_CONNECT_INTERRUPT_PARAMETERS Connect;
+    ULONG Index;
+    PCI_MSI_INFORMATION MsiInformation;
+    PINTERFACE_PCI_MSI MsiInterface;
+    PROCESSOR_SET ProcessorSet;
+    KSTATUS Status;
+
+    ASSERT(Controller->IoQueueCount <= Controller->InterruptVectorCount);
+
+    MsiInterface = &(Controller->PciMsiInterface);
+    for (Index = 0; Index < Controller->IoQueueCount; Index += 1) {
+        RtlZeroMemory(&Connect, sizeof(IO_CONNECT_INTERRUPT_PARAMETERS));
+        Connect.Version = IO_CONNECT_INTERRUPT_PARAMETERS_VERSION;
+        Connect.Device = Controller->OsDevice;
+        Connect.LineNumber = Controller->InterruptLine;
+        Connect.Vector = Controller->InterruptVectors[Index];
+        Connect.InterruptServiceRoutine = NvmeInterruptService;
+        if ((Controller->Flags & NVME_CONTROLLER_FLAG_MSI_X_ENABLED) != 0) {
+            Connect.InterruptServiceRoutine = NvmeMsixInterruptService;
+        }
+
+        Connect.DispatchServiceRoutine = NvmeInterruptServiceDpc;
+        Connect.Context = &(Controller->IoQueues[Index]);
+        Connect.Interrupt = &(Controller->InterruptHandles[Index]);
+        Status = IoConnectInterrupt(&Connect);
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        if ((Controller->Flags & NVME_CONTROLLER_FLAG_MSI_X_ENABLED) == 0) {
+            continue;
+        }
+
+        ProcessorSet.Target = ProcessorTargetSingleProcessor;
+        ProcessorSet.U.Number = Index;
+        Status = MsiInterface->SetVectors(MsiInterface->DeviceToken,
+                                          PciMsiTypeExtended,
+                                          Controller->InterruptVectors[Index],
+                                          Index,
+                                          1,
+                                          &ProcessorSet);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    if ((Controller->Flags & NVME_CONTROLLER_FLAG_MSI_X_ENABLED) == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    RtlZeroMemory(&MsiInformation, sizeof(PCI_MSI_INFORMATION));
+    MsiInformation.Version = PCI_MSI_INTERFACE_INFORMATION_VERSION;
+    MsiInformation.MsiType = PciMsiTypeExtended;
+    MsiInformation.Flags = PCI_MSI_INTERFACE_FLAG_ENABLED;
+    MsiInformation.VectorCount = Controller->InterruptVectorCount;
+    return MsiInterface->GetSetInformation(MsiInterface->DeviceToken,
+                                           &MsiInformation,
+                                           TRUE);
+}
+
+VOID
+NvmepDisconnectInterrupts (
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine disconnects any connected I/O queue interrupts.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+
+    for (Index = 0; Index < NVME_MAX_IO_QUEUES; Index += 1) {
+        if (Controller->InterruptHandles[Index] != INVALID_HANDLE) {
+            IoDisconnectInterrupt(Controller->InterruptHandles[Index]);
+            Controller->InterruptHandles[Index] = INVALID_HANDLE;
+        }
+    }
+
+    return;
+}
+
+VOID
+NvmepEnumerateChildren (
+    PIRP Irp,
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reports a disk child for each active namespace.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    None. The IRP is completed with the appropriate status.
+
+--*/
+
+{
+
+    PDEVICE Children[NVME_MAX_NAMESPACES];
+    PNVME_DISK Disk;
+    ULONG Index;
+    KSTATUS Status;
+
+    Status = STATUS_SUCCESS;
+    for (Index = 0; Index < Controller->DiskCount; Index += 1) {
+        Disk = &(Controller->Disks[Index]);
+        if (Disk->OsDevice == NULL) {
+            Status = IoCreateDevice(NvmeDriver,
+                                    Disk,
+                                    Irp->Device,
+                                    "Disk",
+                                    DISK_CLASS_ID,
+                                    NULL,
+                                    &(Disk->OsDevice));
+
+            if (!KSUCCESS(Status)) {
+                goto EnumerateChildrenEnd;
+            }
+        }
+
+        Children[Index] = Disk->OsDevice;
+    }
+
+    if (Controller->DiskCount != 0) {
+        Status = IoMergeChildArrays(Irp,
+                                    Children,
+                                    Controller->DiskCount,
+                                    NVME_ALLOCATION_TAG);
+    }
+
+EnumerateChildrenEnd:
+    IoCompleteIrp(NvmeDriver, Irp, Status);
+    return;
+}
+
+KSTATUS
+NvmepEnqueueIrp (
+    PNVME_CONTROLLER Controller,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine begins I/O on a fresh IRP using the current processor's
+    queue pair, or queues it if all of that queue's slots are busy.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Irp - Supplies a pointer to the read/write, synchronize, or discard IRP.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP was successfully started or even queued.
+
+    Error code on failure.
+
+--*/
+
+{
+
+    RUNLEVEL OldRunLevel;
+    PNVME_QUEUE Queue;
+    ULONG QueueIndex;
+    PNVME_SLOT Slot;
+
+    if (Controller->IoQueueCount == 0) {
+        return STATUS_NOT_READY;
+    }
+
+    IoPendIrp(NvmeDriver, Irp);
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    QueueIndex = KeGetCurrentProcessorNumber() % Controller->IoQueueCount;
+    Queue = &(Controller->IoQueues[QueueIndex]);
+    KeAcquireSpinLock(&(Queue->Lock));
+    if (Queue->FreeSlot == NVME_SLOT_NONE) {
+        INSERT_BEFORE(&(Irp->ListEntry), &(Queue->IrpQueue));
+
+    } else {
+        Slot = &(Queue->Slots[Queue->FreeSlot]);
+        Queue->FreeSlot = Slot->NextFree;
+        if (NvmepStartIrp(Queue, Slot, Irp) == FALSE) {
+            NvmepBeginNextIrp(Queue, Slot);
+        }
+
+        NvmepKickQueue(Queue);
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    KeLowerRunLevel(OldRunLevel);
+    return STATUS_SUCCESS;
+}
+
+VOID
+NvmepBeginNextIrp (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts the next queued IRP on the given slot, or frees the
+    slot if there is nothing queued. The queue lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Slot - Supplies a pointer to the idle slot.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PIRP Irp;
+
+    ASSERT(KeIsSpinLockHeld(&(Queue->Lock)) != FALSE);
+
+    while (!LIST_EMPTY(&(Queue->IrpQueue))) {
+        Irp = LIST_VALUE(Queue->IrpQueue.Next, IRP, ListEntry);
+        LIST_REMOVE(&(Irp->ListEntry));
+        if (NvmepStartIrp(Queue, Slot, Irp) != FALSE) {
+            return;
+        }
+    }
+
+    Slot->Irp = NULL;
+    Slot->NextFree = Queue->FreeSlot;
+    Queue->FreeSlot = NVME_SLOT_COMMAND_ID(Queue, Slot);
+    return;
+}
+
+BOOL
+NvmepStartIrp (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits the first command for an IRP on the given slot. If
+    the IRP cannot be started it is completed. The queue lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Slot - Supplies a pointer to the slot to use.
+
+    Irp - Supplies a pointer to the IRP to start.
+
+Return Value:
+
+    TRUE if the slot is now in use.
+
+    FALSE if the IRP was completed immediately and the slot is still free.
+
+--*/
+
+{
+
+    PNVME_CONTROLLER Controller;
+    PNVME_DISK Disk;
+    KSTATUS Status;
+
+    Controller = Queue->Controller;
+    Slot->Irp = Irp;
+    Disk = NvmepGetIrpDisk(Controller, Irp);
+    if (Irp->MajorCode == IrpMajorIo) {
+        Status = NvmepSubmitReadWrite(Queue, Slot, Disk, Irp);
+        if (!KSUCCESS(Status)) {
+            goto StartIrpEnd;
+        }
+
+    } else if (Irp->MinorCode == IrpMinorSystemControlDiscard) {
+        Slot->DiscardCompleted = 0;
+        NvmepSubmitDiscard(Queue, Slot, Disk, Irp);
+
+    } else {
+
+        ASSERT((Irp->MajorCode == IrpMajorSystemControl) &&
+               (Irp->MinorCode == IrpMinorSystemControlSynchronize));
+
+        //
+        // Controllers without a volatile write cache are always synchronized.
+        //
+
+        if ((Controller->Flags & NVME_CONTROLLER_FLAG_WRITE_CACHE) == 0) {
+            Status = STATUS_SUCCESS;
+            goto StartIrpEnd;
+        }
+
+        NvmepSubmitFlush(Queue, Slot, Disk);
+    }
+
+    return TRUE;
+
+StartIrpEnd:
+    Slot->Irp = NULL;
+    IoCompleteIrp(NvmeDriver, Irp, Status);
+    return FALSE;
+}
+
+PNVME_DISK
+NvmepGetIrpDisk (
+    PNVME_CONTROLLER Controller,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the namespace an IRP is destined for.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Irp - Supplies a pointer to the IRP.
+
+Return Value:
+
+    Returns a pointer to the disk.
+
+--*/
+
+{
+
+    ULONG Index;
+
+    if (Irp->MajorCode == IrpMajorIo) {
+        return Irp->U.ReadWrite.DeviceContext;
+    }
+
+    for (Index = 0; Index < Controller->DiskCount; Index += 1) {
+        if (Controller->Disks[Index].OsDevice == Irp->Device) {
+            return &(Controller->Disks[Index]);
+        }
+    }
+
+    ASSERT(FALSE);
+
+    return &(Controller->Disks[0]);
+}
+
+KSTATUS
+NvmepSubmitReadWrite (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PNVME_DISK Disk,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills out and submits the next piece of a read or write IRP.
+    As much of the remaining transfer as can be described by one PRP list is
+    sent. The transfer is cut short where the I/O buffer's fragments do not
+    line up on page boundaries, since every PRP entry after the first must be
+    page aligned.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Slot - Supplies a pointer to the slot to use.
+
+    Disk - Supplies a pointer to the target namespace.
+
+    Irp - Supplies a pointer to the read/write IRP.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONGLONG BlockAddress;
+    ULONG BlockCount;
+    UINTN BytesPreviouslyCompleted;
+    UINTN BytesToComplete;
+    NVME_COMMAND Command;
+    PNVME_CONTROLLER Controller;
+    UINTN EntrySize;
+    UINTN FirstSize;
+    PIO_BUFFER_FRAGMENT Fragment;
+    UINTN FragmentIndex;
+    UINTN FragmentOffset;
+    PIO_BUFFER IoBuffer;
+    UINTN IoBufferOffset;
+    ULONGLONG IoOffset;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    PHYSICAL_ADDRESS PreviousEnd;
+    ULONG PrpCount;
+    UINTN TransferSize;
+    UINTN TransferSizeRemaining;
+
+    Controller = Queue->Controller;
+    IoBuffer = Irp->U.ReadWrite.IoBuffer;
+    BytesPreviouslyCompleted = Irp->U.ReadWrite.IoBytesCompleted;
+    BytesToComplete = Irp->U.ReadWrite.IoSizeInBytes;
+    IoOffset = Irp->U.ReadWrite.NewIoOffset;
+
+    ASSERT(BytesPreviouslyCompleted < BytesToComplete);
+    ASSERT(IoOffset == (Irp->U.ReadWrite.IoOffset + BytesPreviouslyCompleted));
+    ASSERT(IS_ALIGNED(IoOffset, Disk->BlockSize) != FALSE);
+
+    TransferSize = BytesToComplete - BytesPreviouslyCompleted;
+    if (TransferSize > Controller->MaxTransferSize) {
+        TransferSize = Controller->MaxTransferSize;
+    }
+
+    //
+    // Get to the current spot in the I/O buffer.
+    //
+
+    IoBufferOffset = MmGetIoBufferCurrentOffset(IoBuffer);
+    IoBufferOffset += BytesPreviouslyCompleted;
+    FragmentIndex = 0;
+    FragmentOffset = 0;
+    while (IoBufferOffset != 0) {
+
+        ASSERT(FragmentIndex < IoBuffer->FragmentCount);
+
+        Fragment = &(IoBuffer->Fragment[FragmentIndex]);
+        if (IoBufferOffset < Fragment->Size) {
+            FragmentOffset = IoBufferOffset;
+            break;
+        }
+
+        IoBufferOffset -= Fragment->Size;
+        FragmentIndex += 1;
+    }
+
+    //
+    // Describe the buffer a page at a time. The first entry may start
+    // anywhere, but later ones must start on a page boundary, which also
+    // means the previous one must have run to the end of its page. Data that
+    // continues physically contiguous within a page needs no new entry.
+    //
+
+    Command.Prp1 = 0;
+    PreviousEnd = 0;
+    PrpCount = 0;
+    TransferSizeRemaining = TransferSize;
+    while (TransferSizeRemaining != 0) {
+
+        ASSERT(FragmentIndex < IoBuffer->FragmentCount);
+
+        Fragment = &(IoBuffer->Fragment[FragmentIndex]);
+        PhysicalAddress = Fragment->PhysicalAddress + FragmentOffset;
+        EntrySize = NVME_PAGE_SIZE - (PhysicalAddress & NVME_PAGE_MASK);
+        if (EntrySize > TransferSizeRemaining) {
+            EntrySize = TransferSizeRemaining;
+        }
+
+        if (EntrySize > (Fragment->Size - FragmentOffset)) {
+            EntrySize = Fragment->Size - FragmentOffset;
+        }
+
+        if (TransferSizeRemaining == TransferSize) {
+            Command.Prp1 = PhysicalAddress;
+
+        } else if (PhysicalAddress != PreviousEnd) {
+            if (((PhysicalAddress & NVME_PAGE_MASK) != 0) ||
+                ((PreviousEnd & NVME_PAGE_MASK) != 0) ||
+                (PrpCount == NVME_PRP_LIST_ENTRIES)) {
+
+                break;
+            }
+
+            Slot->PrpList[PrpCount] = PhysicalAddress;
+            PrpCount += 1;
+
+        } else if ((PhysicalAddress & NVME_PAGE_MASK) == 0) {
+            if (PrpCount == NVME_PRP_LIST_ENTRIES) {
+                break;
+            }
+
+            Slot->PrpList[PrpCount] = PhysicalAddress;
+            PrpCount += 1;
+        }
+
+        PreviousEnd = PhysicalAddress + EntrySize;
+        TransferSizeRemaining -= EntrySize;
+        FragmentOffset += EntrySize;
+        if (FragmentOffset >= Fragment->Size) {
+            FragmentIndex += 1;
+            FragmentOffset = 0;
+        }
+    }
+
+    //
+    // Fragments are block aligned, so any early stop should already be on a
+    // block boundary.
+    //
+
+    TransferSize -= TransferSizeRemaining;
+    TransferSize = ALIGN_RANGE_DOWN(TransferSize, Disk->BlockSize);
+    if (TransferSize == 0) {
+
+        ASSERT(FALSE);
+
+        return STATUS_INVALID_CONFIGURATION;
+    }
+
+    //
+    // The second PRP is the second page directly if the transfer touches at
+    // most two pages, or a pointer to the list otherwise.
+    //
+
+    FirstSize = NVME_PAGE_SIZE - (Command.Prp1 & NVME_PAGE_MASK);
+    Command.Prp2 = 0;
+    if (TransferSize > FirstSize) {
+        if (TransferSize - FirstSize <= NVME_PAGE_SIZE) {
+            Command.Prp2 = Slot->PrpList[0];
+
+        } else {
+            Command.Prp2 = Slot->PrpListPhysical;
+        }
+    }
+
+    BlockAddress = IoOffset >> Disk->BlockShift;
+    BlockCount = TransferSize >> Disk->BlockShift;
+    Command.Dword0 = NVME_COMMAND_DWORD0(NVME_COMMAND_READ,
+                                         NVME_SLOT_COMMAND_ID(Queue, Slot));
+
+    if (Irp->MinorCode == IrpMinorIoWrite) {
+        Command.Dword0 = NVME_COMMAND_DWORD0(
+                                           NVME_COMMAND_WRITE,
+                                           NVME_SLOT_COMMAND_ID(Queue, Slot));
+    }
+
+    Command.NamespaceId = Disk->NamespaceId;
+    Command.Reserved[0] = 0;
+    Command.Reserved[1] = 0;
+    Command.MetadataPointer = 0;
+    Command.Dword10 = (ULONG)BlockAddress;
+    Command.Dword11 = (ULONG)(BlockAddress >> 32);
+    Command.Dword12 = BlockCount - 1;
+    Command.Dword13 = 0;
+    Command.Dword14 = 0;
+    Command.Dword15 = 0;
+    Slot->IoSize = TransferSize;
+    NvmepSubmitCommand(Queue, &Command);
+    return STATUS_SUCCESS;
+}
+
+VOID
+NvmepSubmitFlush (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PNVME_DISK Disk
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits a flush command on the given slot.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Slot - Supplies a pointer to the slot to use.
+
+    Disk - Supplies a pointer to the namespace to flush.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    NVME_COMMAND Command;
+
+    RtlZeroMemory(&Command, sizeof(NVME_COMMAND));
+    Command.Dword0 = NVME_COMMAND_DWORD0(NVME_COMMAND_FLUSH,
+                                         NVME_SLOT_COMMAND_ID(Queue, Slot));
+
+    Command.NamespaceId = Disk->NamespaceId;
+    Slot->IoSize = 0;
+    NvmepSubmitCommand(Queue, &Command);
+    return;
+}
+
+VOID
+NvmepSubmitDiscard (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    PNVME_DISK Disk,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits a dataset management deallocate command covering as
+    much of the remaining discard request as fits in the slot's range buffer.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Slot - Supplies a pointer to the slot to use.
+
+    Disk - Supplies a pointer to the target namespace.
+
+    Irp - Supplies a pointer to the discard IRP.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONGLONG BlockAddress;
+    ULONGLONG BlockCount;
+    ULONGLONG Blocks;
+    NVME_COMMAND Command;
+    PSYSTEM_CONTROL_DISCARD Discard;
+    PNVME_DSM_RANGE Ranges;
+    ULONG RangeCount;
+
+    Discard = Irp->U.SystemControl.SystemContext;
+
+    ASSERT(Slot->DiscardCompleted < Discard->BlockCount);
+
+    BlockAddress = Discard->BlockAddress + Slot->DiscardCompleted;
+    BlockCount = Discard->BlockCount - Slot->DiscardCompleted;
+    Ranges = (PNVME_DSM_RANGE)(Slot->PrpList);
+    RangeCount = 0;
+    Slot->DiscardBlocks = 0;
+    while ((BlockCount != 0) && (RangeCount < NVME_DSM_MAX_RANGES)) {
+        Blocks = BlockCount;
+        if (Blocks > NVME_DSM_MAX_RANGE_BLOCKS) {
+            Blocks = NVME_DSM_MAX_RANGE_BLOCKS;
+        }
+
+        Ranges[RangeCount].Attributes = 0;
+        Ranges[RangeCount].BlockCount = (ULONG)Blocks;
+        Ranges[RangeCount].BlockAddress = BlockAddress;
+        RangeCount += 1;
+        BlockAddress += Blocks;
+        BlockCount -= Blocks;
+        Slot->DiscardBlocks += Blocks;
+    }
+
+    RtlZeroMemory(&Command, sizeof(NVME_COMMAND));
+    Command.Dword0 = NVME_COMMAND_DWORD0(NVME_COMMAND_DATASET_MANAGEMENT,
+                                         NVME_SLOT_COMMAND_ID(Queue, Slot));
+
+    Command.NamespaceId = Disk->NamespaceId;
+    Command.Prp1 = Slot->PrpListPhysical;
+    Command.Dword10 = RangeCount - 1;
+    Command.Dword11 = NVME_DSM_DEALLOCATE;
+    Slot->IoSize = 0;
+    NvmepSubmitCommand(Queue, &Command);
+    return;
+}
+
+KSTATUS
+NvmepConvertCompletionStatus (
+    USHORT CompletionStatus
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts an NVMe completion status into a status code.
+
+Arguments:
+
+    CompletionStatus - Supplies the status field of the completion entry,
+        without the phase bit.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Code;
+    ULONG Type;
+
+    if (CompletionStatus == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    Code = CompletionStatus & NVME_COMPLETION_STATUS_CODE_MASK;
+    Type = (CompletionStatus >> NVME_COMPLETION_STATUS_TYPE_SHIFT) &
+           NVME_COMPLETION_STATUS_TYPE_MASK;
+
+    if (Type == NVME_STATUS_TYPE_GENERIC) {
+        if (Code == NVME_STATUS_INVALID_OPCODE) {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        if (Code == NVME_STATUS_LBA_OUT_OF_RANGE) {
+            return STATUS_OUT_OF_BOUNDS;
+        }
+    }
+
+    RtlDebugPrint("NVMe: I/O error 0x%x\n", CompletionStatus);
+    return STATUS_DEVICE_IO_ERROR;
+}
+
+VOID
+NvmepProcessPciMsiInterfaceChangeNotification (
+    PVOID Context,
+    PDEVICE Device,
+    PVOID InterfaceBuffer,
+    ULONG InterfaceBufferSize,
+    BOOL Arrival
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a PCI MSI interface changes in availability.
+
+Arguments:
+
+    Context - Supplies the caller's context pointer, supplied when the caller
+        requested interface notifications.
+
+    Device - Supplies a pointer to the device exposing or deleting the
+        interface.
+
+    InterfaceBuffer - Supplies a pointer to the interface buffer of the
+        interface.
+
+    InterfaceBufferSize - Supplies the buffer size.
+
+    Arrival - Supplies TRUE if a new interface is arriving, or FALSE if an
+        interface is departing.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNVME_CONTROLLER Controller;
+
+    Controller = Context;
+    if (Arrival != FALSE) {
+        if (InterfaceBufferSize >= sizeof(INTERFACE_PCI_MSI)) {
+            RtlCopyMemory(&(Controller->PciMsiInterface),
+                          InterfaceBuffer,
+                          sizeof(INTERFACE_PCI_MSI));
+
+            Controller->Flags |= NVME_CONTROLLER_FLAG_PCI_MSI_AVAILABLE;
+        }
+
+    } else {
+        Controller->Flags &= ~NVME_CONTROLLER_FLAG_PCI_MSI_AVAILABLE;
+    }
+
+    return;
+}
+
@@ -0,0 +1,931 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    nvme.h
+
+Abstract:
+
+    This header contains definitions for the NVM Express (NVMe) storage
+    controller driver.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/intrface/pci.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// These macros read from and write to controller registers.
+//
+
+#define NVME_READ(_Controller, _Register) \
+    HlReadRegister32((PUCHAR)(_Controller)->ControllerBase + (_Register))
+
+#define NVME_WRITE(_Controller, _Register, _Value)                          \
+    HlWriteRegister32((PUCHAR)(_Controller)->ControllerBase + (_Register),  \
+                      (_Value))
+
+//
+// This macro returns the offset of a queue's submission tail doorbell
+// register.
+//
+
+#define NVME_SUBMISSION_DOORBELL(_Controller, _QueueId) \
+    (NvmeDoorbellBase + ((2 * (_QueueId)) * (_Controller)->DoorbellStride))
+
+//
+// This macro returns the offset of a queue's completion head doorbell
+// register.
+//
+
+#define NVME_COMPLETION_DOORBELL(_Controller, _QueueId)                \
+    (NvmeDoorbellBase +                                                \
+     (((2 * (_QueueId)) + 1) * (_Controller)->DoorbellStride))
+
+//
+// This macro builds the first dword of a command.
+//
+
+#define NVME_COMMAND_DWORD0(_Opcode, _CommandId) \
+    ((_Opcode) | ((ULONG)(_CommandId) << NVME_COMMAND_ID_SHIFT))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define NVME_ALLOCATION_TAG 0x656D764E // 'emvN'
+
+//
+// Define the page size the driver programs into the controller. PRP entries
+// are expressed in these units regardless of the system page size.
+//
+
+#define NVME_PAGE_SIZE 0x1000
+#define NVME_PAGE_MASK (NVME_PAGE_SIZE - 1)
+
+//
+// Define the size of each slot's PRP list. A list never crosses a page, so the
+// controller never mistakes its last entry for a chain pointer. The list
+// doubles as the dataset management range buffer.
+//
+
+#define NVME_PRP_LIST_SIZE 0x200
+#define NVME_PRP_LIST_ENTRIES (NVME_PRP_LIST_SIZE / sizeof(ULONGLONG))
+
+//
+// Define the largest transfer the driver will put in a single command, which
+// is limited by the size of the PRP list.
+//
+
+#define NVME_MAX_TRANSFER_SIZE (NVME_PRP_LIST_ENTRIES * NVME_PAGE_SIZE)
+
+//
+// Define the maximum number of I/O queue pairs the driver will use. Each pair
+// gets its own MSI-X vector, targeted at its own processor.
+//
+
+#define NVME_MAX_IO_QUEUES 16
+
+//
+// Define the admin and I/O queue sizes, clipped to the controller maximum.
+//
+
+#define NVME_ADMIN_QUEUE_SIZE 32
+#define NVME_IO_QUEUE_SIZE 256
+
+//
+// Define the maximum number of namespaces exposed as disks.
+//
+
+#define NVME_MAX_NAMESPACES 16
+
+//
+// Define the maximum number of ranges and blocks per range used in a single
+// dataset management command.
+//
+
+#define NVME_DSM_MAX_RANGES (NVME_PRP_LIST_SIZE / sizeof(NVME_DSM_RANGE))
+#define NVME_DSM_MAX_RANGE_BLOCKS 0x10000000
+
+//
+// Define how long to wait for an admin command, in milliseconds.
+//
+
+#define NVME_ADMIN_TIMEOUT_MS 5000
+
+//
+// Define the value that marks the end of the free slot list.
+//
+
+#define NVME_SLOT_NONE ((ULONG)-1)
+
+//
+// Define the admin queue identifier.
+//
+
+#define NVME_ADMIN_QUEUE_ID 0
+
+//
+// Define controller capability register bits.
+//
+
+#define NVME_CAPABILITY_MAX_ENTRIES_MASK 0x0000FFFF
+#define NVME_CAPABILITY_TIMEOUT_SHIFT 24
+#define NVME_CAPABILITY_TIMEOUT_MASK 0xFF
+#define NVME_CAPABILITY_HIGH_STRIDE_MASK 0x0000000F
+#define NVME_CAPABILITY_HIGH_NVM_COMMAND_SET 0x00000020
+#define NVME_CAPABILITY_HIGH_MIN_PAGE_SIZE_SHIFT 16
+#define NVME_CAPABILITY_HIGH_MIN_PAGE_SIZE_MASK 0xF
+
+//
+// Define the units of the capability timeout field, in milliseconds.
+//
+
+#define NVME_CAPABILITY_TIMEOUT_UNIT_MS 500
+
+//
+// Define controller configuration register bits.
+//
+
+#define NVME_CONFIGURATION_ENABLE 0x00000001
+#define NVME_CONFIGURATION_SUBMISSION_ENTRY_SIZE_SHIFT 16
+#define NVME_CONFIGURATION_COMPLETION_ENTRY_SIZE_SHIFT 20
+#define NVME_CONFIGURATION_SHUTDOWN_NORMAL 0x00004000
+
+//
+// Define the log2 of the submission and completion entry sizes.
+//
+
+#define NVME_SUBMISSION_ENTRY_SIZE_SHIFT 6
+#define NVME_COMPLETION_ENTRY_SIZE_SHIFT 4
+
+//
+// Define controller status register bits.
+//
+
+#define NVME_STATUS_READY 0x00000001
+#define NVME_STATUS_FATAL 0x00000002
+
+//
+// Define admin queue attribute register fields.
+//
+
+#define NVME_ADMIN_QUEUE_COMPLETION_SIZE_SHIFT 16
+
+//
+// Define the interrupt mask bit for the single legacy interrupt vector.
+//
+
+#define NVME_INTERRUPT_VECTOR_0 0x00000001
+
+//
+// Define the command dword 0 fields.
+//
+
+#define NVME_COMMAND_ID_SHIFT 16
+
+//
+// Define the completion status field bits.
+//
+
+#define NVME_COMPLETION_PHASE 0x0001
+#define NVME_COMPLETION_STATUS_SHIFT 1
+#define NVME_COMPLETION_STATUS_MASK 0x7FFF
+#define NVME_COMPLETION_STATUS_CODE_MASK 0x00FF
+#define NVME_COMPLETION_STATUS_TYPE_SHIFT 8
+#define NVME_COMPLETION_STATUS_TYPE_MASK 0x7
+
+//
+// Define the generic command status codes that get special treatment.
+//
+
+#define NVME_STATUS_TYPE_GENERIC 0
+#define NVME_STATUS_INVALID_OPCODE 0x01
+#define NVME_STATUS_LBA_OUT_OF_RANGE 0x80
+
+//
+// Define admin command opcodes.
+//
+
+#define NVME_ADMIN_DELETE_SUBMISSION_QUEUE 0x00
+#define NVME_ADMIN_CREATE_SUBMISSION_QUEUE 0x01
+#define NVME_ADMIN_DELETE_COMPLETION_QUEUE 0x04
+#define NVME_ADMIN_CREATE_COMPLETION_QUEUE 0x05
+#define NVME_ADMIN_IDENTIFY 0x06
+#define NVME_ADMIN_SET_FEATURES 0x09
+
+//
+// Define NVM command set opcodes.
+//
+
+#define NVME_COMMAND_FLUSH 0x00
+#define NVME_COMMAND_WRITE 0x01
+#define NVME_COMMAND_READ 0x02
+#define NVME_COMMAND_DATASET_MANAGEMENT 0x09
+
+//
+// Define create queue command bits.
+//
+
+#define NVME_QUEUE_SIZE_SHIFT 16
+#define NVME_QUEUE_PHYSICALLY_CONTIGUOUS 0x00000001
+#define NVME_QUEUE_INTERRUPTS_ENABLED 0x00000002
+#define NVME_QUEUE_INTERRUPT_VECTOR_SHIFT 16
+#define NVME_QUEUE_COMPLETION_QUEUE_SHIFT 16
+
+//
+// Define identify command structure types.
+//
+
+#define NVME_IDENTIFY_NAMESPACE 0x00
+#define NVME_IDENTIFY_CONTROLLER 0x01
+
+//
+// Define offsets into the identify controller structure.
+//
+
+#define NVME_IDENTIFY_CONTROLLER_MAX_TRANSFER 77
+#define NVME_IDENTIFY_CONTROLLER_NAMESPACE_COUNT 516
+#define NVME_IDENTIFY_CONTROLLER_OPTIONAL_COMMANDS 520
+#define NVME_IDENTIFY_CONTROLLER_WRITE_CACHE 525
+
+#define NVME_OPTIONAL_COMMAND_DATASET_MANAGEMENT 0x0004
+#define NVME_WRITE_CACHE_PRESENT 0x01
+
+//
+// Define offsets into the identify namespace structure.
+//
+
+#define NVME_IDENTIFY_NAMESPACE_SIZE 0
+#define NVME_IDENTIFY_NAMESPACE_FORMATTED_LBA_SIZE 26
+#define NVME_IDENTIFY_NAMESPACE_LBA_FORMATS 128
+
+#define NVME_FORMATTED_LBA_INDEX_MASK 0x0F
+#define NVME_LBA_FORMAT_DATA_SIZE_SHIFT 16
+#define NVME_LBA_FORMAT_DATA_SIZE_MASK 0xFF
+
+//
+// Define feature identifiers.
+//
+
+#define NVME_FEATURE_NUMBER_OF_QUEUES 0x07
+#define NVME_FEATURE_COMPLETION_QUEUES_SHIFT 16
+
+//
+// Define dataset management bits.
+//
+
+#define NVME_DSM_DEALLOCATE 0x00000004
+
+//
+// Define controller flags.
+//
+
+#define NVME_CONTROLLER_FLAG_PCI_MSI_REGISTERED 0x00000001
+#define NVME_CONTROLLER_FLAG_PCI_MSI_AVAILABLE 0x00000002
+#define NVME_CONTROLLER_FLAG_MSI_X_REQUESTED 0x00000004
+#define NVME_CONTROLLER_FLAG_MSI_X_ENABLED 0x00000008
+#define NVME_CONTROLLER_FLAG_WRITE_CACHE 0x00000010
+#define NVME_CONTROLLER_FLAG_DATASET_MANAGEMENT 0x00000020
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _NVME_CONTEXT_TYPE {
+    NvmeContextInvalid,
+    NvmeContextController,
+    NvmeContextDisk
+} NVME_CONTEXT_TYPE, *PNVME_CONTEXT_TYPE;
+
+typedef enum _NVME_REGISTER {
+    NvmeCapabilities = 0x00,
+    NvmeCapabilitiesHigh = 0x04,
+    NvmeVersion = 0x08,
+    NvmeInterruptMaskSet = 0x0C,
+    NvmeInterruptMaskClear = 0x10,
+    NvmeConfiguration = 0x14,
+    NvmeStatus = 0x1C,
+    NvmeAdminQueueAttributes = 0x24,
+    NvmeAdminSubmissionQueue = 0x28,
+    NvmeAdminSubmissionQueueHigh = 0x2C,
+    NvmeAdminCompletionQueue = 0x30,
+    NvmeAdminCompletionQueueHigh = 0x34,
+    NvmeDoorbellBase = 0x1000
+} NVME_REGISTER, *PNVME_REGISTER;
+
+/*++
+
+Structure Description:
+
+    This structure defines an NVMe submission queue entry.
+
+Members:
+
+    Dword0 - Stores the opcode in the low byte and the command identifier in
+        the high word.
+
+    NamespaceId - Stores the namespace the command applies to.
+
+    Reserved - Stores reserved dwords, set to zero.
+
+    MetadataPointer - Stores the physical address of the metadata buffer.
+        This driver does not use metadata.
+
+    Prp1 - Stores the first physical region page entry.
+
+    Prp2 - Stores the second physical region page entry, or the physical
+        address of a PRP list.
+
+    Dword10 through Dword15 - Store the command specific dwords.
+
+--*/
+
+typedef struct _NVME_COMMAND {
+    ULONG Dword0;
+    ULONG NamespaceId;
+    ULONG Reserved[2];
+    ULONGLONG MetadataPointer;
+    ULONGLONG Prp1;
+    ULONGLONG Prp2;
+    ULONG Dword10;
+    ULONG Dword11;
+    ULONG Dword12;
+    ULONG Dword13;
+    ULONG Dword14;
+    ULONG Dword15;
+} PACKED NVME_COMMAND, *PNVME_COMMAND;
+
+/*++
+
+Structure Description:
+
+    This structure defines an NVMe completion queue entry.
+
+Members:
+
+    Dword0 - Stores the command specific result.
+
+    Dword1 - Stores a reserved dword.
+
+    SubmissionHead - Stores the controller's current submission queue head.
+
+    SubmissionQueueId - Stores the submission queue the command came from.
+
+    CommandId - Stores the identifier of the completed command.
+
+    Status - Stores the phase tag in bit zero and the status field above it.
+
+--*/
+
+typedef struct _NVME_COMPLETION {
+    ULONG Dword0;
+    ULONG Dword1;
+    USHORT SubmissionHead;
+    USHORT SubmissionQueueId;
+    USHORT CommandId;
+    USHORT Status;
+} PACKED NVME_COMPLETION, *PNVME_COMPLETION;
+
+/*++
+
+Structure Description:
+
+    This structure defines a dataset management range.
+
+Members:
+
+    Attributes - Stores context attributes, zero for a deallocate.
+
+    BlockCount - Stores the number of logical blocks in the range.
+
+    BlockAddress - Stores the first logical block of the range.
+
+--*/
+
+typedef struct _NVME_DSM_RANGE {
+    ULONG Attributes;
+    ULONG BlockCount;
+    ULONGLONG BlockAddress;
+} PACKED NVME_DSM_RANGE, *PNVME_DSM_RANGE;
+
+typedef struct _NVME_CONTROLLER NVME_CONTROLLER, *PNVME_CONTROLLER;
+typedef struct _NVME_QUEUE NVME_QUEUE, *PNVME_QUEUE;
+
+/*++
+
+Structure Description:
+
+    This structure defines the driver state for one in-flight command.
+
+Members:
+
+    Irp - Stores a pointer to the IRP being serviced by this slot.
+
+    IoSize - Stores the number of bytes transferred by the current command.
+
+    DiscardBlocks - Stores the number of blocks covered by the current
+        dataset management command.
+
+    DiscardCompleted - Stores the number of blocks of the discard request
+        covered by previous dataset management commands.
+
+    PrpList - Stores a pointer to the slot's PRP list, which is also used for
+        dataset management ranges.
+
+    PrpListPhysical - Stores the physical address of the PRP list.
+
+    NextFree - Stores the index of the next free slot if this slot is free.
+
+--*/
+
+typedef struct _NVME_SLOT {
+    PIRP Irp;
+    UINTN IoSize;
+    ULONGLONG DiscardBlocks;
+    ULONGLONG DiscardCompleted;
+    PULONGLONG PrpList;
+    PHYSICAL_ADDRESS PrpListPhysical;
+    ULONG NextFree;
+} NVME_SLOT, *PNVME_SLOT;
+
+/*++
+
+Structure Description:
+
+    This structure defines a submission and completion queue pair. I/O
+    queue pairs are each serviced by their own interrupt vector aimed at
+    their own processor.
+
+Members:
+
+    Controller - Stores a pointer to the owning controller.
+
+    QueueId - Stores the queue identifier.
+
+    Size - Stores the number of entries in each of the two queues.
+
+    SubmissionQueue - Stores a pointer to the submission queue entries.
+
+    CompletionQueue - Stores a pointer to the completion queue entries.
+
+    SubmissionIoBuffer - Stores the I/O buffer backing the submission queue.
+
+    CompletionIoBuffer - Stores the I/O buffer backing the completion queue.
+
+    SubmissionTail - Stores the index of the next submission entry to fill.
+
+    DoorbellTail - Stores the submission tail last written to the doorbell.
+
+    CompletionHead - Stores the index of the next completion entry to look at.
+
+    Phase - Stores the phase tag value that marks a new completion entry.
+
+    Lock - Stores the spin lock serializing access to the queue pair, its
+        slots, and its IRP queue.
+
+    IrpQueue - Stores the list of IRPs waiting for a free slot.
+
+    PrpIoBuffer - Stores the I/O buffer backing the slots' PRP lists.
+
+    Slots - Stores the array of command slots, indexed by command identifier.
+
+    SlotCount - Stores the number of elements in the slot array.
+
+    FreeSlot - Stores the index of the first free slot.
+
+    PendingInterrupts - Stores a non-zero value if the interrupt service
+        routine has seen work for this queue.
+
+--*/
+
+struct _NVME_QUEUE {
+    PNVME_CONTROLLER Controller;
+    USHORT QueueId;
+    USHORT Size;
+    PNVME_COMMAND SubmissionQueue;
+    volatile NVME_COMPLETION *CompletionQueue;
+    PIO_BUFFER SubmissionIoBuffer;
+    PIO_BUFFER CompletionIoBuffer;
+    USHORT SubmissionTail;
+    USHORT DoorbellTail;
+    USHORT CompletionHead;
+    USHORT Phase;
+    KSPIN_LOCK Lock;
+    LIST_ENTRY IrpQueue;
+    PIO_BUFFER PrpIoBuffer;
+    PNVME_SLOT Slots;
+    ULONG SlotCount;
+    ULONG FreeSlot;
+    volatile ULONG PendingInterrupts;
+};
+
+/*++
+
+Structure Description:
+
+    This structure defines a namespace exposed as a disk.
+
+Members:
+
+    Type - Stores a marker identifying the structure as a disk.
+
+    Controller - Stores a pointer to the parent controller.
+
+    OsDevice - Stores a pointer to the OS device for the disk.
+
+    NamespaceId - Stores the namespace identifier.
+
+    BlockSize - Stores the logical block size of the namespace.
+
+    BlockShift - Stores the log2 of the block size.
+
+    BlockCount - Stores the number of logical blocks in the namespace.
+
+--*/
+
+typedef struct _NVME_DISK {
+    NVME_CONTEXT_TYPE Type;
+    PNVME_CONTROLLER Controller;
+    PDEVICE OsDevice;
+    ULONG NamespaceId;
+    ULONG BlockSize;
+    ULONG BlockShift;
+    ULONGLONG BlockCount;
+} NVME_DISK, *PNVME_DISK;
+
+/*++
+
+Structure Description:
+
+    This structure defines the state of an NVMe controller.
+
+Members:
+
+    Type - Stores a marker identifying the structure as a controller.
+
+    OsDevice - Stores a pointer to the OS device for the PCI function.
+
+    ControllerBase - Stores the virtual address of the register space.
+
+    ControllerBaseSize - Stores the size of the register space mapping.
+
+    Flags - Stores a bitfield of flags. See NVME_CONTROLLER_FLAG_*
+        definitions.
+
+    DoorbellStride - Stores the distance between doorbell registers, in
+        bytes.
+
+    MaxQueueEntries - Stores the largest queue the controller supports.
+
+    ReadyTimeout - Stores the maximum time to wait for the controller to
+        change its ready state, in milliseconds.
+
+    MaxTransferSize - Stores the largest transfer to put in a single command,
+        in bytes.
+
+    NamespaceCount - Stores the number of namespaces the controller reports.
+
+    AdminQueue - Stores the admin queue pair.
+
+    IoQueues - Stores the array of I/O queue pairs.
+
+    IoQueueCount - Stores the number of I/O queue pairs in use.
+
+    IdentifyIoBuffer - Stores a page used for identify data.
+
+    InterruptLine - Stores the legacy interrupt line, or
+        INVALID_INTERRUPT_LINE if MSI-X is in use.
+
+    InterruptVectors - Stores the allocated interrupt vectors.
+
+    InterruptVectorCount - Stores the number of valid interrupt vectors.
+
+    InterruptHandles - Stores the connected interrupt handles.
+
+    PciMsiInterface - Stores the PCI MSI interface.
+
+    Disks - Stores the array of namespaces.
+
+    DiskCount - Stores the number of valid namespaces.
+
+--*/
+
+struct _NVME_CONTROLLER {
+    NVME_CONTEXT_TYPE Type;
+    PDEVICE OsDevice;
+    PVOID ControllerBase;
+    UINTN ControllerBaseSize;
+    ULONG Flags;
+    ULONG DoorbellStride;
+    ULONG MaxQueueEntries;
+    ULONG ReadyTimeout;
+    ULONG MaxTransferSize;
+    ULONG NamespaceCount;
+    NVME_QUEUE AdminQueue;
+    PNVME_QUEUE IoQueues;
+    ULONG IoQueueCount;
+    PIO_BUFFER IdentifyIoBuffer;
+    ULONGLONG InterruptLine;
+    ULONGLONG InterruptVectors[NVME_MAX_IO_QUEUES];
+    ULONG InterruptVectorCount;
+    HANDLE InterruptHandles[NVME_MAX_IO_QUEUES];
+    INTERFACE_PCI_MSI PciMsiInterface;
+    NVME_DISK Disks[NVME_MAX_NAMESPACES];
+    ULONG DiskCount;
+};
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+extern PDRIVER NvmeDriver;
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+//
+// Hardware support functions.
+//
+
+KSTATUS
+NvmepResetController (
+    PNVME_CONTROLLER Controller
+    );
+
+/*++
+
+Routine Description:
+
+    This routine disables the controller, sets up the admin queue, enables
+    the controller again, and identifies it.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VOID
+NvmepDisableController (
+    PNVME_CONTROLLER Controller
+    );
+
+/*++
+
+Routine Description:
+
+    This routine disables the controller and frees its queues.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    None.
+
+--*/
+
+KSTATUS
+NvmepAllocateIoQueues (
+    PNVME_CONTROLLER Controller,
+    ULONG QueueCount
+    );
+
+/*++
+
+Routine Description:
+
+    This routine negotiates the number of I/O queues with the controller and
+    allocates memory for them.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    QueueCount - Supplies the number of I/O queue pairs desired.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+KSTATUS
+NvmepCreateIoQueues (
+    PNVME_CONTROLLER Controller
+    );
+
+/*++
+
+Routine Description:
+
+    This routine tells the controller about each allocated I/O queue pair.
+    Interrupts should be connected before this routine is called.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+KSTATUS
+NvmepIdentifyNamespaces (
+    PNVME_CONTROLLER Controller
+    );
+
+/*++
+
+Routine Description:
+
+    This routine identifies the controller's active namespaces and records
+    their geometry.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VOID
+NvmepSubmitCommand (
+    PNVME_QUEUE Queue,
+    PNVME_COMMAND Command
+    );
+
+/*++
+
+Routine Description:
+
+    This routine copies a command into the next submission queue entry. The
+    caller must hold the queue lock, must not overrun the queue, and must
+    call the kick routine to notify the controller.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Command - Supplies a pointer to the command to submit.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+NvmepKickQueue (
+    PNVME_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine rings the submission doorbell if commands have been added
+    since the last time it was rung.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+INTERRUPT_STATUS
+NvmeInterruptService (
+    PVOID Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the legacy interrupt service routine. The line
+    may be shared, so the completion queue is checked for new entries.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the I/O queue.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+INTERRUPT_STATUS
+NvmeMsixInterruptService (
+    PVOID Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the interrupt service routine for an I/O queue's
+    MSI-X vector.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the I/O queue.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+INTERRUPT_STATUS
+NvmeInterruptServiceDpc (
+    PVOID Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the dispatch level interrupt service, which reaps
+    an I/O queue's completions.
+
+Arguments:
+
+    Context - Supplies the context, in this case the I/O queue.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+//
+// Dispatch support functions.
+//
+
+VOID
+NvmepCompleteSlot (
+    PNVME_QUEUE Queue,
+    PNVME_SLOT Slot,
+    USHORT CompletionStatus
+    );
+
+/*++
+
+Routine Description:
+
+    This routine handles a command the controller has finished. It either
+    continues the IRP with the next piece, or completes it and moves on to the
+    next queued IRP. The queue lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Slot - Supplies a pointer to the finished slot.
+
+    CompletionStatus - Supplies the status field of the completion entry,
+        without the phase bit.
+
+Return Value:
+
+    None.
+
+--*/
+
@@ -0,0 +1,1377 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    nvmehw.c
+
+Abstract:
+
+    This module implements hardware support for NVMe controllers: controller
+    reset, the polled admin queue, I/O queue creation, and completion
+    processing.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/driver.h>
+#include "nvme.h"
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro reads a value out of an identify data structure.
+//
+
+#define NVME_IDENTIFY_VALUE(_Type, _Buffer, _Offset) \
+    (*((_Type *)((PUCHAR)(_Buffer) + (_Offset))))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+NvmepWaitForReady (
+    PNVME_CONTROLLER Controller,
+    BOOL Ready
+    );
+
+KSTATUS
+NvmepInitializeQueue (
+    PNVME_CONTROLLER Controller,
+    PNVME_QUEUE Queue,
+    USHORT QueueId,
+    USHORT Size,
+    BOOL CreateSlots
+    );
+
+VOID
+NvmepDestroyQueue (
+    PNVME_QUEUE Queue
+    );
+
+VOID
+NvmepResetQueueState (
+    PNVME_QUEUE Queue
+    );
+
+KSTATUS
+NvmepExecuteAdminCommand (
+    PNVME_CONTROLLER Controller,
+    PNVME_COMMAND Command,
+    PULONG Result
+    );
+
+KSTATUS
+NvmepIdentify (
+    PNVME_CONTROLLER Controller,
+    ULONG Structure,
+    ULONG NamespaceId
+    );
+
+VOID
+NvmepProcessCompletions (
+    PNVME_QUEUE Queue
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+KSTATUS
+NvmepResetController (
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine disables the controller, sets up the admin queue, enables
+    the controller again, and identifies it.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Capabilities;
+    ULONG CapabilitiesHigh;
+    ULONG Configuration;
+    PVOID Identify;
+    ULONG MaxTransferShift;
+    ULONG MinPageShift;
+    USHORT OptionalCommands;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    PNVME_QUEUE Queue;
+    USHORT QueueSize;
+    KSTATUS Status;
+    ULONG Timeout;
+
+    Capabilities = NVME_READ(Controller, NvmeCapabilities);
+    CapabilitiesHigh = NVME_READ(Controller, NvmeCapabilitiesHigh);
+    if ((CapabilitiesHigh & NVME_CAPABILITY_HIGH_NVM_COMMAND_SET) == 0) {
+        RtlDebugPrint("NVMe: NVM command set not supported.\n");
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    //
+    // The driver always uses 4KB pages, which is the smallest size allowed.
+    // Controllers that cannot go that low are not supported.
+    //
+
+    MinPageShift = (CapabilitiesHigh >>
+                    NVME_CAPABILITY_HIGH_MIN_PAGE_SIZE_SHIFT) &
+                   NVME_CAPABILITY_HIGH_MIN_PAGE_SIZE_MASK;
+
+    if (MinPageShift != 0) {
+        RtlDebugPrint("NVMe: Unsupported minimum page size.\n");
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Controller->MaxQueueEntries =
+                      (Capabilities & NVME_CAPABILITY_MAX_ENTRIES_MASK) + 1;
+
+    Timeout = (Capabilities >> NVME_CAPABILITY_TIMEOUT_SHIFT) &
+              NVME_CAPABILITY_TIMEOUT_MASK;
+
+    if (Timeout == 0) {
+        Timeout = 1;
+    }
+
+    Controller->ReadyTimeout = Timeout * NVME_CAPABILITY_TIMEOUT_UNIT_MS;
+    Controller->DoorbellStride =
+        sizeof(ULONG) << (CapabilitiesHigh & NVME_CAPABILITY_HIGH_STRIDE_MASK);
+
+    //
+    // Disable the controller so the admin queue can be programmed.
+    //
+
+    Configuration = NVME_READ(Controller, NvmeConfiguration);
+    if ((Configuration & NVME_CONFIGURATION_ENABLE) != 0) {
+        Configuration &= ~NVME_CONFIGURATION_ENABLE;
+        NVME_WRITE(Controller, NvmeConfiguration, Configuration);
+    }
+
+    Status = NvmepWaitForReady(Controller, FALSE);
+    if (!KSUCCESS(Status)) {
+        goto ResetControllerEnd;
+    }
+
+    Queue = &(Controller->AdminQueue);
+    if (Queue->SubmissionQueue == NULL) {
+        QueueSize = NVME_ADMIN_QUEUE_SIZE;
+        if (QueueSize > Controller->MaxQueueEntries) {
+            QueueSize = Controller->MaxQueueEntries;
+        }
+
+        Status = NvmepInitializeQueue(Controller,
+                                      Queue,
+                                      NVME_ADMIN_QUEUE_ID,
+                                      QueueSize,
+                                      FALSE);
+
+        if (!KSUCCESS(Status)) {
+            goto ResetControllerEnd;
+        }
+    }
+
+    NvmepResetQueueState(Queue);
+    NVME_WRITE(Controller,
+               NvmeAdminQueueAttributes,
+               ((Queue->Size - 1) << NVME_ADMIN_QUEUE_COMPLETION_SIZE_SHIFT) |
+               (Queue->Size - 1));
+
+    PhysicalAddress = Queue->SubmissionIoBuffer->Fragment[0].PhysicalAddress;
+    NVME_WRITE(Controller, NvmeAdminSubmissionQueue, (ULONG)PhysicalAddress);
+    NVME_WRITE(Controller,
+               NvmeAdminSubmissionQueueHigh,
+               (ULONG)(PhysicalAddress >> 32));
+
+    PhysicalAddress = Queue->CompletionIoBuffer->Fragment[0].PhysicalAddress;
+    NVME_WRITE(Controller, NvmeAdminCompletionQueue, (ULONG)PhysicalAddress);
+    NVME_WRITE(Controller,
+               NvmeAdminCompletionQueueHigh,
+               (ULONG)(PhysicalAddress >> 32));
+
+    //
+    // The admin queue is polled, so mask the pin based interrupt to keep
+    // admin completions from asserting a line nobody is listening to. MSI-X
+    // is not enabled yet, so the mask register is still fair game. Legacy
+    // interrupts get unmasked once the I/O queues are up.
+    //
+
+    NVME_WRITE(Controller, NvmeInterruptMaskSet, NVME_INTERRUPT_VECTOR_0);
+    Configuration = NVME_CONFIGURATION_ENABLE |
+                    (NVME_SUBMISSION_ENTRY_SIZE_SHIFT <<
+                     NVME_CONFIGURATION_SUBMISSION_ENTRY_SIZE_SHIFT) |
+                    (NVME_COMPLETION_ENTRY_SIZE_SHIFT <<
+                     NVME_CONFIGURATION_COMPLETION_ENTRY_SIZE_SHIFT);
+
+    NVME_WRITE(Controller, NvmeConfiguration, Configuration);
+    Status = NvmepWaitForReady(Controller, TRUE);
+    if (!KSUCCESS(Status)) {
+        goto ResetControllerEnd;
+    }
+
+    //
+    // Identify the controller to get the transfer limit, namespace count, and
+    // optional features.
+    //
+
+    Status = NvmepIdentify(Controller, NVME_IDENTIFY_CONTROLLER, 0);
+    if (!KSUCCESS(Status)) {
+        goto ResetControllerEnd;
+    }
+
+    Identify = Controller->IdentifyIoBuffer->Fragment[0].VirtualAddress;
+    Controller->MaxTransferSize = NVME_MAX_TRANSFER_SIZE;
+    MaxTransferShift = NVME_IDENTIFY_VALUE(
+                                        UCHAR,
+                                        Identify,
+                                        NVME_IDENTIFY_CONTROLLER_MAX_TRANSFER);
+
+    if ((MaxTransferShift != 0) &&
+        ((NVME_PAGE_SIZE << MaxTransferShift) < NVME_MAX_TRANSFER_SIZE)) {
+
+        Controller->MaxTransferSize = NVME_PAGE_SIZE << MaxTransferShift;
+    }
+
+    Controller->NamespaceCount = NVME_IDENTIFY_VALUE(
+                                    ULONG,
+                                    Identify,
+                                    NVME_IDENTIFY_CONTROLLER_NAMESPACE_COUNT);
+
+    OptionalCommands = NVME_IDENTIFY_VALUE(
+                                    USHORT,
+                                    Identify,
+                                    NVME_IDENTIFY_CONTROLLER_OPTIONAL_COMMANDS);
+
+    Controller->Flags &= ~(NVME_CONTROLLER_FLAG_WRITE_CACHE |
+                           NVME_CONTROLLER_FLAG_DATASET_MANAGEMENT);
+
+    if ((OptionalCommands & NVME_OPTIONAL_COMMAND_DATASET_MANAGEMENT) != 0) {
+        Controller->Flags |= NVME_CONTROLLER_FLAG_DATASET_MANAGEMENT;
+    }
+
+    if ((NVME_IDENTIFY_VALUE(UCHAR,
+                             Identify,
+                             NVME_IDENTIFY_CONTROLLER_WRITE_CACHE) &
+         NVME_WRITE_CACHE_PRESENT) != 0) {
+
+        Controller->Flags |= NVME_CONTROLLER_FLAG_WRITE_CACHE;
+    }
+
+    Status = STATUS_SUCCESS;
+
+ResetControllerEnd:
+    return Status;
+}
+
+VOID
+NvmepDisableController (
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine disables the controller and frees its queues.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Configuration;
+    ULONG Index;
+
+    if (Controller->ControllerBase != NULL) {
+        Configuration = NVME_READ(Controller, NvmeConfiguration);
+        if ((Configuration & NVME_CONFIGURATION_ENABLE) != 0) {
+            Configuration &= ~NVME_CONFIGURATION_ENABLE;
+            NVME_WRITE(Controller, NvmeConfiguration, Configuration);
+            NvmepWaitForReady(Controller, FALSE);
+        }
+    }
+
+    if (Controller->IoQueues != NULL) {
+        for (Index = 0; Index < Controller->IoQueueCount; Index += 1) {
+            NvmepDestroyQueue(&(Controller->IoQueues[Index]));
+        }
+
+        MmFreeNonPagedPool(Controller->IoQueues);
+        Controller->IoQueues = NULL;
+        Controller->IoQueueCount = 0;
+    }
+
+    NvmepDestroyQueue(&(Controller->AdminQueue));
+    if (Controller->IdentifyIoBuffer != NULL) {
+        MmFreeIoBuffer(Controller->IdentifyIoBuffer);
+        Controller->IdentifyIoBuffer = NULL;
+    }
+
+    return;
+}
+
+KSTATUS
+NvmepAllocateIoQueues (
+    PNVME_CONTROLLER Controller,
+    ULONG QueueCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine negotiates the number of I/O queues with the controller and
+    allocates memory for them.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    QueueCount - Supplies the number of I/O queue pairs desired.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    NVME_COMMAND Command;
+    ULONG Granted;
+    ULONG Index;
+    USHORT QueueSize;
+    ULONG Result;
+    KSTATUS Status;
+
+    ASSERT((QueueCount != 0) && (QueueCount <= NVME_MAX_IO_QUEUES));
+    ASSERT(Controller->IoQueues == NULL);
+
+    //
+    // Ask for as many queues as were requested. The controller answers with
+    // how many it actually allocated, which may be more or fewer.
+    //
+
+    RtlZeroMemory(&Command, sizeof(NVME_COMMAND));
+    Command.Dword0 = NVME_COMMAND_DWORD0(NVME_ADMIN_SET_FEATURES, 0);
+    Command.Dword10 = NVME_FEATURE_NUMBER_OF_QUEUES;
+    Command.Dword11 = ((QueueCount - 1) <<
+                       NVME_FEATURE_COMPLETION_QUEUES_SHIFT) |
+                      (QueueCount - 1);
+
+    Status = NvmepExecuteAdminCommand(Controller, &Command, &Result);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    Granted = (Result & 0xFFFF) + 1;
+    if (Granted < QueueCount) {
+        QueueCount = Granted;
+    }
+
+    Granted = (Result >> NVME_FEATURE_COMPLETION_QUEUES_SHIFT) + 1;
+    if (Granted < QueueCount) {
+        QueueCount = Granted;
+    }
+
+    QueueSize = NVME_IO_QUEUE_SIZE;
+    if (QueueSize > Controller->MaxQueueEntries) {
+        QueueSize = Controller->MaxQueueEntries;
+    }
+
+    AllocationSize = QueueCount * sizeof(NVME_QUEUE);
+    Controller->IoQueues = MmAllocateNonPagedPool(AllocationSize,
+                                                  NVME_ALLOCATION_TAG);
+
+    if (Controller->IoQueues == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Controller->IoQueues, AllocationSize);
+    Controller->IoQueueCount = QueueCount;
+    for (Index = 0; Index < QueueCount; Index += 1) {
+        Status = NvmepInitializeQueue(Controller,
+                                      &(Controller->IoQueues[Index]),
+                                      Index + 1,
+                                      QueueSize,
+                                      TRUE);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+NvmepCreateIoQueues (
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tells the controller about each allocated I/O queue pair.
+    Interrupts should be connected before this routine is called.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    NVME_COMMAND Command;
+    ULONG Index;
+    PNVME_QUEUE Queue;
+    ULONG QueueSize;
+    KSTATUS Status;
+    ULONG Vector;
+
+    for (Index = 0; Index < Controller->IoQueueCount; Index += 1) {
+        Queue = &(Controller->IoQueues[Index]);
+        NvmepResetQueueState(Queue);
+        QueueSize = ((ULONG)Queue->Size - 1) << NVME_QUEUE_SIZE_SHIFT;
+
+        //
+        // Each queue pair gets its own MSI-X table entry. The admin queue
+        // shares the first entry, but it is polled.
+        //
+
+        Vector = 0;
+        if ((Controller->Flags & NVME_CONTROLLER_FLAG_MSI_X_ENABLED) != 0) {
+            Vector = Index;
+        }
+
+        RtlZeroMemory(&Command, sizeof(NVME_COMMAND));
+        Command.Dword0 = NVME_COMMAND_DWORD0(
+                                         NVME_ADMIN_CREATE_COMPLETION_QUEUE,
+                                         0);
+
+        Command.Prp1 = Queue->CompletionIoBuffer->Fragment[0].PhysicalAddress;
+        Command.Dword10 = QueueSize | Queue->QueueId;
+        Command.Dword11 = (Vector << NVME_QUEUE_INTERRUPT_VECTOR_SHIFT) |
+                          NVME_QUEUE_INTERRUPTS_ENABLED |
+                          NVME_QUEUE_PHYSICALLY_CONTIGUOUS;
+
+        Status = NvmepExecuteAdminCommand(Controller, &Command, NULL);
+        if (!KSUCCESS(Status)) {
+            RtlDebugPrint("NVMe: Failed to create CQ %d: %d\n",
+                          Queue->QueueId,
+                          Status);
+
+            return Status;
+        }
+
+        RtlZeroMemory(&Command, sizeof(NVME_COMMAND));
+        Command.Dword0 = NVME_COMMAND_DWORD0(
+                                         NVME_ADMIN_CREATE_SUBMISSION_QUEUE,
+                                         0);
+
+        Command.Prp1 = Queue->SubmissionIoBuffer->Fragment[0].PhysicalAddress;
+        Command.Dword10 = QueueSize | Queue->QueueId;
+        Command.Dword11 = (Queue->QueueId <<
+                           NVME_QUEUE_COMPLETION_QUEUE_SHIFT) |
+                          NVME_QUEUE_PHYSICALLY_CONTIGUOUS;
+
+        Status = NvmepExecuteAdminCommand(Controller, &Command, NULL);
+        if (!KSUCCESS(Status)) {
+            RtlDebugPrint("NVMe: Failed to create SQ %d: %d\n",
+                          Queue->QueueId,
+                          Status);
+
+            return Status;
+        }
+    }
+
+    //
+    // Let the legacy interrupt through now that the I/O queues are live.
+    //
+
+    if ((Controller->Flags & NVME_CONTROLLER_FLAG_MSI_X_ENABLED) == 0) {
+        NVME_WRITE(Controller,
+                   NvmeInterruptMaskClear,
+                   NVME_INTERRUPT_VECTOR_0);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+NvmepIdentifyNamespaces (
+    PNVME_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine identifies the controller's active namespaces and records
+    their geometry.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG BlockShift;
+    ULONGLONG BlockCount;
+    PNVME_DISK Disk;
+    ULONG FormatIndex;
+    PVOID Identify;
+    ULONG LbaFormat;
+    ULONG NamespaceCount;
+    ULONG NamespaceId;
+    KSTATUS Status;
+
+    //
+    // The disks survive across restarts, since the OS devices hang off them.
+    //
+
+    if (Controller->DiskCount != 0) {
+        return STATUS_SUCCESS;
+    }
+
+    NamespaceCount = Controller->NamespaceCount;
+    if (NamespaceCount > NVME_MAX_NAMESPACES) {
+        NamespaceCount = NVME_MAX_NAMESPACES;
+    }
+
+    Identify = Controller->IdentifyIoBuffer->Fragment[0].VirtualAddress;
+    for (NamespaceId = 1; NamespaceId <= NamespaceCount; NamespaceId += 1) {
+        Status = NvmepIdentify(Controller,
+                               NVME_IDENTIFY_NAMESPACE,
+                               NamespaceId);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        //
+        // Inactive namespaces come back all zeroes.
+        //
+
+        BlockCount = NVME_IDENTIFY_VALUE(ULONGLONG,
+                                         Identify,
+                                         NVME_IDENTIFY_NAMESPACE_SIZE);
+
+        if (BlockCount == 0) {
+            continue;
+        }
+
+        FormatIndex = NVME_IDENTIFY_VALUE(
+                                   UCHAR,
+                                   Identify,
+                                   NVME_IDENTIFY_NAMESPACE_FORMATTED_LBA_SIZE);
+
+        FormatIndex &= NVME_FORMATTED_LBA_INDEX_MASK;
+        LbaFormat = NVME_IDENTIFY_VALUE(
+                        ULONG,
+                        Identify,
+                        NVME_IDENTIFY_NAMESPACE_LBA_FORMATS +
+                        (FormatIndex * sizeof(ULONG)));
+
+        BlockShift = (LbaFormat >> NVME_LBA_FORMAT_DATA_SIZE_SHIFT) &
+                     NVME_LBA_FORMAT_DATA_SIZE_MASK;
+
+        if ((BlockShift < 9) || ((1 << BlockShift) > NVME_PAGE_SIZE)) {
+            RtlDebugPrint("NVMe: Skipping namespace %d with block shift %d.\n",
+                          NamespaceId,
+                          BlockShift);
+
+            continue;
+        }
+
+        Disk = &(Controller->Disks[Controller->DiskCount]);
+        Disk->Type = NvmeContextDisk;
+        Disk->Controller = Controller;
+        Disk->NamespaceId = NamespaceId;
+        Disk->BlockShift = BlockShift;
+        Disk->BlockSize = 1 << BlockShift;
+        Disk->BlockCount = BlockCount;
+        Controller->DiskCount += 1;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+NvmepSubmitCommand (
+    PNVME_QUEUE Queue,
+    PNVME_COMMAND Command
+    )
+
+/*++
+
+Routine Description:
+
+    This routine copies a command into the next submission queue entry. The
+    caller must hold the queue lock, must not overrun the queue, and must
+    call the kick routine to notify the controller.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+    Command - Supplies a pointer to the command to submit.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlCopyMemory(&(Queue->SubmissionQueue[Queue->SubmissionTail]),
+                  Command,
+                  sizeof(NVME_COMMAND));
+
+    Queue->SubmissionTail += 1;
+    if (Queue->SubmissionTail == Queue->Size) {
+        Queue->SubmissionTail = 0;
+    }
+
+    return;
+}
+
+VOID
+NvmepKickQueue (
+    PNVME_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine rings the submission doorbell if commands have been added
+    since the last time it was rung.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNVME_CONTROLLER Controller;
+
+    if (Queue->SubmissionTail == Queue->DoorbellTail) {
+        return;
+    }
+
+    //
+    // Make sure the entries are visible before the controller goes to fetch
+    // them.
+    //
+
+    RtlMemoryBarrier();
+    Controller = Queue->Controller;
+    NVME_WRITE(Controller,
+               NVME_SUBMISSION_DOORBELL(Controller, Queue->QueueId),
+               Queue->SubmissionTail);
+
+    Queue->DoorbellTail = Queue->SubmissionTail;
+    return;
+}
+
+INTERRUPT_STATUS
+NvmeInterruptService (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the legacy interrupt service routine. The line
+    may be shared, so the completion queue is checked for new entries.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the I/O queue.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    volatile NVME_COMPLETION *Completion;
+    PNVME_QUEUE Queue;
+
+    Queue = Context;
+    Completion = &(Queue->CompletionQueue[Queue->CompletionHead]);
+    if ((Completion->Status & NVME_COMPLETION_PHASE) != Queue->Phase) {
+        return InterruptStatusNotClaimed;
+    }
+
+    //
+    // Mask the interrupt until the DPC has drained the queue, otherwise the
+    // level triggered line stays asserted.
+    //
+
+    NVME_WRITE(Queue->Controller,
+               NvmeInterruptMaskSet,
+               NVME_INTERRUPT_VECTOR_0);
+
+    RtlAtomicOr32(&(Queue->PendingInterrupts), 1);
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+NvmeMsixInterruptService (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the interrupt service routine for an I/O queue's
+    MSI-X vector.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the I/O queue.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PNVME_QUEUE Queue;
+
+    Queue = Context;
+    RtlAtomicOr32(&(Queue->PendingInterrupts), 1);
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+NvmeInterruptServiceDpc (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the dispatch level interrupt service, which reaps
+    an I/O queue's completions.
+
+Arguments:
+
+    Context - Supplies the context, in this case the I/O queue.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PNVME_CONTROLLER Controller;
+    PNVME_QUEUE Queue;
+
+    Queue = Context;
+    Controller = Queue->Controller;
+    if (RtlAtomicExchange32(&(Queue->PendingInterrupts), 0) == 0) {
+        return InterruptStatusNotClaimed;
+    }
+
+    KeAcquireSpinLock(&(Queue->Lock));
+    NvmepProcessCompletions(Queue);
+    NvmepKickQueue(Queue);
+    KeReleaseSpinLock(&(Queue->Lock));
+    if ((Controller->Flags & NVME_CONTROLLER_FLAG_MSI_X_ENABLED) == 0) {
+        NVME_WRITE(Controller,
+                   NvmeInterruptMaskClear,
+                   NVME_INTERRUPT_VECTOR_0);
+    }
+
+    return InterruptStatusClaimed;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+KSTATUS
+NvmepWaitForReady (
+    PNVME_CONTROLLER Controller,
+    BOOL Ready
+    )
+
+/*++
+
+Routine Description:
+
+    This routine waits for the controller's ready bit to reach the given
+    state.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Ready - Supplies a boolean indicating whether to wait for the controller
+        to become ready (TRUE) or to stop being ready (FALSE).
+
+Return Value:
+
+    STATUS_SUCCESS if the ready bit reached the desired state.
+
+    STATUS_DEVICE_IO_ERROR if the controller reported a fatal error.
+
+    STATUS_TIMEOUT if the controller took too long.
+
+--*/
+
+{
+
+    ULONG ControllerStatus;
+    ULONG Desired;
+    ULONGLONG Time;
+    ULONGLONG Timeout;
+
+    Desired = 0;
+    if (Ready != FALSE) {
+        Desired = NVME_STATUS_READY;
+    }
+
+    Time = HlQueryTimeCounter();
+    Timeout = Time + ((Controller->ReadyTimeout *
+                       HlQueryTimeCounterFrequency()) /
+                      MILLISECONDS_PER_SECOND);
+
+    do {
+        ControllerStatus = NVME_READ(Controller, NvmeStatus);
+        if ((Ready != FALSE) &&
+            ((ControllerStatus & NVME_STATUS_FATAL) != 0)) {
+
+            RtlDebugPrint("NVMe: Controller fatal status 0x%x.\n",
+                          ControllerStatus);
+
+            return STATUS_DEVICE_IO_ERROR;
+        }
+
+        if ((ControllerStatus & NVME_STATUS_READY) == Desired) {
+            return STATUS_SUCCESS;
+        }
+
+        Time = HlQueryTimeCounter();
+
+    } while (Time <= Timeout);
+
+    RtlDebugPrint("NVMe: Timed out waiting for ready %d.\n", Ready);
+    return STATUS_TIMEOUT;
+}
+
+KSTATUS
+NvmepInitializeQueue (
+    PNVME_CONTROLLER Controller,
+    PNVME_QUEUE Queue,
+    USHORT QueueId,
+    USHORT Size,
+    BOOL CreateSlots
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates the memory for a queue pair, and optionally its
+    command slots.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Queue - Supplies a pointer to the zeroed queue pair to initialize.
+
+    QueueId - Supplies the queue identifier.
+
+    Size - Supplies the number of entries in each queue.
+
+    CreateSlots - Supplies a boolean indicating whether to create command
+        slots. The polled admin queue does not need any.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    ULONG Flags;
+    ULONG Index;
+    PHYSICAL_ADDRESS PrpPhysical;
+    PUCHAR PrpVirtual;
+    PNVME_SLOT Slot;
+    ULONG SlotCount;
+
+    Queue->Controller = Controller;
+    Queue->QueueId = QueueId;
+    Queue->Size = Size;
+    Queue->FreeSlot = NVME_SLOT_NONE;
+    KeInitializeSpinLock(&(Queue->Lock));
+    INITIALIZE_LIST_HEAD(&(Queue->IrpQueue));
+    Flags = IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS;
+    Queue->SubmissionIoBuffer = MmAllocateNonPagedIoBuffer(
+                                              0,
+                                              MAX_ULONGLONG,
+                                              NVME_PAGE_SIZE,
+                                              Size * sizeof(NVME_COMMAND),
+                                              Flags);
+
+    if (Queue->SubmissionIoBuffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Queue->SubmissionQueue =
+                        Queue->SubmissionIoBuffer->Fragment[0].VirtualAddress;
+
+    Queue->CompletionIoBuffer = MmAllocateNonPagedIoBuffer(
+                                              0,
+                                              MAX_ULONGLONG,
+                                              NVME_PAGE_SIZE,
+                                              Size * sizeof(NVME_COMPLETION),
+                                              Flags);
+
+    if (Queue->CompletionIoBuffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Queue->CompletionQueue =
+                        Queue->CompletionIoBuffer->Fragment[0].VirtualAddress;
+
+    if (CreateSlots == FALSE) {
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Each slot carries one command, so keeping one fewer slot than queue
+    // entries means neither queue can ever overflow.
+    //
+
+    SlotCount = Size - 1;
+    AllocationSize = SlotCount * NVME_PRP_LIST_SIZE;
+    Queue->PrpIoBuffer = MmAllocateNonPagedIoBuffer(0,
+                                                    MAX_ULONGLONG,
+                                                    NVME_PAGE_SIZE,
+                                                    AllocationSize,
+                                                    Flags);
+
+    if (Queue->PrpIoBuffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Queue->Slots = MmAllocateNonPagedPool(SlotCount * sizeof(NVME_SLOT),
+                                          NVME_ALLOCATION_TAG);
+
+    if (Queue->Slots == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    PrpVirtual = Queue->PrpIoBuffer->Fragment[0].VirtualAddress;
+    PrpPhysical = Queue->PrpIoBuffer->Fragment[0].PhysicalAddress;
+    for (Index = 0; Index < SlotCount; Index += 1) {
+        Slot = &(Queue->Slots[Index]);
+        Slot->Irp = NULL;
+        Slot->IoSize = 0;
+        Slot->DiscardBlocks = 0;
+        Slot->DiscardCompleted = 0;
+        Slot->PrpList = (PULONGLONG)(PrpVirtual +
+                                     (Index * NVME_PRP_LIST_SIZE));
+
+        Slot->PrpListPhysical = PrpPhysical + (Index * NVME_PRP_LIST_SIZE);
+        Slot->NextFree = Index + 1;
+    }
+
+    Queue->Slots[SlotCount - 1].NextFree = NVME_SLOT_NONE;
+    Queue->FreeSlot = 0;
+    Queue->SlotCount = SlotCount;
+    return STATUS_SUCCESS;
+}
+
+VOID
+NvmepDestroyQueue (
+    PNVME_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees the memory behind a queue pair.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Queue->SubmissionIoBuffer != NULL) {
+        MmFreeIoBuffer(Queue->SubmissionIoBuffer);
+        Queue->SubmissionIoBuffer = NULL;
+        Queue->SubmissionQueue = NULL;
+    }
+
+    if (Queue->CompletionIoBuffer != NULL) {
+        MmFreeIoBuffer(Queue->CompletionIoBuffer);
+        Queue->CompletionIoBuffer = NULL;
+        Queue->CompletionQueue = NULL;
+    }
+
+    if (Queue->PrpIoBuffer != NULL) {
+        MmFreeIoBuffer(Queue->PrpIoBuffer);
+        Queue->PrpIoBuffer = NULL;
+    }
+
+    if (Queue->Slots != NULL) {
+        MmFreeNonPagedPool(Queue->Slots);
+        Queue->Slots = NULL;
+    }
+
+    Queue->SlotCount = 0;
+    Queue->FreeSlot = NVME_SLOT_NONE;
+    return;
+}
+
+VOID
+NvmepResetQueueState (
+    PNVME_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resets a queue pair's indices to match a freshly created
+    queue on the controller.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    Queue->SubmissionTail = 0;
+    Queue->DoorbellTail = 0;
+    Queue->CompletionHead = 0;
+    Queue->Phase = NVME_COMPLETION_PHASE;
+    RtlZeroMemory((PVOID)(Queue->CompletionQueue),
+                  Queue->Size * sizeof(NVME_COMPLETION));
+
+    return;
+}
+
+KSTATUS
+NvmepExecuteAdminCommand (
+    PNVME_CONTROLLER Controller,
+    PNVME_COMMAND Command,
+    PULONG Result
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits a command to the admin queue and polls for its
+    completion. Admin commands are only sent while starting the controller,
+    so there is never more than one outstanding.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Command - Supplies a pointer to the command to execute.
+
+    Result - Supplies an optional pointer where the command specific result
+        dword will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    volatile NVME_COMPLETION *Completion;
+    USHORT CompletionStatus;
+    PNVME_QUEUE Queue;
+    ULONGLONG Time;
+    ULONGLONG Timeout;
+
+    Queue = &(Controller->AdminQueue);
+    NvmepSubmitCommand(Queue, Command);
+    NvmepKickQueue(Queue);
+    Time = HlQueryTimeCounter();
+    Timeout = Time + ((NVME_ADMIN_TIMEOUT_MS * HlQueryTimeCounterFrequency()) /
+                      MILLISECONDS_PER_SECOND);
+
+    Completion = &(Queue->CompletionQueue[Queue->CompletionHead]);
+    while ((Completion->Status & NVME_COMPLETION_PHASE) != Queue->Phase) {
+        Time = HlQueryTimeCounter();
+        if (Time > Timeout) {
+            RtlDebugPrint("NVMe: Admin command 0x%x timed out.\n",
+                          Command->Dword0 & 0xFF);
+
+            return STATUS_TIMEOUT;
+        }
+    }
+
+    RtlMemoryBarrier();
+    CompletionStatus = Completion->Status >> NVME_COMPLETION_STATUS_SHIFT;
+    if (Result != NULL) {
+        *Result = Completion->Dword0;
+    }
+
+    Queue->CompletionHead += 1;
+    if (Queue->CompletionHead == Queue->Size) {
+        Queue->CompletionHead = 0;
+        Queue->Phase ^= NVME_COMPLETION_PHASE;
+    }
+
+    NVME_WRITE(Controller,
+               NVME_COMPLETION_DOORBELL(Controller, Queue->QueueId),
+               Queue->CompletionHead);
+
+    if (CompletionStatus != 0) {
+        RtlDebugPrint("NVMe: Admin command 0x%x failed: 0x%x\n",
+                      Command->Dword0 & 0xFF,
+                      CompletionStatus);
+
+        return STATUS_DEVICE_IO_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+NvmepIdentify (
+    PNVME_CONTROLLER Controller,
+    ULONG Structure,
+    ULONG NamespaceId
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads an identify data structure into the controller's
+    identify buffer.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Structure - Supplies the structure to return. See NVME_IDENTIFY_*
+        definitions.
+
+    NamespaceId - Supplies the namespace to identify, if applicable.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    NVME_COMMAND Command;
+
+    if (Controller->IdentifyIoBuffer == NULL) {
+        Controller->IdentifyIoBuffer = MmAllocateNonPagedIoBuffer(
+                                        0,
+                                        MAX_ULONGLONG,
+                                        NVME_PAGE_SIZE,
+                                        NVME_PAGE_SIZE,
+                                        IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS);
+
+        if (Controller->IdentifyIoBuffer == NULL) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    RtlZeroMemory(Controller->IdentifyIoBuffer->Fragment[0].VirtualAddress,
+                  NVME_PAGE_SIZE);
+
+    RtlZeroMemory(&Command, sizeof(NVME_COMMAND));
+    Command.Dword0 = NVME_COMMAND_DWORD0(NVME_ADMIN_IDENTIFY, 0);
+    Command.NamespaceId = NamespaceId;
+    Command.Prp1 = Controller->IdentifyIoBuffer->Fragment[0].PhysicalAddress;
+    Command.Dword10 = Structure;
+    return NvmepExecuteAdminCommand(Controller, &Command, NULL);
+}
+
+VOID
+NvmepProcessCompletions (
+    PNVME_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reaps every new entry on a queue pair's completion queue and
+    tells the controller how far it got. The queue lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    USHORT CommandId;
+    volatile NVME_COMPLETION *Completion;
+    USHORT CompletionStatus;
+    PNVME_CONTROLLER Controller;
+    BOOL Processed;
+
+    ASSERT(KeIsSpinLockHeld(&(Queue->Lock)) != FALSE);
+
+    Controller = Queue->Controller;
+    Processed = FALSE;
+    while (TRUE) {
+        Completion = &(Queue->CompletionQueue[Queue->CompletionHead]);
+        CompletionStatus = Completion->Status;
+        if ((CompletionStatus & NVME_COMPLETION_PHASE) != Queue->Phase) {
+            break;
+        }
+
+        //
+        // Don't read the rest of the entry before the phase that covers it.
+        //
+
+        RtlMemoryBarrier();
+        CommandId = Completion->CommandId;
+        Queue->CompletionHead += 1;
+        if (Queue->CompletionHead == Queue->Size) {
+            Queue->CompletionHead = 0;
+            Queue->Phase ^= NVME_COMPLETION_PHASE;
+        }
+
+        Processed = TRUE;
+        if ((CommandId >= Queue->SlotCount) ||
+            (Queue->Slots[CommandId].Irp == NULL)) {
+
+            RtlDebugPrint("NVMe: Spurious completion %d on queue %d.\n",
+                          CommandId,
+                          Queue->QueueId);
+
+            continue;
+        }
+
+        NvmepCompleteSlot(Queue,
+                          &(Queue->Slots[CommandId]),
+                          CompletionStatus >> NVME_COMPLETION_STATUS_SHIFT);
+    }
+
+    if (Processed != FALSE) {
+        NVME_WRITE(Controller,
+                   NVME_COMPLETION_DOORBELL(Controller, Queue->QueueId),
+                   Queue->CompletionHead);
+    }
+
+    return;
+}
+
@@ -742,6 +742,7 @@ Return Value:
     ULONG BlockSize;
     PPARTITION_CHILD Child;
     PVOID Context;
+    PSYSTEM_CONTROL_DISCARD Discard;
     PSYSTEM_CONTROL_FILE_OPERATION FileOperation;
     ULONGLONG FileSize;
     PSYSTEM_CONTROL_LOOKUP Lookup;
@@ -878,6 +879,27 @@ Return Value:
         case IrpMinorSystemControlSynchronize:
             break;
 
+        //
+        // Translate discard requests into disk blocks in place, trimming any
+        // part that runs off the end of the partition.
+        //
+
+        case IrpMinorSystemControlDiscard:
+            if (Child->Index == -1) {
+                break;
+            }
+
+            Discard = (PSYSTEM_CONTROL_DISCARD)Context;
+            Status = PartTranslateIo(Partition,
+                                     &(Discard->BlockAddress),
+                                     &(Discard->BlockCount));
+
+            if (!KSUCCESS(Status)) {
+                IoCompleteIrp(PartDriver, Irp, Status);
+            }
+
+            break;
+
         //
         // Other operations are not supported.
         //
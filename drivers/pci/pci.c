@@ -3747,6 +3747,10 @@ Return Value:
             return "AHCI";
         }
 
+        if (Subclass == PCI_CLASS_MASS_STORAGE_NVME) {
+            return "NVMe";
+        }
+
         break;
 
     case PCI_CLASS_BRIDGE:
@@ -0,0 +1,1961 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    virtblk.c
+
+Abstract:
+
+    This module implements the virtio block device driver. It exposes a single
+    disk child and services I/O through one split virtqueue, using indirect
+    descriptors so that each request occupies a single ring slot.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/driver.h>
+#include <minoca/devinfo/block.h>
+#include <minoca/virtio/virtio.h>
+#include "virtblk.h"
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+VirtblkAddDevice (
+    PVOID Driver,
+    PCSTR DeviceId,
+    PCSTR ClassId,
+    PCSTR CompatibleIds,
+    PVOID DeviceToken
+    );
+
+VOID
+VirtblkDispatchStateChange (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtblkDispatchOpen (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtblkDispatchClose (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtblkDispatchIo (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtblkDispatchSystemControl (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtblkpDispatchControllerStateChange (
+    PIRP Irp,
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    );
+
+VOID
+VirtblkpDispatchDiskStateChange (
+    PIRP Irp,
+    PVIRTIO_BLOCK_DISK Disk
+    );
+
+VOID
+VirtblkpDispatchDiskSystemControl (
+    PIRP Irp,
+    PVIRTIO_BLOCK_DISK Disk
+    );
+
+KSTATUS
+VirtblkpStartController (
+    PIRP Irp,
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    );
+
+KSTATUS
+VirtblkpInitializeSlots (
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    );
+
+VOID
+VirtblkpEnumerateChildren (
+    PIRP Irp,
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    );
+
+INTERRUPT_STATUS
+VirtblkpInterruptService (
+    PVOID Context
+    );
+
+INTERRUPT_STATUS
+VirtblkpMsixInterruptService (
+    PVOID Context
+    );
+
+INTERRUPT_STATUS
+VirtblkpInterruptServiceDpc (
+    PVOID Context
+    );
+
+KSTATUS
+VirtblkpEnqueueIrp (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PIRP Irp
+    );
+
+VOID
+VirtblkpCompleteSlot (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot
+    );
+
+VOID
+VirtblkpBeginNextIrp (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot
+    );
+
+BOOL
+VirtblkpStartIrp (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot,
+    PIRP Irp
+    );
+
+KSTATUS
+VirtblkpStartBlockRequest (
+    PVOID Context,
+    PBLOCK_REQUEST Request
+    );
+
+KSTATUS
+VirtblkpSubmitReadWrite (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot,
+    PBLOCK_REQUEST Request
+    );
+
+KSTATUS
+VirtblkpSubmitFlush (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+PDRIVER VirtblkDriver = NULL;
+UUID VirtblkBlockQueueStatisticsUuid = BLOCK_QUEUE_STATISTICS_UUID;
+
+DRIVER_FUNCTION_TABLE VirtblkDriverFunctionTable = {
+    DRIVER_FUNCTION_TABLE_VERSION,
+    NULL,
+    VirtblkAddDevice,
+    NULL,
+    NULL,
+    VirtblkDispatchStateChange,
+    VirtblkDispatchOpen,
+    VirtblkDispatchClose,
+    VirtblkDispatchIo,
+    VirtblkDispatchSystemControl,
+    NULL
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+__USED
+KSTATUS
+DriverEntry (
+    PDRIVER Driver
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the entry point for the virtio block driver. It registers
+    its other dispatch functions, and performs driver-wide initialization.
+
+Arguments:
+
+    Driver - Supplies a pointer to the driver object.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    Failure code on error.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    VirtblkDriver = Driver;
+    Status = IoRegisterDriverFunctions(Driver, &VirtblkDriverFunctionTable);
+    return Status;
+}
+
+KSTATUS
+VirtblkAddDevice (
+    PVOID Driver,
+    PCSTR DeviceId,
+    PCSTR ClassId,
+    PCSTR CompatibleIds,
+    PVOID DeviceToken
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a device is detected for which the virtio
+    block driver acts as the function driver. The driver will attach itself to
+    the stack.
+
+Arguments:
+
+    Driver - Supplies a pointer to the driver being called.
+
+    DeviceId - Supplies a pointer to a string with the device ID.
+
+    ClassId - Supplies a pointer to a string containing the device's class ID.
+
+    CompatibleIds - Supplies a pointer to a string containing device IDs
+        that would be compatible with this device.
+
+    DeviceToken - Supplies an opaque token that the driver can use to identify
+        the device in the system. This token should be used when attaching to
+        the stack.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    Failure code if the driver was unsuccessful in attaching itself.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+    KSTATUS Status;
+
+    Controller = MmAllocateNonPagedPool(sizeof(VIRTIO_BLOCK_CONTROLLER),
+                                        VIRTIO_BLOCK_ALLOCATION_TAG);
+
+    if (Controller == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto AddDeviceEnd;
+    }
+
+    RtlZeroMemory(Controller, sizeof(VIRTIO_BLOCK_CONTROLLER));
+    Controller->Type = VirtioBlockContextController;
+    Controller->OsDevice = DeviceToken;
+    Controller->FreeSlot = VIRTIO_BLOCK_SLOT_NONE;
+    KeInitializeSpinLock(&(Controller->Lock));
+    INITIALIZE_LIST_HEAD(&(Controller->IrpQueue));
+    Controller->Disk.Type = VirtioBlockContextDisk;
+    Controller->Disk.Controller = Controller;
+    Status = VirtioInitializeDevice(&(Controller->Virtio), DeviceToken);
+    if (!KSUCCESS(Status)) {
+        goto AddDeviceEnd;
+    }
+
+    Status = IoAttachDriverToDevice(Driver, DeviceToken, Controller);
+    if (!KSUCCESS(Status)) {
+        goto AddDeviceEnd;
+    }
+
+AddDeviceEnd:
+    if (!KSUCCESS(Status)) {
+        if (Controller != NULL) {
+            MmFreeNonPagedPool(Controller);
+        }
+    }
+
+    return Status;
+}
+
+VOID
+VirtblkDispatchStateChange (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles State Change IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+
+    Controller = DeviceContext;
+    switch (Controller->Type) {
+    case VirtioBlockContextController:
+        VirtblkpDispatchControllerStateChange(Irp, Controller);
+        break;
+
+    case VirtioBlockContextDisk:
+        VirtblkpDispatchDiskStateChange(Irp, (PVIRTIO_BLOCK_DISK)Controller);
+        break;
+
+    default:
+
+        ASSERT(FALSE);
+
+        IoCompleteIrp(VirtblkDriver, Irp, STATUS_INVALID_CONFIGURATION);
+        break;
+    }
+
+    return;
+}
+
+VOID
+VirtblkDispatchOpen (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles Open IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_DISK Disk;
+
+    //
+    // Only the disk can be opened or closed.
+    //
+
+    Disk = (PVIRTIO_BLOCK_DISK)DeviceContext;
+    if (Disk->Type != VirtioBlockContextDisk) {
+        return;
+    }
+
+    Irp->U.Open.DeviceContext = Disk;
+    IoCompleteIrp(VirtblkDriver, Irp, STATUS_SUCCESS);
+    return;
+}
+
+VOID
+VirtblkDispatchClose (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles Close IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_DISK Disk;
+
+    Disk = (PVIRTIO_BLOCK_DISK)DeviceContext;
+    if (Disk->Type != VirtioBlockContextDisk) {
+        return;
+    }
+
+    IoCompleteIrp(VirtblkDriver, Irp, STATUS_SUCCESS);
+    return;
+}
+
+VOID
+VirtblkDispatchIo (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles I/O IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    BOOL CompleteIrp;
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+    PVIRTIO_BLOCK_DISK Disk;
+    ULONG IrpReadWriteFlags;
+    BOOL PmReferenceAdded;
+    KSTATUS Status;
+    BOOL Write;
+
+    Disk = (PVIRTIO_BLOCK_DISK)Irp->U.ReadWrite.DeviceContext;
+    if (Disk->Type != VirtioBlockContextDisk) {
+        return;
+    }
+
+    Controller = Disk->Controller;
+    CompleteIrp = TRUE;
+    Write = FALSE;
+    if (Irp->MinorCode == IrpMinorIoWrite) {
+        Write = TRUE;
+    }
+
+    //
+    // If this IRP is on the way down, always add a power management reference.
+    //
+
+    PmReferenceAdded = FALSE;
+    if (Irp->Direction == IrpDown) {
+        Status = PmDeviceAddReference(Disk->OsDevice);
+        if (!KSUCCESS(Status)) {
+            goto DispatchIoEnd;
+        }
+
+        PmReferenceAdded = TRUE;
+    }
+
+    IrpReadWriteFlags = IRP_READ_WRITE_FLAG_DMA;
+    if (Write != FALSE) {
+        IrpReadWriteFlags |= IRP_READ_WRITE_FLAG_WRITE;
+    }
+
+    //
+    // If the IRP is on the way up, then clean up after the DMA. An IRP going
+    // up is already complete.
+    //
+
+    if (Irp->Direction == IrpUp) {
+        CompleteIrp = FALSE;
+        PmDeviceReleaseReference(Disk->OsDevice);
+        Status = IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
+        if (!KSUCCESS(Status)) {
+            IoUpdateIrpStatus(Irp, Status);
+        }
+
+    } else {
+        if ((Write != FALSE) &&
+            (VIRTIO_HAS_FEATURE(&(Controller->Virtio),
+                                VIRTIO_BLOCK_FEATURE_READ_ONLY))) {
+
+            Status = STATUS_ACCESS_DENIED;
+            goto DispatchIoEnd;
+        }
+
+        Irp->U.ReadWrite.NewIoOffset = Irp->U.ReadWrite.IoOffset;
+        Status = IoPrepareReadWriteIrp(&(Irp->U.ReadWrite),
+                                       Controller->BlockSize,
+                                       0,
+                                       MAX_ULONGLONG,
+                                       IrpReadWriteFlags);
+
+        if (!KSUCCESS(Status)) {
+            goto DispatchIoEnd;
+        }
+
+        CompleteIrp = FALSE;
+        Status = IoQueueBlockIrp(Controller->BlockQueue, Irp);
+        if (!KSUCCESS(Status)) {
+            IoCompleteReadWriteIrp(&(Irp->U.ReadWrite), IrpReadWriteFlags);
+            CompleteIrp = TRUE;
+        }
+    }
+
+DispatchIoEnd:
+    if (CompleteIrp != FALSE) {
+        if (PmReferenceAdded != FALSE) {
+            PmDeviceReleaseReference(Disk->OsDevice);
+        }
+
+        IoCompleteIrp(VirtblkDriver, Irp, Status);
+    }
+
+    return;
+}
+
+VOID
+VirtblkDispatchSystemControl (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles System Control IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_DISK Disk;
+
+    ASSERT(Irp->MajorCode == IrpMajorSystemControl);
+
+    Disk = (PVIRTIO_BLOCK_DISK)DeviceContext;
+    if (Disk->Type == VirtioBlockContextDisk) {
+        VirtblkpDispatchDiskSystemControl(Irp, Disk);
+    }
+
+    return;
+}
+
+INTERRUPT_STATUS
+VirtblkpInterruptService (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the legacy interrupt service routine for a virtio
+    block device. Reading the ISR status register acknowledges the interrupt.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the controller.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+    UCHAR IsrStatus;
+
+    Controller = Context;
+    IsrStatus = VirtioReadIsrStatus(&(Controller->Virtio));
+    if (IsrStatus == 0) {
+        return InterruptStatusNotClaimed;
+    }
+
+    RtlAtomicOr32(&(Controller->PendingInterrupts), IsrStatus);
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+VirtblkpMsixInterruptService (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the interrupt service routine for the request
+    queue's MSI-X vector. The vector is not shared, so there's nothing to
+    check.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the controller.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+
+    Controller = Context;
+    RtlAtomicOr32(&(Controller->PendingInterrupts),
+                  VIRTIO_ISR_QUEUE_INTERRUPT);
+
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+VirtblkpInterruptServiceDpc (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the dispatch level interrupt service, which reaps
+    completed requests and starts queued ones.
+
+Arguments:
+
+    Context - Supplies the context, in this case the controller structure.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+    ULONG Length;
+    ULONG PendingBits;
+    PVIRTIO_QUEUE Queue;
+    PVIRTIO_BLOCK_SLOT Slot;
+
+    Controller = Context;
+    PendingBits = RtlAtomicExchange32(&(Controller->PendingInterrupts), 0);
+    if (PendingBits == 0) {
+        return InterruptStatusNotClaimed;
+    }
+
+    if ((PendingBits & VIRTIO_ISR_QUEUE_INTERRUPT) == 0) {
+        return InterruptStatusClaimed;
+    }
+
+    Queue = Controller->Queue;
+    KeAcquireSpinLock(&(Controller->Lock));
+
+    //
+    // Keep interrupts quiet while draining the used ring, and go around
+    // again if completions raced with turning them back on.
+    //
+
+    do {
+        VirtioQueueDisableInterrupts(Queue);
+        while (TRUE) {
+            Slot = VirtioQueueGetUsedBuffer(Queue, &Length);
+            if (Slot == NULL) {
+                break;
+            }
+
+            VirtblkpCompleteSlot(Controller, Slot);
+        }
+
+    } while (VirtioQueueEnableInterrupts(Queue, 0) != FALSE);
+
+    VirtioQueueKick(Queue);
+    KeReleaseSpinLock(&(Controller->Lock));
+
+    //
+    // Feed the block queue into any slots that just freed up.
+    //
+
+    IoRunBlockQueue(Controller->BlockQueue);
+    return InterruptStatusClaimed;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+VirtblkpDispatchControllerStateChange (
+    PIRP Irp,
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles state change IRPs for a virtio block controller.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Controller - Supplies a pointer to the controller context.
+
+Return Value:
+
+    None. The routine completes the IRP if appropriate.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    if (Irp->Direction == IrpUp) {
+        if (!KSUCCESS(IoGetIrpStatus(Irp))) {
+            return;
+        }
+
+        switch (Irp->MinorCode) {
+        case IrpMinorQueryResources:
+            Status = VirtioProcessResourceRequirements(
+                                                   &(Controller->Virtio),
+                                                   Irp,
+                                                   VIRTIO_BLOCK_VECTOR_COUNT);
+
+            if (!KSUCCESS(Status)) {
+                IoCompleteIrp(VirtblkDriver, Irp, Status);
+            }
+
+            break;
+
+        case IrpMinorStartDevice:
+            Status = VirtblkpStartController(Irp, Controller);
+            if (!KSUCCESS(Status)) {
+                IoCompleteIrp(VirtblkDriver, Irp, Status);
+            }
+
+            break;
+
+        case IrpMinorQueryChildren:
+            VirtblkpEnumerateChildren(Irp, Controller);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return;
+}
+
+VOID
+VirtblkpDispatchDiskStateChange (
+    PIRP Irp,
+    PVIRTIO_BLOCK_DISK Disk
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles state change IRPs for the virtio block disk.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Disk - Supplies a pointer to the disk.
+
+Return Value:
+
+    None. The routine completes the IRP if appropriate.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    if (Irp->Direction == IrpDown) {
+        switch (Irp->MinorCode) {
+        case IrpMinorStartDevice:
+
+            ASSERT(Disk->OsDevice == Irp->Device);
+
+            Status = PmInitialize(Irp->Device);
+            if (KSUCCESS(Status)) {
+
+                //
+                // Publish the block queue statistics.
+                //
+
+                Status = IoRegisterDeviceInformation(
+                                            Irp->Device,
+                                            &VirtblkBlockQueueStatisticsUuid,
+                                            TRUE);
+            }
+
+            IoCompleteIrp(VirtblkDriver, Irp, Status);
+            break;
+
+        case IrpMinorRemoveDevice:
+            IoRegisterDeviceInformation(Irp->Device,
+                                        &VirtblkBlockQueueStatisticsUuid,
+                                        FALSE);
+
+            IoCompleteIrp(VirtblkDriver, Irp, STATUS_SUCCESS);
+            break;
+
+        case IrpMinorQueryResources:
+        case IrpMinorQueryChildren:
+        case IrpMinorIdle:
+        case IrpMinorSuspend:
+        case IrpMinorResume:
+            IoCompleteIrp(VirtblkDriver, Irp, STATUS_SUCCESS);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return;
+}
+
+VOID
+VirtblkpDispatchDiskSystemControl (
+    PIRP Irp,
+    PVIRTIO_BLOCK_DISK Disk
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles System Control IRPs for the virtio block disk.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Disk - Supplies a pointer to the disk.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONGLONG BlockCount;
+    ULONG BlockSize;
+    PVOID Context;
+    PSYSTEM_CONTROL_FILE_OPERATION FileOperation;
+    PSYSTEM_CONTROL_LOOKUP Lookup;
+    PFILE_PROPERTIES Properties;
+    ULONGLONG PropertiesFileSize;
+    KSTATUS Status;
+
+    Context = Irp->U.SystemControl.SystemContext;
+    BlockSize = Disk->Controller->BlockSize;
+    BlockCount = Disk->Controller->BlockCount;
+    if (Irp->Direction == IrpUp) {
+
+        ASSERT(Irp->MinorCode == IrpMinorSystemControlSynchronize);
+
+        PmDeviceReleaseReference(Disk->OsDevice);
+        return;
+    }
+
+    switch (Irp->MinorCode) {
+    case IrpMinorSystemControlLookup:
+        Lookup = (PSYSTEM_CONTROL_LOOKUP)Context;
+        Status = STATUS_PATH_NOT_FOUND;
+        if (Lookup->Root != FALSE) {
+
+            //
+            // Enable opening of the root as a single file.
+            //
+
+            Properties = Lookup->Properties;
+            Properties->FileId = 0;
+            Properties->Type = IoObjectBlockDevice;
+            Properties->HardLinkCount = 1;
+            Properties->BlockSize = BlockSize;
+            Properties->BlockCount = BlockCount;
+            Properties->Size = BlockCount * BlockSize;
+            Status = STATUS_SUCCESS;
+        }
+
+        IoCompleteIrp(VirtblkDriver, Irp, Status);
+        break;
+
+    //
+    // Writes to the disk's properties are not allowed. Fail if the data
+    // has changed.
+    //
+
+    case IrpMinorSystemControlWriteFileProperties:
+        FileOperation = (PSYSTEM_CONTROL_FILE_OPERATION)Context;
+        Properties = FileOperation->FileProperties;
+        PropertiesFileSize = Properties->Size;
+        if ((Properties->FileId != 0) ||
+            (Properties->Type != IoObjectBlockDevice) ||
+            (Properties->HardLinkCount != 1) ||
+            (Properties->BlockSize != BlockSize) ||
+            (Properties->BlockCount != BlockCount) ||
+            (PropertiesFileSize != (BlockCount * BlockSize))) {
+
+            Status = STATUS_NOT_SUPPORTED;
+
+        } else {
+            Status = STATUS_SUCCESS;
+        }
+
+        IoCompleteIrp(VirtblkDriver, Irp, Status);
+        break;
+
+    case IrpMinorSystemControlTruncate:
+        IoCompleteIrp(VirtblkDriver, Irp, STATUS_NOT_SUPPORTED);
+        break;
+
+    case IrpMinorSystemControlDeviceInformation:
+        IoHandleBlockQueueDeviceInformation(Disk->Controller->BlockQueue, Irp);
+        break;
+
+    //
+    // Send a flush to the device upon getting a synchronize request.
+    //
+
+    case IrpMinorSystemControlSynchronize:
+        Status = PmDeviceAddReference(Disk->OsDevice);
+        if (!KSUCCESS(Status)) {
+            IoCompleteIrp(VirtblkDriver, Irp, Status);
+            break;
+        }
+
+        Status = VirtblkpEnqueueIrp(Disk->Controller, Irp);
+        if (!KSUCCESS(Status)) {
+            PmDeviceReleaseReference(Disk->OsDevice);
+            IoCompleteIrp(VirtblkDriver, Irp, Status);
+        }
+
+        break;
+
+    default:
+
+        ASSERT(FALSE);
+
+        break;
+    }
+
+    return;
+}
+
+KSTATUS
+VirtblkpStartController (
+    PIRP Irp,
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts a virtio block device: it negotiates features, reads
+    the disk geometry, and sets up the request queue and interrupts.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG BlockSize;
+    BLOCK_QUEUE_PARAMETERS BlockQueueParameters;
+    ULONGLONG Capacity;
+    ULONGLONG Features;
+    PINTERRUPT_SERVICE_ROUTINE InterruptService;
+    ULONG SegmentMax;
+    ULONG SizeMax;
+    KSTATUS Status;
+    PVIRTIO_DEVICE Virtio;
+
+    Virtio = &(Controller->Virtio);
+    Status = PmInitialize(Irp->Device);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // The queue survives across restarts.
+    //
+
+    if (Controller->Queue != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    Status = PmDeviceAddReference(Irp->Device);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    Status = VirtioStartDevice(Virtio, Irp);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    Features = (1ULL << VIRTIO_BLOCK_FEATURE_SIZE_MAX) |
+               (1ULL << VIRTIO_BLOCK_FEATURE_SEGMENT_MAX) |
+               (1ULL << VIRTIO_BLOCK_FEATURE_READ_ONLY) |
+               (1ULL << VIRTIO_BLOCK_FEATURE_BLOCK_SIZE) |
+               (1ULL << VIRTIO_BLOCK_FEATURE_FLUSH);
+
+    Status = VirtioNegotiateFeatures(Virtio, Features);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    //
+    // Read the geometry. The capacity is always in 512 byte sectors.
+    //
+
+    Capacity = VIRTIO_READ_DEVICE_CONFIG32(Virtio,
+                                           VIRTIO_BLOCK_CONFIG_CAPACITY);
+
+    Capacity |= (ULONGLONG)VIRTIO_READ_DEVICE_CONFIG32(
+                                      Virtio,
+                                      VIRTIO_BLOCK_CONFIG_CAPACITY + 4) << 32;
+
+    BlockSize = VIRTIO_BLOCK_SECTOR_SIZE;
+    if (VIRTIO_HAS_FEATURE(Virtio, VIRTIO_BLOCK_FEATURE_BLOCK_SIZE)) {
+        BlockSize = VIRTIO_READ_DEVICE_CONFIG32(Virtio,
+                                                VIRTIO_BLOCK_CONFIG_BLOCK_SIZE);
+
+        if ((BlockSize < VIRTIO_BLOCK_SECTOR_SIZE) ||
+            (POWER_OF_2(BlockSize) == FALSE)) {
+
+            BlockSize = VIRTIO_BLOCK_SECTOR_SIZE;
+        }
+    }
+
+    Controller->BlockSize = BlockSize;
+    Controller->BlockCount = (Capacity * VIRTIO_BLOCK_SECTOR_SIZE) / BlockSize;
+    Controller->MaxSegments = VIRTIO_BLOCK_MAX_SEGMENTS;
+    if (VIRTIO_HAS_FEATURE(Virtio, VIRTIO_BLOCK_FEATURE_SEGMENT_MAX)) {
+        SegmentMax = VIRTIO_READ_DEVICE_CONFIG32(
+                                              Virtio,
+                                              VIRTIO_BLOCK_CONFIG_SEGMENT_MAX);
+
+        if ((SegmentMax != 0) && (SegmentMax < Controller->MaxSegments)) {
+            Controller->MaxSegments = SegmentMax;
+        }
+    }
+
+    //
+    // Keep every segment a whole number of blocks so that a request
+    // truncated at the segment limit still ends on a block boundary.
+    //
+
+    SizeMax = VIRTIO_BLOCK_DEFAULT_MAX_SEGMENT_SIZE;
+    if (VIRTIO_HAS_FEATURE(Virtio, VIRTIO_BLOCK_FEATURE_SIZE_MAX)) {
+        SizeMax = VIRTIO_READ_DEVICE_CONFIG32(Virtio,
+                                              VIRTIO_BLOCK_CONFIG_SIZE_MAX);
+
+        if (SizeMax > VIRTIO_BLOCK_DEFAULT_MAX_SEGMENT_SIZE) {
+            SizeMax = VIRTIO_BLOCK_DEFAULT_MAX_SEGMENT_SIZE;
+        }
+    }
+
+    SizeMax = ALIGN_RANGE_DOWN(SizeMax, BlockSize);
+    if (SizeMax == 0) {
+        SizeMax = BlockSize;
+    }
+
+    Controller->MaxSegmentSize = SizeMax;
+
+    //
+    // Connect the interrupt before creating the queue so that the MSI-X
+    // vector is live by the time the device is told about it.
+    //
+
+    InterruptService = VirtblkpInterruptService;
+    if ((Virtio->Flags & VIRTIO_DEVICE_FLAG_MSI_X_ENABLED) != 0) {
+        InterruptService = VirtblkpMsixInterruptService;
+    }
+
+    Status = VirtioConnectInterrupt(Virtio,
+                                    VIRTIO_BLOCK_QUEUE_VECTOR,
+                                    -1,
+                                    InterruptService,
+                                    VirtblkpInterruptServiceDpc,
+                                    NULL,
+                                    Controller);
+
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    Status = VirtioEnableMsiX(Virtio);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    VirtioSetConfigurationVector(Virtio, VIRTIO_MSI_NO_VECTOR);
+    Status = VirtioCreateQueue(Virtio,
+                               0,
+                               VIRTIO_BLOCK_MAX_QUEUE_SIZE,
+                               Controller->MaxSegments + 2,
+                               VIRTIO_BLOCK_QUEUE_VECTOR,
+                               &(Controller->Queue));
+
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    Status = VirtblkpInitializeSlots(Controller);
+    if (!KSUCCESS(Status)) {
+        goto StartControllerEnd;
+    }
+
+    //
+    // Put a block queue in front of the slots so that reads and writes get
+    // merged and scheduled. Merge no further than one request can carry.
+    //
+
+    RtlZeroMemory(&BlockQueueParameters, sizeof(BLOCK_QUEUE_PARAMETERS));
+    BlockQueueParameters.Version = BLOCK_QUEUE_PARAMETERS_VERSION;
+    BlockQueueParameters.Driver = VirtblkDriver;
+    BlockQueueParameters.Context = Controller;
+    BlockQueueParameters.StartRequest = VirtblkpStartBlockRequest;
+    BlockQueueParameters.BlockSize = BlockSize;
+    BlockQueueParameters.MaxTransferSize = (UINTN)Controller->MaxSegments *
+                                           Controller->MaxSegmentSize;
+
+    BlockQueueParameters.MaxSegments = Controller->MaxSegments;
+    BlockQueueParameters.MaxDepth = Controller->SlotCount;
+    Controller->BlockQueue = IoCreateBlockQueue(&BlockQueueParameters);
+    if (Controller->BlockQueue == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto StartControllerEnd;
+    }
+
+    VirtioSetDriverOk(Virtio);
+    Status = STATUS_SUCCESS;
+
+StartControllerEnd:
+    if (!KSUCCESS(Status)) {
+        VirtioDestroyDevice(Virtio);
+        if (Controller->Queue != NULL) {
+            VirtioDestroyQueue(Controller->Queue);
+            Controller->Queue = NULL;
+        }
+
+        if (Controller->RequestIoBuffer != NULL) {
+            MmFreeIoBuffer(Controller->RequestIoBuffer);
+            Controller->RequestIoBuffer = NULL;
+        }
+
+        if (Controller->Slots != NULL) {
+            MmFreeNonPagedPool(Controller->Slots);
+            Controller->Slots = NULL;
+        }
+
+        if (Controller->Scatter != NULL) {
+            MmFreeNonPagedPool(Controller->Scatter);
+            Controller->Scatter = NULL;
+        }
+
+        if (Controller->BlockQueue != NULL) {
+            IoDestroyBlockQueue(Controller->BlockQueue);
+            Controller->BlockQueue = NULL;
+        }
+    }
+
+    PmDeviceReleaseReference(Irp->Device);
+    return Status;
+}
+
+KSTATUS
+VirtblkpInitializeSlots (
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sizes and allocates the request slots. With indirect
+    descriptors each request takes one ring descriptor, otherwise each takes
+    one per segment plus two.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    ULONG Index;
+    PVIRTIO_QUEUE Queue;
+    PHYSICAL_ADDRESS RequestPhysical;
+    PVIRTIO_BLOCK_REQUEST Requests;
+    PVIRTIO_BLOCK_SLOT Slot;
+    ULONG SlotCount;
+
+    Queue = Controller->Queue;
+    if (Queue->IndirectEntryCount != 0) {
+        SlotCount = Queue->Size;
+
+    } else {
+        if (Controller->MaxSegments + 2 > Queue->Size) {
+            Controller->MaxSegments = Queue->Size - 2;
+        }
+
+        SlotCount = Queue->Size / (Controller->MaxSegments + 2);
+    }
+
+    ASSERT((SlotCount != 0) && (Controller->MaxSegments != 0));
+
+    AllocationSize = SlotCount * sizeof(VIRTIO_BLOCK_REQUEST);
+    Controller->RequestIoBuffer = MmAllocateNonPagedIoBuffer(
+                                        0,
+                                        MAX_ULONGLONG,
+                                        sizeof(VIRTIO_BLOCK_REQUEST),
+                                        AllocationSize,
+                                        IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS);
+
+    if (Controller->RequestIoBuffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Requests = Controller->RequestIoBuffer->Fragment[0].VirtualAddress;
+    RequestPhysical = Controller->RequestIoBuffer->Fragment[0].PhysicalAddress;
+    RtlZeroMemory(Requests, AllocationSize);
+    Controller->Slots = MmAllocateNonPagedPool(
+                                        SlotCount * sizeof(VIRTIO_BLOCK_SLOT),
+                                        VIRTIO_BLOCK_ALLOCATION_TAG);
+
+    if (Controller->Slots == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Controller->Scatter = MmAllocateNonPagedPool(
+                   (Controller->MaxSegments + 2) * sizeof(VIRTIO_SCATTER_ENTRY),
+                   VIRTIO_BLOCK_ALLOCATION_TAG);
+
+    if (Controller->Scatter == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (Index = 0; Index < SlotCount; Index += 1) {
+        Slot = &(Controller->Slots[Index]);
+        Slot->Irp = NULL;
+        Slot->BlockRequest = NULL;
+        Slot->IoSize = 0;
+        Slot->Request = &(Requests[Index]);
+        Slot->RequestPhysical = RequestPhysical +
+                                (Index * sizeof(VIRTIO_BLOCK_REQUEST));
+
+        Slot->NextFree = Index + 1;
+    }
+
+    Controller->Slots[SlotCount - 1].NextFree = VIRTIO_BLOCK_SLOT_NONE;
+    Controller->FreeSlot = 0;
+    Controller->SlotCount = SlotCount;
+    return STATUS_SUCCESS;
+}
+
+VOID
+VirtblkpEnumerateChildren (
+    PIRP Irp,
+    PVIRTIO_BLOCK_CONTROLLER Controller
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reports the single disk child of a virtio block device.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    Controller - Supplies a pointer to the controller.
+
+Return Value:
+
+    None. The IRP is completed with the appropriate status.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    if (Controller->Disk.OsDevice == NULL) {
+        Status = IoCreateDevice(VirtblkDriver,
+                                &(Controller->Disk),
+                                Irp->Device,
+                                "Disk",
+                                DISK_CLASS_ID,
+                                NULL,
+                                &(Controller->Disk.OsDevice));
+
+        if (!KSUCCESS(Status)) {
+            goto EnumerateChildrenEnd;
+        }
+    }
+
+    Status = IoMergeChildArrays(Irp,
+                                &(Controller->Disk.OsDevice),
+                                1,
+                                VIRTIO_BLOCK_ALLOCATION_TAG);
+
+EnumerateChildrenEnd:
+    IoCompleteIrp(VirtblkDriver, Irp, Status);
+    return;
+}
+
+KSTATUS
+VirtblkpEnqueueIrp (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine begins a flush for a synchronize IRP, or queues it if all
+    the request slots are busy. Reads and writes go through the block queue
+    instead.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Irp - Supplies a pointer to the synchronize IRP.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP was successfully started or even queued.
+
+    Error code on failure.
+
+--*/
+
+{
+
+    RUNLEVEL OldRunLevel;
+    PVIRTIO_BLOCK_SLOT Slot;
+
+    IoPendIrp(VirtblkDriver, Irp);
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Controller->Lock));
+    if (Controller->FreeSlot == VIRTIO_BLOCK_SLOT_NONE) {
+        INSERT_BEFORE(&(Irp->ListEntry), &(Controller->IrpQueue));
+
+    } else {
+        Slot = &(Controller->Slots[Controller->FreeSlot]);
+        Controller->FreeSlot = Slot->NextFree;
+        if (VirtblkpStartIrp(Controller, Slot, Irp) == FALSE) {
+            VirtblkpBeginNextIrp(Controller, Slot);
+        }
+
+        VirtioQueueKick(Controller->Queue);
+    }
+
+    KeReleaseSpinLock(&(Controller->Lock));
+    KeLowerRunLevel(OldRunLevel);
+    return STATUS_SUCCESS;
+}
+
+VOID
+VirtblkpCompleteSlot (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles a request the device has finished. It either
+    continues the transfer with the next piece, or completes it and moves on
+    to the next queued synchronize IRP. The controller lock must be held.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Slot - Supplies a pointer to the finished slot.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PBLOCK_REQUEST BlockRequest;
+    UINTN IoSize;
+    PIRP Irp;
+    KSTATUS Status;
+
+    ASSERT(KeIsSpinLockHeld(&(Controller->Lock)) != FALSE);
+
+    BlockRequest = Slot->BlockRequest;
+    Irp = Slot->Irp;
+    IoSize = Slot->IoSize;
+    Slot->IoSize = 0;
+
+    ASSERT((Irp != NULL) || (BlockRequest != NULL));
+
+    switch (Slot->Request->Status) {
+    case VIRTIO_BLOCK_STATUS_OK:
+        Status = STATUS_SUCCESS;
+        break;
+
+    case VIRTIO_BLOCK_STATUS_UNSUPPORTED:
+        Status = STATUS_NOT_SUPPORTED;
+        break;
+
+    case VIRTIO_BLOCK_STATUS_IO_ERROR:
+    default:
+        RtlDebugPrint("VirtioBlock: I/O error %d\n", Slot->Request->Status);
+        Status = STATUS_DEVICE_IO_ERROR;
+        break;
+    }
+
+    if ((KSUCCESS(Status)) && (BlockRequest != NULL)) {
+        BlockRequest->IoBytesCompleted += IoSize;
+
+        //
+        // If this is a synchronized write, then send a flush along with it.
+        // Use the I/O size as a hint as to whether or not the flush part has
+        // already gone around.
+        //
+
+        if ((BlockRequest->MinorCode == IrpMinorIoWrite) &&
+            ((BlockRequest->IoFlags & IO_FLAG_DATA_SYNCHRONIZED) != 0) &&
+            (BlockRequest->IoBytesCompleted >= BlockRequest->IoSizeInBytes) &&
+            (IoSize != 0) &&
+            (VIRTIO_HAS_FEATURE(&(Controller->Virtio),
+                                VIRTIO_BLOCK_FEATURE_FLUSH))) {
+
+            Status = VirtblkpSubmitFlush(Controller, Slot);
+            if (KSUCCESS(Status)) {
+                return;
+            }
+
+        } else if (BlockRequest->IoBytesCompleted <
+                   BlockRequest->IoSizeInBytes) {
+
+            Status = VirtblkpSubmitReadWrite(Controller, Slot, BlockRequest);
+            if (KSUCCESS(Status)) {
+                return;
+            }
+        }
+    }
+
+    if (BlockRequest != NULL) {
+        Slot->BlockRequest = NULL;
+        IoCompleteBlockRequest(BlockRequest, Status);
+
+    } else {
+        Slot->Irp = NULL;
+        IoCompleteIrp(VirtblkDriver, Irp, Status);
+    }
+
+    VirtblkpBeginNextIrp(Controller, Slot);
+    return;
+}
+
+VOID
+VirtblkpBeginNextIrp (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts the next queued synchronize IRP on the given slot, or
+    frees the slot if there is nothing queued. The controller lock must be
+    held.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Slot - Supplies a pointer to the idle slot.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PIRP Irp;
+
+    ASSERT(KeIsSpinLockHeld(&(Controller->Lock)) != FALSE);
+
+    while (!LIST_EMPTY(&(Controller->IrpQueue))) {
+        Irp = LIST_VALUE(Controller->IrpQueue.Next, IRP, ListEntry);
+        LIST_REMOVE(&(Irp->ListEntry));
+        if (VirtblkpStartIrp(Controller, Slot, Irp) != FALSE) {
+            return;
+        }
+    }
+
+    Slot->Irp = NULL;
+    Slot->NextFree = Controller->FreeSlot;
+    Controller->FreeSlot = Slot - Controller->Slots;
+    return;
+}
+
+BOOL
+VirtblkpStartIrp (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits the flush for a synchronize IRP on the given slot.
+    If the IRP cannot be started it is completed. The controller lock must be
+    held.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Slot - Supplies a pointer to the slot to use.
+
+    Irp - Supplies a pointer to the IRP to start.
+
+Return Value:
+
+    TRUE if the slot is now in use.
+
+    FALSE if the IRP was completed immediately and the slot is still free.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    ASSERT((Irp->MajorCode == IrpMajorSystemControl) &&
+           (Irp->MinorCode == IrpMinorSystemControlSynchronize));
+
+    //
+    // Devices without a write cache to flush are always synchronized.
+    //
+
+    if (!VIRTIO_HAS_FEATURE(&(Controller->Virtio),
+                            VIRTIO_BLOCK_FEATURE_FLUSH)) {
+
+        Status = STATUS_SUCCESS;
+        goto StartIrpEnd;
+    }
+
+    Slot->Irp = Irp;
+    Status = VirtblkpSubmitFlush(Controller, Slot);
+    if (KSUCCESS(Status)) {
+        return TRUE;
+    }
+
+StartIrpEnd:
+    Slot->Irp = NULL;
+    IoCompleteIrp(VirtblkDriver, Irp, Status);
+    return FALSE;
+}
+
+KSTATUS
+VirtblkpStartBlockRequest (
+    PVOID Context,
+    PBLOCK_REQUEST Request
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called by the block queue to hand a read or write request
+    to the device.
+
+Arguments:
+
+    Context - Supplies the context pointer given when the block queue was
+        created. In this case, this points to the controller.
+
+    Request - Supplies a pointer to the request to start.
+
+Return Value:
+
+    STATUS_SUCCESS if the request was submitted.
+
+    STATUS_RESOURCE_IN_USE if all the slots are busy.
+
+    Other error codes if the request could not be submitted.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+    PVIRTIO_BLOCK_SLOT Slot;
+    KSTATUS Status;
+
+    Controller = Context;
+    KeAcquireSpinLock(&(Controller->Lock));
+    if (Controller->FreeSlot == VIRTIO_BLOCK_SLOT_NONE) {
+        Status = STATUS_RESOURCE_IN_USE;
+        goto StartBlockRequestEnd;
+    }
+
+    Slot = &(Controller->Slots[Controller->FreeSlot]);
+    Controller->FreeSlot = Slot->NextFree;
+    Slot->BlockRequest = Request;
+    Status = VirtblkpSubmitReadWrite(Controller, Slot, Request);
+    if (!KSUCCESS(Status)) {
+        Slot->BlockRequest = NULL;
+        VirtblkpBeginNextIrp(Controller, Slot);
+    }
+
+    VirtioQueueKick(Controller->Queue);
+
+StartBlockRequestEnd:
+    KeReleaseSpinLock(&(Controller->Lock));
+    return Status;
+}
+
+KSTATUS
+VirtblkpSubmitReadWrite (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot,
+    PBLOCK_REQUEST Request
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills out and submits the next piece of a read or write
+    request. As much of the remaining transfer as fits in the segment limit is
+    sent.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Slot - Supplies a pointer to the slot to use.
+
+    Request - Supplies a pointer to the block queue request.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN BytesPreviouslyCompleted;
+    UINTN BytesToComplete;
+    UINTN EntrySize;
+    PIO_BUFFER_FRAGMENT Fragment;
+    UINTN FragmentIndex;
+    UINTN FragmentOffset;
+    PIO_BUFFER IoBuffer;
+    UINTN IoBufferOffset;
+    ULONGLONG IoOffset;
+    PVIRTIO_BLOCK_REQUEST SlotRequest;
+    PVIRTIO_SCATTER_ENTRY Scatter;
+    ULONG ScatterCount;
+    ULONG SegmentFlags;
+    UINTN TransferSize;
+    UINTN TransferSizeRemaining;
+
+    IoBuffer = Request->IoBuffer;
+    BytesPreviouslyCompleted = Request->IoBytesCompleted;
+    BytesToComplete = Request->IoSizeInBytes;
+    IoOffset = Request->IoOffset + BytesPreviouslyCompleted;
+
+    ASSERT(BytesPreviouslyCompleted < BytesToComplete);
+    ASSERT(IS_ALIGNED(IoOffset, Controller->BlockSize) != FALSE);
+
+    TransferSize = BytesToComplete - BytesPreviouslyCompleted;
+    SlotRequest = Slot->Request;
+    SlotRequest->Header.Type = VIRTIO_BLOCK_REQUEST_IN;
+    SegmentFlags = VIRTIO_SCATTER_DEVICE_WRITABLE;
+    if (Request->MinorCode == IrpMinorIoWrite) {
+        SlotRequest->Header.Type = VIRTIO_BLOCK_REQUEST_OUT;
+        SegmentFlags = 0;
+    }
+
+    SlotRequest->Header.Reserved = 0;
+    SlotRequest->Header.Sector = IoOffset / VIRTIO_BLOCK_SECTOR_SIZE;
+    SlotRequest->Status = VIRTIO_BLOCK_STATUS_IO_ERROR;
+    Scatter = Controller->Scatter;
+    Scatter[0].PhysicalAddress = Slot->RequestPhysical;
+    Scatter[0].Length = sizeof(VIRTIO_BLOCK_REQUEST_HEADER);
+    Scatter[0].Flags = 0;
+    ScatterCount = 1;
+
+    //
+    // Get to the current spot in the I/O buffer.
+    //
+
+    IoBufferOffset = MmGetIoBufferCurrentOffset(IoBuffer);
+    IoBufferOffset += BytesPreviouslyCompleted;
+    FragmentIndex = 0;
+    FragmentOffset = 0;
+    while (IoBufferOffset != 0) {
+
+        ASSERT(FragmentIndex < IoBuffer->FragmentCount);
+
+        Fragment = &(IoBuffer->Fragment[FragmentIndex]);
+        if (IoBufferOffset < Fragment->Size) {
+            FragmentOffset = IoBufferOffset;
+            break;
+        }
+
+        IoBufferOffset -= Fragment->Size;
+        FragmentIndex += 1;
+    }
+
+    //
+    // Describe each fragment with a data segment.
+    //
+
+    TransferSizeRemaining = TransferSize;
+    while ((TransferSizeRemaining != 0) &&
+           (ScatterCount <= Controller->MaxSegments)) {
+
+        ASSERT(FragmentIndex < IoBuffer->FragmentCount);
+
+        Fragment = &(IoBuffer->Fragment[FragmentIndex]);
+        EntrySize = TransferSizeRemaining;
+        if (EntrySize > (Fragment->Size - FragmentOffset)) {
+            EntrySize = Fragment->Size - FragmentOffset;
+        }
+
+        if (EntrySize > Controller->MaxSegmentSize) {
+            EntrySize = Controller->MaxSegmentSize;
+        }
+
+        Scatter[ScatterCount].PhysicalAddress = Fragment->PhysicalAddress +
+                                                FragmentOffset;
+
+        Scatter[ScatterCount].Length = EntrySize;
+        Scatter[ScatterCount].Flags = SegmentFlags;
+        ScatterCount += 1;
+        TransferSizeRemaining -= EntrySize;
+        FragmentOffset += EntrySize;
+        if (FragmentOffset >= Fragment->Size) {
+            FragmentIndex += 1;
+            FragmentOffset = 0;
+        }
+    }
+
+    TransferSize -= TransferSizeRemaining;
+
+    ASSERT((TransferSize != 0) &&
+           (IS_ALIGNED(TransferSize, Controller->BlockSize) != FALSE));
+
+    Scatter[ScatterCount].PhysicalAddress =
+                  Slot->RequestPhysical + FIELD_OFFSET(VIRTIO_BLOCK_REQUEST,
+                                                       Status);
+
+    Scatter[ScatterCount].Length = sizeof(UCHAR);
+    Scatter[ScatterCount].Flags = VIRTIO_SCATTER_DEVICE_WRITABLE;
+    ScatterCount += 1;
+    Slot->IoSize = TransferSize;
+    return VirtioQueueAddBuffer(Controller->Queue, Scatter, ScatterCount, Slot);
+}
+
+KSTATUS
+VirtblkpSubmitFlush (
+    PVIRTIO_BLOCK_CONTROLLER Controller,
+    PVIRTIO_BLOCK_SLOT Slot
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits a flush request on the given slot.
+
+Arguments:
+
+    Controller - Supplies a pointer to the controller.
+
+    Slot - Supplies a pointer to the slot to use.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PVIRTIO_BLOCK_REQUEST Request;
+    PVIRTIO_SCATTER_ENTRY Scatter;
+
+    Request = Slot->Request;
+    Request->Header.Type = VIRTIO_BLOCK_REQUEST_FLUSH;
+    Request->Header.Reserved = 0;
+    Request->Header.Sector = 0;
+    Request->Status = VIRTIO_BLOCK_STATUS_IO_ERROR;
+    Scatter = Controller->Scatter;
+    Scatter[0].PhysicalAddress = Slot->RequestPhysical;
+    Scatter[0].Length = sizeof(VIRTIO_BLOCK_REQUEST_HEADER);
+    Scatter[0].Flags = 0;
+    Scatter[1].PhysicalAddress =
+                  Slot->RequestPhysical + FIELD_OFFSET(VIRTIO_BLOCK_REQUEST,
+                                                       Status);
+
+    Scatter[1].Length = sizeof(UCHAR);
+    Scatter[1].Flags = VIRTIO_SCATTER_DEVICE_WRITABLE;
+    Slot->IoSize = 0;
+    return VirtioQueueAddBuffer(Controller->Queue, Scatter, 2, Slot);
+}
+
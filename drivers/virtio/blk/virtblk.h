@@ -0,0 +1,308 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    virtblk.h
+
+Abstract:
+
+    This header contains definitions for the virtio block device driver.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define VIRTIO_BLOCK_ALLOCATION_TAG 0x6B6C4256 // 'klBV'
+
+//
+// Define the size of a virtio block sector. Request sector numbers and the
+// capacity are always expressed in these units, regardless of the logical
+// block size.
+//
+
+#define VIRTIO_BLOCK_SECTOR_SIZE 512
+
+//
+// Define the maximum number of descriptors to use for the queue.
+//
+
+#define VIRTIO_BLOCK_MAX_QUEUE_SIZE 256
+
+//
+// Define the maximum number of data segments in a single request. The header
+// and status byte take two more descriptors.
+//
+
+#define VIRTIO_BLOCK_MAX_SEGMENTS 126
+
+//
+// Define the largest data segment used if the device does not say.
+//
+
+#define VIRTIO_BLOCK_DEFAULT_MAX_SEGMENT_SIZE 0x400000
+
+//
+// Define the number of MSI-X vectors used. Configuration changes are not
+// interesting, so only the request queue gets a vector.
+//
+
+#define VIRTIO_BLOCK_VECTOR_COUNT 1
+#define VIRTIO_BLOCK_QUEUE_VECTOR 0
+
+//
+// Define the device feature bits.
+//
+
+#define VIRTIO_BLOCK_FEATURE_SIZE_MAX 1
+#define VIRTIO_BLOCK_FEATURE_SEGMENT_MAX 2
+#define VIRTIO_BLOCK_FEATURE_READ_ONLY 5
+#define VIRTIO_BLOCK_FEATURE_BLOCK_SIZE 6
+#define VIRTIO_BLOCK_FEATURE_FLUSH 9
+
+//
+// Define the device configuration offsets.
+//
+
+#define VIRTIO_BLOCK_CONFIG_CAPACITY 0x00
+#define VIRTIO_BLOCK_CONFIG_SIZE_MAX 0x08
+#define VIRTIO_BLOCK_CONFIG_SEGMENT_MAX 0x0C
+#define VIRTIO_BLOCK_CONFIG_BLOCK_SIZE 0x14
+
+//
+// Define the request types.
+//
+
+#define VIRTIO_BLOCK_REQUEST_IN 0
+#define VIRTIO_BLOCK_REQUEST_OUT 1
+#define VIRTIO_BLOCK_REQUEST_FLUSH 4
+
+//
+// Define the request status values written by the device.
+//
+
+#define VIRTIO_BLOCK_STATUS_OK 0
+#define VIRTIO_BLOCK_STATUS_IO_ERROR 1
+#define VIRTIO_BLOCK_STATUS_UNSUPPORTED 2
+
+//
+// Define the value that marks the end of the free slot list.
+//
+
+#define VIRTIO_BLOCK_SLOT_NONE ((ULONG)-1)
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _VIRTIO_BLOCK_CONTEXT_TYPE {
+    VirtioBlockContextInvalid,
+    VirtioBlockContextController,
+    VirtioBlockContextDisk
+} VIRTIO_BLOCK_CONTEXT_TYPE, *PVIRTIO_BLOCK_CONTEXT_TYPE;
+
+/*++
+
+Structure Description:
+
+    This structure defines the header at the start of every virtio block
+    request.
+
+Members:
+
+    Type - Stores the request type. See VIRTIO_BLOCK_REQUEST_* definitions.
+
+    Reserved - Stores a reserved value, set to zero.
+
+    Sector - Stores the starting sector of the request, in 512-byte units.
+
+--*/
+
+typedef struct _VIRTIO_BLOCK_REQUEST_HEADER {
+    ULONG Type;
+    ULONG Reserved;
+    ULONGLONG Sector;
+} PACKED VIRTIO_BLOCK_REQUEST_HEADER, *PVIRTIO_BLOCK_REQUEST_HEADER;
+
+/*++
+
+Structure Description:
+
+    This structure defines the DMA-visible portion of a request slot: the
+    request header the device reads and the status byte it writes back.
+
+Members:
+
+    Header - Stores the request header.
+
+    Status - Stores the completion status. See VIRTIO_BLOCK_STATUS_*
+        definitions.
+
+    Padding - Stores padding out to a power of two.
+
+--*/
+
+typedef struct _VIRTIO_BLOCK_REQUEST {
+    VIRTIO_BLOCK_REQUEST_HEADER Header;
+    UCHAR Status;
+    UCHAR Padding[15];
+} PACKED VIRTIO_BLOCK_REQUEST, *PVIRTIO_BLOCK_REQUEST;
+
+/*++
+
+Structure Description:
+
+    This structure defines the driver state for one in-flight request.
+
+Members:
+
+    Irp - Stores a pointer to the synchronize IRP being serviced by this
+        slot, if any.
+
+    BlockRequest - Stores a pointer to the block queue request being serviced
+        by this slot, if any.
+
+    IoSize - Stores the number of bytes transferred by the current request.
+
+    Request - Stores a pointer to the slot's header and status area.
+
+    RequestPhysical - Stores the physical address of the request area.
+
+    NextFree - Stores the index of the next free slot if this slot is free.
+
+--*/
+
+typedef struct _VIRTIO_BLOCK_SLOT {
+    PIRP Irp;
+    PBLOCK_REQUEST BlockRequest;
+    UINTN IoSize;
+    PVIRTIO_BLOCK_REQUEST Request;
+    PHYSICAL_ADDRESS RequestPhysical;
+    ULONG NextFree;
+} VIRTIO_BLOCK_SLOT, *PVIRTIO_BLOCK_SLOT;
+
+typedef struct _VIRTIO_BLOCK_CONTROLLER
+    VIRTIO_BLOCK_CONTROLLER, *PVIRTIO_BLOCK_CONTROLLER;
+
+/*++
+
+Structure Description:
+
+    This structure defines the disk child exposed by a virtio block
+    controller.
+
+Members:
+
+    Type - Stores a marker identifying the structure as a disk.
+
+    Controller - Stores a pointer to the parent controller.
+
+    OsDevice - Stores a pointer to the OS device for the disk.
+
+--*/
+
+typedef struct _VIRTIO_BLOCK_DISK {
+    VIRTIO_BLOCK_CONTEXT_TYPE Type;
+    PVIRTIO_BLOCK_CONTROLLER Controller;
+    PDEVICE OsDevice;
+} VIRTIO_BLOCK_DISK, *PVIRTIO_BLOCK_DISK;
+
+/*++
+
+Structure Description:
+
+    This structure defines the state of a virtio block device.
+
+Members:
+
+    Type - Stores a marker identifying the structure as a controller.
+
+    OsDevice - Stores a pointer to the OS device for the PCI function.
+
+    Virtio - Stores the virtio transport state.
+
+    Queue - Stores a pointer to the request queue.
+
+    Lock - Stores the spin lock serializing access to the queue, slots, and
+        synchronize IRP queue.
+
+    IrpQueue - Stores the list of synchronize IRPs waiting for a free slot.
+
+    BlockQueue - Stores a pointer to the block queue that schedules reads and
+        writes.
+
+    RequestIoBuffer - Stores the I/O buffer backing the request headers and
+        status bytes.
+
+    Slots - Stores the array of request slots.
+
+    SlotCount - Stores the number of elements in the slot array.
+
+    FreeSlot - Stores the index of the first free slot.
+
+    Scatter - Stores a scratch scatter list used while building requests,
+        protected by the lock.
+
+    MaxSegments - Stores the maximum number of data segments per request.
+
+    MaxSegmentSize - Stores the maximum size of a data segment.
+
+    BlockSize - Stores the logical block size of the disk.
+
+    BlockCount - Stores the number of logical blocks on the disk.
+
+    PendingInterrupts - Stores a bitfield of pending legacy interrupt status.
+
+    Disk - Stores the disk child.
+
+--*/
+
+struct _VIRTIO_BLOCK_CONTROLLER {
+    VIRTIO_BLOCK_CONTEXT_TYPE Type;
+    PDEVICE OsDevice;
+    VIRTIO_DEVICE Virtio;
+    PVIRTIO_QUEUE Queue;
+    KSPIN_LOCK Lock;
+    LIST_ENTRY IrpQueue;
+    PBLOCK_QUEUE BlockQueue;
+    PIO_BUFFER RequestIoBuffer;
+    PVIRTIO_BLOCK_SLOT Slots;
+    ULONG SlotCount;
+    ULONG FreeSlot;
+    PVIRTIO_SCATTER_ENTRY Scatter;
+    ULONG MaxSegments;
+    ULONG MaxSegmentSize;
+    ULONG BlockSize;
+    ULONGLONG BlockCount;
+    volatile ULONG PendingInterrupts;
+    VIRTIO_BLOCK_DISK Disk;
+};
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
@@ -0,0 +1,44 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    Virtio
+
+Abstract:
+
+    This directory contains paravirtual virtio device drivers, including
+    the virtio core support library, the block driver, and the network
+    driver.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+from menv import group;
+
+function build() {
+    var entries;
+    var virtioDrivers;
+
+    virtioDrivers = [
+        "drivers/virtio/blk:virtblk",
+        "drivers/virtio/net:virtnet"
+    ];
+
+    entries = group("virtio_drivers", virtioDrivers);
+    return entries;
+}
+
@@ -0,0 +1,1846 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    virtio.c
+
+Abstract:
+
+    This module implements the virtio PCI transport: capability discovery,
+    device status and feature negotiation, virtqueue creation, and MSI-X
+    interrupt routing.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+//
+// Define away the API decorator.
+//
+
+#define VIRTIO_API
+
+#include <minoca/kernel/driver.h>
+#include <minoca/virtio/virtio.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// These macros read from and write to the common configuration registers.
+//
+
+#define VIRTIO_READ_COMMON8(_Device, _Register) \
+    HlReadRegister8((PUCHAR)(_Device)->CommonConfig + (_Register))
+
+#define VIRTIO_WRITE_COMMON8(_Device, _Register, _Value) \
+    HlWriteRegister8((PUCHAR)(_Device)->CommonConfig + (_Register), (_Value))
+
+#define VIRTIO_READ_COMMON16(_Device, _Register) \
+    HlReadRegister16((PUCHAR)(_Device)->CommonConfig + (_Register))
+
+#define VIRTIO_WRITE_COMMON16(_Device, _Register, _Value) \
+    HlWriteRegister16((PUCHAR)(_Device)->CommonConfig + (_Register), (_Value))
+
+#define VIRTIO_READ_COMMON32(_Device, _Register) \
+    HlReadRegister32((PUCHAR)(_Device)->CommonConfig + (_Register))
+
+#define VIRTIO_WRITE_COMMON32(_Device, _Register, _Value) \
+    HlWriteRegister32((PUCHAR)(_Device)->CommonConfig + (_Register), (_Value))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define how long to wait for a device reset to complete, in microseconds.
+//
+
+#define VIRTIO_RESET_TIMEOUT_US 1000000
+#define VIRTIO_RESET_POLL_US 1000
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+VirtiopFindBars (
+    PVIRTIO_DEVICE Device,
+    PRESOURCE_ALLOCATION *Allocations,
+    ULONG AllocationCount
+    );
+
+KSTATUS
+VirtiopParseCapabilities (
+    PVIRTIO_DEVICE Device
+    );
+
+PVOID
+VirtiopMapCapability (
+    PVIRTIO_DEVICE Device,
+    ULONG Bar,
+    ULONG Offset,
+    ULONG Length
+    );
+
+KSTATUS
+VirtiopReadPciConfig (
+    PVIRTIO_DEVICE Device,
+    ULONG Offset,
+    ULONG Size,
+    PULONG Value
+    );
+
+VOID
+VirtiopProcessPciConfigInterfaceChangeNotification (
+    PVOID Context,
+    PDEVICE Device,
+    PVOID InterfaceBuffer,
+    ULONG InterfaceBufferSize,
+    BOOL Arrival
+    );
+
+VOID
+VirtiopProcessPciMsiInterfaceChangeNotification (
+    PVOID Context,
+    PDEVICE Device,
+    PVOID InterfaceBuffer,
+    ULONG InterfaceBufferSize,
+    BOOL Arrival
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+PDRIVER VirtioDriver;
+UUID VirtioPciConfigInterfaceUuid = UUID_PCI_CONFIG_ACCESS;
+UUID VirtioPciMsiInterfaceUuid = UUID_PCI_MESSAGE_SIGNALED_INTERRUPTS;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+__USED
+KSTATUS
+DriverEntry (
+    PDRIVER Driver
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the initial entry point of the virtio support
+    library, called when the library is first loaded.
+
+Arguments:
+
+    Driver - Supplies a pointer to the driver object.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    VirtioDriver = Driver;
+    return STATUS_SUCCESS;
+}
+
+VIRTIO_API
+KSTATUS
+VirtioInitializeDevice (
+    PVIRTIO_DEVICE Device,
+    PDEVICE OsDevice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes a virtio device structure. This should be called
+    when the driver attaches to the device.
+
+Arguments:
+
+    Device - Supplies a pointer to the zeroed device structure to initialize.
+
+    OsDevice - Supplies a pointer to the OS device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Index;
+
+    Device->OsDevice = OsDevice;
+    Device->InterruptLine = INVALID_INTERRUPT_LINE;
+    for (Index = 0; Index < VIRTIO_MAX_INTERRUPT_VECTORS; Index += 1) {
+        Device->InterruptVectors[Index] = INVALID_INTERRUPT_VECTOR;
+        Device->InterruptHandles[Index] = INVALID_HANDLE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VIRTIO_API
+VOID
+VirtioDestroyDevice (
+    PVIRTIO_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tears down the PCI state associated with a virtio device:
+    it disconnects interrupts, resets the device, and unmaps its registers.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    PVOID Mapping;
+
+    if (Device->CommonConfig != NULL) {
+        VirtioResetDevice(Device);
+    }
+
+    for (Index = 0; Index < VIRTIO_MAX_INTERRUPT_VECTORS; Index += 1) {
+        if (Device->InterruptHandles[Index] != INVALID_HANDLE) {
+            IoDisconnectInterrupt(Device->InterruptHandles[Index]);
+            Device->InterruptHandles[Index] = INVALID_HANDLE;
+        }
+    }
+
+    for (Index = 0; Index < VIRTIO_PCI_BAR_COUNT; Index += 1) {
+        if (Device->BarMappings[Index] != NULL) {
+            Mapping = (PVOID)ALIGN_RANGE_DOWN((UINTN)Device->BarMappings[Index],
+                                              MmPageSize());
+
+            MmUnmapAddress(Mapping, Device->BarMappingSizes[Index]);
+
+            Device->BarMappings[Index] = NULL;
+            Device->BarMappingSizes[Index] = 0;
+        }
+    }
+
+    Device->CommonConfig = NULL;
+    Device->NotifyBase = NULL;
+    Device->IsrStatus = NULL;
+    Device->DeviceConfig = NULL;
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_PCI_CONFIG_REGISTERED) != 0) {
+        IoUnregisterForInterfaceNotifications(
+                          &VirtioPciConfigInterfaceUuid,
+                          VirtiopProcessPciConfigInterfaceChangeNotification,
+                          Device->OsDevice,
+                          Device);
+
+        Device->Flags &= ~(VIRTIO_DEVICE_FLAG_PCI_CONFIG_REGISTERED |
+                           VIRTIO_DEVICE_FLAG_PCI_CONFIG_AVAILABLE);
+    }
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_PCI_MSI_REGISTERED) != 0) {
+        IoUnregisterForInterfaceNotifications(
+                             &VirtioPciMsiInterfaceUuid,
+                             VirtiopProcessPciMsiInterfaceChangeNotification,
+                             Device->OsDevice,
+                             Device);
+
+        Device->Flags &= ~(VIRTIO_DEVICE_FLAG_PCI_MSI_REGISTERED |
+                           VIRTIO_DEVICE_FLAG_PCI_MSI_AVAILABLE);
+    }
+
+    return;
+}
+
+VIRTIO_API
+KSTATUS
+VirtioProcessResourceRequirements (
+    PVIRTIO_DEVICE Device,
+    PIRP Irp,
+    ULONG VectorCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine filters the resource requirements for a virtio PCI device. It
+    asks for the given number of MSI-X vectors if MSI-X is available, with a
+    fallback to a single legacy interrupt vector.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Irp - Supplies a pointer to the query resources IRP.
+
+    VectorCount - Supplies the number of MSI-X vectors the driver would like.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PRESOURCE_CONFIGURATION_LIST ConfigurationList;
+    ULONGLONG EdgeTriggered;
+    PRESOURCE_REQUIREMENT FirstVector;
+    ULONG Index;
+    ULONGLONG LineCharacteristics;
+    PCI_MSI_INFORMATION MsiInformation;
+    PINTERFACE_PCI_MSI MsiInterface;
+    PRESOURCE_REQUIREMENT NextRequirement;
+    PRESOURCE_REQUIREMENT Requirement;
+    PRESOURCE_REQUIREMENT_LIST RequirementList;
+    KSTATUS Status;
+    ULONGLONG VectorCharacteristics;
+    PRESOURCE_REQUIREMENT VectorRequirement;
+    RESOURCE_REQUIREMENT VectorTemplate;
+
+    ASSERT((Irp->MajorCode == IrpMajorStateChange) &&
+           (Irp->MinorCode == IrpMinorQueryResources));
+
+    //
+    // Register for the PCI configuration space and MSI interfaces. If they
+    // are ever going to show up, they are already there.
+    //
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_PCI_CONFIG_REGISTERED) == 0) {
+        Status = IoRegisterForInterfaceNotifications(
+                          &VirtioPciConfigInterfaceUuid,
+                          VirtiopProcessPciConfigInterfaceChangeNotification,
+                          Irp->Device,
+                          Device,
+                          TRUE);
+
+        if (!KSUCCESS(Status)) {
+            goto ProcessResourceRequirementsEnd;
+        }
+
+        Device->Flags |= VIRTIO_DEVICE_FLAG_PCI_CONFIG_REGISTERED;
+    }
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_PCI_MSI_REGISTERED) == 0) {
+        Status = IoRegisterForInterfaceNotifications(
+                             &VirtioPciMsiInterfaceUuid,
+                             VirtiopProcessPciMsiInterfaceChangeNotification,
+                             Irp->Device,
+                             Device,
+                             TRUE);
+
+        if (!KSUCCESS(Status)) {
+            goto ProcessResourceRequirementsEnd;
+        }
+
+        Device->Flags |= VIRTIO_DEVICE_FLAG_PCI_MSI_REGISTERED;
+    }
+
+    RtlZeroMemory(&VectorTemplate, sizeof(RESOURCE_REQUIREMENT));
+    VectorTemplate.Type = ResourceTypeInterruptVector;
+    VectorTemplate.Minimum = 0;
+    VectorTemplate.Maximum = -1;
+    VectorTemplate.Length = 1;
+    ConfigurationList = Irp->U.QueryResources.ResourceRequirements;
+
+    //
+    // Clip the vector count to the size of the device's MSI-X table.
+    //
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_PCI_MSI_AVAILABLE) != 0) {
+        MsiInterface = &(Device->PciMsiInterface);
+        RtlZeroMemory(&MsiInformation, sizeof(PCI_MSI_INFORMATION));
+        MsiInformation.Version = PCI_MSI_INTERFACE_INFORMATION_VERSION;
+        MsiInformation.MsiType = PciMsiTypeExtended;
+        Status = MsiInterface->GetSetInformation(MsiInterface->DeviceToken,
+                                                 &MsiInformation,
+                                                 FALSE);
+
+        if ((!KSUCCESS(Status)) || (MsiInformation.MaxVectorCount == 0)) {
+            VectorCount = 0;
+
+        } else if (VectorCount > MsiInformation.MaxVectorCount) {
+            VectorCount = MsiInformation.MaxVectorCount;
+        }
+
+        if (VectorCount > VIRTIO_MAX_INTERRUPT_VECTORS) {
+            VectorCount = VIRTIO_MAX_INTERRUPT_VECTORS;
+        }
+
+    } else {
+        VectorCount = 0;
+    }
+
+    //
+    // Without MSI-X, stick with a vector for each legacy line.
+    //
+
+    if (VectorCount == 0) {
+        Status = IoCreateAndAddInterruptVectorsForLines(ConfigurationList,
+                                                        &VectorTemplate);
+
+        goto ProcessResourceRequirementsEnd;
+    }
+
+    //
+    // Create the MSI-X vectors for every configuration. The first one gets
+    // alternatives for each legacy line, in case the MSI vectors cannot be
+    // satisfied.
+    //
+
+    RequirementList = IoGetNextResourceConfiguration(ConfigurationList, NULL);
+    while (RequirementList != NULL) {
+        FirstVector = NULL;
+        for (Index = 0; Index < VectorCount; Index += 1) {
+            VectorTemplate.Characteristics = INTERRUPT_VECTOR_EDGE_TRIGGERED;
+            VectorTemplate.OwningRequirement = NULL;
+            Status = IoCreateAndAddResourceRequirement(&VectorTemplate,
+                                                       RequirementList,
+                                                       &VectorRequirement);
+
+            if (!KSUCCESS(Status)) {
+                goto ProcessResourceRequirementsEnd;
+            }
+
+            if (FirstVector == NULL) {
+                FirstVector = VectorRequirement;
+            }
+        }
+
+        Requirement = IoGetNextResourceRequirement(RequirementList, NULL);
+        while (Requirement != NULL) {
+            NextRequirement = IoGetNextResourceRequirement(RequirementList,
+                                                           Requirement);
+
+            if (Requirement->Type != ResourceTypeInterruptLine) {
+                Requirement = NextRequirement;
+                continue;
+            }
+
+            VectorCharacteristics = 0;
+            LineCharacteristics = Requirement->Characteristics;
+            if ((LineCharacteristics & INTERRUPT_LINE_ACTIVE_LOW) != 0) {
+                VectorCharacteristics |= INTERRUPT_VECTOR_ACTIVE_LOW;
+            }
+
+            if ((LineCharacteristics & INTERRUPT_LINE_ACTIVE_HIGH) != 0) {
+                VectorCharacteristics |= INTERRUPT_VECTOR_ACTIVE_HIGH;
+            }
+
+            EdgeTriggered = LineCharacteristics & INTERRUPT_LINE_EDGE_TRIGGERED;
+            if (EdgeTriggered != 0) {
+                VectorCharacteristics |= INTERRUPT_VECTOR_EDGE_TRIGGERED;
+            }
+
+            VectorTemplate.Characteristics = VectorCharacteristics;
+            VectorTemplate.OwningRequirement = Requirement;
+            Status = IoCreateAndAddResourceRequirementAlternative(
+                                                            &VectorTemplate,
+                                                            FirstVector);
+
+            if (!KSUCCESS(Status)) {
+                goto ProcessResourceRequirementsEnd;
+            }
+
+            Requirement = NextRequirement;
+        }
+
+        RequirementList = IoGetNextResourceConfiguration(ConfigurationList,
+                                                         RequirementList);
+    }
+
+    Device->Flags |= VIRTIO_DEVICE_FLAG_MSI_X_REQUESTED;
+    Status = STATUS_SUCCESS;
+
+ProcessResourceRequirementsEnd:
+    return Status;
+}
+
+VIRTIO_API
+KSTATUS
+VirtioStartDevice (
+    PVIRTIO_DEVICE Device,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine collects the allocated resources for a virtio device, finds
+    and maps the virtio PCI capabilities, and resets the device, leaving it
+    in the acknowledged state ready for feature negotiation.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Irp - Supplies a pointer to the start device IRP.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PRESOURCE_ALLOCATION Allocation;
+    PRESOURCE_ALLOCATION_LIST AllocationList;
+    PRESOURCE_ALLOCATION Bars[VIRTIO_PCI_BAR_COUNT];
+    ULONG BarCount;
+    BOOL LegacyFound;
+    PRESOURCE_ALLOCATION LineAllocation;
+    ULONG MsiCount;
+    ULONGLONG MsiVectors[VIRTIO_MAX_INTERRUPT_VECTORS];
+    KSTATUS Status;
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_PCI_CONFIG_AVAILABLE) == 0) {
+        RtlDebugPrint("Virtio: No PCI config interface.\n");
+        return STATUS_NOT_READY;
+    }
+
+    //
+    // Loop through the allocated resources to get the BARs and the
+    // interrupt vectors. A vector with an owning line is a legacy interrupt.
+    //
+
+    BarCount = 0;
+    MsiCount = 0;
+    LegacyFound = FALSE;
+    AllocationList = Irp->U.StartDevice.ProcessorLocalResources;
+    Allocation = IoGetNextResourceAllocation(AllocationList, NULL);
+    while (Allocation != NULL) {
+        if (Allocation->Type == ResourceTypeInterruptVector) {
+            LineAllocation = Allocation->OwningAllocation;
+            if (LineAllocation == NULL) {
+                if (MsiCount < VIRTIO_MAX_INTERRUPT_VECTORS) {
+                    MsiVectors[MsiCount] = Allocation->Allocation;
+                    MsiCount += 1;
+                }
+
+            } else if (LegacyFound == FALSE) {
+
+                ASSERT(LineAllocation->Type == ResourceTypeInterruptLine);
+
+                LegacyFound = TRUE;
+                Device->InterruptLine = LineAllocation->Allocation;
+                Device->InterruptVectors[0] = Allocation->Allocation;
+            }
+
+        } else if ((Allocation->Type == ResourceTypePhysicalAddressSpace) ||
+                   (Allocation->Type == ResourceTypeIoPort)) {
+
+            if (BarCount < VIRTIO_PCI_BAR_COUNT) {
+                Bars[BarCount] = Allocation;
+                BarCount += 1;
+            }
+        }
+
+        Allocation = IoGetNextResourceAllocation(AllocationList, Allocation);
+    }
+
+    //
+    // Prefer MSI-X if all the vectors came back without lines.
+    //
+
+    if (LegacyFound != FALSE) {
+        Device->InterruptVectorCount = 1;
+        Device->Flags &= ~VIRTIO_DEVICE_FLAG_MSI_X_ENABLED;
+
+    } else if (MsiCount != 0) {
+
+        ASSERT((Device->Flags & VIRTIO_DEVICE_FLAG_MSI_X_REQUESTED) != 0);
+
+        Device->InterruptLine = INVALID_INTERRUPT_LINE;
+        RtlCopyMemory(Device->InterruptVectors,
+                      MsiVectors,
+                      MsiCount * sizeof(ULONGLONG));
+
+        Device->InterruptVectorCount = MsiCount;
+        Device->Flags |= VIRTIO_DEVICE_FLAG_MSI_X_ENABLED;
+
+    } else {
+        RtlDebugPrint("Virtio: Missing interrupt resources.\n");
+        Status = STATUS_INVALID_CONFIGURATION;
+        goto StartDeviceEnd;
+    }
+
+    Status = VirtiopFindBars(Device, Bars, BarCount);
+    if (!KSUCCESS(Status)) {
+        goto StartDeviceEnd;
+    }
+
+    if (Device->CommonConfig == NULL) {
+        Status = VirtiopParseCapabilities(Device);
+        if (!KSUCCESS(Status)) {
+            goto StartDeviceEnd;
+        }
+    }
+
+    VirtioResetDevice(Device);
+    VIRTIO_WRITE_COMMON8(Device,
+                         VirtioCommonDeviceStatus,
+                         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    Status = STATUS_SUCCESS;
+
+StartDeviceEnd:
+    return Status;
+}
+
+VIRTIO_API
+KSTATUS
+VirtioNegotiateFeatures (
+    PVIRTIO_DEVICE Device,
+    ULONGLONG Features
+    )
+
+/*++
+
+Routine Description:
+
+    This routine negotiates the feature set with the device. The version 1
+    feature is always requested, and the ring features are accepted if the
+    device offers them.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Features - Supplies the device-specific features the driver supports. The
+        intersection of these and the device features is accepted.
+
+Return Value:
+
+    STATUS_SUCCESS if the device accepted the features.
+
+    STATUS_NOT_SUPPORTED if the device does not support version 1 or rejected
+    the feature set.
+
+--*/
+
+{
+
+    ULONGLONG DeviceFeatures;
+    UCHAR DeviceStatus;
+
+    VIRTIO_WRITE_COMMON32(Device, VirtioCommonDeviceFeatureSelect, 0);
+    DeviceFeatures = VIRTIO_READ_COMMON32(Device, VirtioCommonDeviceFeature);
+    VIRTIO_WRITE_COMMON32(Device, VirtioCommonDeviceFeatureSelect, 1);
+    DeviceFeatures |=
+             (ULONGLONG)VIRTIO_READ_COMMON32(Device, VirtioCommonDeviceFeature) <<
+             32;
+
+    Device->DeviceFeatures = DeviceFeatures;
+    if ((DeviceFeatures & (1ULL << VIRTIO_FEATURE_VERSION_1)) == 0) {
+        RtlDebugPrint("Virtio: Legacy-only device not supported.\n");
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Features |= (1ULL << VIRTIO_FEATURE_VERSION_1) |
+                (1ULL << VIRTIO_FEATURE_RING_INDIRECT_DESCRIPTORS) |
+                (1ULL << VIRTIO_FEATURE_RING_EVENT_INDEX);
+
+    Device->DriverFeatures = Features & DeviceFeatures;
+    VIRTIO_WRITE_COMMON32(Device, VirtioCommonDriverFeatureSelect, 0);
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonDriverFeature,
+                          (ULONG)(Device->DriverFeatures));
+
+    VIRTIO_WRITE_COMMON32(Device, VirtioCommonDriverFeatureSelect, 1);
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonDriverFeature,
+                          (ULONG)(Device->DriverFeatures >> 32));
+
+    DeviceStatus = VIRTIO_READ_COMMON8(Device, VirtioCommonDeviceStatus);
+    DeviceStatus |= VIRTIO_STATUS_FEATURES_OK;
+    VIRTIO_WRITE_COMMON8(Device, VirtioCommonDeviceStatus, DeviceStatus);
+    DeviceStatus = VIRTIO_READ_COMMON8(Device, VirtioCommonDeviceStatus);
+    if ((DeviceStatus & VIRTIO_STATUS_FEATURES_OK) == 0) {
+        RtlDebugPrint("Virtio: Device rejected features %I64x.\n",
+                      Device->DriverFeatures);
+
+        VIRTIO_WRITE_COMMON8(Device,
+                             VirtioCommonDeviceStatus,
+                             DeviceStatus | VIRTIO_STATUS_FAILED);
+
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VIRTIO_API
+ULONG
+VirtioGetQueueCount (
+    PVIRTIO_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the number of virtqueues the device supports.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Returns the maximum number of queues.
+
+--*/
+
+{
+
+    return VIRTIO_READ_COMMON16(Device, VirtioCommonQueueCount);
+}
+
+VIRTIO_API
+KSTATUS
+VirtioCreateQueue (
+    PVIRTIO_DEVICE Device,
+    USHORT Index,
+    USHORT MaxSize,
+    ULONG IndirectEntryCount,
+    USHORT MsixVector,
+    PVIRTIO_QUEUE *Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates and enables a split virtqueue on the device. This
+    must be done after feature negotiation but before the device is set to
+    driver OK.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Index - Supplies the queue index to create.
+
+    MaxSize - Supplies the maximum number of descriptors the driver wants, or
+        0 to use the device's maximum.
+
+    IndirectEntryCount - Supplies the number of entries to reserve in each
+        indirect descriptor table. Supply 0 to avoid using indirect
+        descriptors. This is ignored if the feature was not negotiated.
+
+    MsixVector - Supplies the MSI-X table entry to associate with the queue,
+        or VIRTIO_MSI_NO_VECTOR.
+
+    Queue - Supplies a pointer where a pointer to the new queue will be
+        returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN AvailableOffset;
+    UINTN AvailableSize;
+    ULONG DescriptorIndex;
+    PHYSICAL_ADDRESS DescriptorPhysical;
+    UINTN DescriptorSize;
+    PVIRTIO_QUEUE NewQueue;
+    USHORT NotifyOffset;
+    UINTN PageSize;
+    PUCHAR Ring;
+    PHYSICAL_ADDRESS RingPhysical;
+    UINTN RingSize;
+    USHORT Size;
+    KSTATUS Status;
+    UINTN TableSize;
+    UINTN UsedOffset;
+    UINTN UsedSize;
+
+    *Queue = NULL;
+    PageSize = MmPageSize();
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_MSI_X_ENABLED) == 0) {
+        MsixVector = VIRTIO_MSI_NO_VECTOR;
+    }
+
+    VIRTIO_WRITE_COMMON16(Device, VirtioCommonQueueSelect, Index);
+    Size = VIRTIO_READ_COMMON16(Device, VirtioCommonQueueSize);
+    if (Size == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ((MaxSize != 0) && (Size > MaxSize)) {
+        Size = MaxSize;
+    }
+
+    //
+    // Keep the queue a power of two so that ring indices wrap cleanly.
+    //
+
+    while (POWER_OF_2(Size) == FALSE) {
+        Size &= Size - 1;
+    }
+
+    NewQueue = MmAllocateNonPagedPool(sizeof(VIRTIO_QUEUE),
+                                      VIRTIO_ALLOCATION_TAG);
+
+    if (NewQueue == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateQueueEnd;
+    }
+
+    RtlZeroMemory(NewQueue, sizeof(VIRTIO_QUEUE));
+    NewQueue->Device = Device;
+    NewQueue->Index = Index;
+    NewQueue->Size = Size;
+    NewQueue->MsixVector = MsixVector;
+    if (VIRTIO_HAS_FEATURE(Device, VIRTIO_FEATURE_RING_EVENT_INDEX)) {
+        NewQueue->Flags |= VIRTQ_FLAG_EVENT_INDEX;
+    }
+
+    //
+    // Lay out the descriptor table, available ring (including the used event
+    // index), and used ring (including the available event index) in one
+    // physically contiguous allocation. The used ring gets its own page so
+    // that device writes don't bounce the cache lines the driver writes.
+    //
+
+    DescriptorSize = sizeof(VIRTQ_DESCRIPTOR) * Size;
+    AvailableOffset = DescriptorSize;
+    AvailableSize = (sizeof(USHORT) * 3) + (sizeof(USHORT) * Size);
+    UsedOffset = ALIGN_RANGE_UP(AvailableOffset + AvailableSize, PageSize);
+    UsedSize = (sizeof(USHORT) * 3) + (sizeof(VIRTQ_USED_ELEMENT) * Size);
+    RingSize = ALIGN_RANGE_UP(UsedOffset + UsedSize, PageSize);
+    NewQueue->RingIoBuffer = MmAllocateNonPagedIoBuffer(
+                                        0,
+                                        MAX_ULONGLONG,
+                                        PageSize,
+                                        RingSize,
+                                        IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS);
+
+    if (NewQueue->RingIoBuffer == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateQueueEnd;
+    }
+
+    ASSERT(NewQueue->RingIoBuffer->FragmentCount == 1);
+
+    Ring = NewQueue->RingIoBuffer->Fragment[0].VirtualAddress;
+    RingPhysical = NewQueue->RingIoBuffer->Fragment[0].PhysicalAddress;
+    RtlZeroMemory(Ring, RingSize);
+    NewQueue->Descriptors = (PVIRTQ_DESCRIPTOR)Ring;
+    NewQueue->Available = (PVIRTQ_AVAILABLE)(Ring + AvailableOffset);
+    NewQueue->Used = (PVIRTQ_USED)(Ring + UsedOffset);
+
+    //
+    // The event index fields trail each ring. Compute them from the ring base
+    // rather than taking the address of a member of the packed structures.
+    //
+
+    NewQueue->UsedEvent = (volatile USHORT *)(Ring + AvailableOffset +
+                                    FIELD_OFFSET(VIRTQ_AVAILABLE, Ring) +
+                                    (sizeof(USHORT) * Size));
+
+    NewQueue->AvailableEvent = (volatile USHORT *)(Ring + UsedOffset +
+                                    FIELD_OFFSET(VIRTQ_USED, Ring) +
+                                    (sizeof(VIRTQ_USED_ELEMENT) * Size));
+
+    //
+    // Chain every descriptor onto the free list.
+    //
+
+    for (DescriptorIndex = 0; DescriptorIndex < Size; DescriptorIndex += 1) {
+        NewQueue->Descriptors[DescriptorIndex].Next = DescriptorIndex + 1;
+    }
+
+    NewQueue->Descriptors[Size - 1].Next = VIRTQ_END_OF_LIST;
+    NewQueue->FreeHead = 0;
+    NewQueue->FreeCount = Size;
+    NewQueue->Cookies = MmAllocateNonPagedPool(sizeof(PVOID) * Size,
+                                               VIRTIO_ALLOCATION_TAG);
+
+    if (NewQueue->Cookies == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateQueueEnd;
+    }
+
+    RtlZeroMemory(NewQueue->Cookies, sizeof(PVOID) * Size);
+
+    //
+    // Allocate an indirect table for each ring descriptor so that any head
+    // can point at its own table without further allocation in the I/O path.
+    //
+
+    if ((IndirectEntryCount > 1) &&
+        (VIRTIO_HAS_FEATURE(Device,
+                            VIRTIO_FEATURE_RING_INDIRECT_DESCRIPTORS))) {
+
+        TableSize = sizeof(VIRTQ_DESCRIPTOR) * IndirectEntryCount * Size;
+        NewQueue->IndirectIoBuffer = MmAllocateNonPagedIoBuffer(
+                                        0,
+                                        MAX_ULONGLONG,
+                                        VIRTQ_DESCRIPTOR_ALIGNMENT,
+                                        TableSize,
+                                        IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS);
+
+        if (NewQueue->IndirectIoBuffer != NULL) {
+
+            ASSERT(NewQueue->IndirectIoBuffer->FragmentCount == 1);
+
+            NewQueue->IndirectTables =
+                          NewQueue->IndirectIoBuffer->Fragment[0].VirtualAddress;
+
+            NewQueue->IndirectTablesPhysical =
+                         NewQueue->IndirectIoBuffer->Fragment[0].PhysicalAddress;
+
+            NewQueue->IndirectEntryCount = IndirectEntryCount;
+        }
+    }
+
+    //
+    // Program the queue into the device.
+    //
+
+    DescriptorPhysical = RingPhysical;
+    VIRTIO_WRITE_COMMON16(Device, VirtioCommonQueueSize, Size);
+    VIRTIO_WRITE_COMMON16(Device, VirtioCommonQueueMsixVector, MsixVector);
+    if (VIRTIO_READ_COMMON16(Device, VirtioCommonQueueMsixVector) !=
+        MsixVector) {
+
+        RtlDebugPrint("Virtio: Queue %d rejected MSI-X vector %d.\n",
+                      Index,
+                      MsixVector);
+
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto CreateQueueEnd;
+    }
+
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonQueueDescriptorLow,
+                          (ULONG)DescriptorPhysical);
+
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonQueueDescriptorHigh,
+                          (ULONG)(DescriptorPhysical >> 32));
+
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonQueueAvailableLow,
+                          (ULONG)(RingPhysical + AvailableOffset));
+
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonQueueAvailableHigh,
+                          (ULONG)((RingPhysical + AvailableOffset) >> 32));
+
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonQueueUsedLow,
+                          (ULONG)(RingPhysical + UsedOffset));
+
+    VIRTIO_WRITE_COMMON32(Device,
+                          VirtioCommonQueueUsedHigh,
+                          (ULONG)((RingPhysical + UsedOffset) >> 32));
+
+    NotifyOffset = VIRTIO_READ_COMMON16(Device, VirtioCommonQueueNotifyOffset);
+    NewQueue->Notify = (PUCHAR)(Device->NotifyBase) +
+                       (NotifyOffset * Device->NotifyOffsetMultiplier);
+
+    VIRTIO_WRITE_COMMON16(Device, VirtioCommonQueueEnable, 1);
+    Status = STATUS_SUCCESS;
+
+CreateQueueEnd:
+    if (!KSUCCESS(Status)) {
+        if (NewQueue != NULL) {
+            VirtioDestroyQueue(NewQueue);
+            NewQueue = NULL;
+        }
+    }
+
+    *Queue = NewQueue;
+    return Status;
+}
+
+VIRTIO_API
+VOID
+VirtioDestroyQueue (
+    PVIRTIO_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys a virtqueue. The device must have been reset first
+    so that it is no longer using the queue memory.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Queue->RingIoBuffer != NULL) {
+        MmFreeIoBuffer(Queue->RingIoBuffer);
+    }
+
+    if (Queue->IndirectIoBuffer != NULL) {
+        MmFreeIoBuffer(Queue->IndirectIoBuffer);
+    }
+
+    if (Queue->Cookies != NULL) {
+        MmFreeNonPagedPool(Queue->Cookies);
+    }
+
+    MmFreeNonPagedPool(Queue);
+    return;
+}
+
+VIRTIO_API
+VOID
+VirtioSetDriverOk (
+    PVIRTIO_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks the device as live. After this the device may start
+    consuming queues and generating interrupts.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UCHAR DeviceStatus;
+
+    RtlMemoryBarrier();
+    DeviceStatus = VIRTIO_READ_COMMON8(Device, VirtioCommonDeviceStatus);
+    DeviceStatus |= VIRTIO_STATUS_DRIVER_OK;
+    VIRTIO_WRITE_COMMON8(Device, VirtioCommonDeviceStatus, DeviceStatus);
+    return;
+}
+
+VIRTIO_API
+VOID
+VirtioResetDevice (
+    PVIRTIO_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resets the device, causing it to drop all queues.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Waited;
+
+    VIRTIO_WRITE_COMMON8(Device, VirtioCommonDeviceStatus, 0);
+
+    //
+    // The device indicates the reset is complete by reading back zero.
+    //
+
+    Waited = 0;
+    while (VIRTIO_READ_COMMON8(Device, VirtioCommonDeviceStatus) != 0) {
+        if (Waited >= VIRTIO_RESET_TIMEOUT_US) {
+            RtlDebugPrint("Virtio: Reset timed out.\n");
+            break;
+        }
+
+        HlBusySpin(VIRTIO_RESET_POLL_US);
+        Waited += VIRTIO_RESET_POLL_US;
+    }
+
+    return;
+}
+
+VIRTIO_API
+KSTATUS
+VirtioConnectInterrupt (
+    PVIRTIO_DEVICE Device,
+    ULONG VectorIndex,
+    ULONG Processor,
+    PINTERRUPT_SERVICE_ROUTINE InterruptService,
+    PINTERRUPT_SERVICE_ROUTINE DispatchService,
+    PINTERRUPT_SERVICE_ROUTINE LowLevelService,
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine connects one of the device's interrupt vectors. With MSI-X,
+    the vector index is the MSI-X table entry, and the message is targeted at
+    the given processor.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    VectorIndex - Supplies the index of the vector to connect.
+
+    Processor - Supplies the processor number to target, or -1 to let the
+        system choose.
+
+    InterruptService - Supplies an optional pointer to the interrupt service
+        routine.
+
+    DispatchService - Supplies an optional pointer to the dispatch level
+        service routine.
+
+    LowLevelService - Supplies an optional pointer to the low level service
+        routine.
+
+    Context - Supplies the context passed to the service routines.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    IO_CONNECT_INTERRUPT_PARAMETERS Connect;
+    PINTERFACE_PCI_MSI MsiInterface;
+    PROCESSOR_SET ProcessorSet;
+    KSTATUS Status;
+
+    if ((VectorIndex >= Device->InterruptVectorCount) ||
+        (Device->InterruptHandles[VectorIndex] != INVALID_HANDLE)) {
+
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RtlZeroMemory(&Connect, sizeof(IO_CONNECT_INTERRUPT_PARAMETERS));
+    Connect.Version = IO_CONNECT_INTERRUPT_PARAMETERS_VERSION;
+    Connect.Device = Device->OsDevice;
+    Connect.LineNumber = Device->InterruptLine;
+    Connect.Vector = Device->InterruptVectors[VectorIndex];
+    Connect.InterruptServiceRoutine = InterruptService;
+    Connect.DispatchServiceRoutine = DispatchService;
+    Connect.LowLevelServiceRoutine = LowLevelService;
+    Connect.Context = Context;
+    Connect.Interrupt = &(Device->InterruptHandles[VectorIndex]);
+    Status = IoConnectInterrupt(&Connect);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_MSI_X_ENABLED) == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    ProcessorSet.Target = ProcessorTargetAny;
+    if (Processor != (ULONG)-1) {
+        ProcessorSet.Target = ProcessorTargetSingleProcessor;
+        ProcessorSet.U.Number = Processor;
+    }
+
+    MsiInterface = &(Device->PciMsiInterface);
+    Status = MsiInterface->SetVectors(MsiInterface->DeviceToken,
+                                      PciMsiTypeExtended,
+                                      Device->InterruptVectors[VectorIndex],
+                                      VectorIndex,
+                                      1,
+                                      &ProcessorSet);
+
+    if (!KSUCCESS(Status)) {
+        IoDisconnectInterrupt(Device->InterruptHandles[VectorIndex]);
+        Device->InterruptHandles[VectorIndex] = INVALID_HANDLE;
+    }
+
+    return Status;
+}
+
+VIRTIO_API
+KSTATUS
+VirtioEnableMsiX (
+    PVIRTIO_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine enables MSI-X on the device once all vectors are programmed.
+    It does nothing if legacy interrupts are in use.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PCI_MSI_INFORMATION MsiInformation;
+    PINTERFACE_PCI_MSI MsiInterface;
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_MSI_X_ENABLED) == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    MsiInterface = &(Device->PciMsiInterface);
+    RtlZeroMemory(&MsiInformation, sizeof(PCI_MSI_INFORMATION));
+    MsiInformation.Version = PCI_MSI_INTERFACE_INFORMATION_VERSION;
+    MsiInformation.MsiType = PciMsiTypeExtended;
+    MsiInformation.Flags = PCI_MSI_INTERFACE_FLAG_ENABLED;
+    MsiInformation.VectorCount = Device->InterruptVectorCount;
+    return MsiInterface->GetSetInformation(MsiInterface->DeviceToken,
+                                           &MsiInformation,
+                                           TRUE);
+}
+
+VIRTIO_API
+VOID
+VirtioSetConfigurationVector (
+    PVIRTIO_DEVICE Device,
+    USHORT MsixVector
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sets the MSI-X vector used for configuration change
+    interrupts.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    MsixVector - Supplies the MSI-X table entry, or VIRTIO_MSI_NO_VECTOR.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_MSI_X_ENABLED) == 0) {
+        MsixVector = VIRTIO_MSI_NO_VECTOR;
+    }
+
+    VIRTIO_WRITE_COMMON16(Device, VirtioCommonMsixConfig, MsixVector);
+    return;
+}
+
+VIRTIO_API
+UCHAR
+VirtioReadIsrStatus (
+    PVIRTIO_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads and clears the ISR status register. This is only
+    meaningful when legacy interrupts are in use.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Returns the ISR status bits. See VIRTIO_ISR_* definitions.
+
+--*/
+
+{
+
+    return HlReadRegister8(Device->IsrStatus);
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+KSTATUS
+VirtiopFindBars (
+    PVIRTIO_DEVICE Device,
+    PRESOURCE_ALLOCATION *Allocations,
+    ULONG AllocationCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine matches the BAR resource allocations up with BAR numbers.
+    The PCI bus driver creates one allocation per BAR, except that 64-bit
+    BARs consume two BAR slots.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Allocations - Supplies the array of BAR allocations, in order.
+
+    AllocationCount - Supplies the number of elements in the array.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG AllocationIndex;
+    ULONG BarIndex;
+    KSTATUS Status;
+    ULONG Value;
+
+    RtlZeroMemory(Device->BarAllocations, sizeof(Device->BarAllocations));
+    AllocationIndex = 0;
+    BarIndex = 0;
+    while ((BarIndex < VIRTIO_PCI_BAR_COUNT) &&
+           (AllocationIndex < AllocationCount)) {
+
+        Device->BarAllocations[BarIndex] = Allocations[AllocationIndex];
+        AllocationIndex += 1;
+        Status = VirtiopReadPciConfig(
+                                Device,
+                                VIRTIO_PCI_BAR_OFFSET + (BarIndex * sizeof(ULONG)),
+                                sizeof(ULONG),
+                                &Value);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        if (((Value & VIRTIO_PCI_BAR_IO_SPACE) == 0) &&
+            ((Value & VIRTIO_PCI_BAR_MEMORY_SIZE_MASK) ==
+             VIRTIO_PCI_BAR_MEMORY_64_BIT)) {
+
+            BarIndex += 1;
+        }
+
+        BarIndex += 1;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+VirtiopParseCapabilities (
+    PVIRTIO_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine walks the PCI capability list looking for the virtio vendor
+    capabilities, and maps the regions they describe.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Bar;
+    ULONG CapabilityId;
+    ULONG ConfigurationType;
+    ULONG Length;
+    ULONG Multiplier;
+    ULONG Offset;
+    ULONG Pointer;
+    ULONG RegionOffset;
+    KSTATUS Status;
+    ULONG Value;
+    ULONG Visited;
+
+    Status = VirtiopReadPciConfig(Device,
+                                  VIRTIO_PCI_STATUS_OFFSET,
+                                  sizeof(USHORT),
+                                  &Value);
+
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    if ((Value & VIRTIO_PCI_STATUS_CAPABILITIES_LIST) == 0) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    Status = VirtiopReadPciConfig(Device,
+                                  VIRTIO_PCI_CAPABILITIES_POINTER_OFFSET,
+                                  sizeof(UCHAR),
+                                  &Pointer);
+
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // Bound the walk in case the list is malformed.
+    //
+
+    Visited = 0;
+    Pointer &= ~0x3;
+    while ((Pointer != 0) && (Visited < 48)) {
+        Visited += 1;
+        Offset = Pointer;
+        Status = VirtiopReadPciConfig(Device, Offset, sizeof(UCHAR), &Value);
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        CapabilityId = Value;
+        Status = VirtiopReadPciConfig(Device,
+                                      Offset + VIRTIO_PCI_CAPABILITY_NEXT,
+                                      sizeof(UCHAR),
+                                      &Pointer);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        Pointer &= ~0x3;
+        if (CapabilityId != VIRTIO_PCI_CAPABILITY_VENDOR) {
+            continue;
+        }
+
+        Status = VirtiopReadPciConfig(
+                              Device,
+                              Offset + VIRTIO_PCI_CAPABILITY_CONFIGURATION_TYPE,
+                              sizeof(UCHAR),
+                              &ConfigurationType);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        Status = VirtiopReadPciConfig(Device,
+                                      Offset + VIRTIO_PCI_CAPABILITY_BAR,
+                                      sizeof(UCHAR),
+                                      &Bar);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        Status = VirtiopReadPciConfig(Device,
+                                      Offset + VIRTIO_PCI_CAPABILITY_OFFSET,
+                                      sizeof(ULONG),
+                                      &RegionOffset);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        Status = VirtiopReadPciConfig(Device,
+                                      Offset + VIRTIO_PCI_CAPABILITY_LENGTH,
+                                      sizeof(ULONG),
+                                      &Length);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        //
+        // Only take the first capability of each type, as the spec asks the
+        // driver to prefer earlier ones.
+        //
+
+        switch (ConfigurationType) {
+        case VirtioPciConfigurationCommon:
+            if (Device->CommonConfig == NULL) {
+                Device->CommonConfig = VirtiopMapCapability(Device,
+                                                            Bar,
+                                                            RegionOffset,
+                                                            Length);
+            }
+
+            break;
+
+        case VirtioPciConfigurationNotify:
+            if (Device->NotifyBase == NULL) {
+                Status = VirtiopReadPciConfig(
+                               Device,
+                               Offset + VIRTIO_PCI_CAPABILITY_NOTIFY_MULTIPLIER,
+                               sizeof(ULONG),
+                               &Multiplier);
+
+                if (!KSUCCESS(Status)) {
+                    return Status;
+                }
+
+                Device->NotifyOffsetMultiplier = Multiplier;
+                Device->NotifyBase = VirtiopMapCapability(Device,
+                                                          Bar,
+                                                          RegionOffset,
+                                                          Length);
+            }
+
+            break;
+
+        case VirtioPciConfigurationIsr:
+            if (Device->IsrStatus == NULL) {
+                Device->IsrStatus = VirtiopMapCapability(Device,
+                                                         Bar,
+                                                         RegionOffset,
+                                                         Length);
+            }
+
+            break;
+
+        case VirtioPciConfigurationDevice:
+            if (Device->DeviceConfig == NULL) {
+                Device->DeviceConfig = VirtiopMapCapability(Device,
+                                                            Bar,
+                                                            RegionOffset,
+                                                            Length);
+            }
+
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if ((Device->CommonConfig == NULL) || (Device->NotifyBase == NULL) ||
+        (Device->IsrStatus == NULL)) {
+
+        RtlDebugPrint("Virtio: Missing PCI capabilities.\n");
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+PVOID
+VirtiopMapCapability (
+    PVIRTIO_DEVICE Device,
+    ULONG Bar,
+    ULONG Offset,
+    ULONG Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a virtual address for a region described by a virtio
+    capability, mapping the containing BAR if necessary.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Bar - Supplies the BAR number the region lives in.
+
+    Offset - Supplies the offset of the region within the BAR.
+
+    Length - Supplies the length of the region.
+
+Return Value:
+
+    Returns the virtual address of the region on success.
+
+    NULL if the BAR is invalid or could not be mapped.
+
+--*/
+
+{
+
+    UINTN AlignmentOffset;
+    PRESOURCE_ALLOCATION Allocation;
+    PHYSICAL_ADDRESS EndAddress;
+    UINTN PageSize;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    UINTN Size;
+
+    if (Bar >= VIRTIO_PCI_BAR_COUNT) {
+        return NULL;
+    }
+
+    Allocation = Device->BarAllocations[Bar];
+    if ((Allocation == NULL) ||
+        (Allocation->Type != ResourceTypePhysicalAddressSpace) ||
+        ((ULONGLONG)Offset + Length > Allocation->Length)) {
+
+        return NULL;
+    }
+
+    if (Device->BarMappings[Bar] == NULL) {
+        PageSize = MmPageSize();
+        PhysicalAddress = Allocation->Allocation;
+        EndAddress = PhysicalAddress + Allocation->Length;
+        PhysicalAddress = ALIGN_RANGE_DOWN(PhysicalAddress, PageSize);
+        AlignmentOffset = Allocation->Allocation - PhysicalAddress;
+        EndAddress = ALIGN_RANGE_UP(EndAddress, PageSize);
+        Size = (UINTN)(EndAddress - PhysicalAddress);
+        Device->BarMappings[Bar] = MmMapPhysicalAddress(PhysicalAddress,
+                                                        Size,
+                                                        TRUE,
+                                                        FALSE,
+                                                        TRUE);
+
+        if (Device->BarMappings[Bar] == NULL) {
+            return NULL;
+        }
+
+        Device->BarMappingSizes[Bar] = Size;
+        Device->BarMappings[Bar] =
+                          (PUCHAR)(Device->BarMappings[Bar]) + AlignmentOffset;
+    }
+
+    return (PUCHAR)(Device->BarMappings[Bar]) + Offset;
+}
+
+KSTATUS
+VirtiopReadPciConfig (
+    PVIRTIO_DEVICE Device,
+    ULONG Offset,
+    ULONG Size,
+    PULONG Value
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads from the device's PCI configuration space.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Offset - Supplies the byte offset to read.
+
+    Size - Supplies the access size.
+
+    Value - Supplies a pointer where the value will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PINTERFACE_PCI_CONFIG_ACCESS Interface;
+    KSTATUS Status;
+    ULONGLONG Value64;
+
+    if ((Device->Flags & VIRTIO_DEVICE_FLAG_PCI_CONFIG_AVAILABLE) == 0) {
+        return STATUS_NOT_READY;
+    }
+
+    Interface = &(Device->PciConfigInterface);
+    Status = Interface->ReadPciConfig(Interface->DeviceToken,
+                                      Offset,
+                                      Size,
+                                      &Value64);
+
+    *Value = (ULONG)Value64;
+    return Status;
+}
+
+VOID
+VirtiopProcessPciConfigInterfaceChangeNotification (
+    PVOID Context,
+    PDEVICE Device,
+    PVOID InterfaceBuffer,
+    ULONG InterfaceBufferSize,
+    BOOL Arrival
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a PCI configuration space access interface
+    changes in availability.
+
+Arguments:
+
+    Context - Supplies the caller's context pointer, supplied when the caller
+        requested interface notifications.
+
+    Device - Supplies a pointer to the device exposing or deleting the
+        interface.
+
+    InterfaceBuffer - Supplies a pointer to the interface buffer of the
+        interface.
+
+    InterfaceBufferSize - Supplies the buffer size.
+
+    Arrival - Supplies TRUE if a new interface is arriving, or FALSE if an
+        interface is departing.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_DEVICE VirtioDevice;
+
+    VirtioDevice = Context;
+    if (Arrival != FALSE) {
+        if (InterfaceBufferSize >= sizeof(INTERFACE_PCI_CONFIG_ACCESS)) {
+            RtlCopyMemory(&(VirtioDevice->PciConfigInterface),
+                          InterfaceBuffer,
+                          sizeof(INTERFACE_PCI_CONFIG_ACCESS));
+
+            VirtioDevice->Flags |= VIRTIO_DEVICE_FLAG_PCI_CONFIG_AVAILABLE;
+        }
+
+    } else {
+        VirtioDevice->Flags &= ~VIRTIO_DEVICE_FLAG_PCI_CONFIG_AVAILABLE;
+    }
+
+    return;
+}
+
+VOID
+VirtiopProcessPciMsiInterfaceChangeNotification (
+    PVOID Context,
+    PDEVICE Device,
+    PVOID InterfaceBuffer,
+    ULONG InterfaceBufferSize,
+    BOOL Arrival
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a PCI MSI interface changes in availability.
+
+Arguments:
+
+    Context - Supplies the caller's context pointer, supplied when the caller
+        requested interface notifications.
+
+    Device - Supplies a pointer to the device exposing or deleting the
+        interface.
+
+    InterfaceBuffer - Supplies a pointer to the interface buffer of the
+        interface.
+
+    InterfaceBufferSize - Supplies the buffer size.
+
+    Arrival - Supplies TRUE if a new interface is arriving, or FALSE if an
+        interface is departing.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_DEVICE VirtioDevice;
+
+    VirtioDevice = Context;
+    if (Arrival != FALSE) {
+        if (InterfaceBufferSize >= sizeof(INTERFACE_PCI_MSI)) {
+            RtlCopyMemory(&(VirtioDevice->PciMsiInterface),
+                          InterfaceBuffer,
+                          sizeof(INTERFACE_PCI_MSI));
+
+            VirtioDevice->Flags |= VIRTIO_DEVICE_FLAG_PCI_MSI_AVAILABLE;
+        }
+
+    } else {
+        VirtioDevice->Flags &= ~VIRTIO_DEVICE_FLAG_PCI_MSI_AVAILABLE;
+    }
+
+    return;
+}
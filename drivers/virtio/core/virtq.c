@@ -0,0 +1,451 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    virtq.c
+
+Abstract:
+
+    This module implements split virtqueue operations: adding buffers
+    (optionally through indirect descriptor tables), notifying the device,
+    reaping used buffers, and event index based interrupt suppression.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+//
+// Define away the API decorator.
+//
+
+#define VIRTIO_API
+
+#include <minoca/kernel/driver.h>
+#include <minoca/virtio/virtio.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro converts a scatter entry's flags into descriptor flags.
+//
+
+#define VIRTQ_SCATTER_TO_DESCRIPTOR_FLAGS(_ScatterFlags)                    \
+    ((((_ScatterFlags) & VIRTIO_SCATTER_DEVICE_WRITABLE) != 0) ?            \
+     VIRTQ_DESCRIPTOR_WRITE : 0)
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VIRTIO_API
+KSTATUS
+VirtioQueueAddBuffer (
+    PVIRTIO_QUEUE Queue,
+    PVIRTIO_SCATTER_ENTRY Entries,
+    ULONG EntryCount,
+    PVOID Cookie
+    )
+
+/*++
+
+Routine Description:
+
+    This routine exposes a buffer to the device. All device-readable entries
+    must come before all device-writable entries. If indirect descriptors are
+    in use and the buffer has more than one entry, a single ring descriptor is
+    consumed. The caller must synchronize access to the queue and must call
+    the kick routine to notify the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+    Entries - Supplies the array of scatter entries making up the buffer.
+
+    EntryCount - Supplies the number of entries in the array.
+
+    Cookie - Supplies a non-null context pointer returned when the device is
+        done with the buffer.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INSUFFICIENT_RESOURCES if there are not enough free descriptors.
+
+--*/
+
+{
+
+    PVIRTQ_DESCRIPTOR Descriptor;
+    USHORT DescriptorIndex;
+    ULONG EntryIndex;
+    USHORT Head;
+    PVIRTQ_DESCRIPTOR Table;
+    ULONG TableOffset;
+
+    ASSERT((EntryCount != 0) && (Cookie != NULL));
+
+    if (Queue->FreeCount == 0) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Head = Queue->FreeHead;
+
+    //
+    // Use the head descriptor's private indirect table if the buffer fits in
+    // it. This keeps a multi-segment request to a single ring slot, so the
+    // ring does not run dry on large scatter lists.
+    //
+
+    if ((EntryCount > 1) && (EntryCount <= Queue->IndirectEntryCount)) {
+        TableOffset = Head * Queue->IndirectEntryCount;
+        Table = &(Queue->IndirectTables[TableOffset]);
+        for (EntryIndex = 0; EntryIndex < EntryCount; EntryIndex += 1) {
+            Descriptor = &(Table[EntryIndex]);
+            Descriptor->Address = Entries[EntryIndex].PhysicalAddress;
+            Descriptor->Length = Entries[EntryIndex].Length;
+            Descriptor->Flags =
+                VIRTQ_SCATTER_TO_DESCRIPTOR_FLAGS(Entries[EntryIndex].Flags);
+
+            Descriptor->Next = EntryIndex + 1;
+            if (EntryIndex + 1 != EntryCount) {
+                Descriptor->Flags |= VIRTQ_DESCRIPTOR_NEXT;
+            }
+        }
+
+        Descriptor = &(Queue->Descriptors[Head]);
+        Queue->FreeHead = Descriptor->Next;
+        Queue->FreeCount -= 1;
+        Descriptor->Address = Queue->IndirectTablesPhysical +
+                              (TableOffset * sizeof(VIRTQ_DESCRIPTOR));
+
+        Descriptor->Length = EntryCount * sizeof(VIRTQ_DESCRIPTOR);
+        Descriptor->Flags = VIRTQ_DESCRIPTOR_INDIRECT;
+
+    //
+    // Chain descriptors directly off the free list. The next pointers of the
+    // free list are reused as the chain links, so only the flags need
+    // setting. The last descriptor keeps its free list link, which the device
+    // ignores since the next flag is clear.
+    //
+
+    } else {
+        if (EntryCount > Queue->FreeCount) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        DescriptorIndex = Head;
+        for (EntryIndex = 0; EntryIndex < EntryCount; EntryIndex += 1) {
+            Descriptor = &(Queue->Descriptors[DescriptorIndex]);
+            Descriptor->Address = Entries[EntryIndex].PhysicalAddress;
+            Descriptor->Length = Entries[EntryIndex].Length;
+            Descriptor->Flags =
+                VIRTQ_SCATTER_TO_DESCRIPTOR_FLAGS(Entries[EntryIndex].Flags);
+
+            if (EntryIndex + 1 != EntryCount) {
+                Descriptor->Flags |= VIRTQ_DESCRIPTOR_NEXT;
+            }
+
+            DescriptorIndex = Descriptor->Next;
+        }
+
+        Queue->FreeHead = DescriptorIndex;
+        Queue->FreeCount -= EntryCount;
+    }
+
+    Queue->Cookies[Head] = Cookie;
+    Queue->Available->Ring[Queue->AvailableIndex & (Queue->Size - 1)] = Head;
+    Queue->AvailableIndex += 1;
+    return STATUS_SUCCESS;
+}
+
+VIRTIO_API
+BOOL
+VirtioQueueKick (
+    PVIRTIO_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine publishes all buffers added since the last kick and notifies
+    the device if it has asked to be notified.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+Return Value:
+
+    TRUE if the device was notified.
+
+    FALSE if the notification was suppressed.
+
+--*/
+
+{
+
+    BOOL Notify;
+    USHORT NewIndex;
+    USHORT OldIndex;
+
+    //
+    // Make sure the ring entries are visible before the index, and the index
+    // is visible before looking at whether or not the device wants a
+    // notification.
+    //
+
+    RtlMemoryBarrier();
+    NewIndex = Queue->AvailableIndex;
+    OldIndex = Queue->LastKickIndex;
+    *((volatile USHORT *)&(Queue->Available->Index)) = NewIndex;
+    RtlMemoryBarrier();
+    Queue->LastKickIndex = NewIndex;
+    if (NewIndex == OldIndex) {
+        return FALSE;
+    }
+
+    if ((Queue->Flags & VIRTQ_FLAG_EVENT_INDEX) != 0) {
+        Notify = VIRTQ_NEED_EVENT(*(Queue->AvailableEvent), NewIndex, OldIndex);
+
+    } else {
+        Notify = ((Queue->Used->Flags & VIRTQ_USED_NO_NOTIFY) == 0);
+    }
+
+    if (Notify != FALSE) {
+        HlWriteRegister16(Queue->Notify, Queue->Index);
+    }
+
+    return Notify;
+}
+
+VIRTIO_API
+PVOID
+VirtioQueueGetUsedBuffer (
+    PVIRTIO_QUEUE Queue,
+    PULONG Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the next buffer the device has finished with,
+    returning its descriptors to the free list.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+    Length - Supplies a pointer where the number of bytes the device wrote
+        will be returned.
+
+Return Value:
+
+    Returns the cookie supplied when the buffer was added.
+
+    NULL if there are no more used buffers.
+
+--*/
+
+{
+
+    PVOID Cookie;
+    ULONG Count;
+    PVIRTQ_DESCRIPTOR Descriptor;
+    USHORT Head;
+    USHORT Last;
+    PVIRTQ_USED_ELEMENT UsedElement;
+
+    if (Queue->LastUsedIndex == Queue->Used->Index) {
+        return NULL;
+    }
+
+    //
+    // Don't read the element before the index that covers it.
+    //
+
+    RtlMemoryBarrier();
+    UsedElement = &(Queue->Used->Ring[Queue->LastUsedIndex &
+                                      (Queue->Size - 1)]);
+
+    Head = (USHORT)(UsedElement->Id);
+    *Length = UsedElement->Length;
+
+    ASSERT(Head < Queue->Size);
+
+    Cookie = Queue->Cookies[Head];
+    Queue->Cookies[Head] = NULL;
+
+    ASSERT(Cookie != NULL);
+
+    //
+    // Put the chain back on the free list.
+    //
+
+    Count = 1;
+    Last = Head;
+    Descriptor = &(Queue->Descriptors[Head]);
+    if ((Descriptor->Flags & VIRTQ_DESCRIPTOR_INDIRECT) == 0) {
+        while ((Descriptor->Flags & VIRTQ_DESCRIPTOR_NEXT) != 0) {
+            Last = Descriptor->Next;
+            Descriptor = &(Queue->Descriptors[Last]);
+            Count += 1;
+        }
+    }
+
+    Queue->Descriptors[Last].Next = Queue->FreeHead;
+    Queue->FreeHead = Head;
+    Queue->FreeCount += Count;
+    Queue->LastUsedIndex += 1;
+
+    //
+    // Keep asking for an interrupt on the next completion if interrupts are
+    // enabled.
+    //
+
+    if ((Queue->Flags &
+         (VIRTQ_FLAG_EVENT_INDEX | VIRTQ_FLAG_INTERRUPTS_DISABLED)) ==
+        VIRTQ_FLAG_EVENT_INDEX) {
+
+        *(Queue->UsedEvent) = Queue->LastUsedIndex;
+    }
+
+    return Cookie;
+}
+
+VIRTIO_API
+VOID
+VirtioQueueDisableInterrupts (
+    PVIRTIO_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine asks the device not to interrupt for this queue. This is
+    only a hint; the device may still interrupt.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    Queue->Flags |= VIRTQ_FLAG_INTERRUPTS_DISABLED;
+
+    //
+    // With event indices, the used event is simply left alone, so it falls
+    // behind and the device stops interrupting.
+    //
+
+    if ((Queue->Flags & VIRTQ_FLAG_EVENT_INDEX) == 0) {
+        Queue->Available->Flags |= VIRTQ_AVAILABLE_NO_INTERRUPT;
+    }
+
+    return;
+}
+
+VIRTIO_API
+BOOL
+VirtioQueueEnableInterrupts (
+    PVIRTIO_QUEUE Queue,
+    USHORT Delay
+    )
+
+/*++
+
+Routine Description:
+
+    This routine asks the device to interrupt when new used buffers arrive.
+    With event index suppression, the interrupt can be delayed until a number
+    of further buffers are used.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+    Delay - Supplies the number of additional used buffers past the next one
+        to wait for before interrupting. This is ignored without event index
+        support.
+
+Return Value:
+
+    TRUE if used buffers are already pending, in which case the caller should
+    process the queue again rather than waiting for an interrupt.
+
+    FALSE if no buffers are pending.
+
+--*/
+
+{
+
+    USHORT Pending;
+
+    Queue->Flags &= ~VIRTQ_FLAG_INTERRUPTS_DISABLED;
+    if ((Queue->Flags & VIRTQ_FLAG_EVENT_INDEX) != 0) {
+        *(Queue->UsedEvent) = Queue->LastUsedIndex + Delay;
+
+    } else {
+        Delay = 0;
+        Queue->Available->Flags &= ~VIRTQ_AVAILABLE_NO_INTERRUPT;
+    }
+
+    //
+    // Make sure the event write is visible before checking for completions
+    // that raced with it, otherwise a completion could be missed entirely.
+    //
+
+    RtlMemoryBarrier();
+    Pending = Queue->Used->Index - Queue->LastUsedIndex;
+    return (Pending > Delay);
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
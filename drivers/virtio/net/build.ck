@@ -0,0 +1,55 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    Virtio Network
+
+Abstract:
+
+    This module implements the virtio network device driver, with one
+    receive and transmit queue pair per processor where supported.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+from menv import driver;
+
+function build() {
+    var drv;
+    var dynlibs;
+    var entries;
+    var name = "virtnet";
+    var sources;
+
+    sources = [
+        "virtnet.c"
+    ];
+
+    dynlibs = [
+        "drivers/virtio/core:virtio",
+        "drivers/net/netcore:netcore"
+    ];
+
+    drv = {
+        "label": name,
+        "inputs": sources + dynlibs,
+    };
+
+    entries = driver(drv);
+    return entries;
+}
+
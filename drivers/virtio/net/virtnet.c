@@ -0,0 +1,1950 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    virtnet.c
+
+Abstract:
+
+    This module implements the virtio network device driver. When the device
+    supports multiple queues and MSI-X is available, each receive/transmit
+    queue pair gets its own vector targeted at its own processor.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/driver.h>
+#include <minoca/net/netdrv.h>
+#include <minoca/virtio/virtio.h>
+#include "virtnet.h"
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// These macros return the receive and transmit queue indices for a pair.
+//
+
+#define VIRTIO_NET_RECEIVE_QUEUE_INDEX(_Pair) ((_Pair) * 2)
+#define VIRTIO_NET_TRANSMIT_QUEUE_INDEX(_Pair) (((_Pair) * 2) + 1)
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+VirtnetAddDevice (
+    PVOID Driver,
+    PCSTR DeviceId,
+    PCSTR ClassId,
+    PCSTR CompatibleIds,
+    PVOID DeviceToken
+    );
+
+VOID
+VirtnetDispatchStateChange (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtnetDispatchOpen (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtnetDispatchClose (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtnetDispatchIo (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+VOID
+VirtnetDispatchSystemControl (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    );
+
+KSTATUS
+VirtnetSend (
+    PVOID DeviceContext,
+    PNET_PACKET_LIST PacketList
+    );
+
+KSTATUS
+VirtnetGetSetInformation (
+    PVOID DeviceContext,
+    NET_LINK_INFORMATION_TYPE InformationType,
+    PVOID Data,
+    PUINTN DataSize,
+    BOOL Set
+    );
+
+VOID
+VirtnetDestroyLink (
+    PVOID DeviceContext
+    );
+
+INTERRUPT_STATUS
+VirtnetpInterruptService (
+    PVOID Context
+    );
+
+INTERRUPT_STATUS
+VirtnetpInterruptServiceWorker (
+    PVOID Context
+    );
+
+INTERRUPT_STATUS
+VirtnetpQueueInterruptService (
+    PVOID Context
+    );
+
+INTERRUPT_STATUS
+VirtnetpQueueInterruptServiceWorker (
+    PVOID Context
+    );
+
+INTERRUPT_STATUS
+VirtnetpConfigurationInterruptService (
+    PVOID Context
+    );
+
+INTERRUPT_STATUS
+VirtnetpConfigurationInterruptServiceWorker (
+    PVOID Context
+    );
+
+KSTATUS
+VirtnetpStartDevice (
+    PIRP Irp,
+    PVIRTIO_NET_DEVICE Device
+    );
+
+KSTATUS
+VirtnetpConnectInterrupts (
+    PVIRTIO_NET_DEVICE Device,
+    ULONG MaxQueuePairs
+    );
+
+KSTATUS
+VirtnetpCreateQueues (
+    PVIRTIO_NET_DEVICE Device
+    );
+
+VOID
+VirtnetpDestroyQueues (
+    PVIRTIO_NET_DEVICE Device
+    );
+
+KSTATUS
+VirtnetpAddNetworkDevice (
+    PVIRTIO_NET_DEVICE Device
+    );
+
+KSTATUS
+VirtnetpFillReceiveQueue (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    );
+
+KSTATUS
+VirtnetpSetQueuePairCount (
+    PVIRTIO_NET_DEVICE Device
+    );
+
+VOID
+VirtnetpProcessQueuePair (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    );
+
+VOID
+VirtnetpReapTransmittedPackets (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    );
+
+VOID
+VirtnetpSendPendingPackets (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    );
+
+VOID
+VirtnetpUpdateLinkState (
+    PVIRTIO_NET_DEVICE Device
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+PDRIVER VirtnetDriver = NULL;
+
+DRIVER_FUNCTION_TABLE VirtnetDriverFunctionTable = {
+    DRIVER_FUNCTION_TABLE_VERSION,
+    NULL,
+    VirtnetAddDevice,
+    NULL,
+    NULL,
+    VirtnetDispatchStateChange,
+    VirtnetDispatchOpen,
+    VirtnetDispatchClose,
+    VirtnetDispatchIo,
+    VirtnetDispatchSystemControl,
+    NULL
+};
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+__USED
+KSTATUS
+DriverEntry (
+    PDRIVER Driver
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is the entry point for the virtio network driver. It
+    registers its other dispatch functions, and performs driver-wide
+    initialization.
+
+Arguments:
+
+    Driver - Supplies a pointer to the driver object.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    Failure code on error.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    VirtnetDriver = Driver;
+    Status = IoRegisterDriverFunctions(Driver, &VirtnetDriverFunctionTable);
+    return Status;
+}
+
+KSTATUS
+VirtnetAddDevice (
+    PVOID Driver,
+    PCSTR DeviceId,
+    PCSTR ClassId,
+    PCSTR CompatibleIds,
+    PVOID DeviceToken
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called when a device is detected for which the virtio
+    network driver acts as the function driver. The driver will attach itself
+    to the stack.
+
+Arguments:
+
+    Driver - Supplies a pointer to the driver being called.
+
+    DeviceId - Supplies a pointer to a string with the device ID.
+
+    ClassId - Supplies a pointer to a string containing the device's class ID.
+
+    CompatibleIds - Supplies a pointer to a string containing device IDs
+        that would be compatible with this device.
+
+    DeviceToken - Supplies an opaque token that the driver can use to identify
+        the device in the system. This token should be used when attaching to
+        the stack.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    Failure code if the driver was unsuccessful in attaching itself.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+    KSTATUS Status;
+
+    Device = MmAllocateNonPagedPool(sizeof(VIRTIO_NET_DEVICE),
+                                    VIRTIO_NET_ALLOCATION_TAG);
+
+    if (Device == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto AddDeviceEnd;
+    }
+
+    RtlZeroMemory(Device, sizeof(VIRTIO_NET_DEVICE));
+    Device->OsDevice = DeviceToken;
+    Device->ConfigurationLock = KeCreateQueuedLock();
+    if (Device->ConfigurationLock == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto AddDeviceEnd;
+    }
+
+    Status = VirtioInitializeDevice(&(Device->Virtio), DeviceToken);
+    if (!KSUCCESS(Status)) {
+        goto AddDeviceEnd;
+    }
+
+    Status = IoAttachDriverToDevice(Driver, DeviceToken, Device);
+    if (!KSUCCESS(Status)) {
+        goto AddDeviceEnd;
+    }
+
+AddDeviceEnd:
+    if (!KSUCCESS(Status)) {
+        if (Device != NULL) {
+            if (Device->ConfigurationLock != NULL) {
+                KeDestroyQueuedLock(Device->ConfigurationLock);
+            }
+
+            MmFreeNonPagedPool(Device);
+        }
+    }
+
+    return Status;
+}
+
+VOID
+VirtnetDispatchStateChange (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles State Change IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+    ULONG ProcessorCount;
+    KSTATUS Status;
+    ULONG VectorCount;
+
+    ASSERT(Irp->MajorCode == IrpMajorStateChange);
+
+    Device = DeviceContext;
+    if (Irp->Direction == IrpUp) {
+        if (!KSUCCESS(IoGetIrpStatus(Irp))) {
+            return;
+        }
+
+        switch (Irp->MinorCode) {
+        case IrpMinorQueryResources:
+
+            //
+            // Ask for a configuration vector plus one vector per processor,
+            // up to the queue pair limit. The real pair count is only known
+            // after the device is started.
+            //
+
+            ProcessorCount = KeGetActiveProcessorCount();
+            if (ProcessorCount > VIRTIO_NET_MAX_QUEUE_PAIRS) {
+                ProcessorCount = VIRTIO_NET_MAX_QUEUE_PAIRS;
+            }
+
+            VectorCount = 1 + ProcessorCount;
+            Status = VirtioProcessResourceRequirements(&(Device->Virtio),
+                                                       Irp,
+                                                       VectorCount);
+
+            if (!KSUCCESS(Status)) {
+                IoCompleteIrp(VirtnetDriver, Irp, Status);
+            }
+
+            break;
+
+        case IrpMinorStartDevice:
+            Status = VirtnetpStartDevice(Irp, Device);
+            if (!KSUCCESS(Status)) {
+                IoCompleteIrp(VirtnetDriver, Irp, Status);
+            }
+
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return;
+}
+
+VOID
+VirtnetDispatchOpen (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles Open IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    return;
+}
+
+VOID
+VirtnetDispatchClose (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles Close IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    return;
+}
+
+VOID
+VirtnetDispatchIo (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles I/O IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    return;
+}
+
+VOID
+VirtnetDispatchSystemControl (
+    PIRP Irp,
+    PVOID DeviceContext,
+    PVOID IrpContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles System Control IRPs.
+
+Arguments:
+
+    Irp - Supplies a pointer to the I/O request packet.
+
+    DeviceContext - Supplies the context pointer supplied by the driver when it
+        attached itself to the driver stack. Presumably this pointer contains
+        driver-specific device context.
+
+    IrpContext - Supplies the context pointer supplied by the driver when
+        the IRP was created.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+    PSYSTEM_CONTROL_DEVICE_INFORMATION DeviceInformationRequest;
+    KSTATUS Status;
+
+    ASSERT(Irp->MajorCode == IrpMajorSystemControl);
+
+    Device = DeviceContext;
+    if (Irp->Direction == IrpDown) {
+        switch (Irp->MinorCode) {
+        case IrpMinorSystemControlDeviceInformation:
+            DeviceInformationRequest = Irp->U.SystemControl.SystemContext;
+            Status = NetGetSetLinkDeviceInformation(
+                                         Device->NetworkLink,
+                                         &(DeviceInformationRequest->Uuid),
+                                         DeviceInformationRequest->Data,
+                                         &(DeviceInformationRequest->DataSize),
+                                         DeviceInformationRequest->Set);
+
+            IoCompleteIrp(VirtnetDriver, Irp, Status);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return;
+}
+
+KSTATUS
+VirtnetSend (
+    PVOID DeviceContext,
+    PNET_PACKET_LIST PacketList
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sends data through the network. Packets are placed on the
+    transmit queue of the pair belonging to the current processor, so that
+    concurrent senders on different processors do not contend.
+
+Arguments:
+
+    DeviceContext - Supplies a pointer to the device context associated with
+        the link down which this data is to be sent.
+
+    PacketList - Supplies a pointer to a list of network packets to send. Data
+        in these packets may be modified by this routine, but must not be used
+        once this routine returns.
+
+Return Value:
+
+    STATUS_SUCCESS if all packets were sent.
+
+    STATUS_RESOURCE_IN_USE if some or all of the packets were dropped due to
+    the hardware being backed up with too many packets to send.
+
+    Other failure codes indicate that none of the packets were sent.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+    PVIRTIO_NET_QUEUE_PAIR Pair;
+    ULONG PairIndex;
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    Device = (PVIRTIO_NET_DEVICE)DeviceContext;
+
+    //
+    // The thread may migrate after the processor number is read, which only
+    // costs some locality.
+    //
+
+    PairIndex = KeGetCurrentProcessorNumber() % Device->QueuePairCount;
+    Pair = &(Device->QueuePairs[PairIndex]);
+    KeAcquireQueuedLock(Pair->TransmitLock);
+    if (Device->LinkActive == FALSE) {
+        Status = STATUS_NO_NETWORK_CONNECTION;
+        goto SendEnd;
+    }
+
+    if (Pair->TransmitPacketList.Count <
+        VIRTIO_NET_MAX_TRANSMIT_PACKET_LIST_COUNT) {
+
+        NET_APPEND_PACKET_LIST(PacketList, &(Pair->TransmitPacketList));
+        VirtnetpReapTransmittedPackets(Pair);
+        VirtnetpSendPendingPackets(Pair);
+        Status = STATUS_SUCCESS;
+
+    } else {
+        Status = STATUS_RESOURCE_IN_USE;
+    }
+
+SendEnd:
+    KeReleaseQueuedLock(Pair->TransmitLock);
+    return Status;
+}
+
+KSTATUS
+VirtnetGetSetInformation (
+    PVOID DeviceContext,
+    NET_LINK_INFORMATION_TYPE InformationType,
+    PVOID Data,
+    PUINTN DataSize,
+    BOOL Set
+    )
+
+/*++
+
+Routine Description:
+
+    This routine gets or sets the network device layer's link information.
+
+Arguments:
+
+    DeviceContext - Supplies a pointer to the device context associated with
+        the link for which information is being set or queried.
+
+    InformationType - Supplies the type of information being queried or set.
+
+    Data - Supplies a pointer to the data buffer where the data is either
+        returned for a get operation or given for a set operation.
+
+    DataSize - Supplies a pointer that on input contains the size of the data
+        buffer. On output, contains the required size of the data buffer.
+
+    Set - Supplies a boolean indicating if this is a get operation (FALSE) or a
+        set operation (TRUE).
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PULONG Flags;
+    KSTATUS Status;
+
+    switch (InformationType) {
+    case NetLinkInformationChecksumOffload:
+        if (*DataSize != sizeof(ULONG)) {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        if (Set != FALSE) {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        Flags = (PULONG)Data;
+        *Flags = 0;
+        Status = STATUS_SUCCESS;
+        break;
+
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        break;
+    }
+
+    return Status;
+}
+
+VOID
+VirtnetDestroyLink (
+    PVOID DeviceContext
+    )
+
+/*++
+
+Routine Description:
+
+    This routine notifies the device layer that the networking core is in the
+    process of destroying the link and will no longer call into the device for
+    this link. This allows the device layer to release any context that was
+    supporting the device link interface.
+
+Arguments:
+
+    DeviceContext - Supplies a pointer to the device context associated with
+        the link being destroyed.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    return;
+}
+
+INTERRUPT_STATUS
+VirtnetpInterruptService (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the legacy interrupt service routine, used when
+    MSI-X is not available. Reading the ISR status register acknowledges the
+    interrupt.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the device.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+    UCHAR IsrStatus;
+
+    Device = Context;
+    IsrStatus = VirtioReadIsrStatus(&(Device->Virtio));
+    if (IsrStatus == 0) {
+        return InterruptStatusNotClaimed;
+    }
+
+    if ((IsrStatus & VIRTIO_ISR_QUEUE_INTERRUPT) != 0) {
+        RtlAtomicOr32(&(Device->QueuePairs[0].PendingInterrupts),
+                      VIRTIO_NET_PENDING_QUEUE);
+    }
+
+    if ((IsrStatus & VIRTIO_ISR_CONFIGURATION_INTERRUPT) != 0) {
+        RtlAtomicOr32(&(Device->PendingInterrupts),
+                      VIRTIO_NET_PENDING_CONFIGURATION);
+    }
+
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+VirtnetpInterruptServiceWorker (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine processes legacy interrupts at low level.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the device.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+
+    Device = Context;
+    VirtnetpConfigurationInterruptServiceWorker(Device);
+    VirtnetpProcessQueuePair(&(Device->QueuePairs[0]));
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+VirtnetpQueueInterruptService (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the interrupt service routine for a queue pair's
+    MSI-X vector. The vector is not shared, so there's nothing to check.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the queue pair.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_NET_QUEUE_PAIR Pair;
+
+    Pair = Context;
+    RtlAtomicOr32(&(Pair->PendingInterrupts), VIRTIO_NET_PENDING_QUEUE);
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+VirtnetpQueueInterruptServiceWorker (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine processes a queue pair's interrupt at low level.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the queue pair.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    VirtnetpProcessQueuePair(Context);
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+VirtnetpConfigurationInterruptService (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the interrupt service routine for the
+    configuration change MSI-X vector.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the device.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+
+    Device = Context;
+    RtlAtomicOr32(&(Device->PendingInterrupts),
+                  VIRTIO_NET_PENDING_CONFIGURATION);
+
+    return InterruptStatusClaimed;
+}
+
+INTERRUPT_STATUS
+VirtnetpConfigurationInterruptServiceWorker (
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine processes a configuration change at low level, which for
+    this device means a link state change.
+
+Arguments:
+
+    Context - Supplies the context pointer given to the system when the
+        interrupt was connected. In this case, this points to the device.
+
+Return Value:
+
+    Interrupt status.
+
+--*/
+
+{
+
+    PVIRTIO_NET_DEVICE Device;
+    ULONG PendingBits;
+
+    Device = Context;
+    PendingBits = RtlAtomicExchange32(&(Device->PendingInterrupts), 0);
+    if ((PendingBits & VIRTIO_NET_PENDING_CONFIGURATION) != 0) {
+        VirtnetpUpdateLinkState(Device);
+    }
+
+    return InterruptStatusClaimed;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+KSTATUS
+VirtnetpStartDevice (
+    PIRP Irp,
+    PVIRTIO_NET_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine starts a virtio network device: it negotiates features,
+    sets up the queue pairs and their interrupts, and adds the link to core
+    networking.
+
+Arguments:
+
+    Irp - Supplies a pointer to the start device IRP.
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONGLONG Features;
+    UINTN Index;
+    ULONG MaxQueuePairs;
+    BOOL MultipleQueues;
+    ULONG PairIndex;
+    ULONG QueueCount;
+    KSTATUS Status;
+    PVIRTIO_DEVICE Virtio;
+
+    //
+    // The queues survive across restarts.
+    //
+
+    if (Device->QueuePairs != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    Virtio = &(Device->Virtio);
+    Status = VirtioStartDevice(Virtio, Irp);
+    if (!KSUCCESS(Status)) {
+        goto StartDeviceEnd;
+    }
+
+    Features = (1ULL << VIRTIO_NET_FEATURE_MAC) |
+               (1ULL << VIRTIO_NET_FEATURE_STATUS) |
+               (1ULL << VIRTIO_NET_FEATURE_CONTROL_QUEUE) |
+               (1ULL << VIRTIO_NET_FEATURE_MULTIPLE_QUEUES);
+
+    Status = VirtioNegotiateFeatures(Virtio, Features);
+    if (!KSUCCESS(Status)) {
+        goto StartDeviceEnd;
+    }
+
+    if (VIRTIO_HAS_FEATURE(Virtio, VIRTIO_NET_FEATURE_MAC)) {
+        for (Index = 0; Index < ETHERNET_ADDRESS_SIZE; Index += 1) {
+            Device->MacAddress[Index] = VIRTIO_READ_DEVICE_CONFIG8(
+                                                Virtio,
+                                                VIRTIO_NET_CONFIG_MAC + Index);
+        }
+
+    } else {
+        NetCreateEthernetAddress(Device->MacAddress);
+    }
+
+    //
+    // Multiple queues are only usable with a control queue to turn them on.
+    //
+
+    MaxQueuePairs = 1;
+    MultipleQueues = FALSE;
+    if ((VIRTIO_HAS_FEATURE(Virtio, VIRTIO_NET_FEATURE_MULTIPLE_QUEUES)) &&
+        (VIRTIO_HAS_FEATURE(Virtio, VIRTIO_NET_FEATURE_CONTROL_QUEUE))) {
+
+        MultipleQueues = TRUE;
+        MaxQueuePairs = VIRTIO_READ_DEVICE_CONFIG16(
+                                            Virtio,
+                                            VIRTIO_NET_CONFIG_MAX_QUEUE_PAIRS);
+
+        QueueCount = VirtioGetQueueCount(Virtio);
+        if (QueueCount < (MaxQueuePairs * 2) + 1) {
+            Status = STATUS_DEVICE_NOT_CONNECTED;
+            goto StartDeviceEnd;
+        }
+    }
+
+    if (MaxQueuePairs == 0) {
+        Status = STATUS_DEVICE_NOT_CONNECTED;
+        goto StartDeviceEnd;
+    }
+
+    Status = VirtnetpConnectInterrupts(Device, MaxQueuePairs);
+    if (!KSUCCESS(Status)) {
+        goto StartDeviceEnd;
+    }
+
+    Status = VirtnetpCreateQueues(Device);
+    if (!KSUCCESS(Status)) {
+        goto StartDeviceEnd;
+    }
+
+    if (MultipleQueues != FALSE) {
+        Status = VirtioCreateQueue(Virtio,
+                                   MaxQueuePairs * 2,
+                                   0,
+                                   0,
+                                   VIRTIO_MSI_NO_VECTOR,
+                                   &(Device->ControlQueue));
+
+        if (!KSUCCESS(Status)) {
+            goto StartDeviceEnd;
+        }
+    }
+
+    Status = VirtnetpAddNetworkDevice(Device);
+    if (!KSUCCESS(Status)) {
+        goto StartDeviceEnd;
+    }
+
+    for (PairIndex = 0; PairIndex < Device->QueuePairCount; PairIndex += 1) {
+        Status = VirtnetpFillReceiveQueue(&(Device->QueuePairs[PairIndex]));
+        if (!KSUCCESS(Status)) {
+            goto StartDeviceEnd;
+        }
+    }
+
+    VirtioSetDriverOk(Virtio);
+
+    //
+    // The control queue is only live once the driver is OK. A device with
+    // the multiple queue feature starts with a single pair enabled.
+    //
+
+    if (Device->ControlQueue != NULL) {
+        Status = VirtnetpSetQueuePairCount(Device);
+        if (!KSUCCESS(Status)) {
+            goto StartDeviceEnd;
+        }
+    }
+
+    VirtnetpUpdateLinkState(Device);
+    Status = STATUS_SUCCESS;
+
+StartDeviceEnd:
+    if (!KSUCCESS(Status)) {
+        VirtioDestroyDevice(Virtio);
+        if (Device->NetworkLink != NULL) {
+            NetRemoveLink(Device->NetworkLink);
+            Device->NetworkLink = NULL;
+        }
+
+        VirtnetpDestroyQueues(Device);
+    }
+
+    return Status;
+}
+
+KSTATUS
+VirtnetpConnectInterrupts (
+    PVIRTIO_NET_DEVICE Device,
+    ULONG MaxQueuePairs
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decides how many queue pairs to use based on the interrupt
+    vectors available, allocates the queue pair array, and connects the
+    interrupts.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    MaxQueuePairs - Supplies the maximum number of queue pairs the device
+        supports.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN AllocationSize;
+    ULONG Index;
+    PVIRTIO_NET_QUEUE_PAIR Pair;
+    ULONG PairCount;
+    ULONG ProcessorCount;
+    KSTATUS Status;
+    PVIRTIO_DEVICE Virtio;
+
+    Virtio = &(Device->Virtio);
+
+    //
+    // Use one pair per processor if there is a vector for each along with
+    // the configuration vector. Otherwise fall back to a single pair.
+    //
+
+    PairCount = 1;
+    if (((Virtio->Flags & VIRTIO_DEVICE_FLAG_MSI_X_ENABLED) != 0) &&
+        (Virtio->InterruptVectorCount > 1)) {
+
+        ProcessorCount = KeGetActiveProcessorCount();
+        PairCount = Virtio->InterruptVectorCount - 1;
+        if (PairCount > ProcessorCount) {
+            PairCount = ProcessorCount;
+        }
+
+        if (PairCount > MaxQueuePairs) {
+            PairCount = MaxQueuePairs;
+        }
+
+        if (PairCount > VIRTIO_NET_MAX_QUEUE_PAIRS) {
+            PairCount = VIRTIO_NET_MAX_QUEUE_PAIRS;
+        }
+    }
+
+    AllocationSize = sizeof(VIRTIO_NET_QUEUE_PAIR) * PairCount;
+    Device->QueuePairs = MmAllocateNonPagedPool(AllocationSize,
+                                                VIRTIO_NET_ALLOCATION_TAG);
+
+    if (Device->QueuePairs == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Device->QueuePairs, AllocationSize);
+    Device->QueuePairCount = PairCount;
+    for (Index = 0; Index < PairCount; Index += 1) {
+        Pair = &(Device->QueuePairs[Index]);
+        Pair->Device = Device;
+        Pair->Index = Index;
+        NET_INITIALIZE_PACKET_LIST(&(Pair->TransmitPacketList));
+        Pair->ReceiveLock = KeCreateQueuedLock();
+        Pair->TransmitLock = KeCreateQueuedLock();
+        if ((Pair->ReceiveLock == NULL) || (Pair->TransmitLock == NULL)) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    //
+    // Legacy interrupts funnel everything through one shared line.
+    //
+
+    if ((Virtio->Flags & VIRTIO_DEVICE_FLAG_MSI_X_ENABLED) == 0) {
+        Status = VirtioConnectInterrupt(Virtio,
+                                        0,
+                                        -1,
+                                        VirtnetpInterruptService,
+                                        NULL,
+                                        VirtnetpInterruptServiceWorker,
+                                        Device);
+
+        return Status;
+    }
+
+    //
+    // With a single MSI-X vector, the lone pair gets it and configuration
+    // changes are not reported.
+    //
+
+    if (Virtio->InterruptVectorCount == 1) {
+        Status = VirtioConnectInterrupt(Virtio,
+                                        0,
+                                        -1,
+                                        VirtnetpQueueInterruptService,
+                                        NULL,
+                                        VirtnetpQueueInterruptServiceWorker,
+                                        &(Device->QueuePairs[0]));
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        VirtioSetConfigurationVector(Virtio, VIRTIO_MSI_NO_VECTOR);
+        return VirtioEnableMsiX(Virtio);
+    }
+
+    Status = VirtioConnectInterrupt(
+                                   Virtio,
+                                   VIRTIO_NET_CONFIGURATION_VECTOR,
+                                   -1,
+                                   VirtnetpConfigurationInterruptService,
+                                   NULL,
+                                   VirtnetpConfigurationInterruptServiceWorker,
+                                   Device);
+
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // Steer each pair's vector at its own processor, so that receive
+    // processing happens where the sender for that pair tends to run.
+    //
+
+    for (Index = 0; Index < PairCount; Index += 1) {
+        Status = VirtioConnectInterrupt(Virtio,
+                                        1 + Index,
+                                        Index,
+                                        VirtnetpQueueInterruptService,
+                                        NULL,
+                                        VirtnetpQueueInterruptServiceWorker,
+                                        &(Device->QueuePairs[Index]));
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    VirtioSetConfigurationVector(Virtio, VIRTIO_NET_CONFIGURATION_VECTOR);
+    return VirtioEnableMsiX(Virtio);
+}
+
+KSTATUS
+VirtnetpCreateQueues (
+    PVIRTIO_NET_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates the receive and transmit queues for each pair.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Index;
+    PVIRTIO_NET_QUEUE_PAIR Pair;
+    KSTATUS Status;
+    USHORT Vector;
+    PVIRTIO_DEVICE Virtio;
+
+    Virtio = &(Device->Virtio);
+    for (Index = 0; Index < Device->QueuePairCount; Index += 1) {
+        Pair = &(Device->QueuePairs[Index]);
+        Vector = 0;
+        if (Virtio->InterruptVectorCount > 1) {
+            Vector = 1 + Index;
+        }
+
+        //
+        // Every packet is a single segment, so indirect tables would only
+        // add a level of indirection.
+        //
+
+        Status = VirtioCreateQueue(Virtio,
+                                   VIRTIO_NET_RECEIVE_QUEUE_INDEX(Index),
+                                   VIRTIO_NET_MAX_QUEUE_SIZE,
+                                   0,
+                                   Vector,
+                                   &(Pair->ReceiveQueue));
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        Status = VirtioCreateQueue(Virtio,
+                                   VIRTIO_NET_TRANSMIT_QUEUE_INDEX(Index),
+                                   VIRTIO_NET_MAX_QUEUE_SIZE,
+                                   0,
+                                   Vector,
+                                   &(Pair->TransmitQueue));
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+VirtnetpDestroyQueues (
+    PVIRTIO_NET_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys all queues and the packets they hold. The device
+    must already have been reset.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    PNET_PACKET_BUFFER Packet;
+    PVIRTIO_NET_QUEUE_PAIR Pair;
+    PVIRTIO_QUEUE Queue;
+    ULONG QueueIndex;
+    ULONG Slot;
+
+    if (Device->ControlQueue != NULL) {
+        VirtioDestroyQueue(Device->ControlQueue);
+        Device->ControlQueue = NULL;
+    }
+
+    if (Device->ControlIoBuffer != NULL) {
+        MmFreeIoBuffer(Device->ControlIoBuffer);
+        Device->ControlIoBuffer = NULL;
+    }
+
+    if (Device->QueuePairs == NULL) {
+        return;
+    }
+
+    for (Index = 0; Index < Device->QueuePairCount; Index += 1) {
+        Pair = &(Device->QueuePairs[Index]);
+        for (QueueIndex = 0; QueueIndex < 2; QueueIndex += 1) {
+            Queue = Pair->ReceiveQueue;
+            if (QueueIndex != 0) {
+                Queue = Pair->TransmitQueue;
+            }
+
+            if (Queue == NULL) {
+                continue;
+            }
+
+            for (Slot = 0; Slot < Queue->Size; Slot += 1) {
+                Packet = Queue->Cookies[Slot];
+                if (Packet != NULL) {
+                    NetFreeBuffer(Packet);
+                }
+            }
+
+            VirtioDestroyQueue(Queue);
+        }
+
+        while (NET_PACKET_LIST_EMPTY(&(Pair->TransmitPacketList)) == FALSE) {
+            Packet = LIST_VALUE(Pair->TransmitPacketList.Head.Next,
+                                NET_PACKET_BUFFER,
+                                ListEntry);
+
+            NET_REMOVE_PACKET_FROM_LIST(Packet, &(Pair->TransmitPacketList));
+            NetFreeBuffer(Packet);
+        }
+
+        if (Pair->ReceiveLock != NULL) {
+            KeDestroyQueuedLock(Pair->ReceiveLock);
+        }
+
+        if (Pair->TransmitLock != NULL) {
+            KeDestroyQueuedLock(Pair->TransmitLock);
+        }
+    }
+
+    MmFreeNonPagedPool(Device->QueuePairs);
+    Device->QueuePairs = NULL;
+    Device->QueuePairCount = 0;
+    return;
+}
+
+KSTATUS
+VirtnetpAddNetworkDevice (
+    PVIRTIO_NET_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds the device to core networking's available links.
+
+Arguments:
+
+    Device - Supplies a pointer to the device to add.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    NET_LINK_PROPERTIES Properties;
+    KSTATUS Status;
+
+    if (Device->NetworkLink != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Reserve room in front of every transmitted packet for the virtio
+    // header so that the header and frame go down as a single descriptor.
+    //
+
+    RtlZeroMemory(&Properties, sizeof(NET_LINK_PROPERTIES));
+    Properties.Version = NET_LINK_PROPERTIES_VERSION;
+    Properties.TransmitAlignment = 1;
+    Properties.Device = Device->OsDevice;
+    Properties.DeviceContext = Device;
+    Properties.PacketSizeInformation.MaxPacketSize =
+                                                  VIRTIO_NET_RECEIVE_DATA_SIZE;
+
+    Properties.PacketSizeInformation.HeaderSize = sizeof(VIRTIO_NET_HEADER);
+    Properties.DataLinkType = NetDomainEthernet;
+    Properties.MaxPhysicalAddress = MAX_ULONGLONG;
+    Properties.PhysicalAddress.Domain = NetDomainEthernet;
+    RtlCopyMemory(&(Properties.PhysicalAddress.Address),
+                  &(Device->MacAddress),
+                  sizeof(Device->MacAddress));
+
+    Properties.Interface.Send = VirtnetSend;
+    Properties.Interface.GetSetInformation = VirtnetGetSetInformation;
+    Properties.Interface.DestroyLink = VirtnetDestroyLink;
+    Status = NetAddLink(&Properties, &(Device->NetworkLink));
+    return Status;
+}
+
+KSTATUS
+VirtnetpFillReceiveQueue (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    )
+
+/*++
+
+Routine Description:
+
+    This routine posts receive buffers to every free slot of a pair's receive
+    queue.
+
+Arguments:
+
+    Pair - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PNET_PACKET_BUFFER Buffer;
+    PVIRTIO_QUEUE Queue;
+    VIRTIO_SCATTER_ENTRY Scatter;
+    KSTATUS Status;
+
+    Queue = Pair->ReceiveQueue;
+    while (Queue->FreeCount != 0) {
+        Status = NetAllocateBuffer(0,
+                                   sizeof(VIRTIO_NET_HEADER) +
+                                   VIRTIO_NET_RECEIVE_DATA_SIZE,
+                                   0,
+                                   Pair->Device->NetworkLink,
+                                   0,
+                                   &Buffer);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        Scatter.PhysicalAddress = Buffer->BufferPhysicalAddress;
+        Scatter.Length = Buffer->BufferSize;
+        Scatter.Flags = VIRTIO_SCATTER_DEVICE_WRITABLE;
+        Status = VirtioQueueAddBuffer(Queue, &Scatter, 1, Buffer);
+
+        ASSERT(KSUCCESS(Status));
+    }
+
+    VirtioQueueKick(Queue);
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+VirtnetpSetQueuePairCount (
+    PVIRTIO_NET_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tells the device how many queue pairs to use, over the
+    control queue. The device is polled for the answer, as the control queue
+    has no interrupt.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PVIRTIO_NET_CONTROL_QUEUE_PAIRS Command;
+    PHYSICAL_ADDRESS CommandPhysical;
+    ULONG Length;
+    VIRTIO_SCATTER_ENTRY Scatter[2];
+    KSTATUS Status;
+    ULONG Waited;
+
+    if (Device->ControlIoBuffer == NULL) {
+        Device->ControlIoBuffer = MmAllocateNonPagedIoBuffer(
+                                        0,
+                                        MAX_ULONGLONG,
+                                        sizeof(ULONG),
+                                        sizeof(VIRTIO_NET_CONTROL_QUEUE_PAIRS),
+                                        IO_BUFFER_FLAG_PHYSICALLY_CONTIGUOUS);
+
+        if (Device->ControlIoBuffer == NULL) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    Command = Device->ControlIoBuffer->Fragment[0].VirtualAddress;
+    CommandPhysical = Device->ControlIoBuffer->Fragment[0].PhysicalAddress;
+    Command->Class = VIRTIO_NET_CONTROL_CLASS_MULTIPLE_QUEUES;
+    Command->Command = VIRTIO_NET_CONTROL_SET_QUEUE_PAIRS;
+    Command->QueuePairs = Device->QueuePairCount;
+    Command->Ack = VIRTIO_NET_CONTROL_ERROR;
+    Scatter[0].PhysicalAddress = CommandPhysical;
+    Scatter[0].Length = FIELD_OFFSET(VIRTIO_NET_CONTROL_QUEUE_PAIRS, Ack);
+    Scatter[0].Flags = 0;
+    Scatter[1].PhysicalAddress = CommandPhysical + Scatter[0].Length;
+    Scatter[1].Length = sizeof(UCHAR);
+    Scatter[1].Flags = VIRTIO_SCATTER_DEVICE_WRITABLE;
+    Status = VirtioQueueAddBuffer(Device->ControlQueue, Scatter, 2, Command);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    VirtioQueueKick(Device->ControlQueue);
+    Status = STATUS_TIMEOUT;
+    for (Waited = 0;
+         Waited < VIRTIO_NET_CONTROL_TIMEOUT_US;
+         Waited += VIRTIO_NET_CONTROL_POLL_US) {
+
+        if (VirtioQueueGetUsedBuffer(Device->ControlQueue, &Length) != NULL) {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+
+        HlBusySpin(VIRTIO_NET_CONTROL_POLL_US);
+    }
+
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    if (Command->Ack != VIRTIO_NET_CONTROL_OK) {
+        RtlDebugPrint("Virtio-net: Device rejected %d queue pairs.\n",
+                      Device->QueuePairCount);
+
+        return STATUS_DEVICE_IO_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+VirtnetpProcessQueuePair (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles received packets and transmit completions for a
+    queue pair. This routine runs at low level.
+
+Arguments:
+
+    Pair - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PNET_PACKET_BUFFER Buffer;
+    PVIRTIO_NET_DEVICE Device;
+    ULONG Length;
+    NET_PACKET_BUFFER Packet;
+    ULONG PendingBits;
+    PVIRTIO_QUEUE Queue;
+    VIRTIO_SCATTER_ENTRY Scatter;
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    PendingBits = RtlAtomicExchange32(&(Pair->PendingInterrupts), 0);
+    if ((PendingBits & VIRTIO_NET_PENDING_QUEUE) == 0) {
+        return;
+    }
+
+    Device = Pair->Device;
+
+    //
+    // Hand each received frame up the stack and then recycle its buffer
+    // straight back into the ring, since the stack is done with it once the
+    // receive routine returns.
+    //
+
+    Queue = Pair->ReceiveQueue;
+    RtlZeroMemory(&Packet, sizeof(NET_PACKET_BUFFER));
+    KeAcquireQueuedLock(Pair->ReceiveLock);
+    do {
+        VirtioQueueDisableInterrupts(Queue);
+        while (TRUE) {
+            Buffer = VirtioQueueGetUsedBuffer(Queue, &Length);
+            if (Buffer == NULL) {
+                break;
+            }
+
+            if ((Length > sizeof(VIRTIO_NET_HEADER)) &&
+                (Length <= Buffer->BufferSize)) {
+
+                Packet.Buffer = Buffer->Buffer;
+                Packet.BufferPhysicalAddress = Buffer->BufferPhysicalAddress;
+                Packet.BufferSize = Buffer->BufferSize;
+                Packet.DataSize = Length;
+                Packet.DataOffset = sizeof(VIRTIO_NET_HEADER);
+                Packet.FooterOffset = Length;
+                Packet.Flags = 0;
+                NetProcessReceivedPacket(Device->NetworkLink, &Packet);
+            }
+
+            Scatter.PhysicalAddress = Buffer->BufferPhysicalAddress;
+            Scatter.Length = Buffer->BufferSize;
+            Scatter.Flags = VIRTIO_SCATTER_DEVICE_WRITABLE;
+            Status = VirtioQueueAddBuffer(Queue, &Scatter, 1, Buffer);
+
+            ASSERT(KSUCCESS(Status));
+        }
+
+        VirtioQueueKick(Queue);
+
+    } while (VirtioQueueEnableInterrupts(Queue, 0) != FALSE);
+
+    KeReleaseQueuedLock(Pair->ReceiveLock);
+
+    //
+    // Reap transmit completions and push out anything that was waiting for
+    // ring space.
+    //
+
+    KeAcquireQueuedLock(Pair->TransmitLock);
+    VirtnetpReapTransmittedPackets(Pair);
+    VirtnetpSendPendingPackets(Pair);
+    KeReleaseQueuedLock(Pair->TransmitLock);
+    return;
+}
+
+VOID
+VirtnetpReapTransmittedPackets (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees packets the device has finished transmitting. This
+    routine assumes the pair's transmit lock is held.
+
+Arguments:
+
+    Pair - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Length;
+    PNET_PACKET_BUFFER Packet;
+    PVIRTIO_QUEUE Queue;
+
+    ASSERT(KeIsQueuedLockHeld(Pair->TransmitLock) != FALSE);
+
+    Queue = Pair->TransmitQueue;
+
+    //
+    // Transmit completions are batched: the device is asked to interrupt only
+    // after a run of them, since the send path reaps as it goes.
+    //
+
+    do {
+        VirtioQueueDisableInterrupts(Queue);
+        while (TRUE) {
+            Packet = VirtioQueueGetUsedBuffer(Queue, &Length);
+            if (Packet == NULL) {
+                break;
+            }
+
+            NetFreeBuffer(Packet);
+        }
+
+    } while (VirtioQueueEnableInterrupts(
+                                   Queue,
+                                   VIRTIO_NET_TRANSMIT_INTERRUPT_DELAY) != FALSE);
+
+    return;
+}
+
+VOID
+VirtnetpSendPendingPackets (
+    PVIRTIO_NET_QUEUE_PAIR Pair
+    )
+
+/*++
+
+Routine Description:
+
+    This routine moves as many packets as fit from the pair's transmit list
+    into the transmit ring, and notifies the device. This routine assumes the
+    pair's transmit lock is held.
+
+Arguments:
+
+    Pair - Supplies a pointer to the queue pair.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PVIRTIO_NET_HEADER Header;
+    PNET_PACKET_BUFFER Packet;
+    PVIRTIO_QUEUE Queue;
+    VIRTIO_SCATTER_ENTRY Scatter;
+    KSTATUS Status;
+
+    ASSERT(KeIsQueuedLockHeld(Pair->TransmitLock) != FALSE);
+
+    Queue = Pair->TransmitQueue;
+    while ((NET_PACKET_LIST_EMPTY(&(Pair->TransmitPacketList)) == FALSE) &&
+           (Queue->FreeCount != 0)) {
+
+        Packet = LIST_VALUE(Pair->TransmitPacketList.Head.Next,
+                            NET_PACKET_BUFFER,
+                            ListEntry);
+
+        //
+        // The link advertised room for the header in front of the data.
+        //
+
+        ASSERT(Packet->DataOffset >= sizeof(VIRTIO_NET_HEADER));
+
+        Header = (PVIRTIO_NET_HEADER)((PUCHAR)Packet->Buffer +
+                                      Packet->DataOffset -
+                                      sizeof(VIRTIO_NET_HEADER));
+
+        RtlZeroMemory(Header, sizeof(VIRTIO_NET_HEADER));
+        Scatter.PhysicalAddress = Packet->BufferPhysicalAddress +
+                                  Packet->DataOffset -
+                                  sizeof(VIRTIO_NET_HEADER);
+
+        Scatter.Length = Packet->FooterOffset - Packet->DataOffset +
+                         sizeof(VIRTIO_NET_HEADER);
+
+        Scatter.Flags = 0;
+        Status = VirtioQueueAddBuffer(Queue, &Scatter, 1, Packet);
+        if (!KSUCCESS(Status)) {
+            break;
+        }
+
+        NET_REMOVE_PACKET_FROM_LIST(Packet, &(Pair->TransmitPacketList));
+    }
+
+    VirtioQueueKick(Queue);
+    return;
+}
+
+VOID
+VirtnetpUpdateLinkState (
+    PVIRTIO_NET_DEVICE Device
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads the link status from the device and reports any change
+    to core networking. Devices without the status feature are always up.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    BOOL LinkActive;
+    USHORT LinkStatus;
+
+    LinkActive = TRUE;
+    if (VIRTIO_HAS_FEATURE(&(Device->Virtio), VIRTIO_NET_FEATURE_STATUS)) {
+        LinkStatus = VIRTIO_READ_DEVICE_CONFIG16(&(Device->Virtio),
+                                                 VIRTIO_NET_CONFIG_STATUS);
+
+        if ((LinkStatus & VIRTIO_NET_STATUS_LINK_UP) == 0) {
+            LinkActive = FALSE;
+        }
+    }
+
+    KeAcquireQueuedLock(Device->ConfigurationLock);
+    if (LinkActive != Device->LinkActive) {
+        Device->LinkActive = LinkActive;
+        NetSetLinkState(Device->NetworkLink, LinkActive, NET_SPEED_1000_MBPS);
+    }
+
+    KeReleaseQueuedLock(Device->ConfigurationLock);
+    return;
+}
+
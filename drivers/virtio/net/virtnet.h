@@ -0,0 +1,290 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    virtnet.h
+
+Abstract:
+
+    This header contains definitions for the virtio network device driver.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define VIRTIO_NET_ALLOCATION_TAG 0x744E6956 // 'tNiV'
+
+//
+// Define the maximum number of queue pairs the driver will use. Each pair
+// gets its own MSI-X vector, targeted at its own processor.
+//
+
+#define VIRTIO_NET_MAX_QUEUE_PAIRS 16
+
+//
+// Define the maximum number of descriptors in each queue.
+//
+
+#define VIRTIO_NET_MAX_QUEUE_SIZE 256
+
+//
+// Define the size of the data portion of each receive buffer: a maximum
+// sized ethernet frame without the CRC.
+//
+
+#define VIRTIO_NET_RECEIVE_DATA_SIZE 1514
+
+//
+// Define the maximum number of packets to hold in a transmit queue's software
+// list while the ring is full.
+//
+
+#define VIRTIO_NET_MAX_TRANSMIT_PACKET_LIST_COUNT 1024
+
+//
+// Define how many transmit completions to let pile up before asking for an
+// interrupt. Transmit completions are also reaped on the send path.
+//
+
+#define VIRTIO_NET_TRANSMIT_INTERRUPT_DELAY 32
+
+//
+// Define the MSI-X vector used for configuration changes when there are
+// enough vectors to give it its own.
+//
+
+#define VIRTIO_NET_CONFIGURATION_VECTOR 0
+
+//
+// Define the device feature bits.
+//
+
+#define VIRTIO_NET_FEATURE_MAC 5
+#define VIRTIO_NET_FEATURE_STATUS 16
+#define VIRTIO_NET_FEATURE_CONTROL_QUEUE 17
+#define VIRTIO_NET_FEATURE_MULTIPLE_QUEUES 22
+
+//
+// Define the device configuration offsets.
+//
+
+#define VIRTIO_NET_CONFIG_MAC 0x00
+#define VIRTIO_NET_CONFIG_STATUS 0x06
+#define VIRTIO_NET_CONFIG_MAX_QUEUE_PAIRS 0x08
+
+//
+// Define the device status bits.
+//
+
+#define VIRTIO_NET_STATUS_LINK_UP 0x0001
+
+//
+// Define the control queue classes, commands, and acknowledgements.
+//
+
+#define VIRTIO_NET_CONTROL_CLASS_MULTIPLE_QUEUES 4
+#define VIRTIO_NET_CONTROL_SET_QUEUE_PAIRS 0
+#define VIRTIO_NET_CONTROL_OK 0
+#define VIRTIO_NET_CONTROL_ERROR 1
+
+//
+// Define how long to wait for the device to answer a control command, in
+// microseconds.
+//
+
+#define VIRTIO_NET_CONTROL_TIMEOUT_US 1000000
+#define VIRTIO_NET_CONTROL_POLL_US 100
+
+//
+// Define the pending interrupt bits.
+//
+
+#define VIRTIO_NET_PENDING_QUEUE VIRTIO_ISR_QUEUE_INTERRUPT
+#define VIRTIO_NET_PENDING_CONFIGURATION VIRTIO_ISR_CONFIGURATION_INTERRUPT
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure defines the header that precedes every packet on the
+    transmit and receive queues.
+
+Members:
+
+    Flags - Stores checksum flags. This driver uses no offloads, so this is
+        zero.
+
+    GsoType - Stores the segmentation offload type, zero for none.
+
+    HeaderLength - Stores the header length for segmentation offload.
+
+    GsoSize - Stores the segment size for segmentation offload.
+
+    ChecksumStart - Stores the offset to start checksumming from.
+
+    ChecksumOffset - Stores the offset after the start to store the checksum.
+
+    BufferCount - Stores the number of merged receive buffers.
+
+--*/
+
+typedef struct _VIRTIO_NET_HEADER {
+    UCHAR Flags;
+    UCHAR GsoType;
+    USHORT HeaderLength;
+    USHORT GsoSize;
+    USHORT ChecksumStart;
+    USHORT ChecksumOffset;
+    USHORT BufferCount;
+} PACKED VIRTIO_NET_HEADER, *PVIRTIO_NET_HEADER;
+
+/*++
+
+Structure Description:
+
+    This structure defines a control queue command to set the number of
+    active queue pairs, along with the device's reply.
+
+Members:
+
+    Class - Stores the command class.
+
+    Command - Stores the command within the class.
+
+    QueuePairs - Stores the number of queue pairs to enable.
+
+    Ack - Stores the acknowledgement written by the device.
+
+--*/
+
+typedef struct _VIRTIO_NET_CONTROL_QUEUE_PAIRS {
+    UCHAR Class;
+    UCHAR Command;
+    USHORT QueuePairs;
+    UCHAR Ack;
+} PACKED VIRTIO_NET_CONTROL_QUEUE_PAIRS, *PVIRTIO_NET_CONTROL_QUEUE_PAIRS;
+
+typedef struct _VIRTIO_NET_DEVICE VIRTIO_NET_DEVICE, *PVIRTIO_NET_DEVICE;
+
+/*++
+
+Structure Description:
+
+    This structure defines a receive and transmit queue pair. Each pair is
+    serviced by its own interrupt vector aimed at its own processor.
+
+Members:
+
+    Device - Stores a pointer to the owning device.
+
+    Index - Stores the pair index.
+
+    ReceiveQueue - Stores a pointer to the receive virtqueue.
+
+    TransmitQueue - Stores a pointer to the transmit virtqueue.
+
+    ReceiveLock - Stores a pointer to the lock serializing receive processing.
+
+    TransmitLock - Stores a pointer to the lock serializing access to the
+        transmit queue and transmit packet list.
+
+    TransmitPacketList - Stores the list of packets waiting for room in the
+        transmit ring.
+
+    PendingInterrupts - Stores a bitfield of pending work for the pair. See
+        VIRTIO_NET_PENDING_* definitions.
+
+--*/
+
+typedef struct _VIRTIO_NET_QUEUE_PAIR {
+    PVIRTIO_NET_DEVICE Device;
+    ULONG Index;
+    PVIRTIO_QUEUE ReceiveQueue;
+    PVIRTIO_QUEUE TransmitQueue;
+    PQUEUED_LOCK ReceiveLock;
+    PQUEUED_LOCK TransmitLock;
+    NET_PACKET_LIST TransmitPacketList;
+    volatile ULONG PendingInterrupts;
+} VIRTIO_NET_QUEUE_PAIR, *PVIRTIO_NET_QUEUE_PAIR;
+
+/*++
+
+Structure Description:
+
+    This structure defines the state of a virtio network device.
+
+Members:
+
+    OsDevice - Stores a pointer to the OS device.
+
+    Virtio - Stores the virtio transport state.
+
+    NetworkLink - Stores a pointer to the core networking link.
+
+    QueuePairs - Stores the array of queue pairs.
+
+    QueuePairCount - Stores the number of queue pairs in use.
+
+    ControlQueue - Stores a pointer to the control queue, if negotiated.
+
+    ControlIoBuffer - Stores the I/O buffer used for control commands.
+
+    MacAddress - Stores the device's MAC address.
+
+    LinkActive - Stores a boolean indicating whether the link is up.
+
+    PendingInterrupts - Stores a bitfield of pending device-wide work, used by
+        the configuration and legacy interrupts.
+
+    ConfigurationLock - Stores a pointer to the lock serializing link state
+        changes.
+
+--*/
+
+struct _VIRTIO_NET_DEVICE {
+    PDEVICE OsDevice;
+    VIRTIO_DEVICE Virtio;
+    PNET_LINK NetworkLink;
+    PVIRTIO_NET_QUEUE_PAIR QueuePairs;
+    ULONG QueuePairCount;
+    PVIRTIO_QUEUE ControlQueue;
+    PIO_BUFFER ControlIoBuffer;
+    BYTE MacAddress[ETHERNET_ADDRESS_SIZE];
+    BOOL LinkActive;
+    volatile ULONG PendingInterrupts;
+    PQUEUED_LOCK ConfigurationLock;
+};
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
@@ -0,0 +1,142 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    block.h
+
+Abstract:
+
+    This header contains definitions for the block queue statistics device
+    information structure.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define BLOCK_QUEUE_STATISTICS_UUID \
+    {{0x2D55C413, 0xB7BD430A, 0xBFDFBE67, 0x786552DB}}
+
+#define BLOCK_QUEUE_STATISTICS_VERSION 0x00010000
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores the statistics for one direction of traffic through
+    a block queue.
+
+Members:
+
+    Irps - Stores the number of IRPs submitted to the queue.
+
+    BackMerges - Stores the number of IRPs appended to the end of an already
+        queued request.
+
+    FrontMerges - Stores the number of IRPs prepended to the start of an
+        already queued request.
+
+    Requests - Stores the number of requests handed to the device.
+
+    Bytes - Stores the number of bytes successfully transferred.
+
+    Errors - Stores the number of requests that completed with an error.
+
+    DeadlineExpirations - Stores the number of times the scheduler dispatched
+        out of order because a request's deadline had passed.
+
+    TotalLatency - Stores the sum of the latencies of all completed requests,
+        in microseconds. Latency is measured from the arrival of the first IRP
+        in the request until the device completes it.
+
+    MaxLatency - Stores the longest latency of any completed request, in
+        microseconds.
+
+--*/
+
+typedef struct _BLOCK_IO_STATISTICS {
+    ULONGLONG Irps;
+    ULONGLONG BackMerges;
+    ULONGLONG FrontMerges;
+    ULONGLONG Requests;
+    ULONGLONG Bytes;
+    ULONGLONG Errors;
+    ULONGLONG DeadlineExpirations;
+    ULONGLONG TotalLatency;
+    ULONGLONG MaxLatency;
+} BLOCK_IO_STATISTICS, *PBLOCK_IO_STATISTICS;
+
+/*++
+
+Structure Description:
+
+    This structure stores the block queue statistics published by disks whose
+    drivers use a block queue.
+
+Members:
+
+    Version - Stores the structure version. Future revisions will be backwards
+        compatible. Set to BLOCK_QUEUE_STATISTICS_VERSION.
+
+    MaxDepth - Stores the maximum number of requests the queue will have
+        outstanding at the device at once.
+
+    Depth - Stores the number of requests currently outstanding at the device.
+
+    PeakDepth - Stores the largest number of requests ever outstanding at the
+        device at once.
+
+    Queued - Stores the number of requests currently waiting in the queue.
+
+    TotalDepth - Stores the sum of the device queue depth observed as each
+        request was dispatched. Dividing by the total number of requests
+        yields the average depth.
+
+    Plugs - Stores the number of times the queue was plugged.
+
+    Read - Stores the read statistics.
+
+    Write - Stores the write statistics.
+
+--*/
+
+typedef struct _BLOCK_QUEUE_STATISTICS {
+    ULONG Version;
+    ULONG MaxDepth;
+    ULONG Depth;
+    ULONG PeakDepth;
+    ULONG Queued;
+    ULONGLONG TotalDepth;
+    ULONGLONG Plugs;
+    BLOCK_IO_STATISTICS Read;
+    BLOCK_IO_STATISTICS Write;
+} BLOCK_QUEUE_STATISTICS, *PBLOCK_QUEUE_STATISTICS;
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
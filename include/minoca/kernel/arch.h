@@ -742,3 +742,27 @@ Return Value:
 
 --*/
 
+VOID
+ArCaptureTrapFrame (
+    PTRAP_FRAME TrapFrame
+    );
+
+/*++
+
+Routine Description:
+
+    This routine fills in a trap frame with the current register state, as if
+    a trap had been taken at the return address of this routine. The stack
+    pointer is the caller's stack pointer after this routine returns. This is
+    used to record a processor's state when no exception is in progress.
+
+Arguments:
+
+    TrapFrame - Supplies a pointer where the register state will be returned.
+
+Return Value:
+
+    None.
+
+--*/
+
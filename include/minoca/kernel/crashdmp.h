@@ -27,12 +27,35 @@ Module Name:
 
 #define CRASH_DUMP_SIGNATURE 0x504D4443 // 'PMDC'
 
+//
+// Define crash dump header flags.
+//
+
+//
+// This flag is set if the dump file was too small to hold every page, and the
+// memory stream stops short.
+//
+
+#define CRASH_DUMP_FLAG_TRUNCATED 0x00000001
+
+//
+// Define crash dump page record flags.
+//
+
+//
+// This flag is set if the page data is LZ compressed. Otherwise the data is
+// a raw copy of the page.
+//
+
+#define CRASH_DUMP_PAGE_FLAG_COMPRESSED 0x00000001
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
 typedef enum _CRASH_DUMP_TYPE {
     CrashDumpMinimal,
+    CrashDumpKernel,
     CrashDumpTypeMax
 } CRASH_DUMP_TYPE, *PCRASH_DUMP_TYPE;
 
@@ -86,6 +109,26 @@ Structure Description:
 
     Parameter4 - Stores the fourth parameter supplied to the crash routine.
 
+    PageSize - Stores the size of a page on the crashed system, in bytes.
+
+    Flags - Stores a bitmask of flags. See CRASH_DUMP_FLAG_* for definitions.
+
+    MemoryOffset - Stores the offset from the beginning of the file to the
+        stream of page records in a kernel dump. Each record is a
+        CRASH_DUMP_PAGE_HEADER followed immediately by its data. This is 0 for
+        minimal dumps.
+
+    MemorySize - Stores the size of the page record stream, in bytes.
+
+    PageCount - Stores the number of page records in the stream.
+
+    ContextOffset - Stores the offset from the beginning of the file to the
+        CRASH_DUMP_CONTEXT describing the crashing processor. 0 indicates that
+        it is not present.
+
+    ContextSize - Stores the size of the crash dump context, including the
+        loaded module list that follows it, in bytes.
+
 --*/
 
 typedef struct _CRASH_DUMP_HEADER {
@@ -107,8 +150,71 @@ typedef struct _CRASH_DUMP_HEADER {
     ULONGLONG Parameter2;
     ULONGLONG Parameter3;
     ULONGLONG Parameter4;
+    ULONG PageSize;
+    ULONG Flags;
+    ULONGLONG MemoryOffset;
+    ULONGLONG MemorySize;
+    ULONGLONG PageCount;
+    ULONGLONG ContextOffset;
+    ULONG ContextSize;
 } PACKED CRASH_DUMP_HEADER, *PCRASH_DUMP_HEADER;
 
+/*++
+
+Structure Description:
+
+    This structure defines the header for one physical page saved in a kernel
+    crash dump. Records are packed back to back with no alignment.
+
+Members:
+
+    PhysicalAddress - Stores the physical address of the page.
+
+    Size - Stores the size of the data following this header, in bytes.
+
+    Flags - Stores a bitmask of flags. See CRASH_DUMP_PAGE_FLAG_* for
+        definitions.
+
+--*/
+
+typedef struct _CRASH_DUMP_PAGE_HEADER {
+    ULONGLONG PhysicalAddress;
+    ULONG Size;
+    ULONG Flags;
+} PACKED CRASH_DUMP_PAGE_HEADER, *PCRASH_DUMP_PAGE_HEADER;
+
+/*++
+
+Structure Description:
+
+    This structure defines the state of the crashing processor, saved so that
+    the debugger can open a kernel dump as if it were broken into the live
+    system. A MODULE_LIST_HEADER and its array of LOADED_MODULE_ENTRY
+    structures immediately follow this structure.
+
+Members:
+
+    MachineType - Stores the architecture of the crashed system. See
+        MACHINE_TYPE_* definitions.
+
+    Padding - Stores some padding to align the following members.
+
+    SpecialRegisters - Stores the special registers of the crashing processor,
+        including the page table base needed to translate virtual addresses.
+
+    BreakNotification - Stores the general registers and break details of the
+        crashing processor, as they would have been sent to a connected
+        debugger.
+
+--*/
+
+typedef struct _CRASH_DUMP_CONTEXT {
+    ULONG MachineType;
+    ULONG Padding;
+    SPECIAL_REGISTERS_UNION SpecialRegisters;
+    BREAK_NOTIFICATION BreakNotification;
+} PACKED CRASH_DUMP_CONTEXT, *PCRASH_DUMP_CONTEXT;
+
 //
 // -------------------------------------------------------- Function Prototypes
 //
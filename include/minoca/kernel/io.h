@@ -832,6 +832,12 @@ Module Name:
 
 #define PIPE_ATOMIC_WRITE_SIZE 4096
 
+//
+// Define the largest buffer size a pipe can be resized to.
+//
+
+#define PIPE_MAXIMUM_SIZE (8 * _1MB)
+
 //
 // Define I/O test hook bits.
 //
@@ -869,7 +875,7 @@ Module Name:
 // Define the version number for the I/O cache statistics.
 //
 
-#define IO_CACHE_STATISTICS_VERSION 0x1
+#define IO_CACHE_STATISTICS_VERSION 0x2
 #define IO_CACHE_STATISTICS_MAX_VERSION 0x10000000
 
 //
@@ -914,6 +920,12 @@ Module Name:
 #define IRP_READ_WRITE_FLAG_DMA                   0x00000004
 #define IRP_READ_WRITE_FLAG_POLLED                0x00000008
 
+//
+// Define the current block queue parameters structure version.
+//
+
+#define BLOCK_QUEUE_PARAMETERS_VERSION 1
+
 //
 // Define the set of flags describing an I/O request's saved I/O buffer state.
 //
@@ -963,6 +975,16 @@ typedef enum _SEEK_COMMAND {
     SeekCommandFromEnd,
 } SEEK_COMMAND, *PSEEK_COMMAND;
 
+typedef enum _FILE_ADVICE {
+    FileAdviceNormal,
+    FileAdviceSequential,
+    FileAdviceRandom,
+    FileAdviceNoReuse,
+    FileAdviceWillNeed,
+    FileAdviceDontNeed,
+    FileAdviceCount
+} FILE_ADVICE, *PFILE_ADVICE;
+
 typedef enum _TERMINAL_CONTROL_CHARACTER {
     TerminalCharacterEndOfFile,
     TerminalCharacterEndOfLine,
@@ -1787,6 +1809,7 @@ typedef enum _IRP_MINOR_CODE {
     IrpMinorSystemControlDeviceInformation,
     IrpMinorSystemControlGetBlockInformation,
     IrpMinorSystemControlSynchronize,
+    IrpMinorSystemControlDiscard,
 } IRP_MINOR_CODE, *PIRP_MINOR_CODE;
 
 typedef enum _IRP_DIRECTION {
@@ -2193,6 +2216,129 @@ typedef struct _BLOCK_DEVICE_PARAMETERS {
     ULONGLONG BlockCount;
 } BLOCK_DEVICE_PARAMETERS, *PBLOCK_DEVICE_PARAMETERS;
 
+typedef struct _BLOCK_QUEUE BLOCK_QUEUE, *PBLOCK_QUEUE;
+
+/*++
+
+Structure Description:
+
+    This structure describes a request a block queue hands to a storage
+    driver. A request covers one or more contiguous read or write IRPs that
+    were merged together while queued.
+
+Members:
+
+    MinorCode - Stores the direction of the request, either IrpMinorIoRead or
+        IrpMinorIoWrite.
+
+    IoFlags - Stores the I/O flags of the request, the union of the flags of
+        every IRP merged into it. See IO_FLAG_* definitions.
+
+    IoOffset - Stores the offset, in bytes, from the beginning of the device
+        where the request starts.
+
+    IoSizeInBytes - Stores the size of the request, in bytes.
+
+    IoBytesCompleted - Stores the number of bytes the device has transferred
+        so far. The driver updates this as it works through the request.
+
+    IoBuffer - Stores a pointer to the I/O buffer describing the whole
+        request, starting at its current offset. For merged requests this is
+        built from the physical fragments of each IRP's buffer, so it is only
+        suitable for DMA.
+
+    DriverContext - Stores a pointer's worth of storage for the driver.
+
+--*/
+
+typedef struct _BLOCK_REQUEST {
+    IRP_MINOR_CODE MinorCode;
+    ULONG IoFlags;
+    ULONGLONG IoOffset;
+    UINTN IoSizeInBytes;
+    UINTN IoBytesCompleted;
+    PIO_BUFFER IoBuffer;
+    PVOID DriverContext;
+} BLOCK_REQUEST, *PBLOCK_REQUEST;
+
+typedef
+KSTATUS
+(*PBLOCK_QUEUE_START_REQUEST) (
+    PVOID Context,
+    PBLOCK_REQUEST Request
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called by a block queue to hand a request to the device.
+    It is called at dispatch level without any block queue locks held.
+
+Arguments:
+
+    Context - Supplies the context pointer supplied when the block queue was
+        created.
+
+    Request - Supplies a pointer to the request to start.
+
+Return Value:
+
+    STATUS_SUCCESS if the device accepted the request. The driver must call
+    IoCompleteBlockRequest when it finishes.
+
+    STATUS_RESOURCE_IN_USE if the device has no room for the request right
+    now. The request goes back to the head of the queue until the driver next
+    calls IoRunBlockQueue.
+
+    Other error codes fail every IRP in the request.
+
+--*/
+
+/*++
+
+Structure Description:
+
+    This structure describes the parameters for creating a block queue.
+
+Members:
+
+    Version - Stores the structure version. Set to
+        BLOCK_QUEUE_PARAMETERS_VERSION.
+
+    Driver - Stores a pointer to the driver that owns the queue. IRPs
+        submitted to the queue are pended and completed on its behalf.
+
+    Context - Stores a context pointer passed to the start routine.
+
+    StartRequest - Stores a pointer to the routine that hands requests to the
+        device.
+
+    BlockSize - Stores the block size of the device, in bytes.
+
+    MaxTransferSize - Stores the largest request, in bytes, that IRPs will be
+        merged up to.
+
+    MaxSegments - Stores the largest number of I/O buffer fragments that IRPs
+        will be merged up to.
+
+    MaxDepth - Stores the maximum number of requests to have outstanding at
+        the device at once. Requests beyond this wait in the queue, where they
+        can be merged and sorted.
+
+--*/
+
+typedef struct _BLOCK_QUEUE_PARAMETERS {
+    ULONG Version;
+    PDRIVER Driver;
+    PVOID Context;
+    PBLOCK_QUEUE_START_REQUEST StartRequest;
+    ULONG BlockSize;
+    UINTN MaxTransferSize;
+    ULONG MaxSegments;
+    ULONG MaxDepth;
+} BLOCK_QUEUE_PARAMETERS, *PBLOCK_QUEUE_PARAMETERS;
+
 /*++
 
 Structure Description:
@@ -2422,6 +2568,30 @@ typedef struct _SYSTEM_CONTROL_TRUNCATE {
 
 /*++
 
+Structure Description:
+
+    This structure defines the information sent to a block device to discard
+    a range of blocks. The device may deallocate the blocks, after which
+    their contents are undefined.
+
+Members:
+
+    BlockAddress - Stores the first block to discard, relative to the device
+        receiving the request. Drivers that pass the request down, such as
+        the partition driver, translate this in place.
+
+    BlockCount - Stores the number of blocks to discard. This may be trimmed
+        on the way down if the range runs off the end of a partition.
+
+--*/
+
+typedef struct _SYSTEM_CONTROL_DISCARD {
+    ULONGLONG BlockAddress;
+    ULONGLONG BlockCount;
+} SYSTEM_CONTROL_DISCARD, *PSYSTEM_CONTROL_DISCARD;
+
+/*++
+
 Structure Description:
 
     This structure defines a device information result returned as an array
@@ -2633,6 +2803,18 @@ Structure Description:
     LastCleanTime - Stores a time counter value for the last time the page
         cache was cleaned.
 
+    ActivePageCount - Stores the number of page cache entries on the active
+        list, which holds entries that have been used more than once.
+
+    InactivePageCount - Stores the number of page cache entries on the
+        inactive lists, which are evicted first.
+
+    PromotionCount - Stores the number of times an entry has been promoted
+        from the inactive lists to the active list.
+
+    DemotionCount - Stores the number of times an entry has been demoted from
+        the active list back to the inactive list.
+
 --*/
 
 typedef struct _IO_CACHE_STATISTICS {
@@ -2644,6 +2826,10 @@ typedef struct _IO_CACHE_STATISTICS {
     UINTN PhysicalPageCount;
     UINTN DirtyPageCount;
     ULONGLONG LastCleanTime;
+    UINTN ActivePageCount;
+    UINTN InactivePageCount;
+    UINTN PromotionCount;
+    UINTN DemotionCount;
 } IO_CACHE_STATISTICS, *PIO_CACHE_STATISTICS;
 
 /*++
@@ -3851,6 +4037,218 @@ Return Value:
 
 --*/
 
+KERNEL_API
+PBLOCK_QUEUE
+IoCreateBlockQueue (
+    PBLOCK_QUEUE_PARAMETERS Parameters
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates a block queue, which sits between a storage driver
+    and the device. It holds read and write IRPs, merges contiguous ones
+    together, and feeds them to the device in an order that favors reads
+    while bounding how long any request waits.
+
+Arguments:
+
+    Parameters - Supplies a pointer to the queue parameters.
+
+Return Value:
+
+    Returns a pointer to the new block queue on success.
+
+    NULL on allocation failure.
+
+--*/
+
+KERNEL_API
+VOID
+IoDestroyBlockQueue (
+    PBLOCK_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys a block queue. The queue must be empty, with no
+    requests outstanding at the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+KSTATUS
+IoQueueBlockIrp (
+    PBLOCK_QUEUE Queue,
+    PIRP Irp
+    );
+
+/*++
+
+Routine Description:
+
+    This routine submits a read or write IRP to a block queue. The IRP must
+    already be prepared for I/O. It is pended, possibly merged with other
+    queued IRPs, and completed when the device finishes the request carrying
+    it. This routine must be called at or below dispatch level.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    Irp - Supplies a pointer to the read or write IRP.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP was queued.
+
+    STATUS_INSUFFICIENT_RESOURCES if a request could not be allocated. The IRP
+    is not pended in this case.
+
+--*/
+
+KERNEL_API
+VOID
+IoRunBlockQueue (
+    PBLOCK_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine hands queued requests to the device until the queue is empty
+    or the device is full. Drivers call this when room frees up at the device.
+    It must be called at or below dispatch level, and not while holding any
+    lock the start routine acquires.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+VOID
+IoCompleteBlockRequest (
+    PBLOCK_REQUEST Request,
+    KSTATUS Status
+    );
+
+/*++
+
+Routine Description:
+
+    This routine completes a request the device has finished. The bytes
+    completed are split across the request's IRPs in order, and each IRP is
+    completed. This does not start more I/O; call IoRunBlockQueue for that.
+    This routine must be called at or below dispatch level.
+
+Arguments:
+
+    Request - Supplies a pointer to the finished request. It is freed by this
+        routine.
+
+    Status - Supplies the completion status of the request.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+VOID
+IoPlugBlockQueue (
+    PBLOCK_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine plugs a block queue, holding back new requests so that a
+    batch of IRPs about to be submitted can be merged and sorted before any
+    reach the device. Plugs nest. The queue releases a plug on its own after
+    a short delay, so a forgotten or long plug only costs latency.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+VOID
+IoUnplugBlockQueue (
+    PBLOCK_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine releases a plug on a block queue. Releasing the last plug
+    sends the held requests to the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+KERNEL_API
+VOID
+IoHandleBlockQueueDeviceInformation (
+    PBLOCK_QUEUE Queue,
+    PIRP Irp
+    );
+
+/*++
+
+Routine Description:
+
+    This routine handles a device information request for the block queue
+    statistics. Requests for other information types are left alone. Drivers
+    call this from their device information handler, and should register the
+    BLOCK_QUEUE_STATISTICS_UUID information type on the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    Irp - Supplies a pointer to the device information system control IRP.
+
+Return Value:
+
+    None. If the request is for the block queue statistics, the IRP is
+    completed.
+
+--*/
+
 KERNEL_API
 KSTATUS
 IoCreateInterface (
@@ -4408,6 +4806,42 @@ Return Value:
 
 --*/
 
+KERNEL_API
+KSTATUS
+IoAdviseFile (
+    PIO_HANDLE Handle,
+    IO_OFFSET Offset,
+    ULONGLONG Size,
+    FILE_ADVICE Advice
+    );
+
+/*++
+
+Routine Description:
+
+    This routine applies an access pattern hint to the page cache for the file
+    or device behind the given handle.
+
+Arguments:
+
+    Handle - Supplies an open I/O handle.
+
+    Offset - Supplies the offset from the beginning of the file or device of
+        the region the advice applies to. This is ignored for advice that
+        applies to the whole file.
+
+    Size - Supplies the size, in bytes, of the region the advice applies to.
+        Supply a value of -1 to cover from the given offset to the end of the
+        file.
+
+    Advice - Supplies the access pattern hint.
+
+Return Value:
+
+    Status code.
+
+--*/
+
 KERNEL_API
 KSTATUS
 IoSeek (
@@ -5673,6 +6107,32 @@ Return Value:
 
 --*/
 
+INTN
+IoSysAdviseFile (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for giving the kernel hints about
+    how a file will be accessed.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
 INTN
 IoSysCreatePipe (
     PVOID SystemCallParameter
@@ -5698,6 +6158,61 @@ Return Value:
 
 --*/
 
+INTN
+IoSysSpliceMemory (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for splicing user pages into a
+    pipe. Whole, page aligned pages are added to the pipe without being
+    copied, and the rest is written normally.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of bytes completed (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
+INTN
+IoSysTeePipe (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for duplicating the unread
+    contents of one pipe into another without consuming them.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of bytes duplicated (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
 INTN
 IoSysGetCurrentDirectory (
     PVOID SystemCallParameter
@@ -7473,6 +7988,150 @@ Return Value:
 
 --*/
 
+KSTATUS
+IoSpliceStreamBuffer (
+    PSTREAM_BUFFER StreamBuffer,
+    PIO_BUFFER IoBuffer,
+    UINTN ByteCount,
+    ULONG TimeoutInMilliseconds,
+    BOOL NonBlocking,
+    PUINTN BytesSpliced
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds the pages of the given I/O buffer to a stream buffer
+    without copying them. The pages are locked in memory and referenced by
+    the stream until they are read out, so the owner of the buffer must not
+    modify them in the meantime. This routine must be called at low level.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer to write to.
+
+    IoBuffer - Supplies a pointer to the I/O buffer containing the pages to
+        add. The current offset of the I/O buffer must be page aligned.
+
+    ByteCount - Supplies the number of bytes to add. This must be a multiple
+        of the page size.
+
+    TimeoutInMilliseconds - Supplies the number of milliseconds that the I/O
+        operation should be waited on before timing out. Use
+        WAIT_TIME_INDEFINITE to wait forever on the I/O.
+
+    NonBlocking - Supplies a boolean indicating if this operation should avoid
+        blocking.
+
+    BytesSpliced - Supplies a pointer where the number of bytes actually
+        added to the stream will be returned.
+
+Return Value:
+
+    Status code. If a failing status code is returned, then check the number of
+    bytes spliced to see if any pages made it in.
+
+--*/
+
+KSTATUS
+IoTeeStreamBuffer (
+    PSTREAM_BUFFER Source,
+    PSTREAM_BUFFER Destination,
+    UINTN ByteCount,
+    ULONG TimeoutInMilliseconds,
+    BOOL NonBlocking,
+    PUINTN BytesCopied
+    );
+
+/*++
+
+Routine Description:
+
+    This routine duplicates data at the front of one stream buffer onto the
+    end of another without consuming it from the source. The pages are shared
+    between the two streams rather than copied. This routine must be called at
+    low level.
+
+Arguments:
+
+    Source - Supplies a pointer to the stream buffer to duplicate from.
+
+    Destination - Supplies a pointer to the stream buffer to append to.
+
+    ByteCount - Supplies the maximum number of bytes to duplicate.
+
+    TimeoutInMilliseconds - Supplies the number of milliseconds that either
+        side should be waited on before timing out. Use WAIT_TIME_INDEFINITE
+        to wait forever.
+
+    NonBlocking - Supplies a boolean indicating if this operation should avoid
+        blocking.
+
+    BytesCopied - Supplies a pointer where the number of bytes duplicated will
+        be returned.
+
+Return Value:
+
+    STATUS_END_OF_FILE if the source is empty and disconnected.
+
+    STATUS_BROKEN_PIPE if the destination is disconnected.
+
+    Other status codes.
+
+--*/
+
+KSTATUS
+IoResizeStreamBuffer (
+    PSTREAM_BUFFER StreamBuffer,
+    ULONG Size
+    );
+
+/*++
+
+Routine Description:
+
+    This routine changes the capacity of a stream buffer. The size is rounded
+    up to a whole number of pages, and to at least the atomic write size.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+    Size - Supplies the new capacity, in bytes.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_RESOURCE_IN_USE if the stream currently holds more data than would
+    fit in the new size.
+
+    STATUS_INSUFFICIENT_RESOURCES on allocation failure.
+
+--*/
+
+ULONG
+IoGetStreamBufferSize (
+    PSTREAM_BUFFER StreamBuffer
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the capacity of a stream buffer.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+Return Value:
+
+    Returns the capacity of the stream buffer, in bytes.
+
+--*/
+
 KSTATUS
 IoStreamBufferConnect (
     PSTREAM_BUFFER StreamBuffer
@@ -7705,6 +8364,32 @@ Return Value:
 
 --*/
 
+BOOL
+IoIsPageCacheEntryDirty (
+    PPAGE_CACHE_ENTRY Entry
+    );
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the given page cache entry may hold data
+    not yet written to its backing store. It takes no locks, so it can be
+    called while writing a crash dump.
+
+Arguments:
+
+    Entry - Supplies a pointer to a page cache entry.
+
+Return Value:
+
+    TRUE if the entry is dirty, or is mapped and may have been written through
+    the mapping.
+
+    FALSE if the entry's contents can be read back from disk.
+
+--*/
+
 KERNEL_API
 VOID
 IoSetTestHook (
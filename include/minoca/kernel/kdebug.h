@@ -576,6 +576,33 @@ Return Value:
 
 --*/
 
+VOID
+KdFillCrashDumpContext (
+    PTRAP_FRAME TrapFrame,
+    PVOID Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine fills out the machine type, special registers, and break
+    notification of a crash dump context from the given trap frame. It does
+    not depend on the debugger being initialized or connected. The loaded
+    module fields of the break notification are left for the caller.
+
+Arguments:
+
+    TrapFrame - Supplies a pointer to the state of the crashing processor.
+
+    Context - Supplies a pointer to the CRASH_DUMP_CONTEXT to fill out.
+
+Return Value:
+
+    None.
+
+--*/
+
 VOID
 KdDebugExceptionHandler (
     ULONG Exception,
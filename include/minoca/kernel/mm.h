@@ -91,9 +91,18 @@ Module Name:
 
 #define USER_STACK_HEADROOM (128 * _1MB)
 #define USER_STACK_MAX (((UINTN)MAX_USER_ADDRESS + 1) * 3 / 4)
-#define MM_STATISTICS_VERSION 1
+#define MM_STATISTICS_VERSION 2
 #define MM_STATISTICS_MAX_VERSION 0x10000000
 
+//
+// Define the number of processors whose use of an address space is tracked.
+// TLB shootdowns on systems with more processors than this are broadcast.
+//
+
+#define ADDRESS_SPACE_TRACKED_PROCESSORS 256
+#define ADDRESS_SPACE_PROCESSOR_WORDS \
+    (ADDRESS_SPACE_TRACKED_PROCESSORS / (sizeof(ULONG) * BITS_PER_BYTE))
+
 //
 // Define flags for memory accounting systems.
 //
@@ -374,6 +383,16 @@ typedef enum _MEMORY_WARNING_LEVEL {
     MaxMemoryWarningLevels
 } MEMORY_WARNING_LEVEL, *PMEMORY_WARNING_LEVEL;
 
+typedef enum _MEMORY_ADVICE {
+    MemoryAdviceNormal,
+    MemoryAdviceRandom,
+    MemoryAdviceSequential,
+    MemoryAdviceWillNeed,
+    MemoryAdviceDontNeed,
+    MemoryAdviceFree,
+    MemoryAdviceCount
+} MEMORY_ADVICE, *PMEMORY_ADVICE;
+
 typedef enum _MM_INFORMATION_TYPE {
     MmInformationInvalid,
     MmInformationSystemMemory,
@@ -486,6 +505,38 @@ Return Value:
 
 --*/
 
+typedef
+KSTATUS
+(*PMM_CRASH_DUMP_PAGE_ROUTINE) (
+    PVOID Context,
+    PHYSICAL_ADDRESS PhysicalAddress,
+    PVOID Page
+    );
+
+/*++
+
+Routine Description:
+
+    This routine is called for each physical page that belongs in a kernel
+    crash dump.
+
+Arguments:
+
+    Context - Supplies the context pointer passed to the enumeration.
+
+    PhysicalAddress - Supplies the physical address of the page.
+
+    Page - Supplies a temporary mapping of the page, valid only for the
+        duration of the call.
+
+Return Value:
+
+    STATUS_SUCCESS to continue the enumeration.
+
+    Any other status stops the enumeration, and is returned by it.
+
+--*/
+
 /*++
 
 Structure Description:
@@ -677,6 +728,17 @@ Structure Description:
     NonPagedPhysicalPages - Stores the number of physical pages that are
         pinned in memory and cannot be paged out to disk.
 
+    LargePageSize - Stores the size of a large page, or 0 if large pages are
+        not supported.
+
+    LargePages - Stores the number of large pages currently mapped.
+
+    LargePagePromotions - Stores the number of times a region of small pages
+        has been promoted to a large page.
+
+    LargePageSplits - Stores the number of times a large page has been split
+        back into small pages.
+
 --*/
 
 typedef struct _MM_STATISTICS {
@@ -687,6 +749,10 @@ typedef struct _MM_STATISTICS {
     UINTN PhysicalPages;
     UINTN AllocatedPhysicalPages;
     UINTN NonPagedPhysicalPages;
+    UINTN LargePageSize;
+    UINTN LargePages;
+    UINTN LargePagePromotions;
+    UINTN LargePageSplits;
 } MM_STATISTICS, *PMM_STATISTICS;
 
 /*++
@@ -738,6 +804,10 @@ Structure Description:
 
     BreakEnd - Stores the end address of the program break.
 
+    ActiveProcessors - Stores a bitmap of the processors that currently have
+        this address space loaded. TLB shootdowns for user mode addresses are
+        only sent to these processors.
+
 --*/
 
 typedef struct _ADDRESS_SPACE {
@@ -749,6 +819,7 @@ typedef struct _ADDRESS_SPACE {
     PVOID MaxMemoryMap;
     PVOID BreakStart;
     PVOID BreakEnd;
+    volatile ULONG ActiveProcessors[ADDRESS_SPACE_PROCESSOR_WORDS];
 } ADDRESS_SPACE, *PADDRESS_SPACE;
 
 /*++
@@ -2686,6 +2757,32 @@ Return Value:
 
 --*/
 
+INTN
+MmSysAdviseMemory (
+    PVOID SystemCallParameter
+    );
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for giving the kernel hints about
+    how a region of memory will be accessed.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
 KSTATUS
 MmCreateCopyOfUserModeString (
     PCSTR UserModeString,
@@ -4084,6 +4181,36 @@ Return Value:
 
 --*/
 
+KSTATUS
+MmEnumerateCrashDumpPages (
+    PMM_CRASH_DUMP_PAGE_ROUTINE Routine,
+    PVOID Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine walks the physical page database on behalf of the crash dump
+    writer, calling the given routine with a temporary mapping of each page
+    whose contents would be lost with the system. Free pages and page cache
+    pages that match their backing store are skipped. It takes no locks, and
+    must only be called at high run level once the system has crashed.
+
+Arguments:
+
+    Routine - Supplies a pointer to the routine to call for each page.
+
+    Context - Supplies a context pointer passed to the routine.
+
+Return Value:
+
+    STATUS_SUCCESS if every page was enumerated.
+
+    Otherwise, returns the first failing status from the routine.
+
+--*/
+
 VOID
 MmFreePhysicalPages (
     PHYSICAL_ADDRESS PhysicalAddress,
@@ -225,8 +225,9 @@ VOID
 
 Routine Description:
 
-    This routine is called whenever a handle is looked up. It is called with
-    the handle table lock still held.
+    This routine is called whenever a handle is looked up. The handle table
+    lock is not held, but the value cannot be released until this routine
+    returns, so it is the place to take a reference on it.
 
 Arguments:
 
@@ -1139,7 +1140,7 @@ ObGetHandleValue (
 Routine Description:
 
     This routine looks up the given handle and returns the value associated
-    with that handle.
+    with that handle. The handle table lock is not acquired.
 
 Arguments:
 
@@ -153,6 +153,13 @@ Module Name:
 #define SYS_IO_FLAG_WRITE 0x00000001
 #define SYS_IO_FLAG_MASK  0x00000001
 
+//
+// Define pipe splice flags.
+//
+
+#define SYS_SPLICE_FLAG_NON_BLOCKING 0x00000001
+#define SYS_SPLICE_FLAG_GIFT         0x00000002
+
 //
 // Define flush flags.
 //
@@ -357,6 +364,10 @@ typedef enum _SYSTEM_CALL_NUMBER {
     SystemCallSetITimer,
     SystemCallSetResourceLimit,
     SystemCallSetBreak,
+    SystemCallAdviseMemory,
+    SystemCallAdviseFile,
+    SystemCallSpliceMemory,
+    SystemCallTeePipe,
     SystemCallCount
 } SYSTEM_CALL_NUMBER, *PSYSTEM_CALL_NUMBER;
 
@@ -410,6 +421,8 @@ typedef enum _FILE_CONTROL_COMMAND {
     FileControlCommandSetDirectoryFlag,
     FileControlCommandCloseFrom,
     FileControlCommandGetPath,
+    FileControlCommandGetPipeSize,
+    FileControlCommandSetPipeSize,
     FileControlCommandCount
 } FILE_CONTROL_COMMAND, *PFILE_CONTROL_COMMAND;
 
@@ -1245,6 +1258,8 @@ Structure Description:
     Owner - Stores the ID of the process to receive signals on asynchronous
         I/O events.
 
+    PipeSize - Stores the capacity of a pipe's buffer, in bytes.
+
 --*/
 
 typedef union _FILE_CONTROL_PARAMETERS_UNION {
@@ -1254,6 +1269,7 @@ typedef union _FILE_CONTROL_PARAMETERS_UNION {
     ULONG Flags;
     FILE_PATH FilePath;
     PROCESS_ID Owner;
+    ULONG PipeSize;
 } FILE_CONTROL_PARAMETERS_UNION, *PFILE_CONTROL_PARAMETERS_UNION;
 
 /*++
@@ -2512,6 +2528,110 @@ typedef struct _SYSTEM_CALL_SET_RESOURCE_LIMIT {
 
 /*++
 
+Structure Description:
+
+    This structure defines the system call parameters for advising the kernel
+    how a region of the current process' address space will be accessed.
+
+Members:
+
+    Address - Stores the page-aligned starting address of the region.
+
+    Size - Stores the size of the region in bytes.
+
+    Advice - Stores the expected access pattern for the region.
+
+--*/
+
+typedef struct _SYSTEM_CALL_ADVISE_MEMORY {
+    PVOID Address;
+    UINTN Size;
+    MEMORY_ADVICE Advice;
+} SYSCALL_STRUCT SYSTEM_CALL_ADVISE_MEMORY, *PSYSTEM_CALL_ADVISE_MEMORY;
+
+/*++
+
+Structure Description:
+
+    This structure defines the system call parameters for advising the kernel
+    how a file will be accessed.
+
+Members:
+
+    Handle - Stores the handle to the file.
+
+    Offset - Stores the offset from the beginning of the file of the region
+        the advice applies to.
+
+    Size - Stores the size of the region in bytes, or -1 to cover through the
+        end of the file.
+
+    Advice - Stores the expected access pattern for the region.
+
+--*/
+
+typedef struct _SYSTEM_CALL_ADVISE_FILE {
+    HANDLE Handle;
+    IO_OFFSET Offset;
+    ULONGLONG Size;
+    FILE_ADVICE Advice;
+} SYSCALL_STRUCT SYSTEM_CALL_ADVISE_FILE, *PSYSTEM_CALL_ADVISE_FILE;
+
+/*++
+
+Structure Description:
+
+    This structure defines the system call parameters for splicing user pages
+    into a pipe.
+
+Members:
+
+    Handle - Stores the handle to the write end of the pipe.
+
+    VectorArray - Stores a pointer to an array of I/O vector structures which
+        specify the buffers to add to the pipe.
+
+    VectorCount - Stores the number of elements in the vector array.
+
+    Flags - Stores a bitfield of flags. See SYS_SPLICE_FLAG_* definitions.
+
+--*/
+
+typedef struct _SYSTEM_CALL_SPLICE_MEMORY {
+    HANDLE Handle;
+    PIO_VECTOR VectorArray;
+    UINTN VectorCount;
+    ULONG Flags;
+} SYSCALL_STRUCT SYSTEM_CALL_SPLICE_MEMORY, *PSYSTEM_CALL_SPLICE_MEMORY;
+
+/*++
+
+Structure Description:
+
+    This structure defines the system call parameters for duplicating the
+    contents of one pipe into another.
+
+Members:
+
+    Source - Stores the handle to the read end of the pipe to duplicate from.
+
+    Destination - Stores the handle to the write end of the pipe to append to.
+
+    Size - Stores the maximum number of bytes to duplicate.
+
+    Flags - Stores a bitfield of flags. See SYS_SPLICE_FLAG_* definitions.
+
+--*/
+
+typedef struct _SYSTEM_CALL_TEE_PIPE {
+    HANDLE Source;
+    HANDLE Destination;
+    UINTN Size;
+    ULONG Flags;
+} SYSCALL_STRUCT SYSTEM_CALL_TEE_PIPE, *PSYSTEM_CALL_TEE_PIPE;
+
+/*++
+
 Structure Description:
 
     This structure defines a union of all possible system call parameter
@@ -2589,6 +2709,10 @@ typedef union _SYSTEM_CALL_PARAMETER_UNION {
     SYSTEM_CALL_SET_ITIMER SetITimer;
     SYSTEM_CALL_SET_RESOURCE_LIMIT SetResourceLimit;
     SYSTEM_CALL_SET_BREAK SetBreak;
+    SYSTEM_CALL_ADVISE_MEMORY AdviseMemory;
+    SYSTEM_CALL_ADVISE_FILE AdviseFile;
+    SYSTEM_CALL_SPLICE_MEMORY SpliceMemory;
+    SYSTEM_CALL_TEE_PIPE TeePipe;
 } SYSCALL_STRUCT SYSTEM_CALL_PARAMETER_UNION, *PSYSTEM_CALL_PARAMETER_UNION;
 
 typedef
@@ -83,6 +83,13 @@ Module Name:
 #define X64_PML4E_SHIFT 39
 #define X64_PML4E_MASK (X64_PT_MASK << X64_PML4E_SHIFT)
 
+//
+// Define the size of a large page, which is mapped directly by a page
+// directory entry.
+//
+
+#define X64_LARGE_PAGE_SIZE (1ULL << X64_PDE_SHIFT)
+
 //
 // Define the fixed self map address. This is set up by the boot loader and
 // used directly by the kernel. The advantage is it's a compile-time constant
@@ -93,7 +93,8 @@ Module Name:
 //
 
 //
-// Define this flag to perform a garbage collection after every allocation.
+// Define this flag to perform a garbage collection step after every
+// allocation.
 //
 
 #define CK_CONFIGURATION_GC_STRESS 0x00000001
@@ -104,6 +105,12 @@ Module Name:
 
 #define CK_CONFIGURATION_DEBUG_COMPILER 0x00000002
 
+//
+// Define the number of buckets in the garbage collection pause histogram.
+//
+
+#define CK_GC_PAUSE_BUCKETS 24
+
 //
 // Define the maximum UTF-8 value that can be encoded.
 //
@@ -470,6 +477,9 @@ Structure Description:
     MinimumHeapSize - Stores the minimum size of heap, used to keep garbage
         collections from occurring too frequently.
 
+    NurserySize - Stores the number of bytes to allocate in the young
+        generation before collecting it. Zero selects the default.
+
     HeapGrowthPercent - Stores the percentage the heap has to grow to trigger
         another garbage collection. Rather than expressing this as a number
         over 100, it's expressed as a number over 1024 to avoid the divide.
@@ -490,12 +500,64 @@ typedef struct _CK_CONFIGURATION {
     PCK_FOREIGN_FUNCTION UnhandledException;
     UINTN InitialHeapSize;
     UINTN MinimumHeapSize;
+    UINTN NurserySize;
     ULONG HeapGrowthPercent;
     ULONG Flags;
 } CK_CONFIGURATION, *PCK_CONFIGURATION;
 
 /*++
 
+Structure Description:
+
+    This structure contains statistics about the Chalk garbage collector.
+
+Members:
+
+    MinorCollections - Stores the number of young generation collections.
+
+    MajorCollections - Stores the number of completed collections of the
+        whole heap.
+
+    MarkSlices - Stores the number of incremental marking slices run for the
+        old generation.
+
+    BytesPromoted - Stores the total number of bytes that survived a young
+        generation collection and were moved into the old generation.
+
+    ObjectsFreed - Stores the total number of objects the collector has
+        destroyed.
+
+    OldBytes - Stores the approximate size of the old generation.
+
+    NurseryBytes - Stores the number of bytes allocated since the young
+        generation was last collected.
+
+    TotalPause - Stores the total time the collector has spent with the
+        program stopped, in microseconds.
+
+    MaxPause - Stores the longest single pause, in microseconds.
+
+    PauseHistogram - Stores the distribution of pause times. Bucket N counts
+        pauses shorter than 2^N microseconds but at least 2^(N-1) microseconds
+        long. The last bucket also counts every longer pause.
+
+--*/
+
+typedef struct _CK_GC_STATISTICS {
+    ULONGLONG MinorCollections;
+    ULONGLONG MajorCollections;
+    ULONGLONG MarkSlices;
+    ULONGLONG BytesPromoted;
+    ULONGLONG ObjectsFreed;
+    UINTN OldBytes;
+    UINTN NurseryBytes;
+    ULONGLONG TotalPause;
+    ULONGLONG MaxPause;
+    ULONGLONG PauseHistogram[CK_GC_PAUSE_BUCKETS];
+} CK_GC_STATISTICS, *PCK_GC_STATISTICS;
+
+/*++
+
 Structure Description:
 
     This structure describes a variable or other data object in Chalk.
@@ -653,8 +715,9 @@ CkCollectGarbage (
 
 Routine Description:
 
-    This routine performs garbage collection on the given Chalk instance,
-    freeing up unused dynamic memory as appropriate.
+    This routine performs a full garbage collection on the given Chalk
+    instance, freeing up unused dynamic memory as appropriate. Any incremental
+    collection already in progress is finished.
 
 Arguments:
 
@@ -662,9 +725,32 @@ Routine Description:
 
 Return Value:
 
-    Returns a pointer to the newly allocated or reallocated memory on success.
+    None.
+
+--*/
+
+CK_API
+VOID
+CkGetGarbageStatistics (
+    PCK_VM Vm,
+    PCK_GC_STATISTICS Statistics
+    );
+
+/*++
 
-    NULL on allocation failure or for free operations.
+Routine Description:
+
+    This routine returns statistics about the garbage collector.
+
+Arguments:
+
+    Vm - Supplies a pointer to the virtual machine.
+
+    Statistics - Supplies a pointer where the statistics will be returned.
+
+Return Value:
+
+    None.
 
 --*/
 
@@ -521,6 +521,14 @@ Module Name:
 
 #define RED_BLACK_TREE_FLAG_PERIODIC_VALIDATION 0x00000001
 
+//
+// Define the number of entries in the hash table the LZ compressor uses to
+// find matches. The caller supplies the table so that compression can run
+// without allocating memory.
+//
+
+#define RTL_LZ_HASH_TABLE_SIZE 4096
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -733,6 +741,38 @@ Return Value:
 
 --*/
 
+typedef
+BOOL
+(*PPRINT_FORMAT_WRITE_STRING) (
+    PCSTR String,
+    ULONG Size,
+    PPRINT_FORMAT_CONTEXT Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine writes a run of characters to the output during a
+    printf-style formatting operation.
+
+Arguments:
+
+    String - Supplies a pointer to the characters to write. This is not
+        necessarily null terminated.
+
+    Size - Supplies the number of characters to write.
+
+    Context - Supplies a pointer to the printf-context.
+
+Return Value:
+
+    TRUE if all characters were written.
+
+    FALSE on failure.
+
+--*/
+
 /*++
 
 Structure Description:
@@ -745,6 +785,10 @@ Structure Description:
         character to the destination of the formatted string operation. Usually
         this is a file or string.
 
+    WriteString - Stores an optional pointer to a function used to write a
+        run of characters to the destination at once. If this is NULL, runs
+        are sent through the write character routine one at a time.
+
     Context - Stores a pointer's worth of additional context. This pointer is
         not touched by the format string function, it's generally used inside
         the write character routine.
@@ -763,6 +807,7 @@ Structure Description:
 
 struct _PRINT_FORMAT_CONTEXT {
     PPRINT_FORMAT_WRITE_CHARACTER WriteCharacter;
+    PPRINT_FORMAT_WRITE_STRING WriteString;
     PVOID Context;
     ULONG Limit;
     ULONG CharactersWritten;
@@ -1580,6 +1625,87 @@ Return Value:
 
 --*/
 
+RTL_API
+ULONG
+RtlLzCompress (
+    PCVOID Source,
+    ULONG SourceSize,
+    PVOID Destination,
+    ULONG DestinationSize,
+    PULONG HashTable
+    );
+
+/*++
+
+Routine Description:
+
+    This routine compresses a buffer with a small, fast LZ77-class compressor.
+    The output is a series of sequences, each a token byte holding a literal
+    length and a match length, the literal bytes, and a two byte match offset.
+    It favors speed over ratio, and suits data like memory pages that must be
+    compressed quickly in constrained environments.
+
+Arguments:
+
+    Source - Supplies a pointer to the data to compress.
+
+    SourceSize - Supplies the size of the data to compress, in bytes.
+
+    Destination - Supplies a pointer where the compressed data will be
+        written.
+
+    DestinationSize - Supplies the size of the destination buffer, in bytes.
+
+    HashTable - Supplies a pointer to scratch space for the compressor, which
+        must hold RTL_LZ_HASH_TABLE_SIZE entries.
+
+Return Value:
+
+    Returns the size of the compressed data, in bytes.
+
+    0 if the compressed data does not fit in the destination buffer.
+
+--*/
+
+RTL_API
+BOOL
+RtlLzDecompress (
+    PCVOID Source,
+    ULONG SourceSize,
+    PVOID Destination,
+    ULONG DestinationSize,
+    PULONG DecompressedSize
+    );
+
+/*++
+
+Routine Description:
+
+    This routine decompresses data produced by the LZ compressor.
+
+Arguments:
+
+    Source - Supplies a pointer to the compressed data.
+
+    SourceSize - Supplies the size of the compressed data, in bytes.
+
+    Destination - Supplies a pointer where the decompressed data will be
+        written.
+
+    DestinationSize - Supplies the size of the destination buffer, in bytes.
+
+    DecompressedSize - Supplies a pointer where the number of decompressed
+        bytes will be returned.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the compressed data is corrupt or does not fit in the
+    destination buffer.
+
+--*/
+
 RTL_API
 VOID
 RtlRaiseAssertion (
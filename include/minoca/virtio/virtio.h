@@ -0,0 +1,1090 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    virtio.h
+
+Abstract:
+
+    This header contains definitions for the virtio PCI transport and split
+    virtqueue support library shared by paravirtual device drivers.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/intrface/pci.h>
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro returns non-zero if the given feature was negotiated with the
+// device.
+//
+
+#define VIRTIO_HAS_FEATURE(_Device, _Feature) \
+    (((_Device)->DriverFeatures & (1ULL << (_Feature))) != 0)
+
+//
+// These macros read from and write to the device-specific configuration
+// region.
+//
+
+#define VIRTIO_READ_DEVICE_CONFIG8(_Device, _Offset) \
+    HlReadRegister8((PUCHAR)(_Device)->DeviceConfig + (_Offset))
+
+#define VIRTIO_READ_DEVICE_CONFIG16(_Device, _Offset) \
+    HlReadRegister16((PUCHAR)(_Device)->DeviceConfig + (_Offset))
+
+#define VIRTIO_READ_DEVICE_CONFIG32(_Device, _Offset) \
+    HlReadRegister32((PUCHAR)(_Device)->DeviceConfig + (_Offset))
+
+//
+// This macro determines whether or not the device needs to be notified about
+// new available buffers when event index suppression is in use. The event
+// index is the value the device asked to be notified at, and the old and new
+// values bracket the available index change since the last notification.
+//
+
+#define VIRTQ_NEED_EVENT(_EventIndex, _NewIndex, _OldIndex)        \
+    ((USHORT)((_NewIndex) - (_EventIndex) - 1) <                   \
+     (USHORT)((_NewIndex) - (_OldIndex)))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the API decorator.
+//
+
+#ifndef VIRTIO_API
+
+#define VIRTIO_API __DLLIMPORT
+
+#endif
+
+#define VIRTIO_ALLOCATION_TAG 0x74726956 // 'triV'
+
+//
+// Define the PCI vendor ID used by all virtio devices.
+//
+
+#define VIRTIO_PCI_VENDOR_ID 0x1AF4
+
+//
+// Define the maximum number of BARs on a PCI device.
+//
+
+#define VIRTIO_PCI_BAR_COUNT 6
+
+//
+// Define the PCI configuration space offsets used to find the virtio
+// capabilities.
+//
+
+#define VIRTIO_PCI_STATUS_OFFSET 0x06
+#define VIRTIO_PCI_STATUS_CAPABILITIES_LIST 0x0010
+#define VIRTIO_PCI_BAR_OFFSET 0x10
+#define VIRTIO_PCI_CAPABILITIES_POINTER_OFFSET 0x34
+#define VIRTIO_PCI_CAPABILITY_VENDOR 0x09
+
+//
+// Define the PCI BAR bits needed to determine 64-bit BARs.
+//
+
+#define VIRTIO_PCI_BAR_IO_SPACE 0x00000001
+#define VIRTIO_PCI_BAR_MEMORY_SIZE_MASK 0x00000006
+#define VIRTIO_PCI_BAR_MEMORY_64_BIT 0x00000004
+
+//
+// Define the offsets within a virtio vendor-specific PCI capability.
+//
+
+#define VIRTIO_PCI_CAPABILITY_NEXT 0x01
+#define VIRTIO_PCI_CAPABILITY_CONFIGURATION_TYPE 0x03
+#define VIRTIO_PCI_CAPABILITY_BAR 0x04
+#define VIRTIO_PCI_CAPABILITY_OFFSET 0x08
+#define VIRTIO_PCI_CAPABILITY_LENGTH 0x0C
+#define VIRTIO_PCI_CAPABILITY_NOTIFY_MULTIPLIER 0x10
+
+//
+// Define the virtio device status bits.
+//
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FEATURES_OK 0x08
+#define VIRTIO_STATUS_DEVICE_NEEDS_RESET 0x40
+#define VIRTIO_STATUS_FAILED 0x80
+
+//
+// Define the device-independent feature bit numbers.
+//
+
+#define VIRTIO_FEATURE_RING_INDIRECT_DESCRIPTORS 28
+#define VIRTIO_FEATURE_RING_EVENT_INDEX 29
+#define VIRTIO_FEATURE_VERSION_1 32
+
+//
+// Define the value indicating an MSI-X vector is not assigned.
+//
+
+#define VIRTIO_MSI_NO_VECTOR 0xFFFF
+
+//
+// Define the bits in the ISR status register, used with legacy interrupts.
+//
+
+#define VIRTIO_ISR_QUEUE_INTERRUPT 0x01
+#define VIRTIO_ISR_CONFIGURATION_INTERRUPT 0x02
+
+//
+// Define the maximum number of interrupt vectors a virtio device will use.
+//
+
+#define VIRTIO_MAX_INTERRUPT_VECTORS 33
+
+//
+// Define the virtio device flags.
+//
+
+#define VIRTIO_DEVICE_FLAG_PCI_CONFIG_REGISTERED 0x00000001
+#define VIRTIO_DEVICE_FLAG_PCI_CONFIG_AVAILABLE  0x00000002
+#define VIRTIO_DEVICE_FLAG_PCI_MSI_REGISTERED    0x00000004
+#define VIRTIO_DEVICE_FLAG_PCI_MSI_AVAILABLE     0x00000008
+#define VIRTIO_DEVICE_FLAG_MSI_X_REQUESTED       0x00000010
+#define VIRTIO_DEVICE_FLAG_MSI_X_ENABLED         0x00000020
+
+//
+// Define the virtqueue descriptor flags.
+//
+
+#define VIRTQ_DESCRIPTOR_NEXT 0x0001
+#define VIRTQ_DESCRIPTOR_WRITE 0x0002
+#define VIRTQ_DESCRIPTOR_INDIRECT 0x0004
+
+//
+// Define the available ring flags.
+//
+
+#define VIRTQ_AVAILABLE_NO_INTERRUPT 0x0001
+
+//
+// Define the used ring flags.
+//
+
+#define VIRTQ_USED_NO_NOTIFY 0x0001
+
+//
+// Define the alignment requirements of the split virtqueue parts.
+//
+
+#define VIRTQ_DESCRIPTOR_ALIGNMENT 16
+#define VIRTQ_AVAILABLE_ALIGNMENT 2
+#define VIRTQ_USED_ALIGNMENT 4
+
+//
+// Define the value used to terminate the descriptor free list.
+//
+
+#define VIRTQ_END_OF_LIST 0xFFFF
+
+//
+// Define the virtqueue flags.
+//
+
+#define VIRTQ_FLAG_EVENT_INDEX 0x00000001
+#define VIRTQ_FLAG_INTERRUPTS_DISABLED 0x00000002
+
+//
+// Define the scatter entry flags.
+//
+
+#define VIRTIO_SCATTER_DEVICE_WRITABLE 0x00000001
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+typedef enum _VIRTIO_PCI_CONFIGURATION_TYPE {
+    VirtioPciConfigurationInvalid = 0,
+    VirtioPciConfigurationCommon = 1,
+    VirtioPciConfigurationNotify = 2,
+    VirtioPciConfigurationIsr = 3,
+    VirtioPciConfigurationDevice = 4,
+    VirtioPciConfigurationPci = 5
+} VIRTIO_PCI_CONFIGURATION_TYPE, *PVIRTIO_PCI_CONFIGURATION_TYPE;
+
+//
+// Define the offsets in the common configuration structure.
+//
+
+typedef enum _VIRTIO_COMMON_REGISTER {
+    VirtioCommonDeviceFeatureSelect = 0x00,
+    VirtioCommonDeviceFeature = 0x04,
+    VirtioCommonDriverFeatureSelect = 0x08,
+    VirtioCommonDriverFeature = 0x0C,
+    VirtioCommonMsixConfig = 0x10,
+    VirtioCommonQueueCount = 0x12,
+    VirtioCommonDeviceStatus = 0x14,
+    VirtioCommonConfigGeneration = 0x15,
+    VirtioCommonQueueSelect = 0x16,
+    VirtioCommonQueueSize = 0x18,
+    VirtioCommonQueueMsixVector = 0x1A,
+    VirtioCommonQueueEnable = 0x1C,
+    VirtioCommonQueueNotifyOffset = 0x1E,
+    VirtioCommonQueueDescriptorLow = 0x20,
+    VirtioCommonQueueDescriptorHigh = 0x24,
+    VirtioCommonQueueAvailableLow = 0x28,
+    VirtioCommonQueueAvailableHigh = 0x2C,
+    VirtioCommonQueueUsedLow = 0x30,
+    VirtioCommonQueueUsedHigh = 0x34
+} VIRTIO_COMMON_REGISTER, *PVIRTIO_COMMON_REGISTER;
+
+/*++
+
+Structure Description:
+
+    This structure defines a split virtqueue descriptor, as shared with the
+    device.
+
+Members:
+
+    Address - Stores the physical address of the buffer.
+
+    Length - Stores the length of the buffer in bytes.
+
+    Flags - Stores a bitfield of flags. See VIRTQ_DESCRIPTOR_* definitions.
+
+    Next - Stores the index of the next descriptor in the chain if the next
+        flag is set.
+
+--*/
+
+typedef struct _VIRTQ_DESCRIPTOR {
+    ULONGLONG Address;
+    ULONG Length;
+    USHORT Flags;
+    USHORT Next;
+} PACKED VIRTQ_DESCRIPTOR, *PVIRTQ_DESCRIPTOR;
+
+/*++
+
+Structure Description:
+
+    This structure defines the header of the available (driver) ring. The
+    ring of descriptor head indices follows, and after that the used event
+    index if event index suppression was negotiated.
+
+Members:
+
+    Flags - Stores a bitfield of flags. See VIRTQ_AVAILABLE_* definitions.
+
+    Index - Stores the index where the driver will put the next descriptor
+        head, modulo the queue size.
+
+    Ring - Stores the array of available descriptor heads.
+
+--*/
+
+typedef struct _VIRTQ_AVAILABLE {
+    USHORT Flags;
+    USHORT Index;
+    USHORT Ring[ANYSIZE_ARRAY];
+} PACKED VIRTQ_AVAILABLE, *PVIRTQ_AVAILABLE;
+
+/*++
+
+Structure Description:
+
+    This structure defines an element in the used (device) ring.
+
+Members:
+
+    Id - Stores the index of the head of the descriptor chain that was used.
+
+    Length - Stores the total number of bytes written into the device-writable
+        portion of the buffer.
+
+--*/
+
+typedef struct _VIRTQ_USED_ELEMENT {
+    ULONG Id;
+    ULONG Length;
+} PACKED VIRTQ_USED_ELEMENT, *PVIRTQ_USED_ELEMENT;
+
+/*++
+
+Structure Description:
+
+    This structure defines the header of the used (device) ring. The available
+    event index follows the ring if event index suppression was negotiated.
+
+Members:
+
+    Flags - Stores a bitfield of flags. See VIRTQ_USED_* definitions.
+
+    Index - Stores the index where the device will put the next used element,
+        modulo the queue size.
+
+    Ring - Stores the array of used elements.
+
+--*/
+
+typedef struct _VIRTQ_USED {
+    volatile USHORT Flags;
+    volatile USHORT Index;
+    VIRTQ_USED_ELEMENT Ring[ANYSIZE_ARRAY];
+} PACKED VIRTQ_USED, *PVIRTQ_USED;
+
+/*++
+
+Structure Description:
+
+    This structure describes one physically contiguous piece of a buffer
+    handed to a virtqueue.
+
+Members:
+
+    PhysicalAddress - Stores the physical address of the region.
+
+    Length - Stores the length of the region in bytes.
+
+    Flags - Stores a bitfield of flags. See VIRTIO_SCATTER_* definitions.
+
+--*/
+
+typedef struct _VIRTIO_SCATTER_ENTRY {
+    PHYSICAL_ADDRESS PhysicalAddress;
+    ULONG Length;
+    ULONG Flags;
+} VIRTIO_SCATTER_ENTRY, *PVIRTIO_SCATTER_ENTRY;
+
+typedef struct _VIRTIO_DEVICE VIRTIO_DEVICE, *PVIRTIO_DEVICE;
+
+/*++
+
+Structure Description:
+
+    This structure defines the driver's state for a split virtqueue.
+
+Members:
+
+    Device - Stores a pointer to the virtio device that owns the queue.
+
+    Index - Stores the queue index on the device.
+
+    Size - Stores the number of descriptors in the queue.
+
+    MsixVector - Stores the MSI-X vector index assigned to the queue, or
+        VIRTIO_MSI_NO_VECTOR if legacy interrupts are in use.
+
+    RingIoBuffer - Stores a pointer to the I/O buffer containing the
+        descriptor table, available ring, and used ring.
+
+    Descriptors - Stores a pointer to the descriptor table.
+
+    Available - Stores a pointer to the available ring.
+
+    Used - Stores a pointer to the used ring.
+
+    UsedEvent - Stores a pointer to the used event index, which lives at the
+        end of the available ring. The driver writes this to tell the device
+        when to interrupt next.
+
+    AvailableEvent - Stores a pointer to the available event index, which
+        lives at the end of the used ring. The device writes this to tell the
+        driver when to notify next.
+
+    Notify - Stores the mapped address of the queue's notification register.
+
+    FreeHead - Stores the index of the first free descriptor.
+
+    FreeCount - Stores the number of free descriptors.
+
+    LastUsedIndex - Stores the used ring index up to which the driver has
+        consumed completions.
+
+    AvailableIndex - Stores the driver's copy of the available index.
+
+    LastKickIndex - Stores the available index at the time of the last
+        device notification.
+
+    Cookies - Stores an array of driver context pointers, one for each
+        descriptor chain head.
+
+    IndirectIoBuffer - Stores a pointer to the I/O buffer containing the
+        indirect descriptor tables, one for each descriptor in the queue.
+
+    IndirectTables - Stores a pointer to the indirect descriptor tables.
+
+    IndirectTablesPhysical - Stores the physical address of the indirect
+        descriptor tables.
+
+    IndirectEntryCount - Stores the number of entries in each indirect table.
+        This is zero if indirect descriptors are not in use.
+
+    Flags - Stores a bitfield of queue flags. See VIRTQ_FLAG_* definitions.
+
+--*/
+
+typedef struct _VIRTIO_QUEUE {
+    PVIRTIO_DEVICE Device;
+    USHORT Index;
+    USHORT Size;
+    USHORT MsixVector;
+    PIO_BUFFER RingIoBuffer;
+    PVIRTQ_DESCRIPTOR Descriptors;
+    PVIRTQ_AVAILABLE Available;
+    PVIRTQ_USED Used;
+    volatile USHORT *UsedEvent;
+    volatile USHORT *AvailableEvent;
+    PVOID Notify;
+    USHORT FreeHead;
+    USHORT FreeCount;
+    USHORT LastUsedIndex;
+    USHORT AvailableIndex;
+    USHORT LastKickIndex;
+    PVOID *Cookies;
+    PIO_BUFFER IndirectIoBuffer;
+    PVIRTQ_DESCRIPTOR IndirectTables;
+    PHYSICAL_ADDRESS IndirectTablesPhysical;
+    ULONG IndirectEntryCount;
+    ULONG Flags;
+} VIRTIO_QUEUE, *PVIRTIO_QUEUE;
+
+/*++
+
+Structure Description:
+
+    This structure defines a virtio PCI device as seen by the support library.
+
+Members:
+
+    OsDevice - Stores a pointer to the OS device.
+
+    Flags - Stores a bitfield of flags. See VIRTIO_DEVICE_FLAG_* definitions.
+
+    PciConfigInterface - Stores the interface used to access PCI configuration
+        space.
+
+    PciMsiInterface - Stores the interface used to program MSI-X vectors.
+
+    BarAllocations - Stores the resource allocations for each BAR, indexed by
+        the BAR number.
+
+    BarMappings - Stores the virtual mappings of each BAR used by a virtio
+        capability, or NULL if the BAR is not mapped.
+
+    BarMappingSizes - Stores the size of each BAR mapping.
+
+    CommonConfig - Stores the mapped address of the common configuration
+        structure.
+
+    NotifyBase - Stores the mapped address of the notification region.
+
+    NotifyOffsetMultiplier - Stores the multiplier to apply to each queue's
+        notify offset.
+
+    IsrStatus - Stores the mapped address of the ISR status byte.
+
+    DeviceConfig - Stores the mapped address of the device-specific
+        configuration structure.
+
+    DeviceFeatures - Stores the features offered by the device.
+
+    DriverFeatures - Stores the features accepted by the driver.
+
+    InterruptLine - Stores the legacy interrupt line, or INVALID_INTERRUPT_LINE
+        if MSI-X is in use.
+
+    InterruptVectors - Stores the array of interrupt vectors allocated for the
+        device. With MSI-X, index N corresponds to MSI-X table entry N.
+
+    InterruptVectorCount - Stores the number of valid interrupt vectors.
+
+    InterruptHandles - Stores the array of connected interrupt handles.
+
+--*/
+
+struct _VIRTIO_DEVICE {
+    PDEVICE OsDevice;
+    ULONG Flags;
+    INTERFACE_PCI_CONFIG_ACCESS PciConfigInterface;
+    INTERFACE_PCI_MSI PciMsiInterface;
+    PRESOURCE_ALLOCATION BarAllocations[VIRTIO_PCI_BAR_COUNT];
+    PVOID BarMappings[VIRTIO_PCI_BAR_COUNT];
+    UINTN BarMappingSizes[VIRTIO_PCI_BAR_COUNT];
+    PVOID CommonConfig;
+    PVOID NotifyBase;
+    ULONG NotifyOffsetMultiplier;
+    PVOID IsrStatus;
+    PVOID DeviceConfig;
+    ULONGLONG DeviceFeatures;
+    ULONGLONG DriverFeatures;
+    ULONGLONG InterruptLine;
+    ULONGLONG InterruptVectors[VIRTIO_MAX_INTERRUPT_VECTORS];
+    ULONG InterruptVectorCount;
+    HANDLE InterruptHandles[VIRTIO_MAX_INTERRUPT_VECTORS];
+};
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// -------------------------------------------------------- Function Prototypes
+//
+
+VIRTIO_API
+KSTATUS
+VirtioInitializeDevice (
+    PVIRTIO_DEVICE Device,
+    PDEVICE OsDevice
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes a virtio device structure. This should be called
+    when the driver attaches to the device.
+
+Arguments:
+
+    Device - Supplies a pointer to the zeroed device structure to initialize.
+
+    OsDevice - Supplies a pointer to the OS device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VIRTIO_API
+VOID
+VirtioDestroyDevice (
+    PVIRTIO_DEVICE Device
+    );
+
+/*++
+
+Routine Description:
+
+    This routine tears down the PCI state associated with a virtio device:
+    it disconnects interrupts, resets the device, and unmaps its registers.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+VIRTIO_API
+KSTATUS
+VirtioProcessResourceRequirements (
+    PVIRTIO_DEVICE Device,
+    PIRP Irp,
+    ULONG VectorCount
+    );
+
+/*++
+
+Routine Description:
+
+    This routine filters the resource requirements for a virtio PCI device. It
+    asks for the given number of MSI-X vectors if MSI-X is available, with a
+    fallback to a single legacy interrupt vector.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Irp - Supplies a pointer to the query resources IRP.
+
+    VectorCount - Supplies the number of MSI-X vectors the driver would like.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VIRTIO_API
+KSTATUS
+VirtioStartDevice (
+    PVIRTIO_DEVICE Device,
+    PIRP Irp
+    );
+
+/*++
+
+Routine Description:
+
+    This routine collects the allocated resources for a virtio device, finds
+    and maps the virtio PCI capabilities, and resets the device, leaving it
+    in the acknowledged state ready for feature negotiation.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Irp - Supplies a pointer to the start device IRP.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VIRTIO_API
+KSTATUS
+VirtioNegotiateFeatures (
+    PVIRTIO_DEVICE Device,
+    ULONGLONG Features
+    );
+
+/*++
+
+Routine Description:
+
+    This routine negotiates the feature set with the device. The version 1
+    feature is always requested, and the ring features are accepted if the
+    device offers them.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Features - Supplies the device-specific features the driver supports. The
+        intersection of these and the device features is accepted.
+
+Return Value:
+
+    STATUS_SUCCESS if the device accepted the features.
+
+    STATUS_NOT_SUPPORTED if the device does not support version 1 or rejected
+    the feature set.
+
+--*/
+
+VIRTIO_API
+ULONG
+VirtioGetQueueCount (
+    PVIRTIO_DEVICE Device
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the number of virtqueues the device supports.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Returns the maximum number of queues.
+
+--*/
+
+VIRTIO_API
+KSTATUS
+VirtioCreateQueue (
+    PVIRTIO_DEVICE Device,
+    USHORT Index,
+    USHORT MaxSize,
+    ULONG IndirectEntryCount,
+    USHORT MsixVector,
+    PVIRTIO_QUEUE *Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates and enables a split virtqueue on the device. This
+    must be done after feature negotiation but before the device is set to
+    driver OK.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    Index - Supplies the queue index to create.
+
+    MaxSize - Supplies the maximum number of descriptors the driver wants, or
+        0 to use the device's maximum.
+
+    IndirectEntryCount - Supplies the number of entries to reserve in each
+        indirect descriptor table. Supply 0 to avoid using indirect
+        descriptors. This is ignored if the feature was not negotiated.
+
+    MsixVector - Supplies the MSI-X table entry to associate with the queue,
+        or VIRTIO_MSI_NO_VECTOR.
+
+    Queue - Supplies a pointer where a pointer to the new queue will be
+        returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VIRTIO_API
+VOID
+VirtioDestroyQueue (
+    PVIRTIO_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys a virtqueue. The device must have been reset first
+    so that it is no longer using the queue memory.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+VIRTIO_API
+VOID
+VirtioSetDriverOk (
+    PVIRTIO_DEVICE Device
+    );
+
+/*++
+
+Routine Description:
+
+    This routine marks the device as live. After this the device may start
+    consuming queues and generating interrupts.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+VIRTIO_API
+VOID
+VirtioResetDevice (
+    PVIRTIO_DEVICE Device
+    );
+
+/*++
+
+Routine Description:
+
+    This routine resets the device, causing it to drop all queues.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    None.
+
+--*/
+
+VIRTIO_API
+KSTATUS
+VirtioConnectInterrupt (
+    PVIRTIO_DEVICE Device,
+    ULONG VectorIndex,
+    ULONG Processor,
+    PINTERRUPT_SERVICE_ROUTINE InterruptService,
+    PINTERRUPT_SERVICE_ROUTINE DispatchService,
+    PINTERRUPT_SERVICE_ROUTINE LowLevelService,
+    PVOID Context
+    );
+
+/*++
+
+Routine Description:
+
+    This routine connects one of the device's interrupt vectors. With MSI-X,
+    the vector index is the MSI-X table entry, and the message is targeted at
+    the given processor.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    VectorIndex - Supplies the index of the vector to connect.
+
+    Processor - Supplies the processor number to target, or -1 to let the
+        system choose.
+
+    InterruptService - Supplies an optional pointer to the interrupt service
+        routine.
+
+    DispatchService - Supplies an optional pointer to the dispatch level
+        service routine.
+
+    LowLevelService - Supplies an optional pointer to the low level service
+        routine.
+
+    Context - Supplies the context passed to the service routines.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VIRTIO_API
+KSTATUS
+VirtioEnableMsiX (
+    PVIRTIO_DEVICE Device
+    );
+
+/*++
+
+Routine Description:
+
+    This routine enables MSI-X on the device once all vectors are programmed.
+    It does nothing if legacy interrupts are in use.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+VIRTIO_API
+VOID
+VirtioSetConfigurationVector (
+    PVIRTIO_DEVICE Device,
+    USHORT MsixVector
+    );
+
+/*++
+
+Routine Description:
+
+    This routine sets the MSI-X vector used for configuration change
+    interrupts.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+    MsixVector - Supplies the MSI-X table entry, or VIRTIO_MSI_NO_VECTOR.
+
+Return Value:
+
+    None.
+
+--*/
+
+VIRTIO_API
+UCHAR
+VirtioReadIsrStatus (
+    PVIRTIO_DEVICE Device
+    );
+
+/*++
+
+Routine Description:
+
+    This routine reads and clears the ISR status register. This is only
+    meaningful when legacy interrupts are in use.
+
+Arguments:
+
+    Device - Supplies a pointer to the device.
+
+Return Value:
+
+    Returns the ISR status bits. See VIRTIO_ISR_* definitions.
+
+--*/
+
+VIRTIO_API
+KSTATUS
+VirtioQueueAddBuffer (
+    PVIRTIO_QUEUE Queue,
+    PVIRTIO_SCATTER_ENTRY Entries,
+    ULONG EntryCount,
+    PVOID Cookie
+    );
+
+/*++
+
+Routine Description:
+
+    This routine exposes a buffer to the device. All device-readable entries
+    must come before all device-writable entries. If indirect descriptors are
+    in use and the buffer has more than one entry, a single ring descriptor is
+    consumed. The caller must synchronize access to the queue and must call
+    the kick routine to notify the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+    Entries - Supplies the array of scatter entries making up the buffer.
+
+    EntryCount - Supplies the number of entries in the array.
+
+    Cookie - Supplies a non-null context pointer returned when the device is
+        done with the buffer.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INSUFFICIENT_RESOURCES if there are not enough free descriptors.
+
+--*/
+
+VIRTIO_API
+BOOL
+VirtioQueueKick (
+    PVIRTIO_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine publishes all buffers added since the last kick and notifies
+    the device if it has asked to be notified.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+Return Value:
+
+    TRUE if the device was notified.
+
+    FALSE if the notification was suppressed.
+
+--*/
+
+VIRTIO_API
+PVOID
+VirtioQueueGetUsedBuffer (
+    PVIRTIO_QUEUE Queue,
+    PULONG Length
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the next buffer the device has finished with,
+    returning its descriptors to the free list.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+    Length - Supplies a pointer where the number of bytes the device wrote
+        will be returned.
+
+Return Value:
+
+    Returns the cookie supplied when the buffer was added.
+
+    NULL if there are no more used buffers.
+
+--*/
+
+VIRTIO_API
+VOID
+VirtioQueueDisableInterrupts (
+    PVIRTIO_QUEUE Queue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine asks the device not to interrupt for this queue. This is
+    only a hint; the device may still interrupt.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+VIRTIO_API
+BOOL
+VirtioQueueEnableInterrupts (
+    PVIRTIO_QUEUE Queue,
+    USHORT Delay
+    );
+
+/*++
+
+Routine Description:
+
+    This routine asks the device to interrupt when new used buffers arrive.
+    With event index suppression, the interrupt can be delayed until a number
+    of further buffers are used.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue.
+
+    Delay - Supplies the number of additional used buffers past the next one
+        to wait for before interrupting. This is ignored without event index
+        support.
+
+Return Value:
+
+    TRUE if used buffers are already pending, in which case the caller should
+    process the queue again rather than waiting for an interrupt.
+
+    FALSE if no buffers are pending.
+
+--*/
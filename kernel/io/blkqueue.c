@@ -0,0 +1,1577 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    blkqueue.c
+
+Abstract:
+
+    This module implements the block queue, a layer storage drivers can put
+    between themselves and their devices. It holds read and write IRPs,
+    merges contiguous ones into larger requests, and dispatches them with a
+    deadline scheduler: requests go out in offset order in batches, reads are
+    favored over writes, and any request whose deadline passes is serviced
+    next.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/kernel.h>
+#include <minoca/devinfo/block.h>
+#include "iop.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define BLOCK_QUEUE_ALLOCATION_TAG 0x516B6C42 // 'QlkB'
+
+//
+// Define the indices of the two scheduling directions.
+//
+
+#define BLOCK_QUEUE_READ 0
+#define BLOCK_QUEUE_WRITE 1
+#define BLOCK_QUEUE_DIRECTION_COUNT 2
+
+//
+// Define how long requests may wait before they are serviced ahead of the
+// sweep, in milliseconds.
+//
+
+#define BLOCK_QUEUE_READ_DEADLINE_MS 500
+#define BLOCK_QUEUE_WRITE_DEADLINE_MS 5000
+
+//
+// Define the number of requests dispatched in offset order before the
+// scheduler reconsiders direction and deadlines.
+//
+
+#define BLOCK_QUEUE_BATCH_SIZE 16
+
+//
+// Define the number of read batches that may go out while writes wait
+// before a write batch is forced.
+//
+
+#define BLOCK_QUEUE_WRITES_STARVED 2
+
+//
+// Define how long a plug holds the queue before it releases itself, in
+// microseconds.
+//
+
+#define BLOCK_QUEUE_UNPLUG_DELAY 3000
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure defines the queue's private view of a request.
+
+Members:
+
+    Public - Stores the portion of the request visible to the driver.
+
+    Queue - Stores a pointer to the owning queue.
+
+    SortListEntry - Stores pointers to the neighboring requests in offset
+        order, or in the retry list once the request has been picked.
+
+    FifoListEntry - Stores pointers to the neighboring requests in arrival
+        order.
+
+    IrpList - Stores the head of the list of IRPs in the request, in offset
+        order, linked through their list entries.
+
+    IrpCount - Stores the number of IRPs in the request.
+
+    SegmentCount - Stores the total number of I/O buffer fragments the IRPs
+        span.
+
+    ArrivalTime - Stores the time counter value when the first IRP arrived.
+
+    Deadline - Stores the time counter value after which the request is
+        serviced ahead of the sweep.
+
+    MergedIoBuffer - Stores a pointer to the I/O buffer built to describe a
+        merged request, or NULL if the request has a single IRP.
+
+--*/
+
+typedef struct _BLOCK_REQUEST_INTERNAL {
+    BLOCK_REQUEST Public;
+    PBLOCK_QUEUE Queue;
+    LIST_ENTRY SortListEntry;
+    LIST_ENTRY FifoListEntry;
+    LIST_ENTRY IrpList;
+    ULONG IrpCount;
+    ULONG SegmentCount;
+    ULONGLONG ArrivalTime;
+    ULONGLONG Deadline;
+    PIO_BUFFER MergedIoBuffer;
+} BLOCK_REQUEST_INTERNAL, *PBLOCK_REQUEST_INTERNAL;
+
+/*++
+
+Structure Description:
+
+    This structure defines the scheduling state for one direction.
+
+Members:
+
+    SortList - Stores the head of the list of waiting requests sorted by
+        offset.
+
+    FifoList - Stores the head of the list of waiting requests in arrival
+        order.
+
+    Next - Stores a pointer to the next request in offset order after the
+        last one dispatched in this direction, or NULL to start a new sweep.
+
+    Count - Stores the number of waiting requests.
+
+    DeadlineInterval - Stores the amount of time, in time counter ticks, a
+        request may wait before it is serviced ahead of the sweep.
+
+    Statistics - Stores the statistics for this direction.
+
+--*/
+
+typedef struct _BLOCK_QUEUE_DIRECTION {
+    LIST_ENTRY SortList;
+    LIST_ENTRY FifoList;
+    PBLOCK_REQUEST_INTERNAL Next;
+    ULONG Count;
+    ULONGLONG DeadlineInterval;
+    BLOCK_IO_STATISTICS Statistics;
+} BLOCK_QUEUE_DIRECTION, *PBLOCK_QUEUE_DIRECTION;
+
+/*++
+
+Structure Description:
+
+    This structure defines a block queue.
+
+Members:
+
+    Driver - Stores a pointer to the driver that owns the queue.
+
+    Context - Stores the context pointer passed to the start routine.
+
+    StartRequest - Stores a pointer to the routine that hands requests to the
+        device.
+
+    BlockSize - Stores the device block size.
+
+    MaxTransferSize - Stores the largest size requests are merged up to.
+
+    MaxSegments - Stores the largest number of fragments requests are merged
+        up to.
+
+    MaxDepth - Stores the maximum number of requests outstanding at the
+        device.
+
+    Lock - Stores the spin lock protecting the queue.
+
+    Direction - Stores the scheduling state for reads and writes.
+
+    RetryList - Stores the head of the list of requests the device turned
+        away, which go out before anything else.
+
+    Queued - Stores the number of requests waiting, including those on the
+        retry list.
+
+    Depth - Stores the number of requests outstanding at the device.
+
+    BatchDirection - Stores the direction of the current batch.
+
+    BatchCount - Stores the number of requests dispatched in the current
+        batch.
+
+    WritesStarved - Stores the number of read batches started while writes
+        were waiting.
+
+    Stalled - Stores a boolean indicating that the device turned away a
+        request and nothing should be dispatched until the driver runs the
+        queue.
+
+    RunSequence - Stores a counter incremented each time the driver runs the
+        queue, used to detect room freeing up while a start was in progress.
+
+    PlugCount - Stores the number of outstanding plugs.
+
+    PlugExpired - Stores a boolean indicating the current plug has been held
+        too long and is no longer honored.
+
+    UnplugTimerQueued - Stores a boolean indicating whether the unplug timer
+        is queued.
+
+    UnplugTimer - Stores a pointer to the timer that releases long plugs.
+
+    UnplugDpc - Stores a pointer to the DPC queued by the unplug timer.
+
+    UnplugDelay - Stores the plug duration, in time counter ticks.
+
+    PeakDepth - Stores the largest device queue depth seen.
+
+    TotalDepth - Stores the sum of the device queue depth at each dispatch.
+
+    Plugs - Stores the number of times the queue has been plugged.
+
+--*/
+
+struct _BLOCK_QUEUE {
+    PDRIVER Driver;
+    PVOID Context;
+    PBLOCK_QUEUE_START_REQUEST StartRequest;
+    ULONG BlockSize;
+    UINTN MaxTransferSize;
+    ULONG MaxSegments;
+    ULONG MaxDepth;
+    KSPIN_LOCK Lock;
+    BLOCK_QUEUE_DIRECTION Direction[BLOCK_QUEUE_DIRECTION_COUNT];
+    LIST_ENTRY RetryList;
+    ULONG Queued;
+    ULONG Depth;
+    ULONG BatchDirection;
+    ULONG BatchCount;
+    ULONG WritesStarved;
+    BOOL Stalled;
+    ULONG RunSequence;
+    ULONG PlugCount;
+    BOOL PlugExpired;
+    volatile ULONG UnplugTimerQueued;
+    PKTIMER UnplugTimer;
+    PDPC UnplugDpc;
+    ULONGLONG UnplugDelay;
+    ULONG PeakDepth;
+    ULONGLONG TotalDepth;
+    ULONGLONG Plugs;
+};
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+VOID
+IopRunBlockQueue (
+    PBLOCK_QUEUE Queue,
+    BOOL DriverRun
+    );
+
+PBLOCK_REQUEST_INTERNAL
+IopSelectBlockRequest (
+    PBLOCK_QUEUE Queue
+    );
+
+VOID
+IopRemoveBlockRequest (
+    PBLOCK_QUEUE Queue,
+    PBLOCK_QUEUE_DIRECTION Direction,
+    PBLOCK_REQUEST_INTERNAL Request
+    );
+
+BOOL
+IopMergeBlockIrp (
+    PBLOCK_QUEUE Queue,
+    PBLOCK_QUEUE_DIRECTION Direction,
+    PIRP Irp,
+    ULONG SegmentCount
+    );
+
+VOID
+IopInsertSortedBlockRequest (
+    PBLOCK_QUEUE_DIRECTION Direction,
+    PBLOCK_REQUEST_INTERNAL Request
+    );
+
+KSTATUS
+IopBuildBlockRequestIoBuffer (
+    PBLOCK_REQUEST_INTERNAL Request
+    );
+
+ULONG
+IopCountBlockIrpSegments (
+    PIRP Irp
+    );
+
+VOID
+IopBlockQueueUnplugDpc (
+    PDPC Dpc
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+UUID IoBlockQueueStatisticsUuid = BLOCK_QUEUE_STATISTICS_UUID;
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+KERNEL_API
+PBLOCK_QUEUE
+IoCreateBlockQueue (
+    PBLOCK_QUEUE_PARAMETERS Parameters
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a block queue, which sits between a storage driver
+    and the device. It holds read and write IRPs, merges contiguous ones
+    together, and feeds them to the device in an order that favors reads
+    while bounding how long any request waits.
+
+Arguments:
+
+    Parameters - Supplies a pointer to the queue parameters.
+
+Return Value:
+
+    Returns a pointer to the new block queue on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PBLOCK_QUEUE_DIRECTION Direction;
+    ULONGLONG Frequency;
+    ULONG Index;
+    PBLOCK_QUEUE Queue;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    if ((Parameters->Version < BLOCK_QUEUE_PARAMETERS_VERSION) ||
+        (Parameters->StartRequest == NULL) ||
+        (Parameters->BlockSize == 0) ||
+        (Parameters->MaxDepth == 0)) {
+
+        return NULL;
+    }
+
+    Queue = MmAllocateNonPagedPool(sizeof(BLOCK_QUEUE),
+                                   BLOCK_QUEUE_ALLOCATION_TAG);
+
+    if (Queue == NULL) {
+        return NULL;
+    }
+
+    RtlZeroMemory(Queue, sizeof(BLOCK_QUEUE));
+    Queue->Driver = Parameters->Driver;
+    Queue->Context = Parameters->Context;
+    Queue->StartRequest = Parameters->StartRequest;
+    Queue->BlockSize = Parameters->BlockSize;
+    Queue->MaxTransferSize = Parameters->MaxTransferSize;
+    Queue->MaxSegments = Parameters->MaxSegments;
+    Queue->MaxDepth = Parameters->MaxDepth;
+    KeInitializeSpinLock(&(Queue->Lock));
+    INITIALIZE_LIST_HEAD(&(Queue->RetryList));
+    Frequency = HlQueryTimeCounterFrequency();
+    for (Index = 0; Index < BLOCK_QUEUE_DIRECTION_COUNT; Index += 1) {
+        Direction = &(Queue->Direction[Index]);
+        INITIALIZE_LIST_HEAD(&(Direction->SortList));
+        INITIALIZE_LIST_HEAD(&(Direction->FifoList));
+    }
+
+    Queue->Direction[BLOCK_QUEUE_READ].DeadlineInterval =
+                 (Frequency * BLOCK_QUEUE_READ_DEADLINE_MS) /
+                 MILLISECONDS_PER_SECOND;
+
+    Queue->Direction[BLOCK_QUEUE_WRITE].DeadlineInterval =
+                 (Frequency * BLOCK_QUEUE_WRITE_DEADLINE_MS) /
+                 MILLISECONDS_PER_SECOND;
+
+    Queue->UnplugDelay = KeConvertMicrosecondsToTimeTicks(
+                                                    BLOCK_QUEUE_UNPLUG_DELAY);
+
+    Queue->UnplugTimer = KeCreateTimer(BLOCK_QUEUE_ALLOCATION_TAG);
+    Queue->UnplugDpc = KeCreateDpc(IopBlockQueueUnplugDpc, Queue);
+    if ((Queue->UnplugTimer == NULL) || (Queue->UnplugDpc == NULL)) {
+        IoDestroyBlockQueue(Queue);
+        return NULL;
+    }
+
+    return Queue;
+}
+
+KERNEL_API
+VOID
+IoDestroyBlockQueue (
+    PBLOCK_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys a block queue. The queue must be empty, with no
+    requests outstanding at the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the queue to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT((Queue->Queued == 0) && (Queue->Depth == 0));
+
+    if (Queue->UnplugTimer != NULL) {
+        KeCancelTimer(Queue->UnplugTimer);
+    }
+
+    if (Queue->UnplugDpc != NULL) {
+        KeFlushDpc(Queue->UnplugDpc);
+        KeDestroyDpc(Queue->UnplugDpc);
+    }
+
+    if (Queue->UnplugTimer != NULL) {
+        KeDestroyTimer(Queue->UnplugTimer);
+    }
+
+    MmFreeNonPagedPool(Queue);
+    return;
+}
+
+KERNEL_API
+KSTATUS
+IoQueueBlockIrp (
+    PBLOCK_QUEUE Queue,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine submits a read or write IRP to a block queue. The IRP must
+    already be prepared for I/O. It is pended, possibly merged with other
+    queued IRPs, and completed when the device finishes the request carrying
+    it. This routine must be called at or below dispatch level.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    Irp - Supplies a pointer to the read or write IRP.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP was queued.
+
+    STATUS_INSUFFICIENT_RESOURCES if a request could not be allocated. The IRP
+    is not pended in this case.
+
+--*/
+
+{
+
+    PIO_BATCH Batch;
+    PBLOCK_QUEUE_DIRECTION Direction;
+    ULONG Index;
+    BOOL Merged;
+    RUNLEVEL OldRunLevel;
+    PBLOCK_REQUEST_INTERNAL Request;
+    ULONG SegmentCount;
+
+    ASSERT(Irp->MajorCode == IrpMajorIo);
+    ASSERT((Irp->MinorCode == IrpMinorIoRead) ||
+           (Irp->MinorCode == IrpMinorIoWrite));
+
+    ASSERT(Irp->U.ReadWrite.IoBytesCompleted == 0);
+    ASSERT(Irp->U.ReadWrite.IoSizeInBytes != 0);
+
+    //
+    // Allocate a request up front, since it cannot be done with the lock
+    // held. It is freed again if the IRP merges into an existing request.
+    //
+
+    Request = MmAllocateNonPagedPool(sizeof(BLOCK_REQUEST_INTERNAL),
+                                     BLOCK_QUEUE_ALLOCATION_TAG);
+
+    if (Request == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    //
+    // If the submitter is starting a batch of IRPs, plug the queue the first
+    // time the batch reaches it so the rest of the batch can merge and sort
+    // before going out. The batch pulls the plug once it is all submitted.
+    //
+
+    Batch = IopGetIrpBatch(Irp);
+    if (Batch != NULL) {
+        Batch->IrpQueued = TRUE;
+        for (Index = 0; Index < Batch->QueueCount; Index += 1) {
+            if (Batch->Queues[Index] == Queue) {
+                break;
+            }
+        }
+
+        if ((Index == Batch->QueueCount) &&
+            (Batch->QueueCount < IO_BATCH_MAX_QUEUES)) {
+
+            IoPlugBlockQueue(Queue);
+            Batch->Queues[Batch->QueueCount] = Queue;
+            Batch->QueueCount += 1;
+        }
+    }
+
+    SegmentCount = IopCountBlockIrpSegments(Irp);
+    Direction = &(Queue->Direction[BLOCK_QUEUE_READ]);
+    if (Irp->MinorCode == IrpMinorIoWrite) {
+        Direction = &(Queue->Direction[BLOCK_QUEUE_WRITE]);
+    }
+
+    IoPendIrp(Queue->Driver, Irp);
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+    Direction->Statistics.Irps += 1;
+    Merged = IopMergeBlockIrp(Queue, Direction, Irp, SegmentCount);
+    if (Merged == FALSE) {
+        RtlZeroMemory(Request, sizeof(BLOCK_REQUEST_INTERNAL));
+        Request->Public.MinorCode = Irp->MinorCode;
+        Request->Public.IoFlags = Irp->U.ReadWrite.IoFlags;
+        Request->Public.IoOffset = Irp->U.ReadWrite.IoOffset;
+        Request->Public.IoSizeInBytes = Irp->U.ReadWrite.IoSizeInBytes;
+        Request->Public.IoBuffer = Irp->U.ReadWrite.IoBuffer;
+        Request->Queue = Queue;
+        INITIALIZE_LIST_HEAD(&(Request->IrpList));
+        INSERT_BEFORE(&(Irp->ListEntry), &(Request->IrpList));
+        Request->IrpCount = 1;
+        Request->SegmentCount = SegmentCount;
+        Request->ArrivalTime = HlQueryTimeCounter();
+        Request->Deadline = Request->ArrivalTime + Direction->DeadlineInterval;
+        IopInsertSortedBlockRequest(Direction, Request);
+        INSERT_BEFORE(&(Request->FifoListEntry), &(Direction->FifoList));
+        Direction->Count += 1;
+        Queue->Queued += 1;
+        Request = NULL;
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    if (Request != NULL) {
+        MmFreeNonPagedPool(Request);
+    }
+
+    IopRunBlockQueue(Queue, FALSE);
+    KeLowerRunLevel(OldRunLevel);
+    return STATUS_SUCCESS;
+}
+
+KERNEL_API
+VOID
+IoRunBlockQueue (
+    PBLOCK_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine hands queued requests to the device until the queue is empty
+    or the device is full. Drivers call this when room frees up at the device.
+    It must be called at or below dispatch level, and not while holding any
+    lock the start routine acquires.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RUNLEVEL OldRunLevel;
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    IopRunBlockQueue(Queue, TRUE);
+    KeLowerRunLevel(OldRunLevel);
+    return;
+}
+
+KERNEL_API
+VOID
+IoCompleteBlockRequest (
+    PBLOCK_REQUEST Request,
+    KSTATUS Status
+    )
+
+/*++
+
+Routine Description:
+
+    This routine completes a request the device has finished. The bytes
+    completed are split across the request's IRPs in order, and each IRP is
+    completed. This does not start more I/O; call IoRunBlockQueue for that.
+    This routine must be called at or below dispatch level.
+
+Arguments:
+
+    Request - Supplies a pointer to the finished request. It is freed by this
+        routine.
+
+    Status - Supplies the completion status of the request.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN BytesRemaining;
+    PBLOCK_QUEUE_DIRECTION Direction;
+    PIRP Irp;
+    UINTN IrpBytes;
+    KSTATUS IrpStatus;
+    ULONGLONG Latency;
+    RUNLEVEL OldRunLevel;
+    PBLOCK_QUEUE Queue;
+    PBLOCK_REQUEST_INTERNAL RequestInternal;
+
+    RequestInternal = PARENT_STRUCTURE(Request, BLOCK_REQUEST_INTERNAL, Public);
+    Queue = RequestInternal->Queue;
+
+    ASSERT(Request->IoBytesCompleted <= Request->IoSizeInBytes);
+
+    Latency = HlQueryTimeCounter() - RequestInternal->ArrivalTime;
+    Latency = (Latency * MICROSECONDS_PER_SECOND) /
+              HlQueryTimeCounterFrequency();
+
+    //
+    // Hand out the completed bytes in order. IRPs wholly covered by them
+    // succeeded even if the request as a whole ran into an error later on.
+    //
+
+    BytesRemaining = Request->IoBytesCompleted;
+    while (!LIST_EMPTY(&(RequestInternal->IrpList))) {
+        Irp = LIST_VALUE(RequestInternal->IrpList.Next, IRP, ListEntry);
+        LIST_REMOVE(&(Irp->ListEntry));
+        IrpBytes = Irp->U.ReadWrite.IoSizeInBytes;
+        IrpStatus = STATUS_SUCCESS;
+        if (IrpBytes > BytesRemaining) {
+            IrpBytes = BytesRemaining;
+            IrpStatus = Status;
+        }
+
+        BytesRemaining -= IrpBytes;
+        Irp->U.ReadWrite.IoBytesCompleted = IrpBytes;
+        Irp->U.ReadWrite.NewIoOffset = Irp->U.ReadWrite.IoOffset + IrpBytes;
+        IoCompleteIrp(Queue->Driver, Irp, IrpStatus);
+    }
+
+    Direction = &(Queue->Direction[BLOCK_QUEUE_READ]);
+    if (Request->MinorCode == IrpMinorIoWrite) {
+        Direction = &(Queue->Direction[BLOCK_QUEUE_WRITE]);
+    }
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+
+    ASSERT(Queue->Depth != 0);
+
+    Queue->Depth -= 1;
+    Direction->Statistics.Bytes += Request->IoBytesCompleted;
+    if (!KSUCCESS(Status)) {
+        Direction->Statistics.Errors += 1;
+    }
+
+    Direction->Statistics.TotalLatency += Latency;
+    if (Latency > Direction->Statistics.MaxLatency) {
+        Direction->Statistics.MaxLatency = Latency;
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    KeLowerRunLevel(OldRunLevel);
+    if (RequestInternal->MergedIoBuffer != NULL) {
+        MmFreeIoBuffer(RequestInternal->MergedIoBuffer);
+    }
+
+    MmFreeNonPagedPool(RequestInternal);
+    return;
+}
+
+KERNEL_API
+VOID
+IoPlugBlockQueue (
+    PBLOCK_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine plugs a block queue, holding back new requests so that a
+    batch of IRPs about to be submitted can be merged and sorted before any
+    reach the device. Plugs nest. The queue releases a plug on its own after
+    a short delay, so a forgotten or long plug only costs latency.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RUNLEVEL OldRunLevel;
+    BOOL QueueTimer;
+    KSTATUS Status;
+
+    QueueTimer = FALSE;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+    if (Queue->PlugCount == 0) {
+        Queue->PlugExpired = FALSE;
+        Queue->Plugs += 1;
+        QueueTimer = TRUE;
+    }
+
+    Queue->PlugCount += 1;
+    KeReleaseSpinLock(&(Queue->Lock));
+
+    //
+    // Only one plug timer is ever queued. A timer left over from an earlier
+    // plug may release this one early, which is harmless.
+    //
+
+    if ((QueueTimer != FALSE) &&
+        (RtlAtomicCompareExchange32(&(Queue->UnplugTimerQueued), 1, 0) == 0)) {
+
+        Status = KeQueueTimer(Queue->UnplugTimer,
+                              TimerQueueSoftWake,
+                              HlQueryTimeCounter() + Queue->UnplugDelay,
+                              0,
+                              0,
+                              Queue->UnplugDpc);
+
+        if (!KSUCCESS(Status)) {
+            RtlAtomicExchange32(&(Queue->UnplugTimerQueued), 0);
+            KeAcquireSpinLock(&(Queue->Lock));
+            Queue->PlugExpired = TRUE;
+            KeReleaseSpinLock(&(Queue->Lock));
+        }
+    }
+
+    KeLowerRunLevel(OldRunLevel);
+    return;
+}
+
+KERNEL_API
+VOID
+IoUnplugBlockQueue (
+    PBLOCK_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine releases a plug on a block queue. Releasing the last plug
+    sends the held requests to the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RUNLEVEL OldRunLevel;
+    BOOL Run;
+
+    Run = FALSE;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&(Queue->Lock));
+
+    ASSERT(Queue->PlugCount != 0);
+
+    Queue->PlugCount -= 1;
+    if (Queue->PlugCount == 0) {
+        Run = TRUE;
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    if (Run != FALSE) {
+        IopRunBlockQueue(Queue, FALSE);
+    }
+
+    KeLowerRunLevel(OldRunLevel);
+    return;
+}
+
+KERNEL_API
+VOID
+IoHandleBlockQueueDeviceInformation (
+    PBLOCK_QUEUE Queue,
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles a device information request for the block queue
+    statistics. Requests for other information types are left alone. Drivers
+    call this from their device information handler, and should register the
+    BLOCK_QUEUE_STATISTICS_UUID information type on the device.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    Irp - Supplies a pointer to the device information system control IRP.
+
+Return Value:
+
+    None. If the request is for the block queue statistics, the IRP is
+    completed.
+
+--*/
+
+{
+
+    PSYSTEM_CONTROL_DEVICE_INFORMATION Request;
+    BLOCK_QUEUE_STATISTICS Statistics;
+    KSTATUS Status;
+
+    ASSERT((Irp->MajorCode == IrpMajorSystemControl) &&
+           (Irp->MinorCode == IrpMinorSystemControlDeviceInformation));
+
+    Request = Irp->U.SystemControl.SystemContext;
+    if (RtlAreUuidsEqual(&(Request->Uuid), &IoBlockQueueStatisticsUuid) ==
+        FALSE) {
+
+        return;
+    }
+
+    if (Request->Set != FALSE) {
+        Status = STATUS_ACCESS_DENIED;
+        goto HandleBlockQueueDeviceInformationEnd;
+    }
+
+    if (Request->DataSize < sizeof(BLOCK_QUEUE_STATISTICS)) {
+        Request->DataSize = sizeof(BLOCK_QUEUE_STATISTICS);
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto HandleBlockQueueDeviceInformationEnd;
+    }
+
+    //
+    // Take a snapshot with the lock held, and copy it out afterwards, since
+    // the request data may be paged.
+    //
+
+    RtlZeroMemory(&Statistics, sizeof(BLOCK_QUEUE_STATISTICS));
+    Statistics.Version = BLOCK_QUEUE_STATISTICS_VERSION;
+    Statistics.MaxDepth = Queue->MaxDepth;
+    KeAcquireSpinLock(&(Queue->Lock));
+    Statistics.Depth = Queue->Depth;
+    Statistics.PeakDepth = Queue->PeakDepth;
+    Statistics.Queued = Queue->Queued;
+    Statistics.TotalDepth = Queue->TotalDepth;
+    Statistics.Plugs = Queue->Plugs;
+    RtlCopyMemory(&(Statistics.Read),
+                  &(Queue->Direction[BLOCK_QUEUE_READ].Statistics),
+                  sizeof(BLOCK_IO_STATISTICS));
+
+    RtlCopyMemory(&(Statistics.Write),
+                  &(Queue->Direction[BLOCK_QUEUE_WRITE].Statistics),
+                  sizeof(BLOCK_IO_STATISTICS));
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    RtlCopyMemory(Request->Data, &Statistics, sizeof(BLOCK_QUEUE_STATISTICS));
+    Request->DataSize = sizeof(BLOCK_QUEUE_STATISTICS);
+    Status = STATUS_SUCCESS;
+
+HandleBlockQueueDeviceInformationEnd:
+    IoCompleteIrp(Queue->Driver, Irp, Status);
+    return;
+}
+
+VOID
+IopInitializeIoBatch (
+    PIO_BATCH Batch
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes an I/O batch for the current thread.
+
+Arguments:
+
+    Batch - Supplies a pointer to the batch to initialize.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlZeroMemory(Batch, sizeof(IO_BATCH));
+    Batch->Thread = KeGetCurrentThread();
+    return;
+}
+
+VOID
+IopUnplugIoBatch (
+    PIO_BATCH Batch
+    )
+
+/*++
+
+Routine Description:
+
+    This routine releases the plugs a batch placed on block queues, sending
+    the IRPs submitted in the batch to their devices. This must be called
+    before waiting on any IRP in the batch.
+
+Arguments:
+
+    Batch - Supplies a pointer to the batch.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+
+    for (Index = 0; Index < Batch->QueueCount; Index += 1) {
+        IoUnplugBlockQueue(Batch->Queues[Index]);
+        Batch->Queues[Index] = NULL;
+    }
+
+    Batch->QueueCount = 0;
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+IopRunBlockQueue (
+    PBLOCK_QUEUE Queue,
+    BOOL DriverRun
+    )
+
+/*++
+
+Routine Description:
+
+    This routine hands queued requests to the device until the queue is
+    empty, the device is full, or the queue is plugged. This routine must be
+    called at dispatch level.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    DriverRun - Supplies a boolean indicating whether the driver asked for
+        the run because room freed up at the device, which clears a stall.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PBLOCK_REQUEST_INTERNAL Request;
+    ULONG RunSequence;
+    KSTATUS Status;
+
+    ASSERT(KeGetRunLevel() == RunLevelDispatch);
+
+    KeAcquireSpinLock(&(Queue->Lock));
+    if (DriverRun != FALSE) {
+        Queue->RunSequence += 1;
+        Queue->Stalled = FALSE;
+    }
+
+    while ((Queue->Depth < Queue->MaxDepth) && (Queue->Stalled == FALSE)) {
+
+        //
+        // Honor a plug unless it has gone stale or enough has piled up to
+        // fill the device anyway.
+        //
+
+        if ((Queue->PlugCount != 0) &&
+            (Queue->PlugExpired == FALSE) &&
+            (Queue->Queued < Queue->MaxDepth)) {
+
+            break;
+        }
+
+        if (!LIST_EMPTY(&(Queue->RetryList))) {
+            Request = LIST_VALUE(Queue->RetryList.Next,
+                                 BLOCK_REQUEST_INTERNAL,
+                                 SortListEntry);
+
+            LIST_REMOVE(&(Request->SortListEntry));
+            Queue->Queued -= 1;
+
+        } else {
+            Request = IopSelectBlockRequest(Queue);
+            if (Request == NULL) {
+                break;
+            }
+        }
+
+        Queue->Depth += 1;
+        Queue->TotalDepth += Queue->Depth;
+        if (Queue->Depth > Queue->PeakDepth) {
+            Queue->PeakDepth = Queue->Depth;
+        }
+
+        RunSequence = Queue->RunSequence;
+        KeReleaseSpinLock(&(Queue->Lock));
+        Status = STATUS_SUCCESS;
+        if ((Request->IrpCount > 1) && (Request->MergedIoBuffer == NULL)) {
+            Status = IopBuildBlockRequestIoBuffer(Request);
+        }
+
+        if (KSUCCESS(Status)) {
+            Status = Queue->StartRequest(Queue->Context, &(Request->Public));
+        }
+
+        if (KSUCCESS(Status)) {
+            KeAcquireSpinLock(&(Queue->Lock));
+            continue;
+        }
+
+        //
+        // If the device is full, put the request back at the front of the
+        // line. Stall until the driver says room has freed up, unless it
+        // already did while the start was in progress.
+        //
+
+        if (Status == STATUS_RESOURCE_IN_USE) {
+            KeAcquireSpinLock(&(Queue->Lock));
+            Queue->Depth -= 1;
+            INSERT_AFTER(&(Request->SortListEntry), &(Queue->RetryList));
+            Queue->Queued += 1;
+            if (Queue->RunSequence == RunSequence) {
+                Queue->Stalled = TRUE;
+            }
+
+            continue;
+        }
+
+        IoCompleteBlockRequest(&(Request->Public), Status);
+        KeAcquireSpinLock(&(Queue->Lock));
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    return;
+}
+
+PBLOCK_REQUEST_INTERNAL
+IopSelectBlockRequest (
+    PBLOCK_QUEUE Queue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine picks the next request to send to the device and removes it
+    from the scheduling lists. The queue lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+Return Value:
+
+    Returns a pointer to the next request, or NULL if nothing is waiting.
+
+--*/
+
+{
+
+    PBLOCK_QUEUE_DIRECTION Direction;
+    ULONG DirectionIndex;
+    PBLOCK_REQUEST_INTERNAL Request;
+    PBLOCK_QUEUE_DIRECTION Reads;
+    PBLOCK_QUEUE_DIRECTION Writes;
+
+    //
+    // Continue the current batch in offset order if there is more of it.
+    //
+
+    Direction = &(Queue->Direction[Queue->BatchDirection]);
+    if ((Queue->BatchCount < BLOCK_QUEUE_BATCH_SIZE) &&
+        (Direction->Next != NULL)) {
+
+        Request = Direction->Next;
+        goto SelectBlockRequestEnd;
+    }
+
+    //
+    // Start a new batch. Reads go first, unless writes have been passed over
+    // too many times already.
+    //
+
+    Reads = &(Queue->Direction[BLOCK_QUEUE_READ]);
+    Writes = &(Queue->Direction[BLOCK_QUEUE_WRITE]);
+    if ((Reads->Count != 0) &&
+        ((Writes->Count == 0) ||
+         (Queue->WritesStarved < BLOCK_QUEUE_WRITES_STARVED))) {
+
+        DirectionIndex = BLOCK_QUEUE_READ;
+        if (Writes->Count != 0) {
+            Queue->WritesStarved += 1;
+        }
+
+    } else if (Writes->Count != 0) {
+        DirectionIndex = BLOCK_QUEUE_WRITE;
+        Queue->WritesStarved = 0;
+
+    } else {
+        return NULL;
+    }
+
+    Direction = &(Queue->Direction[DirectionIndex]);
+    Queue->BatchDirection = DirectionIndex;
+    Queue->BatchCount = 0;
+
+    //
+    // Jump to the oldest request if its deadline has passed or there is no
+    // sweep in progress. Otherwise keep sweeping up through the offsets.
+    //
+
+    ASSERT(!LIST_EMPTY(&(Direction->FifoList)));
+
+    Request = LIST_VALUE(Direction->FifoList.Next,
+                         BLOCK_REQUEST_INTERNAL,
+                         FifoListEntry);
+
+    if (HlQueryTimeCounter() >= Request->Deadline) {
+        Direction->Statistics.DeadlineExpirations += 1;
+
+    } else if (Direction->Next != NULL) {
+        Request = Direction->Next;
+    }
+
+SelectBlockRequestEnd:
+    IopRemoveBlockRequest(Queue, Direction, Request);
+    Queue->BatchCount += 1;
+    Direction->Statistics.Requests += 1;
+    return Request;
+}
+
+VOID
+IopRemoveBlockRequest (
+    PBLOCK_QUEUE Queue,
+    PBLOCK_QUEUE_DIRECTION Direction,
+    PBLOCK_REQUEST_INTERNAL Request
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes a request from the scheduling lists, remembering its
+    successor in offset order as the next request in the sweep. The queue
+    lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    Direction - Supplies a pointer to the request's direction.
+
+    Request - Supplies a pointer to the request to remove.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    Direction->Next = NULL;
+    if (Request->SortListEntry.Next != &(Direction->SortList)) {
+        Direction->Next = LIST_VALUE(Request->SortListEntry.Next,
+                                     BLOCK_REQUEST_INTERNAL,
+                                     SortListEntry);
+    }
+
+    LIST_REMOVE(&(Request->SortListEntry));
+    LIST_REMOVE(&(Request->FifoListEntry));
+
+    ASSERT((Direction->Count != 0) && (Queue->Queued != 0));
+
+    Direction->Count -= 1;
+    Queue->Queued -= 1;
+    return;
+}
+
+BOOL
+IopMergeBlockIrp (
+    PBLOCK_QUEUE Queue,
+    PBLOCK_QUEUE_DIRECTION Direction,
+    PIRP Irp,
+    ULONG SegmentCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to merge an IRP onto the end or the front of a
+    waiting request it touches. The queue lock must be held.
+
+Arguments:
+
+    Queue - Supplies a pointer to the block queue.
+
+    Direction - Supplies a pointer to the scheduling direction of the IRP.
+
+    Irp - Supplies a pointer to the IRP to merge.
+
+    SegmentCount - Supplies the number of I/O buffer fragments the IRP spans.
+
+Return Value:
+
+    TRUE if the IRP was merged into a request.
+
+    FALSE if no suitable request was found.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    ULONGLONG IrpEnd;
+    ULONGLONG IrpOffset;
+    UINTN IrpSize;
+    PBLOCK_REQUEST_INTERNAL Request;
+    ULONGLONG RequestEnd;
+
+    IrpOffset = Irp->U.ReadWrite.IoOffset;
+    IrpSize = Irp->U.ReadWrite.IoSizeInBytes;
+    IrpEnd = IrpOffset + IrpSize;
+    CurrentEntry = Direction->SortList.Next;
+    while (CurrentEntry != &(Direction->SortList)) {
+        Request = LIST_VALUE(CurrentEntry,
+                             BLOCK_REQUEST_INTERNAL,
+                             SortListEntry);
+
+        CurrentEntry = CurrentEntry->Next;
+
+        //
+        // The list is sorted, so once requests start beyond the IRP nothing
+        // further can touch it.
+        //
+
+        if (Request->Public.IoOffset > IrpEnd) {
+            break;
+        }
+
+        RequestEnd = Request->Public.IoOffset + Request->Public.IoSizeInBytes;
+        if ((RequestEnd != IrpOffset) &&
+            (Request->Public.IoOffset != IrpEnd)) {
+
+            continue;
+        }
+
+        if ((Request->Public.IoSizeInBytes + IrpSize >
+             Queue->MaxTransferSize) ||
+            (Request->SegmentCount + SegmentCount > Queue->MaxSegments)) {
+
+            continue;
+        }
+
+        if (RequestEnd == IrpOffset) {
+            INSERT_BEFORE(&(Irp->ListEntry), &(Request->IrpList));
+            Direction->Statistics.BackMerges += 1;
+
+        } else {
+            INSERT_AFTER(&(Irp->ListEntry), &(Request->IrpList));
+            Request->Public.IoOffset = IrpOffset;
+            Direction->Statistics.FrontMerges += 1;
+
+            //
+            // The request starts earlier now, so it may need to move back in
+            // the sorted list.
+            //
+
+            LIST_REMOVE(&(Request->SortListEntry));
+            IopInsertSortedBlockRequest(Direction, Request);
+        }
+
+        Request->Public.IoSizeInBytes += IrpSize;
+        Request->Public.IoFlags |= Irp->U.ReadWrite.IoFlags;
+        Request->IrpCount += 1;
+        Request->SegmentCount += SegmentCount;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+VOID
+IopInsertSortedBlockRequest (
+    PBLOCK_QUEUE_DIRECTION Direction,
+    PBLOCK_REQUEST_INTERNAL Request
+    )
+
+/*++
+
+Routine Description:
+
+    This routine inserts a request into its direction's sorted list. The
+    search starts from the end, as requests most often arrive in ascending
+    order. The queue lock must be held.
+
+Arguments:
+
+    Direction - Supplies a pointer to the scheduling direction.
+
+    Request - Supplies a pointer to the request to insert.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PBLOCK_REQUEST_INTERNAL Previous;
+
+    CurrentEntry = Direction->SortList.Previous;
+    while (CurrentEntry != &(Direction->SortList)) {
+        Previous = LIST_VALUE(CurrentEntry,
+                              BLOCK_REQUEST_INTERNAL,
+                              SortListEntry);
+
+        if (Previous->Public.IoOffset <= Request->Public.IoOffset) {
+            break;
+        }
+
+        CurrentEntry = CurrentEntry->Previous;
+    }
+
+    INSERT_AFTER(&(Request->SortListEntry), CurrentEntry);
+    return;
+}
+
+KSTATUS
+IopBuildBlockRequestIoBuffer (
+    PBLOCK_REQUEST_INTERNAL Request
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds the I/O buffer describing a merged request out of the
+    fragments of each IRP's buffer.
+
+Arguments:
+
+    Request - Supplies a pointer to the merged request.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    PIRP Irp;
+    PIO_BUFFER IoBuffer;
+    KSTATUS Status;
+
+    //
+    // The uninitialized buffer gets a fragment for each page of the size
+    // given, so ask for enough pages to cover every fragment.
+    //
+
+    IoBuffer = MmAllocateUninitializedIoBuffer(
+                                Request->SegmentCount << MmPageShift(),
+                                0);
+
+    if (IoBuffer == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    CurrentEntry = Request->IrpList.Next;
+    while (CurrentEntry != &(Request->IrpList)) {
+        Irp = LIST_VALUE(CurrentEntry, IRP, ListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        Status = MmAppendIoBuffer(IoBuffer,
+                                  Irp->U.ReadWrite.IoBuffer,
+                                  0,
+                                  Irp->U.ReadWrite.IoSizeInBytes);
+
+        if (!KSUCCESS(Status)) {
+            MmFreeIoBuffer(IoBuffer);
+            return Status;
+        }
+    }
+
+    ASSERT(MmGetIoBufferSize(IoBuffer) == Request->Public.IoSizeInBytes);
+
+    Request->MergedIoBuffer = IoBuffer;
+    Request->Public.IoBuffer = IoBuffer;
+    return STATUS_SUCCESS;
+}
+
+ULONG
+IopCountBlockIrpSegments (
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine counts the I/O buffer fragments an IRP's transfer spans.
+
+Arguments:
+
+    Irp - Supplies a pointer to the read or write IRP.
+
+Return Value:
+
+    Returns the number of fragments.
+
+--*/
+
+{
+
+    UINTN BytesRemaining;
+    UINTN FragmentIndex;
+    UINTN FragmentSize;
+    PIO_BUFFER IoBuffer;
+    UINTN Offset;
+    ULONG SegmentCount;
+
+    IoBuffer = Irp->U.ReadWrite.IoBuffer;
+    Offset = MmGetIoBufferCurrentOffset(IoBuffer);
+    BytesRemaining = Irp->U.ReadWrite.IoSizeInBytes;
+    SegmentCount = 0;
+    for (FragmentIndex = 0;
+         (FragmentIndex < IoBuffer->FragmentCount) && (BytesRemaining != 0);
+         FragmentIndex += 1) {
+
+        FragmentSize = IoBuffer->Fragment[FragmentIndex].Size;
+        if (Offset >= FragmentSize) {
+            Offset -= FragmentSize;
+            continue;
+        }
+
+        FragmentSize -= Offset;
+        Offset = 0;
+        if (FragmentSize > BytesRemaining) {
+            FragmentSize = BytesRemaining;
+        }
+
+        BytesRemaining -= FragmentSize;
+        SegmentCount += 1;
+    }
+
+    return SegmentCount;
+}
+
+VOID
+IopBlockQueueUnplugDpc (
+    PDPC Dpc
+    )
+
+/*++
+
+Routine Description:
+
+    This routine is called at dispatch level when a plug has been held too
+    long. It stops honoring the plug and gets the held requests moving.
+
+Arguments:
+
+    Dpc - Supplies a pointer to the DPC that is running.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PBLOCK_QUEUE Queue;
+
+    Queue = Dpc->UserData;
+    RtlAtomicExchange32(&(Queue->UnplugTimerQueued), 0);
+    KeAcquireSpinLock(&(Queue->Lock));
+    if (Queue->PlugCount != 0) {
+        Queue->PlugExpired = TRUE;
+    }
+
+    KeReleaseSpinLock(&(Queue->Lock));
+    IopRunBlockQueue(Queue, FALSE);
+    return;
+}
@@ -39,6 +39,7 @@ function build() {
 
     baseSources = [
         "arb.c",
+        "blkqueue.c",
         "cachedio.c",
         "cstate.c",
         "device.c",
@@ -1568,6 +1568,7 @@ Return Value:
     UINTN CopySize;
     ULONGLONG FileSize;
     ULONG PageSize;
+    UINTN ReadAheadSize;
     PIO_BUFFER ReadIoBuffer;
     IO_CONTEXT ReadIoContext;
     KSTATUS Status;
@@ -1603,21 +1604,35 @@ Return Value:
 
     //
     // If this is a miss for a device, read ahead some amount in anticipation
-    // of accessing the next pages of the device in the near future. Don't read
-    // ahead if system memory is low.
+    // of accessing the next pages of the device in the near future. Files
+    // that were advised to be sequential read ahead further, and those
+    // advised to be random don't read ahead at all. Don't read ahead if system
+    // memory is low.
     //
 
-    if (FileObject->Properties.Type == IoObjectBlockDevice) {
+    ReadAheadSize = 0;
+    if ((FileObject->Flags & FILE_OBJECT_FLAG_RANDOM_ACCESS) == 0) {
+        if ((FileObject->Flags & FILE_OBJECT_FLAG_SEQUENTIAL_ACCESS) != 0) {
+            ReadAheadSize = IO_SEQUENTIAL_READ_AHEAD_SIZE;
+
+        } else if (FileObject->Properties.Type == IoObjectBlockDevice) {
+            ReadAheadSize = IO_READ_AHEAD_SIZE;
+        }
+    }
+
+    if (ReadAheadSize != 0) {
         FileSize = FileObject->Properties.Size;
-        if (MmGetPhysicalMemoryWarningLevel() == MemoryWarningLevelNone) {
-            BlockAlignedSize = ALIGN_RANGE_UP(BlockAlignedSize,
-                                              IO_READ_AHEAD_SIZE);
+        if ((MmGetPhysicalMemoryWarningLevel() == MemoryWarningLevelNone) &&
+            (BlockAlignedOffset < FileSize)) {
+
+            BlockAlignedSize = ALIGN_RANGE_UP(BlockAlignedSize, ReadAheadSize);
 
-            ASSERT(IS_ALIGNED(IO_READ_AHEAD_SIZE, PageSize));
+            ASSERT(IS_ALIGNED(ReadAheadSize, PageSize));
         }
 
-        if (((BlockAlignedOffset + BlockAlignedSize) < BlockAlignedOffset) ||
-            ((BlockAlignedOffset + BlockAlignedSize) > FileSize)) {
+        if ((BlockAlignedOffset < FileSize) &&
+            (((BlockAlignedOffset + BlockAlignedSize) < BlockAlignedOffset) ||
+             ((BlockAlignedOffset + BlockAlignedSize) > FileSize))) {
 
             BlockAlignedSize = FileSize - BlockAlignedOffset;
             BlockAlignedSize = ALIGN_RANGE_UP(BlockAlignedSize, PageSize);
@@ -2329,10 +2329,7 @@ Return Value:
                                        SourceFileObject);
 
             if (NewPathEntry != NULL) {
-                INSERT_BEFORE(
-                        &(NewPathEntry->SiblingListEntry),
-                        &(DestinationDirectoryPathPoint.PathEntry->ChildList));
-
+                IopPathLink(NewPathEntry);
                 IopFileObjectAddReference(SourceFileObject);
             }
         }
@@ -130,6 +130,12 @@ Module Name:
 
 #define IRP_ACTIVE 0x00000004
 
+//
+// Define the number of block queues an I/O batch can keep plugged at once.
+//
+
+#define IO_BATCH_MAX_QUEUES 4
+
 //
 // This flag is used during processing Query Children to mark pre-existing
 // devices and notice missing ones.
@@ -228,6 +234,18 @@ Module Name:
 
 #define FILE_OBJECT_FLAG_NON_PAGED_IO_STATE 0x00000100
 
+//
+// These flags are set when user mode has advised that the file object will be
+// read sequentially or randomly. They govern how much is read ahead on a page
+// cache miss.
+//
+
+#define FILE_OBJECT_FLAG_SEQUENTIAL_ACCESS 0x00000200
+#define FILE_OBJECT_FLAG_RANDOM_ACCESS 0x00000400
+
+#define FILE_OBJECT_FLAG_ACCESS_PATTERN_MASK \
+    (FILE_OBJECT_FLAG_SEQUENTIAL_ACCESS | FILE_OBJECT_FLAG_RANDOM_ACCESS)
+
 //
 // The resource allocation work is currently assigned to the system work queue.
 //
@@ -240,6 +258,12 @@ Module Name:
 
 #define IO_READ_AHEAD_SIZE _128KB
 
+//
+// Define the size of read-aheads for file objects being read sequentially.
+//
+
+#define IO_SEQUENTIAL_READ_AHEAD_SIZE _512KB
+
 //
 // This flag is set to indicate that the eviction operation is executing as a
 // result of a truncate. All image sections should be unmapped and all page
@@ -447,6 +471,10 @@ Structure Description:
     CacheListEntry - Stores pointers to the next and previous entries in the
         LRU list of the path entry cache.
 
+    HashListEntry - Stores pointers to the next and previous entries in the
+        path entry hash bucket. An entry is in the hash table exactly when it
+        is on its parent's child list.
+
     ReferenceCount - Stores the reference count of the entry.
 
     MountCount - Stores the number of mount points mounted on this path entry.
@@ -482,6 +510,7 @@ Structure Description:
 struct _PATH_ENTRY {
     LIST_ENTRY SiblingListEntry;
     LIST_ENTRY CacheListEntry;
+    LIST_ENTRY HashListEntry;
     volatile ULONG ReferenceCount;
     volatile ULONG MountCount;
     BOOL Negative;
@@ -687,6 +716,35 @@ typedef struct _IO_CONTEXT {
 
 /*++
 
+Structure Description:
+
+    This structure defines a batch of I/O IRPs that are started without
+    waiting for each one in turn. Block queues the IRPs land in are plugged
+    until the batch is unplugged, so the whole batch can be merged and sorted
+    before any of it reaches the device.
+
+Members:
+
+    Thread - Stores a pointer to the thread submitting the batch.
+
+    IrpQueued - Stores a boolean indicating whether the IRP most recently
+        started in the batch was put in a block queue.
+
+    QueueCount - Stores the number of block queues plugged for the batch.
+
+    Queues - Stores the block queues plugged for the batch.
+
+--*/
+
+typedef struct _IO_BATCH {
+    PKTHREAD Thread;
+    BOOL IrpQueued;
+    ULONG QueueCount;
+    PBLOCK_QUEUE Queues[IO_BATCH_MAX_QUEUES];
+} IO_BATCH, *PIO_BATCH;
+
+/*++
+
 Structure Description:
 
     This structure defines an entry in the device database, which associates
@@ -3210,6 +3268,41 @@ Return Value:
 
 --*/
 
+KSTATUS
+IopGetSetPipeSize (
+    PIO_HANDLE Handle,
+    BOOL Set,
+    PULONG Size
+    );
+
+/*++
+
+Routine Description:
+
+    This routine gets or sets the capacity of a pipe's buffer.
+
+Arguments:
+
+    Handle - Supplies a pointer to the pipe I/O handle.
+
+    Set - Supplies a boolean indicating whether to resize the pipe (TRUE) or
+        just query its size (FALSE).
+
+    Size - Supplies a pointer that on input contains the requested size for
+        set operations. On output, contains the actual size of the pipe.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_HANDLE if the handle is not a pipe.
+
+    STATUS_INVALID_PARAMETER if the requested size is too large.
+
+    STATUS_RESOURCE_IN_USE if the pipe holds more data than the new size.
+
+--*/
+
 KSTATUS
 IopInitializeTerminalSupport (
     VOID
@@ -4063,6 +4156,30 @@ Return Value:
 
 --*/
 
+VOID
+IopPathLink (
+    PPATH_ENTRY Entry
+    );
+
+/*++
+
+Routine Description:
+
+    This routine links the given path entry into the path hierarchy, making it
+    visible to lookups in its parent. The caller must hold the parent path
+    entry's file object lock exclusively.
+
+Arguments:
+
+    Entry - Supplies a pointer to the path entry to link. It must have a
+        parent and must not already be linked.
+
+Return Value:
+
+    None.
+
+--*/
+
 VOID
 IopPathUnlink (
     PPATH_ENTRY Entry
@@ -4553,6 +4670,94 @@ Return Value:
 
 --*/
 
+KSTATUS
+IopStartIoIrp (
+    PDEVICE Device,
+    IRP_MINOR_CODE MinorCodeNumber,
+    PIRP_READ_WRITE Request,
+    PIO_BATCH Batch,
+    PIRP *Irp
+    );
+
+/*++
+
+Routine Description:
+
+    This routine creates an I/O IRP and starts it down the device stack
+    without waiting for it to finish. IopFinishIoIrp must be called on the
+    returned IRP to wait for it and collect the results.
+
+Arguments:
+
+    Device - Supplies a pointer to the device to send the IRP to.
+
+    MinorCodeNumber - Supplies the minor code number to send to the IRP.
+
+    Request - Supplies a pointer to the I/O request parameters.
+
+    Batch - Supplies an optional pointer to the batch the IRP belongs to. An
+        IRP that pends anywhere other than a block queue is waited on before
+        this routine returns, as the driver holding it may not be able to
+        take another until it finishes.
+
+    Irp - Supplies a pointer where the started IRP will be returned on
+        success.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+KSTATUS
+IopFinishIoIrp (
+    PIRP Irp,
+    PIRP_READ_WRITE Request
+    );
+
+/*++
+
+Routine Description:
+
+    This routine waits for an I/O IRP started with IopStartIoIrp to finish,
+    copies the results back to the request, and destroys the IRP.
+
+Arguments:
+
+    Irp - Supplies a pointer to the started IRP.
+
+    Request - Supplies a pointer where the completed request parameters will
+        be returned.
+
+Return Value:
+
+    Returns the completion status of the IRP.
+
+--*/
+
+PIO_BATCH
+IopGetIrpBatch (
+    PIRP Irp
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the batch an IRP is being started in, if the calling
+    thread is the one starting it.
+
+Arguments:
+
+    Irp - Supplies a pointer to the IRP.
+
+Return Value:
+
+    Returns a pointer to the batch, or NULL if the IRP is not being started
+    as part of a batch.
+
+--*/
+
 KSTATUS
 IopSendSystemControlIrp (
     PDEVICE Device,
@@ -4861,3 +5066,47 @@ Return Value:
 
 --*/
 
+VOID
+IopInitializeIoBatch (
+    PIO_BATCH Batch
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes an I/O batch for the current thread.
+
+Arguments:
+
+    Batch - Supplies a pointer to the batch to initialize.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+IopUnplugIoBatch (
+    PIO_BATCH Batch
+    );
+
+/*++
+
+Routine Description:
+
+    This routine releases the block queue plugs taken for an I/O batch,
+    sending the batch's requests to their devices. This must be called before
+    waiting on any IRP in the batch.
+
+Arguments:
+
+    Batch - Supplies a pointer to the batch.
+
+Return Value:
+
+    None.
+
+--*/
+
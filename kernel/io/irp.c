@@ -98,6 +98,9 @@ Structure Description:
     Flags - Stores a set of informational flags about the IRP. See IRP_*
         definitions.
 
+    Batch - Stores a pointer to the I/O batch the IRP is being started in,
+        while the submitting thread pumps it down the stack.
+
 --*/
 
 typedef struct _IRP_INTERNAL {
@@ -109,12 +112,24 @@ typedef struct _IRP_INTERNAL {
     ULONG StackIndex;
     ULONG StackSize;
     ULONG Flags;
+    PIO_BATCH Batch;
 } IRP_INTERNAL, *PIRP_INTERNAL;
 
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
 
+KSTATUS
+IopStartIrp (
+    PIRP_INTERNAL Irp,
+    PIO_BATCH Batch
+    );
+
+KSTATUS
+IopFinishIrp (
+    PIRP_INTERNAL Irp
+    );
+
 BOOL
 IopPumpIrpThroughStack (
     PIRP_INTERNAL Irp
@@ -484,6 +499,7 @@ Return Value:
     Irp->Public.Device = Device;
     Irp->Public.MajorCode = MajorCode;
     Irp->Flags = 0;
+    Irp->Batch = NULL;
     Irp->Stack = NULL;
     Irp->StackIndex = 0;
 
@@ -773,85 +789,23 @@ Return Value:
 {
 
     PIRP_INTERNAL InternalIrp;
-    BOOL IrpDone;
     KSTATUS Status;
 
     InternalIrp = (PIRP_INTERNAL)Irp;
 
     ASSERT(KeGetRunLevel() <= RunLevelDispatch);
 
-    //
-    // Crash if the IRP was improperly allocated or modified.
-    //
-
-    if (InternalIrp->Magic != IRP_MAGIC_VALUE) {
-        KeCrashSystem(CRASH_INVALID_IRP,
-                      IrpCrashImproperlyAllocated,
-                      (UINTN)Irp,
-                      (UINTN)Irp->Device,
-                      0);
-    }
-
-    if ((InternalIrp->Device != Irp->Device) ||
-        (InternalIrp->MajorCode != Irp->MajorCode)) {
-
-        KeCrashSystem(CRASH_INVALID_IRP,
-                      IrpCrashConstantStateModified,
-                      (UINTN)Irp,
-                      (UINTN)Irp->Device,
-                      0);
-    }
-
-    //
-    // Fail if the IRP is not properly initialized.
-    //
-
-    if ((Irp == NULL) ||
-        (Irp->MinorCode == IrpMinorInvalid) ||
-        (Irp->Direction != IrpDown) ||
-        (Irp->CompletionRoutine != NULL)) {
-
-        Status = STATUS_INVALID_PARAMETER;
-        goto SendSynchronousIrpEnd;
-    }
-
-    ASSERT((InternalIrp->Flags &
-            (IRP_COMPLETE | IRP_ACTIVE | IRP_PENDING)) == 0);
-
     //
     // Pump the IRP through its driver stack. If it returns and is not done,
-    // then it was pended. Wait for the IRP to be signaled and then continue
-    // pumping it through the stack until it is done.
+    // then it was pended. Wait for it to finish.
     //
 
-    Status = STATUS_SUCCESS;
-    InternalIrp->Flags |= IRP_ACTIVE;
-    while (TRUE) {
-        ObSignalObject(Irp, SignalOptionUnsignal);
-        IrpDone = IopPumpIrpThroughStack(InternalIrp);
-        if (IrpDone != FALSE) {
-            break;
-        }
-
-        ASSERT((InternalIrp->Flags & IRP_PENDING) != 0);
-
-        Status = ObWaitOnObject(Irp, 0, WAIT_TIME_INDEFINITE);
-        if (!KSUCCESS(Status)) {
-
-            ASSERT(FALSE);
-
-            break;
-        }
-
-        ASSERT((InternalIrp->Flags & IRP_COMPLETE) != 0);
-
-        InternalIrp->Flags &= ~IRP_PENDING;
+    Status = IopStartIrp(InternalIrp, NULL);
+    if (!KSUCCESS(Status)) {
+        return Status;
     }
 
-    InternalIrp->Flags &= ~IRP_ACTIVE;
-
-SendSynchronousIrpEnd:
-    return Status;
+    return IopFinishIrp(InternalIrp);
 }
 
 KERNEL_API
@@ -1397,6 +1351,58 @@ Return Value:
 
 --*/
 
+{
+
+    PIRP IoIrp;
+    KSTATUS Status;
+
+    Status = IopStartIoIrp(Device, MinorCodeNumber, Request, NULL, &IoIrp);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    return IopFinishIoIrp(IoIrp, Request);
+}
+
+KSTATUS
+IopStartIoIrp (
+    PDEVICE Device,
+    IRP_MINOR_CODE MinorCodeNumber,
+    PIRP_READ_WRITE Request,
+    PIO_BATCH Batch,
+    PIRP *Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates an I/O IRP and starts it down the device stack
+    without waiting for it to finish. IopFinishIoIrp must be called on the
+    returned IRP to wait for it and collect the results.
+
+Arguments:
+
+    Device - Supplies a pointer to the device to send the IRP to.
+
+    MinorCodeNumber - Supplies the minor code number to send to the IRP.
+
+    Request - Supplies a pointer to the I/O request parameters.
+
+    Batch - Supplies an optional pointer to the batch the IRP belongs to. An
+        IRP that pends anywhere other than a block queue is waited on before
+        this routine returns, as the driver holding it may not be able to
+        take another until it finishes.
+
+    Irp - Supplies a pointer where the started IRP will be returned on
+        success.
+
+Return Value:
+
+    Status code.
+
+--*/
+
 {
 
     PIRP IoIrp;
@@ -1406,10 +1412,10 @@ Return Value:
     ASSERT((Device != NULL) && (Device != IoRootDevice));
     ASSERT(KeGetRunLevel() < RunLevelDispatch);
 
+    *Irp = NULL;
     IoIrp = IoCreateIrp(Device, IrpMajorIo, 0);
     if (IoIrp == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto SendIoIrpEnd;
+        return STATUS_INSUFFICIENT_RESOURCES;
     }
 
     Thread = KeGetCurrentThread();
@@ -1431,43 +1437,119 @@ Return Value:
     IoIrp->MinorCode = MinorCodeNumber;
     RtlCopyMemory(&(IoIrp->U.ReadWrite), Request, sizeof(IRP_READ_WRITE));
     IoIrp->U.ReadWrite.IoBufferState.IoBuffer = NULL;
-    Status = IoSendSynchronousIrp(IoIrp);
+    Status = IopStartIrp((PIRP_INTERNAL)IoIrp, Batch);
+    if (!KSUCCESS(Status)) {
+        IoDestroyIrp(IoIrp);
+        return Status;
+    }
+
+    *Irp = IoIrp;
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+IopFinishIoIrp (
+    PIRP Irp,
+    PIRP_READ_WRITE Request
+    )
+
+/*++
+
+Routine Description:
+
+    This routine waits for an I/O IRP started with IopStartIoIrp to finish,
+    copies the results back to the request, and destroys the IRP.
+
+Arguments:
+
+    Irp - Supplies a pointer to the started IRP.
+
+    Request - Supplies a pointer where the completed request parameters will
+        be returned.
+
+Return Value:
+
+    Returns the completion status of the IRP.
+
+--*/
+
+{
+
+    PDEVICE Device;
+    KSTATUS Status;
+    PKTHREAD Thread;
+
+    Status = IopFinishIrp((PIRP_INTERNAL)Irp);
     if (!KSUCCESS(Status)) {
-        goto SendIoIrpEnd;
+        goto FinishIoIrpEnd;
     }
 
-    ASSERT(IoIrp->U.ReadWrite.IoBufferState.IoBuffer == NULL);
+    ASSERT(Irp->U.ReadWrite.IoBufferState.IoBuffer == NULL);
 
-    RtlCopyMemory(Request, &(IoIrp->U.ReadWrite), sizeof(IRP_READ_WRITE));
+    RtlCopyMemory(Request, &(Irp->U.ReadWrite), sizeof(IRP_READ_WRITE));
+    Device = Irp->Device;
+    Thread = KeGetCurrentThread();
     if (Device->Header.Type == ObjectDevice) {
-        if (MinorCodeNumber == IrpMinorIoWrite) {
+        if (Irp->MinorCode == IrpMinorIoWrite) {
             RtlAtomicAdd64(&(IoGlobalStatistics.BytesWritten),
-                           IoIrp->U.ReadWrite.IoBytesCompleted);
+                           Irp->U.ReadWrite.IoBytesCompleted);
 
             Thread->ResourceUsage.BytesWritten +=
-                                           IoIrp->U.ReadWrite.IoBytesCompleted;
+                                             Irp->U.ReadWrite.IoBytesCompleted;
 
             Thread->ResourceUsage.DeviceWrites += 1;
 
         } else {
             RtlAtomicAdd64(&(IoGlobalStatistics.BytesRead),
-                           IoIrp->U.ReadWrite.IoBytesCompleted);
+                           Irp->U.ReadWrite.IoBytesCompleted);
 
             Thread->ResourceUsage.BytesRead +=
-                                           IoIrp->U.ReadWrite.IoBytesCompleted;
+                                             Irp->U.ReadWrite.IoBytesCompleted;
 
             Thread->ResourceUsage.DeviceReads += 1;
         }
     }
 
-    Status = IoGetIrpStatus(IoIrp);
+    Status = IoGetIrpStatus(Irp);
 
-SendIoIrpEnd:
-    if (IoIrp != NULL) {
-        IoDestroyIrp(IoIrp);
+FinishIoIrpEnd:
+    IoDestroyIrp(Irp);
+    return Status;
+}
+
+PIO_BATCH
+IopGetIrpBatch (
+    PIRP Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the batch an IRP is being started in, if the calling
+    thread is the one starting it.
+
+Arguments:
+
+    Irp - Supplies a pointer to the IRP.
+
+Return Value:
+
+    Returns a pointer to the batch, or NULL if the IRP is not being started
+    as part of a batch.
+
+--*/
+
+{
+
+    PIO_BATCH Batch;
+
+    Batch = ((PIRP_INTERNAL)Irp)->Batch;
+    if ((Batch != NULL) && (Batch->Thread != KeGetCurrentThread())) {
+        Batch = NULL;
     }
 
-    return Status;
+    return Batch;
 }
 
 KSTATUS
@@ -1713,6 +1795,158 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+KSTATUS
+IopStartIrp (
+    PIRP_INTERNAL Irp,
+    PIO_BATCH Batch
+    )
+
+/*++
+
+Routine Description:
+
+    This routine validates an IRP and pumps it down its driver stack until it
+    is either done or pended. If the IRP is done, it is no longer active
+    when this routine returns.
+
+Arguments:
+
+    Irp - Supplies a pointer to the initialized IRP to send.
+
+    Batch - Supplies an optional pointer to the batch the IRP is being started
+        in. If the IRP pends somewhere other than a block queue, it is
+        finished before returning.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP was sent.
+
+    STATUS_INVALID_PARAMETER if the IRP was not properly initialized.
+
+--*/
+
+{
+
+    BOOL IrpDone;
+
+    //
+    // Crash if the IRP was improperly allocated or modified.
+    //
+
+    if (Irp->Magic != IRP_MAGIC_VALUE) {
+        KeCrashSystem(CRASH_INVALID_IRP,
+                      IrpCrashImproperlyAllocated,
+                      (UINTN)Irp,
+                      (UINTN)Irp->Public.Device,
+                      0);
+    }
+
+    if ((Irp->Device != Irp->Public.Device) ||
+        (Irp->MajorCode != Irp->Public.MajorCode)) {
+
+        KeCrashSystem(CRASH_INVALID_IRP,
+                      IrpCrashConstantStateModified,
+                      (UINTN)Irp,
+                      (UINTN)Irp->Public.Device,
+                      0);
+    }
+
+    //
+    // Fail if the IRP is not properly initialized.
+    //
+
+    if ((Irp->Public.MinorCode == IrpMinorInvalid) ||
+        (Irp->Public.Direction != IrpDown) ||
+        (Irp->Public.CompletionRoutine != NULL)) {
+
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ASSERT((Irp->Flags & (IRP_COMPLETE | IRP_ACTIVE | IRP_PENDING)) == 0);
+
+    Irp->Flags |= IRP_ACTIVE;
+    ObSignalObject(Irp, SignalOptionUnsignal);
+    if (Batch != NULL) {
+        Batch->IrpQueued = FALSE;
+        Irp->Batch = Batch;
+    }
+
+    IrpDone = IopPumpIrpThroughStack(Irp);
+    Irp->Batch = NULL;
+    if (IrpDone != FALSE) {
+        Irp->Flags &= ~IRP_ACTIVE;
+
+    //
+    // A driver that pends an IRP outside a block queue may hold resources
+    // until it comes back up, so don't start anything else behind it.
+    //
+
+    } else if ((Batch != NULL) && (Batch->IrpQueued == FALSE)) {
+        return IopFinishIrp(Irp);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+IopFinishIrp (
+    PIRP_INTERNAL Irp
+    )
+
+/*++
+
+Routine Description:
+
+    This routine waits for a started IRP to be signaled and continues pumping
+    it through the stack until it is done.
+
+Arguments:
+
+    Irp - Supplies a pointer to the started IRP.
+
+Return Value:
+
+    STATUS_SUCCESS if the IRP finished. This says nothing of the completion
+    status of the IRP.
+
+    Error status code if the wait failed.
+
+--*/
+
+{
+
+    BOOL IrpDone;
+    KSTATUS Status;
+
+    Status = STATUS_SUCCESS;
+    IrpDone = FALSE;
+    if ((Irp->Flags & IRP_ACTIVE) == 0) {
+        IrpDone = TRUE;
+    }
+
+    while (IrpDone == FALSE) {
+
+        ASSERT((Irp->Flags & IRP_PENDING) != 0);
+
+        Status = ObWaitOnObject(Irp, 0, WAIT_TIME_INDEFINITE);
+        if (!KSUCCESS(Status)) {
+
+            ASSERT(FALSE);
+
+            break;
+        }
+
+        ASSERT((Irp->Flags & IRP_COMPLETE) != 0);
+
+        Irp->Flags &= ~IRP_PENDING;
+        ObSignalObject(Irp, SignalOptionUnsignal);
+        IrpDone = IopPumpIrpThroughStack(Irp);
+    }
+
+    Irp->Flags &= ~IRP_ACTIVE;
+    return Status;
+}
+
 BOOL
 IopPumpIrpThroughStack (
     PIRP_INTERNAL Irp
@@ -124,6 +124,23 @@ Module Name:
 
 #define PAGE_CACHE_ENTRY_FLAG_HARD_FLUSH_REQUESTED 0x00000040
 
+//
+// Set this flag if the page cache entry has been looked up since the last time
+// the list scans looked at it. Inactive entries with this flag set get
+// promoted to the active list, and active entries with it set get another
+// trip around the active list.
+//
+
+#define PAGE_CACHE_ENTRY_FLAG_REFERENCED 0x00000080
+
+//
+// These flags are set if the page cache entry is on the active list or on one
+// of the inactive lists. They are protected by the list lock.
+//
+
+#define PAGE_CACHE_ENTRY_FLAG_ACTIVE 0x00000100
+#define PAGE_CACHE_ENTRY_FLAG_INACTIVE 0x00000200
+
 //
 // If any of the dirty mask bits are set, then the page cache entry needs to
 // be cleaned and flushed.
@@ -157,6 +174,14 @@ Module Name:
 
 #define PAGE_CACHE_FLUSH_MAX_CLEAN_STREAK 4
 
+//
+// Define the number of flush buffers a block device flush may have in flight
+// at once. Their writes are submitted together so the block queue can merge
+// and sort them.
+//
+
+#define PAGE_CACHE_FLUSH_BATCH_SIZE 8
+
 //
 // Define the block expansion count for the page cache entry block allocator.
 //
@@ -192,6 +217,20 @@ Module Name:
 
 #define PAGE_CACHE_CLEAN_DELAY_MIN (5000 * MICROSECONDS_PER_MILLISECOND)
 
+//
+// Define the number of page cache entries each processor collects before
+// acquiring the list lock to put them all on the inactive list.
+//
+
+#define PAGE_CACHE_LIST_BATCH_SIZE 32
+
+//
+// Define how many times larger than the inactive lists the active list is
+// allowed to get before entries start getting demoted.
+//
+
+#define PAGE_CACHE_ACTIVE_LIST_RATIO 2
+
 //
 // --------------------------------------------------------------------- Macros
 //
@@ -247,9 +286,9 @@ Structure Description:
     Node - Stores the Red-Black tree node information for this page cache
         entry.
 
-    ListEntry - Stores this page cache entry's list entry in an LRU list, local
-        list, or dirty list. This list entry is protected by the global page
-        cache list lock.
+    ListEntry - Stores this page cache entry's list entry in the active list,
+        an inactive list, a local list, or a dirty list. This list entry is
+        protected by the global page cache list lock.
 
     FileObject - Stores a pointer to the file object for the device or file to
         which the page cache entry belongs.
@@ -284,6 +323,86 @@ struct _PAGE_CACHE_ENTRY {
     volatile ULONG Flags;
 };
 
+/*++
+
+Structure Description:
+
+    This structure defines a processor's batch of page cache entries waiting
+    to be put on the inactive list.
+
+Members:
+
+    Lock - Stores the spin lock protecting the batch. It is only ever contended
+        by the page cache thread draining the batch.
+
+    Count - Stores the number of valid entries in the array.
+
+    Entries - Stores the array of page cache entries. Each one holds a
+        reference owned by the batch.
+
+--*/
+
+typedef struct _PAGE_CACHE_LIST_BATCH {
+    KSPIN_LOCK Lock;
+    ULONG Count;
+    PPAGE_CACHE_ENTRY Entries[PAGE_CACHE_LIST_BATCH_SIZE];
+} PAGE_CACHE_LIST_BATCH, *PPAGE_CACHE_LIST_BATCH;
+
+/*++
+
+Structure Description:
+
+    This structure defines a single write within a page cache flush batch.
+
+Members:
+
+    IoBuffer - Stores a pointer to the cache-backed I/O buffer being written.
+
+    Irp - Stores a pointer to the started write IRP.
+
+    Parameters - Stores the parameters of the write IRP.
+
+    BytesToWrite - Stores the number of bytes being written.
+
+    Flags - Stores the I/O flags used for the write. See IO_FLAG_* for
+        definitions.
+
+    Status - Stores the status of the write once it has finished.
+
+--*/
+
+typedef struct _PAGE_CACHE_FLUSH_WRITE {
+    PIO_BUFFER IoBuffer;
+    PIRP Irp;
+    IRP_READ_WRITE Parameters;
+    UINTN BytesToWrite;
+    ULONG Flags;
+    KSTATUS Status;
+} PAGE_CACHE_FLUSH_WRITE, *PPAGE_CACHE_FLUSH_WRITE;
+
+/*++
+
+Structure Description:
+
+    This structure defines a batch of page cache flush writes to a block
+    device that are in flight together.
+
+Members:
+
+    IoBatch - Stores the I/O batch the writes are started in.
+
+    Count - Stores the number of writes started.
+
+    Writes - Stores the array of writes. Each one owns a flush buffer.
+
+--*/
+
+typedef struct _PAGE_CACHE_FLUSH_BATCH {
+    IO_BATCH IoBatch;
+    ULONG Count;
+    PAGE_CACHE_FLUSH_WRITE Writes[PAGE_CACHE_FLUSH_BATCH_SIZE];
+} PAGE_CACHE_FLUSH_BATCH, *PPAGE_CACHE_FLUSH_BATCH;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -327,7 +446,33 @@ KSTATUS
 IopFlushPageCacheBuffer (
     PIO_BUFFER FlushBuffer,
     UINTN FlushSize,
-    ULONG Flags
+    ULONG Flags,
+    PPAGE_CACHE_FLUSH_BATCH Batch
+    );
+
+KSTATUS
+IopCompletePageCacheFlush (
+    PIO_BUFFER FlushBuffer,
+    UINTN BytesToWrite,
+    UINTN BytesCompleted,
+    ULONG Flags,
+    KSTATUS Status
+    );
+
+PPAGE_CACHE_FLUSH_BATCH
+IopCreatePageCacheFlushBatch (
+    VOID
+    );
+
+VOID
+IopDestroyPageCacheFlushBatch (
+    PPAGE_CACHE_FLUSH_BATCH Batch
+    );
+
+KSTATUS
+IopFinishPageCacheFlushBatch (
+    PFILE_OBJECT FileObject,
+    PPAGE_CACHE_FLUSH_BATCH Batch
     );
 
 VOID
@@ -378,6 +523,44 @@ IopUpdatePageCacheEntryList (
     BOOL Created
     );
 
+VOID
+IopRequeueMappedPageCacheEntry (
+    PPAGE_CACHE_ENTRY Entry
+    );
+
+VOID
+IopQueuePageCacheListBatch (
+    PPAGE_CACHE_ENTRY Entry
+    );
+
+VOID
+IopDrainPageCacheListBatches (
+    VOID
+    );
+
+VOID
+IopProcessPageCacheListBatch (
+    PPAGE_CACHE_ENTRY *Entries,
+    ULONG Count
+    );
+
+VOID
+IopInsertPageCacheEntryOnList (
+    PPAGE_CACHE_ENTRY Entry,
+    PLIST_ENTRY ListHead,
+    ULONG ListFlag
+    );
+
+VOID
+IopRemovePageCacheEntryFromList (
+    PPAGE_CACHE_ENTRY Entry
+    );
+
+VOID
+IopBalancePageCacheLists (
+    UINTN DemoteCount
+    );
+
 BOOL
 IopIsPageCacheTooBig (
     PUINTN FreePhysicalPages
@@ -393,23 +576,46 @@ IopCheckFileObjectPageCache (
     PFILE_OBJECT FileObject
     );
 
+VOID
+IopPrefetchPageCache (
+    PIO_HANDLE Handle,
+    IO_OFFSET Offset,
+    ULONGLONG Size
+    );
+
+VOID
+IopDropPageCacheEntries (
+    PFILE_OBJECT FileObject,
+    IO_OFFSET Offset,
+    ULONGLONG Size
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
 
+//
+// Stores the list head for page cache entries that have been used more than
+// once. Entries are promoted here from the inactive list, and demoted back
+// from the front when this list grows too large relative to the inactive
+// lists.
+//
+
+LIST_ENTRY IoPageCacheActiveList;
+
 //
 // Stores the list head for the page cache entries that are ordered from least
-// to most recently used. This will mostly contain clean entries, but could
-// have a few dirty entries on it.
+// to most recently used. New entries start here. This will mostly contain
+// clean entries, but could have a few dirty entries on it.
 //
 
-LIST_ENTRY IoPageCacheCleanList;
+LIST_ENTRY IoPageCacheInactiveList;
 
 //
 // Stores the list head for page cache entries that are clean but not mapped.
-// The unmap loop moves entries from the clean list to here to avoid iterating
-// over them too many times. These entries are considered even less used than
-// the clean list.
+// The unmap loop moves entries from the inactive list to here to avoid
+// iterating over them too many times. These entries are considered even less
+// used than the inactive list.
 //
 
 LIST_ENTRY IoPageCacheCleanUnmappedList;
@@ -428,6 +634,30 @@ LIST_ENTRY IoPageCacheRemovalList;
 
 PQUEUED_LOCK IoPageCacheListLock;
 
+//
+// Store the number of entries on the active list and on the two inactive
+// lists. These are protected by the list lock.
+//
+
+UINTN IoPageCacheActivePageCount = 0;
+UINTN IoPageCacheInactivePageCount = 0;
+
+//
+// Store the number of times entries have been promoted to the active list and
+// demoted back to the inactive list. These are protected by the list lock.
+//
+
+UINTN IoPageCachePromotionCount = 0;
+UINTN IoPageCacheDemotionCount = 0;
+
+//
+// Store the array of per-processor batches of entries waiting to be put on the
+// inactive list.
+//
+
+PPAGE_CACHE_LIST_BATCH IoPageCacheListBatches;
+ULONG IoPageCacheListBatchCount;
+
 //
 // Store the target number of free pages in the system the page cache shoots
 // for once low-memory eviction of page cache entries kicks in.
@@ -641,9 +871,128 @@ Return Value:
     Statistics->PhysicalPageCount = IoPageCachePhysicalPageCount;
     Statistics->DirtyPageCount = IoPageCacheDirtyPageCount;
     Statistics->LastCleanTime = LastCleanTime;
+    Statistics->ActivePageCount = IoPageCacheActivePageCount;
+    Statistics->InactivePageCount = IoPageCacheInactivePageCount;
+    Statistics->PromotionCount = IoPageCachePromotionCount;
+    Statistics->DemotionCount = IoPageCacheDemotionCount;
     return STATUS_SUCCESS;
 }
 
+KERNEL_API
+KSTATUS
+IoAdviseFile (
+    PIO_HANDLE Handle,
+    IO_OFFSET Offset,
+    ULONGLONG Size,
+    FILE_ADVICE Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine applies an access pattern hint to the page cache for the file
+    or device behind the given handle.
+
+Arguments:
+
+    Handle - Supplies an open I/O handle.
+
+    Offset - Supplies the offset from the beginning of the file or device of
+        the region the advice applies to. This is ignored for advice that
+        applies to the whole file.
+
+    Size - Supplies the size, in bytes, of the region the advice applies to.
+        Supply a value of -1 to cover from the given offset to the end of the
+        file.
+
+    Advice - Supplies the access pattern hint.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PFILE_OBJECT FileObject;
+    KSTATUS Status;
+
+    if ((Advice < FileAdviceNormal) || (Advice >= FileAdviceCount) ||
+        (Offset < 0)) {
+
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    //
+    // Advice is meaningless for objects that don't go through the page cache.
+    //
+
+    FileObject = Handle->FileObject;
+    if (IO_IS_FILE_OBJECT_CACHEABLE(FileObject) == FALSE) {
+        return STATUS_SUCCESS;
+    }
+
+    Status = STATUS_SUCCESS;
+    switch (Advice) {
+    case FileAdviceNormal:
+        RtlAtomicAnd32(&(FileObject->Flags),
+                       ~FILE_OBJECT_FLAG_ACCESS_PATTERN_MASK);
+
+        break;
+
+    case FileAdviceSequential:
+        RtlAtomicAnd32(&(FileObject->Flags), ~FILE_OBJECT_FLAG_RANDOM_ACCESS);
+        RtlAtomicOr32(&(FileObject->Flags), FILE_OBJECT_FLAG_SEQUENTIAL_ACCESS);
+        break;
+
+    case FileAdviceRandom:
+        RtlAtomicAnd32(&(FileObject->Flags),
+                       ~FILE_OBJECT_FLAG_SEQUENTIAL_ACCESS);
+
+        RtlAtomicOr32(&(FileObject->Flags), FILE_OBJECT_FLAG_RANDOM_ACCESS);
+        break;
+
+    //
+    // Entries that are only used once never leave the inactive list, so they
+    // are already the first to go.
+    //
+
+    case FileAdviceNoReuse:
+        break;
+
+    case FileAdviceWillNeed:
+        IopPrefetchPageCache(Handle, Offset, Size);
+        break;
+
+    //
+    // Write out anything dirty in the region so that as much of it as
+    // possible can be dropped from the cache.
+    //
+
+    case FileAdviceDontNeed:
+        Status = IopFlushFileObject(FileObject, Offset, Size, 0, FALSE, NULL);
+        if (!KSUCCESS(Status)) {
+            break;
+        }
+
+        KeAcquireSharedExclusiveLockExclusive(FileObject->Lock);
+        IopDropPageCacheEntries(FileObject, Offset, Size);
+        KeReleaseSharedExclusiveLockExclusive(FileObject->Lock);
+        break;
+
+    default:
+
+        ASSERT(FALSE);
+
+        Status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    return Status;
+}
+
 VOID
 IoPageCacheEntryAddReference (
     PPAGE_CACHE_ENTRY Entry
@@ -705,33 +1054,35 @@ Return Value:
 {
 
     ULONG OldReferenceCount;
+    ULONG ReferenceCount;
 
-    OldReferenceCount = RtlAtomicAdd32(&(Entry->ReferenceCount), -1);
-
-    ASSERT((OldReferenceCount != 0) && (OldReferenceCount < 0x1000));
-
-    //
-    // Potentially insert the page cache entry on the LRU list if the reference
-    // count just dropped to zero.
-    //
-
-    if ((OldReferenceCount == 1) &&
-        (Entry->ListEntry.Next == NULL) &&
-        ((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0)) {
+    while (TRUE) {
+        ReferenceCount = Entry->ReferenceCount;
 
-        KeAcquireQueuedLock(IoPageCacheListLock);
+        ASSERT((ReferenceCount != 0) && (ReferenceCount < 0x1000));
 
         //
-        // Double check to make sure it's not on a list or dirty now.
+        // If this is the last reference and the entry is clean but not on a
+        // list, hand the reference to this processor's list batch instead of
+        // dropping it. The batch will put the entry on the inactive list and
+        // then release the reference.
         //
 
-        if ((Entry->ListEntry.Next == NULL) &&
+        if ((ReferenceCount == 1) &&
+            (Entry->ListEntry.Next == NULL) &&
             ((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0)) {
 
-            INSERT_BEFORE(&(Entry->ListEntry), &IoPageCacheCleanList);
+            IopQueuePageCacheListBatch(Entry);
+            break;
         }
 
-        KeReleaseQueuedLock(IoPageCacheListLock);
+        OldReferenceCount = RtlAtomicCompareExchange32(&(Entry->ReferenceCount),
+                                                       ReferenceCount - 1,
+                                                       ReferenceCount);
+
+        if (OldReferenceCount == ReferenceCount) {
+            break;
+        }
     }
 
     return;
@@ -896,10 +1247,10 @@ Return Value:
 
             //
             // If it wasn't dirty, it may need to be moved from the
-            // clean-unmapped list to the clean list.
+            // clean-unmapped list to the inactive list.
             //
 
-            IopUpdatePageCacheEntryList(UnmappedEntry, FALSE);
+            IopRequeueMappedPageCacheEntry(UnmappedEntry);
         }
     }
 
@@ -1002,7 +1353,7 @@ Return Value:
             ((DirtyEntry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY) == 0)) {
 
             if (DirtyEntry->ListEntry.Next != NULL) {
-                LIST_REMOVE(&(DirtyEntry->ListEntry));
+                IopRemovePageCacheEntryFromList(DirtyEntry);
             }
 
             INSERT_BEFORE(&(DirtyEntry->ListEntry),
@@ -1026,6 +1377,52 @@ Return Value:
     return;
 }
 
+BOOL
+IoIsPageCacheEntryDirty (
+    PPAGE_CACHE_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the given page cache entry may hold data
+    not yet written to its backing store. It takes no locks, so it can be
+    called while writing a crash dump.
+
+Arguments:
+
+    Entry - Supplies a pointer to a page cache entry.
+
+Return Value:
+
+    TRUE if the entry is dirty, or is mapped and may have been written through
+    the mapping.
+
+    FALSE if the entry's contents can be read back from disk.
+
+--*/
+
+{
+
+    PPAGE_CACHE_ENTRY BackingEntry;
+    ULONG Flags;
+
+    Flags = Entry->Flags;
+    BackingEntry = Entry->BackingEntry;
+    if (BackingEntry != NULL) {
+        Flags |= BackingEntry->Flags;
+    }
+
+    if ((Flags & (PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK |
+                  PAGE_CACHE_ENTRY_FLAG_MAPPED)) != 0) {
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 KSTATUS
 IopInitializePageCache (
     VOID
@@ -1049,6 +1446,9 @@ Return Value:
 
 {
 
+    UINTN AllocationSize;
+    ULONG BatchCount;
+    ULONG BatchIndex;
     PBLOCK_ALLOCATOR BlockAllocator;
     ULONGLONG CurrentTime;
     ULONG PageShift;
@@ -1057,7 +1457,8 @@ Return Value:
     UINTN TotalPhysicalPages;
     UINTN TotalVirtualMemory;
 
-    INITIALIZE_LIST_HEAD(&IoPageCacheCleanList);
+    INITIALIZE_LIST_HEAD(&IoPageCacheActiveList);
+    INITIALIZE_LIST_HEAD(&IoPageCacheInactiveList);
     INITIALIZE_LIST_HEAD(&IoPageCacheCleanUnmappedList);
     INITIALIZE_LIST_HEAD(&IoPageCacheRemovalList);
     IoPageCacheListLock = KeCreateQueuedLock();
@@ -1067,11 +1468,32 @@ Return Value:
     }
 
     //
-    // Create a timer to schedule the page cache worker.
+    // Create a batch of pending list insertions for each processor.
     //
 
-    IoPageCacheWorkTimer = KeCreateTimer(PAGE_CACHE_ALLOCATION_TAG);
-    if (IoPageCacheWorkTimer == NULL) {
+    BatchCount = KeGetActiveProcessorCount();
+    AllocationSize = BatchCount * sizeof(PAGE_CACHE_LIST_BATCH);
+    IoPageCacheListBatches = MmAllocateNonPagedPool(AllocationSize,
+                                                    PAGE_CACHE_ALLOCATION_TAG);
+
+    if (IoPageCacheListBatches == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializePageCacheEnd;
+    }
+
+    RtlZeroMemory(IoPageCacheListBatches, AllocationSize);
+    for (BatchIndex = 0; BatchIndex < BatchCount; BatchIndex += 1) {
+        KeInitializeSpinLock(&(IoPageCacheListBatches[BatchIndex].Lock));
+    }
+
+    IoPageCacheListBatchCount = BatchCount;
+
+    //
+    // Create a timer to schedule the page cache worker.
+    //
+
+    IoPageCacheWorkTimer = KeCreateTimer(PAGE_CACHE_ALLOCATION_TAG);
+    if (IoPageCacheWorkTimer == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto InitializePageCacheEnd;
     }
@@ -1214,6 +1636,12 @@ Return Value:
             IoPageCacheListLock = NULL;
         }
 
+        if (IoPageCacheListBatches != NULL) {
+            MmFreeNonPagedPool(IoPageCacheListBatches);
+            IoPageCacheListBatches = NULL;
+            IoPageCacheListBatchCount = 0;
+        }
+
         if (IoPageCacheWorkTimer != NULL) {
             KeDestroyTimer(IoPageCacheWorkTimer);
             IoPageCacheWorkTimer = NULL;
@@ -1734,6 +2162,8 @@ Return Value:
 {
 
     PPAGE_CACHE_ENTRY BackingEntry;
+    PPAGE_CACHE_FLUSH_BATCH Batch;
+    KSTATUS BatchStatus;
     BOOL BytesFlushed;
     PPAGE_CACHE_ENTRY CacheEntry;
     UINTN CleanStreak;
@@ -1754,6 +2184,7 @@ Return Value:
     BOOL UseDirtyPageList;
 
     PageCacheThread = FALSE;
+    Batch = NULL;
     BytesFlushed = FALSE;
     CacheEntry = NULL;
     FlushBuffer = NULL;
@@ -1816,13 +2247,25 @@ Return Value:
     }
 
     //
-    // Allocate a buffer to support the maximum allowed flush size.
+    // Block devices get several flush buffers so that their writes can be in
+    // the block queue together. If those can't be allocated, fall back to
+    // writing one buffer at a time. Allocate a buffer to support the maximum
+    // allowed flush size.
     //
 
-    FlushBuffer = MmAllocateUninitializedIoBuffer(PAGE_CACHE_FLUSH_MAX, 0);
-    if (FlushBuffer == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto FlushPageCacheEntriesEnd;
+    if (FileObject->Properties.Type == IoObjectBlockDevice) {
+        Batch = IopCreatePageCacheFlushBatch();
+    }
+
+    if (Batch != NULL) {
+        FlushBuffer = Batch->Writes[0].IoBuffer;
+
+    } else {
+        FlushBuffer = MmAllocateUninitializedIoBuffer(PAGE_CACHE_FLUSH_MAX, 0);
+        if (FlushBuffer == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto FlushPageCacheEntriesEnd;
+        }
     }
 
     PageSize = MmPageSize();
@@ -1901,8 +2344,7 @@ Return Value:
                 //
 
                 if (Node->Parent == NULL) {
-                    LIST_REMOVE(&(CacheEntry->ListEntry));
-                    CacheEntry->ListEntry.Next = NULL;
+                    IopRemovePageCacheEntryFromList(CacheEntry);
                     Node = NULL;
                     continue;
                 }
@@ -2052,7 +2494,7 @@ Return Value:
             IoPageCacheEntryAddReference(CacheEntry);
         }
 
-        Status = IopFlushPageCacheBuffer(FlushBuffer, FlushSize, Flags);
+        Status = IopFlushPageCacheBuffer(FlushBuffer, FlushSize, Flags, Batch);
         if (!KSUCCESS(Status)) {
             TotalStatus = Status;
 
@@ -2061,9 +2503,22 @@ Return Value:
         }
 
         //
-        // Prepare the flush buffer to be used again.
+        // If the write went out as part of a batch, move on to the next free
+        // flush buffer, finishing the batch if they are all in flight.
+        // Otherwise prepare the flush buffer to be used again.
         //
 
+        if (Batch != NULL) {
+            if (Batch->Count == PAGE_CACHE_FLUSH_BATCH_SIZE) {
+                Status = IopFinishPageCacheFlushBatch(FileObject, Batch);
+                if (!KSUCCESS(Status)) {
+                    TotalStatus = Status;
+                }
+            }
+
+            FlushBuffer = Batch->Writes[Batch->Count].IoBuffer;
+        }
+
         MmResetIoBuffer(FlushBuffer);
         FlushSize = 0;
         CleanStreak = 0;
@@ -2159,7 +2614,7 @@ Return Value:
 
     FlushSize -= CleanStreak << PageShift;
     if (FlushSize != 0) {
-        Status = IopFlushPageCacheBuffer(FlushBuffer, FlushSize, Flags);
+        Status = IopFlushPageCacheBuffer(FlushBuffer, FlushSize, Flags, Batch);
         if (!KSUCCESS(Status)) {
             TotalStatus = Status;
 
@@ -2172,6 +2627,23 @@ Return Value:
 
 FlushPageCacheEntriesEnd:
 
+    //
+    // Wait for any writes still in flight before the flush is considered
+    // done.
+    //
+
+    if (Batch != NULL) {
+        if (Batch->Count != 0) {
+            BatchStatus = IopFinishPageCacheFlushBatch(FileObject, Batch);
+            if (!KSUCCESS(BatchStatus)) {
+                TotalStatus = BatchStatus;
+            }
+        }
+
+        IopDestroyPageCacheFlushBatch(Batch);
+        FlushBuffer = NULL;
+    }
+
     //
     // If there are still entries on the local list, put those back on the
     // dirty list. Be careful. If this routine released the file object lock,
@@ -2367,7 +2839,7 @@ Return Value:
         Destroyed = FALSE;
         KeAcquireQueuedLock(IoPageCacheListLock);
         if (CacheEntry->ListEntry.Next != NULL) {
-            LIST_REMOVE(&(CacheEntry->ListEntry));
+            IopRemovePageCacheEntryFromList(CacheEntry);
         }
 
         if (CacheEntry->ReferenceCount == 0) {
@@ -2662,19 +3134,20 @@ Return Value:
         if ((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_PENDING) == 0) {
 
             //
-            // If requested, move the page cache entry to the back of the LRU
-            // list; assume that this page has been fairly recently used on
-            // account of it having been dirty. If the page is already on a
-            // list, then leave it as its current location.
+            // If requested, move the page cache entry to the back of the
+            // inactive list; assume that this page has been fairly recently
+            // used on account of it having been dirty. It has to earn its way
+            // onto the active list like any other entry.
             //
 
             if (MoveToCleanList != FALSE) {
                 if (Entry->ListEntry.Next != NULL) {
-                    LIST_REMOVE(&(Entry->ListEntry));
-                    Entry->ListEntry.Next = NULL;
+                    IopRemovePageCacheEntryFromList(Entry);
                 }
 
-                INSERT_BEFORE(&(Entry->ListEntry), &IoPageCacheCleanList);
+                IopInsertPageCacheEntryOnList(Entry,
+                                              &IoPageCacheInactiveList,
+                                              PAGE_CACHE_ENTRY_FLAG_INACTIVE);
             }
         }
 
@@ -2778,12 +3251,13 @@ Return Value:
         MarkedDirty = TRUE;
 
         //
-        // Remove the page cache entry from the clean LRU if it's on one.
+        // Remove the page cache entry from the active or inactive list if it's
+        // on one.
         //
 
         KeAcquireQueuedLock(IoPageCacheListLock);
         if (DirtyEntry->ListEntry.Next != NULL) {
-            LIST_REMOVE(&(DirtyEntry->ListEntry));
+            IopRemovePageCacheEntryFromList(DirtyEntry);
         }
 
         //
@@ -3120,6 +3594,7 @@ Return Value:
                 //
 
                 IopUpdatePageCacheEntryList(LowerEntry, FALSE);
+                IopRequeueMappedPageCacheEntry(LowerEntry);
             }
         }
     }
@@ -3172,7 +3647,8 @@ Routine Description:
 
     This routine removes as many clean page cache entries as is necessary to
     bring the size of the page cache back down to a reasonable level. It evicts
-    the page cache entries in LRU order.
+    from the inactive lists in LRU order, demoting entries from the active
+    list only when the inactive lists run dry.
 
 Arguments:
 
@@ -3228,11 +3704,13 @@ Return Value:
     }
 
     //
-    // Iterate over the clean LRU page cache list trying to find which page
+    // Iterate over the inactive page cache lists trying to find which page
     // cache entries can be removed. Stop as soon as the target count has been
-    // reached.
+    // reached. Referenced entries found along the way get promoted rather than
+    // removed.
     //
 
+    IopBalancePageCacheLists(0);
     INITIALIZE_LIST_HEAD(&DestroyListHead);
     if (!LIST_EMPTY(&IoPageCacheCleanUnmappedList)) {
         IopRemovePageCacheEntriesFromList(&IoPageCacheCleanUnmappedList,
@@ -3242,7 +3720,20 @@ Return Value:
     }
 
     if (TargetRemoveCount != 0) {
-        IopRemovePageCacheEntriesFromList(&IoPageCacheCleanList,
+        IopRemovePageCacheEntriesFromList(&IoPageCacheInactiveList,
+                                          &DestroyListHead,
+                                          TimidEffort,
+                                          &TargetRemoveCount);
+    }
+
+    //
+    // If the inactive lists could not satisfy the request, demote the coldest
+    // active entries and go around once more.
+    //
+
+    if ((TargetRemoveCount != 0) && (!LIST_EMPTY(&IoPageCacheActiveList))) {
+        IopBalancePageCacheLists(TargetRemoveCount);
+        IopRemovePageCacheEntriesFromList(&IoPageCacheInactiveList,
                                           &DestroyListHead,
                                           TimidEffort,
                                           &TargetRemoveCount);
@@ -3915,6 +4406,14 @@ Return Value:
 
         while (TRUE) {
 
+            //
+            // Put any entries sitting in per-processor batches on the inactive
+            // list so they can be trimmed, and so evicted ones drop their
+            // references.
+            //
+
+            IopDrainPageCacheListBatches();
+
             //
             // Blast away the list of page cache entries that are ready for
             // removal.
@@ -3972,7 +4471,8 @@ KSTATUS
 IopFlushPageCacheBuffer (
     PIO_BUFFER FlushBuffer,
     UINTN FlushSize,
-    ULONG Flags
+    ULONG Flags,
+    PPAGE_CACHE_FLUSH_BATCH Batch
     )
 
 /*++
@@ -3992,14 +4492,20 @@ Routine Description:
     Flags - Supplies a bitmaks of I/O flags for the flush. See IO_FLAG_* for
         definitions.
 
+    Batch - Supplies an optional pointer to a flush batch for a block device.
+        If the write can go straight to the device, it is started in the batch
+        and the buffer is owned by the batch until the batch is finished.
+
 Return Value:
 
-    Status code.
+    Status code. The status of a write started in a batch is returned when the
+    batch is finished.
 
 --*/
 
 {
 
+    ULONG BlockSize;
     UINTN BufferOffset;
     UINTN BytesToWrite;
     PPAGE_CACHE_ENTRY CacheEntry;
@@ -4013,6 +4519,7 @@ Return Value:
     ULONG OldFlags;
     ULONG PageSize;
     KSTATUS Status;
+    PPAGE_CACHE_FLUSH_WRITE Write;
 
     CacheEntry = MmGetIoBufferPageCacheEntry(FlushBuffer, 0);
     FileObject = CacheEntry->FileObject;
@@ -4114,6 +4621,54 @@ Return Value:
 
     if (FileObject->Properties.Type == IoObjectBlockDevice) {
         KeReleaseSharedExclusiveLockShared(FileObject->Lock);
+
+        //
+        // Whole blocks can be started straight down to the device as part of
+        // the batch. The batch completes the write once it is finished.
+        //
+
+        BlockSize = FileObject->Properties.BlockSize;
+        if ((Batch != NULL) &&
+            (IS_ALIGNED(FileOffset, BlockSize) != FALSE) &&
+            (IS_ALIGNED(BytesToWrite, BlockSize) != FALSE)) {
+
+            ASSERT(Batch->Count < PAGE_CACHE_FLUSH_BATCH_SIZE);
+
+            Write = &(Batch->Writes[Batch->Count]);
+
+            ASSERT(Write->IoBuffer == FlushBuffer);
+
+            Write->Parameters.DeviceContext = FileObject->DeviceContext;
+            Write->Parameters.IoFlags = Flags;
+            Write->Parameters.TimeoutInMilliseconds = WAIT_TIME_INDEFINITE;
+            Write->Parameters.FileProperties = &(FileObject->Properties);
+            Write->Parameters.IoOffset = FileOffset;
+            Write->Parameters.IoSizeInBytes = BytesToWrite;
+            Write->Parameters.IoBytesCompleted = 0;
+            Write->Parameters.NewIoOffset = FileOffset;
+            Write->Parameters.IoBuffer = FlushBuffer;
+            Status = IopStartIoIrp(FileObject->Device,
+                                   IrpMinorIoWrite,
+                                   &(Write->Parameters),
+                                   &(Batch->IoBatch),
+                                   &(Write->Irp));
+
+            KeAcquireSharedExclusiveLockShared(FileObject->Lock);
+            if (KSUCCESS(Status)) {
+                Write->BytesToWrite = BytesToWrite;
+                Write->Flags = Flags;
+                Batch->Count += 1;
+
+            } else {
+                Status = IopCompletePageCacheFlush(FlushBuffer,
+                                                   BytesToWrite,
+                                                   0,
+                                                   Flags,
+                                                   Status);
+            }
+
+            goto FlushPageCacheBufferEnd;
+        }
     }
 
     IoContext.IoBuffer = FlushBuffer;
@@ -4127,9 +4682,68 @@ Return Value:
         KeAcquireSharedExclusiveLockShared(FileObject->Lock);
     }
 
+    Status = IopCompletePageCacheFlush(FlushBuffer,
+                                       BytesToWrite,
+                                       IoContext.BytesCompleted,
+                                       Flags,
+                                       Status);
+
+FlushPageCacheBufferEnd:
+    return Status;
+}
+
+KSTATUS
+IopCompletePageCacheFlush (
+    PIO_BUFFER FlushBuffer,
+    UINTN BytesToWrite,
+    UINTN BytesCompleted,
+    ULONG Flags,
+    KSTATUS Status
+    )
+
+/*++
+
+Routine Description:
+
+    This routine handles the result of writing out a flush buffer, marking
+    any pages that did not make it out dirty again. This routine assumes the
+    file object lock is held shared.
+
+Arguments:
+
+    FlushBuffer - Supplies a pointer to the cache-backed I/O buffer that was
+        written.
+
+    BytesToWrite - Supplies the number of bytes that were to be written.
+
+    BytesCompleted - Supplies the number of bytes actually written.
+
+    Flags - Supplies the bitmask of I/O flags used for the write. See
+        IO_FLAG_* for definitions.
+
+    Status - Supplies the status of the write.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN BufferOffset;
+    PPAGE_CACHE_ENTRY CacheEntry;
+    PFILE_OBJECT FileObject;
+    IO_OFFSET FileOffset;
+    ULONG PageSize;
+
+    CacheEntry = MmGetIoBufferPageCacheEntry(FlushBuffer, 0);
+    FileObject = CacheEntry->FileObject;
+    FileOffset = CacheEntry->Offset;
+    PageSize = MmPageSize();
     if ((IoPageCacheDebugFlags & PAGE_CACHE_DEBUG_FLUSH) != 0) {
         if ((!KSUCCESS(Status)) || (Flags != 0) ||
-            (IoContext.BytesCompleted != BytesToWrite)) {
+            (BytesCompleted != BytesToWrite)) {
 
             RtlDebugPrint("PAGE CACHE: Flushed FILE_OBJECT 0x%08x "
                           "with status 0x%08x: flags 0x%x, file offset "
@@ -4140,7 +4754,7 @@ Return Value:
                           Flags,
                           FileOffset,
                           BytesToWrite,
-                          IoContext.BytesCompleted);
+                          BytesCompleted);
 
         } else {
             RtlDebugPrint("PAGE CACHE: Flushed FILE_OBJECT 0x%x "
@@ -4152,20 +4766,20 @@ Return Value:
     }
 
     if (!KSUCCESS(Status))  {
-        goto FlushPageCacheBufferEnd;
+        goto CompletePageCacheFlushEnd;
     }
 
-    if (IoContext.BytesCompleted != BytesToWrite) {
+    if (BytesCompleted != BytesToWrite) {
 
         ASSERT(FALSE);
 
         Status = STATUS_DATA_LENGTH_MISMATCH;
-        goto FlushPageCacheBufferEnd;
+        goto CompletePageCacheFlushEnd;
     }
 
     Status = STATUS_SUCCESS;
 
-FlushPageCacheBufferEnd:
+CompletePageCacheFlushEnd:
     if (!KSUCCESS(Status)) {
 
         //
@@ -4173,7 +4787,7 @@ Return Value:
         // object lock exclusive.
         //
 
-        BufferOffset = ALIGN_RANGE_DOWN(IoContext.BytesCompleted, PageSize);
+        BufferOffset = ALIGN_RANGE_DOWN(BytesCompleted, PageSize);
         if (BufferOffset < BytesToWrite) {
             KeSharedExclusiveLockConvertToExclusive(FileObject->Lock);
             while (BufferOffset < BytesToWrite) {
@@ -4188,14 +4802,170 @@ Return Value:
             KeAcquireSharedExclusiveLockShared(FileObject->Lock);
         }
 
-        if (IoContext.BytesCompleted != BytesToWrite) {
-            IopMarkFileObjectDirty(CacheEntry->FileObject);
+        if (BytesCompleted != BytesToWrite) {
+            IopMarkFileObjectDirty(FileObject);
         }
     }
 
     return Status;
 }
 
+PPAGE_CACHE_FLUSH_BATCH
+IopCreatePageCacheFlushBatch (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates a page cache flush batch and all of its flush
+    buffers.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns a pointer to the batch on success, or NULL on allocation failure.
+
+--*/
+
+{
+
+    PPAGE_CACHE_FLUSH_BATCH Batch;
+    ULONG Index;
+    PIO_BUFFER IoBuffer;
+
+    Batch = MmAllocatePagedPool(sizeof(PAGE_CACHE_FLUSH_BATCH),
+                                PAGE_CACHE_ALLOCATION_TAG);
+
+    if (Batch == NULL) {
+        return NULL;
+    }
+
+    RtlZeroMemory(Batch, sizeof(PAGE_CACHE_FLUSH_BATCH));
+    IopInitializeIoBatch(&(Batch->IoBatch));
+    for (Index = 0; Index < PAGE_CACHE_FLUSH_BATCH_SIZE; Index += 1) {
+        IoBuffer = MmAllocateUninitializedIoBuffer(PAGE_CACHE_FLUSH_MAX, 0);
+        if (IoBuffer == NULL) {
+            IopDestroyPageCacheFlushBatch(Batch);
+            return NULL;
+        }
+
+        Batch->Writes[Index].IoBuffer = IoBuffer;
+    }
+
+    return Batch;
+}
+
+VOID
+IopDestroyPageCacheFlushBatch (
+    PPAGE_CACHE_FLUSH_BATCH Batch
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys a page cache flush batch. The batch must not have
+    any writes in flight.
+
+Arguments:
+
+    Batch - Supplies a pointer to the batch to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+
+    ASSERT(Batch->Count == 0);
+
+    for (Index = 0; Index < PAGE_CACHE_FLUSH_BATCH_SIZE; Index += 1) {
+        if (Batch->Writes[Index].IoBuffer != NULL) {
+            MmFreeIoBuffer(Batch->Writes[Index].IoBuffer);
+        }
+    }
+
+    MmFreePagedPool(Batch);
+    return;
+}
+
+KSTATUS
+IopFinishPageCacheFlushBatch (
+    PFILE_OBJECT FileObject,
+    PPAGE_CACHE_FLUSH_BATCH Batch
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sends the writes started in a page cache flush batch to the
+    device, waits for them all to finish, and completes each one. This
+    routine assumes the file object lock is held shared, and drops it while
+    waiting.
+
+Arguments:
+
+    FileObject - Supplies a pointer to the block device file object being
+        flushed.
+
+    Batch - Supplies a pointer to the batch to finish.
+
+Return Value:
+
+    Returns the status of the first write to fail, or STATUS_SUCCESS if all
+    writes succeeded.
+
+--*/
+
+{
+
+    ULONG Index;
+    KSTATUS Status;
+    KSTATUS TotalStatus;
+    PPAGE_CACHE_FLUSH_WRITE Write;
+
+    ASSERT(FileObject->Properties.Type == IoObjectBlockDevice);
+    ASSERT(KeIsSharedExclusiveLockHeldShared(FileObject->Lock) != FALSE);
+
+    TotalStatus = STATUS_SUCCESS;
+    KeReleaseSharedExclusiveLockShared(FileObject->Lock);
+    IopUnplugIoBatch(&(Batch->IoBatch));
+    for (Index = 0; Index < Batch->Count; Index += 1) {
+        Write = &(Batch->Writes[Index]);
+        Write->Status = IopFinishIoIrp(Write->Irp, &(Write->Parameters));
+        Write->Irp = NULL;
+    }
+
+    KeAcquireSharedExclusiveLockShared(FileObject->Lock);
+    for (Index = 0; Index < Batch->Count; Index += 1) {
+        Write = &(Batch->Writes[Index]);
+        Status = IopCompletePageCacheFlush(Write->IoBuffer,
+                                           Write->BytesToWrite,
+                                           Write->Parameters.IoBytesCompleted,
+                                           Write->Flags,
+                                           Write->Status);
+
+        if ((!KSUCCESS(Status)) && (KSUCCESS(TotalStatus))) {
+            TotalStatus = Status;
+        }
+
+        MmResetIoBuffer(Write->IoBuffer);
+    }
+
+    Batch->Count = 0;
+    return TotalStatus;
+}
+
 VOID
 IopTrimRemovalPageCacheList (
     VOID
@@ -4298,6 +5068,7 @@ Return Value:
     PPAGE_CACHE_ENTRY CacheEntry;
     PFILE_OBJECT FileObject;
     ULONG Flags;
+    ULONG ListFlag;
     LIST_ENTRY LocalList;
     PSHARED_EXCLUSIVE_LOCK Lock;
     PLIST_ENTRY MoveList;
@@ -4314,7 +5085,8 @@ Return Value:
     //
     // Move the contents of the list over to a local list to avoid infinitely
     // working on the same entries. The local list is also protected by the
-    // list lock, and cannot be manipulated without it.
+    // list lock, and cannot be manipulated without it. Entries on it keep
+    // their list flags, as they are going back where they came from.
     //
 
     MOVE_LIST(PageCacheListHead, &LocalList);
@@ -4339,8 +5111,7 @@ Return Value:
             //
 
             if (CacheEntry->ReferenceCount != 0) {
-                LIST_REMOVE(&(CacheEntry->ListEntry));
-                CacheEntry->ListEntry.Next = NULL;
+                IopRemovePageCacheEntryFromList(CacheEntry);
 
                 //
                 // Double check the reference count. If it dropped to zero
@@ -4351,8 +5122,10 @@ Return Value:
 
                 RtlMemoryBarrier();
                 if (CacheEntry->ReferenceCount == 0) {
-                    INSERT_BEFORE(&(CacheEntry->ListEntry),
-                                  &IoPageCacheCleanList);
+                    IopInsertPageCacheEntryOnList(
+                                               CacheEntry,
+                                               &IoPageCacheInactiveList,
+                                               PAGE_CACHE_ENTRY_FLAG_INACTIVE);
                 }
 
                 continue;
@@ -4365,8 +5138,26 @@ Return Value:
             //
 
             if ((Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) != 0) {
-                LIST_REMOVE(&(CacheEntry->ListEntry));
-                CacheEntry->ListEntry.Next = NULL;
+                IopRemovePageCacheEntryFromList(CacheEntry);
+                continue;
+            }
+
+            //
+            // Entries that were looked up again while inactive get promoted to
+            // the active list instead of being removed. A one-time scan never
+            // sets the referenced flag, so it cannot push the working set out.
+            //
+
+            if ((Flags & PAGE_CACHE_ENTRY_FLAG_REFERENCED) != 0) {
+                IopRemovePageCacheEntryFromList(CacheEntry);
+                RtlAtomicAnd32(&(CacheEntry->Flags),
+                               ~PAGE_CACHE_ENTRY_FLAG_REFERENCED);
+
+                IopInsertPageCacheEntryOnList(CacheEntry,
+                                              &IoPageCacheActiveList,
+                                              PAGE_CACHE_ENTRY_FLAG_ACTIVE);
+
+                IoPageCachePromotionCount += 1;
                 continue;
             }
         }
@@ -4381,10 +5172,12 @@ Return Value:
         Lock = FileObject->Lock;
         if (TimidEffort != FALSE) {
             if (KeTryToAcquireSharedExclusiveLockExclusive(Lock) == FALSE) {
-                LIST_REMOVE(&(CacheEntry->ListEntry));
+                IopRemovePageCacheEntryFromList(CacheEntry);
                 if (CacheEntry->Node.Parent != NULL) {
-                    INSERT_BEFORE(&(CacheEntry->ListEntry),
-                                  &IoPageCacheCleanList);
+                    IopInsertPageCacheEntryOnList(
+                                               CacheEntry,
+                                               &IoPageCacheInactiveList,
+                                               PAGE_CACHE_ENTRY_FLAG_INACTIVE);
 
                 } else {
                     INSERT_BEFORE(&(CacheEntry->ListEntry),
@@ -4491,6 +5284,7 @@ Return Value:
         // move it to the destroy list.
         //
 
+        ListFlag = 0;
         MoveList = NULL;
         if ((PageTakenDown != FALSE) &&
             (CacheEntry->ReferenceCount == 1)) {
@@ -4517,16 +5311,17 @@ Return Value:
 
         } else {
             if ((CacheEntry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0) {
-                MoveList = &IoPageCacheCleanList;
+                MoveList = &IoPageCacheInactiveList;
+                ListFlag = PAGE_CACHE_ENTRY_FLAG_INACTIVE;
             }
         }
 
         if (MoveList != NULL) {
             if (CacheEntry->ListEntry.Next != NULL) {
-                LIST_REMOVE(&(CacheEntry->ListEntry));
+                IopRemovePageCacheEntryFromList(CacheEntry);
             }
 
-            INSERT_BEFORE(&(CacheEntry->ListEntry), MoveList);
+            IopInsertPageCacheEntryOnList(CacheEntry, MoveList, ListFlag);
         }
 
         IoPageCacheEntryReleaseReference(CacheEntry);
@@ -4555,7 +5350,7 @@ Routine Description:
 
     This routine unmaps as many clean page cache entries as is necessary to
     bring the number of mapped page cache entries back down to a reasonable
-    level. It unmaps page cache entires in LRU order.
+    level. It unmaps entries from the inactive list in LRU order.
 
 Arguments:
 
@@ -4576,6 +5371,7 @@ Return Value:
     PLIST_ENTRY CurrentEntry;
     PFILE_OBJECT FileObject;
     UINTN FreeVirtualPages;
+    ULONG ListFlag;
     PSHARED_EXCLUSIVE_LOCK Lock;
     UINTN MappedCleanPageCount;
     PLIST_ENTRY MoveList;
@@ -4589,7 +5385,7 @@ Return Value:
 
     TargetUnmapCount = 0;
     FreeVirtualPages = -1;
-    if ((LIST_EMPTY(&IoPageCacheCleanList)) ||
+    if ((LIST_EMPTY(&IoPageCacheInactiveList)) ||
         (IopIsPageCacheTooMapped(&FreeVirtualPages) == FALSE)) {
 
         return;
@@ -4647,20 +5443,21 @@ Return Value:
     }
 
     //
-    // Iterate over the clean LRU page cache list trying to unmap page cache
+    // Iterate over the inactive page cache list trying to unmap page cache
     // entries. Stop as soon as the target count has been reached.
     //
 
+    IopBalancePageCacheLists(0);
     UnmapStart = NULL;
     UnmapSize = 0;
     UnmapCount = 0;
     PageSize = MmPageSize();
     KeAcquireQueuedLock(IoPageCacheListLock);
-    while ((!LIST_EMPTY(&IoPageCacheCleanList)) &&
+    while ((!LIST_EMPTY(&IoPageCacheInactiveList)) &&
            ((TargetUnmapCount != UnmapCount) ||
             (MmGetVirtualMemoryWarningLevel() != MemoryWarningLevelNone))) {
 
-        CurrentEntry = IoPageCacheCleanList.Next;
+        CurrentEntry = IoPageCacheInactiveList.Next;
         CacheEntry = LIST_VALUE(CurrentEntry, PAGE_CACHE_ENTRY, ListEntry);
 
         //
@@ -4669,8 +5466,7 @@ Return Value:
         //
 
         if (CacheEntry->ReferenceCount != 0) {
-            LIST_REMOVE(&(CacheEntry->ListEntry));
-            CacheEntry->ListEntry.Next = NULL;
+            IopRemovePageCacheEntryFromList(CacheEntry);
 
             //
             // Double check the reference count. If it dropped to zero while
@@ -4681,7 +5477,9 @@ Return Value:
 
             RtlMemoryBarrier();
             if (CacheEntry->ReferenceCount == 0) {
-                INSERT_BEFORE(&(CacheEntry->ListEntry), &IoPageCacheCleanList);
+                IopInsertPageCacheEntryOnList(CacheEntry,
+                                              &IoPageCacheInactiveList,
+                                              PAGE_CACHE_ENTRY_FLAG_INACTIVE);
             }
 
             continue;
@@ -4693,8 +5491,25 @@ Return Value:
         //
 
         if ((CacheEntry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) != 0) {
-            LIST_REMOVE(&(CacheEntry->ListEntry));
-            CacheEntry->ListEntry.Next = NULL;
+            IopRemovePageCacheEntryFromList(CacheEntry);
+            continue;
+        }
+
+        //
+        // Promote entries that were looked up again rather than unmapping
+        // them, the same as the physical trim does.
+        //
+
+        if ((CacheEntry->Flags & PAGE_CACHE_ENTRY_FLAG_REFERENCED) != 0) {
+            IopRemovePageCacheEntryFromList(CacheEntry);
+            RtlAtomicAnd32(&(CacheEntry->Flags),
+                           ~PAGE_CACHE_ENTRY_FLAG_REFERENCED);
+
+            IopInsertPageCacheEntryOnList(CacheEntry,
+                                          &IoPageCacheActiveList,
+                                          PAGE_CACHE_ENTRY_FLAG_ACTIVE);
+
+            IoPageCachePromotionCount += 1;
             continue;
         }
 
@@ -4708,9 +5523,10 @@ Return Value:
              (PAGE_CACHE_ENTRY_FLAG_MAPPED |
               PAGE_CACHE_ENTRY_FLAG_OWNER)) == PAGE_CACHE_ENTRY_FLAG_OWNER) {
 
-            LIST_REMOVE(&(CacheEntry->ListEntry));
-            INSERT_BEFORE(&(CacheEntry->ListEntry),
-                          &IoPageCacheCleanUnmappedList);
+            IopRemovePageCacheEntryFromList(CacheEntry);
+            IopInsertPageCacheEntryOnList(CacheEntry,
+                                          &IoPageCacheCleanUnmappedList,
+                                          PAGE_CACHE_ENTRY_FLAG_INACTIVE);
 
             continue;
         }
@@ -4727,8 +5543,11 @@ Return Value:
 
         if (TimidEffort != FALSE) {
             if (KeTryToAcquireSharedExclusiveLockExclusive(Lock) == FALSE) {
-                LIST_REMOVE(&(CacheEntry->ListEntry));
-                INSERT_BEFORE(&(CacheEntry->ListEntry), &ReturnList);
+                IopRemovePageCacheEntryFromList(CacheEntry);
+                IopInsertPageCacheEntryOnList(CacheEntry,
+                                              &ReturnList,
+                                              PAGE_CACHE_ENTRY_FLAG_INACTIVE);
+
                 continue;
             }
         }
@@ -4788,12 +5607,14 @@ Return Value:
         // does not get processed again in case it is still on the clean list.
         //
 
+        ListFlag = 0;
         MoveList = NULL;
         if (CacheEntry->Node.Parent == NULL) {
             MoveList = &IoPageCacheRemovalList;
 
         } else {
             if ((CacheEntry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0) {
+                ListFlag = PAGE_CACHE_ENTRY_FLAG_INACTIVE;
                 if (((CacheEntry->Flags & PAGE_CACHE_ENTRY_FLAG_MAPPED) == 0) &&
                     (CacheEntry->BackingEntry == NULL)) {
 
@@ -4807,10 +5628,10 @@ Return Value:
 
         if (MoveList != NULL) {
             if (CacheEntry->ListEntry.Next != NULL) {
-                LIST_REMOVE(&(CacheEntry->ListEntry));
+                IopRemovePageCacheEntryFromList(CacheEntry);
             }
 
-            INSERT_BEFORE(&(CacheEntry->ListEntry), MoveList);
+            IopInsertPageCacheEntryOnList(CacheEntry, MoveList, ListFlag);
         }
 
         IoPageCacheEntryReleaseReference(CacheEntry);
@@ -4818,11 +5639,12 @@ Return Value:
 
     //
     // Stick any entries whose locks couldn't be acquired back at the time
-    // back on the list.
+    // back on the list. They were counted as inactive when they went on the
+    // return list.
     //
 
     if (!LIST_EMPTY(&ReturnList)) {
-        APPEND_LIST(&ReturnList, &IoPageCacheCleanList);
+        APPEND_LIST(&ReturnList, &IoPageCacheInactiveList);
     }
 
     KeReleaseQueuedLock(IoPageCacheListLock);
@@ -5200,9 +6022,9 @@ IopUpdatePageCacheEntryList (
 
 Routine Description:
 
-    This routine updates a page cache entry's list entry by putting it on the
-    appropriate list. This should be used when a page cache entry is looked up
-    or when it is created.
+    This routine records a use of a page cache entry for the replacement
+    policy. This should be used when a page cache entry is looked up or when it
+    is created.
 
 Arguments:
 
@@ -5220,13 +6042,10 @@ Return Value:
 
 {
 
-    KeAcquireQueuedLock(IoPageCacheListLock);
-
     //
-    // If the page cache entry is not new, then it might already be on a
-    // list. If it's on a clean list, move it to the back. If it's clean
-    // and not on a list, then it probably got ripped off the list because
-    // there are references on it.
+    // A lookup just marks the entry referenced, without touching the list
+    // lock. The list scans promote or rotate referenced entries when they come
+    // across them.
     //
 
     if (Created == FALSE) {
@@ -5238,16 +6057,13 @@ Return Value:
         ASSERT(((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0) ||
                (Entry->ListEntry.Next != NULL));
 
-        if (((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0) &&
-            (Entry->ListEntry.Next != NULL)) {
-
-            LIST_REMOVE(&(Entry->ListEntry));
-            INSERT_BEFORE(&(Entry->ListEntry), &IoPageCacheCleanList);
+        if ((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_REFERENCED) == 0) {
+            RtlAtomicOr32(&(Entry->Flags), PAGE_CACHE_ENTRY_FLAG_REFERENCED);
         }
 
     //
-    // New pages do not start on a list. Stick it on the back of the clean
-    // list.
+    // New pages do not start on a list. Queue it for the back of the inactive
+    // list. The batch gets its own reference.
     //
 
     } else {
@@ -5255,58 +6071,467 @@ Return Value:
         ASSERT(Entry->ListEntry.Next == NULL);
         ASSERT((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0);
 
-        INSERT_BEFORE(&(Entry->ListEntry), &IoPageCacheCleanList);
+        IoPageCacheEntryAddReference(Entry);
+        IopQueuePageCacheListBatch(Entry);
     }
 
-    KeReleaseQueuedLock(IoPageCacheListLock);
     return;
 }
 
-BOOL
-IopIsPageCacheTooBig (
-    PUINTN FreePhysicalPages
+VOID
+IopRequeueMappedPageCacheEntry (
+    PPAGE_CACHE_ENTRY Entry
     )
 
 /*++
 
 Routine Description:
 
-    This routine determines if the page cache is too large given current
-    memory constraints.
+    This routine moves a clean inactive page cache entry that was just mapped
+    to the back of the inactive list, taking it off the clean unmapped list if
+    it was there. Active entries are left where they are.
 
 Arguments:
 
-    FreePhysicalPages - Supplies an optional pointer where the number of free
-        physical pages used at the time of computation will be returned. This
-        will only be returned if the page cache is reported to be too big.
+    Entry - Supplies a pointer to the page cache entry that was mapped.
 
 Return Value:
 
-    TRUE if the page cache is too big and should shrink.
-
-    FALSE if the page cache is too small or just right.
+    None.
 
 --*/
 
 {
 
-    UINTN FreePages;
-
-    //
-    // Don't let the page cache shrink too much. If it's already below the
-    // minimum just skip it (but leave the target remove count set so that
-    // paging out is requested). Otherwise, clip the remove count to avoid
-    // going below the minimum.
-    //
+    KeAcquireQueuedLock(IoPageCacheListLock);
+    if (((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0) &&
+        ((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_INACTIVE) != 0)) {
 
-    if (IoPageCachePhysicalPageCount <= IoPageCacheMinimumPages) {
-        return FALSE;
+        IopRemovePageCacheEntryFromList(Entry);
+        IopInsertPageCacheEntryOnList(Entry,
+                                      &IoPageCacheInactiveList,
+                                      PAGE_CACHE_ENTRY_FLAG_INACTIVE);
     }
 
-    //
-    // Get the current number of free pages in the system, and determine if the
-    // page cache still has room to grow.
-    //
+    KeReleaseQueuedLock(IoPageCacheListLock);
+    return;
+}
+
+VOID
+IopQueuePageCacheListBatch (
+    PPAGE_CACHE_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a page cache entry to the current processor's batch of
+    entries waiting to go on the inactive list. When the batch fills up, the
+    whole batch is put on the list with a single acquire of the list lock.
+    The list lock must not be held by the caller.
+
+Arguments:
+
+    Entry - Supplies a pointer to the page cache entry. The caller's reference
+        is transferred to the batch.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPAGE_CACHE_LIST_BATCH Batch;
+    ULONG Count;
+    PPAGE_CACHE_ENTRY Entries[PAGE_CACHE_LIST_BATCH_SIZE];
+    RUNLEVEL OldRunLevel;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+
+    Count = 0;
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    Batch = &(IoPageCacheListBatches[KeGetCurrentProcessorNumber() %
+                                     IoPageCacheListBatchCount]);
+
+    KeAcquireSpinLock(&(Batch->Lock));
+
+    ASSERT(Batch->Count < PAGE_CACHE_LIST_BATCH_SIZE);
+
+    Batch->Entries[Batch->Count] = Entry;
+    Batch->Count += 1;
+    if (Batch->Count == PAGE_CACHE_LIST_BATCH_SIZE) {
+        Count = Batch->Count;
+        RtlCopyMemory(Entries,
+                      Batch->Entries,
+                      Count * sizeof(PPAGE_CACHE_ENTRY));
+
+        Batch->Count = 0;
+    }
+
+    KeReleaseSpinLock(&(Batch->Lock));
+    KeLowerRunLevel(OldRunLevel);
+    if (Count != 0) {
+        IopProcessPageCacheListBatch(Entries, Count);
+    }
+
+    return;
+}
+
+VOID
+IopDrainPageCacheListBatches (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine empties every processor's batch of page cache entries onto
+    the inactive list.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPAGE_CACHE_LIST_BATCH Batch;
+    ULONG BatchIndex;
+    ULONG Count;
+    PPAGE_CACHE_ENTRY Entries[PAGE_CACHE_LIST_BATCH_SIZE];
+    RUNLEVEL OldRunLevel;
+
+    for (BatchIndex = 0;
+         BatchIndex < IoPageCacheListBatchCount;
+         BatchIndex += 1) {
+
+        Batch = &(IoPageCacheListBatches[BatchIndex]);
+        if (Batch->Count == 0) {
+            continue;
+        }
+
+        OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+        KeAcquireSpinLock(&(Batch->Lock));
+        Count = Batch->Count;
+        RtlCopyMemory(Entries,
+                      Batch->Entries,
+                      Count * sizeof(PPAGE_CACHE_ENTRY));
+
+        Batch->Count = 0;
+        KeReleaseSpinLock(&(Batch->Lock));
+        KeLowerRunLevel(OldRunLevel);
+        if (Count != 0) {
+            IopProcessPageCacheListBatch(Entries, Count);
+        }
+    }
+
+    return;
+}
+
+VOID
+IopProcessPageCacheListBatch (
+    PPAGE_CACHE_ENTRY *Entries,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine puts a batch of page cache entries on the inactive list and
+    releases the references the batch held on them.
+
+Arguments:
+
+    Entries - Supplies an array of page cache entries, each with a reference
+        owned by the batch.
+
+    Count - Supplies the number of entries in the array.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPAGE_CACHE_ENTRY Entry;
+    ULONG Index;
+
+    KeAcquireQueuedLock(IoPageCacheListLock);
+    for (Index = 0; Index < Count; Index += 1) {
+        Entry = Entries[Index];
+
+        //
+        // Anything that got put on a list or dirtied while waiting in the
+        // batch is already where it belongs. Evicted entries cannot have been
+        // destroyed with the batch's reference held, so send them to the
+        // removal list.
+        //
+
+        if ((Entry->ListEntry.Next != NULL) ||
+            ((Entry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) != 0)) {
+
+            continue;
+        }
+
+        if (Entry->Node.Parent != NULL) {
+            IopInsertPageCacheEntryOnList(Entry,
+                                          &IoPageCacheInactiveList,
+                                          PAGE_CACHE_ENTRY_FLAG_INACTIVE);
+
+        } else {
+            INSERT_BEFORE(&(Entry->ListEntry), &IoPageCacheRemovalList);
+        }
+    }
+
+    KeReleaseQueuedLock(IoPageCacheListLock);
+
+    //
+    // Now that the entries are on lists, releasing the references will not
+    // queue them again.
+    //
+
+    for (Index = 0; Index < Count; Index += 1) {
+        IoPageCacheEntryReleaseReference(Entries[Index]);
+    }
+
+    return;
+}
+
+VOID
+IopInsertPageCacheEntryOnList (
+    PPAGE_CACHE_ENTRY Entry,
+    PLIST_ENTRY ListHead,
+    ULONG ListFlag
+    )
+
+/*++
+
+Routine Description:
+
+    This routine puts a page cache entry at the back of the given list. The
+    list lock must be held and the entry must not be on a list.
+
+Arguments:
+
+    Entry - Supplies a pointer to the page cache entry.
+
+    ListHead - Supplies a pointer to the head of the list.
+
+    ListFlag - Supplies PAGE_CACHE_ENTRY_FLAG_ACTIVE if the list is the active
+        list, PAGE_CACHE_ENTRY_FLAG_INACTIVE if the entries on the list count
+        as inactive, or 0 otherwise.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT(KeIsQueuedLockHeld(IoPageCacheListLock) != FALSE);
+    ASSERT(Entry->ListEntry.Next == NULL);
+    ASSERT((Entry->Flags & (PAGE_CACHE_ENTRY_FLAG_ACTIVE |
+                            PAGE_CACHE_ENTRY_FLAG_INACTIVE)) == 0);
+
+    INSERT_BEFORE(&(Entry->ListEntry), ListHead);
+    if (ListFlag != 0) {
+        RtlAtomicOr32(&(Entry->Flags), ListFlag);
+        if (ListFlag == PAGE_CACHE_ENTRY_FLAG_ACTIVE) {
+            IoPageCacheActivePageCount += 1;
+
+        } else {
+
+            ASSERT(ListFlag == PAGE_CACHE_ENTRY_FLAG_INACTIVE);
+
+            IoPageCacheInactivePageCount += 1;
+        }
+    }
+
+    return;
+}
+
+VOID
+IopRemovePageCacheEntryFromList (
+    PPAGE_CACHE_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine takes a page cache entry off whatever list it is on. The list
+    lock must be held.
+
+Arguments:
+
+    Entry - Supplies a pointer to the page cache entry.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG OldFlags;
+
+    ASSERT(KeIsQueuedLockHeld(IoPageCacheListLock) != FALSE);
+    ASSERT(Entry->ListEntry.Next != NULL);
+
+    LIST_REMOVE(&(Entry->ListEntry));
+    Entry->ListEntry.Next = NULL;
+    if ((Entry->Flags & (PAGE_CACHE_ENTRY_FLAG_ACTIVE |
+                         PAGE_CACHE_ENTRY_FLAG_INACTIVE)) != 0) {
+
+        OldFlags = RtlAtomicAnd32(&(Entry->Flags),
+                                  ~(PAGE_CACHE_ENTRY_FLAG_ACTIVE |
+                                    PAGE_CACHE_ENTRY_FLAG_INACTIVE));
+
+        if ((OldFlags & PAGE_CACHE_ENTRY_FLAG_ACTIVE) != 0) {
+            IoPageCacheActivePageCount -= 1;
+
+        } else {
+            IoPageCacheInactivePageCount -= 1;
+        }
+    }
+
+    return;
+}
+
+VOID
+IopBalancePageCacheLists (
+    UINTN DemoteCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine moves entries from the front of the active list to the back
+    of the inactive list until the active list is back within its share of
+    the cache. Active entries that were referenced since they were last seen
+    get another trip around the active list instead.
+
+Arguments:
+
+    DemoteCount - Supplies the number of entries that must be demoted
+        regardless of the list sizes, because the inactive lists could not
+        satisfy a trim. Referenced entries are not spared when this is nonzero.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPAGE_CACHE_ENTRY CacheEntry;
+    ULONG OldFlags;
+    UINTN ScanCount;
+
+    KeAcquireQueuedLock(IoPageCacheListLock);
+    ScanCount = IoPageCacheActivePageCount;
+    while ((ScanCount != 0) && (!LIST_EMPTY(&IoPageCacheActiveList))) {
+        if ((DemoteCount == 0) &&
+            (IoPageCacheActivePageCount <=
+             (IoPageCacheInactivePageCount * PAGE_CACHE_ACTIVE_LIST_RATIO))) {
+
+            break;
+        }
+
+        ScanCount -= 1;
+        CacheEntry = LIST_VALUE(IoPageCacheActiveList.Next,
+                                PAGE_CACHE_ENTRY,
+                                ListEntry);
+
+        IopRemovePageCacheEntryFromList(CacheEntry);
+        OldFlags = RtlAtomicAnd32(&(CacheEntry->Flags),
+                                  ~PAGE_CACHE_ENTRY_FLAG_REFERENCED);
+
+        if (((OldFlags & PAGE_CACHE_ENTRY_FLAG_REFERENCED) != 0) &&
+            (DemoteCount == 0)) {
+
+            IopInsertPageCacheEntryOnList(CacheEntry,
+                                          &IoPageCacheActiveList,
+                                          PAGE_CACHE_ENTRY_FLAG_ACTIVE);
+
+            continue;
+        }
+
+        IopInsertPageCacheEntryOnList(CacheEntry,
+                                      &IoPageCacheInactiveList,
+                                      PAGE_CACHE_ENTRY_FLAG_INACTIVE);
+
+        IoPageCacheDemotionCount += 1;
+        if (DemoteCount != 0) {
+            DemoteCount -= 1;
+        }
+    }
+
+    KeReleaseQueuedLock(IoPageCacheListLock);
+    return;
+}
+
+BOOL
+IopIsPageCacheTooBig (
+    PUINTN FreePhysicalPages
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines if the page cache is too large given current
+    memory constraints.
+
+Arguments:
+
+    FreePhysicalPages - Supplies an optional pointer where the number of free
+        physical pages used at the time of computation will be returned. This
+        will only be returned if the page cache is reported to be too big.
+
+Return Value:
+
+    TRUE if the page cache is too big and should shrink.
+
+    FALSE if the page cache is too small or just right.
+
+--*/
+
+{
+
+    UINTN FreePages;
+
+    //
+    // Don't let the page cache shrink too much. If it's already below the
+    // minimum just skip it (but leave the target remove count set so that
+    // paging out is requested). Otherwise, clip the remove count to avoid
+    // going below the minimum.
+    //
+
+    if (IoPageCachePhysicalPageCount <= IoPageCacheMinimumPages) {
+        return FALSE;
+    }
+
+    //
+    // Get the current number of free pages in the system, and determine if the
+    // page cache still has room to grow.
+    //
 
     FreePages = MmGetTotalFreePhysicalPages();
     if (FreePages > IoPageCacheHeadroomPagesTrigger) {
@@ -5457,3 +6682,248 @@ Return Value:
     return;
 }
 
+VOID
+IopPrefetchPageCache (
+    PIO_HANDLE Handle,
+    IO_OFFSET Offset,
+    ULONGLONG Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads the given region of a file into the page cache so that
+    later accesses to it hit in the cache. Prefetching is only a hint, so it
+    quietly stops early on any failure or if memory gets tight.
+
+Arguments:
+
+    Handle - Supplies an open I/O handle for the file or device.
+
+    Offset - Supplies the offset from the beginning of the file or device of
+        the region to prefetch.
+
+    Size - Supplies the size, in bytes, of the region to prefetch. Supply -1
+        to prefetch through the end of the file.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN BytesRead;
+    IO_OFFSET End;
+    PFILE_OBJECT FileObject;
+    IO_OFFSET FileSize;
+    PIO_BUFFER IoBuffer;
+    ULONG PageSize;
+    UINTN ReadSize;
+    KSTATUS Status;
+
+    FileObject = Handle->FileObject;
+    FileSize = FileObject->Properties.Size;
+    if (Offset >= FileSize) {
+        return;
+    }
+
+    End = FileSize;
+    if (Size < (ULONGLONG)(FileSize - Offset)) {
+        End = Offset + Size;
+    }
+
+    PageSize = MmPageSize();
+    Offset = ALIGN_RANGE_DOWN(Offset, PageSize);
+    while (Offset < End) {
+        if (MmGetPhysicalMemoryWarningLevel() != MemoryWarningLevelNone) {
+            break;
+        }
+
+        ReadSize = IO_READ_AHEAD_SIZE;
+        if ((End - Offset) < ReadSize) {
+            ReadSize = ALIGN_RANGE_UP(End - Offset, PageSize);
+        }
+
+        //
+        // Read into an I/O buffer with no pages of its own. The cached read
+        // fills it with page cache entries, which are released again when
+        // the buffer is freed.
+        //
+
+        IoBuffer = MmAllocateUninitializedIoBuffer(ReadSize, 0);
+        if (IoBuffer == NULL) {
+            break;
+        }
+
+        Status = IoReadAtOffset(Handle,
+                                IoBuffer,
+                                Offset,
+                                ReadSize,
+                                0,
+                                WAIT_TIME_INDEFINITE,
+                                &BytesRead,
+                                NULL);
+
+        MmFreeIoBuffer(IoBuffer);
+        if ((!KSUCCESS(Status)) || (BytesRead == 0)) {
+            break;
+        }
+
+        Offset += ReadSize;
+    }
+
+    return;
+}
+
+VOID
+IopDropPageCacheEntries (
+    PFILE_OBJECT FileObject,
+    IO_OFFSET Offset,
+    ULONGLONG Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes the clean, unused page cache entries that lie
+    entirely within the given region of a file object. Dirty entries and
+    entries that are in use are left alone. The file object lock must be held
+    exclusively.
+
+Arguments:
+
+    FileObject - Supplies a pointer to the file object.
+
+    Offset - Supplies the offset from the beginning of the file or device of
+        the region to drop.
+
+    Size - Supplies the size, in bytes, of the region to drop. Supply -1 to
+        drop through the end of the file.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPAGE_CACHE_ENTRY CacheEntry;
+    LIST_ENTRY DestroyListHead;
+    IO_OFFSET End;
+    ULONG ListFlag;
+    PLIST_ENTRY MoveList;
+    PRED_BLACK_TREE_NODE Node;
+    ULONG PageSize;
+    BOOL PageTakenDown;
+    PAGE_CACHE_ENTRY SearchEntry;
+    KSTATUS Status;
+
+    ASSERT(KeIsSharedExclusiveLockHeldExclusive(FileObject->Lock) != FALSE);
+
+    if (RED_BLACK_TREE_EMPTY(&(FileObject->PageCacheTree)) != FALSE) {
+        return;
+    }
+
+    End = Offset + Size;
+    if ((Size == (ULONGLONG)-1) || (End < Offset)) {
+        End = MAX_LONGLONG;
+    }
+
+    INITIALIZE_LIST_HEAD(&DestroyListHead);
+    PageSize = MmPageSize();
+    SearchEntry.FileObject = FileObject;
+    SearchEntry.Offset = Offset;
+    SearchEntry.Flags = 0;
+    Node = RtlRedBlackTreeSearchClosest(&(FileObject->PageCacheTree),
+                                        &(SearchEntry.Node),
+                                        TRUE);
+
+    while (Node != NULL) {
+        CacheEntry = LIST_VALUE(Node, PAGE_CACHE_ENTRY, Node);
+        if ((End - PageSize) < CacheEntry->Offset) {
+            break;
+        }
+
+        Node = RtlRedBlackTreeGetNextNode(&(FileObject->PageCacheTree),
+                                          FALSE,
+                                          Node);
+
+        if ((CacheEntry->ReferenceCount != 0) ||
+            ((CacheEntry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) != 0)) {
+
+            continue;
+        }
+
+        //
+        // Take a reference so the entry doesn't get pulled off its list, then
+        // unmap it from any image sections. Only take it out of the tree if
+        // that left this thread with the only reference and it is still
+        // clean.
+        //
+
+        IoPageCacheEntryAddReference(CacheEntry);
+        PageTakenDown = FALSE;
+        if (CacheEntry->ReferenceCount == 1) {
+            Status = IopUnmapPageCacheEntrySections(CacheEntry);
+            if ((KSUCCESS(Status)) &&
+                (IS_HARD_FLUSH_REQUIRED(CacheEntry->Flags) == FALSE) &&
+                ((CacheEntry->Flags & PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0)) {
+
+                IopRemovePageCacheEntryFromTree(CacheEntry);
+                RtlAtomicAnd32(&(CacheEntry->Flags),
+                               ~PAGE_CACHE_ENTRY_FLAG_WAS_DIRTY);
+
+                PageTakenDown = TRUE;
+            }
+        }
+
+        //
+        // Move the entry to the right list while the list lock is held, as
+        // releasing the reference would otherwise try to put a clean entry
+        // back on a list itself.
+        //
+
+        ListFlag = 0;
+        MoveList = NULL;
+        KeAcquireQueuedLock(IoPageCacheListLock);
+        if (PageTakenDown != FALSE) {
+            if (CacheEntry->ReferenceCount == 1) {
+                MoveList = &DestroyListHead;
+
+            } else {
+                MoveList = &IoPageCacheRemovalList;
+            }
+
+        } else if (((CacheEntry->Flags &
+                     PAGE_CACHE_ENTRY_FLAG_DIRTY_MASK) == 0) &&
+                   (CacheEntry->ListEntry.Next == NULL)) {
+
+            MoveList = &IoPageCacheInactiveList;
+            ListFlag = PAGE_CACHE_ENTRY_FLAG_INACTIVE;
+        }
+
+        if (MoveList != NULL) {
+            if (CacheEntry->ListEntry.Next != NULL) {
+                IopRemovePageCacheEntryFromList(CacheEntry);
+            }
+
+            IopInsertPageCacheEntryOnList(CacheEntry, MoveList, ListFlag);
+        }
+
+        IoPageCacheEntryReleaseReference(CacheEntry);
+        KeReleaseQueuedLock(IoPageCacheListLock);
+    }
+
+    IopDestroyPageCacheEntries(&DestroyListHead);
+    if (LIST_EMPTY(&IoPageCacheRemovalList) == FALSE) {
+        IopSchedulePageCacheThread();
+    }
+
+    return;
+}
+
@@ -58,6 +58,34 @@ Module Name:
 
 #define PATH_UNREACHABLE_PATH_PREFIX "(unreachable)/"
 
+//
+// Define the bounds on the number of buckets in the path entry hash table.
+// The table is sized at boot from the path entry cache limit, aiming for a
+// handful of entries per bucket when the cache is full.
+//
+
+#define PATH_ENTRY_HASH_MIN_BUCKETS 1024
+#define PATH_ENTRY_HASH_MAX_BUCKETS 32768
+#define PATH_ENTRY_HASH_ENTRIES_PER_BUCKET 8
+
+//
+// Define the number of locks protecting the path entry hash buckets. Buckets
+// share locks round robin.
+//
+
+#define PATH_ENTRY_HASH_LOCK_COUNT 64
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro returns the lock protecting the given hash bucket index.
+//
+
+#define PATH_ENTRY_HASH_LOCK(_BucketIndex) \
+    (IoPathEntryHashLocks[(_BucketIndex) & (PATH_ENTRY_HASH_LOCK_COUNT - 1)])
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -117,6 +145,31 @@ IopFindPathPoint (
     PPATH_POINT Result
     );
 
+BOOL
+IopFindPathPointWithoutLock (
+    PPATH_POINT Parent,
+    ULONG OpenFlags,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash,
+    PPATH_POINT Result
+    );
+
+PPATH_ENTRY
+IopFindPathEntryInHash (
+    PPATH_ENTRY Parent,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash,
+    UINTN BucketIndex
+    );
+
+UINTN
+IopGetPathEntryHashBucket (
+    PPATH_ENTRY Parent,
+    ULONG Hash
+    );
+
 VOID
 IopPathEntryReleaseReference (
     PPATH_ENTRY Entry,
@@ -159,6 +212,15 @@ LIST_ENTRY IoPathEntryList;
 UINTN IoPathEntryListSize;
 UINTN IoPathEntryListMaxSize;
 
+//
+// Store the hash table of linked path entries, keyed by parent and name hash,
+// along with the locks protecting its buckets.
+//
+
+PLIST_ENTRY IoPathEntryHashTable;
+UINTN IoPathEntryHashMask;
+PQUEUED_LOCK IoPathEntryHashLocks[PATH_ENTRY_HASH_LOCK_COUNT];
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -443,8 +505,11 @@ Return Value:
 
 {
 
+    UINTN BucketCount;
+    UINTN BucketIndex;
     BOOL Created;
     PFILE_OBJECT FileObject;
+    UINTN LockIndex;
     ULONGLONG MaxMemory;
     PPATH_ENTRY PathEntry;
     FILE_PROPERTIES Properties;
@@ -473,6 +538,42 @@ Return Value:
                                PATH_ENTRY_CACHE_MAX_MEMORY_PERCENT) / 100) /
                              sizeof(PATH_ENTRY);
 
+    //
+    // Create the path entry hash table.
+    //
+
+    BucketCount = PATH_ENTRY_HASH_MIN_BUCKETS;
+    while ((BucketCount < PATH_ENTRY_HASH_MAX_BUCKETS) &&
+           (BucketCount * PATH_ENTRY_HASH_ENTRIES_PER_BUCKET <
+            IoPathEntryListMaxSize)) {
+
+        BucketCount <<= 1;
+    }
+
+    IoPathEntryHashTable = MmAllocatePagedPool(BucketCount * sizeof(LIST_ENTRY),
+                                               PATH_ALLOCATION_TAG);
+
+    if (IoPathEntryHashTable == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto InitializePathSupportEnd;
+    }
+
+    for (BucketIndex = 0; BucketIndex < BucketCount; BucketIndex += 1) {
+        INITIALIZE_LIST_HEAD(&(IoPathEntryHashTable[BucketIndex]));
+    }
+
+    IoPathEntryHashMask = BucketCount - 1;
+    for (LockIndex = 0;
+         LockIndex < PATH_ENTRY_HASH_LOCK_COUNT;
+         LockIndex += 1) {
+
+        IoPathEntryHashLocks[LockIndex] = KeCreateQueuedLock();
+        if (IoPathEntryHashLocks[LockIndex] == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto InitializePathSupportEnd;
+        }
+    }
+
     RootObject = ObGetRootObject();
     IopFillOutFilePropertiesForObject(&Properties, RootObject);
     Status = IopCreateOrLookupFileObject(&Properties,
@@ -504,6 +605,21 @@ Return Value:
             IoPathEntryListLock = NULL;
         }
 
+        for (LockIndex = 0;
+             LockIndex < PATH_ENTRY_HASH_LOCK_COUNT;
+             LockIndex += 1) {
+
+            if (IoPathEntryHashLocks[LockIndex] != NULL) {
+                KeDestroyQueuedLock(IoPathEntryHashLocks[LockIndex]);
+                IoPathEntryHashLocks[LockIndex] = NULL;
+            }
+        }
+
+        if (IoPathEntryHashTable != NULL) {
+            MmFreePagedPool(IoPathEntryHashTable);
+            IoPathEntryHashTable = NULL;
+        }
+
         if (RootObject != NULL) {
             ObReleaseReference(RootObject);
         }
@@ -1025,6 +1141,50 @@ Return Value:
     return FALSE;
 }
 
+VOID
+IopPathLink (
+    PPATH_ENTRY Entry
+    )
+
+/*++
+
+Routine Description:
+
+    This routine links the given path entry into the path hierarchy, making it
+    visible to lookups in its parent. The caller must hold the parent path
+    entry's file object lock exclusively.
+
+Arguments:
+
+    Entry - Supplies a pointer to the path entry to link. It must have a
+        parent and must not already be linked.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN BucketIndex;
+    PQUEUED_LOCK Lock;
+
+    ASSERT(Entry->Parent != NULL);
+    ASSERT(Entry->SiblingListEntry.Next == NULL);
+    ASSERT(Entry->HashListEntry.Next == NULL);
+
+    INSERT_BEFORE(&(Entry->SiblingListEntry), &(Entry->Parent->ChildList));
+    BucketIndex = IopGetPathEntryHashBucket(Entry->Parent, Entry->Hash);
+    Lock = PATH_ENTRY_HASH_LOCK(BucketIndex);
+    KeAcquireQueuedLock(Lock);
+    INSERT_BEFORE(&(Entry->HashListEntry),
+                  &(IoPathEntryHashTable[BucketIndex]));
+
+    KeReleaseQueuedLock(Lock);
+    return;
+}
+
 VOID
 IopPathUnlink (
     PPATH_ENTRY Entry
@@ -1051,6 +1211,9 @@ Return Value:
 
 {
 
+    UINTN BucketIndex;
+    PQUEUED_LOCK Lock;
+
     ASSERT(Entry->Parent != NULL);
 
     //
@@ -1064,6 +1227,15 @@ Return Value:
         Entry->SiblingListEntry.Next = NULL;
     }
 
+    if (Entry->HashListEntry.Next != NULL) {
+        BucketIndex = IopGetPathEntryHashBucket(Entry->Parent, Entry->Hash);
+        Lock = PATH_ENTRY_HASH_LOCK(BucketIndex);
+        KeAcquireQueuedLock(Lock);
+        LIST_REMOVE(&(Entry->HashListEntry));
+        Entry->HashListEntry.Next = NULL;
+        KeReleaseQueuedLock(Lock);
+    }
+
     return;
 }
 
@@ -1742,24 +1914,37 @@ Return Value:
     }
 
     //
-    // First cruise through the cached list looking for this entry. Successful
-    // return adds a reference to the found entry.
+    // First look for the entry in the cache. Successful return adds a
+    // reference to the found entry. Most lookups of entries already in use
+    // can be satisfied without touching the directory lock at all.
     //
 
+    Hash = IopHashPathString(Name, NameSize);
+    FoundPathPoint = FALSE;
     if (DirectoryLockHeld == FALSE) {
-        KeAcquireSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        FoundPathPoint = IopFindPathPointWithoutLock(Directory,
+                                                     OpenFlags,
+                                                     Name,
+                                                     NameSize,
+                                                     Hash,
+                                                     Result);
     }
 
-    Hash = IopHashPathString(Name, NameSize);
-    FoundPathPoint = IopFindPathPoint(Directory,
-                                      OpenFlags,
-                                      Name,
-                                      NameSize,
-                                      Hash,
-                                      Result);
+    if (FoundPathPoint == FALSE) {
+        if (DirectoryLockHeld == FALSE) {
+            KeAcquireSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        }
 
-    if (DirectoryLockHeld == FALSE) {
-        KeReleaseSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        FoundPathPoint = IopFindPathPoint(Directory,
+                                          OpenFlags,
+                                          Name,
+                                          NameSize,
+                                          Hash,
+                                          Result);
+
+        if (DirectoryLockHeld == FALSE) {
+            KeReleaseSharedExclusiveLockShared(DirectoryFileObject->Lock);
+        }
     }
 
     if (FoundPathPoint != FALSE) {
@@ -3183,9 +3368,7 @@ Return Value:
         ASSERT((FileObject == NULL) ||
                (FileObject->Properties.HardLinkCount != 0));
 
-        INSERT_BEFORE(&(PathEntry->SiblingListEntry),
-                      &(DirectoryEntry->ChildList));
-
+        IopPathLink(PathEntry);
         Result->PathEntry = PathEntry;
         IoMountPointAddReference(Directory->MountPoint);
         Result->MountPoint = Directory->MountPoint;
@@ -3394,10 +3577,10 @@ IopFindPathPoint (
 
 Routine Description:
 
-    This routine loops through the given path point's child path entries
-    looking for a child with the given name. It follows any mount points it
-    encounters unless the open flags specify otherwise. This routine assumes
-    the parent's file object lock is held.
+    This routine searches the path entry hash for a child of the given path
+    point with the given name. It follows any mount points it encounters
+    unless the open flags specify otherwise. This routine assumes the parent's
+    file object lock is held.
 
 Arguments:
 
@@ -3427,10 +3610,11 @@ Return Value:
 
 {
 
-    PLIST_ENTRY CurrentEntry;
+    UINTN BucketIndex;
     PPATH_ENTRY Entry;
     PMOUNT_POINT FoundMountPoint;
     PPATH_ENTRY FoundPathEntry;
+    PQUEUED_LOCK Lock;
     PFILE_OBJECT ParentFileObject;
     BOOL ResultValid;
 
@@ -3441,29 +3625,21 @@ Return Value:
     ASSERT(KeIsSharedExclusiveLockHeld(ParentFileObject->Lock) != FALSE);
 
     //
-    // Cruise through the cached list looking for this entry.
+    // The bucket lock only guards the walk of the bucket. Once found, the
+    // entry cannot be unlinked or destroyed while the parent's lock is held.
     //
 
-    CurrentEntry = Parent->PathEntry->ChildList.Next;
-    while (CurrentEntry != &(Parent->PathEntry->ChildList)) {
-        Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, SiblingListEntry);
-        CurrentEntry = CurrentEntry->Next;
-
-        //
-        // Quickly skip entries without a name or with the wrong hash.
-        //
+    BucketIndex = IopGetPathEntryHashBucket(Parent->PathEntry, Hash);
+    Lock = PATH_ENTRY_HASH_LOCK(BucketIndex);
+    KeAcquireQueuedLock(Lock);
+    Entry = IopFindPathEntryInHash(Parent->PathEntry,
+                                   Name,
+                                   NameSize,
+                                   Hash,
+                                   BucketIndex);
 
-        if ((Entry->Hash != Hash) || (Entry->Name == NULL)) {
-            continue;
-        }
-
-        //
-        // If the names are not equal, this isn't the winner.
-        //
-
-        if (IopArePathsEqual(Entry->Name, Name, NameSize) == FALSE) {
-            continue;
-        }
+    KeReleaseQueuedLock(Lock);
+    if (Entry != NULL) {
 
         //
         // If the found entry is a mount point, then the parent mount point's
@@ -3499,12 +3675,232 @@ Return Value:
         Result->PathEntry = FoundPathEntry;
         Result->MountPoint = FoundMountPoint;
         ResultValid = TRUE;
-        break;
     }
 
     return ResultValid;
 }
 
+BOOL
+IopFindPathPointWithoutLock (
+    PPATH_POINT Parent,
+    ULONG OpenFlags,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash,
+    PPATH_POINT Result
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to find a child of the given path point without
+    acquiring the parent's file object lock. It only succeeds for entries
+    that already have a reference and that are not mount points (or whose
+    mount points are not to be followed). Anything else is left to
+    IopFindPathPoint.
+
+Arguments:
+
+    Parent - Supplies a pointer to the parent path point whose children should
+        be searched. The caller must have a reference on it.
+
+    OpenFlags - Supplies a bitfield of flags governing the behavior of the
+        search. See OPEN_FLAG_* definitions.
+
+    Name - Supplies a pointer the query string, which may not be null
+        terminated.
+
+    NameSize - Supplies the size of the string including the assumed null
+        terminator that is never checked.
+
+    Hash - Supplies the hash of the name query string.
+
+    Result - Supplies a pointer to a path point that receives the found path
+        entry and associated mount point on success. References are taken on
+        both elements if found.
+
+Return Value:
+
+    Returns TRUE if a matching path point was found, or FALSE if the caller
+    should search again with the parent's lock held.
+
+--*/
+
+{
+
+    UINTN BucketIndex;
+    PPATH_ENTRY Entry;
+    PQUEUED_LOCK Lock;
+    ULONG OldReferenceCount;
+    ULONG ReferenceCount;
+
+    ASSERT(NameSize != 0);
+
+    BucketIndex = IopGetPathEntryHashBucket(Parent->PathEntry, Hash);
+    Lock = PATH_ENTRY_HASH_LOCK(BucketIndex);
+    KeAcquireQueuedLock(Lock);
+    Entry = IopFindPathEntryInHash(Parent->PathEntry,
+                                   Name,
+                                   NameSize,
+                                   Hash,
+                                   BucketIndex);
+
+    if ((Entry == NULL) ||
+        ((Entry->MountCount != 0) &&
+         ((OpenFlags & OPEN_FLAG_NO_MOUNT_POINT) == 0))) {
+
+        KeReleaseQueuedLock(Lock);
+        return FALSE;
+    }
+
+    //
+    // Without the parent's lock, an entry whose count has hit zero may be on
+    // its way to destruction. Only take a reference if someone else already
+    // holds one. Entries can't be freed while they're in the hash, and they
+    // can't leave the hash without this lock.
+    //
+
+    ReferenceCount = Entry->ReferenceCount;
+    while (ReferenceCount != 0) {
+        OldReferenceCount = RtlAtomicCompareExchange32(&(Entry->ReferenceCount),
+                                                       ReferenceCount + 1,
+                                                       ReferenceCount);
+
+        if (OldReferenceCount == ReferenceCount) {
+            break;
+        }
+
+        ReferenceCount = OldReferenceCount;
+    }
+
+    KeReleaseQueuedLock(Lock);
+    if (ReferenceCount == 0) {
+        return FALSE;
+    }
+
+    ASSERT(ReferenceCount < 0x10000000);
+
+    Result->PathEntry = Entry;
+    Result->MountPoint = Parent->MountPoint;
+    IoMountPointAddReference(Result->MountPoint);
+    return TRUE;
+}
+
+PPATH_ENTRY
+IopFindPathEntryInHash (
+    PPATH_ENTRY Parent,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG Hash,
+    UINTN BucketIndex
+    )
+
+/*++
+
+Routine Description:
+
+    This routine searches a path entry hash bucket for the child of the given
+    parent with the given name. This routine assumes the bucket's lock is
+    held.
+
+Arguments:
+
+    Parent - Supplies a pointer to the parent path entry.
+
+    Name - Supplies a pointer the query string, which may not be null
+        terminated.
+
+    NameSize - Supplies the size of the string including the assumed null
+        terminator that is never checked.
+
+    Hash - Supplies the hash of the name query string.
+
+    BucketIndex - Supplies the index of the bucket to search.
+
+Return Value:
+
+    Returns a pointer to the matching path entry, without a reference.
+
+    NULL if no entry matches.
+
+--*/
+
+{
+
+    PLIST_ENTRY Bucket;
+    PLIST_ENTRY CurrentEntry;
+    PPATH_ENTRY Entry;
+
+    ASSERT(KeIsQueuedLockHeld(PATH_ENTRY_HASH_LOCK(BucketIndex)) != FALSE);
+
+    Bucket = &(IoPathEntryHashTable[BucketIndex]);
+    CurrentEntry = Bucket->Next;
+    while (CurrentEntry != Bucket) {
+        Entry = LIST_VALUE(CurrentEntry, PATH_ENTRY, HashListEntry);
+        CurrentEntry = CurrentEntry->Next;
+
+        //
+        // Quickly skip entries of other directories, without a name, or with
+        // the wrong hash.
+        //
+
+        if ((Entry->Parent != Parent) ||
+            (Entry->Hash != Hash) ||
+            (Entry->Name == NULL)) {
+
+            continue;
+        }
+
+        if (IopArePathsEqual(Entry->Name, Name, NameSize) != FALSE) {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+UINTN
+IopGetPathEntryHashBucket (
+    PPATH_ENTRY Parent,
+    ULONG Hash
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the path entry hash bucket for the given parent and
+    name hash.
+
+Arguments:
+
+    Parent - Supplies a pointer to the parent path entry.
+
+    Hash - Supplies the hash of the child's name.
+
+Return Value:
+
+    Returns the bucket index.
+
+--*/
+
+{
+
+    UINTN Key;
+
+    //
+    // Mix the parent's address in so that common names like "bin" spread out
+    // across directories. The low bits of a pool address carry little
+    // information.
+    //
+
+    Key = ((UINTN)Parent >> 4) * 0x9E3779B1;
+    Key ^= Hash;
+    Key ^= Key >> 16;
+    return Key & IoPathEntryHashMask;
+}
+
 VOID
 IopPathEntryReleaseReference (
     PPATH_ENTRY Entry,
@@ -3776,10 +4172,7 @@ Return Value:
         // entries.
         //
 
-        if (Entry->SiblingListEntry.Next != NULL) {
-            LIST_REMOVE(&(Entry->SiblingListEntry));
-            Entry->SiblingListEntry.Next = NULL;
-        }
+        IopPathUnlink(Entry);
 
         ASSERT(ParentFileObject != NULL);
 
@@ -106,6 +106,15 @@ IopDestroyPipe (
     PVOID PipeObject
     );
 
+KSTATUS
+IopSplicePipeBuffer (
+    PPIPE Pipe,
+    PVOID Buffer,
+    UINTN Size,
+    BOOL NonBlocking,
+    PUINTN BytesSpliced
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -826,6 +835,343 @@ Return Value:
     return Status;
 }
 
+KSTATUS
+IopGetSetPipeSize (
+    PIO_HANDLE Handle,
+    BOOL Set,
+    PULONG Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine gets or sets the capacity of a pipe's buffer.
+
+Arguments:
+
+    Handle - Supplies a pointer to the pipe I/O handle.
+
+    Set - Supplies a boolean indicating whether to resize the pipe (TRUE) or
+        just query its size (FALSE).
+
+    Size - Supplies a pointer that on input contains the requested size for
+        set operations. On output, contains the actual size of the pipe.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_HANDLE if the handle is not a pipe.
+
+    STATUS_INVALID_PARAMETER if the requested size is too large.
+
+    STATUS_RESOURCE_IN_USE if the pipe holds more data than the new size.
+
+--*/
+
+{
+
+    PFILE_OBJECT FileObject;
+    PPIPE Pipe;
+    KSTATUS Status;
+
+    FileObject = Handle->FileObject;
+    if (FileObject->Properties.Type != IoObjectPipe) {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    Pipe = FileObject->SpecialIo;
+    if (Set != FALSE) {
+        if (*Size > PIPE_MAXIMUM_SIZE) {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        Status = IoResizeStreamBuffer(Pipe->StreamBuffer, *Size);
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    *Size = IoGetStreamBufferSize(Pipe->StreamBuffer);
+    return STATUS_SUCCESS;
+}
+
+INTN
+IoSysSpliceMemory (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for splicing user pages into a
+    pipe. Whole, page aligned pages are added to the pipe without being
+    copied, and the rest is written normally.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of bytes completed (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    UINTN BytesThisRound;
+    PKPROCESS CurrentProcess;
+    PFILE_OBJECT FileObject;
+    PIO_HANDLE Handle;
+    UINTN Index;
+    BOOL NonBlocking;
+    PSYSTEM_CALL_SPLICE_MEMORY Parameters;
+    PPIPE Pipe;
+    INTN Result;
+    KSTATUS Status;
+    IO_VECTOR Vector;
+
+    CurrentProcess = PsGetCurrentProcess();
+    Parameters = (PSYSTEM_CALL_SPLICE_MEMORY)SystemCallParameter;
+    BytesCompleted = 0;
+    Handle = ObGetHandleValue(CurrentProcess->HandleTable,
+                              Parameters->Handle,
+                              NULL);
+
+    if (Handle == NULL) {
+        Status = STATUS_INVALID_HANDLE;
+        goto SysSpliceMemoryEnd;
+    }
+
+    FileObject = Handle->FileObject;
+    if ((FileObject->Properties.Type != IoObjectPipe) ||
+        ((Handle->Access & IO_ACCESS_WRITE) == 0)) {
+
+        Status = STATUS_INVALID_HANDLE;
+        goto SysSpliceMemoryEnd;
+    }
+
+    if (Parameters->VectorCount > MAX_IO_VECTOR_COUNT) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto SysSpliceMemoryEnd;
+    }
+
+    NonBlocking = FALSE;
+    if (((Parameters->Flags & SYS_SPLICE_FLAG_NON_BLOCKING) != 0) ||
+        ((Handle->OpenFlags & OPEN_FLAG_NON_BLOCKING) != 0)) {
+
+        NonBlocking = TRUE;
+    }
+
+    Pipe = FileObject->SpecialIo;
+    Status = STATUS_SUCCESS;
+    for (Index = 0; Index < Parameters->VectorCount; Index += 1) {
+        if (Pipe->ReaderCount == 0) {
+            Status = STATUS_BROKEN_PIPE;
+            break;
+        }
+
+        Status = MmCopyFromUserMode(&Vector,
+                                    &(Parameters->VectorArray[Index]),
+                                    sizeof(IO_VECTOR));
+
+        if (!KSUCCESS(Status)) {
+            break;
+        }
+
+        Status = IopSplicePipeBuffer(Pipe,
+                                     Vector.Data,
+                                     Vector.Length,
+                                     NonBlocking,
+                                     &BytesThisRound);
+
+        BytesCompleted += BytesThisRound;
+        if ((!KSUCCESS(Status)) || (BytesThisRound != Vector.Length)) {
+            break;
+        }
+    }
+
+    if (Status == STATUS_BROKEN_PIPE) {
+        PsSignalProcess(CurrentProcess, SIGNAL_BROKEN_PIPE, NULL);
+    }
+
+SysSpliceMemoryEnd:
+    if (Handle != NULL) {
+        IoIoHandleReleaseReference(Handle);
+    }
+
+    if ((Status == STATUS_INTERRUPTED) || (Status == STATUS_TRY_AGAIN)) {
+        if (BytesCompleted == 0) {
+            if (Status == STATUS_INTERRUPTED) {
+                Status = STATUS_RESTART_AFTER_SIGNAL;
+            }
+
+        } else {
+            Status = STATUS_SUCCESS;
+        }
+    }
+
+    Result = Status;
+    if (KSUCCESS(Status) && (BytesCompleted != 0)) {
+
+        ASSERT(BytesCompleted <= (UINTN)MAX_INTN);
+
+        Result = (INTN)BytesCompleted;
+    }
+
+    return Result;
+}
+
+INTN
+IoSysTeePipe (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for duplicating the unread
+    contents of one pipe into another without consuming them.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or the number of bytes duplicated (a positive integer) on
+    success.
+
+    Error status code (a negative integer) on failure.
+
+--*/
+
+{
+
+    UINTN BytesCompleted;
+    PKPROCESS CurrentProcess;
+    PIO_HANDLE Destination;
+    PPIPE DestinationPipe;
+    BOOL NonBlocking;
+    PSYSTEM_CALL_TEE_PIPE Parameters;
+    INTN Result;
+    PIO_HANDLE Source;
+    PPIPE SourcePipe;
+    KSTATUS Status;
+
+    CurrentProcess = PsGetCurrentProcess();
+    Parameters = (PSYSTEM_CALL_TEE_PIPE)SystemCallParameter;
+    BytesCompleted = 0;
+    Destination = NULL;
+    Source = ObGetHandleValue(CurrentProcess->HandleTable,
+                              Parameters->Source,
+                              NULL);
+
+    if (Source == NULL) {
+        Status = STATUS_INVALID_HANDLE;
+        goto SysTeePipeEnd;
+    }
+
+    Destination = ObGetHandleValue(CurrentProcess->HandleTable,
+                                   Parameters->Destination,
+                                   NULL);
+
+    if (Destination == NULL) {
+        Status = STATUS_INVALID_HANDLE;
+        goto SysTeePipeEnd;
+    }
+
+    if ((Source->FileObject->Properties.Type != IoObjectPipe) ||
+        (Destination->FileObject->Properties.Type != IoObjectPipe) ||
+        ((Source->Access & IO_ACCESS_READ) == 0) ||
+        ((Destination->Access & IO_ACCESS_WRITE) == 0)) {
+
+        Status = STATUS_INVALID_HANDLE;
+        goto SysTeePipeEnd;
+    }
+
+    SourcePipe = Source->FileObject->SpecialIo;
+    DestinationPipe = Destination->FileObject->SpecialIo;
+    if (SourcePipe == DestinationPipe) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto SysTeePipeEnd;
+    }
+
+    if (DestinationPipe->ReaderCount == 0) {
+        Status = STATUS_BROKEN_PIPE;
+        PsSignalProcess(CurrentProcess, SIGNAL_BROKEN_PIPE, NULL);
+        goto SysTeePipeEnd;
+    }
+
+    NonBlocking = FALSE;
+    if (((Parameters->Flags & SYS_SPLICE_FLAG_NON_BLOCKING) != 0) ||
+        ((Source->OpenFlags & OPEN_FLAG_NON_BLOCKING) != 0) ||
+        ((Destination->OpenFlags & OPEN_FLAG_NON_BLOCKING) != 0)) {
+
+        NonBlocking = TRUE;
+    }
+
+    Status = IoTeeStreamBuffer(SourcePipe->StreamBuffer,
+                               DestinationPipe->StreamBuffer,
+                               Parameters->Size,
+                               WAIT_TIME_INDEFINITE,
+                               NonBlocking,
+                               &BytesCompleted);
+
+    //
+    // An empty source with no writers is the end of the data, which tee
+    // reports as zero bytes.
+    //
+
+    if (Status == STATUS_END_OF_FILE) {
+        Status = STATUS_SUCCESS;
+
+    } else if (Status == STATUS_BROKEN_PIPE) {
+        PsSignalProcess(CurrentProcess, SIGNAL_BROKEN_PIPE, NULL);
+    }
+
+SysTeePipeEnd:
+    if (Source != NULL) {
+        IoIoHandleReleaseReference(Source);
+    }
+
+    if (Destination != NULL) {
+        IoIoHandleReleaseReference(Destination);
+    }
+
+    if (Status == STATUS_INTERRUPTED) {
+        if (BytesCompleted == 0) {
+            Status = STATUS_RESTART_AFTER_SIGNAL;
+
+        } else {
+            Status = STATUS_SUCCESS;
+        }
+    }
+
+    Result = Status;
+    if ((KSUCCESS(Status) || (Status == STATUS_BROKEN_PIPE)) &&
+        (BytesCompleted != 0)) {
+
+        ASSERT(BytesCompleted <= (UINTN)MAX_INTN);
+
+        Result = (INTN)BytesCompleted;
+    }
+
+    return Result;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -863,3 +1209,114 @@ Return Value:
     return;
 }
 
+KSTATUS
+IopSplicePipeBuffer (
+    PPIPE Pipe,
+    PVOID Buffer,
+    UINTN Size,
+    BOOL NonBlocking,
+    PUINTN BytesSpliced
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a user mode buffer to a pipe. Whole pages are spliced
+    in without copying, and the unaligned head and tail are copied.
+
+Arguments:
+
+    Pipe - Supplies a pointer to the pipe to write to.
+
+    Buffer - Supplies the user mode address of the data.
+
+    Size - Supplies the number of bytes to add.
+
+    NonBlocking - Supplies a boolean indicating if the operation should avoid
+        blocking.
+
+    BytesSpliced - Supplies a pointer where the number of bytes added to the
+        pipe will be returned.
+
+Return Value:
+
+    Status code. Check the bytes spliced to see if any data made it in.
+
+--*/
+
+{
+
+    PVOID Aligned;
+    UINTN BytesThisRound;
+    UINTN Chunk;
+    PIO_BUFFER IoBuffer;
+    ULONG PageSize;
+    BOOL Splice;
+    KSTATUS Status;
+
+    *BytesSpliced = 0;
+    PageSize = MmPageSize();
+    Status = STATUS_SUCCESS;
+    while (Size != 0) {
+
+        //
+        // Copy up to the next page boundary, splice whole pages (but no more
+        // than the pipe can hold, to bound how much gets locked at once), and
+        // copy the remainder.
+        //
+
+        Aligned = ALIGN_POINTER_UP(Buffer, PageSize);
+        Splice = FALSE;
+        if (Aligned != Buffer) {
+            Chunk = Aligned - Buffer;
+            if (Chunk > Size) {
+                Chunk = Size;
+            }
+
+        } else if (Size >= PageSize) {
+            Chunk = ALIGN_RANGE_DOWN(Size, PageSize);
+            if (Chunk > IoGetStreamBufferSize(Pipe->StreamBuffer)) {
+                Chunk = IoGetStreamBufferSize(Pipe->StreamBuffer);
+            }
+
+            Splice = TRUE;
+
+        } else {
+            Chunk = Size;
+        }
+
+        Status = MmCreateIoBuffer(Buffer, Chunk, 0, &IoBuffer);
+        if (!KSUCCESS(Status)) {
+            break;
+        }
+
+        if (Splice != FALSE) {
+            Status = IoSpliceStreamBuffer(Pipe->StreamBuffer,
+                                          IoBuffer,
+                                          Chunk,
+                                          WAIT_TIME_INDEFINITE,
+                                          NonBlocking,
+                                          &BytesThisRound);
+
+        } else {
+            Status = IoWriteStreamBuffer(Pipe->StreamBuffer,
+                                         IoBuffer,
+                                         Chunk,
+                                         WAIT_TIME_INDEFINITE,
+                                         NonBlocking,
+                                         &BytesThisRound);
+        }
+
+        MmFreeIoBuffer(IoBuffer);
+        *BytesSpliced += BytesThisRound;
+        Buffer += BytesThisRound;
+        Size -= BytesThisRound;
+        if ((!KSUCCESS(Status)) || (BytesThisRound != Chunk)) {
+            break;
+        }
+    }
+
+    return Status;
+}
+
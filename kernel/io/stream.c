@@ -32,11 +32,18 @@ Module Name:
 #include <minoca/kernel/kernel.h>
 #include "iop.h"
 
+
 //
 // ---------------------------------------------------------------- Definitions
 //
 
-#define DEFAULT_STREAM_BUFFER_SIZE 8192
+#define DEFAULT_STREAM_BUFFER_SIZE _64KB
+
+//
+// Define the maximum number of segments duplicated in one pass of a tee.
+//
+
+#define STREAM_TEE_BATCH_SIZE 16
 
 //
 // ------------------------------------------------------ Data Type Definitions
@@ -46,22 +53,79 @@ Module Name:
 
 Structure Description:
 
-    This structure describes characteristics about a data stream buffer.
+    This structure describes a run of one or more pages holding stream data.
+    Pages written into the stream are allocated by the stream itself. Pages
+    spliced into the stream are locked and mapped rather than copied. Once a
+    page is referenced by more than one segment its contents are read only.
+
+Members:
+
+    ReferenceCount - Stores the number of segments (or callers) referring to
+        the page run.
+
+    Buffer - Stores the kernel virtual address of the start of the run.
+
+    IoBuffer - Stores a pointer to the locked I/O buffer backing a spliced
+        run, or NULL if the page was allocated by the stream.
+
+--*/
+
+typedef struct _STREAM_PAGE {
+    volatile ULONG ReferenceCount;
+    PVOID Buffer;
+    PIO_BUFFER IoBuffer;
+} STREAM_PAGE, *PSTREAM_PAGE;
+
+/*++
+
+Structure Description:
+
+    This structure describes a slot in the stream buffer's ring: a span of
+    unread data within a stream page.
+
+Members:
+
+    Page - Stores a pointer to the page run holding the data.
+
+    Offset - Stores the offset from the start of the page run to the first
+        unread byte.
+
+    Size - Stores the number of unread bytes in the segment.
+
+--*/
+
+typedef struct _STREAM_SEGMENT {
+    PSTREAM_PAGE Page;
+    UINTN Offset;
+    ULONG Size;
+} STREAM_SEGMENT, *PSTREAM_SEGMENT;
+
+/*++
+
+Structure Description:
+
+    This structure describes characteristics about a data stream buffer. The
+    data lives in a ring of segments, each of which holds at most a page.
 
 Members:
 
     Flags - Stores a bitfield of flags governing the state of the stream buffer.
         See STREAM_BUFFER_FLAG_* definitions.
 
-    Size - Stores the size of the buffer, in bytes.
+    Size - Stores the capacity of the buffer, in bytes.
+
+    Segments - Stores a pointer to the ring of segments.
+
+    SegmentCapacity - Stores the number of elements in the segment ring.
+
+    Head - Stores the index of the segment holding the next byte to read.
 
-    Buffer - Stores a pointer to the actual stream buffer.
+    SegmentCount - Stores the number of segments in use, starting at the head.
 
-    NextReadOffset - Stores the offset from the beginning of the buffer where
-        the next read should occur (points to the first unread byte).
+    BytesUsed - Stores the number of unread bytes in the buffer.
 
-    NextWriteOffset - Stores the offset from the beginning of the buffer where
-        the next write should occur (points to the first unused offset).
+    SparePage - Stores an optional pointer to a freed page kept around for the
+        next write, to avoid churning the allocator.
 
     AtomicWriteSize - Stores the number of bytes that can always be written
         to the stream atomically (without interleaving).
@@ -76,9 +140,12 @@ Structure Description:
 struct _STREAM_BUFFER {
     ULONG Flags;
     ULONG Size;
-    PVOID Buffer;
-    ULONG NextReadOffset;
-    ULONG NextWriteOffset;
+    PSTREAM_SEGMENT Segments;
+    ULONG SegmentCapacity;
+    ULONG Head;
+    ULONG SegmentCount;
+    UINTN BytesUsed;
+    PSTREAM_PAGE SparePage;
     ULONG AtomicWriteSize;
     PQUEUED_LOCK Lock;
     PIO_OBJECT_STATE IoState;
@@ -88,6 +155,45 @@ struct _STREAM_BUFFER {
 // ----------------------------------------------- Internal Function Prototypes
 //
 
+PSTREAM_PAGE
+IopAllocateStreamPage (
+    PSTREAM_BUFFER StreamBuffer
+    );
+
+VOID
+IopStreamPageAddReference (
+    PSTREAM_PAGE Page
+    );
+
+VOID
+IopStreamPageReleaseReference (
+    PSTREAM_BUFFER StreamBuffer,
+    PSTREAM_PAGE Page
+    );
+
+PSTREAM_SEGMENT
+IopGetStreamBufferWritableTail (
+    PSTREAM_BUFFER StreamBuffer
+    );
+
+UINTN
+IopGetStreamBufferFreeSpace (
+    PSTREAM_BUFFER StreamBuffer
+    );
+
+VOID
+IopAppendStreamSegment (
+    PSTREAM_BUFFER StreamBuffer,
+    PSTREAM_PAGE Page,
+    UINTN Offset,
+    ULONG Size
+    );
+
+VOID
+IopUpdateStreamBufferWriteEvent (
+    PSTREAM_BUFFER StreamBuffer
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -119,7 +225,7 @@ Routine Description:
         buffer. See STREAM_BUFFER_FLAG_* definitions.
 
     BufferSize - Supplies the size of the buffer. Supply zero to use a default
-        system value.
+        system value. This is rounded up to a whole number of pages.
 
     AtomicWriteSize - Supplies the number of bytes that can always be written
         to the stream atomically (without interleaving).
@@ -134,27 +240,31 @@ Return Value:
 
 {
 
+    ULONG MinimumCount;
+    ULONG PageShift;
+    ULONG PageSize;
+    ULONG SegmentCount;
     KSTATUS Status;
     PSTREAM_BUFFER StreamBuffer;
 
+    PageShift = MmPageShift();
+    PageSize = MmPageSize();
     if (AtomicWriteSize == 0) {
         AtomicWriteSize = 1;
     }
 
     if (BufferSize == 0) {
         BufferSize = DEFAULT_STREAM_BUFFER_SIZE;
+    }
 
     //
-    // Bump up the internal buffer size since one byte of the buffer is always
-    // wasted.
+    // The buffer needs to hold at least one atomic write.
     //
 
-    } else {
-        BufferSize += 1;
-    }
-
-    if (BufferSize < AtomicWriteSize) {
-        BufferSize = AtomicWriteSize + 1;
+    SegmentCount = ALIGN_RANGE_UP(BufferSize, PageSize) >> PageShift;
+    MinimumCount = ALIGN_RANGE_UP(AtomicWriteSize, PageSize) >> PageShift;
+    if (SegmentCount < MinimumCount) {
+        SegmentCount = MinimumCount;
     }
 
     //
@@ -170,7 +280,8 @@ Return Value:
     }
 
     RtlZeroMemory(StreamBuffer, sizeof(STREAM_BUFFER));
-    StreamBuffer->Size = BufferSize;
+    StreamBuffer->Size = SegmentCount << PageShift;
+    StreamBuffer->SegmentCapacity = SegmentCount;
     StreamBuffer->AtomicWriteSize = AtomicWriteSize;
     StreamBuffer->Lock = KeCreateQueuedLock();
     if (StreamBuffer->Lock == NULL) {
@@ -179,13 +290,15 @@ Return Value:
     }
 
     //
-    // Create the buffer itself.
+    // Create the segment ring. The pages themselves are allocated as data
+    // comes in.
     //
 
-    StreamBuffer->Buffer = MmAllocatePagedPool(BufferSize,
-                                               FI_ALLOCATION_TAG);
+    StreamBuffer->Segments = MmAllocatePagedPool(
+                                       SegmentCount * sizeof(STREAM_SEGMENT),
+                                       FI_ALLOCATION_TAG);
 
-    if (StreamBuffer->Buffer == NULL) {
+    if (StreamBuffer->Segments == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto CreateStreamBufferEnd;
     }
@@ -208,8 +321,8 @@ Return Value:
                 KeDestroyQueuedLock(StreamBuffer->Lock);
             }
 
-            if (StreamBuffer->Buffer != NULL) {
-                MmFreePagedPool(StreamBuffer->Buffer);
+            if (StreamBuffer->Segments != NULL) {
+                MmFreePagedPool(StreamBuffer->Segments);
             }
 
             MmFreePagedPool(StreamBuffer);
@@ -244,14 +357,30 @@ Return Value:
 
 {
 
+    ULONG Index;
+    PSTREAM_SEGMENT Segment;
+
     if (StreamBuffer->Lock != NULL) {
         KeDestroyQueuedLock(StreamBuffer->Lock);
     }
 
     StreamBuffer->IoState = NULL;
-    if (StreamBuffer->Buffer != NULL) {
-        MmFreePagedPool(StreamBuffer->Buffer);
-        StreamBuffer->Buffer = NULL;
+    if (StreamBuffer->Segments != NULL) {
+        while (StreamBuffer->SegmentCount != 0) {
+            Index = StreamBuffer->Head;
+            Segment = &(StreamBuffer->Segments[Index]);
+            IopStreamPageReleaseReference(NULL, Segment->Page);
+            StreamBuffer->Head = (Index + 1) % StreamBuffer->SegmentCapacity;
+            StreamBuffer->SegmentCount -= 1;
+        }
+
+        MmFreePagedPool(StreamBuffer->Segments);
+        StreamBuffer->Segments = NULL;
+    }
+
+    if (StreamBuffer->SparePage != NULL) {
+        MmFreePagedPool(StreamBuffer->SparePage);
+        StreamBuffer->SparePage = NULL;
     }
 
     MmFreePagedPool(StreamBuffer);
@@ -303,12 +432,11 @@ Return Value:
 
 {
 
-    ULONG BytesAvailable;
-    ULONG BytesReadHere;
+    UINTN BytesReadHere;
     ULONG BytesToRead;
     ULONG EventsMask;
-    ULONG NextWriteOffset;
     ULONG ReturnedEvents;
+    PSTREAM_SEGMENT Segment;
     KSTATUS Status;
 
     *BytesRead = 0;
@@ -354,7 +482,7 @@ Return Value:
         // Start over if there's nothing to read.
         //
 
-        if (StreamBuffer->NextReadOffset == StreamBuffer->NextWriteOffset) {
+        if (StreamBuffer->SegmentCount == 0) {
 
             //
             // If the IN flag is set, then that would mean this routine is
@@ -394,106 +522,54 @@ Return Value:
         }
 
         //
-        // Now read the buffer, at least going to the end of the buffer.
-        // Wraparounds will be handled later on.
+        // Copy out of segments until the request is satisfied or the buffer
+        // runs dry, handing back each page as it is emptied.
         //
 
-        NextWriteOffset = StreamBuffer->NextWriteOffset;
-
-        ASSERT(NextWriteOffset < StreamBuffer->Size);
-
-        if (NextWriteOffset > StreamBuffer->NextReadOffset) {
-            BytesAvailable = NextWriteOffset - StreamBuffer->NextReadOffset;
-
-        } else {
-            BytesAvailable = StreamBuffer->Size - StreamBuffer->NextReadOffset;
-        }
-
-        BytesToRead = BytesAvailable;
-        if (ByteCount < BytesToRead) {
-            BytesToRead = ByteCount;
-        }
-
-        Status = MmCopyIoBufferData(
-                           IoBuffer,
-                           StreamBuffer->Buffer + StreamBuffer->NextReadOffset,
-                           *BytesRead,
-                           BytesToRead,
-                           TRUE);
-
-        if (!KSUCCESS(Status)) {
-            KeReleaseQueuedLock(StreamBuffer->Lock);
-            return Status;
-        }
-
-        //
-        // Update the read offset so that it always contains a valid value.
-        //
-
-        if (StreamBuffer->NextReadOffset + BytesToRead == StreamBuffer->Size) {
-            StreamBuffer->NextReadOffset = 0;
-
-        } else {
-            StreamBuffer->NextReadOffset += BytesToRead;
-        }
-
-        ASSERT(StreamBuffer->NextReadOffset < StreamBuffer->Size);
-
-        *BytesRead += BytesToRead;
-        BytesReadHere += BytesToRead;
-        ByteCount -= BytesToRead;
-
-        //
-        // The first copy is done, but it's possible that the eligible read
-        // content wraps around. Grab the rest of that data if so.
-        //
-
-        if ((ByteCount != 0) &&
-            (StreamBuffer->NextReadOffset != NextWriteOffset)) {
-
-            ASSERT(StreamBuffer->NextReadOffset == 0);
-            ASSERT(NextWriteOffset > StreamBuffer->NextReadOffset);
-
-            BytesAvailable = NextWriteOffset - StreamBuffer->NextReadOffset;
-            BytesToRead = BytesAvailable;
+        while ((ByteCount != 0) && (StreamBuffer->SegmentCount != 0)) {
+            Segment = &(StreamBuffer->Segments[StreamBuffer->Head]);
+            BytesToRead = Segment->Size;
             if (ByteCount < BytesToRead) {
                 BytesToRead = ByteCount;
             }
 
-            //
-            // Don't break out of the loop on failure right away, as the
-            // I/O state events need to be adjusted for the successful first
-            // copy that happened.
-            //
-
             Status = MmCopyIoBufferData(
-                           IoBuffer,
-                           StreamBuffer->Buffer + StreamBuffer->NextReadOffset,
-                           *BytesRead,
-                           BytesToRead,
-                           TRUE);
-
-            if (KSUCCESS(Status)) {
-                StreamBuffer->NextReadOffset += BytesToRead;
+                                     IoBuffer,
+                                     Segment->Page->Buffer + Segment->Offset,
+                                     *BytesRead,
+                                     BytesToRead,
+                                     TRUE);
 
-                ASSERT(StreamBuffer->NextReadOffset < StreamBuffer->Size);
+            if (!KSUCCESS(Status)) {
+                break;
+            }
 
-                *BytesRead += BytesToRead;
-                BytesReadHere += BytesToRead;
-                ByteCount -= BytesToRead;
+            Segment->Offset += BytesToRead;
+            Segment->Size -= BytesToRead;
+            StreamBuffer->BytesUsed -= BytesToRead;
+            *BytesRead += BytesToRead;
+            BytesReadHere += BytesToRead;
+            ByteCount -= BytesToRead;
+            if (Segment->Size == 0) {
+                IopStreamPageReleaseReference(StreamBuffer, Segment->Page);
+                Segment->Page = NULL;
+                StreamBuffer->Head = (StreamBuffer->Head + 1) %
+                                     StreamBuffer->SegmentCapacity;
+
+                StreamBuffer->SegmentCount -= 1;
             }
         }
 
         //
-        // Signal the write event (since more space was just made), and signal
+        // Update the write event (since more space was just made), and signal
         // the read event if there is still data left to be read. Don't do
         // this if the error events are set, as this is probably a disconnected
         // pipe with some data left in it.
         //
 
         if ((ReturnedEvents & POLL_ERROR_EVENTS) == 0) {
-            IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, TRUE);
-            if (StreamBuffer->NextReadOffset != StreamBuffer->NextWriteOffset) {
+            IopUpdateStreamBufferWriteEvent(StreamBuffer);
+            if (StreamBuffer->BytesUsed != 0) {
                 IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, TRUE);
 
             } else {
@@ -502,11 +578,6 @@ Return Value:
         }
 
         KeReleaseQueuedLock(StreamBuffer->Lock);
-
-        //
-        // If that second copy failed, now's the time to break out.
-        //
-
         if (!KSUCCESS(Status)) {
             return Status;
         }
@@ -560,16 +631,19 @@ Return Value:
 
 {
 
-    ULONG BytesAvailable;
-    ULONG BytesToWrite;
+    UINTN BytesToWrite;
     ULONG EventsMask;
-    ULONG NextReadOffset;
+    UINTN Offset;
+    PSTREAM_PAGE Page;
+    ULONG PageSize;
     ULONG ReturnedEvents;
+    PSTREAM_SEGMENT Segment;
     KSTATUS Status;
-    ULONG TotalBytesAvailable;
+    UINTN TotalBytesAvailable;
 
     *BytesWritten = 0;
     EventsMask = POLL_EVENT_OUT | POLL_ERROR_EVENTS;
+    PageSize = MmPageSize();
 
     ASSERT(KeGetRunLevel() == RunLevelLow);
 
@@ -599,53 +673,13 @@ Return Value:
 
         KeAcquireQueuedLock(StreamBuffer->Lock);
 
-        //
-        // Figure out how much room there is.
-        //
-
-        NextReadOffset = StreamBuffer->NextReadOffset;
-
-        ASSERT(NextReadOffset < StreamBuffer->Size);
-
-        if (NextReadOffset <= StreamBuffer->NextWriteOffset) {
-
-            //
-            // The total available is the entire buffer (minus one) minus the
-            // distance between the read and write pointers.
-            //
-
-            TotalBytesAvailable = (StreamBuffer->Size - 1) -
-                                  (StreamBuffer->NextWriteOffset -
-                                   NextReadOffset);
-
-            //
-            // The first copy goes from the next write offset to the end, but
-            // if the read offset is right at zero then the padding byte is at
-            // the end there.
-            //
-
-            BytesAvailable = StreamBuffer->Size - StreamBuffer->NextWriteOffset;
-            if (NextReadOffset == 0) {
-                BytesAvailable -= 1;
-            }
-
-        } else {
-
-            //
-            // The total available space is the distance between the write
-            // catching up to the read, minus the one buffer byte.
-            //
-
-            BytesAvailable = NextReadOffset - StreamBuffer->NextWriteOffset - 1;
-            TotalBytesAvailable = BytesAvailable;
-        }
-
         //
         // Start over if the buffer is full. The stream stipulates that it will
         // always be able to write at least the atomic size without
         // interleaving.
         //
 
+        TotalBytesAvailable = IopGetStreamBufferFreeSpace(StreamBuffer);
         if ((TotalBytesAvailable < ByteCount) &&
             (TotalBytesAvailable < StreamBuffer->AtomicWriteSize)) {
 
@@ -664,87 +698,56 @@ Return Value:
         }
 
         //
-        // Now write to the buffer, at least going to the end of the buffer.
-        // Wraparounds will be handled later on.
-        //
-
-        ASSERT(BytesAvailable != 0);
-
-        BytesToWrite = BytesAvailable;
-        if (ByteCount < BytesToWrite) {
-            BytesToWrite = ByteCount;
-        }
-
-        Status = MmCopyIoBufferData(
-                          IoBuffer,
-                          StreamBuffer->Buffer + StreamBuffer->NextWriteOffset,
-                          *BytesWritten,
-                          BytesToWrite,
-                          FALSE);
-
-        if (!KSUCCESS(Status)) {
-            KeReleaseQueuedLock(StreamBuffer->Lock);
-            return Status;
-        }
-
-        //
-        // Update the next write pointer in a manner that ensures its value is
-        // always valid.
+        // Fill the last page if it is private to this stream, then move on to
+        // fresh pages.
         //
 
-        if (StreamBuffer->NextWriteOffset + BytesToWrite ==
-            StreamBuffer->Size) {
-
-            StreamBuffer->NextWriteOffset = 0;
-
-        } else {
-            StreamBuffer->NextWriteOffset += BytesToWrite;
-        }
-
-        *BytesWritten += BytesToWrite;
-        ByteCount -= BytesToWrite;
-        TotalBytesAvailable -= BytesToWrite;
-
-        //
-        // The first copy is done, but it's possible that the eligible space
-        // wraps around. Write the remainder if so.
-        //
+        while ((ByteCount != 0) && (TotalBytesAvailable != 0)) {
+            Segment = IopGetStreamBufferWritableTail(StreamBuffer);
+            if (Segment != NULL) {
+                Page = Segment->Page;
+                Offset = Segment->Offset + Segment->Size;
 
-        if ((ByteCount != 0) &&
-            (((StreamBuffer->NextWriteOffset + 1) % StreamBuffer->Size) !=
-                                                             NextReadOffset)) {
+            } else {
+                Page = IopAllocateStreamPage(StreamBuffer);
+                if (Page == NULL) {
+                    Status = STATUS_INSUFFICIENT_RESOURCES;
+                    break;
+                }
 
-            ASSERT(StreamBuffer->NextWriteOffset == 0);
-            ASSERT(NextReadOffset > StreamBuffer->NextWriteOffset + 1);
+                Offset = 0;
+            }
 
-            BytesAvailable = NextReadOffset - StreamBuffer->NextWriteOffset - 1;
-            BytesToWrite = BytesAvailable;
+            BytesToWrite = PageSize - Offset;
             if (ByteCount < BytesToWrite) {
                 BytesToWrite = ByteCount;
             }
 
-            //
-            // Don't break out of the loop on failure right away, as the
-            // I/O state events need to be adjusted for the successful first
-            // copy that happened.
-            //
+            Status = MmCopyIoBufferData(IoBuffer,
+                                        Page->Buffer + Offset,
+                                        *BytesWritten,
+                                        BytesToWrite,
+                                        FALSE);
 
-            Status = MmCopyIoBufferData(
-                          IoBuffer,
-                          StreamBuffer->Buffer + StreamBuffer->NextWriteOffset,
-                          *BytesWritten,
-                          BytesToWrite,
-                          FALSE);
+            if (!KSUCCESS(Status)) {
+                if (Segment == NULL) {
+                    IopStreamPageReleaseReference(StreamBuffer, Page);
+                }
 
-            if (KSUCCESS(Status)) {
-                StreamBuffer->NextWriteOffset += BytesToWrite;
+                break;
+            }
 
-                ASSERT(StreamBuffer->NextWriteOffset < StreamBuffer->Size);
+            if (Segment != NULL) {
+                Segment->Size += BytesToWrite;
+                StreamBuffer->BytesUsed += BytesToWrite;
 
-                *BytesWritten += BytesToWrite;
-                ByteCount -= BytesToWrite;
-                TotalBytesAvailable -= BytesToWrite;
+            } else {
+                IopAppendStreamSegment(StreamBuffer, Page, 0, BytesToWrite);
             }
+
+            *BytesWritten += BytesToWrite;
+            ByteCount -= BytesToWrite;
+            TotalBytesAvailable -= BytesToWrite;
         }
 
         //
@@ -752,23 +755,12 @@ Return Value:
         // the write event if there is still space left.
         //
 
-        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, TRUE);
-
-        ASSERT(TotalBytesAvailable < StreamBuffer->Size);
-
-        if (TotalBytesAvailable >= StreamBuffer->AtomicWriteSize) {
-            IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, TRUE);
-
-        } else {
-            IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, FALSE);
+        if (StreamBuffer->BytesUsed != 0) {
+            IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, TRUE);
         }
 
+        IopUpdateStreamBufferWriteEvent(StreamBuffer);
         KeReleaseQueuedLock(StreamBuffer->Lock);
-
-        //
-        // If that second copy failed, now is the time to exit.
-        //
-
         if (!KSUCCESS(Status)) {
             return Status;
         }
@@ -778,101 +770,574 @@ Return Value:
 }
 
 KSTATUS
-IoStreamBufferConnect (
-    PSTREAM_BUFFER StreamBuffer
+IoSpliceStreamBuffer (
+    PSTREAM_BUFFER StreamBuffer,
+    PIO_BUFFER IoBuffer,
+    UINTN ByteCount,
+    ULONG TimeoutInMilliseconds,
+    BOOL NonBlocking,
+    PUINTN BytesSpliced
     )
 
 /*++
 
 Routine Description:
 
-    This routine resets the I/O object state when someone connects to a stream
-    buffer.
+    This routine adds the pages of the given I/O buffer to a stream buffer
+    without copying them. The pages are locked in memory and referenced by
+    the stream until they are read out, so the owner of the buffer must not
+    modify them in the meantime. This routine must be called at low level.
 
 Arguments:
 
-    StreamBuffer - Supplies a pointer to the stream buffer.
+    StreamBuffer - Supplies a pointer to the stream buffer to write to.
 
-Return Value:
+    IoBuffer - Supplies a pointer to the I/O buffer containing the pages to
+        add. The current offset of the I/O buffer must be page aligned.
 
-    Status code.
+    ByteCount - Supplies the number of bytes to add. This must be a multiple
+        of the page size.
 
---*/
+    TimeoutInMilliseconds - Supplies the number of milliseconds that the I/O
+        operation should be waited on before timing out. Use
+        WAIT_TIME_INDEFINITE to wait forever on the I/O.
 
-{
+    NonBlocking - Supplies a boolean indicating if this operation should avoid
+        blocking.
 
-    ULONG TotalBytesAvailable;
+    BytesSpliced - Supplies a pointer where the number of bytes actually
+        added to the stream will be returned.
 
-    KeAcquireQueuedLock(StreamBuffer->Lock);
+Return Value:
 
-    //
-    // Figure out how much space there is.
-    //
+    Status code. If a failing status code is returned, then check the number of
+    bytes spliced to see if any pages made it in.
 
-    if (StreamBuffer->NextReadOffset <= StreamBuffer->NextWriteOffset) {
+--*/
 
-        //
-        // The total available is the entire buffer (minus one) minus the
-        // distance between the read and write pointers.
-        //
+{
 
-        TotalBytesAvailable = (StreamBuffer->Size - 1) -
-                              (StreamBuffer->NextWriteOffset -
-                               StreamBuffer->NextReadOffset);
+    ULONG EventsMask;
+    PIO_BUFFER LockedBuffer;
+    BOOL LockedCopy;
+    UINTN Offset;
+    PSTREAM_PAGE Page;
+    ULONG PageSize;
+    ULONG ReturnedEvents;
+    KSTATUS Status;
 
-    } else {
+    *BytesSpliced = 0;
+    EventsMask = POLL_EVENT_OUT | POLL_ERROR_EVENTS;
+    PageSize = MmPageSize();
+    Page = NULL;
 
-        //
-        // The total available space is the distance between the write
-        // catching up to the read, minus the one buffer byte.
-        //
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+    ASSERT(IS_ALIGNED(ByteCount, PageSize) != FALSE);
+    ASSERT(IS_ALIGNED(MmGetIoBufferCurrentOffset(IoBuffer), PageSize));
 
-        TotalBytesAvailable = StreamBuffer->NextReadOffset -
-                              StreamBuffer->NextWriteOffset - 1;
+    if (ByteCount == 0) {
+        return STATUS_SUCCESS;
     }
 
     //
-    // Signal the write event if there's space to be written.
+    // Lock the pages down in a separate I/O buffer that the stream can own.
+    // If the buffer was already locked, it belongs to the caller, so fall
+    // back to copying.
     //
 
-    if (TotalBytesAvailable >= StreamBuffer->AtomicWriteSize) {
-        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, TRUE);
+    LockedBuffer = IoBuffer;
+    Status = MmValidateIoBuffer(0,
+                                MAX_ULONGLONG,
+                                1,
+                                ByteCount,
+                                FALSE,
+                                &LockedBuffer,
+                                &LockedCopy);
 
-    } else {
-        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, FALSE);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    if (LockedCopy == FALSE) {
+        if (LockedBuffer != IoBuffer) {
+            MmFreeIoBuffer(LockedBuffer);
+        }
+
+        return IoWriteStreamBuffer(StreamBuffer,
+                                   IoBuffer,
+                                   ByteCount,
+                                   TimeoutInMilliseconds,
+                                   NonBlocking,
+                                   BytesSpliced);
     }
 
     //
-    // Signal the read event if there's data in there.
+    // Map the pages up front so that readers in any process can copy out of
+    // them without modifying the I/O buffer.
     //
 
-    if (TotalBytesAvailable != StreamBuffer->Size - 1) {
-        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, TRUE);
+    Status = MmMapIoBuffer(LockedBuffer, FALSE, FALSE, TRUE);
+    if (!KSUCCESS(Status)) {
+        MmFreeIoBuffer(LockedBuffer);
+        return Status;
+    }
 
-    } else {
-        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, FALSE);
+    Page = MmAllocatePagedPool(sizeof(STREAM_PAGE), FI_ALLOCATION_TAG);
+    if (Page == NULL) {
+        MmFreeIoBuffer(LockedBuffer);
+        return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    KeReleaseQueuedLock(StreamBuffer->Lock);
-    return STATUS_SUCCESS;
-}
+    Page->ReferenceCount = 1;
+    Page->Buffer = LockedBuffer->Fragment[0].VirtualAddress +
+                   MmGetIoBufferCurrentOffset(LockedBuffer);
 
-PIO_OBJECT_STATE
-IoStreamBufferGetIoObjectState (
-    PSTREAM_BUFFER StreamBuffer
-    )
+    Page->IoBuffer = LockedBuffer;
+    Offset = 0;
+    while (ByteCount != 0) {
+        if (NonBlocking == FALSE) {
+            Status = IoWaitForIoObjectState(StreamBuffer->IoState,
+                                            EventsMask,
+                                            TRUE,
+                                            TimeoutInMilliseconds,
+                                            &ReturnedEvents);
 
-/*++
+            if (!KSUCCESS(Status)) {
+                break;
+            }
 
-Routine Description:
+            if (ReturnedEvents != POLL_EVENT_OUT) {
+                Status = STATUS_BROKEN_PIPE;
+                break;
+            }
+        }
 
-    This routine returns the I/O state for a stream buffer.
+        KeAcquireQueuedLock(StreamBuffer->Lock);
 
-Arguments:
+        //
+        // Each page needs a whole slot. If there are none, wait for a reader
+        // to free one up.
+        //
 
-    StreamBuffer - Supplies a pointer to the stream buffer.
+        if (StreamBuffer->SegmentCount == StreamBuffer->SegmentCapacity) {
+            IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, FALSE);
+            KeReleaseQueuedLock(StreamBuffer->Lock);
+            if (NonBlocking == FALSE) {
+                continue;
 
-Return Value:
+            } else {
+                if (*BytesSpliced == 0) {
+                    Status = STATUS_TRY_AGAIN;
+                }
+
+                break;
+            }
+        }
+
+        while ((ByteCount != 0) &&
+               (StreamBuffer->SegmentCount < StreamBuffer->SegmentCapacity)) {
+
+            IopStreamPageAddReference(Page);
+            IopAppendStreamSegment(StreamBuffer, Page, Offset, PageSize);
+            Offset += PageSize;
+            ByteCount -= PageSize;
+            *BytesSpliced += PageSize;
+        }
+
+        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, TRUE);
+        IopUpdateStreamBufferWriteEvent(StreamBuffer);
+        KeReleaseQueuedLock(StreamBuffer->Lock);
+    }
+
+    //
+    // Drop the initial reference. The run is unlocked once the last segment
+    // referring to it is read.
+    //
+
+    IopStreamPageReleaseReference(NULL, Page);
+    return Status;
+}
+
+KSTATUS
+IoTeeStreamBuffer (
+    PSTREAM_BUFFER Source,
+    PSTREAM_BUFFER Destination,
+    UINTN ByteCount,
+    ULONG TimeoutInMilliseconds,
+    BOOL NonBlocking,
+    PUINTN BytesCopied
+    )
+
+/*++
+
+Routine Description:
+
+    This routine duplicates data at the front of one stream buffer onto the
+    end of another without consuming it from the source. The pages are shared
+    between the two streams rather than copied. This routine must be called at
+    low level.
+
+Arguments:
+
+    Source - Supplies a pointer to the stream buffer to duplicate from.
+
+    Destination - Supplies a pointer to the stream buffer to append to.
+
+    ByteCount - Supplies the maximum number of bytes to duplicate.
+
+    TimeoutInMilliseconds - Supplies the number of milliseconds that either
+        side should be waited on before timing out. Use WAIT_TIME_INDEFINITE
+        to wait forever.
+
+    NonBlocking - Supplies a boolean indicating if this operation should avoid
+        blocking.
+
+    BytesCopied - Supplies a pointer where the number of bytes duplicated will
+        be returned.
+
+Return Value:
+
+    STATUS_END_OF_FILE if the source is empty and disconnected.
+
+    STATUS_BROKEN_PIPE if the destination is disconnected.
+
+    Other status codes.
+
+--*/
+
+{
+
+    STREAM_SEGMENT Batch[STREAM_TEE_BATCH_SIZE];
+    ULONG BatchCount;
+    ULONG BatchIndex;
+    ULONG EventsMask;
+    ULONG Index;
+    ULONG ReturnedEvents;
+    PSTREAM_SEGMENT Segment;
+    ULONG SegmentIndex;
+    KSTATUS Status;
+
+    *BytesCopied = 0;
+
+    ASSERT(KeGetRunLevel() == RunLevelLow);
+    ASSERT(Source != Destination);
+
+    if (ByteCount == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Wait for something to show up in the source.
+    //
+
+    EventsMask = POLL_EVENT_IN | POLL_ERROR_EVENTS;
+    while (TRUE) {
+        if (NonBlocking == FALSE) {
+            Status = IoWaitForIoObjectState(Source->IoState,
+                                            EventsMask,
+                                            TRUE,
+                                            TimeoutInMilliseconds,
+                                            &ReturnedEvents);
+
+            if (!KSUCCESS(Status)) {
+                return Status;
+            }
+
+        } else {
+            ReturnedEvents = Source->IoState->Events & EventsMask;
+        }
+
+        KeAcquireQueuedLock(Source->Lock);
+        if (Source->SegmentCount != 0) {
+            break;
+        }
+
+        KeReleaseQueuedLock(Source->Lock);
+        if ((ReturnedEvents & POLL_ERROR_EVENTS) != 0) {
+            return STATUS_END_OF_FILE;
+        }
+
+        if (NonBlocking != FALSE) {
+            return STATUS_TRY_AGAIN;
+        }
+    }
+
+    //
+    // Take references on the pages at the front of the source. Once a page is
+    // shared, neither stream will write into it again.
+    //
+
+    BatchCount = 0;
+    SegmentIndex = 0;
+    while ((SegmentIndex < Source->SegmentCount) &&
+           (BatchCount < STREAM_TEE_BATCH_SIZE) &&
+           (ByteCount != 0)) {
+
+        Index = (Source->Head + SegmentIndex) % Source->SegmentCapacity;
+        Segment = &(Source->Segments[Index]);
+        Batch[BatchCount] = *Segment;
+        if (ByteCount < Segment->Size) {
+            Batch[BatchCount].Size = ByteCount;
+        }
+
+        IopStreamPageAddReference(Segment->Page);
+        ByteCount -= Batch[BatchCount].Size;
+        BatchCount += 1;
+        SegmentIndex += 1;
+    }
+
+    KeReleaseQueuedLock(Source->Lock);
+
+    //
+    // Push the segments onto the destination, waiting for room as needed.
+    //
+
+    EventsMask = POLL_EVENT_OUT | POLL_ERROR_EVENTS;
+    BatchIndex = 0;
+    Status = STATUS_SUCCESS;
+    while (BatchIndex < BatchCount) {
+        if (NonBlocking == FALSE) {
+            Status = IoWaitForIoObjectState(Destination->IoState,
+                                            EventsMask,
+                                            TRUE,
+                                            TimeoutInMilliseconds,
+                                            &ReturnedEvents);
+
+            if (!KSUCCESS(Status)) {
+                break;
+            }
+
+            if (ReturnedEvents != POLL_EVENT_OUT) {
+                Status = STATUS_BROKEN_PIPE;
+                break;
+            }
+        }
+
+        KeAcquireQueuedLock(Destination->Lock);
+        if (Destination->SegmentCount == Destination->SegmentCapacity) {
+            IoSetIoObjectState(Destination->IoState, POLL_EVENT_OUT, FALSE);
+            KeReleaseQueuedLock(Destination->Lock);
+            if (NonBlocking == FALSE) {
+                continue;
+
+            } else {
+                if (*BytesCopied == 0) {
+                    Status = STATUS_TRY_AGAIN;
+                }
+
+                break;
+            }
+        }
+
+        while ((BatchIndex < BatchCount) &&
+               (Destination->SegmentCount < Destination->SegmentCapacity)) {
+
+            Segment = &(Batch[BatchIndex]);
+            IopAppendStreamSegment(Destination,
+                                   Segment->Page,
+                                   Segment->Offset,
+                                   Segment->Size);
+
+            *BytesCopied += Segment->Size;
+            BatchIndex += 1;
+        }
+
+        IoSetIoObjectState(Destination->IoState, POLL_EVENT_IN, TRUE);
+        IopUpdateStreamBufferWriteEvent(Destination);
+        KeReleaseQueuedLock(Destination->Lock);
+    }
+
+    //
+    // Release the references on anything that didn't make it across.
+    //
+
+    while (BatchIndex < BatchCount) {
+        IopStreamPageReleaseReference(NULL, Batch[BatchIndex].Page);
+        BatchIndex += 1;
+    }
+
+    return Status;
+}
+
+KSTATUS
+IoResizeStreamBuffer (
+    PSTREAM_BUFFER StreamBuffer,
+    ULONG Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine changes the capacity of a stream buffer. The size is rounded
+    up to a whole number of pages, and to at least the atomic write size.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+    Size - Supplies the new capacity, in bytes.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_RESOURCE_IN_USE if the stream currently holds more data than would
+    fit in the new size.
+
+    STATUS_INSUFFICIENT_RESOURCES on allocation failure.
+
+--*/
+
+{
+
+    ULONG Index;
+    ULONG MinimumCount;
+    PSTREAM_SEGMENT NewSegments;
+    PSTREAM_SEGMENT OldSegments;
+    ULONG PageShift;
+    ULONG PageSize;
+    ULONG SegmentCount;
+    KSTATUS Status;
+
+    PageShift = MmPageShift();
+    PageSize = MmPageSize();
+    SegmentCount = ALIGN_RANGE_UP(Size, PageSize) >> PageShift;
+    MinimumCount = ALIGN_RANGE_UP(StreamBuffer->AtomicWriteSize, PageSize) >>
+                   PageShift;
+
+    if (SegmentCount < MinimumCount) {
+        SegmentCount = MinimumCount;
+    }
+
+    NewSegments = MmAllocatePagedPool(SegmentCount * sizeof(STREAM_SEGMENT),
+                                      FI_ALLOCATION_TAG);
+
+    if (NewSegments == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    KeAcquireQueuedLock(StreamBuffer->Lock);
+    if (StreamBuffer->SegmentCount > SegmentCount) {
+        KeReleaseQueuedLock(StreamBuffer->Lock);
+        MmFreePagedPool(NewSegments);
+        return STATUS_RESOURCE_IN_USE;
+    }
+
+    //
+    // Unwrap the existing segments to the front of the new ring.
+    //
+
+    for (Index = 0; Index < StreamBuffer->SegmentCount; Index += 1) {
+        NewSegments[Index] = StreamBuffer->Segments[
+                                            (StreamBuffer->Head + Index) %
+                                            StreamBuffer->SegmentCapacity];
+    }
+
+    OldSegments = StreamBuffer->Segments;
+    StreamBuffer->Segments = NewSegments;
+    StreamBuffer->SegmentCapacity = SegmentCount;
+    StreamBuffer->Head = 0;
+    StreamBuffer->Size = SegmentCount << PageShift;
+    if ((StreamBuffer->IoState->Events & POLL_ERROR_EVENTS) == 0) {
+        IopUpdateStreamBufferWriteEvent(StreamBuffer);
+    }
+
+    KeReleaseQueuedLock(StreamBuffer->Lock);
+    MmFreePagedPool(OldSegments);
+    Status = STATUS_SUCCESS;
+    return Status;
+}
+
+ULONG
+IoGetStreamBufferSize (
+    PSTREAM_BUFFER StreamBuffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the capacity of a stream buffer.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+Return Value:
+
+    Returns the capacity of the stream buffer, in bytes.
+
+--*/
+
+{
+
+    return StreamBuffer->Size;
+}
+
+KSTATUS
+IoStreamBufferConnect (
+    PSTREAM_BUFFER StreamBuffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine resets the I/O object state when someone connects to a stream
+    buffer.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    KeAcquireQueuedLock(StreamBuffer->Lock);
+
+    //
+    // Signal the write event if there's space to be written.
+    //
+
+    IopUpdateStreamBufferWriteEvent(StreamBuffer);
+
+    //
+    // Signal the read event if there's data in there.
+    //
+
+    if (StreamBuffer->BytesUsed != 0) {
+        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, TRUE);
+
+    } else {
+        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_IN, FALSE);
+    }
+
+    KeReleaseQueuedLock(StreamBuffer->Lock);
+    return STATUS_SUCCESS;
+}
+
+PIO_OBJECT_STATE
+IoStreamBufferGetIoObjectState (
+    PSTREAM_BUFFER StreamBuffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the I/O state for a stream buffer.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+Return Value:
 
     Returns a pointer to the stream buffer's I/O object state.
 
@@ -887,3 +1352,318 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+PSTREAM_PAGE
+IopAllocateStreamPage (
+    PSTREAM_BUFFER StreamBuffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a page for new data written into a stream buffer.
+    The stream buffer's lock must be held.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+Return Value:
+
+    Returns a pointer to the page with a single reference on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    PSTREAM_PAGE Page;
+
+    ASSERT(KeIsQueuedLockHeld(StreamBuffer->Lock) != FALSE);
+
+    Page = StreamBuffer->SparePage;
+    if (Page != NULL) {
+        StreamBuffer->SparePage = NULL;
+
+    } else {
+        Page = MmAllocatePagedPool(sizeof(STREAM_PAGE) + MmPageSize(),
+                                   FI_ALLOCATION_TAG);
+
+        if (Page == NULL) {
+            return NULL;
+        }
+
+        Page->Buffer = (PVOID)(Page + 1);
+        Page->IoBuffer = NULL;
+    }
+
+    Page->ReferenceCount = 1;
+    return Page;
+}
+
+VOID
+IopStreamPageAddReference (
+    PSTREAM_PAGE Page
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a reference to a stream page.
+
+Arguments:
+
+    Page - Supplies a pointer to the page.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG OldCount;
+
+    OldCount = RtlAtomicAdd32(&(Page->ReferenceCount), 1);
+
+    ASSERT((OldCount != 0) && (OldCount < 0x10000000));
+
+    return;
+}
+
+VOID
+IopStreamPageReleaseReference (
+    PSTREAM_BUFFER StreamBuffer,
+    PSTREAM_PAGE Page
+    )
+
+/*++
+
+Routine Description:
+
+    This routine releases a reference on a stream page, freeing it if this was
+    the last one.
+
+Arguments:
+
+    StreamBuffer - Supplies an optional pointer to a stream buffer whose lock
+        is held. If supplied, a freed page may be kept as the stream's spare.
+
+    Page - Supplies a pointer to the page.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG OldCount;
+
+    OldCount = RtlAtomicAdd32(&(Page->ReferenceCount), (ULONG)-1);
+
+    ASSERT((OldCount != 0) && (OldCount < 0x10000000));
+
+    if (OldCount != 1) {
+        return;
+    }
+
+    if (Page->IoBuffer != NULL) {
+        MmFreeIoBuffer(Page->IoBuffer);
+        MmFreePagedPool(Page);
+
+    } else if ((StreamBuffer != NULL) && (StreamBuffer->SparePage == NULL)) {
+
+        ASSERT(KeIsQueuedLockHeld(StreamBuffer->Lock) != FALSE);
+
+        StreamBuffer->SparePage = Page;
+
+    } else {
+        MmFreePagedPool(Page);
+    }
+
+    return;
+}
+
+PSTREAM_SEGMENT
+IopGetStreamBufferWritableTail (
+    PSTREAM_BUFFER StreamBuffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the last segment of a stream buffer if new data can
+    be appended into its page. That is only the case for pages the stream
+    allocated itself that are not shared and have room left.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer, whose lock must be
+        held.
+
+Return Value:
+
+    Returns a pointer to the tail segment, or NULL if new data needs a new
+    page.
+
+--*/
+
+{
+
+    ULONG Index;
+    PSTREAM_SEGMENT Segment;
+
+    if (StreamBuffer->SegmentCount == 0) {
+        return NULL;
+    }
+
+    Index = (StreamBuffer->Head + StreamBuffer->SegmentCount - 1) %
+            StreamBuffer->SegmentCapacity;
+
+    Segment = &(StreamBuffer->Segments[Index]);
+    if ((Segment->Page->IoBuffer != NULL) ||
+        (Segment->Page->ReferenceCount != 1) ||
+        ((Segment->Offset + Segment->Size) >= MmPageSize())) {
+
+        return NULL;
+    }
+
+    return Segment;
+}
+
+UINTN
+IopGetStreamBufferFreeSpace (
+    PSTREAM_BUFFER StreamBuffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines how many bytes can be written into a stream buffer
+    right now.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer, whose lock must be
+        held.
+
+Return Value:
+
+    Returns the number of bytes that can be written.
+
+--*/
+
+{
+
+    ULONG PageSize;
+    PSTREAM_SEGMENT Segment;
+    UINTN Space;
+
+    PageSize = MmPageSize();
+    Space = StreamBuffer->SegmentCapacity - StreamBuffer->SegmentCount;
+    Space *= PageSize;
+
+    Segment = IopGetStreamBufferWritableTail(StreamBuffer);
+    if (Segment != NULL) {
+        Space += PageSize - (Segment->Offset + Segment->Size);
+    }
+
+    return Space;
+}
+
+VOID
+IopAppendStreamSegment (
+    PSTREAM_BUFFER StreamBuffer,
+    PSTREAM_PAGE Page,
+    UINTN Offset,
+    ULONG Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a segment to the end of a stream buffer. There must be a
+    free slot, and the stream buffer's lock must be held.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+    Page - Supplies a pointer to the page holding the data. The caller's
+        reference on the page is transferred to the stream.
+
+    Offset - Supplies the offset of the data within the page run.
+
+    Size - Supplies the number of bytes in the segment.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    PSTREAM_SEGMENT Segment;
+
+    ASSERT(StreamBuffer->SegmentCount < StreamBuffer->SegmentCapacity);
+    ASSERT(Size != 0);
+
+    Index = (StreamBuffer->Head + StreamBuffer->SegmentCount) %
+            StreamBuffer->SegmentCapacity;
+
+    Segment = &(StreamBuffer->Segments[Index]);
+    Segment->Page = Page;
+    Segment->Offset = Offset;
+    Segment->Size = Size;
+    StreamBuffer->SegmentCount += 1;
+    StreamBuffer->BytesUsed += Size;
+    return;
+}
+
+VOID
+IopUpdateStreamBufferWriteEvent (
+    PSTREAM_BUFFER StreamBuffer
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sets or clears the out event of a stream buffer depending on
+    whether an atomic write would fit. The stream buffer's lock must be held.
+
+Arguments:
+
+    StreamBuffer - Supplies a pointer to the stream buffer.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN Space;
+
+    Space = IopGetStreamBufferFreeSpace(StreamBuffer);
+    if (Space >= StreamBuffer->AtomicWriteSize) {
+        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, TRUE);
+
+    } else {
+        IoSetIoObjectState(StreamBuffer->IoState, POLL_EVENT_OUT, FALSE);
+    }
+
+    return;
+}
+
@@ -875,6 +875,61 @@ Return Value:
     return Status;
 }
 
+INTN
+IoSysAdviseFile (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine implements the system call for giving the kernel hints about
+    how a file will be accessed.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
+{
+
+    PKPROCESS CurrentProcess;
+    PIO_HANDLE HandleValue;
+    PSYSTEM_CALL_ADVISE_FILE Parameters;
+    KSTATUS Status;
+
+    CurrentProcess = PsGetCurrentProcess();
+
+    ASSERT(CurrentProcess != PsGetKernelProcess());
+
+    Parameters = (PSYSTEM_CALL_ADVISE_FILE)SystemCallParameter;
+    HandleValue = ObGetHandleValue(CurrentProcess->HandleTable,
+                                   Parameters->Handle,
+                                   NULL);
+
+    if (HandleValue == NULL) {
+        return STATUS_INVALID_HANDLE;
+    }
+
+    Status = IoAdviseFile(HandleValue,
+                          Parameters->Offset,
+                          Parameters->Size,
+                          Parameters->Advice);
+
+    IoIoHandleReleaseReference(HandleValue);
+    return Status;
+}
+
 INTN
 IoSysCreatePipe (
     PVOID SystemCallParameter
@@ -2195,6 +2250,41 @@ Return Value:
 
         break;
 
+    case FileControlCommandGetPipeSize:
+        Status = IopGetSetPipeSize(IoHandle,
+                                   FALSE,
+                                   &(LocalParameters.PipeSize));
+
+        if (KSUCCESS(Status)) {
+            CopyOutSize = sizeof(ULONG);
+        }
+
+        break;
+
+    case FileControlCommandSetPipeSize:
+        if (FileControl->Parameters == NULL) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto SysFileControlEnd;
+        }
+
+        Status = MmCopyFromUserMode(&LocalParameters,
+                                    FileControl->Parameters,
+                                    sizeof(ULONG));
+
+        if (!KSUCCESS(Status)) {
+            goto SysFileControlEnd;
+        }
+
+        Status = IopGetSetPipeSize(IoHandle,
+                                   TRUE,
+                                   &(LocalParameters.PipeSize));
+
+        if (KSUCCESS(Status)) {
+            CopyOutSize = sizeof(ULONG);
+        }
+
+        break;
+
     default:
         Status = STATUS_INVALID_PARAMETER;
         break;
@@ -32,6 +32,7 @@ Module Name:
 #include <minoca/kernel/kernel.h>
 #include <minoca/kernel/bootload.h>
 #include <minoca/debug/dbgproto.h>
+#include <minoca/kernel/crashdmp.h>
 #include "kdp.h"
 
 //
@@ -280,6 +281,13 @@ KdpInitializeBreakNotification (
     PDEBUG_PACKET Packet
     );
 
+VOID
+KdpFillBreakNotification (
+    ULONG Exception,
+    PTRAP_FRAME TrapFrame,
+    PBREAK_NOTIFICATION BreakNotification
+    );
+
 VOID
 KdpReboot (
     DEBUG_REBOOT_TYPE RebootType,
@@ -970,6 +978,48 @@ Return Value:
     return;
 }
 
+VOID
+KdFillCrashDumpContext (
+    PTRAP_FRAME TrapFrame,
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills out the machine type, special registers, and break
+    notification of a crash dump context from the given trap frame. It does
+    not depend on the debugger being initialized or connected. The loaded
+    module fields of the break notification are left for the caller.
+
+Arguments:
+
+    TrapFrame - Supplies a pointer to the state of the crashing processor.
+
+    Context - Supplies a pointer to the CRASH_DUMP_CONTEXT to fill out.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PCRASH_DUMP_CONTEXT CrashContext;
+
+    CrashContext = Context;
+    CrashContext->MachineType = KdMachineType;
+    CrashContext->Padding = 0;
+    KdpGetSpecialRegisters(&(CrashContext->SpecialRegisters));
+    KdpFillBreakNotification(EXCEPTION_BREAK,
+                             TrapFrame,
+                             &(CrashContext->BreakNotification));
+
+    return;
+}
+
 VOID
 KdDebugExceptionHandler (
     ULONG Exception,
@@ -2978,7 +3028,50 @@ Return Value:
 
 {
 
-    PBREAK_NOTIFICATION BreakNotification;
+    KdpFillBreakNotification(Exception,
+                             TrapFrame,
+                             (PBREAK_NOTIFICATION)Packet->Payload);
+
+    //
+    // Send the break notification to the debugger.
+    //
+
+    Packet->Header.Command = DbgBreakNotification;
+    Packet->Header.PayloadSize = sizeof(BREAK_NOTIFICATION);
+    return;
+}
+
+VOID
+KdpFillBreakNotification (
+    ULONG Exception,
+    PTRAP_FRAME TrapFrame,
+    PBREAK_NOTIFICATION BreakNotification
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills out a break notification describing the current
+    processor state.
+
+Arguments:
+
+    Exception - Supplies the type of exception to notify the debugger about.
+
+    TrapFrame - Supplies a pointer to the current trap frame.
+
+    BreakNotification - Supplies a pointer to the break notification to fill
+        out.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
     PVOID InstructionPointer;
     PVOID InstructionPointerAddress;
     PBYTE InstructionStream;
@@ -2987,12 +3080,6 @@ Return Value:
     PPROCESSOR_BLOCK ProcessorBlock;
     ULONG StreamIndex;
 
-    //
-    // Begin to initialize the break notification that will be sent to the
-    // debugger.
-    //
-
-    BreakNotification = (PBREAK_NOTIFICATION)Packet->Payload;
     BreakNotification->LoadedModuleCount = KdLoadedModules.ModuleCount;
     BreakNotification->LoadedModuleSignature = KdLoadedModules.Signature;
 
@@ -3104,13 +3191,6 @@ Return Value:
     //
 
     KdpGetRegisters(TrapFrame, &(BreakNotification->Registers));
-
-    //
-    // Send the break notification to the debugger.
-    //
-
-    Packet->Header.Command = DbgBreakNotification;
-    Packet->Header.PayloadSize = sizeof(BREAK_NOTIFICATION);
     return;
 }
 
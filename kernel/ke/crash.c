@@ -98,6 +98,13 @@ Return Value:
 
     KSTATUS Status;
 
+    //
+    // Record the crashing processor's registers before anything else runs, so
+    // the crash dump describes this point whether or not a debugger is
+    // attached.
+    //
+
+    ArCaptureTrapFrame(&KeCrashTrapFrame);
     KeRaiseRunLevel(RunLevelHigh);
 
     //
@@ -135,7 +142,8 @@ Return Value:
     // reset the system.
     //
 
-    Status = KepWriteCrashDump(CrashCode,
+    Status = KepWriteCrashDump(&KeCrashTrapFrame,
+                               CrashCode,
                                Parameter1,
                                Parameter2,
                                Parameter3,
@@ -31,7 +31,9 @@ Module Name:
 //
 
 #include <minoca/kernel/kernel.h>
+#include <minoca/debug/dbgproto.h>
 #include <minoca/kernel/crashdmp.h>
+#include <minoca/kernel/kdebug.h>
 #include <minoca/intrface/disk.h>
 #include "kep.h"
 
@@ -39,6 +41,13 @@ Module Name:
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the size of the buffer kernel dump page records are gathered in
+// before being written out. Larger writes keep the disk busy for less time.
+//
+
+#define CRASH_DUMP_STAGING_SIZE (128 * _1KB)
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -76,6 +85,45 @@ typedef struct _CRASH_DUMP_FILE {
     PDISK_INTERFACE DiskInterface;
 } CRASH_DUMP_FILE, *PCRASH_DUMP_FILE;
 
+/*++
+
+Structure Description:
+
+    This structure defines the state of a kernel dump being streamed out to a
+    crash dump file.
+
+Members:
+
+    File - Stores a pointer to the crash dump file being written.
+
+    Buffer - Stores the virtual address of the staging buffer.
+
+    BufferFill - Stores the number of bytes of the staging buffer in use.
+
+    FileOffset - Stores the file offset the start of the staging buffer will
+        be written to.
+
+    FileEnd - Stores the block aligned end of the usable portion of the file.
+
+    PageCount - Stores the number of page records written so far.
+
+    StreamSize - Stores the number of bytes of page records written so far.
+
+    Truncated - Stores a boolean indicating whether the file ran out of room.
+
+--*/
+
+typedef struct _CRASH_DUMP_WRITER {
+    PCRASH_DUMP_FILE File;
+    PUCHAR Buffer;
+    UINTN BufferFill;
+    ULONGLONG FileOffset;
+    ULONGLONG FileEnd;
+    ULONGLONG PageCount;
+    ULONGLONG StreamSize;
+    BOOL Truncated;
+} CRASH_DUMP_WRITER, *PCRASH_DUMP_WRITER;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -100,6 +148,32 @@ KepCrashDumpDiskInterfaceNotificationCallback (
     BOOL Arrival
     );
 
+KSTATUS
+KepWriteKernelCrashDump (
+    PCRASH_DUMP_FILE CrashFile,
+    PCRASH_DUMP_HEADER Header
+    );
+
+KSTATUS
+KepWriteCrashDumpPage (
+    PVOID Context,
+    PHYSICAL_ADDRESS PhysicalAddress,
+    PVOID Page
+    );
+
+KSTATUS
+KepFlushCrashDumpWriter (
+    PCRASH_DUMP_WRITER Writer,
+    BOOL Final
+    );
+
+KSTATUS
+KepGetCrashDumpContext (
+    PTRAP_FRAME TrapFrame,
+    PVOID Buffer,
+    PULONG BufferSize
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -123,6 +197,15 @@ UUID KeDiskInterfaceUuid = UUID_DISK_INTERFACE;
 
 PIO_BUFFER KeCrashDumpScratchBuffer;
 
+//
+// Store the type of crash dump to write, along with the staging buffer and
+// compressor hash table used by kernel dumps.
+//
+
+CRASH_DUMP_TYPE KeCrashDumpType = CrashDumpKernel;
+PIO_BUFFER KeCrashDumpStagingBuffer;
+PULONG KeCrashDumpHashTable;
+
 //
 // Store a boolean indicating whether to write all crash dump files or just
 // stop at the first successfully written one.
@@ -350,11 +433,50 @@ Return Value:
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
+    //
+    // Set up the larger resources needed for kernel dumps. If they can't be
+    // had, settle for minimal dumps rather than failing.
+    //
+
+    if (KeCrashDumpType == CrashDumpKernel) {
+        KeCrashDumpStagingBuffer = MmAllocateNonPagedIoBuffer(
+                                                       0,
+                                                       MAX_ULONGLONG,
+                                                       0,
+                                                       CRASH_DUMP_STAGING_SIZE,
+                                                       0);
+
+        KeCrashDumpHashTable = MmAllocateNonPagedPool(
+                                      RTL_LZ_HASH_TABLE_SIZE * sizeof(ULONG),
+                                      KE_ALLOCATION_TAG);
+
+        if ((KeCrashDumpStagingBuffer == NULL) ||
+            (KeCrashDumpHashTable == NULL) ||
+            (!KSUCCESS(MmMapIoBuffer(KeCrashDumpStagingBuffer,
+                                     FALSE,
+                                     FALSE,
+                                     TRUE)))) {
+
+            if (KeCrashDumpStagingBuffer != NULL) {
+                MmFreeIoBuffer(KeCrashDumpStagingBuffer);
+                KeCrashDumpStagingBuffer = NULL;
+            }
+
+            if (KeCrashDumpHashTable != NULL) {
+                MmFreeNonPagedPool(KeCrashDumpHashTable);
+                KeCrashDumpHashTable = NULL;
+            }
+
+            KeCrashDumpType = CrashDumpMinimal;
+        }
+    }
+
     return STATUS_SUCCESS;
 }
 
 KSTATUS
 KepWriteCrashDump (
+    PTRAP_FRAME TrapFrame,
     ULONG CrashCode,
     ULONGLONG Parameter1,
     ULONGLONG Parameter2,
@@ -370,6 +492,9 @@ Routine Description:
 
 Arguments:
 
+    TrapFrame - Supplies a pointer to the register state of the crashing
+        processor.
+
     CrashCode - Supplies the reason for the system crash.
 
     Parameter1 - Supplies an optional parameter regarding the crash.
@@ -394,9 +519,12 @@ Return Value:
     ULONG BufferSize;
     UINTN BytesCompleted;
     USHORT Checksum;
+    ULONG ContextOffset;
     PCRASH_DUMP_FILE CrashFile;
     PLIST_ENTRY CurrentEntry;
     PCRASH_DUMP_HEADER Header;
+    UINTN HeaderSize;
+    ULONG PageSize;
     KSTATUS Status;
     SYSTEM_VERSION_INFORMATION VersionInformation;
 
@@ -404,6 +532,7 @@ Return Value:
         RtlDebugPrint("No registered crash dump files.\n");
     }
 
+    PageSize = MmPageSize();
     Status = STATUS_SUCCESS;
     CurrentEntry = KeCrashDumpListHead.Next;
     while (CurrentEntry != &KeCrashDumpListHead) {
@@ -458,6 +587,7 @@ Return Value:
         Header->Parameter2 = Parameter2;
         Header->Parameter3 = Parameter3;
         Header->Parameter4 = Parameter4;
+        Header->PageSize = PageSize;
 
         //
         // Copy the system version information to the header if available.
@@ -492,6 +622,58 @@ Return Value:
             Header->DumpSize += BufferSize;
         }
 
+        //
+        // Append the crashing processor's state and the loaded module list so
+        // the debugger can open the dump as a target.
+        //
+
+        ContextOffset = ALIGN_RANGE_UP(Header->DumpSize, sizeof(ULONGLONG));
+        if (ContextOffset < KeCrashDumpScratchBuffer->Fragment[0].Size) {
+            BufferSize = KeCrashDumpScratchBuffer->Fragment[0].Size -
+                         ContextOffset;
+
+            Status = KepGetCrashDumpContext(TrapFrame,
+                                            (PVOID)Header + ContextOffset,
+                                            &BufferSize);
+
+            if (KSUCCESS(Status)) {
+                Header->ContextOffset = ContextOffset;
+                Header->ContextSize = BufferSize;
+                Header->DumpSize = ContextOffset + BufferSize;
+            }
+        }
+
+        HeaderSize = (UINTN)Header->DumpSize;
+
+        //
+        // For a kernel dump, stream the page records out after the first page
+        // and only then come back for the header, so that a dump cut short
+        // never looks complete.
+        //
+
+        if (KeCrashDumpType == CrashDumpKernel) {
+            Header->Type = CrashDumpKernel;
+            Header->MemoryOffset = ALIGN_RANGE_UP(PageSize,
+                                                  BlockIoContext->BlockSize);
+
+            Status = KepWriteKernelCrashDump(CrashFile, Header);
+            if (KSUCCESS(Status)) {
+                Header->DumpSize = Header->MemoryOffset + Header->MemorySize;
+
+            } else {
+                RtlDebugPrint("Failed to write kernel dump to file 0x%x: %d. "
+                              "Falling back to minimal dump.\n",
+                              CrashFile,
+                              Status);
+
+                Header->Type = CrashDumpMinimal;
+                Header->Flags = 0;
+                Header->MemoryOffset = 0;
+                Header->MemorySize = 0;
+                Header->PageCount = 0;
+            }
+        }
+
         //
         // Calculate the header's checksum. Do not include the product and
         // build strings as they are outside the header.
@@ -507,7 +689,7 @@ Return Value:
         Status = IoWriteFileBlocks(&(CrashFile->BlockIoContext),
                                    KeCrashDumpScratchBuffer,
                                    0,
-                                   (UINTN)Header->DumpSize,
+                                   HeaderSize,
                                    &BytesCompleted);
 
         if (!KSUCCESS(Status)) {
@@ -536,6 +718,375 @@ Return Value:
 // --------------------------------------------------------- Internal Functions
 //
 
+KSTATUS
+KepWriteKernelCrashDump (
+    PCRASH_DUMP_FILE CrashFile,
+    PCRASH_DUMP_HEADER Header
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the compressed contents of physical memory out to a
+    crash dump file, starting at the memory offset in the header. Free pages
+    and clean page cache pages are left out.
+
+Arguments:
+
+    CrashFile - Supplies a pointer to the crash dump file to write to.
+
+    Header - Supplies a pointer to the crash dump header. The memory offset
+        must be filled in. On return, the memory size, page count, and
+        flags will be filled in.
+
+Return Value:
+
+    Status code. Running out of room in the file is not a failure; the dump
+    is marked as truncated instead.
+
+--*/
+
+{
+
+    ULONG BlockSize;
+    KSTATUS Status;
+    CRASH_DUMP_WRITER Writer;
+
+    BlockSize = CrashFile->BlockIoContext.BlockSize;
+
+    ASSERT((KeCrashDumpStagingBuffer != NULL) &&
+           (KeCrashDumpHashTable != NULL));
+
+    ASSERT((BlockSize != 0) &&
+           (IS_ALIGNED(CRASH_DUMP_STAGING_SIZE, BlockSize) != FALSE));
+
+    RtlZeroMemory(&Writer, sizeof(CRASH_DUMP_WRITER));
+    Writer.File = CrashFile;
+    Writer.Buffer = KeCrashDumpStagingBuffer->Fragment[0].VirtualAddress;
+    Writer.FileOffset = Header->MemoryOffset;
+    Writer.FileEnd = ALIGN_RANGE_DOWN(CrashFile->FileSize, BlockSize);
+    if (Writer.FileEnd <= Writer.FileOffset) {
+        return STATUS_END_OF_FILE;
+    }
+
+    Status = MmEnumerateCrashDumpPages(KepWriteCrashDumpPage, &Writer);
+    if ((Status == STATUS_END_OF_FILE) && (Writer.Truncated != FALSE)) {
+        Header->Flags |= CRASH_DUMP_FLAG_TRUNCATED;
+        Status = STATUS_SUCCESS;
+    }
+
+    if (KSUCCESS(Status)) {
+        Status = KepFlushCrashDumpWriter(&Writer, TRUE);
+    }
+
+    Header->MemorySize = Writer.StreamSize;
+    Header->PageCount = Writer.PageCount;
+    if (KSUCCESS(Status)) {
+        RtlDebugPrint("Wrote %I64d pages (%I64d bytes)%s.\n",
+                      Writer.PageCount,
+                      Writer.StreamSize,
+                      (Writer.Truncated != FALSE) ? ", truncated" : "");
+    }
+
+    return Status;
+}
+
+KSTATUS
+KepWriteCrashDumpPage (
+    PVOID Context,
+    PHYSICAL_ADDRESS PhysicalAddress,
+    PVOID Page
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compresses one page of physical memory into the crash dump
+    staging buffer, writing the buffer out if it fills up.
+
+Arguments:
+
+    Context - Supplies a pointer to the crash dump writer.
+
+    PhysicalAddress - Supplies the physical address of the page.
+
+    Page - Supplies a temporary mapping of the page.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_END_OF_FILE if the crash dump file is full.
+
+    Other error codes if the write failed.
+
+--*/
+
+{
+
+    PUCHAR Data;
+    ULONG PageSize;
+    PCRASH_DUMP_PAGE_HEADER Record;
+    ULONG RecordFlags;
+    UINTN RecordSize;
+    ULONG Size;
+    KSTATUS Status;
+    PCRASH_DUMP_WRITER Writer;
+
+    Writer = Context;
+    PageSize = MmPageSize();
+
+    //
+    // Make sure there's room for the worst case record before compressing
+    // straight into the staging buffer.
+    //
+
+    if (Writer->BufferFill + sizeof(CRASH_DUMP_PAGE_HEADER) + PageSize >
+        CRASH_DUMP_STAGING_SIZE) {
+
+        Status = KepFlushCrashDumpWriter(Writer, FALSE);
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    Record = (PCRASH_DUMP_PAGE_HEADER)(Writer->Buffer + Writer->BufferFill);
+    Data = (PUCHAR)(Record + 1);
+
+    //
+    // Store the page raw if compression doesn't save anything.
+    //
+
+    RecordFlags = CRASH_DUMP_PAGE_FLAG_COMPRESSED;
+    Size = RtlLzCompress(Page,
+                         PageSize,
+                         Data,
+                         PageSize - 1,
+                         KeCrashDumpHashTable);
+
+    if (Size == 0) {
+        RtlCopyMemory(Data, Page, PageSize);
+        Size = PageSize;
+        RecordFlags = 0;
+    }
+
+    RecordSize = sizeof(CRASH_DUMP_PAGE_HEADER) + Size;
+    if (Writer->FileOffset + Writer->BufferFill + RecordSize >
+        Writer->FileEnd) {
+
+        Writer->Truncated = TRUE;
+        return STATUS_END_OF_FILE;
+    }
+
+    Record->PhysicalAddress = PhysicalAddress;
+    Record->Size = Size;
+    Record->Flags = RecordFlags;
+    Writer->BufferFill += RecordSize;
+    Writer->PageCount += 1;
+    Writer->StreamSize += RecordSize;
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+KepFlushCrashDumpWriter (
+    PCRASH_DUMP_WRITER Writer,
+    BOOL Final
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the contents of the crash dump staging buffer out to
+    the file. Only whole blocks are written unless this is the final flush,
+    with the partial block left over moved to the front of the buffer.
+
+Arguments:
+
+    Writer - Supplies a pointer to the crash dump writer.
+
+    Final - Supplies a boolean indicating if this is the last flush, in which
+        case the trailing partial block is written as well.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG BlockSize;
+    UINTN BytesCompleted;
+    UINTN Remainder;
+    KSTATUS Status;
+    UINTN WriteSize;
+
+    BlockSize = Writer->File->BlockIoContext.BlockSize;
+    if (Final != FALSE) {
+        WriteSize = ALIGN_RANGE_UP(Writer->BufferFill, BlockSize);
+
+    } else {
+        WriteSize = ALIGN_RANGE_DOWN(Writer->BufferFill, BlockSize);
+    }
+
+    if (WriteSize == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    ASSERT(Writer->FileOffset + WriteSize <= Writer->FileEnd);
+
+    Status = IoWriteFileBlocks(&(Writer->File->BlockIoContext),
+                               KeCrashDumpStagingBuffer,
+                               Writer->FileOffset,
+                               WriteSize,
+                               &BytesCompleted);
+
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // The leftover is less than a block, and so never overlaps the block
+    // aligned data it's copied from.
+    //
+
+    Remainder = 0;
+    if (Final == FALSE) {
+        Remainder = Writer->BufferFill - WriteSize;
+        if (Remainder != 0) {
+            RtlCopyMemory(Writer->Buffer,
+                          Writer->Buffer + WriteSize,
+                          Remainder);
+        }
+    }
+
+    Writer->FileOffset += WriteSize;
+    Writer->BufferFill = Remainder;
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+KepGetCrashDumpContext (
+    PTRAP_FRAME TrapFrame,
+    PVOID Buffer,
+    PULONG BufferSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds the processor context and loaded module list stored
+    in a crash dump. It works whether or not the kernel debugger was ever
+    initialized, as the module list comes straight from the kernel process.
+
+Arguments:
+
+    TrapFrame - Supplies a pointer to the register state of the crashing
+        processor.
+
+    Buffer - Supplies a pointer where the crash dump context followed by the
+        loaded module list will be written.
+
+    BufferSize - Supplies a pointer that on input contains the size of the
+        buffer in bytes. On output, returns the number of bytes used.
+
+Return Value:
+
+    STATUS_SUCCESS on success. Modules that do not fit in the buffer are left
+    out of the list.
+
+    STATUS_BUFFER_TOO_SMALL if the buffer cannot even hold the context.
+
+--*/
+
+{
+
+    PCRASH_DUMP_CONTEXT Context;
+    PLIST_ENTRY CurrentEntry;
+    PLOADED_MODULE_ENTRY CurrentModule;
+    ULONG EntrySize;
+    PLOADED_IMAGE Image;
+    PKPROCESS KernelProcess;
+    PMODULE_LIST_HEADER List;
+    PSTR Name;
+    ULONG NameSize;
+    ULONG Offset;
+
+    Offset = sizeof(CRASH_DUMP_CONTEXT) + sizeof(MODULE_LIST_HEADER);
+    if (*BufferSize < Offset) {
+        *BufferSize = 0;
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    Context = Buffer;
+    KdFillCrashDumpContext(TrapFrame, Context);
+    List = (PMODULE_LIST_HEADER)(Context + 1);
+    RtlZeroMemory(List, sizeof(MODULE_LIST_HEADER));
+
+    //
+    // Walk the kernel process image list without its lock, as nothing else is
+    // running this late in a crash and the lock may be held by the very code
+    // that crashed.
+    //
+
+    KernelProcess = PsGetKernelProcess();
+    if ((KernelProcess != NULL) &&
+        (KernelProcess->ImageListHead.Next != NULL)) {
+
+        CurrentEntry = KernelProcess->ImageListHead.Next;
+        while (CurrentEntry != &(KernelProcess->ImageListHead)) {
+            Image = LIST_VALUE(CurrentEntry, LOADED_IMAGE, ListEntry);
+            CurrentEntry = CurrentEntry->Next;
+            if (Image->FileName == NULL) {
+                continue;
+            }
+
+            Name = RtlStringFindCharacterRight(Image->FileName, '/', -1);
+            if (Name != NULL) {
+                Name += 1;
+
+            } else {
+                Name = Image->FileName;
+            }
+
+            NameSize = (RtlStringLength(Name) + 1) * sizeof(CHAR);
+            EntrySize = sizeof(LOADED_MODULE_ENTRY) + NameSize -
+                        (ANYSIZE_ARRAY * sizeof(CHAR));
+
+            if ((EntrySize > *BufferSize) ||
+                (Offset > *BufferSize - EntrySize)) {
+
+                break;
+            }
+
+            CurrentModule = Buffer + Offset;
+            CurrentModule->StructureSize = EntrySize;
+            CurrentModule->Timestamp = Image->File.ModificationDate;
+            CurrentModule->LowestAddress =
+                      (UINTN)(Image->PreferredLowestAddress +
+                              Image->BaseDifference);
+
+            CurrentModule->Size = Image->Size;
+            CurrentModule->Process = KernelProcess->Identifiers.ProcessId;
+            RtlCopyMemory(CurrentModule->BinaryName, Name, NameSize);
+            List->ModuleCount += 1;
+            List->Signature += Image->File.ModificationDate +
+                               CurrentModule->LowestAddress;
+
+            Offset += EntrySize;
+        }
+    }
+
+    Context->BreakNotification.LoadedModuleCount = List->ModuleCount;
+    Context->BreakNotification.LoadedModuleSignature = List->Signature;
+    *BufferSize = Offset;
+    return STATUS_SUCCESS;
+}
+
 VOID
 KepCrashDumpDiskInterfaceNotificationCallback (
     PVOID Context,
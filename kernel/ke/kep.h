@@ -96,6 +96,12 @@ extern ULONGLONG KeClockRate;
 
 extern BOOL KeDisableDynamicTick;
 
+//
+// Store the register state of the processor that crashed the system.
+//
+
+extern TRAP_FRAME KeCrashTrapFrame;
+
 //
 // -------------------------------------------------------- Function Prototypes
 //
@@ -490,6 +496,7 @@ Return Value:
 
 KSTATUS
 KepWriteCrashDump (
+    PTRAP_FRAME TrapFrame,
     ULONG CrashCode,
     ULONGLONG Parameter1,
     ULONGLONG Parameter2,
@@ -505,6 +512,9 @@ Routine Description:
 
 Arguments:
 
+    TrapFrame - Supplies a pointer to the register state of the crashing
+        processor.
+
     CrashCode - Supplies the reason for the system crash.
 
     Parameter1 - Supplies an optional parameter regarding the crash.
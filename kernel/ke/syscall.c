@@ -221,6 +221,10 @@ SYSTEM_CALL_TABLE_ENTRY KeSystemCallTable[SystemCallCount] = {
     {MmSysSetBreak,
         sizeof(SYSTEM_CALL_SET_BREAK),
         sizeof(SYSTEM_CALL_SET_BREAK)},
+    {MmSysAdviseMemory, sizeof(SYSTEM_CALL_ADVISE_MEMORY), 0},
+    {IoSysAdviseFile, sizeof(SYSTEM_CALL_ADVISE_FILE), 0},
+    {IoSysSpliceMemory, sizeof(SYSTEM_CALL_SPLICE_MEMORY), 0},
+    {IoSysTeePipe, sizeof(SYSTEM_CALL_TEE_PIPE), 0},
 };
 
 //
@@ -50,6 +50,14 @@ Module Name:
 // -------------------------------------------------------------------- Globals
 //
 
+//
+// Store the register state of the processor that crashed the system. It lives
+// here rather than on the crashing stack because only the architecture code
+// knows the size of a trap frame.
+//
+
+TRAP_FRAME KeCrashTrapFrame;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -819,10 +819,25 @@ Return Value:
 
     ULONG FirstIndex;
     PFIRST_LEVEL_TABLE FirstTable;
+    PADDRESS_SPACE PreviousSpace;
+    PPROCESSOR_BLOCK ProcessorBlock;
     PADDRESS_SPACE_ARM Space;
 
     Space = (PADDRESS_SPACE_ARM)AddressSpace;
 
+    //
+    // Mark the new address space as in use on this processor before loading
+    // it so that TLB shootdowns for it are not missed.
+    //
+
+    ProcessorBlock = Processor;
+    PreviousSpace = ProcessorBlock->RunningThread->OwningProcess->AddressSpace;
+    if (PreviousSpace != AddressSpace) {
+        MmpUpdateAddressSpaceProcessors(AddressSpace,
+                                        ProcessorBlock->ProcessorNumber,
+                                        TRUE);
+    }
+
     //
     // Make sure the current stack is visible. It might not be if this current
     // thread is new and its stack pushed out into a new page table not in the
@@ -836,6 +851,12 @@ Return Value:
     }
 
     ArSwitchTtbr0(Space->PageDirectoryPhysical);
+    if (PreviousSpace != AddressSpace) {
+        MmpUpdateAddressSpaceProcessors(PreviousSpace,
+                                        ProcessorBlock->ProcessorNumber,
+                                        FALSE);
+    }
+
     return;
 }
 
@@ -2926,6 +2947,69 @@ Return Value:
     return STATUS_SUCCESS;
 }
 
+BOOL
+MmpWriteProtectSectionMappings (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts all the mappings of the given virtual address region
+    in the current process to read-only for a copy-on-write fork, without
+    copying them anywhere. This architecture always copies the mappings into
+    the new process, so nothing is done here.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the current address space.
+
+    VirtualAddress - Supplies the starting virtual address of the memory range.
+
+    Size - Supplies the size of the virtual address region, in bytes.
+
+Return Value:
+
+    FALSE always.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
+BOOL
+MmpResolveDeferredWriteProtection (
+    PVOID FaultingAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pushes write protection applied at the directory level down
+    into the page table covering the given user mode address. Write
+    protection is never deferred on this architecture.
+
+Arguments:
+
+    FaultingAddress - Supplies the address of the write fault.
+
+Return Value:
+
+    FALSE always.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
 VOID
 MmpCreatePageTables (
     PVOID VirtualAddress,
@@ -3029,6 +3113,64 @@ Return Value:
     return;
 }
 
+BOOL
+MmpPromoteLargePage (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to replace the page table covering the given address
+    with a single large page mapping. Large pages are not used on this
+    architecture.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space the address belongs
+        to.
+
+    VirtualAddress - Supplies a virtual address within the region to promote.
+
+Return Value:
+
+    FALSE always.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
+UINTN
+MmpGetLargePageSize (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the size of a large page on this architecture.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    0 always, as large pages are not used on this architecture.
+
+--*/
+
+{
+
+    return 0;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -144,6 +144,18 @@ Return Value:
                       0);
     }
 
+    //
+    // A write beneath a page table that fork only protected at the directory
+    // level just needs that protection pushed down into the page table.
+    //
+
+    if (((FaultFlags & FAULT_FLAG_WRITE) != 0) &&
+        ((FaultFlags & FAULT_FLAG_PAGE_NOT_PRESENT) == 0) &&
+        (MmpResolveDeferredWriteProtection(FaultingAddress) != FALSE)) {
+
+        return;
+    }
+
     //
     // Determine the process that owns the faulting section.
     //
@@ -138,6 +138,21 @@ MmpDestroyImageSectionMappings (
     PIMAGE_SECTION Section
     );
 
+KSTATUS
+MmpPrefetchImageSection (
+    PIMAGE_SECTION Section,
+    UINTN PageOffset,
+    UINTN PageCount
+    );
+
+KSTATUS
+MmpDiscardImageSectionPages (
+    PIMAGE_SECTION Section,
+    UINTN PageOffset,
+    UINTN PageCount,
+    MEMORY_ADVICE Advice
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -1205,6 +1220,7 @@ Return Value:
     BOOL AddressLockHeld;
     ULONG AllocationSize;
     ULONG BitmapSize;
+    BOOL CopyDeferred;
     PLIST_ENTRY CurrentEntry;
     PIMAGE_SECTION CurrentSection;
     ULONG Flags;
@@ -1408,19 +1424,33 @@ Return Value:
     INSERT_BEFORE(&(NewSection->CopyListEntry), &(SectionToCopy->ChildList));
 
     //
-    // Convert the mapping to read-only and copy the mappings to the
-    // destination in one skillful maneuver.
+    // Anonymous pages are only ever found through the section tree, so the
+    // copy can fault them in from its parent as it touches them. Just write
+    // protect the source, which the architecture may defer to the first
+    // write fault in each page table. Otherwise convert the mapping to
+    // read-only and copy the mappings to the destination in one skillful
+    // maneuver.
     //
 
     if (SectionToCopy->MinTouched < SectionToCopy->MaxTouched) {
-        Status = MmpCopyAndChangeSectionMappings(
+        CopyDeferred = FALSE;
+        if ((SectionToCopy->Flags & IMAGE_SECTION_NO_IMAGE_BACKING) != 0) {
+            CopyDeferred = MmpWriteProtectSectionMappings(
+                        SectionToCopy->AddressSpace,
+                        SectionToCopy->MinTouched,
+                        SectionToCopy->MaxTouched - SectionToCopy->MinTouched);
+        }
+
+        if (CopyDeferred == FALSE) {
+            Status = MmpCopyAndChangeSectionMappings(
                         DestinationAddressSpace,
                         SectionToCopy->AddressSpace,
                         SectionToCopy->MinTouched,
                         SectionToCopy->MaxTouched - SectionToCopy->MinTouched);
 
-        if (!KSUCCESS(Status)) {
-            goto CopyImageSectionEnd;
+            if (!KSUCCESS(Status)) {
+                goto CopyImageSectionEnd;
+            }
         }
     }
 
@@ -1771,6 +1801,111 @@ Return Value:
     return Status;
 }
 
+KSTATUS
+MmpAdviseImageSectionRegion (
+    PIMAGE_SECTION Section,
+    UINTN PageOffset,
+    UINTN PageCount,
+    MEMORY_ADVICE Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine applies an access pattern hint to the specified region of the
+    given image section. It prefetches or discards pages, and passes access
+    pattern hints down to the backing image.
+
+Arguments:
+
+    Section - Supplies a pointer to the image section.
+
+    PageOffset - Supplies the offset, in pages, to the start of the region.
+
+    PageCount - Supplies the number of pages in the region.
+
+    Advice - Supplies the access pattern hint.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    FILE_ADVICE FileAdvice;
+    IO_OFFSET FileOffset;
+    ULONG PageShift;
+    KSTATUS Status;
+
+    ASSERT(Section->AddressSpace == PsGetCurrentProcess()->AddressSpace);
+
+    PageShift = MmPageShift();
+    Status = STATUS_SUCCESS;
+    switch (Advice) {
+    case MemoryAdviceNormal:
+    case MemoryAdviceRandom:
+    case MemoryAdviceSequential:
+    case MemoryAdviceWillNeed:
+
+        //
+        // Page-ins of backed sections go through the page cache of the
+        // backing file, so let the access pattern steer how much the page
+        // cache reads around each fault.
+        //
+
+        if (Section->ImageBacking.DeviceHandle != INVALID_HANDLE) {
+            if (Advice == MemoryAdviceRandom) {
+                FileAdvice = FileAdviceRandom;
+
+            } else if (Advice == MemoryAdviceSequential) {
+                FileAdvice = FileAdviceSequential;
+
+            } else if (Advice == MemoryAdviceWillNeed) {
+                FileAdvice = FileAdviceWillNeed;
+
+            } else {
+                FileAdvice = FileAdviceNormal;
+            }
+
+            FileOffset = Section->ImageBacking.Offset +
+                         (PageOffset << PageShift);
+
+            Status = IoAdviseFile(Section->ImageBacking.DeviceHandle,
+                                  FileOffset,
+                                  (ULONGLONG)PageCount << PageShift,
+                                  FileAdvice);
+
+            if (!KSUCCESS(Status)) {
+                break;
+            }
+        }
+
+        if (Advice == MemoryAdviceWillNeed) {
+            Status = MmpPrefetchImageSection(Section, PageOffset, PageCount);
+        }
+
+        break;
+
+    case MemoryAdviceDontNeed:
+    case MemoryAdviceFree:
+        Status = MmpDiscardImageSectionPages(Section,
+                                             PageOffset,
+                                             PageCount,
+                                             Advice);
+
+        break;
+
+    default:
+        Status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    return Status;
+}
+
 VOID
 MmpImageSectionAddReference (
     PIMAGE_SECTION ImageSection
@@ -4269,3 +4404,280 @@ Return Value:
     return;
 }
 
+KSTATUS
+MmpPrefetchImageSection (
+    PIMAGE_SECTION Section,
+    UINTN PageOffset,
+    UINTN PageCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pages in the given region of an image section ahead of it
+    being accessed. Anonymous pages that have never been written are skipped,
+    as there is nothing to read for them. This stops early without failing if
+    memory gets tight or the section shrinks.
+
+Arguments:
+
+    Section - Supplies a pointer to the image section.
+
+    PageOffset - Supplies the offset, in pages, to the start of the region.
+
+    PageCount - Supplies the number of pages in the region.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN BitmapIndex;
+    ULONG BitmapMask;
+    UINTN CurrentOffset;
+    BOOL HasContents;
+    PIMAGE_SECTION OwningSection;
+    UINTN PageIndex;
+    ULONG PageShift;
+    KSTATUS Status;
+
+    if (((Section->Flags & IMAGE_SECTION_ACCESS_MASK) == 0) ||
+        ((Section->Flags & IMAGE_SECTION_NON_PAGED) != 0)) {
+
+        return STATUS_SUCCESS;
+    }
+
+    PageShift = MmPageShift();
+    Status = STATUS_SUCCESS;
+    for (PageIndex = 0; PageIndex < PageCount; PageIndex += 1) {
+        if (MmGetPhysicalMemoryWarningLevel() != MemoryWarningLevelNone) {
+            break;
+        }
+
+        CurrentOffset = PageOffset + PageIndex;
+
+        //
+        // An anonymous page only has contents worth bringing in if its owner
+        // has dirtied it at some point.
+        //
+
+        if ((Section->Flags & IMAGE_SECTION_NO_IMAGE_BACKING) != 0) {
+            HasContents = FALSE;
+            KeAcquireQueuedLock(Section->Lock);
+            if (((Section->Flags & IMAGE_SECTION_DESTROYED) == 0) &&
+                (CurrentOffset < (Section->Size >> PageShift))) {
+
+                OwningSection = MmpGetOwningSection(Section, CurrentOffset);
+                BitmapIndex = IMAGE_SECTION_BITMAP_INDEX(CurrentOffset);
+                BitmapMask = IMAGE_SECTION_BITMAP_MASK(CurrentOffset);
+                if ((OwningSection->DirtyPageBitmap != NULL) &&
+                    ((OwningSection->DirtyPageBitmap[BitmapIndex] &
+                      BitmapMask) != 0)) {
+
+                    HasContents = TRUE;
+                }
+
+                MmpImageSectionReleaseReference(OwningSection);
+            }
+
+            KeReleaseQueuedLock(Section->Lock);
+            if (HasContents == FALSE) {
+                continue;
+            }
+        }
+
+        Status = MmpPageIn(Section, CurrentOffset, NULL);
+        if (!KSUCCESS(Status)) {
+
+            //
+            // The section shrinking or the backing image ending is not an
+            // error for a hint, it just means there is nothing more to do.
+            //
+
+            if ((Status == STATUS_TRY_AGAIN) ||
+                (Status == STATUS_TOO_LATE) ||
+                (Status == STATUS_END_OF_FILE)) {
+
+                Status = STATUS_SUCCESS;
+            }
+
+            break;
+        }
+    }
+
+    return Status;
+}
+
+KSTATUS
+MmpDiscardImageSectionPages (
+    PIMAGE_SECTION Section,
+    UINTN PageOffset,
+    UINTN PageCount,
+    MEMORY_ADVICE Advice
+    )
+
+/*++
+
+Routine Description:
+
+    This routine throws away the contents of the given region of an image
+    section without writing anything back. The next access to a discarded
+    anonymous page gets a zeroed page, and the next access to a discarded
+    private page of a file mapping reads the file again. Pages still shared
+    with a forked child are left alone, since the child depends on them.
+
+Arguments:
+
+    Section - Supplies a pointer to the image section.
+
+    PageOffset - Supplies the offset, in pages, to the start of the region.
+
+    PageCount - Supplies the number of pages in the region.
+
+    Advice - Supplies the discard flavor, either MemoryAdviceDontNeed or
+        MemoryAdviceFree. Only anonymous private memory can be freed.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    UINTN BitmapIndex;
+    ULONG BitmapMask;
+    PIMAGE_SECTION Child;
+    PLIST_ENTRY CurrentEntry;
+    UINTN CurrentOffset;
+    BOOL FreePhysicalPage;
+    BOOL Inherited;
+    UINTN PageIndex;
+    BOOL PageMapped;
+    ULONG PageShift;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    UINTN SectionPageCount;
+    KSTATUS Status;
+
+    ASSERT((Advice == MemoryAdviceDontNeed) || (Advice == MemoryAdviceFree));
+
+    if ((Section->Flags & IMAGE_SECTION_NON_PAGED) != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ((Advice == MemoryAdviceFree) &&
+        (((Section->Flags & IMAGE_SECTION_NO_IMAGE_BACKING) == 0) ||
+         ((Section->Flags & IMAGE_SECTION_SHARED) != 0))) {
+
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    PageShift = MmPageShift();
+    Status = STATUS_SUCCESS;
+    KeAcquireQueuedLock(Section->Lock);
+    if ((Section->Flags & IMAGE_SECTION_DESTROYED) != 0) {
+        goto DiscardImageSectionPagesEnd;
+    }
+
+    SectionPageCount = Section->Size >> PageShift;
+    if (PageOffset >= SectionPageCount) {
+        goto DiscardImageSectionPagesEnd;
+    }
+
+    if (PageCount > (SectionPageCount - PageOffset)) {
+        PageCount = SectionPageCount - PageOffset;
+    }
+
+    //
+    // Shared sections only ever map the page cache, which keeps the data. Just
+    // unmap the pages so they can be trimmed.
+    //
+
+    if ((Section->Flags & IMAGE_SECTION_SHARED) != 0) {
+        Status = MmpUnmapImageSection(Section, PageOffset, PageCount, 0);
+        goto DiscardImageSectionPagesEnd;
+    }
+
+    for (PageIndex = 0; PageIndex < PageCount; PageIndex += 1) {
+        CurrentOffset = PageOffset + PageIndex;
+        BitmapIndex = IMAGE_SECTION_BITMAP_INDEX(CurrentOffset);
+        BitmapMask = IMAGE_SECTION_BITMAP_MASK(CurrentOffset);
+
+        //
+        // Skip pages that a child still inherits from this section.
+        //
+
+        CurrentEntry = Section->ChildList.Next;
+        while (CurrentEntry != &(Section->ChildList)) {
+            Child = LIST_VALUE(CurrentEntry, IMAGE_SECTION, CopyListEntry);
+            if ((Child->InheritPageBitmap[BitmapIndex] & BitmapMask) != 0) {
+                break;
+            }
+
+            CurrentEntry = CurrentEntry->Next;
+        }
+
+        if (CurrentEntry != &(Section->ChildList)) {
+            continue;
+        }
+
+        Inherited = FALSE;
+        if ((Section->InheritPageBitmap != NULL) &&
+            ((Section->InheritPageBitmap[BitmapIndex] & BitmapMask) != 0)) {
+
+            Inherited = TRUE;
+        }
+
+        //
+        // Unmap the page. It only belongs to this section if it isn't
+        // inherited from a parent and isn't a clean page cache page.
+        //
+
+        PageMapped = MmpIsImageSectionMapped(Section,
+                                             CurrentOffset,
+                                             &PhysicalAddress);
+
+        if (PageMapped != FALSE) {
+            FreePhysicalPage = TRUE;
+            if ((Inherited != FALSE) ||
+                (((Section->Flags & IMAGE_SECTION_BACKED) != 0) &&
+                 ((Section->DirtyPageBitmap[BitmapIndex] & BitmapMask) == 0))) {
+
+                FreePhysicalPage = FALSE;
+            }
+
+            MmpModifySectionMapping(Section,
+                                    CurrentOffset,
+                                    INVALID_PHYSICAL_ADDRESS,
+                                    FALSE,
+                                    NULL,
+                                    TRUE);
+
+            if (FreePhysicalPage != FALSE) {
+                MmFreePhysicalPage(PhysicalAddress);
+            }
+        }
+
+        //
+        // Break any inheritance and forget about the contents, including any
+        // copy in the page file, so the next fault starts over.
+        //
+
+        if (Inherited != FALSE) {
+            Section->InheritPageBitmap[BitmapIndex] &= ~BitmapMask;
+        }
+
+        if (Section->DirtyPageBitmap != NULL) {
+            Section->DirtyPageBitmap[BitmapIndex] &= ~BitmapMask;
+        }
+    }
+
+DiscardImageSectionPagesEnd:
+    KeReleaseQueuedLock(Section->Lock);
+    return Status;
+}
+
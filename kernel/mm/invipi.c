@@ -25,6 +25,7 @@ Module Name:
 
 --*/
 
+
 //
 // ------------------------------------------------------------------- Includes
 //
@@ -36,6 +37,17 @@ Module Name:
 // ---------------------------------------------------------------- Definitions
 //
 
+//
+// Define the number of user mode pages above which it's cheaper to flush the
+// entire TLB than to invalidate each page individually. Kernel mode ranges are
+// always invalidated page by page since global entries may survive a full
+// flush.
+//
+
+#define MM_TLB_ENTIRE_FLUSH_THRESHOLD 32
+
+#define ADDRESS_SPACE_PROCESSOR_WORD_BITS (sizeof(ULONG) * BITS_PER_BYTE)
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -44,6 +56,12 @@ Module Name:
 // ----------------------------------------------- Internal Function Prototypes
 //
 
+VOID
+MmpInvalidateLocalTlb (
+    PVOID VirtualAddress,
+    ULONG PageCount
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -86,23 +104,22 @@ Return Value:
 
 {
 
-    PVOID Address;
-    ULONG Index;
     RUNLEVEL OldRunLevel;
-    ULONG PageSize;
     PKPROCESS Process;
 
     OldRunLevel = KeRaiseRunLevel(RunLevelIpi);
-    PageSize = MmPageSize();
     Process = PsGetCurrentProcess();
+
+    //
+    // Processors that switched away from the address space after the request
+    // was sent have already had their user mode TLB entries flushed.
+    //
+
     if ((MmInvalidateIpiAddress >= KERNEL_VA_START) ||
         (Process->AddressSpace == MmInvalidateIpiAddressSpace)) {
 
-        Address = MmInvalidateIpiAddress;
-        for (Index = 0; Index < MmInvalidateIpiPageCount; Index += 1) {
-            ArInvalidateTlbEntry(Address);
-            Address = (PVOID)((UINTN)Address + PageSize);
-        }
+        MmpInvalidateLocalTlb(MmInvalidateIpiAddress,
+                              MmInvalidateIpiPageCount);
     }
 
     RtlAtomicAdd32(&MmInvalidateIpiProcessorsRemaining, -1);
@@ -121,7 +138,10 @@ MmpSendTlbInvalidateIpi (
 
 Routine Description:
 
-    This routine invalidates the given TLB entry on all active processors.
+    This routine invalidates the given TLB entries on all processors that may
+    have them cached. Kernel mode addresses are invalidated on every active
+    processor. User mode addresses are only invalidated on the processors
+    that currently have the given address space loaded.
 
 Arguments:
 
@@ -129,7 +149,9 @@ Routine Description:
 
     VirtualAddress - Supplies the virtual address to invalidate.
 
-    PageCount - Supplies the number of pages to invalidate.
+    PageCount - Supplies the number of pages to invalidate. Large user mode
+        ranges result in the entire TLB being flushed on each target
+        processor.
 
 Return Value:
 
@@ -139,43 +161,126 @@ Return Value:
 
 {
 
+    ULONG ActiveCount;
+    BOOL Broadcast;
+    ULONG CurrentProcessor;
+    ULONG Mask;
     RUNLEVEL OldRunLevel;
-    ULONG PageIndex;
-    ULONG PageSize;
+    PKPROCESS Process;
+    ULONG ProcessorMask[ADDRESS_SPACE_PROCESSOR_WORDS];
     PROCESSOR_SET ProcessorSet;
     KSTATUS Status;
+    ULONG TargetCount;
+    ULONG WordIndex;
 
     //
     // If there is only one processor in the system, do the invalidate
     // directly.
     //
 
-    if (KeGetActiveProcessorCount() == 1) {
-        PageSize = MmPageSize();
-        for (PageIndex = 0; PageIndex < PageCount; PageIndex += 1) {
-            ArInvalidateTlbEntry(VirtualAddress);
-            VirtualAddress = (PVOID)((UINTN)VirtualAddress + PageSize);
+    ActiveCount = KeGetActiveProcessorCount();
+    if (ActiveCount == 1) {
+        MmpInvalidateLocalTlb(VirtualAddress, PageCount);
+        return;
+    }
+
+    //
+    // Invalidate the local TLB directly rather than sending an IPI to self.
+    // This processor has the entries if the address space is loaded or the
+    // addresses are global.
+    //
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    CurrentProcessor = KeGetCurrentProcessorNumber();
+    Process = PsGetCurrentProcess();
+    if ((VirtualAddress >= KERNEL_VA_START) ||
+        (Process->AddressSpace == AddressSpace)) {
+
+        MmpInvalidateLocalTlb(VirtualAddress, PageCount);
+    }
+
+    //
+    // Figure out which other processors need to hear about it. The page table
+    // changes must be visible before the set of processors is sampled, as a
+    // processor that loads the address space after this point will see the
+    // new entries.
+    //
+
+    Broadcast = FALSE;
+    if ((VirtualAddress >= KERNEL_VA_START) ||
+        (AddressSpace == NULL) ||
+        (ActiveCount > ADDRESS_SPACE_TRACKED_PROCESSORS)) {
+
+        Broadcast = TRUE;
+        TargetCount = ActiveCount - 1;
+
+    } else {
+        RtlMemoryBarrier();
+        TargetCount = 0;
+        for (WordIndex = 0;
+             WordIndex < ADDRESS_SPACE_PROCESSOR_WORDS;
+             WordIndex += 1) {
+
+            Mask = AddressSpace->ActiveProcessors[WordIndex];
+            if (WordIndex ==
+                (CurrentProcessor / ADDRESS_SPACE_PROCESSOR_WORD_BITS)) {
+
+                Mask &= ~((ULONG)1 << (CurrentProcessor %
+                                       ADDRESS_SPACE_PROCESSOR_WORD_BITS));
+            }
+
+            ProcessorMask[WordIndex] = Mask;
+            TargetCount += RtlCountSetBits32(Mask);
         }
 
+        if (TargetCount == (ActiveCount - 1)) {
+            Broadcast = TRUE;
+        }
+    }
+
+    if (TargetCount == 0) {
+        KeLowerRunLevel(OldRunLevel);
         return;
     }
 
-    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
     KeAcquireSpinLock(&MmInvalidateIpiLock);
     MmInvalidateIpiAddressSpace = AddressSpace;
     MmInvalidateIpiAddress = VirtualAddress;
     MmInvalidateIpiPageCount = PageCount;
-    MmInvalidateIpiProcessorsRemaining = KeGetActiveProcessorCount();
+    MmInvalidateIpiProcessorsRemaining = TargetCount;
     RtlMemoryBarrier();
 
     //
-    // Send out the IPI.
+    // Send out the IPI, either to everyone else or to each processor running
+    // in the address space.
     //
 
-    ProcessorSet.Target = ProcessorTargetAll;
-    Status = HlSendIpi(IpiTypeTlbFlush, &ProcessorSet);
-    if (!KSUCCESS(Status)) {
-        KeCrashSystem(CRASH_IPI_FAILURE, Status, 0, 0, 0);
+    if (Broadcast != FALSE) {
+        ProcessorSet.Target = ProcessorTargetAllExcludingSelf;
+        Status = HlSendIpi(IpiTypeTlbFlush, &ProcessorSet);
+        if (!KSUCCESS(Status)) {
+            KeCrashSystem(CRASH_IPI_FAILURE, Status, 0, 0, 0);
+        }
+
+    } else {
+        ProcessorSet.Target = ProcessorTargetSingleProcessor;
+        for (WordIndex = 0;
+             WordIndex < ADDRESS_SPACE_PROCESSOR_WORDS;
+             WordIndex += 1) {
+
+            Mask = ProcessorMask[WordIndex];
+            while (Mask != 0) {
+                ProcessorSet.U.Number =
+                              (WordIndex * ADDRESS_SPACE_PROCESSOR_WORD_BITS) +
+                              RtlCountTrailingZeros32(Mask);
+
+                Mask &= Mask - 1;
+                Status = HlSendIpi(IpiTypeTlbFlush, &ProcessorSet);
+                if (!KSUCCESS(Status)) {
+                    KeCrashSystem(CRASH_IPI_FAILURE, Status, 0, 0, 0);
+                }
+            }
+        }
     }
 
     //
@@ -191,7 +296,135 @@ Return Value:
     return;
 }
 
+VOID
+MmpFlushAddressSpaceTlb (
+    PADDRESS_SPACE AddressSpace
+    )
+
+/*++
+
+Routine Description:
+
+    This routine flushes all user mode TLB entries for the given address space
+    on every processor that has it loaded. This is used to batch up changes
+    that touch large portions of an address space, such as converting it to
+    copy-on-write.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space to flush.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    MmpSendTlbInvalidateIpi(AddressSpace, NULL, MAX_ULONG);
+    return;
+}
+
+VOID
+MmpUpdateAddressSpaceProcessors (
+    PADDRESS_SPACE AddressSpace,
+    ULONG ProcessorNumber,
+    BOOL Active
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks whether or not the given processor has the address
+    space loaded. When switching address spaces, the new space must be marked
+    active before it is loaded, and the old space must only be marked inactive
+    after the switch.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space being switched to
+        or from.
+
+    ProcessorNumber - Supplies the number of the current processor.
+
+    Active - Supplies a boolean indicating whether the processor is loading
+        (TRUE) or leaving (FALSE) the address space.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Bit;
+    ULONG WordIndex;
+
+    if (ProcessorNumber >= ADDRESS_SPACE_TRACKED_PROCESSORS) {
+        return;
+    }
+
+    WordIndex = ProcessorNumber / ADDRESS_SPACE_PROCESSOR_WORD_BITS;
+    Bit = (ULONG)1 << (ProcessorNumber % ADDRESS_SPACE_PROCESSOR_WORD_BITS);
+    if (Active != FALSE) {
+        RtlAtomicOr32(&(AddressSpace->ActiveProcessors[WordIndex]), Bit);
+
+    } else {
+        RtlAtomicAnd32(&(AddressSpace->ActiveProcessors[WordIndex]), ~Bit);
+    }
+
+    return;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
 
+VOID
+MmpInvalidateLocalTlb (
+    PVOID VirtualAddress,
+    ULONG PageCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine invalidates a range of TLB entries on the current processor.
+
+Arguments:
+
+    VirtualAddress - Supplies the first virtual address to invalidate.
+
+    PageCount - Supplies the number of pages to invalidate.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG PageIndex;
+    ULONG PageSize;
+
+    if ((VirtualAddress < KERNEL_VA_START) &&
+        (PageCount > MM_TLB_ENTIRE_FLUSH_THRESHOLD)) {
+
+        ArInvalidateEntireTlb();
+        return;
+    }
+
+    PageSize = MmPageSize();
+    for (PageIndex = 0; PageIndex < PageCount; PageIndex += 1) {
+        ArInvalidateTlbEntry(VirtualAddress);
+        VirtualAddress = (PVOID)((UINTN)VirtualAddress + PageSize);
+    }
+
+    return;
+}
+
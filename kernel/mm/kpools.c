@@ -671,6 +671,10 @@ Return Value:
 
     KeReleaseQueuedLock(MmPagedPoolLock);
     MmpGetPhysicalPageStatistics(Statistics);
+    Statistics->LargePageSize = MmpGetLargePageSize();
+    Statistics->LargePages = MmLargePageCount;
+    Statistics->LargePagePromotions = MmLargePagePromotions;
+    Statistics->LargePageSplits = MmLargePageSplits;
     return STATUS_SUCCESS;
 }
 
@@ -1044,6 +1048,7 @@ Return Value:
 
 {
 
+    UINTN LargePageSize;
     BOOL LockHeld;
     RUNLEVEL OldRunLevel;
     ULONG PageSize;
@@ -1076,6 +1081,16 @@ Return Value:
     LockHeld = FALSE;
     VaRequest.Size = Size;
     VaRequest.Alignment = PageSize;
+
+    //
+    // Align big expansions so they can be mapped with large pages.
+    //
+
+    LargePageSize = MmpGetLargePageSize();
+    if ((LargePageSize != 0) && (Size >= LargePageSize)) {
+        VaRequest.Alignment = LargePageSize;
+    }
+
     VaRequest.Min = 0;
     VaRequest.Max = MAX_ADDRESS;
     VaRequest.MemoryType = MemoryTypeNonPagedPool;
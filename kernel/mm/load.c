@@ -1205,6 +1205,208 @@ Return Value:
     return STATUS_SUCCESS;
 }
 
+INTN
+MmSysAdviseMemory (
+    PVOID SystemCallParameter
+    )
+
+/*++
+
+Routine Description:
+
+    This routine responds to system calls from user mode supplying a hint
+    about how a region of the current process' memory is going to be used.
+
+Arguments:
+
+    SystemCallParameter - Supplies a pointer to the parameters supplied with
+        the system call. This structure will be a stack-local copy of the
+        actual parameters passed from user-mode.
+
+Return Value:
+
+    STATUS_SUCCESS or positive integer on success.
+
+    Error status code on failure.
+
+--*/
+
+{
+
+    PVOID AdviseRegionEnd;
+    PVOID AdviseRegionStart;
+    PADDRESS_SPACE AddressSpace;
+    ULONGLONG AlignedSize;
+    PLIST_ENTRY CurrentEntry;
+    PIMAGE_SECTION CurrentSection;
+    BOOL LockHeld;
+    UINTN OverlapPageCount;
+    UINTN OverlapPageOffset;
+    UINTN OverlapSize;
+    PVOID OverlapStart;
+    ULONG PageShift;
+    ULONG PageSize;
+    PSYSTEM_CALL_ADVISE_MEMORY Parameters;
+    PKPROCESS Process;
+    PIMAGE_SECTION ReleaseSection;
+    PVOID SectionEnd;
+    PVOID SectionStart;
+    KSTATUS Status;
+    ULONGLONG TotalAdviseSize;
+
+    PageShift = MmPageShift();
+    PageSize = MmPageSize();
+    Parameters = (PSYSTEM_CALL_ADVISE_MEMORY)SystemCallParameter;
+    ReleaseSection = NULL;
+
+    //
+    // The address must be non-zero and a page-aligned.
+    //
+
+    if ((Parameters->Address == NULL) ||
+        (IS_ALIGNED((UINTN)Parameters->Address, PageSize) == FALSE)) {
+
+        Status = STATUS_INVALID_PARAMETER;
+        goto SysAdviseMemoryEnd;
+    }
+
+    if ((Parameters->Advice < MemoryAdviceNormal) ||
+        (Parameters->Advice >= MemoryAdviceCount)) {
+
+        Status = STATUS_INVALID_PARAMETER;
+        goto SysAdviseMemoryEnd;
+    }
+
+    if (Parameters->Size == 0) {
+        Status = STATUS_SUCCESS;
+        goto SysAdviseMemoryEnd;
+    }
+
+    //
+    // If the specified range is not all within user mode, then fail.
+    //
+
+    if ((Parameters->Address + Parameters->Size < Parameters->Address) ||
+        ((Parameters->Address + Parameters->Size) > USER_VA_END)) {
+
+        Status = STATUS_INVALID_ADDRESS_RANGE;
+        goto SysAdviseMemoryEnd;
+    }
+
+    //
+    // Loop over the current process' image sections, applying the advice to
+    // the portion of each that overlaps the region.
+    //
+
+    AlignedSize = ALIGN_RANGE_UP(Parameters->Size, PageSize);
+    Status = STATUS_SUCCESS;
+    TotalAdviseSize = 0;
+    Process = PsGetCurrentProcess();
+    AddressSpace = Process->AddressSpace;
+    AdviseRegionStart = Parameters->Address;
+    AdviseRegionEnd = AdviseRegionStart + AlignedSize;
+    MmAcquireAddressSpaceLock(AddressSpace);
+    LockHeld = TRUE;
+    CurrentEntry = AddressSpace->SectionListHead.Next;
+    while (CurrentEntry != &(AddressSpace->SectionListHead)) {
+        CurrentSection = LIST_VALUE(CurrentEntry,
+                                    IMAGE_SECTION,
+                                    AddressListEntry);
+
+        SectionStart = CurrentSection->VirtualAddress;
+        SectionEnd = SectionStart + CurrentSection->Size;
+        if ((SectionStart >= AdviseRegionEnd) ||
+            (SectionEnd <= AdviseRegionStart)) {
+
+            CurrentEntry = CurrentEntry->Next;
+            continue;
+        }
+
+        OverlapStart = SectionStart;
+        if (SectionStart < AdviseRegionStart) {
+            OverlapStart = AdviseRegionStart;
+        }
+
+        if (SectionEnd < AdviseRegionEnd) {
+            OverlapSize = SectionEnd - OverlapStart;
+
+        } else {
+            OverlapSize = AdviseRegionEnd - OverlapStart;
+        }
+
+        ASSERT(OverlapSize != 0);
+
+        TotalAdviseSize += OverlapSize;
+
+        //
+        // Release the lock and process the current section, as prefetching
+        // may need to wait on I/O.
+        //
+
+        MmpImageSectionAddReference(CurrentSection);
+        MmReleaseAddressSpaceLock(AddressSpace);
+        LockHeld = FALSE;
+        if (ReleaseSection != NULL) {
+            MmpImageSectionReleaseReference(ReleaseSection);
+            ReleaseSection = NULL;
+        }
+
+        ReleaseSection = CurrentSection;
+        OverlapPageCount = OverlapSize >> PageShift;
+        OverlapPageOffset = (OverlapStart - SectionStart) >> PageShift;
+        Status = MmpAdviseImageSectionRegion(CurrentSection,
+                                             OverlapPageOffset,
+                                             OverlapPageCount,
+                                             Parameters->Advice);
+
+        if (!KSUCCESS(Status)) {
+            goto SysAdviseMemoryEnd;
+        }
+
+        if (SectionEnd >= AdviseRegionEnd) {
+            break;
+        }
+
+        //
+        // Reacquire the lock and try to continue forward in the image section
+        // list. If the current image section was removed, restart from the
+        // beginning.
+        //
+
+        MmAcquireAddressSpaceLock(AddressSpace);
+        LockHeld = TRUE;
+        if (CurrentSection->AddressListEntry.Next == NULL) {
+            CurrentEntry = AddressSpace->SectionListHead.Next;
+            TotalAdviseSize = 0;
+
+        } else {
+            CurrentEntry = CurrentEntry->Next;
+        }
+    }
+
+    if (LockHeld != FALSE) {
+        MmReleaseAddressSpaceLock(AddressSpace);
+        LockHeld = FALSE;
+    }
+
+    //
+    // If the advice did not cover the whole requested range, then some
+    // portion of it was not mapped.
+    //
+
+    if (TotalAdviseSize != AlignedSize) {
+        Status = STATUS_INVALID_ADDRESS_RANGE;
+        goto SysAdviseMemoryEnd;
+    }
+
+SysAdviseMemoryEnd:
+    if (ReleaseSection != NULL) {
+        MmpImageSectionReleaseReference(ReleaseSection);
+    }
+
+    return Status;
+}
+
 VOID
 MmCleanUpProcessMemory (
     PADDRESS_SPACE AddressSpace,
@@ -390,6 +390,15 @@ extern PKEVENT MmPagingFreePagesEvent;
 
 extern KSPIN_LOCK MmInvalidateIpiLock;
 
+//
+// Store the number of large pages currently mapped, and the number of times
+// regions have been promoted to or split from large pages.
+//
+
+extern UINTN MmLargePageCount;
+extern UINTN MmLargePagePromotions;
+extern UINTN MmLargePageSplits;
+
 //
 // Define cache line sizes for the CPU L1 caches.
 //
@@ -492,6 +501,69 @@ Return Value:
 
 --*/
 
+PHYSICAL_ADDRESS
+MmpTryAllocatePhysicalPages (
+    UINTN PageCount,
+    UINTN Alignment
+    );
+
+/*++
+
+Routine Description:
+
+    This routine attempts to allocate a run of physical pages without waiting
+    for memory to be freed and without dipping into the reserve held back for
+    when memory is low. All allocated pages start out as non-paged.
+
+Arguments:
+
+    PageCount - Supplies the number of consecutive physical pages required.
+
+    Alignment - Supplies the alignment requirement of the allocation, in pages.
+        Valid values are powers of 2. Values of 1 or 0 indicate no alignment
+        requirement.
+
+Return Value:
+
+    Returns the physical address of the first page of allocated memory on
+    success, or INVALID_PHYSICAL_ADDRESS if no such run is readily available.
+
+--*/
+
+PHYSICAL_ADDRESS
+MmpAllocatePhysicalPageInRun (
+    PHYSICAL_ADDRESS PreferredAddress,
+    UINTN RunPageCount,
+    UINTN RunOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine attempts to allocate a single physical page that sits at a
+    particular offset within a free, naturally aligned run of pages, so that
+    neighboring allocations can later be mapped with a large page. It does not
+    wait for memory to be freed. The page starts out as non-paged.
+
+Arguments:
+
+    PreferredAddress - Supplies the physical address that would continue an
+        existing run, or INVALID_PHYSICAL_ADDRESS if there is no preference.
+
+    RunPageCount - Supplies the size of the run in pages. This must be a power
+        of two.
+
+    RunOffset - Supplies the page offset within the run that the returned page
+        should occupy.
+
+Return Value:
+
+    Returns the physical address of the allocated page on success, or
+    INVALID_PHYSICAL_ADDRESS if no suitable page is readily available.
+
+--*/
+
 PHYSICAL_ADDRESS
 MmpAllocateIdentityMappablePhysicalPages (
     UINTN PageCount,
@@ -1123,6 +1195,69 @@ Return Value:
 
 --*/
 
+BOOL
+MmpWriteProtectSectionMappings (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress,
+    UINTN Size
+    );
+
+/*++
+
+Routine Description:
+
+    This routine converts all the mappings of the given virtual address region
+    in the current process to read-only for a copy-on-write fork, without
+    copying them anywhere. Page tables that the region covers entirely may be
+    write-protected at the directory level, deferring the per-page work until
+    the first write fault beneath them. The caller is responsible for flushing
+    the TLB.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the current address space.
+
+    VirtualAddress - Supplies the starting virtual address of the memory range.
+
+    Size - Supplies the size of the virtual address region, in bytes.
+
+Return Value:
+
+    TRUE if the region was write-protected. The copy can then fault its pages
+    in from the source on demand.
+
+    FALSE if this architecture needs the mappings copied up front with
+    MmpCopyAndChangeSectionMappings. Nothing was changed.
+
+--*/
+
+BOOL
+MmpResolveDeferredWriteProtection (
+    PVOID FaultingAddress
+    );
+
+/*++
+
+Routine Description:
+
+    This routine pushes write protection applied at the directory level down
+    into the page table covering the given user mode address, if there is any
+    such deferred protection. This routine must be called below dispatch
+    level.
+
+Arguments:
+
+    FaultingAddress - Supplies the address of the write fault.
+
+Return Value:
+
+    TRUE if deferred write protection was resolved, and the faulting access
+    should simply be retried.
+
+    FALSE if the fault requires further attention.
+
+--*/
+
 VOID
 MmpCreatePageTables (
     PVOID VirtualAddress,
@@ -1174,6 +1309,59 @@ Return Value:
 
 --*/
 
+BOOL
+MmpPromoteLargePage (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress
+    );
+
+/*++
+
+Routine Description:
+
+    This routine attempts to replace the page table covering the given address
+    with a single large page mapping. This only succeeds if every page in the
+    naturally aligned large page region is mapped to one naturally aligned,
+    physically contiguous run with identical attributes. The caller must
+    ensure that the mappings in the region cannot change concurrently.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space the address belongs
+        to. For user mode addresses, this must be the current address space.
+
+    VirtualAddress - Supplies a virtual address within the region to promote.
+
+Return Value:
+
+    TRUE if the region is now mapped by a large page.
+
+    FALSE if the region was not eligible for promotion.
+
+--*/
+
+UINTN
+MmpGetLargePageSize (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine returns the size of a large page on this architecture.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the large page size in bytes, or 0 if large pages are not
+    supported.
+
+--*/
+
 KSTATUS
 MmpAddAccountingDescriptor (
     PMEMORY_ACCOUNTING Accountant,
@@ -1720,6 +1908,38 @@ Return Value:
 
 --*/
 
+KSTATUS
+MmpAdviseImageSectionRegion (
+    PIMAGE_SECTION Section,
+    UINTN PageOffset,
+    UINTN PageCount,
+    MEMORY_ADVICE Advice
+    );
+
+/*++
+
+Routine Description:
+
+    This routine applies an access pattern hint to the specified region of the
+    given image section. It prefetches or discards pages, and passes access
+    pattern hints down to the backing image.
+
+Arguments:
+
+    Section - Supplies a pointer to the image section.
+
+    PageOffset - Supplies the offset, in pages, to the start of the region.
+
+    PageCount - Supplies the number of pages in the region.
+
+    Advice - Supplies the access pattern hint.
+
+Return Value:
+
+    Status code.
+
+--*/
+
 VOID
 MmpImageSectionAddReference (
     PIMAGE_SECTION ImageSection
@@ -2125,7 +2345,10 @@ MmpSendTlbInvalidateIpi (
 
 Routine Description:
 
-    This routine invalidates the given TLB entry on all active processors.
+    This routine invalidates the given TLB entries on all processors that may
+    have them cached. Kernel mode addresses are invalidated on every active
+    processor. User mode addresses are only invalidated on the processors
+    that currently have the given address space loaded.
 
 Arguments:
 
@@ -2133,7 +2356,65 @@ Routine Description:
 
     VirtualAddress - Supplies the virtual address to invalidate.
 
-    PageCount - Supplies the number of pages to invalidate.
+    PageCount - Supplies the number of pages to invalidate. Large user mode
+        ranges result in the entire TLB being flushed on each target
+        processor.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+MmpFlushAddressSpaceTlb (
+    PADDRESS_SPACE AddressSpace
+    );
+
+/*++
+
+Routine Description:
+
+    This routine flushes all user mode TLB entries for the given address space
+    on every processor that has it loaded. This is used to batch up changes
+    that touch large portions of an address space, such as converting it to
+    copy-on-write.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space to flush.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+MmpUpdateAddressSpaceProcessors (
+    PADDRESS_SPACE AddressSpace,
+    ULONG ProcessorNumber,
+    BOOL Active
+    );
+
+/*++
+
+Routine Description:
+
+    This routine marks whether or not the given processor has the address
+    space loaded. When switching address spaces, the new space must be marked
+    active before it is loaded, and the old space must only be marked inactive
+    after the switch.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space being switched to
+        or from.
+
+    ProcessorNumber - Supplies the number of the current processor.
+
+    Active - Supplies a boolean indicating whether the processor is loading
+        (TRUE) or leaving (FALSE) the address space.
 
 Return Value:
 
@@ -2430,6 +2711,77 @@ Return Value:
 
 --*/
 
+BOOL
+MmpLargePageFitsRange (
+    PVOID RangeStart,
+    UINTN RangeSize,
+    PVOID VirtualAddress,
+    UINTN LargePageSize
+    );
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the naturally aligned large page
+    containing the given address lies entirely within a range.
+
+Arguments:
+
+    RangeStart - Supplies the starting address of the range.
+
+    RangeSize - Supplies the size of the range in bytes.
+
+    VirtualAddress - Supplies an address within the range.
+
+    LargePageSize - Supplies the size of a large page, which must be a power
+        of two. Supply 0 if large pages are not supported.
+
+Return Value:
+
+    TRUE if the whole large page fits within the range.
+
+    FALSE otherwise.
+
+--*/
+
+PHYSICAL_ADDRESS
+MmpGetLargePageNeighborHint (
+    PVOID VirtualAddress,
+    PVOID NeighborAddress,
+    PHYSICAL_ADDRESS NeighborPhysical,
+    UINTN LargePageSize
+    );
+
+/*++
+
+Routine Description:
+
+    This routine determines the physical page that would extend the same
+    naturally aligned physical run as an already mapped neighboring page, so
+    that the large page region can later be promoted.
+
+Arguments:
+
+    VirtualAddress - Supplies the page aligned address about to be mapped.
+
+    NeighborAddress - Supplies the page aligned address of a neighboring page
+        in the same large page region.
+
+    NeighborPhysical - Supplies the physical address the neighbor is mapped
+        to, or INVALID_PHYSICAL_ADDRESS if it is not mapped.
+
+    LargePageSize - Supplies the size of a large page, which must be a power
+        of two.
+
+Return Value:
+
+    Returns the preferred physical address for the new page, or
+    INVALID_PHYSICAL_ADDRESS if the neighbor is not part of a suitably placed
+    run.
+
+--*/
+
 BOOL
 MmpCheckUserModeCopyRoutines (
     PTRAP_FRAME TrapFrame
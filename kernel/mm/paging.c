@@ -75,6 +75,7 @@ Module Name:
 #define PAGE_IN_CONTEXT_FLAG_ALLOCATE_IRP        0x00000002
 #define PAGE_IN_CONTEXT_FLAG_ALLOCATE_SWAP_SPACE 0x00000004
 #define PAGE_IN_CONTEXT_FLAG_ALLOCATE_MASK       0x00000007
+#define PAGE_IN_CONTEXT_FLAG_LARGE_PAGE          0x00000008
 
 //
 // ------------------------------------------------------ Data Type Definitions
@@ -107,6 +108,13 @@ Structure Description:
     Flags - Stores a bitmask of page in context flags. See
         PAGE_IN_CONTEXT_FLAG_* for definitions.
 
+    PreferredPhysicalAddress - Stores the physical address that would extend
+        the physical run of the page's neighbors, if the large page flag is
+        set.
+
+    LargePageOffset - Stores the page offset of the faulting page within its
+        large page region, if the large page flag is set.
+
 --*/
 
 typedef struct _PAGE_IN_CONTEXT {
@@ -116,6 +124,8 @@ typedef struct _PAGE_IN_CONTEXT {
     PMEMORY_RESERVATION SwapSpace;
     PPAGING_ENTRY PagingEntry;
     ULONG Flags;
+    PHYSICAL_ADDRESS PreferredPhysicalAddress;
+    UINTN LargePageOffset;
 } PAGE_IN_CONTEXT, *PPAGE_IN_CONTEXT;
 
 /*++
@@ -315,6 +325,13 @@ MmpMapPageInSection (
     BOOL LockPage
     );
 
+PHYSICAL_ADDRESS
+MmpMapInheritedPage (
+    PIMAGE_SECTION Section,
+    PIMAGE_SECTION OwningSection,
+    UINTN PageOffset
+    );
+
 KSTATUS
 MmpAllocatePageInStructures (
     PIMAGE_SECTION Section,
@@ -333,6 +350,19 @@ MmpCanWriteToSection (
     UINTN PageOffset
     );
 
+VOID
+MmpPrepareLargePageAllocation (
+    PIMAGE_SECTION Section,
+    PVOID VirtualAddress,
+    PPAGE_IN_CONTEXT Context
+    );
+
+BOOL
+MmpIsLargePageCandidate (
+    PIMAGE_SECTION Section,
+    PVOID VirtualAddress
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -2071,6 +2101,129 @@ Return Value:
     return;
 }
 
+BOOL
+MmpLargePageFitsRange (
+    PVOID RangeStart,
+    UINTN RangeSize,
+    PVOID VirtualAddress,
+    UINTN LargePageSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the naturally aligned large page
+    containing the given address lies entirely within a range.
+
+Arguments:
+
+    RangeStart - Supplies the starting address of the range.
+
+    RangeSize - Supplies the size of the range in bytes.
+
+    VirtualAddress - Supplies an address within the range.
+
+    LargePageSize - Supplies the size of a large page, which must be a power
+        of two. Supply 0 if large pages are not supported.
+
+Return Value:
+
+    TRUE if the whole large page fits within the range.
+
+    FALSE otherwise.
+
+--*/
+
+{
+
+    PVOID Base;
+
+    if ((LargePageSize == 0) ||
+        (VirtualAddress < RangeStart) ||
+        (VirtualAddress >= RangeStart + RangeSize)) {
+
+        return FALSE;
+    }
+
+    Base = ALIGN_POINTER_DOWN(VirtualAddress, LargePageSize);
+    if ((Base < RangeStart) ||
+        ((UINTN)(Base - RangeStart) + LargePageSize > RangeSize)) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+PHYSICAL_ADDRESS
+MmpGetLargePageNeighborHint (
+    PVOID VirtualAddress,
+    PVOID NeighborAddress,
+    PHYSICAL_ADDRESS NeighborPhysical,
+    UINTN LargePageSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines the physical page that would extend the same
+    naturally aligned physical run as an already mapped neighboring page, so
+    that the large page region can later be promoted.
+
+Arguments:
+
+    VirtualAddress - Supplies the page aligned address about to be mapped.
+
+    NeighborAddress - Supplies the page aligned address of a neighboring page
+        in the same large page region.
+
+    NeighborPhysical - Supplies the physical address the neighbor is mapped
+        to, or INVALID_PHYSICAL_ADDRESS if it is not mapped.
+
+    LargePageSize - Supplies the size of a large page, which must be a power
+        of two.
+
+Return Value:
+
+    Returns the preferred physical address for the new page, or
+    INVALID_PHYSICAL_ADDRESS if the neighbor is not part of a suitably placed
+    run.
+
+--*/
+
+{
+
+    UINTN LargePageMask;
+    PHYSICAL_ADDRESS Physical;
+
+    LargePageMask = LargePageSize - 1;
+    if ((NeighborPhysical == INVALID_PHYSICAL_ADDRESS) ||
+        (LargePageSize == 0) ||
+        (ALIGN_POINTER_DOWN(VirtualAddress, LargePageSize) !=
+         ALIGN_POINTER_DOWN(NeighborAddress, LargePageSize))) {
+
+        return INVALID_PHYSICAL_ADDRESS;
+    }
+
+    //
+    // The neighbor has to sit at the same offset within its physical large
+    // page as it does within the virtual one, or no run could ever line up.
+    //
+
+    if ((NeighborPhysical & LargePageMask) !=
+        ((UINTN)NeighborAddress & LargePageMask)) {
+
+        return INVALID_PHYSICAL_ADDRESS;
+    }
+
+    Physical = (NeighborPhysical & ~(PHYSICAL_ADDRESS)LargePageMask) +
+               ((UINTN)VirtualAddress & LargePageMask);
+
+    return Physical;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -2807,6 +2960,25 @@ Return Value:
             break;
         }
 
+        //
+        // A copy made by fork does not get its parent's pages mapped up
+        // front. If an ancestor already has the page, share it.
+        //
+
+        if ((OwningSection != ImageSection) &&
+            ((ImageSection->Flags & IMAGE_SECTION_DESTROYED) == 0) &&
+            (PageOffset < (ImageSection->Size >> PageShift))) {
+
+            ExistingPhysicalAddress = MmpMapInheritedPage(ImageSection,
+                                                          OwningSection,
+                                                          PageOffset);
+
+            if (ExistingPhysicalAddress != INVALID_PHYSICAL_ADDRESS) {
+                Status = STATUS_SUCCESS;
+                break;
+            }
+        }
+
         //
         // Figure out if the page is clean or dirty.
         //
@@ -2833,6 +3005,10 @@ Return Value:
             //
 
             if (Context.PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
+                MmpPrepareLargePageAllocation(ImageSection,
+                                              VirtualAddress,
+                                              &Context);
+
                 KeReleaseQueuedLock(ImageSection->Lock);
                 MmpImageSectionReleaseReference(OwningSection);
                 if (RootSection != NULL) {
@@ -3027,6 +3203,20 @@ Return Value:
 
                 Context.PagingEntry = NULL;
                 Context.PhysicalAddress = INVALID_PHYSICAL_ADDRESS;
+
+                //
+                // If this page may have completed a physically contiguous
+                // large page region, try to map the region with a large page.
+                // The section lock keeps the mappings still.
+                //
+
+                if (((Context.Flags & PAGE_IN_CONTEXT_FLAG_LARGE_PAGE) != 0) &&
+                    (MmpIsLargePageCandidate(ImageSection, VirtualAddress) !=
+                     FALSE)) {
+
+                    MmpPromoteLargePage(ImageSection->AddressSpace,
+                                        VirtualAddress);
+                }
             }
         }
     }
@@ -5238,6 +5428,96 @@ Return Value:
     return;
 }
 
+PHYSICAL_ADDRESS
+MmpMapInheritedPage (
+    PIMAGE_SECTION Section,
+    PIMAGE_SECTION OwningSection,
+    UINTN PageOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine maps a page that the given section inherits into that
+    section, if the owning section already has the page mapped. Copies made by
+    fork are not populated up front, so they pick up the pages they share with
+    their ancestors this way as they touch them. This routine assumes the
+    section lock is held.
+
+Arguments:
+
+    Section - Supplies a pointer to the inheriting image section. It must
+        belong to the current process.
+
+    OwningSection - Supplies a pointer to the ancestor section that owns the
+        page.
+
+    PageOffset - Supplies the offset in pages from the beginning of the section
+        where this page belongs.
+
+Return Value:
+
+    Returns the physical address that was mapped.
+
+    INVALID_PHYSICAL_ADDRESS if the owning section does not have the page
+    mapped.
+
+--*/
+
+{
+
+    BOOL CanWrite;
+    ULONG MapFlags;
+    ULONG PageShift;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    PVOID VirtualAddress;
+
+    ASSERT(KeIsQueuedLockHeld(Section->Lock) != FALSE);
+    ASSERT(Section->AddressSpace == PsGetCurrentProcess()->AddressSpace);
+    ASSERT(OwningSection->AddressSpace != Section->AddressSpace);
+
+    PageShift = MmPageShift();
+    VirtualAddress = Section->VirtualAddress + (PageOffset << PageShift);
+
+    ASSERT(VirtualAddress < USER_VA_END);
+
+    PhysicalAddress = MmpVirtualToPhysicalInOtherProcess(
+                                                    OwningSection->AddressSpace,
+                                                    VirtualAddress);
+
+    if (PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
+        return INVALID_PHYSICAL_ADDRESS;
+    }
+
+    MapFlags = Section->MapFlags | MAP_FLAG_PAGABLE | MAP_FLAG_USER_MODE;
+    if ((Section->Flags & IMAGE_SECTION_EXECUTABLE) != 0) {
+        MapFlags |= MAP_FLAG_EXECUTE;
+    }
+
+    if ((Section->Flags &
+         (IMAGE_SECTION_READABLE | IMAGE_SECTION_WRITABLE)) != 0) {
+
+        MapFlags |= MAP_FLAG_PRESENT;
+    }
+
+    CanWrite = MmpCanWriteToSection(OwningSection, Section, PageOffset);
+    if (CanWrite == FALSE) {
+        MapFlags |= MAP_FLAG_READ_ONLY;
+    }
+
+    MmpMapPage(PhysicalAddress, VirtualAddress, MapFlags);
+    if (Section->MinTouched > VirtualAddress) {
+        Section->MinTouched = VirtualAddress;
+    }
+
+    if (Section->MaxTouched < VirtualAddress + (1 << PageShift)) {
+        Section->MaxTouched = VirtualAddress + (1 << PageShift);
+    }
+
+    return PhysicalAddress;
+}
+
 KSTATUS
 MmpAllocatePageInStructures (
     PIMAGE_SECTION Section,
@@ -5279,10 +5559,24 @@ Return Value:
         ASSERT(Context->PhysicalAddress == INVALID_PHYSICAL_ADDRESS);
         ASSERT(Context->PagingEntry == NULL);
 
-        Context->PhysicalAddress = MmpAllocatePhysicalPages(1, 1);
+        //
+        // Try to place the page where it can later become part of a large
+        // page, but don't wait around for memory to do it.
+        //
+
+        if ((Context->Flags & PAGE_IN_CONTEXT_FLAG_LARGE_PAGE) != 0) {
+            Context->PhysicalAddress = MmpAllocatePhysicalPageInRun(
+                                  Context->PreferredPhysicalAddress,
+                                  MmpGetLargePageSize() >> MmPageShift(),
+                                  Context->LargePageOffset);
+        }
+
         if (Context->PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
-            Status = STATUS_NO_MEMORY;
-            goto AllocatePageInStructuresEnd;
+            Context->PhysicalAddress = MmpAllocatePhysicalPages(1, 1);
+            if (Context->PhysicalAddress == INVALID_PHYSICAL_ADDRESS) {
+                Status = STATUS_NO_MEMORY;
+                goto AllocatePageInStructuresEnd;
+            }
         }
 
         //
@@ -5520,3 +5814,128 @@ Return Value:
     return CanWrite;
 }
 
+VOID
+MmpPrepareLargePageAllocation (
+    PIMAGE_SECTION Section,
+    PVOID VirtualAddress,
+    PPAGE_IN_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether a page about to be faulted into an
+    anonymous section should be placed so that its large page region can be
+    promoted, and if so records the placement in the page in context. The
+    section lock must be held.
+
+Arguments:
+
+    Section - Supplies a pointer to the faulting image section.
+
+    VirtualAddress - Supplies the page aligned address being faulted in.
+
+    Context - Supplies a pointer to the page in context.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UINTN LargePageSize;
+    PVOID Neighbor;
+    ULONG PageSize;
+
+    Context->Flags &= ~PAGE_IN_CONTEXT_FLAG_LARGE_PAGE;
+    Context->PreferredPhysicalAddress = INVALID_PHYSICAL_ADDRESS;
+    if (MmpIsLargePageCandidate(Section, VirtualAddress) == FALSE) {
+        return;
+    }
+
+    //
+    // Look at the previous page, or the next one for the first page of the
+    // region, to try to continue its physical run.
+    //
+
+    LargePageSize = MmpGetLargePageSize();
+    PageSize = MmPageSize();
+    Neighbor = VirtualAddress - PageSize;
+    if (IS_POINTER_ALIGNED(VirtualAddress, LargePageSize)) {
+        Neighbor = VirtualAddress + PageSize;
+    }
+
+    Context->PreferredPhysicalAddress = MmpGetLargePageNeighborHint(
+                                         VirtualAddress,
+                                         Neighbor,
+                                         MmpVirtualToPhysical(Neighbor, NULL),
+                                         LargePageSize);
+
+    Context->LargePageOffset = ((UINTN)VirtualAddress & (LargePageSize - 1)) >>
+                               MmPageShift();
+
+    Context->Flags |= PAGE_IN_CONTEXT_FLAG_LARGE_PAGE;
+    return;
+}
+
+BOOL
+MmpIsLargePageCandidate (
+    PIMAGE_SECTION Section,
+    PVOID VirtualAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine determines whether the large page region containing the
+    given address in an anonymous section could be mapped with a large page.
+    Only private sections of the current process that are not shared through
+    fork with any other section qualify, since copy-on-write and paging work
+    on small pages. The section lock must be held.
+
+Arguments:
+
+    Section - Supplies a pointer to the image section.
+
+    VirtualAddress - Supplies an address within the section.
+
+Return Value:
+
+    TRUE if the region is a candidate for a large page.
+
+    FALSE otherwise.
+
+--*/
+
+{
+
+    PKPROCESS Process;
+
+    if ((Section->Flags &
+         (IMAGE_SECTION_SHARED | IMAGE_SECTION_BACKED |
+          IMAGE_SECTION_DESTROYING | IMAGE_SECTION_DESTROYED)) != 0) {
+
+        return FALSE;
+    }
+
+    if ((Section->Parent != NULL) ||
+        (LIST_EMPTY(&(Section->ChildList)) == FALSE) ||
+        (VirtualAddress >= KERNEL_VA_START)) {
+
+        return FALSE;
+    }
+
+    Process = PsGetCurrentProcess();
+    if (Section->AddressSpace != Process->AddressSpace) {
+        return FALSE;
+    }
+
+    return MmpLargePageFitsRange(Section->VirtualAddress,
+                                 Section->Size,
+                                 VirtualAddress,
+                                 MmpGetLargePageSize());
+}
@@ -249,6 +249,13 @@ MmpUpdatePhysicalMemoryStatistics (
     BOOL Allocation
     );
 
+BOOL
+MmpClaimFreePhysicalPages (
+    PPHYSICAL_MEMORY_SEGMENT Segment,
+    UINTN SegmentOffset,
+    UINTN PageCount
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -482,6 +489,112 @@ Return Value:
     return MmTotalPhysicalPages - MmTotalAllocatedPhysicalPages;
 }
 
+KSTATUS
+MmEnumerateCrashDumpPages (
+    PMM_CRASH_DUMP_PAGE_ROUTINE Routine,
+    PVOID Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine walks the physical page database on behalf of the crash dump
+    writer, calling the given routine with a temporary mapping of each page
+    whose contents would be lost with the system. Free pages and page cache
+    pages that match their backing store are skipped. It takes no locks, and
+    must only be called at high run level once the system has crashed.
+
+Arguments:
+
+    Routine - Supplies a pointer to the routine to call for each page.
+
+    Context - Supplies a context pointer passed to the routine.
+
+Return Value:
+
+    STATUS_SUCCESS if every page was enumerated.
+
+    Otherwise, returns the first failing status from the routine.
+
+--*/
+
+{
+
+    PLIST_ENTRY CurrentEntry;
+    UINTN PageCount;
+    UINTN PageIndex;
+    ULONG PageShift;
+    PPAGE_CACHE_ENTRY PageCacheEntry;
+    PHYSICAL_ADDRESS PhysicalAddress;
+    PPHYSICAL_PAGE PhysicalPage;
+    PPROCESSOR_BLOCK ProcessorBlock;
+    PPHYSICAL_MEMORY_SEGMENT Segment;
+    KSTATUS Status;
+    PVOID SwapPage;
+
+    ASSERT(KeGetRunLevel() == RunLevelHigh);
+
+    //
+    // Borrow this processor's swap page to map each page in turn. It may
+    // have been in use when the system went down, so clear it out first.
+    // Nothing else will run on this processor, so the local TLB is the only
+    // one that needs invalidating.
+    //
+
+    PageShift = MmPageShift();
+    ProcessorBlock = KeGetCurrentProcessorBlock();
+    SwapPage = ProcessorBlock->SwapPage;
+    MmpUnmapPages(SwapPage, 1, 0, NULL);
+    Status = STATUS_SUCCESS;
+    CurrentEntry = MmPhysicalSegmentListHead.Next;
+    while (CurrentEntry != &MmPhysicalSegmentListHead) {
+        Segment = LIST_VALUE(CurrentEntry, PHYSICAL_MEMORY_SEGMENT, ListEntry);
+        CurrentEntry = CurrentEntry->Next;
+        PhysicalPage = (PPHYSICAL_PAGE)(Segment + 1);
+        PageCount = (Segment->EndAddress - Segment->StartAddress) >> PageShift;
+        for (PageIndex = 0; PageIndex < PageCount; PageIndex += 1) {
+            if (PhysicalPage[PageIndex].U.Free == PHYSICAL_PAGE_FREE) {
+                continue;
+            }
+
+            //
+            // Clean page cache pages can be read back from disk, so leave
+            // them out.
+            //
+
+            if ((PhysicalPage[PageIndex].U.Flags &
+                 PHYSICAL_PAGE_FLAG_NON_PAGED) != 0) {
+
+                PageCacheEntry = PhysicalPage[PageIndex].U.PageCacheEntry;
+                PageCacheEntry = (PVOID)((UINTN)PageCacheEntry &
+                                         ~PHYSICAL_PAGE_FLAG_NON_PAGED);
+
+                if ((PageCacheEntry != NULL) &&
+                    (IoIsPageCacheEntryDirty(PageCacheEntry) == FALSE)) {
+
+                    continue;
+                }
+            }
+
+            PhysicalAddress = Segment->StartAddress +
+                              ((PHYSICAL_ADDRESS)PageIndex << PageShift);
+
+            MmpMapPage(PhysicalAddress,
+                       SwapPage,
+                       MAP_FLAG_PRESENT | MAP_FLAG_GLOBAL | MAP_FLAG_READ_ONLY);
+
+            Status = Routine(Context, PhysicalAddress, SwapPage);
+            MmpUnmapPages(SwapPage, 1, 0, NULL);
+            if (!KSUCCESS(Status)) {
+                return Status;
+            }
+        }
+    }
+
+    return Status;
+}
+
 VOID
 MmFreePhysicalPages (
     PHYSICAL_ADDRESS PhysicalAddress,
@@ -1099,6 +1212,218 @@ Return Value:
     return WorkingAllocation;
 }
 
+PHYSICAL_ADDRESS
+MmpTryAllocatePhysicalPages (
+    UINTN PageCount,
+    UINTN Alignment
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to allocate a run of physical pages without waiting
+    for memory to be freed and without dipping into the reserve held back for
+    when memory is low. All allocated pages start out as non-paged.
+
+Arguments:
+
+    PageCount - Supplies the number of consecutive physical pages required.
+
+    Alignment - Supplies the alignment requirement of the allocation, in pages.
+        Valid values are powers of 2. Values of 1 or 0 indicate no alignment
+        requirement.
+
+Return Value:
+
+    Returns the physical address of the first page of allocated memory on
+    success, or INVALID_PHYSICAL_ADDRESS if no such run is readily available.
+
+--*/
+
+{
+
+    PHYSICAL_ADDRESS Allocation;
+    PPHYSICAL_MEMORY_SEGMENT Segment;
+    UINTN SegmentOffset;
+    BOOL SignalEvent;
+
+    Allocation = INVALID_PHYSICAL_ADDRESS;
+    SignalEvent = FALSE;
+    if (Alignment == 0) {
+        Alignment = 1;
+    }
+
+    if (MmPhysicalPageLock != NULL) {
+        KeAcquireQueuedLock(MmPhysicalPageLock);
+    }
+
+    if ((MmTotalPhysicalPages - MmTotalAllocatedPhysicalPages) <
+        (MmMinimumFreePhysicalPages + PageCount)) {
+
+        goto TryAllocatePhysicalPagesEnd;
+    }
+
+    Segment = MmpFindPhysicalPages(PageCount,
+                                   Alignment,
+                                   PhysicalMemoryFindFree,
+                                   &SegmentOffset,
+                                   NULL);
+
+    if (Segment != NULL) {
+        Allocation = Segment->StartAddress + (SegmentOffset << MmPageShift());
+        SignalEvent = MmpClaimFreePhysicalPages(Segment,
+                                                SegmentOffset,
+                                                PageCount);
+    }
+
+TryAllocatePhysicalPagesEnd:
+    if (MmPhysicalPageLock != NULL) {
+        KeReleaseQueuedLock(MmPhysicalPageLock);
+    }
+
+    if (SignalEvent != FALSE) {
+
+        ASSERT(MmPhysicalMemoryWarningEvent != NULL);
+
+        KeSignalEvent(MmPhysicalMemoryWarningEvent, SignalOptionPulse);
+    }
+
+    return Allocation;
+}
+
+PHYSICAL_ADDRESS
+MmpAllocatePhysicalPageInRun (
+    PHYSICAL_ADDRESS PreferredAddress,
+    UINTN RunPageCount,
+    UINTN RunOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to allocate a single physical page that sits at a
+    particular offset within a free, naturally aligned run of pages, so that
+    neighboring allocations can later be mapped with a large page. It does not
+    wait for memory to be freed. The page starts out as non-paged.
+
+Arguments:
+
+    PreferredAddress - Supplies the physical address that would continue an
+        existing run, or INVALID_PHYSICAL_ADDRESS if there is no preference.
+
+    RunPageCount - Supplies the size of the run in pages. This must be a power
+        of two.
+
+    RunOffset - Supplies the page offset within the run that the returned page
+        should occupy.
+
+Return Value:
+
+    Returns the physical address of the allocated page on success, or
+    INVALID_PHYSICAL_ADDRESS if no suitable page is readily available.
+
+--*/
+
+{
+
+    PHYSICAL_ADDRESS Allocation;
+    PLIST_ENTRY CurrentEntry;
+    PPHYSICAL_PAGE PhysicalPage;
+    ULONG PageShift;
+    PPHYSICAL_MEMORY_SEGMENT Segment;
+    UINTN SegmentOffset;
+    BOOL SignalEvent;
+
+    ASSERT(POWER_OF_2(RunPageCount) != FALSE);
+    ASSERT(RunOffset < RunPageCount);
+
+    Allocation = INVALID_PHYSICAL_ADDRESS;
+    PageShift = MmPageShift();
+    SignalEvent = FALSE;
+    if (MmPhysicalPageLock != NULL) {
+        KeAcquireQueuedLock(MmPhysicalPageLock);
+    }
+
+    //
+    // Don't bother building runs when memory is tight, as the pages would
+    // just get paged out and split again.
+    //
+
+    if ((MmTotalPhysicalPages - MmTotalAllocatedPhysicalPages) <
+        (MmMinimumFreePhysicalPages + RunPageCount)) {
+
+        goto AllocatePhysicalPageInRunEnd;
+    }
+
+    //
+    // Take the preferred page if it is free.
+    //
+
+    if (PreferredAddress != INVALID_PHYSICAL_ADDRESS) {
+        CurrentEntry = MmPhysicalSegmentListHead.Next;
+        while (CurrentEntry != &MmPhysicalSegmentListHead) {
+            Segment = LIST_VALUE(CurrentEntry,
+                                 PHYSICAL_MEMORY_SEGMENT,
+                                 ListEntry);
+
+            CurrentEntry = CurrentEntry->Next;
+            if ((PreferredAddress < Segment->StartAddress) ||
+                (PreferredAddress >= Segment->EndAddress)) {
+
+                continue;
+            }
+
+            SegmentOffset = (PreferredAddress - Segment->StartAddress) >>
+                            PageShift;
+
+            PhysicalPage = (PPHYSICAL_PAGE)(Segment + 1) + SegmentOffset;
+            if (PhysicalPage->U.Free == PHYSICAL_PAGE_FREE) {
+                Allocation = PreferredAddress;
+                SignalEvent = MmpClaimFreePhysicalPages(Segment,
+                                                        SegmentOffset,
+                                                        1);
+
+                goto AllocatePhysicalPageInRunEnd;
+            }
+
+            break;
+        }
+    }
+
+    //
+    // Otherwise start a new run in a completely free aligned block, leaving
+    // the rest of the block free for the neighboring pages.
+    //
+
+    Segment = MmpFindPhysicalPages(RunPageCount,
+                                   RunPageCount,
+                                   PhysicalMemoryFindFree,
+                                   &SegmentOffset,
+                                   NULL);
+
+    if (Segment != NULL) {
+        SegmentOffset += RunOffset;
+        Allocation = Segment->StartAddress + (SegmentOffset << PageShift);
+        SignalEvent = MmpClaimFreePhysicalPages(Segment, SegmentOffset, 1);
+    }
+
+AllocatePhysicalPageInRunEnd:
+    if (MmPhysicalPageLock != NULL) {
+        KeReleaseQueuedLock(MmPhysicalPageLock);
+    }
+
+    if (SignalEvent != FALSE) {
+
+        ASSERT(MmPhysicalMemoryWarningEvent != NULL);
+
+        KeSignalEvent(MmPhysicalMemoryWarningEvent, SignalOptionPulse);
+    }
+
+    return Allocation;
+}
+
 PHYSICAL_ADDRESS
 MmpAllocateIdentityMappablePhysicalPages (
     UINTN PageCount,
@@ -3065,3 +3390,49 @@ Return Value:
     return SignalEvent;
 }
 
+BOOL
+MmpClaimFreePhysicalPages (
+    PPHYSICAL_MEMORY_SEGMENT Segment,
+    UINTN SegmentOffset,
+    UINTN PageCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks a run of free physical pages as allocated non-paged
+    pages. The physical page lock must be held.
+
+Arguments:
+
+    Segment - Supplies a pointer to the segment containing the pages.
+
+    SegmentOffset - Supplies the index of the first page within the segment.
+
+    PageCount - Supplies the number of pages to claim.
+
+Return Value:
+
+    Returns TRUE if the physical memory warning event should be signaled, or
+    FALSE otherwise.
+
+--*/
+
+{
+
+    UINTN PageIndex;
+    PPHYSICAL_PAGE PhysicalPage;
+
+    PhysicalPage = (PPHYSICAL_PAGE)(Segment + 1) + SegmentOffset;
+    for (PageIndex = 0; PageIndex < PageCount; PageIndex += 1) {
+
+        ASSERT(PhysicalPage->U.Free == PHYSICAL_PAGE_FREE);
+
+        PhysicalPage->U.Flags = PHYSICAL_PAGE_FLAG_NON_PAGED;
+        PhysicalPage += 1;
+    }
+
+    Segment->FreePages -= PageCount;
+    return MmpUpdatePhysicalMemoryStatistics(PageCount, TRUE);
+}
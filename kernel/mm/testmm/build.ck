@@ -38,7 +38,8 @@ function build() {
         "stubs.c",
         "testmm.c",
         "testmdl.c",
-        "testuva.c"
+        "testuva.c",
+        "testlp.c"
     ];
 
     buildLibs = [
@@ -0,0 +1,238 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    testlp.c
+
+Abstract:
+
+    This module contains tests for the large page placement helpers.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/kernel/kernel.h>
+#include "../mmp.h"
+#include "testmm.h"
+
+#include <stdio.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define TEST_LARGE_PAGE_SIZE 0x200000
+#define TEST_PAGE_SIZE 0x1000
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestLargePages (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests the helpers that decide where large pages can be used
+    and how physical pages should be placed to build them.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of test failures.
+
+--*/
+
+{
+
+    PVOID Base;
+    ULONG Failures;
+    PHYSICAL_ADDRESS Hint;
+    PHYSICAL_ADDRESS Physical;
+
+    Failures = 0;
+    Base = (PVOID)(UINTN)0x40000000;
+
+    //
+    // A range covering exactly one aligned large page fits anywhere inside.
+    //
+
+    if ((MmpLargePageFitsRange(Base,
+                               TEST_LARGE_PAGE_SIZE,
+                               Base,
+                               TEST_LARGE_PAGE_SIZE) == FALSE) ||
+        (MmpLargePageFitsRange(Base,
+                               TEST_LARGE_PAGE_SIZE,
+                               Base + TEST_LARGE_PAGE_SIZE - TEST_PAGE_SIZE,
+                               TEST_LARGE_PAGE_SIZE) == FALSE)) {
+
+        printf("LP: Aligned range did not fit a large page.\n");
+        Failures += 1;
+    }
+
+    //
+    // Ranges that stop short of or start past the large page boundary don't.
+    //
+
+    if (MmpLargePageFitsRange(Base,
+                              TEST_LARGE_PAGE_SIZE - TEST_PAGE_SIZE,
+                              Base,
+                              TEST_LARGE_PAGE_SIZE) != FALSE) {
+
+        printf("LP: Short range fit a large page.\n");
+        Failures += 1;
+    }
+
+    if (MmpLargePageFitsRange(Base + TEST_PAGE_SIZE,
+                              TEST_LARGE_PAGE_SIZE * 2,
+                              Base + TEST_PAGE_SIZE,
+                              TEST_LARGE_PAGE_SIZE) != FALSE) {
+
+        printf("LP: Unaligned range start fit a large page.\n");
+        Failures += 1;
+    }
+
+    //
+    // An unaligned range can still hold the aligned large page in its middle,
+    // but not the partial ones at either end.
+    //
+
+    if ((MmpLargePageFitsRange(Base + TEST_PAGE_SIZE,
+                               TEST_LARGE_PAGE_SIZE * 2,
+                               Base + TEST_LARGE_PAGE_SIZE,
+                               TEST_LARGE_PAGE_SIZE) == FALSE) ||
+        (MmpLargePageFitsRange(Base + TEST_PAGE_SIZE,
+                               TEST_LARGE_PAGE_SIZE * 2,
+                               Base + (TEST_LARGE_PAGE_SIZE * 2),
+                               TEST_LARGE_PAGE_SIZE) != FALSE)) {
+
+        printf("LP: Middle of unaligned range was handled wrong.\n");
+        Failures += 1;
+    }
+
+    //
+    // Addresses outside the range and a zero large page size never fit.
+    //
+
+    if ((MmpLargePageFitsRange(Base,
+                               TEST_LARGE_PAGE_SIZE,
+                               Base + TEST_LARGE_PAGE_SIZE,
+                               TEST_LARGE_PAGE_SIZE) != FALSE) ||
+        (MmpLargePageFitsRange(Base, TEST_LARGE_PAGE_SIZE, Base, 0) !=
+         FALSE)) {
+
+        printf("LP: Out of range address fit a large page.\n");
+        Failures += 1;
+    }
+
+    //
+    // A neighbor at the matching physical offset yields the next page of the
+    // run, in either direction.
+    //
+
+    Physical = 0x12200000 + (5 * TEST_PAGE_SIZE);
+    Hint = MmpGetLargePageNeighborHint(Base + (6 * TEST_PAGE_SIZE),
+                                       Base + (5 * TEST_PAGE_SIZE),
+                                       Physical,
+                                       TEST_LARGE_PAGE_SIZE);
+
+    if (Hint != Physical + TEST_PAGE_SIZE) {
+        printf("LP: Forward hint was 0x%llx, expected 0x%llx.\n",
+               Hint,
+               Physical + TEST_PAGE_SIZE);
+
+        Failures += 1;
+    }
+
+    Physical = 0x12200000 + TEST_PAGE_SIZE;
+    Hint = MmpGetLargePageNeighborHint(Base,
+                                       Base + TEST_PAGE_SIZE,
+                                       Physical,
+                                       TEST_LARGE_PAGE_SIZE);
+
+    if (Hint != 0x12200000) {
+        printf("LP: Backward hint was 0x%llx, expected 0x12200000.\n", Hint);
+        Failures += 1;
+    }
+
+    //
+    // A neighbor that isn't mapped, is misplaced within its physical large
+    // page, or is in another large page region gives no hint.
+    //
+
+    Hint = MmpGetLargePageNeighborHint(Base + TEST_PAGE_SIZE,
+                                       Base,
+                                       INVALID_PHYSICAL_ADDRESS,
+                                       TEST_LARGE_PAGE_SIZE);
+
+    if (Hint != INVALID_PHYSICAL_ADDRESS) {
+        printf("LP: Unmapped neighbor gave hint 0x%llx.\n", Hint);
+        Failures += 1;
+    }
+
+    Hint = MmpGetLargePageNeighborHint(Base + TEST_PAGE_SIZE,
+                                       Base,
+                                       0x12200000 + TEST_PAGE_SIZE,
+                                       TEST_LARGE_PAGE_SIZE);
+
+    if (Hint != INVALID_PHYSICAL_ADDRESS) {
+        printf("LP: Misplaced neighbor gave hint 0x%llx.\n", Hint);
+        Failures += 1;
+    }
+
+    Hint = MmpGetLargePageNeighborHint(Base + TEST_LARGE_PAGE_SIZE,
+                                       Base + TEST_LARGE_PAGE_SIZE -
+                                       TEST_PAGE_SIZE,
+                                       0x12200000 + TEST_LARGE_PAGE_SIZE -
+                                       TEST_PAGE_SIZE,
+                                       TEST_LARGE_PAGE_SIZE);
+
+    if (Hint != INVALID_PHYSICAL_ADDRESS) {
+        printf("LP: Neighbor across a large page gave hint 0x%llx.\n", Hint);
+        Failures += 1;
+    }
+
+    return Failures;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
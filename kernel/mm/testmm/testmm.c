@@ -105,6 +105,12 @@ Return Value:
         printf("\nUser VA test had %d failures.\n", Failures);
     }
 
+    TotalTestsFailed += Failures;
+    Failures = TestLargePages();
+    if (Failures != 0) {
+        printf("\nLarge page test had %d failures.\n", Failures);
+    }
+
     TotalTestsFailed += Failures;
 
     //
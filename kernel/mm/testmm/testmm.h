@@ -106,3 +106,25 @@ Return Value:
 
 --*/
 
+ULONG
+TestLargePages (
+    VOID
+    );
+
+/*++
+
+Routine Description:
+
+    This routine tests the helpers that decide where large pages can be used
+    and how physical pages should be placed to build them.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of test failures.
+
+--*/
+
@@ -169,6 +169,15 @@ UINTN MmVirtualMemoryWarningLevel1Trigger;
 
 UINTN MmFreeVirtualByteCount;
 
+//
+// Store the number of large pages currently mapped, and the number of times
+// regions have been promoted to or split from large pages.
+//
+
+UINTN MmLargePageCount;
+UINTN MmLargePagePromotions;
+UINTN MmLargePageSplits;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -1173,11 +1182,12 @@ Return Value:
     }
 
     //
-    // Invalidate the entire TLB as all the source process's writable image
-    // sections were converted to read-only image sections.
+    // Flush the source address space's TLB entries everywhere it's loaded in
+    // one go, as all the source process's writable image sections were
+    // converted to read-only image sections.
     //
 
-    ArInvalidateEntireTlb();
+    MmpFlushAddressSpaceTlb(Source);
 
     //
     // Map the user shared data page. The accounting descriptor will get copied
@@ -1908,6 +1918,8 @@ Return Value:
 
 {
 
+    PVOID LargeAddress;
+    UINTN LargePageCount;
     ULONG MapFlags;
     UINTN MapIndex;
     UINTN PageCount;
@@ -1947,9 +1959,54 @@ Return Value:
     PageCount = RangeSize >> PageShift;
     RunPageCount = PhysicalRunSize >> PageShift;
     PhysicalRunAlignment >>= PageShift;
+
+    //
+    // Kernel ranges with ordinary caching can be backed by large pages where
+    // the virtual range allows, if the larger run is compatible with what the
+    // caller asked for.
+    //
+
+    LargePageCount = 0;
+    if ((RangeAddress >= KERNEL_VA_START) &&
+        (WriteThrough == FALSE) &&
+        (NonCached == FALSE)) {
+
+        LargePageCount = MmpGetLargePageSize() >> PageShift;
+        if ((LargePageCount == 0) ||
+            ((LargePageCount % RunPageCount) != 0) ||
+            ((PhysicalRunAlignment != 0) &&
+             ((LargePageCount % PhysicalRunAlignment) != 0))) {
+
+            LargePageCount = 0;
+        }
+    }
+
     Status = STATUS_SUCCESS;
     VirtualAddress = RangeAddress;
-    for (PageIndex = 0; PageIndex < PageCount; PageIndex += RunPageCount) {
+    PageIndex = 0;
+    while (PageIndex < PageCount) {
+        if ((LargePageCount != 0) &&
+            ((PageCount - PageIndex) >= LargePageCount) &&
+            (IS_POINTER_ALIGNED(VirtualAddress,
+                                LargePageCount << PageShift))) {
+
+            PhysicalPage = MmpTryAllocatePhysicalPages(LargePageCount,
+                                                       LargePageCount);
+
+            if (PhysicalPage != INVALID_PHYSICAL_ADDRESS) {
+                LargeAddress = VirtualAddress;
+                for (MapIndex = 0; MapIndex < LargePageCount; MapIndex += 1) {
+                    MmpMapPage(PhysicalPage, VirtualAddress, MapFlags);
+                    VirtualAddress += PageSize;
+                    PhysicalPage += PageSize;
+                }
+
+                MmpPromoteLargePage(MmKernelAddressSpace, LargeAddress);
+                PageIndex += LargePageCount;
+                continue;
+            }
+        }
+
         PhysicalPage = MmpAllocatePhysicalPages(RunPageCount,
                                                 PhysicalRunAlignment);
 
@@ -1963,6 +2020,8 @@ Return Value:
             VirtualAddress += PageSize;
             PhysicalPage += PageSize;
         }
+
+        PageIndex += RunPageCount;
     }
 
     if (!KSUCCESS(Status)) {
@@ -110,6 +110,24 @@ Module Name:
 #define X64_PTE(_VirtualAddress) \
     ((PPTE)X64_PT(_VirtualAddress) + X64_PT_INDEX(_VirtualAddress))
 
+//
+// Define the page table entry bits that must match across every page in a
+// region for it to be promoted to a large page, and that carry over into the
+// large page directory entry.
+//
+
+#define X64_LARGE_PAGE_ATTRIBUTE_MASK \
+    (X86_PTE_PRESENT | X86_PTE_WRITABLE | X86_PTE_USER_MODE | \
+     X86_PTE_WRITE_THROUGH | X86_PTE_CACHE_DISABLED | X86_PTE_LARGE | \
+     X86_PTE_GLOBAL | X86_PTE_NX)
+
+//
+// Define the software bit set in a page directory entry that fork made
+// read-only in place of every page table entry beneath it.
+//
+
+#define X64_PDE_DEFERRED_WRITE_PROTECT 0x00000200
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -145,6 +163,23 @@ MmpCreatePageTable (
     BOOL ZeroTable
     );
 
+VOID
+MmpSplitLargePageEntry (
+    PADDRESS_SPACE_X64 AddressSpace,
+    volatile PTE *Pde,
+    PVOID VirtualAddress
+    );
+
+VOID
+MmpPushLargePageTable (
+    PHYSICAL_ADDRESS Table
+    );
+
+PHYSICAL_ADDRESS
+MmpPopLargePageTable (
+    VOID
+    );
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -165,6 +200,15 @@ volatile PTE *MmKernelPml4;
 
 KSPIN_LOCK MmPageTableLock;
 
+//
+// Stores the reserve of page tables used to split large pages, linked through
+// their first entries, and the number of tables in it. Each large page
+// contributes one table. These are protected by the page table lock.
+//
+
+PHYSICAL_ADDRESS MmLargePageTableList = INVALID_PHYSICAL_ADDRESS;
+UINTN MmLargePageTableCount;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -429,11 +473,19 @@ Return Value:
             break;
         }
 
-        if ((*X64_PDE(Current) & X86_PTE_PRESENT) == 0) {
+        Table = X64_PDE(Current);
+        if ((*Table & X86_PTE_PRESENT) == 0) {
             break;
         }
 
-        Table = X64_PTE(Current);
+        //
+        // A large page directory entry is itself the leaf mapping.
+        //
+
+        if ((*Table & X86_PTE_LARGE) == 0) {
+            Table = X64_PTE(Current);
+        }
+
         if ((*Table & X86_PTE_PRESENT) == 0) {
             break;
         }
@@ -494,7 +546,11 @@ Return Value:
            ((*X64_PDPE(Address) & X86_PTE_PRESENT) != 0) &&
            ((*X64_PDE(Address) & X86_PTE_PRESENT) != 0));
 
-    Pte = X64_PTE(Address);
+    Pte = X64_PDE(Address);
+    if ((*Pte & X86_PTE_LARGE) == 0) {
+        Pte = X64_PTE(Address);
+    }
+
     if ((*Pte & X86_PTE_WRITABLE) == 0) {
         *WasWritable = FALSE;
         if (Writable != FALSE) {
@@ -543,10 +599,25 @@ Return Value:
 {
 
     ULONG Index;
+    PADDRESS_SPACE PreviousSpace;
+    PPROCESSOR_BLOCK ProcessorBlock;
     PADDRESS_SPACE_X64 Space;
 
     Space = (PADDRESS_SPACE_X64)AddressSpace;
 
+    //
+    // Mark the new address space as in use on this processor before loading
+    // it so that TLB shootdowns for it are not missed.
+    //
+
+    ProcessorBlock = Processor;
+    PreviousSpace = ProcessorBlock->RunningThread->OwningProcess->AddressSpace;
+    if (PreviousSpace != AddressSpace) {
+        MmpUpdateAddressSpaceProcessors(AddressSpace,
+                                        ProcessorBlock->ProcessorNumber,
+                                        TRUE);
+    }
+
     //
     // Make sure the current stack is visible. It might not be if this current
     // thread is new and its stack pushed out into a new level 4 table not in
@@ -559,6 +630,12 @@ Return Value:
 
     X64_PML4T[Index] = MmKernelPml4[Index];
     ArSetCurrentPageDirectory(Space->Pml4Physical);
+    if (PreviousSpace != AddressSpace) {
+        MmpUpdateAddressSpaceProcessors(PreviousSpace,
+                                        ProcessorBlock->ProcessorNumber,
+                                        FALSE);
+    }
+
     return;
 }
 
@@ -936,7 +1013,8 @@ Return Value:
         if (((Pml4[Pml4Index] & X86_PTE_PRESENT) != 0) &&
             ((*X64_PDPE(FaultingAddress) & X86_PTE_PRESENT) != 0) &&
             ((*X64_PDE(FaultingAddress) & X86_PTE_PRESENT) != 0) &&
-            ((*X64_PTE(FaultingAddress) & X86_PTE_PRESENT) != 0)) {
+            (((*X64_PDE(FaultingAddress) & X86_PTE_LARGE) != 0) ||
+             ((*X64_PTE(FaultingAddress) & X86_PTE_PRESENT) != 0))) {
 
             return TRUE;
         }
@@ -1013,6 +1091,13 @@ Return Value:
         MmpEnsurePageTables(AddressSpace, VirtualAddress);
     }
 
+    //
+    // Every page covered by a large page is already mapped, so nothing new
+    // should be landing inside one.
+    //
+
+    ASSERT((*X64_PDE(VirtualAddress) & X86_PTE_LARGE) == 0);
+
     Pte = X64_PTE(VirtualAddress);
 
     ASSERT(((*Pte & X86_PTE_PRESENT) == 0) && (X86_PTE_ENTRY(*Pte) == 0));
@@ -1185,6 +1270,17 @@ Return Value:
             continue;
         }
 
+        //
+        // Break up any large page into small pages so that the individual
+        // pages can be unmapped and freed below.
+        //
+
+        if ((*X64_PDE(CurrentVirtual) & X86_PTE_LARGE) != 0) {
+            MmpSplitLargePageEntry(AddressSpace,
+                                   X64_PDE(CurrentVirtual),
+                                   CurrentVirtual);
+        }
+
         Pte = X64_PTE(CurrentVirtual);
 
         //
@@ -1378,22 +1474,41 @@ Return Value:
         return INVALID_PHYSICAL_ADDRESS;
     }
 
-    Pte = X64_PTE(VirtualAddress);
-    PhysicalAddress = X86_PTE_ENTRY(*Pte);
-    if (PhysicalAddress == 0) {
+    //
+    // A large page directory entry maps the whole region directly.
+    //
 
-        ASSERT((*Pte & X86_PTE_PRESENT) == 0);
+    Pte = X64_PDE(VirtualAddress);
+    if ((*Pte & X86_PTE_LARGE) != 0) {
+        PhysicalAddress = X86_PTE_ENTRY(*Pte) +
+                          ((UINTN)VirtualAddress & (X64_LARGE_PAGE_SIZE - 1));
 
-        return INVALID_PHYSICAL_ADDRESS;
+    } else {
+        Pte = X64_PTE(VirtualAddress);
+        PhysicalAddress = X86_PTE_ENTRY(*Pte);
+        if (PhysicalAddress == 0) {
+
+            ASSERT((*Pte & X86_PTE_PRESENT) == 0);
+
+            return INVALID_PHYSICAL_ADDRESS;
+        }
+
+        PhysicalAddress += (UINTN)VirtualAddress & PAGE_MASK;
     }
 
-    PhysicalAddress += (UINTN)VirtualAddress & PAGE_MASK;
     if (Attributes != NULL) {
         if ((*Pte & X86_PTE_PRESENT) != 0) {
             *Attributes |= MAP_FLAG_PRESENT;
         }
 
-        if ((*Pte & X86_PTE_WRITABLE) == 0) {
+        //
+        // The directory entry may have been write-protected on behalf of
+        // every page beneath it.
+        //
+
+        if (((*Pte & X86_PTE_WRITABLE) == 0) ||
+            ((*X64_PDE(VirtualAddress) & X86_PTE_WRITABLE) == 0)) {
+
             *Attributes |= MAP_FLAG_READ_ONLY;
         }
 
@@ -1447,10 +1562,8 @@ Return Value:
                                 VirtualAddress,
                                 FALSE);
 
-    if (Pte == NULL) {
-        Physical = INVALID_PHYSICAL_ADDRESS;
-
-    } else {
+    Physical = INVALID_PHYSICAL_ADDRESS;
+    if ((Pte != NULL) && (X86_PTE_ENTRY(*Pte) != 0)) {
         Physical = X86_PTE_ENTRY(*Pte);
     }
 
@@ -1753,10 +1866,15 @@ Return Value:
     PTE PteValue;
     BOOL SendInvalidateIpi;
 
+    ChangedSomething = FALSE;
     InvalidateTlb = TRUE;
     SendInvalidateIpi = TRUE;
     End = VirtualAddress + (PageCount << PAGE_SHIFT);
-    Process = PsGetKernelProcess();
+    Process = PsGetCurrentProcess();
+    if (VirtualAddress >= KERNEL_VA_START) {
+        Process = PsGetKernelProcess();
+    }
+
     AddressSpace = Process->AddressSpace;
     if (End <= USER_VA_END) {
 
@@ -1836,6 +1954,40 @@ Return Value:
             continue;
         }
 
+        //
+        // A large page covered entirely by the range can have its attributes
+        // changed in place, as long as it stays present. Otherwise it has to
+        // be broken up into small pages first.
+        //
+
+        if ((*Pte & X86_PTE_LARGE) != 0) {
+            if ((IS_POINTER_ALIGNED(CurrentVirtual, X64_LARGE_PAGE_SIZE)) &&
+                (End - CurrentVirtual >= X64_LARGE_PAGE_SIZE) &&
+                ((PteMask & ~PteValue & X86_PTE_PRESENT) == 0)) {
+
+                if ((*Pte & PteMask) != PteValue) {
+                    *Pte = (*Pte & ~PteMask) | PteValue;
+                    if (SendInvalidateIpi == FALSE) {
+                        if (InvalidateTlb != FALSE) {
+                            ArInvalidateTlbEntry(CurrentVirtual);
+                        }
+
+                    } else if (ChangedSomething == FALSE) {
+                        ChangedSomething = TRUE;
+                        VirtualAddress = CurrentVirtual;
+                        PageCount = (End - CurrentVirtual) >> PAGE_SHIFT;
+                    }
+                }
+
+                CurrentVirtual += X64_LARGE_PAGE_SIZE;
+                continue;
+            }
+
+            MmpSplitLargePageEntry((PADDRESS_SPACE_X64)AddressSpace,
+                                   Pte,
+                                   CurrentVirtual);
+        }
+
         Pte = X64_PTE(CurrentVirtual);
         if (X86_PTE_ENTRY(*Pte) == 0) {
 
@@ -2241,6 +2393,17 @@ Return Value:
                     PdEnd = VirtualEnd;
                 }
 
+                //
+                // Copy-on-write works a page at a time, so break up any large
+                // page in the source first.
+                //
+
+                if ((Pd[PdIndex] & X86_PTE_LARGE) != 0) {
+                    MmpSplitLargePageEntry((PADDRESS_SPACE_X64)Source,
+                                           &(Pd[PdIndex]),
+                                           PdStart);
+                }
+
                 //
                 // Finally, map in and drill into the PT. If the PT has not yet
                 // been mapped, zero out the parts that don't apply to this
@@ -2356,6 +2519,210 @@ Return Value:
     return STATUS_SUCCESS;
 }
 
+BOOL
+MmpWriteProtectSectionMappings (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts all the mappings of the given virtual address region
+    in the current process to read-only for a copy-on-write fork, without
+    copying them anywhere. Page tables that the region covers entirely are
+    write-protected at the directory level, deferring the per-page work until
+    the first write fault beneath them. The caller is responsible for flushing
+    the TLB.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the current address space.
+
+    VirtualAddress - Supplies the starting virtual address of the memory range.
+
+    Size - Supplies the size of the virtual address region, in bytes.
+
+Return Value:
+
+    TRUE always, as the region is always write-protected.
+
+--*/
+
+{
+
+    PVOID CurrentVirtual;
+    PVOID End;
+    RUNLEVEL OldRunLevel;
+    volatile PTE *Pde;
+    PVOID PdEnd;
+    PPTE Pml4;
+    ULONG Pml4Index;
+    PPTE Pte;
+
+    End = VirtualAddress + Size;
+
+    ASSERT(AddressSpace == PsGetCurrentProcess()->AddressSpace);
+    ASSERT((End > VirtualAddress) && (End <= USER_VA_END));
+    ASSERT((IS_POINTER_ALIGNED(VirtualAddress, PAGE_SIZE)) &&
+           (IS_POINTER_ALIGNED(End, PAGE_SIZE)));
+
+    CurrentVirtual = VirtualAddress;
+    while (CurrentVirtual < End) {
+        Pml4Index = X64_PML4_INDEX(CurrentVirtual);
+        Pml4 = X64_PML4T;
+        if ((Pml4[Pml4Index] & X86_PTE_PRESENT) == 0) {
+            CurrentVirtual = ALIGN_POINTER_UP(CurrentVirtual + PAGE_SIZE,
+                                              1ULL << X64_PML4E_SHIFT);
+
+            continue;
+        }
+
+        Pte = X64_PDPE(CurrentVirtual);
+        if ((*Pte & X86_PTE_PRESENT) == 0) {
+            CurrentVirtual = ALIGN_POINTER_UP(CurrentVirtual + PAGE_SIZE,
+                                              1ULL << X64_PDPE_SHIFT);
+
+            continue;
+        }
+
+        PdEnd = ALIGN_POINTER_UP(CurrentVirtual + PAGE_SIZE,
+                                 1ULL << X64_PDE_SHIFT);
+
+        Pde = X64_PDE(CurrentVirtual);
+        if ((*Pde & X86_PTE_PRESENT) == 0) {
+            CurrentVirtual = PdEnd;
+            continue;
+        }
+
+        //
+        // Copy-on-write works a page at a time, so break up any large page
+        // first.
+        //
+
+        if ((*Pde & X86_PTE_LARGE) != 0) {
+            MmpSplitLargePageEntry((PADDRESS_SPACE_X64)AddressSpace,
+                                   (PPTE)Pde,
+                                   CurrentVirtual);
+        }
+
+        //
+        // If the region covers the whole page table, clear the writable bit
+        // in the directory entry instead of in each of the entries beneath
+        // it. The processor honors the most restrictive setting along the
+        // walk.
+        //
+
+        if ((IS_POINTER_ALIGNED(CurrentVirtual, X64_LARGE_PAGE_SIZE)) &&
+            (PdEnd <= End)) {
+
+            OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+            KeAcquireSpinLock(&MmPageTableLock);
+            *Pde = (*Pde & ~X86_PTE_WRITABLE) | X64_PDE_DEFERRED_WRITE_PROTECT;
+            KeReleaseSpinLock(&MmPageTableLock);
+            KeLowerRunLevel(OldRunLevel);
+            CurrentVirtual = PdEnd;
+            continue;
+        }
+
+        //
+        // Otherwise protect just the pages the region covers.
+        //
+
+        if (PdEnd > End) {
+            PdEnd = End;
+        }
+
+        while (CurrentVirtual < PdEnd) {
+            Pte = X64_PTE(CurrentVirtual);
+            if (X86_PTE_ENTRY(*Pte) != 0) {
+                *Pte &= ~X86_PTE_WRITABLE;
+            }
+
+            CurrentVirtual += PAGE_SIZE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOL
+MmpResolveDeferredWriteProtection (
+    PVOID FaultingAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pushes write protection applied at the directory level down
+    into the page table covering the given user mode address, if there is any
+    such deferred protection. This routine must be called below dispatch
+    level.
+
+Arguments:
+
+    FaultingAddress - Supplies the address of the write fault.
+
+Return Value:
+
+    TRUE if deferred write protection was resolved, and the faulting access
+    should simply be retried.
+
+    FALSE if the fault requires further attention.
+
+--*/
+
+{
+
+    ULONG Index;
+    RUNLEVEL OldRunLevel;
+    volatile PTE *Pde;
+    PPTE Pt;
+
+    if ((FaultingAddress >= USER_VA_END) ||
+        ((*X64_PML4E(FaultingAddress) & X86_PTE_PRESENT) == 0) ||
+        ((*X64_PDPE(FaultingAddress) & X86_PTE_PRESENT) == 0)) {
+
+        return FALSE;
+    }
+
+    Pde = X64_PDE(FaultingAddress);
+    if ((*Pde & X64_PDE_DEFERRED_WRITE_PROTECT) == 0) {
+        return FALSE;
+    }
+
+    //
+    // Every page beneath this directory entry was present when it was
+    // protected, and anything mapped since was mapped with the right access.
+    // Write protecting them all is always safe, since a write fault on a
+    // writable section just makes the page writable again. Once that's done
+    // the directory entry can go back to being writable. Another thread may
+    // have gotten here first, in which case there's nothing left to do but
+    // retry.
+    //
+
+    Pt = X64_PT(FaultingAddress);
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&MmPageTableLock);
+    if ((*Pde & X64_PDE_DEFERRED_WRITE_PROTECT) != 0) {
+
+        ASSERT((*Pde & (X86_PTE_PRESENT | X86_PTE_LARGE)) == X86_PTE_PRESENT);
+
+        for (Index = 0; Index < X64_PTE_COUNT; Index += 1) {
+            Pt[Index] &= ~X86_PTE_WRITABLE;
+        }
+
+        *Pde = (*Pde | X86_PTE_WRITABLE) & ~X64_PDE_DEFERRED_WRITE_PROTECT;
+    }
+
+    KeReleaseSpinLock(&MmPageTableLock);
+    KeLowerRunLevel(OldRunLevel);
+    return TRUE;
+}
+
 VOID
 MmpCreatePageTables (
     PVOID VirtualAddress,
@@ -2538,6 +2905,7 @@ Return Value:
 {
 
     INTN Inactive;
+    PVOID LargeVirtual;
     PPTE Pd;
     ULONG PdIndex;
     PPTE Pdp;
@@ -2601,6 +2969,23 @@ Return Value:
                     continue;
                 }
 
+                //
+                // Large pages each hold a page table in reserve. Turn them
+                // back into a page table so that it gets freed like any other.
+                //
+
+                if ((Pd[PdIndex] & X86_PTE_LARGE) != 0) {
+                    LargeVirtual = (PVOID)(((UINTN)Pml4Index <<
+                                            X64_PML4E_SHIFT) |
+                                           ((UINTN)PdpIndex <<
+                                            X64_PDPE_SHIFT) |
+                                           ((UINTN)PdIndex << X64_PDE_SHIFT));
+
+                    MmpSplitLargePageEntry(Space,
+                                           &(Pd[PdIndex]),
+                                           LargeVirtual);
+                }
+
                 //
                 // PTs may or may not be valid, but there's no need to dig into
                 // them since there are no lower level tables beyond it.
@@ -2615,7 +3000,8 @@ Return Value:
                     Pd[PdIndex] = 0;
 
                 } else {
-                    Pd[PdIndex] &= ~X86_PTE_PRESENT;
+                    Pd[PdIndex] &= ~(X86_PTE_PRESENT |
+                                     X64_PDE_DEFERRED_WRITE_PROTECT);
                 }
 
                 Total += 1;
@@ -2658,6 +3044,191 @@ Return Value:
     return;
 }
 
+BOOL
+MmpPromoteLargePage (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to replace the page table covering the given address
+    with a single large page mapping. This only succeeds if every page in the
+    naturally aligned large page region is mapped to one naturally aligned,
+    physically contiguous run with identical attributes. The caller must
+    ensure that the mappings in the region cannot change concurrently.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space the address belongs
+        to. For user mode addresses, this must be the current address space.
+
+    VirtualAddress - Supplies a virtual address within the region to promote.
+
+Return Value:
+
+    TRUE if the region is now mapped by a large page.
+
+    FALSE if the region was not eligible for promotion.
+
+--*/
+
+{
+
+    PTE Attributes;
+    PVOID Base;
+    PTE Dirty;
+    PTE Entry;
+    ULONG Index;
+    PTE LargeEntry;
+    RUNLEVEL OldRunLevel;
+    volatile PTE *Pde;
+    PHYSICAL_ADDRESS Physical;
+    ULONG Pml4Index;
+    PPTE Pt;
+    PHYSICAL_ADDRESS Table;
+
+    Base = ALIGN_POINTER_DOWN(VirtualAddress, X64_LARGE_PAGE_SIZE);
+    Pml4Index = X64_PML4_INDEX(Base);
+    if (Base >= KERNEL_VA_START) {
+
+        ASSERT(Pml4Index != X64_SELF_MAP_INDEX);
+
+        X64_PML4T[Pml4Index] = MmKernelPml4[Pml4Index];
+
+    } else {
+
+        ASSERT(AddressSpace == PsGetCurrentProcess()->AddressSpace);
+    }
+
+    if (((X64_PML4T[Pml4Index] & X86_PTE_PRESENT) == 0) ||
+        ((*X64_PDPE(Base) & X86_PTE_PRESENT) == 0)) {
+
+        return FALSE;
+    }
+
+    //
+    // A table still waiting on deferred write protection holds pages that
+    // look writable but are not.
+    //
+
+    Pde = X64_PDE(Base);
+    if (((*Pde & X86_PTE_PRESENT) == 0) || ((*Pde & X86_PTE_LARGE) != 0) ||
+        ((*Pde & X64_PDE_DEFERRED_WRITE_PROTECT) != 0)) {
+
+        return FALSE;
+    }
+
+    //
+    // The first page determines the physical base and the attributes that all
+    // other pages must share. The PAT bit sits where the large bit goes, so
+    // pages using it are left alone. Check the last page next, since tables
+    // usually fill in ascending order and it's the most likely to be missing.
+    //
+
+    Pt = X64_PT(Base);
+    Entry = Pt[0];
+    Physical = X86_PTE_ENTRY(Entry);
+    Attributes = Entry & X64_LARGE_PAGE_ATTRIBUTE_MASK;
+    if (((Entry & X86_PTE_PRESENT) == 0) ||
+        ((Entry & X86_PTE_LARGE) != 0) ||
+        (IS_ALIGNED(Physical, X64_LARGE_PAGE_SIZE) == FALSE)) {
+
+        return FALSE;
+    }
+
+    Entry = Pt[X64_PTE_COUNT - 1];
+    if ((X86_PTE_ENTRY(Entry) !=
+         Physical + X64_LARGE_PAGE_SIZE - PAGE_SIZE) ||
+        ((Entry & X64_LARGE_PAGE_ATTRIBUTE_MASK) != Attributes)) {
+
+        return FALSE;
+    }
+
+    Dirty = 0;
+    for (Index = 0; Index < X64_PTE_COUNT; Index += 1) {
+        Entry = Pt[Index];
+        if ((X86_PTE_ENTRY(Entry) != Physical + ((UINTN)Index << PAGE_SHIFT)) ||
+            ((Entry & X64_LARGE_PAGE_ATTRIBUTE_MASK) != Attributes)) {
+
+            return FALSE;
+        }
+
+        Dirty |= Entry & X86_PTE_DIRTY;
+    }
+
+    //
+    // Other processors may still set the dirty bit through the old page table
+    // until they are flushed, so writable large pages start out dirty to make
+    // sure no modification is ever lost.
+    //
+
+    if ((Attributes & X86_PTE_WRITABLE) != 0) {
+        Dirty = X86_PTE_DIRTY;
+    }
+
+    LargeEntry = Physical | Attributes | Dirty | X86_PTE_ACCESSED |
+                 X86_PTE_LARGE;
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&MmPageTableLock);
+    Table = X86_PTE_ENTRY(*Pde);
+    *Pde = LargeEntry;
+    MmLargePageCount += 1;
+    MmLargePagePromotions += 1;
+    KeReleaseSpinLock(&MmPageTableLock);
+    KeLowerRunLevel(OldRunLevel);
+
+    //
+    // Flush the small translations and any cached reference to the old page
+    // table everywhere before the table is set aside.
+    //
+
+    MmpSendTlbInvalidateIpi(AddressSpace, Base, 1);
+    MmpSendTlbInvalidateIpi(AddressSpace, X64_PT(Base), 1);
+
+    //
+    // Hold on to the old page table so that splitting this large page later
+    // never needs to allocate memory.
+    //
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&MmPageTableLock);
+    MmpPushLargePageTable(Table);
+    KeReleaseSpinLock(&MmPageTableLock);
+    KeLowerRunLevel(OldRunLevel);
+    return TRUE;
+}
+
+UINTN
+MmpGetLargePageSize (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the size of a large page on this architecture.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the large page size in bytes, or 0 if large pages are not
+    supported.
+
+--*/
+
+{
+
+    return X64_LARGE_PAGE_SIZE;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -2901,6 +3472,19 @@ Return Value:
             }
 
         } else {
+
+            //
+            // Split a large page so there is a page table to return an entry
+            // from.
+            //
+
+            if ((Level == X64_PAGE_LEVEL - 1) &&
+                ((*Pte & X86_PTE_LARGE) != 0)) {
+
+                MmpSplitLargePageEntry(AddressSpace, Pte, VirtualAddress);
+                NextTable = X86_PTE_ENTRY(*Pte);
+            }
+
             Physical = NextTable;
             *SwapPte = 0;
             ArInvalidateTlbEntry(SwapPage);
@@ -3162,3 +3746,201 @@ Return Value:
     return STATUS_SUCCESS;
 }
 
+VOID
+MmpSplitLargePageEntry (
+    PADDRESS_SPACE_X64 AddressSpace,
+    volatile PTE *Pde,
+    PVOID VirtualAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine breaks a large page back up into a page table of small pages
+    with the same attributes. The page table comes from the reserve set aside
+    when the large page was created, so this routine never fails. The page
+    directory entry may live in the current processor's swap page, which is
+    preserved.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space that owns the
+        mapping. This may be NULL for kernel addresses.
+
+    Pde - Supplies a pointer to the page directory entry to split.
+
+    VirtualAddress - Supplies a virtual address within the large page.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PTE Attributes;
+    ULONG Index;
+    PTE LargeEntry;
+    RUNLEVEL OldRunLevel;
+    PHYSICAL_ADDRESS Physical;
+    PPROCESSOR_BLOCK Processor;
+    PTE SavedSwapPte;
+    PPTE SwapPage;
+    volatile PTE *SwapPte;
+    PHYSICAL_ADDRESS Table;
+
+    OldRunLevel = KeRaiseRunLevel(RunLevelDispatch);
+    KeAcquireSpinLock(&MmPageTableLock);
+
+    //
+    // Someone else may have split it already.
+    //
+
+    LargeEntry = *Pde;
+    if ((LargeEntry & X86_PTE_LARGE) == 0) {
+        KeReleaseSpinLock(&MmPageTableLock);
+        KeLowerRunLevel(OldRunLevel);
+        return;
+    }
+
+    Table = MmpPopLargePageTable();
+    Physical = X86_PTE_ENTRY(LargeEntry);
+    Attributes = LargeEntry & (PAGE_MASK | X86_PTE_NX) & ~X86_PTE_LARGE;
+    Processor = KeGetCurrentProcessorBlock();
+    SwapPage = Processor->SwapPage;
+    SwapPte = X64_PTE(SwapPage);
+    SavedSwapPte = *SwapPte;
+    *SwapPte = Table | X86_PTE_PRESENT | X86_PTE_WRITABLE;
+    ArInvalidateTlbEntry(SwapPage);
+    for (Index = 0; Index < X64_PTE_COUNT; Index += 1) {
+        SwapPage[Index] = (Physical + ((UINTN)Index << PAGE_SHIFT)) |
+                          Attributes;
+    }
+
+    *SwapPte = SavedSwapPte;
+    ArInvalidateTlbEntry(SwapPage);
+    *Pde = Table | X86_PTE_PRESENT | X86_PTE_WRITABLE | X86_PTE_USER_MODE;
+    MmLargePageCount -= 1;
+    MmLargePageSplits += 1;
+    KeReleaseSpinLock(&MmPageTableLock);
+
+    //
+    // Both the large translation and the self map view of the new page table
+    // may be cached. Dropping the page table address drops both.
+    //
+
+    VirtualAddress = ALIGN_POINTER_DOWN(VirtualAddress, X64_LARGE_PAGE_SIZE);
+    MmpSendTlbInvalidateIpi((PADDRESS_SPACE)AddressSpace,
+                            X64_PT(VirtualAddress),
+                            1);
+
+    MmpSendTlbInvalidateIpi((PADDRESS_SPACE)AddressSpace, VirtualAddress, 1);
+    KeLowerRunLevel(OldRunLevel);
+    return;
+}
+
+VOID
+MmpPushLargePageTable (
+    PHYSICAL_ADDRESS Table
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a page table to the reserve used for splitting large
+    pages. The tables are linked through their first entry. The page table
+    lock must be held.
+
+Arguments:
+
+    Table - Supplies the physical address of the page table to set aside.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PPROCESSOR_BLOCK Processor;
+    PTE SavedSwapPte;
+    PPTE SwapPage;
+    volatile PTE *SwapPte;
+
+    ASSERT(KeIsSpinLockHeld(&MmPageTableLock) != FALSE);
+
+    Processor = KeGetCurrentProcessorBlock();
+    SwapPage = Processor->SwapPage;
+    SwapPte = X64_PTE(SwapPage);
+    SavedSwapPte = *SwapPte;
+    *SwapPte = Table | X86_PTE_PRESENT | X86_PTE_WRITABLE;
+    ArInvalidateTlbEntry(SwapPage);
+    SwapPage[0] = MmLargePageTableList;
+    *SwapPte = SavedSwapPte;
+    ArInvalidateTlbEntry(SwapPage);
+    MmLargePageTableList = Table;
+    MmLargePageTableCount += 1;
+    return;
+}
+
+PHYSICAL_ADDRESS
+MmpPopLargePageTable (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes a page table from the reserve used for splitting
+    large pages. The page table lock must be held.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the physical address of the page table. Its contents are
+    undefined.
+
+--*/
+
+{
+
+    PPROCESSOR_BLOCK Processor;
+    PTE SavedSwapPte;
+    PPTE SwapPage;
+    volatile PTE *SwapPte;
+    PHYSICAL_ADDRESS Table;
+
+    ASSERT(KeIsSpinLockHeld(&MmPageTableLock) != FALSE);
+
+    //
+    // Every large page puts a table in reserve, so this should never run dry.
+    //
+
+    Table = MmLargePageTableList;
+    if (Table == INVALID_PHYSICAL_ADDRESS) {
+
+        ASSERT(FALSE);
+
+        KeCrashSystem(CRASH_OUT_OF_MEMORY, MmLargePageCount, 0, 0, 0);
+    }
+
+    Processor = KeGetCurrentProcessorBlock();
+    SwapPage = Processor->SwapPage;
+    SwapPte = X64_PTE(SwapPage);
+    SavedSwapPte = *SwapPte;
+    *SwapPte = Table | X86_PTE_PRESENT | X86_PTE_WRITABLE;
+    ArInvalidateTlbEntry(SwapPage);
+    MmLargePageTableList = SwapPage[0];
+    *SwapPte = SavedSwapPte;
+    ArInvalidateTlbEntry(SwapPage);
+    MmLargePageTableCount -= 1;
+    return Table;
+}
@@ -553,12 +553,26 @@ Return Value:
 {
 
     ULONG DirectoryIndex;
+    PADDRESS_SPACE PreviousSpace;
     PPROCESSOR_BLOCK ProcessorBlock;
     PADDRESS_SPACE_X86 Space;
     PTSS Tss;
 
     Space = (PADDRESS_SPACE_X86)AddressSpace;
 
+    //
+    // Mark the new address space as in use on this processor before loading
+    // it so that TLB shootdowns for it are not missed.
+    //
+
+    ProcessorBlock = Processor;
+    PreviousSpace = ProcessorBlock->RunningThread->OwningProcess->AddressSpace;
+    if (PreviousSpace != AddressSpace) {
+        MmpUpdateAddressSpaceProcessors(AddressSpace,
+                                        ProcessorBlock->ProcessorNumber,
+                                        TRUE);
+    }
+
     //
     // Make sure the current stack is visible. It might not be if this current
     // thread is new and its stack pushed out into a new page table not in the
@@ -569,7 +583,6 @@ Return Value:
     Space->PageDirectory[DirectoryIndex] =
                                          MmKernelPageDirectory[DirectoryIndex];
 
-    ProcessorBlock = Processor;
     Tss = ProcessorBlock->Tss;
 
     //
@@ -579,6 +592,12 @@ Return Value:
 
     Tss->Cr3 = Space->PageDirectoryPhysical;
     ArSetCurrentPageDirectory(Space->PageDirectoryPhysical);
+    if (PreviousSpace != AddressSpace) {
+        MmpUpdateAddressSpaceProcessors(PreviousSpace,
+                                        ProcessorBlock->ProcessorNumber,
+                                        FALSE);
+    }
+
     return;
 }
 
@@ -2338,6 +2357,69 @@ Return Value:
     return STATUS_SUCCESS;
 }
 
+BOOL
+MmpWriteProtectSectionMappings (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress,
+    UINTN Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts all the mappings of the given virtual address region
+    in the current process to read-only for a copy-on-write fork, without
+    copying them anywhere. This architecture always copies the mappings into
+    the new process, so nothing is done here.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the current address space.
+
+    VirtualAddress - Supplies the starting virtual address of the memory range.
+
+    Size - Supplies the size of the virtual address region, in bytes.
+
+Return Value:
+
+    FALSE always.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
+BOOL
+MmpResolveDeferredWriteProtection (
+    PVOID FaultingAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine pushes write protection applied at the directory level down
+    into the page table covering the given user mode address. Write
+    protection is never deferred on this architecture.
+
+Arguments:
+
+    FaultingAddress - Supplies the address of the write fault.
+
+Return Value:
+
+    FALSE always.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
 VOID
 MmpCreatePageTables (
     PVOID VirtualAddress,
@@ -2443,6 +2525,64 @@ Return Value:
     return;
 }
 
+BOOL
+MmpPromoteLargePage (
+    PADDRESS_SPACE AddressSpace,
+    PVOID VirtualAddress
+    )
+
+/*++
+
+Routine Description:
+
+    This routine attempts to replace the page table covering the given address
+    with a single large page mapping. Large pages are not used on this
+    architecture.
+
+Arguments:
+
+    AddressSpace - Supplies a pointer to the address space the address belongs
+        to.
+
+    VirtualAddress - Supplies a virtual address within the region to promote.
+
+Return Value:
+
+    FALSE always.
+
+--*/
+
+{
+
+    return FALSE;
+}
+
+UINTN
+MmpGetLargePageSize (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the size of a large page on this architecture.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    0 always, as large pages are not used on this architecture.
+
+--*/
+
+{
+
+    return 0;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
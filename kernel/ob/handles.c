@@ -38,10 +38,19 @@ Module Name:
 #define HANDLE_TABLE_ALLOCATION_TAG 0x646E6148 // 'dnaH'
 
 //
-// Define the initial size of the handle table, in entries.
+// Define the number of entries in each leaf of the handle table. Leaves never
+// move once allocated, so lookups can find an entry without the lock.
 //
 
-#define HANDLE_TABLE_INITIAL_SIZE 16
+#define HANDLE_TABLE_LEAF_SHIFT 6
+#define HANDLE_TABLE_LEAF_SIZE (1 << HANDLE_TABLE_LEAF_SHIFT)
+#define HANDLE_TABLE_LEAF_MASK (HANDLE_TABLE_LEAF_SIZE - 1)
+
+//
+// Define the initial number of leaf slots in the handle table directory.
+//
+
+#define HANDLE_TABLE_INITIAL_LEAF_COUNT 1
 
 //
 // Define handle flags.
@@ -92,12 +101,35 @@ Structure Description:
 --*/
 
 typedef struct _HANDLE_TABLE_ENTRY {
-    ULONG Flags;
-    PVOID HandleValue;
+    volatile ULONG Flags;
+    PVOID volatile HandleValue;
 } HANDLE_TABLE_ENTRY, *PHANDLE_TABLE_ENTRY;
 
 /*++
 
+Structure Description:
+
+    This structure defines the top level of a handle table. The directory is
+    replaced wholesale when it grows, and the old one is freed once no lookup
+    can still be looking at it.
+
+Members:
+
+    LeafCount - Stores the number of leaf slots in the directory.
+
+    Leaves - Stores the array of pointers to leaves, each holding
+        HANDLE_TABLE_LEAF_SIZE entries. Slots are NULL until a descriptor in
+        that range is first used.
+
+--*/
+
+typedef struct _HANDLE_TABLE_DIRECTORY {
+    ULONG LeafCount;
+    PHANDLE_TABLE_ENTRY volatile Leaves[ANYSIZE_ARRAY];
+} HANDLE_TABLE_DIRECTORY, *PHANDLE_TABLE_DIRECTORY;
+
+/*++
+
 Structure Description:
 
     This structure defines a handle table.
@@ -110,25 +142,32 @@ Structure Description:
 
     MaxDescriptor - Stores the maximum valid descriptor number.
 
-    Entries - Stores the actual array of handles.
+    Directory - Stores a pointer to the current directory of leaves.
 
-    ArraySize - Stores the number of elements in the array.
-
-    Lock - Stores a pointer to a lock protecting access to the handle table.
+    Lock - Stores a pointer to a lock serializing changes to the handle table.
+        Lookups do not acquire it.
 
     LookupCallback - Stores an optional pointer to a routine that is called
         whenever a handle is looked up.
 
+    LookupEpoch - Stores the index of the lookup counter new lookups should
+        use.
+
+    Lookups - Stores the number of lookups in flight under each epoch. Changes
+        that remove an entry or retire a directory flip the epoch and wait for
+        the old count to drain before anything is freed.
+
 --*/
 
 struct _HANDLE_TABLE {
     PKPROCESS Process;
     ULONG NextDescriptor;
     ULONG MaxDescriptor;
-    PHANDLE_TABLE_ENTRY Entries;
-    ULONG ArraySize;
+    PHANDLE_TABLE_DIRECTORY volatile Directory;
     PQUEUED_LOCK Lock;
     PHANDLE_TABLE_LOOKUP_CALLBACK LookupCallback;
+    volatile ULONG LookupEpoch;
+    volatile ULONG Lookups[2];
 };
 
 //
@@ -141,6 +180,22 @@ ObpExpandHandleTable (
     ULONG Descriptor
     );
 
+PHANDLE_TABLE_DIRECTORY
+ObpCreateHandleTableDirectory (
+    ULONG LeafCount
+    );
+
+PHANDLE_TABLE_ENTRY
+ObpGetHandleTableEntry (
+    PHANDLE_TABLE_DIRECTORY Directory,
+    ULONG Descriptor
+    );
+
+VOID
+ObpWaitForHandleLookups (
+    PHANDLE_TABLE Table
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -181,7 +236,6 @@ Return Value:
 
 {
 
-    UINTN AllocationSize;
     PHANDLE_TABLE HandleTable;
     KSTATUS Status;
 
@@ -199,32 +253,23 @@ Return Value:
         ObAddReference(Process);
     }
 
+    RtlZeroMemory(HandleTable, sizeof(HANDLE_TABLE));
     HandleTable->Process = Process;
-    HandleTable->Lock = NULL;
-    HandleTable->NextDescriptor = 0;
-    HandleTable->MaxDescriptor = 0;
     HandleTable->LookupCallback = LookupCallbackRoutine;
-    AllocationSize = HANDLE_TABLE_INITIAL_SIZE * sizeof(HANDLE_TABLE_ENTRY);
-    HandleTable->Entries = MmAllocatePagedPool(AllocationSize,
-                                               HANDLE_TABLE_ALLOCATION_TAG);
+    HandleTable->Directory = ObpCreateHandleTableDirectory(
+                                              HANDLE_TABLE_INITIAL_LEAF_COUNT);
 
-    if (HandleTable->Entries == NULL) {
+    if (HandleTable->Directory == NULL) {
         Status = STATUS_INSUFFICIENT_RESOURCES;
         goto CreateHandleTableEnd;
     }
 
-    RtlZeroMemory(HandleTable->Entries, AllocationSize);
-    HandleTable->ArraySize = HANDLE_TABLE_INITIAL_SIZE;
-    Status = STATUS_SUCCESS;
+    Status = ObpExpandHandleTable(HandleTable, 0);
 
 CreateHandleTableEnd:
     if (!KSUCCESS(Status)) {
         if (HandleTable != NULL) {
-            if (HandleTable->Entries != NULL) {
-                MmFreePagedPool(HandleTable->Entries);
-            }
-
-            MmFreePagedPool(HandleTable);
+            ObDestroyHandleTable(HandleTable);
             HandleTable = NULL;
         }
     }
@@ -256,14 +301,25 @@ Return Value:
 
 {
 
+    PHANDLE_TABLE_DIRECTORY Directory;
+    ULONG LeafIndex;
+
     ASSERT(KeGetRunLevel() == RunLevelLow);
+    ASSERT((HandleTable->Lookups[0] == 0) && (HandleTable->Lookups[1] == 0));
 
     if (HandleTable->Lock != NULL) {
         KeDestroyQueuedLock(HandleTable->Lock);
     }
 
-    if (HandleTable->Entries != NULL) {
-        MmFreePagedPool(HandleTable->Entries);
+    Directory = HandleTable->Directory;
+    if (Directory != NULL) {
+        for (LeafIndex = 0; LeafIndex < Directory->LeafCount; LeafIndex += 1) {
+            if (Directory->Leaves[LeafIndex] != NULL) {
+                MmFreePagedPool(Directory->Leaves[LeafIndex]);
+            }
+        }
+
+        MmFreePagedPool(Directory);
     }
 
     if (HandleTable->Process != NULL) {
@@ -351,6 +407,7 @@ Return Value:
 {
 
     ULONG Descriptor;
+    PHANDLE_TABLE_ENTRY Entry;
     KSTATUS Status;
 
     ASSERT(KeGetRunLevel() == RunLevelLow);
@@ -373,11 +430,17 @@ Return Value:
     }
 
     //
-    // Loop until a free slot is found.
+    // Loop until a free slot is found. Descriptors in leaves that haven't
+    // been allocated yet are all free.
     //
 
-    while ((Descriptor < Table->ArraySize) &&
-           ((Table->Entries[Descriptor].Flags & HANDLE_FLAG_ALLOCATED) != 0)) {
+    while (TRUE) {
+        Entry = ObpGetHandleTableEntry(Table->Directory, Descriptor);
+        if ((Entry == NULL) ||
+            ((Entry->Flags & HANDLE_FLAG_ALLOCATED) == 0)) {
+
+            break;
+        }
 
         Descriptor += 1;
     }
@@ -390,19 +453,25 @@ Return Value:
     // Expand the table if needed.
     //
 
-    if (Descriptor >= Table->ArraySize) {
+    if (Entry == NULL) {
         Status = ObpExpandHandleTable(Table, Descriptor);
         if (!KSUCCESS(Status)) {
             goto CreateHandleEnd;
         }
+
+        Entry = ObpGetHandleTableEntry(Table->Directory, Descriptor);
     }
 
     ASSERT(HandleValue != NULL);
 
-    Table->Entries[Descriptor].Flags = HANDLE_FLAG_ALLOCATED |
-                                       (Flags & HANDLE_FLAG_MASK);
+    //
+    // Lookups check the flags before reading the value, so the value must be
+    // visible first.
+    //
 
-    Table->Entries[Descriptor].HandleValue = HandleValue;
+    Entry->HandleValue = HandleValue;
+    RtlMemoryBarrier();
+    Entry->Flags = HANDLE_FLAG_ALLOCATED | (Flags & HANDLE_FLAG_MASK);
     *NewHandle = (HANDLE)(UINTN)Descriptor;
     if (Descriptor > Table->MaxDescriptor) {
         Table->MaxDescriptor = Descriptor;
@@ -442,6 +511,7 @@ Return Value:
 {
 
     ULONG Descriptor;
+    PHANDLE_TABLE_ENTRY Entry;
 
     ASSERT((Table->Process == NULL) ||
            (Table->Process->ThreadCount == 0) ||
@@ -449,20 +519,26 @@ Return Value:
 
     Descriptor = (UINTN)Handle;
     OB_ACQUIRE_HANDLE_TABLE_LOCK(Table);
-    if (Descriptor >= Table->ArraySize) {
+    Entry = ObpGetHandleTableEntry(Table->Directory, Descriptor);
+    if ((Entry == NULL) || ((Entry->Flags & HANDLE_FLAG_ALLOCATED) == 0)) {
         goto DestroyHandleEnd;
     }
 
-    if ((Table->Entries[Descriptor].Flags & HANDLE_FLAG_ALLOCATED) == 0) {
-        goto DestroyHandleEnd;
-    }
-
-    Table->Entries[Descriptor].HandleValue = NULL;
-    Table->Entries[Descriptor].Flags = 0;
+    Entry->Flags = 0;
+    RtlMemoryBarrier();
+    Entry->HandleValue = NULL;
     if (Table->NextDescriptor > Descriptor) {
         Table->NextDescriptor = Descriptor;
     }
 
+    //
+    // The caller is likely to drop its reference on the value as soon as
+    // this returns. Let any lookup that already saw the value finish taking
+    // its own reference first.
+    //
+
+    ObpWaitForHandleLookups(Table);
+
 DestroyHandleEnd:
     OB_RELEASE_HANDLE_TABLE_LOCK(Table);
     return;
@@ -515,6 +591,8 @@ Return Value:
 {
 
     ULONG Descriptor;
+    PHANDLE_TABLE_ENTRY Entry;
+    ULONG PreviousFlags;
     KSTATUS Status;
 
     ASSERT(KeGetRunLevel() == RunLevelLow);
@@ -527,31 +605,43 @@ Return Value:
     ASSERT(Handle != INVALID_HANDLE);
 
     Descriptor = (UINTN)Handle;
-    if (Descriptor >= Table->ArraySize) {
+    Entry = ObpGetHandleTableEntry(Table->Directory, Descriptor);
+    if (Entry == NULL) {
         Status = ObpExpandHandleTable(Table, Descriptor);
         if (!KSUCCESS(Status)) {
             goto ReplaceHandleValueEnd;
         }
+
+        Entry = ObpGetHandleTableEntry(Table->Directory, Descriptor);
     }
 
     ASSERT(NewHandleValue != NULL);
 
+    PreviousFlags = Entry->Flags;
     if (OldFlags != NULL) {
-        *OldFlags = Table->Entries[Descriptor].Flags & HANDLE_FLAG_MASK;
+        *OldFlags = PreviousFlags & HANDLE_FLAG_MASK;
     }
 
     if (OldHandleValue != NULL) {
-        *OldHandleValue = Table->Entries[Descriptor].HandleValue;
+        *OldHandleValue = Entry->HandleValue;
     }
 
-    Table->Entries[Descriptor].Flags = HANDLE_FLAG_ALLOCATED |
-                                       (NewFlags & HANDLE_FLAG_MASK);
-
-    Table->Entries[Descriptor].HandleValue = NewHandleValue;
+    Entry->HandleValue = NewHandleValue;
+    RtlMemoryBarrier();
+    Entry->Flags = HANDLE_FLAG_ALLOCATED | (NewFlags & HANDLE_FLAG_MASK);
     if (Descriptor > Table->MaxDescriptor) {
         Table->MaxDescriptor = Descriptor;
     }
 
+    //
+    // If a value was displaced, the caller will likely release it. Make sure
+    // lookups that picked up the old value are done with it.
+    //
+
+    if ((PreviousFlags & HANDLE_FLAG_ALLOCATED) != 0) {
+        ObpWaitForHandleLookups(Table);
+    }
+
     Status = STATUS_SUCCESS;
 
 ReplaceHandleValueEnd:
@@ -571,7 +661,9 @@ ObGetHandleValue (
 Routine Description:
 
     This routine looks up the given handle and returns the value associated
-    with that handle.
+    with that handle. The handle table lock is not acquired. Instead the
+    lookup is counted, and anything that removes a value or frees part of the
+    table waits for counted lookups to finish.
 
 Arguments:
 
@@ -593,6 +685,8 @@ Return Value:
 {
 
     ULONG Descriptor;
+    PHANDLE_TABLE_ENTRY Entry;
+    ULONG Epoch;
     ULONG LocalFlags;
     PVOID Value;
 
@@ -603,23 +697,47 @@ Return Value:
     Descriptor = (UINTN)Handle;
     LocalFlags = 0;
     Value = NULL;
-    OB_ACQUIRE_HANDLE_TABLE_LOCK(Table);
-    if (Descriptor >= Table->ArraySize) {
+
+    //
+    // Count the lookup under the current epoch. If the epoch flipped between
+    // reading it and bumping the counter, then a change may already have
+    // looked at that counter and moved on, so back out and try again. Once
+    // the epoch is confirmed after the increment, any change that flips away
+    // from it will wait for this lookup.
+    //
+
+    while (TRUE) {
+        Epoch = Table->LookupEpoch & 0x1;
+        RtlAtomicAdd32(&(Table->Lookups[Epoch]), 1);
+        if ((Table->LookupEpoch & 0x1) == Epoch) {
+            break;
+        }
+
+        RtlAtomicAdd32(&(Table->Lookups[Epoch]), -1);
+    }
+
+    Entry = ObpGetHandleTableEntry(Table->Directory, Descriptor);
+    if (Entry == NULL) {
         goto GetHandleValueEnd;
     }
 
-    LocalFlags = Table->Entries[Descriptor].Flags;
+    LocalFlags = Entry->Flags;
     if ((LocalFlags & HANDLE_FLAG_ALLOCATED) == 0) {
         goto GetHandleValueEnd;
     }
 
-    Value = Table->Entries[Descriptor].HandleValue;
+    RtlMemoryBarrier();
+    Value = Entry->HandleValue;
+    if (Value == NULL) {
+        goto GetHandleValueEnd;
+    }
+
     if (Table->LookupCallback != NULL) {
         Table->LookupCallback(Table, (HANDLE)(UINTN)Descriptor, Value);
     }
 
 GetHandleValueEnd:
-    OB_RELEASE_HANDLE_TABLE_LOCK(Table);
+    RtlAtomicAdd32(&(Table->Lookups[Epoch]), -1);
     if ((Flags != NULL) && (Value != NULL)) {
         *Flags = LocalFlags & HANDLE_FLAG_MASK;
     }
@@ -669,6 +787,7 @@ Return Value:
 {
 
     ULONG Descriptor;
+    PHANDLE_TABLE_ENTRY Entry;
     ULONG NewValue;
     ULONG OriginalValue;
     KSTATUS Status;
@@ -680,21 +799,18 @@ Return Value:
     Status = STATUS_INVALID_HANDLE;
     Descriptor = (UINTN)Handle;
     OB_ACQUIRE_HANDLE_TABLE_LOCK(Table);
-    if (Descriptor >= Table->ArraySize) {
-        goto GetSetHandleFlagsEnd;
-    }
-
-    if ((Table->Entries[Descriptor].Flags & HANDLE_FLAG_ALLOCATED) == 0) {
+    Entry = ObpGetHandleTableEntry(Table->Directory, Descriptor);
+    if ((Entry == NULL) || ((Entry->Flags & HANDLE_FLAG_ALLOCATED) == 0)) {
         goto GetSetHandleFlagsEnd;
     }
 
     Status = STATUS_SUCCESS;
     NewValue = *Flags;
-    OriginalValue = Table->Entries[Descriptor].Flags;
+    OriginalValue = Entry->Flags;
     *Flags = OriginalValue & HANDLE_FLAG_MASK;
     if (Set != FALSE) {
-        Table->Entries[Descriptor].Flags = (NewValue & HANDLE_FLAG_MASK) |
-                                           (OriginalValue & ~HANDLE_FLAG_MASK);
+        Entry->Flags = (NewValue & HANDLE_FLAG_MASK) |
+                       (OriginalValue & ~HANDLE_FLAG_MASK);
     }
 
 GetSetHandleFlagsEnd:
@@ -728,6 +844,8 @@ Return Value:
 {
 
     ULONG Descriptor;
+    PHANDLE_TABLE_DIRECTORY Directory;
+    PHANDLE_TABLE_ENTRY Entry;
     HANDLE Handle;
 
     ASSERT((Table->Process == NULL) ||
@@ -736,11 +854,15 @@ Return Value:
 
     Handle = INVALID_HANDLE;
     OB_ACQUIRE_HANDLE_TABLE_LOCK(Table);
+    Directory = Table->Directory;
     Descriptor = Table->MaxDescriptor;
+    while (TRUE) {
+        Entry = ObpGetHandleTableEntry(Directory, Descriptor);
+        if ((Entry != NULL) && ((Entry->Flags & HANDLE_FLAG_ALLOCATED) != 0)) {
+            Handle = (HANDLE)(UINTN)Descriptor;
+            break;
+        }
 
-    ASSERT(Descriptor < Table->ArraySize);
-
-    while ((Table->Entries[Descriptor].Flags & HANDLE_FLAG_ALLOCATED) == 0) {
         if (Descriptor == 0) {
             break;
         }
@@ -748,10 +870,6 @@ Return Value:
         Descriptor -= 1;
     }
 
-    if ((Table->Entries[Descriptor].Flags & HANDLE_FLAG_ALLOCATED) != 0) {
-        Handle = (HANDLE)(UINTN)Descriptor;
-    }
-
     Table->MaxDescriptor = Descriptor;
     OB_RELEASE_HANDLE_TABLE_LOCK(Table);
     return Handle;
@@ -792,21 +910,25 @@ Return Value:
 {
 
     ULONG Descriptor;
+    PHANDLE_TABLE_DIRECTORY Directory;
+    PHANDLE_TABLE_ENTRY Entry;
 
     ASSERT((Table->Process == NULL) ||
            (Table->Process->ThreadCount == 0) ||
            (Table->Process == PsGetCurrentProcess()));
 
     OB_ACQUIRE_HANDLE_TABLE_LOCK(Table);
+    Directory = Table->Directory;
     for (Descriptor = 0; Descriptor <= Table->MaxDescriptor; Descriptor += 1) {
-        if ((Table->Entries[Descriptor].Flags & HANDLE_FLAG_ALLOCATED) == 0) {
+        Entry = ObpGetHandleTableEntry(Directory, Descriptor);
+        if ((Entry == NULL) || ((Entry->Flags & HANDLE_FLAG_ALLOCATED) == 0)) {
             continue;
         }
 
         IterateRoutine(Table,
                        (HANDLE)(UINTN)Descriptor,
-                       Table->Entries[Descriptor].Flags & HANDLE_FLAG_MASK,
-                       Table->Entries[Descriptor].HandleValue,
+                       Entry->Flags & HANDLE_FLAG_MASK,
+                       Entry->HandleValue,
                        IterateRoutineContext);
     }
 
@@ -829,7 +951,10 @@ ObpExpandHandleTable (
 Routine Description:
 
     This routine expands the given handle table to support a given number of
-    descriptors.
+    descriptors. If the directory is too small, a larger copy is published
+    and the old one is freed once lookups are done with it. The leaf holding
+    the descriptor is then allocated if needed. Existing entries never move.
+    This routine assumes the handle table lock is held.
 
 Arguments:
 
@@ -847,63 +972,193 @@ Return Value:
 {
 
     UINTN AllocationSize;
-    PVOID NewBuffer;
-    UINTN NewCapacity;
-    KSTATUS Status;
+    PHANDLE_TABLE_DIRECTORY Directory;
+    PHANDLE_TABLE_ENTRY Leaf;
+    ULONG LeafIndex;
+    ULONG NewLeafCount;
+    PHANDLE_TABLE_DIRECTORY OldDirectory;
 
     if (Descriptor >= OB_MAX_HANDLES) {
-        Status = STATUS_INVALID_HANDLE;
-        goto ExpandHandleTableEnd;
+        return STATUS_INVALID_HANDLE;
     }
 
     //
-    // Expand the table if needed.
+    // Grow the directory if needed. The leaf pointers are copied over, and
+    // lookups may use either directory until the old one is retired.
     //
 
-    if (Descriptor >= Table->ArraySize) {
-        NewCapacity = Table->ArraySize * 2;
-        while ((NewCapacity <= Descriptor) &&
-               (NewCapacity >= Table->ArraySize)) {
+    LeafIndex = Descriptor >> HANDLE_TABLE_LEAF_SHIFT;
+    OldDirectory = Table->Directory;
+    if (LeafIndex >= OldDirectory->LeafCount) {
+        NewLeafCount = OldDirectory->LeafCount * 2;
+        while (NewLeafCount <= LeafIndex) {
+            NewLeafCount *= 2;
+        }
 
-            NewCapacity *= 2;
+        Directory = ObpCreateHandleTableDirectory(NewLeafCount);
+        if (Directory == NULL) {
+            return STATUS_INSUFFICIENT_RESOURCES;
         }
 
-        AllocationSize = NewCapacity * sizeof(HANDLE_TABLE_ENTRY);
-        if ((NewCapacity <= Descriptor) ||
-            (NewCapacity < Table->ArraySize) ||
-            ((AllocationSize / sizeof(HANDLE_TABLE_ENTRY)) != NewCapacity)) {
+        RtlCopyMemory((PVOID)(Directory->Leaves),
+                      (PVOID)(OldDirectory->Leaves),
+                      OldDirectory->LeafCount * sizeof(PHANDLE_TABLE_ENTRY));
 
-            Status = STATUS_TOO_MANY_HANDLES;
-            goto ExpandHandleTableEnd;
-        }
+        RtlMemoryBarrier();
+        Table->Directory = Directory;
+        ObpWaitForHandleLookups(Table);
+        MmFreePagedPool(OldDirectory);
+    }
 
-        ASSERT((NewCapacity > Table->ArraySize) &&
-               (NewCapacity > Table->NextDescriptor));
+    //
+    // Allocate the leaf, making sure its zeroed contents are visible before
+    // it is published.
+    //
 
-        NewBuffer = MmAllocatePagedPool(AllocationSize,
-                                        HANDLE_TABLE_ALLOCATION_TAG);
+    Directory = Table->Directory;
+    if (Directory->Leaves[LeafIndex] == NULL) {
+        AllocationSize = HANDLE_TABLE_LEAF_SIZE * sizeof(HANDLE_TABLE_ENTRY);
+        Leaf = MmAllocatePagedPool(AllocationSize,
+                                   HANDLE_TABLE_ALLOCATION_TAG);
 
-        if (NewBuffer == NULL) {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto ExpandHandleTableEnd;
+        if (Leaf == NULL) {
+            return STATUS_INSUFFICIENT_RESOURCES;
         }
 
-        RtlCopyMemory(NewBuffer,
-                      Table->Entries,
-                      Table->ArraySize * sizeof(HANDLE_TABLE_ENTRY));
+        RtlZeroMemory(Leaf, AllocationSize);
+        RtlMemoryBarrier();
+        Directory->Leaves[LeafIndex] = Leaf;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+PHANDLE_TABLE_DIRECTORY
+ObpCreateHandleTableDirectory (
+    ULONG LeafCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates an empty handle table directory.
+
+Arguments:
+
+    LeafCount - Supplies the number of leaf slots the directory should have.
+
+Return Value:
+
+    Returns a pointer to the new directory on success.
+
+    NULL on allocation failure.
 
-        RtlZeroMemory(
-                NewBuffer + (Table->ArraySize * sizeof(HANDLE_TABLE_ENTRY)),
-                (NewCapacity - Table->ArraySize) * sizeof(HANDLE_TABLE_ENTRY));
+--*/
+
+{
+
+    UINTN AllocationSize;
+    PHANDLE_TABLE_DIRECTORY Directory;
+
+    ASSERT(LeafCount != 0);
 
-        MmFreePagedPool(Table->Entries);
-        Table->Entries = NewBuffer;
-        Table->ArraySize = NewCapacity;
+    AllocationSize = sizeof(HANDLE_TABLE_DIRECTORY) +
+                     ((LeafCount - ANYSIZE_ARRAY) *
+                      sizeof(PHANDLE_TABLE_ENTRY));
+
+    Directory = MmAllocatePagedPool(AllocationSize,
+                                    HANDLE_TABLE_ALLOCATION_TAG);
+
+    if (Directory == NULL) {
+        return NULL;
     }
 
-    Status = STATUS_SUCCESS;
+    RtlZeroMemory(Directory, AllocationSize);
+    Directory->LeafCount = LeafCount;
+    return Directory;
+}
 
-ExpandHandleTableEnd:
-    return Status;
+PHANDLE_TABLE_ENTRY
+ObpGetHandleTableEntry (
+    PHANDLE_TABLE_DIRECTORY Directory,
+    ULONG Descriptor
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the entry for a descriptor in a handle table
+    directory.
+
+Arguments:
+
+    Directory - Supplies a pointer to the directory to search.
+
+    Descriptor - Supplies the descriptor to find.
+
+Return Value:
+
+    Returns a pointer to the entry.
+
+    NULL if the descriptor is beyond the end of the directory or its leaf
+    has not been allocated.
+
+--*/
+
+{
+
+    PHANDLE_TABLE_ENTRY Leaf;
+    ULONG LeafIndex;
+
+    LeafIndex = Descriptor >> HANDLE_TABLE_LEAF_SHIFT;
+    if (LeafIndex >= Directory->LeafCount) {
+        return NULL;
+    }
+
+    Leaf = Directory->Leaves[LeafIndex];
+    if (Leaf == NULL) {
+        return NULL;
+    }
+
+    return &(Leaf[Descriptor & HANDLE_TABLE_LEAF_MASK]);
+}
+
+VOID
+ObpWaitForHandleLookups (
+    PHANDLE_TABLE Table
+    )
+
+/*++
+
+Routine Description:
+
+    This routine waits until every lookup that might have seen the handle
+    table before the caller's change has finished. New lookups are steered to
+    the other counter first, and lookups that raced with the flip recount
+    themselves there, so the wait only covers lookups already in flight. This
+    routine assumes the handle table lock is held.
+
+Arguments:
+
+    Table - Supplies a pointer to the handle table.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Epoch;
+
+    Epoch = RtlAtomicXor32(&(Table->LookupEpoch), 1) & 0x1;
+    while (Table->Lookups[Epoch] != 0) {
+        KeYield();
+    }
+
+    return;
 }
 
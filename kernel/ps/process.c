@@ -3734,8 +3734,9 @@ PspHandleTableLookupCallback (
 
 Routine Description:
 
-    This routine is called whenever a handle is looked up. It is called with
-    the handle table lock still held.
+    This routine is called whenever a handle is looked up. The handle table
+    lock is not held, but the value cannot be released until this routine
+    returns, so it is the place to take a reference on it.
 
 Arguments:
 
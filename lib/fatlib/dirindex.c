@@ -0,0 +1,1769 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    dirindex.c
+
+Abstract:
+
+    This module implements the in-memory directory index, which hashes the
+    names in a directory and tracks its runs of free entries so that lookups
+    and creates do not need to scan the directory.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel, Boot, Build
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/lib/fat/fatlib.h>
+#include <minoca/lib/fat/fat.h>
+#include "fatlibp.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the maximum number of directory indexes kept per volume. The least
+// recently used index is destroyed when this is exceeded.
+//
+
+#define FAT_DIRECTORY_INDEX_MAX_COUNT 64
+
+//
+// Define the initial number of hash buckets in a directory index, and the
+// average chain length at which the bucket arrays are doubled.
+//
+
+#define FAT_DIRECTORY_INDEX_INITIAL_BUCKETS 64
+#define FAT_DIRECTORY_INDEX_ENTRIES_PER_BUCKET 2
+
+//
+// Define the end offset value used when the directory cannot grow (a full
+// FAT12/16 root directory).
+//
+
+#define FAT_DIRECTORY_INDEX_NO_END MAX_ULONG
+
+//
+// Define directory index flags.
+//
+
+//
+// This flag is set if the directory contains the same name more than once.
+// Only the first is indexed, so removing it invalidates the whole index.
+//
+
+#define FAT_DIRECTORY_INDEX_DUPLICATES 0x00000001
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+/*++
+
+Structure Description:
+
+    This structure stores a single name in a directory index.
+
+Members:
+
+    NameNext - Stores a pointer to the next entry in the same name hash bucket.
+
+    OffsetNext - Stores a pointer to the next entry in the same offset hash
+        bucket.
+
+    Hash - Stores the hash of the name.
+
+    EntryOffset - Stores the directory offset of the short entry for the name.
+
+    NameSize - Stores the size of the name in bytes, including the null
+        terminator.
+
+    Name - Stores a pointer to the name, which is allocated after this
+        structure.
+
+--*/
+
+typedef struct _FAT_DIRECTORY_INDEX_ENTRY FAT_DIRECTORY_INDEX_ENTRY;
+typedef FAT_DIRECTORY_INDEX_ENTRY *PFAT_DIRECTORY_INDEX_ENTRY;
+
+struct _FAT_DIRECTORY_INDEX_ENTRY {
+    PFAT_DIRECTORY_INDEX_ENTRY NameNext;
+    PFAT_DIRECTORY_INDEX_ENTRY OffsetNext;
+    ULONG Hash;
+    ULONG EntryOffset;
+    ULONG NameSize;
+    PSTR Name;
+};
+
+/*++
+
+Structure Description:
+
+    This structure stores a run of consecutive erased directory entries.
+
+Members:
+
+    TreeNode - Stores the red-black tree information, sorted by offset.
+
+    Offset - Stores the directory offset of the first erased entry.
+
+    Count - Stores the number of erased entries in the run.
+
+--*/
+
+typedef struct _FAT_DIRECTORY_FREE_RUN {
+    RED_BLACK_TREE_NODE TreeNode;
+    ULONG Offset;
+    ULONG Count;
+} FAT_DIRECTORY_FREE_RUN, *PFAT_DIRECTORY_FREE_RUN;
+
+/*++
+
+Structure Description:
+
+    This structure stores the index of a single directory.
+
+Members:
+
+    TreeNode - Stores the red-black tree information for the volume's tree of
+        directory indexes, sorted by directory cluster.
+
+    ListEntry - Stores pointers to the next and previous indexes in the
+        volume's least recently used list.
+
+    DirectoryCluster - Stores the starting cluster of the directory.
+
+    Flags - Stores a bitmask of flags. See FAT_DIRECTORY_INDEX_* definitions.
+
+    Buckets - Stores a pointer to the hash buckets. The first half of the
+        array is hashed by name, the second half by entry offset.
+
+    BucketCount - Stores the number of buckets in each half of the array. This
+        is always a power of two.
+
+    EntryCount - Stores the number of names in the index.
+
+    FreeRunTree - Stores the tree of free entry runs in the directory.
+
+    EndOffset - Stores the directory offset of the end marker, where entries
+        are appended when no free run is large enough.
+
+--*/
+
+typedef struct _FAT_DIRECTORY_INDEX {
+    RED_BLACK_TREE_NODE TreeNode;
+    LIST_ENTRY ListEntry;
+    ULONG DirectoryCluster;
+    ULONG Flags;
+    PFAT_DIRECTORY_INDEX_ENTRY *Buckets;
+    ULONG BucketCount;
+    ULONG EntryCount;
+    RED_BLACK_TREE FreeRunTree;
+    ULONG EndOffset;
+} FAT_DIRECTORY_INDEX, *PFAT_DIRECTORY_INDEX;
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+FatpLoadDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PFAT_DIRECTORY_INDEX *Index
+    );
+
+PFAT_DIRECTORY_INDEX
+FatpFindDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    );
+
+KSTATUS
+FatpBuildDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PFAT_DIRECTORY_INDEX *NewIndex
+    );
+
+VOID
+FatpDestroyDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    );
+
+VOID
+FatpRemoveDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    );
+
+KSTATUS
+FatpInsertDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG EntryOffset
+    );
+
+PFAT_DIRECTORY_INDEX_ENTRY
+FatpFindDirectoryIndexEntry (
+    PFAT_DIRECTORY_INDEX Index,
+    PCSTR Name,
+    ULONG NameLength,
+    ULONG Hash
+    );
+
+VOID
+FatpResizeDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    );
+
+KSTATUS
+FatpAddDirectoryFreeRun (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    ULONG Offset,
+    ULONG Count
+    );
+
+KSTATUS
+FatpClaimDirectoryEntries (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    ULONG Offset,
+    ULONG Count
+    );
+
+ULONG
+FatpHashDirectoryName (
+    PCSTR Name,
+    ULONG NameLength
+    );
+
+COMPARISON_RESULT
+FatpCompareDirectoryIndexNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    );
+
+COMPARISON_RESULT
+FatpCompareDirectoryFreeRunNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VOID
+FatpInitializeDirectoryIndexes (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes the directory index tree for the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlRedBlackTreeInitialize(&(Volume->DirectoryIndexTree),
+                              0,
+                              FatpCompareDirectoryIndexNodes);
+
+    INITIALIZE_LIST_HEAD(&(Volume->DirectoryIndexList));
+    Volume->DirectoryIndexCount = 0;
+    return;
+}
+
+VOID
+FatpDestroyDirectoryIndexes (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys all directory indexes on the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX Index;
+
+    //
+    // The lock isn't acquired because the volume is being destroyed, so no one
+    // should be doing any accesses.
+    //
+
+    while (LIST_EMPTY(&(Volume->DirectoryIndexList)) == FALSE) {
+        Index = LIST_VALUE(Volume->DirectoryIndexList.Next,
+                           FAT_DIRECTORY_INDEX,
+                           ListEntry);
+
+        FatpRemoveDirectoryIndex(Volume, Index);
+        FatpDestroyDirectoryIndex(Volume, Index);
+    }
+
+    return;
+}
+
+KSTATUS
+FatpDirectoryIndexLookup (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PCSTR Name,
+    ULONG NameLength,
+    PULONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine looks up a name in the directory's index, building the index
+    from the directory contents if this is the first access.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. Its position is
+        changed if the index needs to be built.
+
+    Name - Supplies the name to look up, which may not be null terminated.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    EntryOffset - Supplies a pointer where the directory offset of the name's
+        short entry will be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS if the name was found.
+
+    STATUS_PATH_NOT_FOUND if the name is not in the directory.
+
+    Other error codes if the index could not be built.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    ULONG Hash;
+    PFAT_DIRECTORY_INDEX Index;
+    KSTATUS Status;
+
+    Hash = FatpHashDirectoryName(Name, NameLength);
+    Status = FatpLoadDirectoryIndex(Volume, Directory, &Index);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    Entry = FatpFindDirectoryIndexEntry(Index, Name, NameLength, Hash);
+    if (Entry != NULL) {
+        *EntryOffset = Entry->EntryOffset;
+        Status = STATUS_SUCCESS;
+
+    } else {
+        Status = STATUS_PATH_NOT_FOUND;
+    }
+
+    FatReleaseLock(Volume->Lock);
+    return Status;
+}
+
+KSTATUS
+FatpDirectoryIndexFindFreeEntries (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONG EntryCount,
+    PULONG EntryOffset,
+    PBOOL AtEnd
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds room for a set of consecutive entries in a directory.
+    The first run of erased entries large enough is used, otherwise the
+    entries go at the end of the directory.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. Its position is
+        changed if the index needs to be built.
+
+    EntryCount - Supplies the number of consecutive entries needed.
+
+    EntryOffset - Supplies a pointer where the directory offset of the first
+        free entry will be returned.
+
+    AtEnd - Supplies a pointer where a boolean will be returned indicating if
+        the entries go at the end of the directory, in which case a new end
+        marker needs to be written after them.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VOLUME_FULL if the directory is full and cannot grow.
+
+    Other error codes if the index could not be built.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX Index;
+    PRED_BLACK_TREE_NODE Node;
+    PFAT_DIRECTORY_FREE_RUN Run;
+    KSTATUS Status;
+
+    Status = FatpLoadDirectoryIndex(Volume, Directory, &Index);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    Node = RtlRedBlackTreeGetLowestNode(&(Index->FreeRunTree));
+    while (Node != NULL) {
+        Run = RED_BLACK_TREE_VALUE(Node, FAT_DIRECTORY_FREE_RUN, TreeNode);
+        if (Run->Count >= EntryCount) {
+            *EntryOffset = Run->Offset;
+            *AtEnd = FALSE;
+            Status = STATUS_SUCCESS;
+            goto DirectoryIndexFindFreeEntriesEnd;
+        }
+
+        Node = RtlRedBlackTreeGetNextNode(&(Index->FreeRunTree), FALSE, Node);
+    }
+
+    if (Index->EndOffset == FAT_DIRECTORY_INDEX_NO_END) {
+        Status = STATUS_VOLUME_FULL;
+        goto DirectoryIndexFindFreeEntriesEnd;
+    }
+
+    *EntryOffset = Index->EndOffset;
+    *AtEnd = TRUE;
+    Status = STATUS_SUCCESS;
+
+DirectoryIndexFindFreeEntriesEnd:
+    FatReleaseLock(Volume->Lock);
+    return Status;
+}
+
+VOID
+FatpDirectoryIndexAddEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONG FirstOffset,
+    ULONG EntryCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a newly written set of entries to the directory's index,
+    if the directory is indexed. The name is decoded back from the directory
+    so that the index holds exactly what a scan would find.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. It must not have
+        any unflushed writes. Its position is changed.
+
+    FirstOffset - Supplies the directory offset of the first entry written.
+
+    EntryCount - Supplies the number of entries written, including the short
+        entry at the end.
+
+Return Value:
+
+    None. If the index cannot be updated it is destroyed.
+
+--*/
+
+{
+
+    ULONG DirectoryCluster;
+    FAT_DIRECTORY_ENTRY Entry;
+    ULONG EntriesRead;
+    PFAT_DIRECTORY_INDEX Index;
+    PSTR Name;
+    ULONG NameSize;
+    KSTATUS Status;
+
+    ASSERT((Directory->FatFlags & FAT_DIRECTORY_FLAG_DIRTY) == 0);
+
+    DirectoryCluster = Directory->File->FirstCluster;
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    FatReleaseLock(Volume->Lock);
+    if (Index == NULL) {
+        return;
+    }
+
+    //
+    // Read the name back. This is all in the directory context's buffer or
+    // the cache, as it was just written.
+    //
+
+    NameSize = FAT_MAX_LONG_FILE_LENGTH + 1;
+    Name = FatAllocatePagedMemory(Volume->Device.DeviceToken, NameSize);
+    if (Name == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto DirectoryIndexAddEntryEnd;
+    }
+
+    Status = FatpDirectorySeek(Directory, FirstOffset);
+    if (!KSUCCESS(Status)) {
+        goto DirectoryIndexAddEntryEnd;
+    }
+
+    Status = FatpReadNextDirectoryEntry(Directory,
+                                        NULL,
+                                        Name,
+                                        &NameSize,
+                                        &Entry,
+                                        &EntriesRead);
+
+    if (!KSUCCESS(Status)) {
+        goto DirectoryIndexAddEntryEnd;
+    }
+
+    if (EntriesRead != EntryCount) {
+        Status = STATUS_FILE_CORRUPT;
+        goto DirectoryIndexAddEntryEnd;
+    }
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if (Index != NULL) {
+        Status = FatpClaimDirectoryEntries(Volume,
+                                           Index,
+                                           FirstOffset,
+                                           EntryCount);
+
+        if (KSUCCESS(Status)) {
+            Status = FatpInsertDirectoryIndexEntry(
+                                            Volume,
+                                            Index,
+                                            Name,
+                                            NameSize,
+                                            FirstOffset + EntryCount - 1);
+        }
+
+        if (!KSUCCESS(Status)) {
+            FatpRemoveDirectoryIndex(Volume, Index);
+            FatReleaseLock(Volume->Lock);
+            FatpDestroyDirectoryIndex(Volume, Index);
+            Status = STATUS_SUCCESS;
+
+        } else {
+            FatReleaseLock(Volume->Lock);
+        }
+    }
+
+DirectoryIndexAddEntryEnd:
+    if (Name != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Name);
+    }
+
+    if (!KSUCCESS(Status)) {
+        FatpInvalidateDirectoryIndex(Volume, DirectoryCluster);
+    }
+
+    return;
+}
+
+VOID
+FatpDirectoryIndexRemoveEntry (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    ULONG FirstOffset,
+    ULONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes an erased name from the directory's index, if the
+    directory is indexed, and records its entries as free.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+    FirstOffset - Supplies the directory offset of the first entry that was
+        erased.
+
+    EntryOffset - Supplies the directory offset of the erased short entry.
+
+Return Value:
+
+    None. If the index cannot be updated it is destroyed.
+
+--*/
+
+{
+
+    ULONG BucketMask;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    PFAT_DIRECTORY_INDEX Index;
+    PFAT_DIRECTORY_INDEX_ENTRY *Previous;
+    KSTATUS Status;
+
+    ASSERT(FirstOffset <= EntryOffset);
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if (Index == NULL) {
+        FatReleaseLock(Volume->Lock);
+        return;
+    }
+
+    Status = STATUS_SUCCESS;
+    if ((Index->Flags & FAT_DIRECTORY_INDEX_DUPLICATES) != 0) {
+        Status = STATUS_NOT_SUPPORTED;
+        goto DirectoryIndexRemoveEntryEnd;
+    }
+
+    //
+    // Find and unlink the entry from the offset hash, then from the name hash.
+    //
+
+    BucketMask = Index->BucketCount - 1;
+    Previous = &(Index->Buckets[Index->BucketCount +
+                                (EntryOffset & BucketMask)]);
+
+    Entry = *Previous;
+    while ((Entry != NULL) && (Entry->EntryOffset != EntryOffset)) {
+        Previous = &(Entry->OffsetNext);
+        Entry = *Previous;
+    }
+
+    if (Entry != NULL) {
+        *Previous = Entry->OffsetNext;
+        Previous = &(Index->Buckets[Entry->Hash & BucketMask]);
+        while (*Previous != Entry) {
+
+            ASSERT(*Previous != NULL);
+
+            Previous = &((*Previous)->NameNext);
+        }
+
+        *Previous = Entry->NameNext;
+        Index->EntryCount -= 1;
+        FatFreePagedMemory(Volume->Device.DeviceToken, Entry);
+    }
+
+    Status = FatpAddDirectoryFreeRun(Volume,
+                                     Index,
+                                     FirstOffset,
+                                     EntryOffset - FirstOffset + 1);
+
+DirectoryIndexRemoveEntryEnd:
+    if (!KSUCCESS(Status)) {
+        FatpRemoveDirectoryIndex(Volume, Index);
+
+    } else {
+        Index = NULL;
+    }
+
+    FatReleaseLock(Volume->Lock);
+    if (Index != NULL) {
+        FatpDestroyDirectoryIndex(Volume, Index);
+    }
+
+    return;
+}
+
+VOID
+FatpInvalidateDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys the index for the given directory, if there is one.
+    It will be rebuilt from the directory contents on next use.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX Index;
+
+    FatAcquireLock(Volume->Lock);
+    Index = FatpFindDirectoryIndex(Volume, DirectoryCluster);
+    if (Index != NULL) {
+        FatpRemoveDirectoryIndex(Volume, Index);
+    }
+
+    FatReleaseLock(Volume->Lock);
+    if (Index != NULL) {
+        FatpDestroyDirectoryIndex(Volume, Index);
+    }
+
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+KSTATUS
+FatpLoadDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PFAT_DIRECTORY_INDEX *Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the index for the given directory, building it if it
+    does not exist yet. On success the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. Its position is
+        changed if the index needs to be built.
+
+    Index - Supplies a pointer where a pointer to the index will be returned.
+        The index is only valid while the volume lock is held.
+
+Return Value:
+
+    Status code. On success, the volume lock is held and the caller must
+    release it.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX Evicted;
+    PFAT_DIRECTORY_INDEX Existing;
+    PFAT_DIRECTORY_INDEX NewIndex;
+    KSTATUS Status;
+
+    FatAcquireLock(Volume->Lock);
+    Existing = FatpFindDirectoryIndex(Volume, Directory->File->FirstCluster);
+    if (Existing != NULL) {
+        *Index = Existing;
+        return STATUS_SUCCESS;
+    }
+
+    FatReleaseLock(Volume->Lock);
+
+    //
+    // Scan the directory with the lock released.
+    //
+
+    Status = FatpBuildDirectoryIndex(Volume, Directory, &NewIndex);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // Check again in case someone else built the same index, and insert the
+    // new one if not. Make room by evicting the least recently used index.
+    //
+
+    Evicted = NULL;
+    FatAcquireLock(Volume->Lock);
+    Existing = FatpFindDirectoryIndex(Volume, Directory->File->FirstCluster);
+    if (Existing == NULL) {
+        if (Volume->DirectoryIndexCount >= FAT_DIRECTORY_INDEX_MAX_COUNT) {
+            Evicted = LIST_VALUE(Volume->DirectoryIndexList.Previous,
+                                 FAT_DIRECTORY_INDEX,
+                                 ListEntry);
+
+            FatpRemoveDirectoryIndex(Volume, Evicted);
+        }
+
+        RtlRedBlackTreeInsert(&(Volume->DirectoryIndexTree),
+                              &(NewIndex->TreeNode));
+
+        INSERT_AFTER(&(NewIndex->ListEntry), &(Volume->DirectoryIndexList));
+        Volume->DirectoryIndexCount += 1;
+        Existing = NewIndex;
+        NewIndex = NULL;
+    }
+
+    *Index = Existing;
+
+    //
+    // Destroying an index does not touch the volume, so it's safe to do with
+    // the lock held.
+    //
+
+    if (NewIndex != NULL) {
+        FatpDestroyDirectoryIndex(Volume, NewIndex);
+    }
+
+    if (Evicted != NULL) {
+        FatpDestroyDirectoryIndex(Volume, Evicted);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+PFAT_DIRECTORY_INDEX
+FatpFindDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds the index for the given directory and marks it most
+    recently used. The volume lock must be held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+Return Value:
+
+    Returns a pointer to the index, or NULL if the directory is not indexed.
+
+--*/
+
+{
+
+    PRED_BLACK_TREE_NODE FoundNode;
+    PFAT_DIRECTORY_INDEX Index;
+    FAT_DIRECTORY_INDEX Search;
+
+    Search.DirectoryCluster = DirectoryCluster;
+    FoundNode = RtlRedBlackTreeSearch(&(Volume->DirectoryIndexTree),
+                                      &(Search.TreeNode));
+
+    if (FoundNode == NULL) {
+        return NULL;
+    }
+
+    Index = RED_BLACK_TREE_VALUE(FoundNode, FAT_DIRECTORY_INDEX, TreeNode);
+    if (Volume->DirectoryIndexList.Next != &(Index->ListEntry)) {
+        LIST_REMOVE(&(Index->ListEntry));
+        INSERT_AFTER(&(Index->ListEntry), &(Volume->DirectoryIndexList));
+    }
+
+    return Index;
+}
+
+KSTATUS
+FatpBuildDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PFAT_DIRECTORY_INDEX *NewIndex
+    )
+
+/*++
+
+Routine Description:
+
+    This routine creates an index for a directory by scanning its contents:
+    once for the names and once for the free entry runs.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. Its position is
+        changed.
+
+    NewIndex - Supplies a pointer where a pointer to the new index will be
+        returned on success. It is not yet inserted in the volume's tree.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG AllocationSize;
+    FAT_DIRECTORY_ENTRY Entry;
+    ULONG EntriesRead;
+    PFAT_DIRECTORY_INDEX Index;
+    PSTR Name;
+    ULONG NameSize;
+    ULONG Offset;
+    ULONG RunCount;
+    ULONG RunStart;
+    KSTATUS Status;
+
+    Name = NULL;
+    Index = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                   sizeof(FAT_DIRECTORY_INDEX));
+
+    if (Index == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto BuildDirectoryIndexEnd;
+    }
+
+    RtlZeroMemory(Index, sizeof(FAT_DIRECTORY_INDEX));
+    Index->DirectoryCluster = Directory->File->FirstCluster;
+    RtlRedBlackTreeInitialize(&(Index->FreeRunTree),
+                              0,
+                              FatpCompareDirectoryFreeRunNodes);
+
+    Index->BucketCount = FAT_DIRECTORY_INDEX_INITIAL_BUCKETS;
+    AllocationSize = Index->BucketCount * 2 *
+                     sizeof(PFAT_DIRECTORY_INDEX_ENTRY);
+
+    Index->Buckets = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                            AllocationSize);
+
+    if (Index->Buckets == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto BuildDirectoryIndexEnd;
+    }
+
+    RtlZeroMemory(Index->Buckets, AllocationSize);
+    Name = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                  FAT_MAX_LONG_FILE_LENGTH + 1);
+
+    if (Name == NULL) {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto BuildDirectoryIndexEnd;
+    }
+
+    //
+    // Gather up all the names. The offsets are tracked the same way a lookup
+    // scan would track them.
+    //
+
+    Offset = DIRECTORY_CONTENTS_OFFSET;
+    Status = FatpDirectorySeek(Directory, Offset);
+    if (!KSUCCESS(Status)) {
+        goto BuildDirectoryIndexEnd;
+    }
+
+    while (TRUE) {
+        NameSize = FAT_MAX_LONG_FILE_LENGTH + 1;
+        Status = FatpReadNextDirectoryEntry(Directory,
+                                            NULL,
+                                            Name,
+                                            &NameSize,
+                                            &Entry,
+                                            &EntriesRead);
+
+        if (Status == STATUS_END_OF_FILE) {
+            break;
+
+        } else if (!KSUCCESS(Status)) {
+            goto BuildDirectoryIndexEnd;
+        }
+
+        Offset += EntriesRead;
+        Status = FatpInsertDirectoryIndexEntry(Volume,
+                                               Index,
+                                               Name,
+                                               NameSize,
+                                               Offset - 1);
+
+        if (!KSUCCESS(Status)) {
+            goto BuildDirectoryIndexEnd;
+        }
+    }
+
+    //
+    // Now go back through looking at the raw entries for runs of erased
+    // entries and the end of the directory.
+    //
+
+    Offset = DIRECTORY_CONTENTS_OFFSET;
+    Status = FatpDirectorySeek(Directory, Offset);
+    if (!KSUCCESS(Status)) {
+        goto BuildDirectoryIndexEnd;
+    }
+
+    RunCount = 0;
+    RunStart = 0;
+    while (TRUE) {
+        Status = FatpReadDirectory(Directory, &Entry, 1, &EntriesRead);
+        if (Status == STATUS_END_OF_FILE) {
+            Index->EndOffset = Offset;
+            break;
+
+        } else if (!KSUCCESS(Status)) {
+            goto BuildDirectoryIndexEnd;
+        }
+
+        //
+        // If this is the root directory and the end of it was reached, there
+        // is no more room at the end.
+        //
+
+        if (EntriesRead == 0) {
+            Index->EndOffset = FAT_DIRECTORY_INDEX_NO_END;
+            break;
+        }
+
+        ASSERT(EntriesRead == 1);
+
+        if (Entry.DosName[0] == FAT_DIRECTORY_ENTRY_END) {
+            Index->EndOffset = Offset;
+            break;
+        }
+
+        if (Entry.DosName[0] == FAT_DIRECTORY_ENTRY_ERASED) {
+            if (RunCount == 0) {
+                RunStart = Offset;
+            }
+
+            RunCount += 1;
+
+        } else if (RunCount != 0) {
+            Status = FatpAddDirectoryFreeRun(Volume, Index, RunStart, RunCount);
+            if (!KSUCCESS(Status)) {
+                goto BuildDirectoryIndexEnd;
+            }
+
+            RunCount = 0;
+        }
+
+        Offset += 1;
+    }
+
+    if (RunCount != 0) {
+        Status = FatpAddDirectoryFreeRun(Volume, Index, RunStart, RunCount);
+        if (!KSUCCESS(Status)) {
+            goto BuildDirectoryIndexEnd;
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+
+BuildDirectoryIndexEnd:
+    if (Name != NULL) {
+        FatFreePagedMemory(Volume->Device.DeviceToken, Name);
+    }
+
+    if (!KSUCCESS(Status)) {
+        if (Index != NULL) {
+            FatpDestroyDirectoryIndex(Volume, Index);
+            Index = NULL;
+        }
+    }
+
+    *NewIndex = Index;
+    return Status;
+}
+
+VOID
+FatpDestroyDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees a directory index and all its entries. The index must
+    not be in the volume's tree.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the index to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG BucketIndex;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    PFAT_DIRECTORY_INDEX_ENTRY NextEntry;
+    PRED_BLACK_TREE_NODE Node;
+    PFAT_DIRECTORY_FREE_RUN Run;
+
+    if (Index->Buckets != NULL) {
+        for (BucketIndex = 0;
+             BucketIndex < Index->BucketCount;
+             BucketIndex += 1) {
+
+            Entry = Index->Buckets[BucketIndex];
+            while (Entry != NULL) {
+                NextEntry = Entry->NameNext;
+                FatFreePagedMemory(Volume->Device.DeviceToken, Entry);
+                Entry = NextEntry;
+            }
+        }
+
+        FatFreePagedMemory(Volume->Device.DeviceToken, Index->Buckets);
+    }
+
+    while (TRUE) {
+        Node = RtlRedBlackTreeGetLowestNode(&(Index->FreeRunTree));
+        if (Node == NULL) {
+            break;
+        }
+
+        Run = RED_BLACK_TREE_VALUE(Node, FAT_DIRECTORY_FREE_RUN, TreeNode);
+        RtlRedBlackTreeRemove(&(Index->FreeRunTree), Node);
+        FatFreePagedMemory(Volume->Device.DeviceToken, Run);
+    }
+
+    FatFreePagedMemory(Volume->Device.DeviceToken, Index);
+    return;
+}
+
+VOID
+FatpRemoveDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine removes a directory index from the volume's tree and list.
+    The volume lock must be held, unless the volume is being destroyed.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the index to remove.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlRedBlackTreeRemove(&(Volume->DirectoryIndexTree), &(Index->TreeNode));
+    LIST_REMOVE(&(Index->ListEntry));
+
+    ASSERT(Volume->DirectoryIndexCount != 0);
+
+    Volume->DirectoryIndexCount -= 1;
+    return;
+}
+
+KSTATUS
+FatpInsertDirectoryIndexEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    PCSTR Name,
+    ULONG NameSize,
+    ULONG EntryOffset
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a name to a directory index. If the name is already
+    there, the index is marked as containing duplicates and the existing name
+    wins, just as it would in a scan.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the index.
+
+    Name - Supplies a pointer to the null terminated name.
+
+    NameSize - Supplies the size of the name in bytes, including the null
+        terminator.
+
+    EntryOffset - Supplies the directory offset of the name's short entry.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG BucketMask;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    ULONG Hash;
+
+    ASSERT((NameSize != 0) && (Name[NameSize - 1] == '\0'));
+
+    Hash = FatpHashDirectoryName(Name, NameSize);
+    if (FatpFindDirectoryIndexEntry(Index, Name, NameSize, Hash) != NULL) {
+        Index->Flags |= FAT_DIRECTORY_INDEX_DUPLICATES;
+        return STATUS_SUCCESS;
+    }
+
+    Entry = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                   sizeof(FAT_DIRECTORY_INDEX_ENTRY) +
+                                   NameSize);
+
+    if (Entry == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Entry->Hash = Hash;
+    Entry->EntryOffset = EntryOffset;
+    Entry->NameSize = NameSize;
+    Entry->Name = (PSTR)(Entry + 1);
+    RtlCopyMemory(Entry->Name, Name, NameSize);
+    if (Index->EntryCount >=
+        Index->BucketCount * FAT_DIRECTORY_INDEX_ENTRIES_PER_BUCKET) {
+
+        FatpResizeDirectoryIndex(Volume, Index);
+    }
+
+    BucketMask = Index->BucketCount - 1;
+    Entry->NameNext = Index->Buckets[Hash & BucketMask];
+    Index->Buckets[Hash & BucketMask] = Entry;
+    Entry->OffsetNext = Index->Buckets[Index->BucketCount +
+                                       (EntryOffset & BucketMask)];
+
+    Index->Buckets[Index->BucketCount + (EntryOffset & BucketMask)] = Entry;
+    Index->EntryCount += 1;
+    return STATUS_SUCCESS;
+}
+
+PFAT_DIRECTORY_INDEX_ENTRY
+FatpFindDirectoryIndexEntry (
+    PFAT_DIRECTORY_INDEX Index,
+    PCSTR Name,
+    ULONG NameLength,
+    ULONG Hash
+    )
+
+/*++
+
+Routine Description:
+
+    This routine finds a name in a directory index. Names are compared the
+    same way as a directory scan compares them.
+
+Arguments:
+
+    Index - Supplies a pointer to the index.
+
+    Name - Supplies the name to find, which may not be null terminated.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    Hash - Supplies the hash of the name.
+
+Return Value:
+
+    Returns a pointer to the index entry on success.
+
+    NULL if the name is not in the index.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+
+    Entry = Index->Buckets[Hash & (Index->BucketCount - 1)];
+    while (Entry != NULL) {
+        if ((Entry->Hash == Hash) &&
+            (Entry->NameSize <= NameLength) &&
+            (RtlAreStringsEqual(Name, Entry->Name, NameLength - 1) != FALSE)) {
+
+            return Entry;
+        }
+
+        Entry = Entry->NameNext;
+    }
+
+    return NULL;
+}
+
+VOID
+FatpResizeDirectoryIndex (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index
+    )
+
+/*++
+
+Routine Description:
+
+    This routine doubles the number of hash buckets in a directory index. On
+    allocation failure the index is left as is, just with longer chains.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the index.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG AllocationSize;
+    ULONG BucketIndex;
+    ULONG BucketMask;
+    PFAT_DIRECTORY_INDEX_ENTRY Entry;
+    PFAT_DIRECTORY_INDEX_ENTRY *NewBuckets;
+    ULONG NewCount;
+    PFAT_DIRECTORY_INDEX_ENTRY NextEntry;
+    ULONG OffsetBucket;
+
+    NewCount = Index->BucketCount * 2;
+    AllocationSize = NewCount * 2 * sizeof(PFAT_DIRECTORY_INDEX_ENTRY);
+    NewBuckets = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                        AllocationSize);
+
+    if (NewBuckets == NULL) {
+        return;
+    }
+
+    RtlZeroMemory(NewBuckets, AllocationSize);
+    BucketMask = NewCount - 1;
+    for (BucketIndex = 0; BucketIndex < Index->BucketCount; BucketIndex += 1) {
+        Entry = Index->Buckets[BucketIndex];
+        while (Entry != NULL) {
+            NextEntry = Entry->NameNext;
+            Entry->NameNext = NewBuckets[Entry->Hash & BucketMask];
+            NewBuckets[Entry->Hash & BucketMask] = Entry;
+            OffsetBucket = NewCount + (Entry->EntryOffset & BucketMask);
+            Entry->OffsetNext = NewBuckets[OffsetBucket];
+            NewBuckets[OffsetBucket] = Entry;
+            Entry = NextEntry;
+        }
+    }
+
+    FatFreePagedMemory(Volume->Device.DeviceToken, Index->Buckets);
+    Index->Buckets = NewBuckets;
+    Index->BucketCount = NewCount;
+    return;
+}
+
+KSTATUS
+FatpAddDirectoryFreeRun (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    ULONG Offset,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine records a run of erased entries in a directory index,
+    merging it with the runs on either side of it.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the index.
+
+    Offset - Supplies the directory offset of the first erased entry.
+
+    Count - Supplies the number of erased entries.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_FREE_RUN Next;
+    PRED_BLACK_TREE_NODE Node;
+    PFAT_DIRECTORY_FREE_RUN Previous;
+    PFAT_DIRECTORY_FREE_RUN Run;
+    FAT_DIRECTORY_FREE_RUN Search;
+
+    ASSERT(Count != 0);
+
+    Next = NULL;
+    Previous = NULL;
+    Search.Offset = Offset;
+    Node = RtlRedBlackTreeSearchClosest(&(Index->FreeRunTree),
+                                        &(Search.TreeNode),
+                                        FALSE);
+
+    if (Node != NULL) {
+        Previous = RED_BLACK_TREE_VALUE(Node, FAT_DIRECTORY_FREE_RUN, TreeNode);
+
+        ASSERT(Previous->Offset <= Offset);
+
+        Node = RtlRedBlackTreeGetNextNode(&(Index->FreeRunTree), FALSE, Node);
+
+    } else {
+        Node = RtlRedBlackTreeGetLowestNode(&(Index->FreeRunTree));
+    }
+
+    if (Node != NULL) {
+        Next = RED_BLACK_TREE_VALUE(Node, FAT_DIRECTORY_FREE_RUN, TreeNode);
+    }
+
+    //
+    // The run should never overlap one that's already free.
+    //
+
+    if (((Previous != NULL) && (Previous->Offset + Previous->Count > Offset)) ||
+        ((Next != NULL) && (Next->Offset < Offset + Count))) {
+
+        ASSERT(FALSE);
+
+        return STATUS_FILE_CORRUPT;
+    }
+
+    if ((Previous != NULL) && (Previous->Offset + Previous->Count == Offset)) {
+        Previous->Count += Count;
+        if ((Next != NULL) &&
+            (Next->Offset == Previous->Offset + Previous->Count)) {
+
+            Previous->Count += Next->Count;
+            RtlRedBlackTreeRemove(&(Index->FreeRunTree), &(Next->TreeNode));
+            FatFreePagedMemory(Volume->Device.DeviceToken, Next);
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Growing the next run downwards doesn't change its place in the tree.
+    //
+
+    if ((Next != NULL) && (Next->Offset == Offset + Count)) {
+        Next->Offset = Offset;
+        Next->Count += Count;
+        return STATUS_SUCCESS;
+    }
+
+    Run = FatAllocatePagedMemory(Volume->Device.DeviceToken,
+                                 sizeof(FAT_DIRECTORY_FREE_RUN));
+
+    if (Run == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Run->Offset = Offset;
+    Run->Count = Count;
+    RtlRedBlackTreeInsert(&(Index->FreeRunTree), &(Run->TreeNode));
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+FatpClaimDirectoryEntries (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_INDEX Index,
+    ULONG Offset,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks a range of directory entries as used in the index,
+    either by carving it out of a free run or by moving the end of the
+    directory past it.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Index - Supplies a pointer to the index.
+
+    Offset - Supplies the directory offset of the first entry now in use.
+
+    Count - Supplies the number of entries now in use.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PRED_BLACK_TREE_NODE Node;
+    PFAT_DIRECTORY_FREE_RUN Run;
+    ULONG RunEnd;
+    FAT_DIRECTORY_FREE_RUN Search;
+
+    if (Offset == Index->EndOffset) {
+        Index->EndOffset += Count;
+        return STATUS_SUCCESS;
+    }
+
+    Search.Offset = Offset;
+    Node = RtlRedBlackTreeSearchClosest(&(Index->FreeRunTree),
+                                        &(Search.TreeNode),
+                                        FALSE);
+
+    if (Node == NULL) {
+        return STATUS_FILE_CORRUPT;
+    }
+
+    Run = RED_BLACK_TREE_VALUE(Node, FAT_DIRECTORY_FREE_RUN, TreeNode);
+    RunEnd = Run->Offset + Run->Count;
+    if ((Run->Offset > Offset) || (RunEnd < Offset + Count)) {
+        return STATUS_FILE_CORRUPT;
+    }
+
+    //
+    // Shrinking a run from the front doesn't change its place in the tree.
+    //
+
+    if (Run->Offset == Offset) {
+        if (Run->Count == Count) {
+            RtlRedBlackTreeRemove(&(Index->FreeRunTree), Node);
+            FatFreePagedMemory(Volume->Device.DeviceToken, Run);
+
+        } else {
+            Run->Offset += Count;
+            Run->Count -= Count;
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    Run->Count = Offset - Run->Offset;
+    if (RunEnd != Offset + Count) {
+        return FatpAddDirectoryFreeRun(Volume,
+                                       Index,
+                                       Offset + Count,
+                                       RunEnd - (Offset + Count));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+ULONG
+FatpHashDirectoryName (
+    PCSTR Name,
+    ULONG NameLength
+    )
+
+/*++
+
+Routine Description:
+
+    This routine hashes a directory entry name.
+
+Arguments:
+
+    Name - Supplies the name to hash, which may not be null terminated.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+Return Value:
+
+    Returns the hash of the name.
+
+--*/
+
+{
+
+    ULONG Length;
+
+    Length = 0;
+    while ((Length + 1 < NameLength) && (Name[Length] != '\0')) {
+        Length += 1;
+    }
+
+    return RtlComputeCrc32(0, Name, Length);
+}
+
+COMPARISON_RESULT
+FatpCompareDirectoryIndexNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares directory indexes by their directory clusters.
+
+Arguments:
+
+    Tree - Supplies a pointer to the Red-Black tree that owns both nodes.
+
+    FirstNode - Supplies a pointer to the left side of the comparison.
+
+    SecondNode - Supplies a pointer to the second side of the comparison.
+
+Return Value:
+
+    Same if the two nodes have the same value.
+
+    Ascending if the first node is less than the second node.
+
+    Descending if the second node is less than the first node.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_INDEX First;
+    PFAT_DIRECTORY_INDEX Second;
+
+    First = RED_BLACK_TREE_VALUE(FirstNode, FAT_DIRECTORY_INDEX, TreeNode);
+    Second = RED_BLACK_TREE_VALUE(SecondNode, FAT_DIRECTORY_INDEX, TreeNode);
+    if (First->DirectoryCluster > Second->DirectoryCluster) {
+        return ComparisonResultDescending;
+    }
+
+    if (First->DirectoryCluster < Second->DirectoryCluster) {
+        return ComparisonResultAscending;
+    }
+
+    return ComparisonResultSame;
+}
+
+COMPARISON_RESULT
+FatpCompareDirectoryFreeRunNodes (
+    PRED_BLACK_TREE Tree,
+    PRED_BLACK_TREE_NODE FirstNode,
+    PRED_BLACK_TREE_NODE SecondNode
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compares directory free runs by their offsets.
+
+Arguments:
+
+    Tree - Supplies a pointer to the Red-Black tree that owns both nodes.
+
+    FirstNode - Supplies a pointer to the left side of the comparison.
+
+    SecondNode - Supplies a pointer to the second side of the comparison.
+
+Return Value:
+
+    Same if the two nodes have the same value.
+
+    Ascending if the first node is less than the second node.
+
+    Descending if the second node is less than the first node.
+
+--*/
+
+{
+
+    PFAT_DIRECTORY_FREE_RUN First;
+    PFAT_DIRECTORY_FREE_RUN Second;
+
+    First = RED_BLACK_TREE_VALUE(FirstNode, FAT_DIRECTORY_FREE_RUN, TreeNode);
+    Second = RED_BLACK_TREE_VALUE(SecondNode, FAT_DIRECTORY_FREE_RUN, TreeNode);
+    if (First->Offset > Second->Offset) {
+        return ComparisonResultDescending;
+    }
+
+    if (First->Offset < Second->Offset) {
+        return ComparisonResultAscending;
+    }
+
+    return ComparisonResultSame;
+}
+
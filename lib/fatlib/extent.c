@@ -0,0 +1,659 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    extent.c
+
+Abstract:
+
+    This module implements the per-file cache of cluster extents, which maps
+    cluster indices within a file to clusters on the volume without walking
+    the File Allocation Table one link at a time.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Kernel, Boot, Build
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include <minoca/lib/fat/fatlib.h>
+#include <minoca/lib/fat/fat.h>
+#include "fatlibp.h"
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the initial number of extents allocated for a cache.
+//
+
+#define FAT_EXTENT_CACHE_INITIAL_CAPACITY 8
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+KSTATUS
+FatpExtendExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG FirstCluster,
+    ULONG FileCluster
+    );
+
+KSTATUS
+FatpAppendExtent (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG Cluster
+    );
+
+VOID
+FatpResetExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+VOID
+FatpInitializeExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    BOOL NonPaged
+    )
+
+/*++
+
+Routine Description:
+
+    This routine initializes an empty cluster extent cache.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume the cache belongs to.
+
+    Cache - Supplies a pointer to the cache to initialize.
+
+    NonPaged - Supplies a boolean indicating whether the extents should be
+        allocated from non-paged memory.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlZeroMemory(Cache, sizeof(FAT_EXTENT_CACHE));
+    Cache->Generation = Volume->ChainGeneration;
+    if (NonPaged != FALSE) {
+        Cache->Flags |= FAT_EXTENT_CACHE_NON_PAGED;
+    }
+
+    return;
+}
+
+VOID
+FatpDestroyExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees the extents held by a cluster extent cache.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume the cache belongs to.
+
+    Cache - Supplies a pointer to the cache to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Cache->Extents != NULL) {
+        if ((Cache->Flags & FAT_EXTENT_CACHE_NON_PAGED) != 0) {
+            FatFreeNonPagedMemory(Volume->Device.DeviceToken, Cache->Extents);
+
+        } else {
+            FatFreePagedMemory(Volume->Device.DeviceToken, Cache->Extents);
+        }
+    }
+
+    Cache->Extents = NULL;
+    Cache->Count = 0;
+    Cache->Capacity = 0;
+    Cache->ClusterCount = 0;
+    return;
+}
+
+KSTATUS
+FatpBuildExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG FirstCluster,
+    BOOL Pin
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills a cluster extent cache with the entire cluster chain
+    of a file.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume.
+
+    Cache - Supplies a pointer to the cache to fill.
+
+    FirstCluster - Supplies the first cluster of the file.
+
+    Pin - Supplies a boolean indicating whether the cache should be pinned.
+        A pinned cache is never invalidated or extended, so it can be read
+        without holding the volume lock. This is only appropriate for files
+        whose cluster chain never changes while they are open, like the page
+        file.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    KSTATUS Status;
+
+    FatAcquireLock(Volume->Lock);
+    Status = FatpExtendExtentCache(Volume, Cache, FirstCluster, MAX_ULONG);
+    if (Status == STATUS_END_OF_FILE) {
+        Status = STATUS_SUCCESS;
+    }
+
+    if ((KSUCCESS(Status)) && (Pin != FALSE)) {
+        Cache->Flags |= FAT_EXTENT_CACHE_PINNED;
+    }
+
+    FatReleaseLock(Volume->Lock);
+    return Status;
+}
+
+KSTATUS
+FatpGetFileCluster (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength
+    )
+
+/*++
+
+Routine Description:
+
+    This routine translates a cluster index within a file into a cluster on
+    the volume, extending the file's extent cache if necessary.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the zero-based index of the cluster within the
+        file.
+
+    Cluster - Supplies a pointer where the volume cluster is returned. If the
+        file ends before the requested cluster, this returns the file's last
+        cluster.
+
+    RunLength - Supplies a pointer where the number of contiguous clusters
+        starting at the returned cluster is returned. If the file ends before
+        the requested cluster, this returns the total number of clusters in
+        the file.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_END_OF_FILE if the file's cluster chain ends before the requested
+    cluster.
+
+    STATUS_FILE_CORRUPT if the cluster chain is broken.
+
+    Other error codes on device I/O or allocation failures.
+
+--*/
+
+{
+
+    PFAT_EXTENT_CACHE Cache;
+    PFAT_FILE_EXTENT Extent;
+    ULONG High;
+    BOOL LockHeld;
+    ULONG Low;
+    ULONG Middle;
+    KSTATUS Status;
+    PFAT_VOLUME Volume;
+
+    Cache = &(File->ExtentCache);
+    Volume = File->Volume;
+    LockHeld = FALSE;
+    if ((Cache->Flags & FAT_EXTENT_CACHE_PINNED) == 0) {
+        FatAcquireLock(Volume->Lock);
+        LockHeld = TRUE;
+
+        //
+        // Throw away the cache if any cluster chain on the volume has been
+        // cut short since it was built.
+        //
+
+        if (Cache->Generation != Volume->ChainGeneration) {
+            FatpResetExtentCache(Volume, Cache);
+        }
+
+        if (FileCluster >= Cache->ClusterCount) {
+            Status = FatpExtendExtentCache(Volume,
+                                           Cache,
+                                           File->FirstCluster,
+                                           FileCluster);
+
+            if (!KSUCCESS(Status)) {
+                goto GetFileClusterEnd;
+            }
+        }
+    }
+
+    if (FileCluster >= Cache->ClusterCount) {
+        Status = STATUS_END_OF_FILE;
+        goto GetFileClusterEnd;
+    }
+
+    //
+    // Binary search for the last extent starting at or before the desired
+    // cluster.
+    //
+
+    ASSERT(Cache->Count != 0);
+
+    Low = 0;
+    High = Cache->Count - 1;
+    while (Low < High) {
+        Middle = Low + ((High - Low + 1) / 2);
+        if (Cache->Extents[Middle].FileCluster <= FileCluster) {
+            Low = Middle;
+
+        } else {
+            High = Middle - 1;
+        }
+    }
+
+    Extent = &(Cache->Extents[Low]);
+
+    ASSERT((FileCluster >= Extent->FileCluster) &&
+           (FileCluster - Extent->FileCluster < Extent->Length));
+
+    *Cluster = Extent->Cluster + (FileCluster - Extent->FileCluster);
+    *RunLength = Extent->Length - (FileCluster - Extent->FileCluster);
+    Status = STATUS_SUCCESS;
+
+GetFileClusterEnd:
+    if (Status == STATUS_END_OF_FILE) {
+        if (Cache->Count != 0) {
+            Extent = &(Cache->Extents[Cache->Count - 1]);
+            *Cluster = Extent->Cluster + Extent->Length - 1;
+
+        } else {
+            *Cluster = FAT_CLUSTER_FREE;
+        }
+
+        *RunLength = Cache->ClusterCount;
+    }
+
+    if (LockHeld != FALSE) {
+        FatReleaseLock(Volume->Lock);
+    }
+
+    return Status;
+}
+
+VOID
+FatpTruncateExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG ClusterCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine records that a cluster chain on the volume is being cut
+    short, which invalidates the extents cached by every open file. The given
+    cache, which belongs to the file being cut, is trimmed rather than
+    invalidated. This routine assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume.
+
+    Cache - Supplies an optional pointer to the extent cache of the file whose
+        chain is being cut.
+
+    ClusterCount - Supplies the number of clusters that remain in the chain.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PFAT_FILE_EXTENT Extent;
+    ULONG OldGeneration;
+
+    OldGeneration = Volume->ChainGeneration;
+    Volume->ChainGeneration += 1;
+    if (Cache == NULL) {
+        return;
+    }
+
+    ASSERT((Cache->Flags & FAT_EXTENT_CACHE_PINNED) == 0);
+
+    //
+    // If the cache was already stale then it can't be trusted even up to the
+    // new length.
+    //
+
+    if (Cache->Generation != OldGeneration) {
+        FatpResetExtentCache(Volume, Cache);
+        return;
+    }
+
+    Cache->Generation = Volume->ChainGeneration;
+    if (Cache->ClusterCount <= ClusterCount) {
+        return;
+    }
+
+    while (Cache->Count != 0) {
+        Extent = &(Cache->Extents[Cache->Count - 1]);
+        if (Extent->FileCluster < ClusterCount) {
+            Extent->Length = ClusterCount - Extent->FileCluster;
+            break;
+        }
+
+        Cache->Count -= 1;
+    }
+
+    Cache->ClusterCount = ClusterCount;
+    return;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+KSTATUS
+FatpExtendExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG FirstCluster,
+    ULONG FileCluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine walks the cluster chain from the end of the cached extents
+    until the given cluster index is covered. This routine assumes the volume
+    lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume.
+
+    Cache - Supplies a pointer to the cache to extend.
+
+    FirstCluster - Supplies the first cluster of the file.
+
+    FileCluster - Supplies the index of the cluster within the file that the
+        cache should cover. Supply MAX_ULONG to cache the whole chain.
+
+Return Value:
+
+    STATUS_SUCCESS if the cache now covers the requested cluster.
+
+    STATUS_END_OF_FILE if the chain ended first. The cache covers the whole
+    chain in this case.
+
+    STATUS_FILE_CORRUPT if the chain is broken.
+
+    Other error codes on device I/O or allocation failures.
+
+--*/
+
+{
+
+    ULONG Cluster;
+    PFAT_FILE_EXTENT Extent;
+    ULONG NextCluster;
+    KSTATUS Status;
+
+    ASSERT((Cache->Flags & FAT_EXTENT_CACHE_PINNED) == 0);
+
+    if (Cache->Count == 0) {
+        if ((FirstCluster < FAT_CLUSTER_BEGIN) ||
+            (FirstCluster >= Volume->ClusterCount)) {
+
+            return STATUS_FILE_CORRUPT;
+        }
+
+        Status = FatpAppendExtent(Volume, Cache, FirstCluster);
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    Extent = &(Cache->Extents[Cache->Count - 1]);
+    Cluster = Extent->Cluster + Extent->Length - 1;
+    while (Cache->ClusterCount <= FileCluster) {
+        Status = FatpFatCacheReadClusterEntry(Volume,
+                                              TRUE,
+                                              Cluster,
+                                              &NextCluster);
+
+        if (!KSUCCESS(Status)) {
+            return Status;
+        }
+
+        //
+        // A free entry in the middle of a chain is treated as the end, the
+        // same as when getting the next cluster.
+        //
+
+        if ((NextCluster == FAT_CLUSTER_FREE) ||
+            (NextCluster > Volume->ClusterBad)) {
+
+            return STATUS_END_OF_FILE;
+        }
+
+        if ((NextCluster < FAT_CLUSTER_BEGIN) ||
+            (NextCluster >= Volume->ClusterCount)) {
+
+            return STATUS_FILE_CORRUPT;
+        }
+
+        Extent = &(Cache->Extents[Cache->Count - 1]);
+        if (NextCluster == Cluster + 1) {
+            Extent->Length += 1;
+            Cache->ClusterCount += 1;
+
+        } else {
+            Status = FatpAppendExtent(Volume, Cache, NextCluster);
+            if (!KSUCCESS(Status)) {
+                return Status;
+            }
+        }
+
+        Cluster = NextCluster;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+KSTATUS
+FatpAppendExtent (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG Cluster
+    )
+
+/*++
+
+Routine Description:
+
+    This routine adds a new one-cluster extent to the end of the cache,
+    growing the extent array if needed.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume.
+
+    Cache - Supplies a pointer to the cache.
+
+    Cluster - Supplies the volume cluster that starts the new extent.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Capacity;
+    PVOID DeviceToken;
+    PFAT_FILE_EXTENT Extent;
+    PFAT_FILE_EXTENT NewExtents;
+
+    DeviceToken = Volume->Device.DeviceToken;
+    if (Cache->Count == Cache->Capacity) {
+        Capacity = Cache->Capacity * 2;
+        if (Capacity == 0) {
+            Capacity = FAT_EXTENT_CACHE_INITIAL_CAPACITY;
+        }
+
+        if ((Cache->Flags & FAT_EXTENT_CACHE_NON_PAGED) != 0) {
+            NewExtents = FatAllocateNonPagedMemory(
+                                          DeviceToken,
+                                          Capacity * sizeof(FAT_FILE_EXTENT));
+
+        } else {
+            NewExtents = FatAllocatePagedMemory(
+                                          DeviceToken,
+                                          Capacity * sizeof(FAT_FILE_EXTENT));
+        }
+
+        if (NewExtents == NULL) {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (Cache->Extents != NULL) {
+            RtlCopyMemory(NewExtents,
+                          Cache->Extents,
+                          Cache->Count * sizeof(FAT_FILE_EXTENT));
+
+            if ((Cache->Flags & FAT_EXTENT_CACHE_NON_PAGED) != 0) {
+                FatFreeNonPagedMemory(DeviceToken, Cache->Extents);
+
+            } else {
+                FatFreePagedMemory(DeviceToken, Cache->Extents);
+            }
+        }
+
+        Cache->Extents = NewExtents;
+        Cache->Capacity = Capacity;
+    }
+
+    Extent = &(Cache->Extents[Cache->Count]);
+    Extent->FileCluster = Cache->ClusterCount;
+    Extent->Cluster = Cluster;
+    Extent->Length = 1;
+    Cache->Count += 1;
+    Cache->ClusterCount += 1;
+    return STATUS_SUCCESS;
+}
+
+VOID
+FatpResetExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache
+    )
+
+/*++
+
+Routine Description:
+
+    This routine empties an extent cache, keeping its array for reuse, and
+    stamps it with the volume's current chain generation. This routine assumes
+    the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume.
+
+    Cache - Supplies a pointer to the cache to reset.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ASSERT((Cache->Flags & FAT_EXTENT_CACHE_PINNED) == 0);
+
+    Cache->Count = 0;
+    Cache->ClusterCount = 0;
+    Cache->Generation = Volume->ChainGeneration;
+    return;
+}
+
@@ -939,6 +939,7 @@ Return Value:
                   sizeof(BLOCK_DEVICE_PARAMETERS));
 
     FatpInitializeFileMappingTree(FatVolume);
+    FatpInitializeDirectoryIndexes(FatVolume);
     FatVolume->BlockShift =
                           RtlCountTrailingZeros32(FatVolume->Device.BlockSize);
 
@@ -1181,8 +1182,10 @@ Return Value:
     PFAT_VOLUME FatVolume;
 
     FatVolume = (PFAT_VOLUME)Volume;
+    FatpDestroyFreeClusterBitmap(FatVolume);
     FatpDestroyFatCache(FatVolume);
     FatpDestroyFileMappingTree(FatVolume);
+    FatpDestroyDirectoryIndexes(FatVolume);
     FatDestroyLock(FatVolume->Lock);
     FatFreeNonPagedMemory(FatVolume->Device.DeviceToken, FatVolume);
     return STATUS_SUCCESS;
@@ -1350,9 +1353,29 @@ Return Value:
     RtlZeroMemory(FatFile, sizeof(FAT_FILE));
     FatFile->Volume = FatVolume;
     FatFile->OpenFlags = Flags;
-    FatFile->SeekTable[0] = FirstCluster;
+    FatFile->FirstCluster = FirstCluster;
     FatFile->ScratchIoBuffer = ScratchIoBuffer;
     FatFile->ScratchIoBufferLock = ScratchIoBufferLock;
+    FatpInitializeExtentCache(FatVolume,
+                              &(FatFile->ExtentCache),
+                              ((Flags & OPEN_FLAG_PAGE_FILE) != 0));
+
+    //
+    // The page file's cluster chain doesn't change while it's open, so cache
+    // all of it now. Paging I/O can then translate offsets without touching
+    // the FAT or taking the volume lock.
+    //
+
+    if ((Flags & OPEN_FLAG_PAGE_FILE) != 0) {
+        Status = FatpBuildExtentCache(FatVolume,
+                                      &(FatFile->ExtentCache),
+                                      FirstCluster,
+                                      TRUE);
+
+        if (!KSUCCESS(Status)) {
+            goto OpenFileIdEnd;
+        }
+    }
 
     //
     // If this is the root directory and the root directory is outside the
@@ -1379,6 +1402,7 @@ Return Value:
         }
 
         if (FatFile != NULL) {
+            FatpDestroyExtentCache(FatVolume, &(FatFile->ExtentCache));
             if ((Flags & OPEN_FLAG_PAGE_FILE) != 0) {
                 FatFreeNonPagedMemory(FatVolume->Device.DeviceToken, FatFile);
 
@@ -1428,6 +1452,7 @@ Return Value:
         FatDestroyLock(FatFile->ScratchIoBufferLock);
     }
 
+    FatpDestroyExtentCache(FatFile->Volume, &(FatFile->ExtentCache));
     if ((FatFile->OpenFlags & OPEN_FLAG_PAGE_FILE) != 0) {
         FatFreeNonPagedMemory(FatFile->Volume->Device.DeviceToken, FatFile);
 
@@ -2057,7 +2082,7 @@ Return Value:
             ShortEntryOffset = EntryOffset + EntriesRead - 1;
             Status = FatpAllocateClusterForEmptyFile(Volume,
                                                      &DirectoryContext,
-                                                     File->SeekTable[0],
+                                                     File->FirstCluster,
                                                      &FatDirectoryEntry,
                                                      ShortEntryOffset);
 
@@ -2350,6 +2375,14 @@ Return Value:
         goto UnlinkEnd;
     }
 
+    //
+    // The index of a removed directory is of no further use.
+    //
+
+    if ((DirectoryEntry.FileAttributes & FAT_SUBDIRECTORY) != 0) {
+        FatpInvalidateDirectoryIndex(Volume, (ULONG)FileId);
+    }
+
     Status = STATUS_SUCCESS;
 
 UnlinkEnd:
@@ -2752,31 +2785,25 @@ Return Value:
     ULONG BlockSize;
     ULONGLONG ByteOffset;
     ULONGLONG ClusterAlignedDestination;
-    ULONG ClusterBad;
     ULONGLONG ClusterEnd;
+    ULONG ClusterShift;
     ULONG ClusterSize;
     ULONGLONG ClusterStart;
     ULONG CurrentCluster;
     ULONGLONG CurrentOffset;
-    ULONG CurrentWindowIndex;
     ULONGLONG DestinationOffset;
     ULONGLONG DiskByteOffset;
     PFAT_FILE File;
     ULONGLONG FileByteOffset;
-    ULONG PreviousCluster;
-    ULONG PreviousTableIndex;
+    ULONG RunLength;
     KSTATUS Status;
-    ULONG TableIndex;
     PFAT_VOLUME Volume;
-    PVOID Window;
-    ULONG WindowIndex;
-    ULONG WindowOffset;
 
     File = (PFAT_FILE)FileToken;
     Volume = File->Volume;
     BlockShift = Volume->BlockShift;
     BlockSize = Volume->Device.BlockSize;
-    ClusterBad = Volume->ClusterBad;
+    ClusterShift = Volume->ClusterShift;
     ClusterSize = Volume->ClusterSize;
     FileByteOffset = FatSeekInformation->FileByteOffset;
     Status = STATUS_SUCCESS;
@@ -2865,15 +2892,15 @@ Return Value:
             // end of the file.
             //
 
-            if ((File->SeekTable[0] == FAT_CLUSTER_FREE) ||
-                (File->SeekTable[0] >= Volume->ClusterCount)) {
+            if ((File->FirstCluster == FAT_CLUSTER_FREE) ||
+                (File->FirstCluster >= Volume->ClusterCount)) {
 
                 Status = STATUS_END_OF_FILE;
                 goto FatFileSeekEnd;
             }
 
-            FatSeekInformation->CurrentCluster = File->SeekTable[0];
-            ByteOffset = FAT_CLUSTER_TO_BYTE(File->Volume, File->SeekTable[0]);
+            FatSeekInformation->CurrentCluster = File->FirstCluster;
+            ByteOffset = FAT_CLUSTER_TO_BYTE(File->Volume, File->FirstCluster);
             FatSeekInformation->CurrentBlock = ByteOffset >> BlockShift;
 
             ASSERT(IS_ALIGNED(ByteOffset, BlockSize) != FALSE);
@@ -2911,142 +2938,48 @@ Return Value:
     }
 
     //
-    // Get the nearest seek table index, and march down until a seek table
-    // entry is filled in. The first one is guaranteed to be filled in.
-    //
-
-    ASSERT(File->SeekTable[0] != 0);
-
-    TableIndex = FAT_SEEK_TABLE_INDEX(DestinationOffset);
-    while (File->SeekTable[TableIndex] == 0) {
-        TableIndex -= 1;
-    }
-
-    CurrentOffset = FAT_SEEK_TABLE_OFFSET(TableIndex);
-    CurrentCluster = File->SeekTable[TableIndex];
-
-    ASSERT((CurrentCluster >= FAT_CLUSTER_BEGIN) &&
-           (CurrentCluster < Volume->ClusterCount));
-
-    //
-    // As an optimization, if the current offset is below the destination and
-    // closer than this offset, use it.
-    //
-
-    if ((ALIGN_RANGE_DOWN(FileByteOffset, ClusterSize) <= DestinationOffset) &&
-        (FileByteOffset > CurrentOffset)) {
-
-        CurrentOffset = ALIGN_RANGE_DOWN(FileByteOffset, ClusterSize);
-        if (FatSeekInformation->ClusterByteOffset == ClusterSize) {
-
-            ASSERT(CurrentOffset >= ClusterSize);
-
-            CurrentOffset -= ClusterSize;
-        }
-
-        CurrentCluster = FatSeekInformation->CurrentCluster;
-    }
-
-    //
-    // Cruise the singly linked list of clusters.
+    // Look up the destination cluster in the file's extent cache rather than
+    // walking the cluster chain from a known position.
     //
 
     ClusterAlignedDestination = ALIGN_RANGE_DOWN(DestinationOffset,
                                                  ClusterSize);
 
-    PreviousCluster = CurrentCluster;
-    PreviousTableIndex = TableIndex;
-    CurrentWindowIndex = MAX_ULONG;
-    while (CurrentOffset < ClusterAlignedDestination) {
-
-        //
-        // Read the window if necessary. Chances are the previous window is
-        // still the correct one.
-        //
-
-        WindowIndex = FAT_WINDOW_INDEX(Volume, CurrentCluster);
-        if (WindowIndex != CurrentWindowIndex) {
-            Status = FatpFatCacheGetFatWindow(Volume,
-                                              FALSE,
-                                              CurrentCluster,
-                                              &Window,
-                                              &WindowOffset);
-
-            if (!KSUCCESS(Status)) {
-                goto FatFileSeekEnd;
-            }
-
-            CurrentWindowIndex = WindowIndex;
+    Status = FatpGetFileCluster(
+                         File,
+                         (ULONG)(ClusterAlignedDestination >> ClusterShift),
+                         &CurrentCluster,
+                         &RunLength);
 
-        } else if (Volume->Format != Fat12Format) {
-            WindowOffset = CurrentCluster -
-                           FAT_WINDOW_INDEX_TO_CLUSTER(Volume, WindowIndex);
-        }
-
-        //
-        // Get the next cluster.
-        //
-
-        if (Volume->Format == Fat12Format) {
-            CurrentCluster = FAT12_READ_CLUSTER(Window, CurrentCluster);
-
-        } else if (Volume->Format == Fat16Format) {
-            CurrentCluster = ((PUSHORT)Window)[WindowOffset];
-
-        } else {
-            CurrentCluster = ((PULONG)Window)[WindowOffset];
-        }
-
-        CurrentOffset += ClusterSize;
-
-        //
-        // Stop if the end of the file was hit.
-        //
+    //
+    // If the end of the file was hit, the last cluster and the cluster count
+    // of the file were returned. Tip it just over the line so just before the
+    // first I/O operation it needs to fetch the next cluster.
+    //
 
+    if (Status == STATUS_END_OF_FILE) {
         if ((CurrentCluster < FAT_CLUSTER_BEGIN) ||
-            (CurrentCluster >= ClusterBad)) {
-
-            if (CurrentOffset == ClusterAlignedDestination) {
-                Status = STATUS_SUCCESS;
-
-            } else {
-                Status = STATUS_END_OF_FILE;
-            }
+            (CurrentCluster >= Volume->ClusterCount)) {
 
-            DiskByteOffset = FAT_CLUSTER_TO_BYTE(Volume, PreviousCluster);
-
-            //
-            // Tip it just over the line so just before the first I/O operation
-            // it needs to fetch the next cluster.
-            //
-
-            FatSeekInformation->CurrentBlock = DiskByteOffset >> BlockShift;
-            FatSeekInformation->ClusterByteOffset = ClusterSize;
-            FatSeekInformation->CurrentCluster = PreviousCluster;
-            FatSeekInformation->FileByteOffset = CurrentOffset;
+            Status = STATUS_FILE_CORRUPT;
             goto FatFileSeekEnd;
         }
 
-        //
-        // Populate the seek table.
-        //
-
-        TableIndex = FAT_SEEK_TABLE_INDEX(CurrentOffset);
-        if (TableIndex != PreviousTableIndex) {
-            if ((CurrentOffset & FAT_SEEK_OFFSET_MASK) == 0) {
-
-                ASSERT((File->SeekTable[TableIndex] == 0) ||
-                       (File->SeekTable[TableIndex] == CurrentCluster));
-
-                ASSERT(CurrentCluster != 0);
-
-                File->SeekTable[TableIndex] = CurrentCluster;
-            }
-
-            PreviousTableIndex = TableIndex;
+        CurrentOffset = (ULONGLONG)RunLength << ClusterShift;
+        if (CurrentOffset == ClusterAlignedDestination) {
+            Status = STATUS_SUCCESS;
         }
 
-        PreviousCluster = CurrentCluster;
+        DiskByteOffset = FAT_CLUSTER_TO_BYTE(Volume, CurrentCluster);
+        FatSeekInformation->CurrentBlock = DiskByteOffset >> BlockShift;
+        FatSeekInformation->ClusterByteOffset = ClusterSize;
+        FatSeekInformation->CurrentCluster = CurrentCluster;
+        FatSeekInformation->FileByteOffset = CurrentOffset;
+        goto FatFileSeekEnd;
+    }
+
+    if (!KSUCCESS(Status)) {
+        goto FatFileSeekEnd;
     }
 
     //
@@ -3319,7 +3252,8 @@ Return Value:
         Status = FatpPerformLongEntryMaintenance(&DirectoryContext,
                                                  EntryOffset,
                                                  Checksum,
-                                                 NewChecksum);
+                                                 NewChecksum,
+                                                 NULL);
 
         if (!KSUCCESS(Status)) {
             goto FatWriteFilePropertiesEnd;
@@ -3371,10 +3305,9 @@ Routine Description:
     Volume - Supplies a pointer to the FAT volume.
 
     FileToken - Supplies an optional pointer to an open file token for the
-        file. If this is set, then the seek table for the file will be
-        maintained. If no file is supplied or there are other open files, the
-        seek table for those files will be wrong and may cause volume
-        corruption.
+        file. If this is set, then the cached cluster extents for the file
+        are trimmed and kept. The cached extents of every other open file on
+        the volume are invalidated.
 
     FileId - Supplies the ID of the file whose contents should be deleted or
         truncated.
@@ -3396,13 +3329,14 @@ Return Value:
 
     ULONG ClusterCount;
     BOOL DirtyFat;
+    PFAT_EXTENT_CACHE ExtentCache;
     PFAT_VOLUME FatVolume;
     PFAT_FILE File;
     KSTATUS FlushStatus;
+    ULONG KeptClusters;
     ULONG NextCluster;
     ULONG StartingCluster;
     KSTATUS Status;
-    ULONG TableIndex;
     BOOL VolumeLockHeld;
 
     ASSERT((Truncate != FALSE) || (FileSize == 0));
@@ -3410,7 +3344,13 @@ Return Value:
     DirtyFat = FALSE;
     FatVolume = (PFAT_VOLUME)Volume;
     File = (PFAT_FILE)FileToken;
+    ExtentCache = NULL;
+    if (File != NULL) {
+        ExtentCache = &(File->ExtentCache);
+    }
+
     ClusterCount = FatVolume->ClusterCount;
+    KeptClusters = 1;
     StartingCluster = (ULONG)FileId;
     VolumeLockHeld = FALSE;
 
@@ -3448,6 +3388,7 @@ Return Value:
             }
 
             FileSize -= FatVolume->ClusterSize;
+            KeptClusters += 1;
         }
 
         //
@@ -3466,6 +3407,17 @@ Return Value:
             goto DeleteFileBlocksEnd;
         }
 
+        //
+        // If the chain was just cut short, update the extent caches while
+        // the lock is still held.
+        //
+
+        if ((NextCluster >= FAT_CLUSTER_BEGIN) &&
+            (NextCluster < ClusterCount)) {
+
+            FatpTruncateExtentCache(FatVolume, ExtentCache, KeptClusters);
+        }
+
         DirtyFat = TRUE;
         FatReleaseLock(FatVolume->Lock);
         VolumeLockHeld = FALSE;
@@ -3495,17 +3447,13 @@ Return Value:
     }
 
     //
-    // Clean out the seek table if a file was provided.
+    // If the whole chain is going away, invalidate the extent caches.
     //
 
-    if (File != NULL) {
-        TableIndex = FAT_SEEK_TABLE_INDEX(FileSize);
-        if ((TableIndex == 0) && (Truncate != FALSE)) {
-            TableIndex = 1;
-        }
-
-        RtlZeroMemory(&(File->SeekTable[TableIndex]),
-                      (FAT_SEEK_TABLE_SIZE - TableIndex) * FAT32_CLUSTER_WIDTH);
+    if (Truncate == FALSE) {
+        FatAcquireLock(FatVolume->Lock);
+        FatpTruncateExtentCache(FatVolume, ExtentCache, 0);
+        FatReleaseLock(FatVolume->Lock);
     }
 
     //
@@ -3575,17 +3523,16 @@ Return Value:
 {
 
     PFILE_BLOCK_ENTRY BlockEntry;
-    ULONG CurrentCluster;
     ULONGLONG DiskByteOffset;
+    PFAT_FILE_EXTENT Extent;
+    FAT_EXTENT_CACHE ExtentCache;
+    ULONG ExtentIndex;
     PFAT_VOLUME FatVolume;
     PFILE_BLOCK_INFORMATION Information;
-    ULONG NextCluster;
-    ULONG RunCount;
-    ULONG RunStart;
     KSTATUS Status;
 
     FatVolume = (PFAT_VOLUME)Volume;
-    NextCluster = (ULONG)FileId;
+    FatpInitializeExtentCache(FatVolume, &ExtentCache, FALSE);
 
     //
     // Create the head of the list.
@@ -3602,52 +3549,21 @@ Return Value:
     INITIALIZE_LIST_HEAD(&(Information->BlockList));
 
     //
-    // Loop getting the next cluster, creating a new run every time a
-    // non-contiguous cluster is discovered.
+    // Collect the file's cluster chain as extents, and add a block run for
+    // each one.
     //
 
-    RunStart = NextCluster;
-    RunCount = 1;
-    while (TRUE) {
-        CurrentCluster = NextCluster;
-        Status = FatpGetNextCluster(FatVolume, 0, CurrentCluster, &NextCluster);
-        if (!KSUCCESS(Status)) {
-            goto GetFileBlockInformationEnd;
-        }
-
-        //
-        // If the next cluster is free, reserved, or bad, the file is corrupt.
-        //
-
-        if ((NextCluster < FAT_CLUSTER_BEGIN) ||
-            (NextCluster == FatVolume->ClusterBad)) {
-
-            Status = STATUS_FILE_CORRUPT;
-            goto GetFileBlockInformationEnd;
-        }
+    Status = FatpBuildExtentCache(FatVolume,
+                                  &ExtentCache,
+                                  (ULONG)FileId,
+                                  FALSE);
 
-        //
-        // If this is the end of the file, exit and add the last run after the
-        // loop.
-        //
-
-        if (NextCluster > FatVolume->ClusterBad) {
-            break;
-        }
-
-        //
-        // If this is part of the run, then up the count and continue.
-        //
-
-        if (NextCluster == (CurrentCluster + 1)) {
-            RunCount += 1;
-            continue;
-        }
-
-        //
-        // The run is over. Add it to the list.
-        //
+    if (!KSUCCESS(Status)) {
+        goto GetFileBlockInformationEnd;
+    }
 
+    for (ExtentIndex = 0; ExtentIndex < ExtentCache.Count; ExtentIndex += 1) {
+        Extent = &(ExtentCache.Extents[ExtentIndex]);
         BlockEntry = FatAllocateNonPagedMemory(FatVolume->Device.DeviceToken,
                                                sizeof(FILE_BLOCK_ENTRY));
 
@@ -3656,35 +3572,14 @@ Return Value:
             goto GetFileBlockInformationEnd;
         }
 
-        DiskByteOffset = FAT_CLUSTER_TO_BYTE(FatVolume, RunStart);
+        DiskByteOffset = FAT_CLUSTER_TO_BYTE(FatVolume, Extent->Cluster);
         BlockEntry->Address = DiskByteOffset >> FatVolume->BlockShift;
-        BlockEntry->Count = (RunCount * FatVolume->ClusterSize) >>
-                            FatVolume->BlockShift;
+        BlockEntry->Count = ((ULONGLONG)Extent->Length *
+                             FatVolume->ClusterSize) >> FatVolume->BlockShift;
 
         INSERT_BEFORE(&(BlockEntry->ListEntry), &(Information->BlockList));
-        RunStart = NextCluster;
-        RunCount = 1;
     }
 
-    //
-    // Add the last run to the list.
-    //
-
-    BlockEntry = FatAllocateNonPagedMemory(FatVolume->Device.DeviceToken,
-                                           sizeof(FILE_BLOCK_ENTRY));
-
-    if (BlockEntry == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
-        goto GetFileBlockInformationEnd;
-    }
-
-    DiskByteOffset = FAT_CLUSTER_TO_BYTE(FatVolume, RunStart);
-    BlockEntry->Address = DiskByteOffset >> FatVolume->BlockShift;
-    BlockEntry->Count = (RunCount * FatVolume->ClusterSize) >>
-                        FatVolume->BlockShift;
-
-    INSERT_BEFORE(&(BlockEntry->ListEntry), &(Information->BlockList));
-
     //
     // Now that the disk blocks are collected, query the backing device so that
     // it has a chance to adjust the offsets to absolute disk offsets.
@@ -3701,6 +3596,7 @@ Return Value:
     Status = STATUS_SUCCESS;
 
 GetFileBlockInformationEnd:
+    FatpDestroyExtentCache(FatVolume, &ExtentCache);
     if (!KSUCCESS(Status)) {
         if (Information != NULL) {
             while (LIST_EMPTY(&(Information->BlockList)) == FALSE) {
@@ -3758,6 +3654,7 @@ Return Value:
     BOOL Dirty;
     PFAT_VOLUME FatVolume;
     ULONG NextCluster;
+    ULONG RunSize;
     KSTATUS Status;
 
     FatVolume = Volume;
@@ -3775,8 +3672,24 @@ Return Value:
             return Status;
         }
 
+        //
+        // Allocate everything still needed as one run. The loop then walks
+        // the freshly chained clusters without allocating again, unless the
+        // free space was too fragmented to satisfy the whole request.
+        //
+
         if (NextCluster >= ClusterCount) {
-            Status = FatpAllocateCluster(Volume, Cluster, &NextCluster, FALSE);
+            RunSize = (ULONG)((FileSize - CurrentSize +
+                               FatVolume->ClusterSize - 1) >>
+                              FatVolume->ClusterShift);
+
+            Status = FatpAllocateClusterRun(Volume,
+                                            Cluster,
+                                            RunSize,
+                                            &NextCluster,
+                                            NULL,
+                                            FALSE);
+
             if (!KSUCCESS(Status)) {
                 return Status;
             }
@@ -3873,15 +3786,17 @@ Return Value:
     ULONG CurrentCluster;
     PFAT_FILE File;
     ULONGLONG FileByteOffset;
+    ULONG FileCluster;
     KSTATUS FlushStatus;
+    ULONG LastFileCluster;
     UINTN MaxContiguousBytes;
     ULONG NewCluster;
     BOOL NewTerritory;
     ULONG NextCluster;
+    ULONG RunSize;
     PFAT_IO_BUFFER ScratchIoBuffer;
     BOOL ScratchLockHeld;
     KSTATUS Status;
-    ULONG TableIndex;
     UINTN TotalBytesProcessed;
     PFAT_VOLUME Volume;
 
@@ -3932,7 +3847,7 @@ Return Value:
             // ID.
             //
 
-            if (File->SeekTable[0] == FAT_CLUSTER_FREE) {
+            if (File->FirstCluster == FAT_CLUSTER_FREE) {
 
                 ASSERT(FALSE);
 
@@ -3940,8 +3855,8 @@ Return Value:
                 goto PerformFileIoEnd;
             }
 
-            if ((File->SeekTable[0] < FAT_CLUSTER_BEGIN) ||
-                (File->SeekTable[0] >= ClusterBad)) {
+            if ((File->FirstCluster < FAT_CLUSTER_BEGIN) ||
+                (File->FirstCluster >= ClusterBad)) {
 
                 Status = STATUS_FILE_CORRUPT;
                 goto PerformFileIoEnd;
@@ -3952,8 +3867,8 @@ Return Value:
             // the file.
             //
 
-            FatSeekInformation->CurrentCluster = File->SeekTable[0];
-            ByteOffset = FAT_CLUSTER_TO_BYTE(Volume, File->SeekTable[0]);
+            FatSeekInformation->CurrentCluster = File->FirstCluster;
+            ByteOffset = FAT_CLUSTER_TO_BYTE(Volume, File->FirstCluster);
             FatSeekInformation->CurrentBlock = ByteOffset >> BlockShift;
 
             ASSERT(IS_ALIGNED(ByteOffset, BlockSize) != FALSE);
@@ -4004,10 +3919,17 @@ Return Value:
             ASSERT((IoFlags & IO_FLAG_NO_ALLOCATE) == 0);
             ASSERT((File->OpenFlags & OPEN_FLAG_PAGE_FILE) == 0);
 
-            Status = FatpAllocateCluster(Volume,
-                                         FatSeekInformation->CurrentCluster,
-                                         &NewCluster,
-                                         FALSE);
+            //
+            // Allocate enough clusters for the whole write in one run.
+            //
+
+            RunSize = ALIGN_RANGE_UP(SizeInBytes, ClusterSize) >> ClusterShift;
+            Status = FatpAllocateClusterRun(Volume,
+                                            FatSeekInformation->CurrentCluster,
+                                            RunSize,
+                                            &NewCluster,
+                                            NULL,
+                                            FALSE);
 
             if (!KSUCCESS(Status)) {
                 goto PerformFileIoEnd;
@@ -4034,22 +3956,6 @@ Return Value:
         }
 
         FatSeekInformation->ClusterByteOffset = 0;
-
-        //
-        // Populate the seek table.
-        //
-
-        TableIndex = FAT_SEEK_TABLE_INDEX(FatSeekInformation->FileByteOffset);
-        if ((FatSeekInformation->FileByteOffset & FAT_SEEK_OFFSET_MASK) == 0) {
-
-            ASSERT((File->SeekTable[TableIndex] == 0) ||
-                   (File->SeekTable[TableIndex] ==
-                    FatSeekInformation->CurrentCluster));
-
-            ASSERT(FatSeekInformation->CurrentCluster != 0);
-
-            File->SeekTable[TableIndex] = FatSeekInformation->CurrentCluster;
-        }
     }
 
     ASSERT(FatSeekInformation->CurrentBlock != 0);
@@ -4074,6 +3980,48 @@ Return Value:
 
             CurrentCluster = FatSeekInformation->CurrentCluster;
             FileByteOffset = FatSeekInformation->FileByteOffset;
+
+            //
+            // Use the extent cache to skip over the clusters known to follow
+            // the current one contiguously, so that the walk below only
+            // needs to read the FAT where the run breaks. Failures here just
+            // fall back to walking the chain.
+            //
+
+            if (MaxContiguousBytes < SizeInBytes) {
+                FileCluster = (ULONG)(FileByteOffset >> ClusterShift);
+                LastFileCluster = (ULONG)((FileByteOffset + SizeInBytes - 1) >>
+                                          ClusterShift);
+
+                //
+                // Pull the whole range of this I/O into the cache first, then
+                // look up the run containing the current cluster.
+                //
+
+                FatpGetFileCluster(File,
+                                   LastFileCluster,
+                                   &NextCluster,
+                                   &RunSize);
+
+                Status = FatpGetFileCluster(File,
+                                            FileCluster,
+                                            &NextCluster,
+                                            &RunSize);
+
+                if ((KSUCCESS(Status)) && (NextCluster == CurrentCluster)) {
+                    while ((RunSize > 1) &&
+                           (MaxContiguousBytes < SizeInBytes)) {
+
+                        MaxContiguousBytes += ClusterSize;
+                        CurrentCluster += 1;
+                        RunSize -= 1;
+                    }
+                }
+
+                NextCluster = FAT_CLUSTER_FREE;
+                Status = STATUS_SUCCESS;
+            }
+
             while (MaxContiguousBytes < SizeInBytes) {
                 Status = FatpGetNextCluster(Volume,
                                             IoFlags,
@@ -4099,10 +4047,20 @@ Return Value:
                     ASSERT((IoFlags & IO_FLAG_NO_ALLOCATE) == 0);
                     ASSERT((File->OpenFlags & OPEN_FLAG_PAGE_FILE) == 0);
 
-                    Status = FatpAllocateCluster(Volume,
-                                                 CurrentCluster,
-                                                 &NewCluster,
-                                                 FALSE);
+                    //
+                    // Allocate the rest of the write's growth as one run.
+                    // Later passes of this loop follow the new chain.
+                    //
+
+                    RunSize = ALIGN_RANGE_UP(SizeInBytes - MaxContiguousBytes,
+                                             ClusterSize) >> ClusterShift;
+
+                    Status = FatpAllocateClusterRun(Volume,
+                                                    CurrentCluster,
+                                                    RunSize,
+                                                    &NewCluster,
+                                                    NULL,
+                                                    FALSE);
 
                     if (!KSUCCESS(Status)) {
                         goto PerformFileIoEnd;
@@ -4118,22 +4076,6 @@ Return Value:
 
                 MaxContiguousBytes += ClusterSize;
                 CurrentCluster = NextCluster;
-                FileByteOffset += ClusterSize;
-
-                //
-                // Populate the seek table.
-                //
-
-                TableIndex = FAT_SEEK_TABLE_INDEX(FileByteOffset);
-                if ((FileByteOffset & FAT_SEEK_OFFSET_MASK) == 0) {
-
-                    ASSERT((File->SeekTable[TableIndex] == 0) ||
-                           (File->SeekTable[TableIndex] == CurrentCluster));
-
-                    ASSERT(CurrentCluster != 0);
-
-                    File->SeekTable[TableIndex] = CurrentCluster;
-                }
             }
         }
 
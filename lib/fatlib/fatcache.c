@@ -686,6 +686,309 @@ Return Value:
     return TotalStatus;
 }
 
+KSTATUS
+FatpFatCacheWriteClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG FirstCluster,
+    ULONG ClusterCount,
+    ULONG LastValue
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the FAT cache to chain together a run of consecutive
+    clusters. Each cluster in the run is pointed at the one after it, and the
+    last cluster is set to the given value. Each window touched is marked
+    dirty once rather than once per cluster. This routine assumes that the
+    volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    FirstCluster - Supplies the first cluster of the run.
+
+    ClusterCount - Supplies the number of clusters in the run.
+
+    LastValue - Supplies the value to write into the FAT entry of the last
+        cluster in the run. This is usually the end of file marker.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONG Cluster;
+    ULONG EndCluster;
+    ULONG EndOffset;
+    PFAT_CACHE FatCache;
+    PVOID FatWindow;
+    ULONG StartOffset;
+    KSTATUS Status;
+    ULONG Value;
+    ULONG WindowEnd;
+    ULONG WindowIndex;
+    ULONG WindowStart;
+
+    FatCache = &(Volume->FatCache);
+
+    ASSERT(FatCache->Windows != NULL);
+    ASSERT(ClusterCount != 0);
+    ASSERT((FirstCluster >= FAT_CLUSTER_BEGIN) &&
+           (FirstCluster + ClusterCount <= Volume->ClusterCount));
+
+    Cluster = FirstCluster;
+    EndCluster = FirstCluster + ClusterCount;
+    while (Cluster < EndCluster) {
+        WindowIndex = FAT_WINDOW_INDEX(Volume, Cluster);
+
+        ASSERT(WindowIndex < FatCache->WindowCount);
+
+        if (FatCache->Windows[WindowIndex] == NULL) {
+            Status = FatpFatCacheReadWindow(Volume, TRUE, WindowIndex);
+            if (!KSUCCESS(Status)) {
+                goto FatCacheWriteClusterRunEnd;
+            }
+        }
+
+        FatWindow = FatCache->Windows[WindowIndex];
+
+        //
+        // FAT12 FATs always fit in the first window, and are indexed by the
+        // cluster number directly.
+        //
+
+        if (Volume->Format == Fat12Format) {
+
+            ASSERT(WindowIndex == 0);
+
+            WindowEnd = EndCluster;
+            StartOffset = (UINTN)FAT12_CLUSTER_BYTE(0, Cluster);
+            EndOffset = (UINTN)FAT12_CLUSTER_BYTE(0, WindowEnd - 1) +
+                        sizeof(USHORT);
+
+            while (Cluster < WindowEnd) {
+                Value = Cluster + 1;
+                if (Value == EndCluster) {
+                    Value = LastValue;
+                }
+
+                FAT12_WRITE_CLUSTER(FatWindow, Cluster, Value);
+                Cluster += 1;
+            }
+
+        } else {
+            WindowStart = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, WindowIndex);
+            WindowEnd = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, WindowIndex + 1);
+            if (WindowEnd > EndCluster) {
+                WindowEnd = EndCluster;
+            }
+
+            StartOffset = (Cluster - WindowStart) << Volume->ClusterWidthShift;
+            EndOffset = (WindowEnd - WindowStart) << Volume->ClusterWidthShift;
+            while (Cluster < WindowEnd) {
+                Value = Cluster + 1;
+                if (Value == EndCluster) {
+                    Value = LastValue;
+                }
+
+                if (Volume->Format == Fat16Format) {
+                    ((PUSHORT)FatWindow)[Cluster - WindowStart] = Value;
+
+                } else {
+                    ((PULONG)FatWindow)[Cluster - WindowStart] = Value;
+                }
+
+                Cluster += 1;
+            }
+        }
+
+        //
+        // Mark the region in the window that's dirty, and potentially expand
+        // the set of windows that need to be flushed.
+        //
+
+        if (FatCache->Dirty[WindowIndex].Min > StartOffset) {
+            FatCache->Dirty[WindowIndex].Min = StartOffset;
+        }
+
+        if (FatCache->Dirty[WindowIndex].Max < EndOffset) {
+            FatCache->Dirty[WindowIndex].Max = EndOffset;
+        }
+
+        if (FatCache->DirtyStart > WindowIndex) {
+            FatCache->DirtyStart = WindowIndex;
+        }
+
+        if (FatCache->DirtyEnd < WindowIndex + 1) {
+            FatCache->DirtyEnd = WindowIndex + 1;
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+
+FatCacheWriteClusterRunEnd:
+    return Status;
+}
+
+KSTATUS
+FatpFatCacheScanFreeClusters (
+    PFAT_VOLUME Volume,
+    PULONG Bitmap,
+    PULONG FreeCount
+    )
+
+/*++
+
+Routine Description:
+
+    This routine scans the entire File Allocation Table and sets a bit in the
+    given bitmap for every free cluster. Windows already in the cache are used
+    directly. Windows not in the cache are read into a transient buffer so
+    that a scan of a large FAT does not pin the whole table in memory. This
+    routine assumes that the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Bitmap - Supplies a pointer to a zeroed bitmap with at least one bit per
+        cluster in the volume.
+
+    FreeCount - Supplies a pointer where the number of free clusters found
+        will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    ULONGLONG BlockAddress;
+    ULONG BlockShift;
+    ULONG Cluster;
+    ULONG ClusterCount;
+    PFAT_CACHE FatCache;
+    ULONG Free;
+    PFAT_IO_BUFFER ScratchIoBuffer;
+    PVOID ScratchWindow;
+    KSTATUS Status;
+    ULONG Value;
+    PVOID Window;
+    ULONG WindowEnd;
+    ULONG WindowIndex;
+    ULONG WindowStart;
+
+    BlockShift = Volume->BlockShift;
+    ClusterCount = Volume->ClusterCount;
+    FatCache = &(Volume->FatCache);
+    Free = 0;
+    ScratchIoBuffer = NULL;
+    ScratchWindow = NULL;
+    Cluster = FAT_CLUSTER_BEGIN;
+    while (Cluster < ClusterCount) {
+        WindowIndex = FAT_WINDOW_INDEX(Volume, Cluster);
+
+        ASSERT(WindowIndex < FatCache->WindowCount);
+
+        Window = FatCache->Windows[WindowIndex];
+        if (Window == NULL) {
+            if (ScratchIoBuffer == NULL) {
+                ScratchIoBuffer = FatAllocateIoBuffer(
+                                                  Volume->Device.DeviceToken,
+                                                  FatCache->WindowSize);
+
+                if (ScratchIoBuffer == NULL) {
+                    Status = STATUS_INSUFFICIENT_RESOURCES;
+                    goto FatCacheScanFreeClustersEnd;
+                }
+
+                ScratchWindow = FatMapIoBuffer(ScratchIoBuffer);
+                if (ScratchWindow == NULL) {
+                    Status = STATUS_INSUFFICIENT_RESOURCES;
+                    goto FatCacheScanFreeClustersEnd;
+                }
+            }
+
+            BlockAddress = Volume->FatByteStart +
+                           ((ULONGLONG)WindowIndex << FatCache->WindowShift);
+
+            BlockAddress >>= BlockShift;
+
+            Status = FatReadDevice(Volume->Device.DeviceToken,
+                                   BlockAddress,
+                                   FatCache->WindowSize >> BlockShift,
+                                   IO_FLAG_FS_DATA | IO_FLAG_FS_METADATA,
+                                   NULL,
+                                   ScratchIoBuffer);
+
+            if (!KSUCCESS(Status)) {
+                goto FatCacheScanFreeClustersEnd;
+            }
+
+            Window = ScratchWindow;
+        }
+
+        if (Volume->Format == Fat12Format) {
+
+            ASSERT(WindowIndex == 0);
+
+            while (Cluster < ClusterCount) {
+                Value = FAT12_READ_CLUSTER(Window, Cluster);
+                if (Value == FAT_CLUSTER_FREE) {
+                    FAT_FREE_BITMAP_SET(Bitmap, Cluster);
+
+                    Free += 1;
+                }
+
+                Cluster += 1;
+            }
+
+            continue;
+        }
+
+        WindowStart = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, WindowIndex);
+        WindowEnd = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, WindowIndex + 1);
+        if (WindowEnd > ClusterCount) {
+            WindowEnd = ClusterCount;
+        }
+
+        while (Cluster < WindowEnd) {
+            if (Volume->Format == Fat16Format) {
+                Value = ((PUSHORT)Window)[Cluster - WindowStart];
+
+            } else {
+                Value = ((PULONG)Window)[Cluster - WindowStart];
+            }
+
+            if (Value == FAT_CLUSTER_FREE) {
+                FAT_FREE_BITMAP_SET(Bitmap, Cluster);
+
+                Free += 1;
+            }
+
+            Cluster += 1;
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+
+FatCacheScanFreeClustersEnd:
+    if (ScratchIoBuffer != NULL) {
+        FatFreeIoBuffer(ScratchIoBuffer);
+    }
+
+    *FreeCount = Free;
+    return Status;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -70,16 +70,23 @@ Module Name:
      (_Volume)->ClusterWidthShift)
 
 //
-// This macro gets the closest seek table entry for the given file offset.
+// These macros test, set, and clear the bit for a cluster in the free cluster
+// bitmap. A set bit indicates a free cluster.
 //
 
-#define FAT_SEEK_TABLE_INDEX(_Offset) ((_Offset) >> FAT_SEEK_OFFSET_SHIFT)
+#define FAT_FREE_BITMAP_BITS (sizeof(ULONG) * BITS_PER_BYTE)
 
-//
-// This macro converts a seek table index back into an offset.
-//
+#define FAT_FREE_BITMAP_TEST(_Bitmap, _Cluster)                  \
+    (((_Bitmap)[(_Cluster) / FAT_FREE_BITMAP_BITS] &             \
+      (1UL << ((_Cluster) % FAT_FREE_BITMAP_BITS))) != 0)
 
-#define FAT_SEEK_TABLE_OFFSET(_Index) ((_Index) << FAT_SEEK_OFFSET_SHIFT)
+#define FAT_FREE_BITMAP_SET(_Bitmap, _Cluster)                   \
+    ((_Bitmap)[(_Cluster) / FAT_FREE_BITMAP_BITS] |=             \
+     (1UL << ((_Cluster) % FAT_FREE_BITMAP_BITS)))
+
+#define FAT_FREE_BITMAP_CLEAR(_Bitmap, _Cluster)                 \
+    ((_Bitmap)[(_Cluster) / FAT_FREE_BITMAP_BITS] &=             \
+     ~(1UL << ((_Cluster) % FAT_FREE_BITMAP_BITS)))
 
 //
 // ---------------------------------------------------------------- Definitions
@@ -93,14 +100,11 @@ Module Name:
 #define FAT_DIRECTORY_FLAG_POSITION_AT_END 0x00000002
 
 //
-// Define the number of seek table entries to keep across the entire
-// theoretical 4GB file.
+// Define FAT extent cache flags.
 //
 
-#define FAT_SEEK_TABLE_SHIFT 6
-#define FAT_SEEK_TABLE_SIZE (1UL << FAT_SEEK_TABLE_SHIFT)
-#define FAT_SEEK_OFFSET_SHIFT (32 - FAT_SEEK_TABLE_SHIFT)
-#define FAT_SEEK_OFFSET_MASK ((1UL << FAT_SEEK_OFFSET_SHIFT) - 1)
+#define FAT_EXTENT_CACHE_NON_PAGED 0x00000001
+#define FAT_EXTENT_CACHE_PINNED 0x00000002
 
 //
 // Define bits in the encoded non-standard permissions field.
@@ -265,6 +269,25 @@ Structure Description:
     FatCache - Stores the File Allocation Table cache. This is used for cluster
         allocation and next cluster lookup during seek, read, and write.
 
+    FreeClusterBitmap - Stores an optional pointer to a bitmap with one bit
+        per cluster, set if the cluster is free. It is built from the FAT the
+        first time a cluster is allocated, and is protected by the volume lock.
+
+    FreeClusterCount - Stores the number of set bits in the free cluster
+        bitmap.
+
+    ChainGeneration - Stores a counter that is incremented every time a
+        cluster chain is cut short. Cached file extents stamped with an older
+        value are discarded.
+
+    DirectoryIndexTree - Stores the tree of in-memory directory indexes,
+        keyed by directory cluster. It is protected by the volume lock.
+
+    DirectoryIndexList - Stores the list of directory indexes, most recently
+        used first.
+
+    DirectoryIndexCount - Stores the number of directory indexes.
+
 --*/
 
 typedef struct _FAT_VOLUME {
@@ -292,10 +315,73 @@ typedef struct _FAT_VOLUME {
     PVOID Lock;
     RED_BLACK_TREE FileMappingTree;
     FAT_CACHE FatCache;
+    PULONG FreeClusterBitmap;
+    ULONG FreeClusterCount;
+    ULONG ChainGeneration;
+    RED_BLACK_TREE DirectoryIndexTree;
+    LIST_ENTRY DirectoryIndexList;
+    ULONG DirectoryIndexCount;
 } FAT_VOLUME, *PFAT_VOLUME;
 
 /*++
 
+Structure Description:
+
+    This structure defines a run of contiguous clusters within a file.
+
+Members:
+
+    FileCluster - Stores the index of the run's first cluster within the file.
+
+    Cluster - Stores the volume cluster number of the run's first cluster.
+
+    Length - Stores the number of clusters in the run.
+
+--*/
+
+typedef struct _FAT_FILE_EXTENT {
+    ULONG FileCluster;
+    ULONG Cluster;
+    ULONG Length;
+} FAT_FILE_EXTENT, *PFAT_FILE_EXTENT;
+
+/*++
+
+Structure Description:
+
+    This structure defines the cache of a file's cluster chain, stored as an
+    array of extents sorted by file cluster. The cache always describes a
+    prefix of the chain, and is extended lazily as deeper clusters are
+    requested. Unless pinned, it is protected by the volume lock.
+
+Members:
+
+    Extents - Stores a pointer to the array of extents.
+
+    Count - Stores the number of valid extents in the array.
+
+    Capacity - Stores the number of extents the array can hold.
+
+    ClusterCount - Stores the number of file clusters described by the
+        extents.
+
+    Generation - Stores the volume chain generation the cache is valid for.
+
+    Flags - Stores a bitmask of flags. See FAT_EXTENT_CACHE_* definitions.
+
+--*/
+
+typedef struct _FAT_EXTENT_CACHE {
+    PFAT_FILE_EXTENT Extents;
+    ULONG Count;
+    ULONG Capacity;
+    ULONG ClusterCount;
+    ULONG Generation;
+    ULONG Flags;
+} FAT_EXTENT_CACHE, *PFAT_EXTENT_CACHE;
+
+/*++
+
 Structure Description:
 
     This structure defines file system state associated with an open file.
@@ -321,9 +407,10 @@ Structure Description:
         guaranteed to be at least 512 bytes large. This should only be used
         for page file operations.
 
-    SeekTable - Stores cluster numbers for file offsets spread evenly through
-        out the maximum theoretical file size of 4GB. The first value is file
-        offset 0, and is always filled in.
+    FirstCluster - Stores the first cluster of the file, which is also its
+        file ID.
+
+    ExtentCache - Stores the cache of the file's cluster chain.
 
 --*/
 
@@ -333,7 +420,8 @@ typedef struct _FAT_FILE {
     BOOL IsRootDirectory;
     PVOID ScratchIoBufferLock;
     PFAT_IO_BUFFER ScratchIoBuffer;
-    ULONG SeekTable[FAT_SEEK_TABLE_SIZE];
+    ULONG FirstCluster;
+    FAT_EXTENT_CACHE ExtentCache;
 } FAT_FILE, *PFAT_FILE;
 
 /*++
@@ -665,6 +753,60 @@ Return Value:
 
 --*/
 
+KSTATUS
+FatpAllocateClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG PreviousCluster,
+    ULONG ClusterCount,
+    PULONG NewCluster,
+    PULONG AllocatedCount,
+    BOOL Flush
+    );
+
+/*++
+
+Routine Description:
+
+    This routine allocates a run of contiguous free clusters, chains them
+    together, and chains the run so that the specified previous cluster points
+    to its first cluster. The run will be as close to the requested size as
+    the free space allows, but may be shorter.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    PreviousCluster - Supplies the cluster that should point to the newly
+        allocated run. Specify FAT32_CLUSTER_END if no previous cluster should
+        be updated. If this is a valid cluster, the run is placed directly
+        after it if possible.
+
+    ClusterCount - Supplies the desired number of clusters in the run.
+
+    NewCluster - Supplies a pointer that will receive the first cluster number
+        of the run.
+
+    AllocatedCount - Supplies an optional pointer that receives the number of
+        clusters actually allocated. This will be between one and the desired
+        count on success.
+
+    Flush - Supplies a boolean indicating if the FAT cache should be flushed.
+        Supply TRUE here unless more clusters are going to be allocated in
+        bulk, in which case the caller needs to explicitly flush the FAT
+        cache.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid cluster was supplied.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
 KSTATUS
 FatpFreeClusterChain (
     PFAT_VOLUME Volume,
@@ -693,6 +835,28 @@ Return Value:
 
 --*/
 
+VOID
+FatpDestroyFreeClusterBitmap (
+    PFAT_VOLUME Volume
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys the free cluster bitmap for the given volume, if one
+    was built.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
 KSTATUS
 FatpIsDirectoryEmpty (
     PFAT_VOLUME Volume,
@@ -843,7 +1007,8 @@ FatpPerformLongEntryMaintenance (
     PFAT_DIRECTORY_CONTEXT Directory,
     ULONGLONG EntryOffset,
     UCHAR Checksum,
-    ULONG NewChecksum
+    ULONG NewChecksum,
+    PULONGLONG FirstEntryOffset
     );
 
 /*++
@@ -867,6 +1032,10 @@ Routine Description:
     NewChecksum - Supplies the new checksum to set in the long entries. If this
         is -1, then the directory entries will be marked erased.
 
+    FirstEntryOffset - Supplies an optional pointer that receives the
+        directory offset of the first entry modified. This is the short entry
+        offset if no long entries were modified.
+
 Return Value:
 
     Status code.
@@ -1326,6 +1495,227 @@ Return Value:
 
 --*/
 
+//
+// Directory index support functions.
+//
+
+VOID
+FatpInitializeDirectoryIndexes (
+    PFAT_VOLUME Volume
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes the directory index tree for the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+FatpDestroyDirectoryIndexes (
+    PFAT_VOLUME Volume
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys all directory indexes on the given volume.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+KSTATUS
+FatpDirectoryIndexLookup (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    PCSTR Name,
+    ULONG NameLength,
+    PULONG EntryOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine looks up a name in the directory's index, building the index
+    from the directory contents if this is the first access.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. Its position is
+        changed if the index needs to be built.
+
+    Name - Supplies the name to look up, which may not be null terminated.
+
+    NameLength - Supplies the size of the name buffer in bytes, including the
+        null terminator.
+
+    EntryOffset - Supplies a pointer where the directory offset of the name's
+        short entry will be returned on success.
+
+Return Value:
+
+    STATUS_SUCCESS if the name was found.
+
+    STATUS_PATH_NOT_FOUND if the name is not in the directory.
+
+    Other error codes if the index could not be built.
+
+--*/
+
+KSTATUS
+FatpDirectoryIndexFindFreeEntries (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONG EntryCount,
+    PULONG EntryOffset,
+    PBOOL AtEnd
+    );
+
+/*++
+
+Routine Description:
+
+    This routine finds room for a set of consecutive entries in a directory.
+    The first run of erased entries large enough is used, otherwise the
+    entries go at the end of the directory.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. Its position is
+        changed if the index needs to be built.
+
+    EntryCount - Supplies the number of consecutive entries needed.
+
+    EntryOffset - Supplies a pointer where the directory offset of the first
+        free entry will be returned.
+
+    AtEnd - Supplies a pointer where a boolean will be returned indicating if
+        the entries go at the end of the directory, in which case a new end
+        marker needs to be written after them.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_VOLUME_FULL if the directory is full and cannot grow.
+
+    Other error codes if the index could not be built.
+
+--*/
+
+VOID
+FatpDirectoryIndexAddEntry (
+    PFAT_VOLUME Volume,
+    PFAT_DIRECTORY_CONTEXT Directory,
+    ULONG FirstOffset,
+    ULONG EntryCount
+    );
+
+/*++
+
+Routine Description:
+
+    This routine adds a newly written set of entries to the directory's index,
+    if the directory is indexed. The name is decoded back from the directory
+    so that the index holds exactly what a scan would find.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    Directory - Supplies a pointer to the directory context. It must not have
+        any unflushed writes. Its position is changed.
+
+    FirstOffset - Supplies the directory offset of the first entry written.
+
+    EntryCount - Supplies the number of entries written, including the short
+        entry at the end.
+
+Return Value:
+
+    None. If the index cannot be updated it is destroyed.
+
+--*/
+
+VOID
+FatpDirectoryIndexRemoveEntry (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster,
+    ULONG FirstOffset,
+    ULONG EntryOffset
+    );
+
+/*++
+
+Routine Description:
+
+    This routine removes an erased name from the directory's index, if the
+    directory is indexed, and records its entries as free.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+    FirstOffset - Supplies the directory offset of the first entry that was
+        erased.
+
+    EntryOffset - Supplies the directory offset of the erased short entry.
+
+Return Value:
+
+    None. If the index cannot be updated it is destroyed.
+
+--*/
+
+VOID
+FatpInvalidateDirectoryIndex (
+    PFAT_VOLUME Volume,
+    ULONG DirectoryCluster
+    );
+
+/*++
+
+Routine Description:
+
+    This routine destroys the index for the given directory, if there is one.
+    It will be rebuilt from the directory contents on next use.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    DirectoryCluster - Supplies the starting cluster of the directory.
+
+Return Value:
+
+    None.
+
+--*/
+
 //
 // File Allocation Table cache support functions.
 //
@@ -1525,3 +1915,237 @@ Return Value:
     Status code.
 
 --*/
+
+KSTATUS
+FatpFatCacheWriteClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG FirstCluster,
+    ULONG ClusterCount,
+    ULONG LastValue
+    );
+
+/*++
+
+Routine Description:
+
+    This routine writes the FAT cache to chain together a run of consecutive
+    clusters. Each cluster in the run is pointed at the one after it, and the
+    last cluster is set to the given value. Each window touched is marked
+    dirty once rather than once per cluster. This routine assumes that the
+    volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    FirstCluster - Supplies the first cluster of the run.
+
+    ClusterCount - Supplies the number of clusters in the run.
+
+    LastValue - Supplies the value to write into the FAT entry of the last
+        cluster in the run. This is usually the end of file marker.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+KSTATUS
+FatpFatCacheScanFreeClusters (
+    PFAT_VOLUME Volume,
+    PULONG Bitmap,
+    PULONG FreeCount
+    );
+
+/*++
+
+Routine Description:
+
+    This routine scans the entire File Allocation Table and sets a bit in the
+    given bitmap for every free cluster. Windows already in the cache are used
+    directly. Windows not in the cache are read into a transient buffer so
+    that a scan of a large FAT does not pin the whole table in memory. This
+    routine assumes that the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Bitmap - Supplies a pointer to a zeroed bitmap with at least one bit per
+        cluster in the volume.
+
+    FreeCount - Supplies a pointer where the number of free clusters found
+        will be returned.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+//
+// File extent cache support functions.
+//
+
+VOID
+FatpInitializeExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    BOOL NonPaged
+    );
+
+/*++
+
+Routine Description:
+
+    This routine initializes an empty cluster extent cache.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume the cache belongs to.
+
+    Cache - Supplies a pointer to the cache to initialize.
+
+    NonPaged - Supplies a boolean indicating whether the extents should be
+        allocated from non-paged memory.
+
+Return Value:
+
+    None.
+
+--*/
+
+VOID
+FatpDestroyExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache
+    );
+
+/*++
+
+Routine Description:
+
+    This routine frees the extents held by a cluster extent cache.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume the cache belongs to.
+
+    Cache - Supplies a pointer to the cache to destroy.
+
+Return Value:
+
+    None.
+
+--*/
+
+KSTATUS
+FatpBuildExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG FirstCluster,
+    BOOL Pin
+    );
+
+/*++
+
+Routine Description:
+
+    This routine fills a cluster extent cache with the entire cluster chain
+    of a file.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume.
+
+    Cache - Supplies a pointer to the cache to fill.
+
+    FirstCluster - Supplies the first cluster of the file.
+
+    Pin - Supplies a boolean indicating whether the cache should be pinned.
+        A pinned cache is never invalidated or extended, so it can be read
+        without holding the volume lock. This is only appropriate for files
+        whose cluster chain never changes while they are open, like the page
+        file.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+KSTATUS
+FatpGetFileCluster (
+    PFAT_FILE File,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength
+    );
+
+/*++
+
+Routine Description:
+
+    This routine translates a cluster index within a file into a cluster on
+    the volume, extending the file's extent cache if necessary.
+
+Arguments:
+
+    File - Supplies a pointer to the open file.
+
+    FileCluster - Supplies the zero-based index of the cluster within the
+        file.
+
+    Cluster - Supplies a pointer where the volume cluster is returned. If the
+        file ends before the requested cluster, this returns the file's last
+        cluster.
+
+    RunLength - Supplies a pointer where the number of contiguous clusters
+        starting at the returned cluster is returned. If the file ends before
+        the requested cluster, this returns the total number of clusters in
+        the file.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_END_OF_FILE if the file's cluster chain ends before the requested
+    cluster.
+
+    STATUS_FILE_CORRUPT if the cluster chain is broken.
+
+    Other error codes on device I/O or allocation failures.
+
+--*/
+
+VOID
+FatpTruncateExtentCache (
+    PFAT_VOLUME Volume,
+    PFAT_EXTENT_CACHE Cache,
+    ULONG ClusterCount
+    );
+
+/*++
+
+Routine Description:
+
+    This routine records that a cluster chain on the volume is being cut
+    short, which invalidates the extents cached by every open file. The given
+    cache, which belongs to the file being cut, is trimmed rather than
+    invalidated. This routine assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the volume.
+
+    Cache - Supplies an optional pointer to the extent cache of the file whose
+        chain is being cut.
+
+    ClusterCount - Supplies the number of clusters that remain in the chain.
+
+Return Value:
+
+    None.
+
+--*/
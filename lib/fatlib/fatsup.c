@@ -45,6 +45,13 @@ Module Name:
 #define RANDOM_MULTIPLIER 1103515245
 #define RANDOM_INCREMENT 12345
 
+//
+// Define the amount of space left after a file that is growing, so that it
+// can keep growing contiguously while other files are allocated elsewhere.
+//
+
+#define FAT_APPEND_PREALLOCATION_SIZE _128KB
+
 //
 // ---------------------------------------------------------------- Definitions
 //
@@ -74,6 +81,27 @@ FatpCreateDirectoryEntriesForFile (
     PULONG EntryCount
     );
 
+KSTATUS
+FatpCreateFreeClusterBitmap (
+    PFAT_VOLUME Volume
+    );
+
+ULONG
+FatpFindFreeClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG Hint,
+    ULONG ClusterCount,
+    PULONG RunStart
+    );
+
+VOID
+FatpMarkClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG FirstCluster,
+    ULONG ClusterCount,
+    BOOL Free
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -149,114 +177,79 @@ Return Value:
     ULONG Cluster;
     ULONG EntriesRead;
     BOOL IsDotEntry;
-    ULONGLONG Offset;
-    PSTR PotentialName;
-    ULONG PotentialNameBufferSize;
-    ULONG PotentialNameSize;
+    ULONG Offset;
     KSTATUS Status;
 
-    Offset = DIRECTORY_CONTENTS_OFFSET;
-    PotentialName = NULL;
+    Offset = 0;
     if (NameLength <= 1) {
         return STATUS_PATH_NOT_FOUND;
     }
 
     //
-    // Seek to the beginning of the directory.
+    // Find the entry in the directory's index, which builds the index if this
+    // is the first time through.
     //
 
-    Status = FatpDirectorySeek(Directory, Offset);
+    Status = FatpDirectoryIndexLookup(Volume,
+                                      Directory,
+                                      Name,
+                                      NameLength,
+                                      &Offset);
+
     if (!KSUCCESS(Status)) {
         goto LookupDirectoryEntryEnd;
     }
 
     //
-    // Allocate a buffer for the name.
+    // Read in the short entry.
     //
 
-    PotentialNameBufferSize = FAT_MAX_LONG_FILE_LENGTH + 1;
-    PotentialName = FatAllocatePagedMemory(Volume->Device.DeviceToken,
-                                           PotentialNameBufferSize);
+    Status = FatpDirectorySeek(Directory, Offset);
+    if (!KSUCCESS(Status)) {
+        goto LookupDirectoryEntryEnd;
+    }
 
-    if (PotentialName == NULL) {
-        Status = STATUS_INSUFFICIENT_RESOURCES;
+    Status = FatpReadDirectory(Directory, Entry, 1, &EntriesRead);
+    if (!KSUCCESS(Status)) {
+        goto LookupDirectoryEntryEnd;
+    }
+
+    if (EntriesRead != 1) {
+        Status = STATUS_FILE_CORRUPT;
         goto LookupDirectoryEntryEnd;
     }
 
     //
-    // Loop reading directory entries until a matching one is found or the end
-    // is reached.
+    // Set the mapping between the file and the directory, except for the . and
+    // .. entries. Also, empty files may have a cluster ID of 0, don't save
+    // those either.
     //
 
-    while (TRUE) {
-        PotentialNameSize = PotentialNameBufferSize;
-        Status = FatpReadNextDirectoryEntry(Directory,
-                                            NULL,
-                                            PotentialName,
-                                            &PotentialNameSize,
-                                            Entry,
-                                            &EntriesRead);
-
-        if (!KSUCCESS(Status)) {
-            if (Status == STATUS_END_OF_FILE) {
-                Status = STATUS_PATH_NOT_FOUND;
-            }
-
-            goto LookupDirectoryEntryEnd;
-        }
-
-        Offset += EntriesRead;
-        if (PotentialNameSize > NameLength) {
-            continue;
-        }
-
-        if (RtlAreStringsEqual(Name, PotentialName, NameLength - 1) != FALSE) {
+    IsDotEntry = FALSE;
+    if ((Name[0] == '.') &&
+        ((Name[1] == '\0') ||
+         ((Name[1] == '.') && (Name[2] == '\0')))) {
 
-            ASSERT(Offset != 0);
-
-            Offset -= 1;
-
-            //
-            // Set the mapping between the file and the directory, except for
-            // the . and .. entries. Also, empty files may have a cluster ID of
-            // 0, don't save those either.
-            //
-
-            IsDotEntry = FALSE;
-            if ((Name[0] == '.') &&
-                ((Name[1] == '\0') ||
-                 ((Name[1] == '.') && (Name[2] == '\0')))) {
-
-                IsDotEntry = TRUE;
-            }
-
-            if (IsDotEntry == FALSE) {
-                Cluster = (Entry->ClusterHigh << 16) | Entry->ClusterLow;
-                if ((Cluster >= FAT_CLUSTER_BEGIN) &&
-                    (Cluster < Volume->ClusterBad)) {
+        IsDotEntry = TRUE;
+    }
 
-                    Status = FatpSetFileMapping(Volume,
-                                                Cluster,
-                                                Directory->File->SeekTable[0],
-                                                Offset);
+    if (IsDotEntry == FALSE) {
+        Cluster = (Entry->ClusterHigh << 16) | Entry->ClusterLow;
+        if ((Cluster >= FAT_CLUSTER_BEGIN) && (Cluster < Volume->ClusterBad)) {
+            Status = FatpSetFileMapping(Volume,
+                                        Cluster,
+                                        Directory->File->FirstCluster,
+                                        Offset);
 
-                    if (!KSUCCESS(Status)) {
-                        goto LookupDirectoryEntryEnd;
-                    }
-                }
+            if (!KSUCCESS(Status)) {
+                goto LookupDirectoryEntryEnd;
             }
-
-            break;
         }
     }
 
     Status = STATUS_SUCCESS;
 
 LookupDirectoryEntryEnd:
-    if (PotentialName != NULL) {
-        FatFreePagedMemory(Volume->Device.DeviceToken, PotentialName);
-    }
-
     if (!KSUCCESS(Status)) {
         Offset = 0;
     }
@@ -531,17 +524,13 @@ Return Value:
     FAT_DIRECTORY_CONTEXT DirectoryContext;
     BOOL DirectoryContextInitialized;
     FAT_DIRECTORY_ENTRY DirectoryEntry;
-    ULONG EntriesRead;
     ULONG EntriesWritten;
     ULONG EntryCount;
-    ULONGLONG EntryOffset;
+    ULONG EntryOffset;
     FAT_DIRECTORY_ENTRY ExistingEntry;
     ULONG FirstCluster;
     PFAT_DIRECTORY_ENTRY NewEntries;
-    ULONGLONG Offset;
-    ULONGLONG PotentialOffset;
     BOOL SetMapping;
-    ULONG SpanCount;
     KSTATUS Status;
     BOOL WriteEndEntry;
 
@@ -612,113 +601,30 @@ Return Value:
     ASSERT(EntryCount != 0);
 
     //
-    // Reset to the beginning of the directory file.
+    // Find room for the new entries, either in a run of erased entries or at
+    // the end of the directory.
     //
 
-    Offset = DIRECTORY_CONTENTS_OFFSET;
-    Status = FatpDirectorySeek(&DirectoryContext, Offset);
+    Status = FatpDirectoryIndexFindFreeEntries(Volume,
+                                               &DirectoryContext,
+                                               EntryCount,
+                                               &EntryOffset,
+                                               &WriteEndEntry);
+
     if (!KSUCCESS(Status)) {
         goto CreateDirectoryEntryEnd;
     }
 
     //
-    // Look for either enough deleted entries or the ending entry.
-    //
-
-    EntryOffset = -1;
-    PotentialOffset = -1;
-    SpanCount = 0;
-    WriteEndEntry = FALSE;
-    while (TRUE) {
-        Status = FatpReadDirectory(&DirectoryContext,
-                                   &DirectoryEntry,
-                                   1,
-                                   &EntriesRead);
-
-        if (Status == STATUS_END_OF_FILE) {
-            WriteEndEntry = TRUE;
-            break;
-
-        } else if (!KSUCCESS(Status)) {
-            goto CreateDirectoryEntryEnd;
-        }
-
-        //
-        // If this is the root directory and the end of it was reached, there's
-        // no space in the root directory.
-        //
-
-        if (EntriesRead == 0) {
-            Status = STATUS_VOLUME_FULL;
-            goto CreateDirectoryEntryEnd;
-        }
-
-        ASSERT(EntriesRead == 1);
-
-        //
-        // If the end is found, use it.
-        //
-
-        if (DirectoryEntry.DosName[0] == FAT_DIRECTORY_ENTRY_END) {
-            EntryOffset = Offset;
-            WriteEndEntry = TRUE;
-            break;
-        }
-
-        //
-        // If an erased entry was found, that's also perfect.
-        //
-
-        if (DirectoryEntry.DosName[0] == FAT_DIRECTORY_ENTRY_ERASED) {
-            if (PotentialOffset == -1) {
-                PotentialOffset = Offset;
-                SpanCount = 1;
-
-            } else {
-                SpanCount += 1;
-            }
-
-            if (SpanCount >= EntryCount) {
-                EntryOffset = PotentialOffset;
-                break;
-            }
-
-        //
-        // This is a regular entry, so it breaks the span.
-        //
-
-        } else {
-            PotentialOffset = -1;
-            SpanCount = 0;
-        }
-
-        Offset += 1;
-    }
-
-    //
-    // Seek either to the desired entry or to the end. If no entry was found,
-    // the file pointer must already be at the end, so there's no need to seek.
+    // Seek to the chosen spot. Seeking to the end may hit the end of the file,
+    // in which case the writes extend the directory.
     //
 
-    if (EntryOffset != -1) {
-        Status = FatpDirectorySeek(&DirectoryContext, EntryOffset);
-        if (!KSUCCESS(Status)) {
-
-            ASSERT(Status != STATUS_END_OF_FILE);
-
+    Status = FatpDirectorySeek(&DirectoryContext, EntryOffset);
+    if (!KSUCCESS(Status)) {
+        if ((Status != STATUS_END_OF_FILE) || (WriteEndEntry == FALSE)) {
             goto CreateDirectoryEntryEnd;
         }
-
-    //
-    // If an entry offset is not set, then this better have reached the end of
-    // the file.
-    //
-
-    } else {
-
-        ASSERT(Status == STATUS_END_OF_FILE);
-
-        EntryOffset = Offset;
     }
 
     //
@@ -787,11 +693,23 @@ Return Value:
     }
 
     *DirectorySize = DirectoryContext.ClusterPosition.FileByteOffset;
+    FatpDirectoryIndexAddEntry(Volume,
+                               &DirectoryContext,
+                               EntryOffset,
+                               EntryCount);
+
     Status = STATUS_SUCCESS;
 
 CreateDirectoryEntryEnd:
+
+    //
+    // If the writes may have started, the directory index can no longer be
+    // trusted.
+    //
+
     if (!KSUCCESS(Status) && (SetMapping != FALSE)) {
         FatpUnsetFileMapping(Volume, FirstCluster);
+        FatpInvalidateDirectoryIndex(Volume, (ULONG)DirectoryFileId);
     }
 
     if (DirectoryContextInitialized != FALSE) {
@@ -1317,151 +1235,166 @@ Return Value:
 
 --*/
 
+{
+
+    return FatpAllocateClusterRun(Volume,
+                                  PreviousCluster,
+                                  1,
+                                  NewCluster,
+                                  NULL,
+                                  Flush);
+}
+
+KSTATUS
+FatpAllocateClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG PreviousCluster,
+    ULONG ClusterCount,
+    PULONG NewCluster,
+    PULONG AllocatedCount,
+    BOOL Flush
+    )
+
+/*++
+
+Routine Description:
+
+    This routine allocates a run of contiguous free clusters, chains them
+    together, and chains the run so that the specified previous cluster points
+    to its first cluster. The run will be as close to the requested size as
+    the free space allows, but may be shorter.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume.
+
+    PreviousCluster - Supplies the cluster that should point to the newly
+        allocated run. Specify FAT32_CLUSTER_END if no previous cluster should
+        be updated. If this is a valid cluster, the run is placed directly
+        after it if possible.
+
+    ClusterCount - Supplies the desired number of clusters in the run.
+
+    NewCluster - Supplies a pointer that will receive the first cluster number
+        of the run.
+
+    AllocatedCount - Supplies an optional pointer that receives the number of
+        clusters actually allocated. This will be between one and the desired
+        count on success.
+
+    Flush - Supplies a boolean indicating if the FAT cache should be flushed.
+        Supply TRUE here unless more clusters are going to be allocated in
+        bulk, in which case the caller needs to explicitly flush the FAT
+        cache.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_INVALID_PARAMETER if an invalid cluster was supplied.
+
+    STATUS_VOLUME_FULL if no free clusters exist.
+
+    Other error codes on device I/O errors.
+
+--*/
+
 {
 
     ULONG AllocatedCluster;
     ULONG BlockShift;
-    ULONG ClusterCount;
-    ULONG ClusterEnd;
-    ULONG CurrentCluster;
+    ULONG Hint;
     PFAT32_INFORMATION_SECTOR Information;
     ULONGLONG InformationBlock;
     PFAT_IO_BUFFER InformationIoBuffer;
     ULONG IoFlags;
+    ULONG LastCluster;
+    ULONG Preallocation;
+    ULONG RunSize;
     ULONG SearchStart;
     KSTATUS Status;
-    ULONG Value;
-    PVOID Window;
-    PUSHORT Window16;
-    PULONG Window32;
-    ULONG WindowOffset;
-    ULONG WindowSize;
+    ULONG TotalClusters;
 
     AllocatedCluster = FAT_CLUSTER_FREE;
     BlockShift = Volume->BlockShift;
-    ClusterCount = Volume->ClusterCount;
     InformationIoBuffer = NULL;
     IoFlags = IO_FLAG_FS_DATA | IO_FLAG_FS_METADATA;
+    RunSize = 0;
+    TotalClusters = Volume->ClusterCount;
 
+    ASSERT(ClusterCount != 0);
     ASSERT((PreviousCluster >= Volume->ClusterBad) ||
-           (PreviousCluster < ClusterCount));
+           (PreviousCluster < TotalClusters));
 
-    if ((PreviousCluster < Volume->ClusterBad) &&
-        (PreviousCluster >= ClusterCount)) {
+    if (((PreviousCluster < Volume->ClusterBad) &&
+         (PreviousCluster >= TotalClusters)) ||
+        (ClusterCount == 0)) {
 
+        *NewCluster = FAT_CLUSTER_FREE;
         return STATUS_INVALID_PARAMETER;
     }
 
     FatAcquireLock(Volume->Lock);
+    if (Volume->FreeClusterBitmap == NULL) {
+        Status = FatpCreateFreeClusterBitmap(Volume);
+        if (!KSUCCESS(Status)) {
+            goto AllocateClusterRunEnd;
+        }
+    }
+
     if ((Volume->ClusterSearchStart < FAT_CLUSTER_BEGIN) ||
-        (Volume->ClusterSearchStart >= ClusterCount)) {
+        (Volume->ClusterSearchStart >= TotalClusters)) {
 
         Volume->ClusterSearchStart = FAT_CLUSTER_BEGIN;
     }
 
     //
-    // Search for a free block. Start just after the last allocated cluster.
+    // Prefer growing a file in place, directly after its current last
+    // cluster.
     //
 
-    CurrentCluster = Volume->ClusterSearchStart;
-    ClusterEnd = ClusterCount;
-    SearchStart = CurrentCluster;
-    CurrentCluster += 1;
-    WindowSize = FAT_WINDOW_INDEX_TO_CLUSTER(Volume, 1);
-    WindowOffset = MAX_ULONG;
-    while (CurrentCluster != SearchStart) {
-
-        //
-        // If this is the end of the FAT, wrap around to the beginning.
-        //
-
-        if (CurrentCluster >= ClusterEnd) {
-            CurrentCluster = FAT_CLUSTER_BEGIN;
-            WindowOffset = MAX_ULONG;
-            ClusterEnd = SearchStart;
-        }
+    Hint = FAT_CLUSTER_FREE;
+    if ((PreviousCluster >= FAT_CLUSTER_BEGIN) &&
+        (PreviousCluster < TotalClusters)) {
 
-        //
-        // Read the next window if needed.
-        //
-
-        if (WindowOffset >= WindowSize) {
-            Status = FatpFatCacheGetFatWindow(Volume,
-                                              TRUE,
-                                              CurrentCluster,
-                                              &Window,
-                                              &WindowOffset);
-
-            if (!KSUCCESS(Status)) {
-                goto AllocateClusterEnd;
-            }
-        }
-
-        //
-        // Scan the whole window.
-        //
-
-        if (Volume->Format == Fat12Format) {
-            while (CurrentCluster < ClusterEnd) {
-                Value = FAT12_READ_CLUSTER(Window, CurrentCluster);
-                if (Value == FAT_CLUSTER_FREE) {
-                    break;
-                }
-
-                CurrentCluster += 1;
-            }
-
-        } else if (Volume->Format == Fat16Format) {
-            Window16 = Window;
-            while ((WindowOffset < WindowSize) &&
-                   (CurrentCluster < ClusterEnd) &&
-                   (Window16[WindowOffset] != FAT_CLUSTER_FREE)) {
-
-                WindowOffset += 1;
-                CurrentCluster += 1;
-            }
-
-        } else {
-            Window32 = Window;
-            while ((WindowOffset < WindowSize) &&
-                   (CurrentCluster < ClusterEnd) &&
-                   (Window32[WindowOffset] != FAT_CLUSTER_FREE)) {
-
-                WindowOffset += 1;
-                CurrentCluster += 1;
-            }
-        }
-
-        if ((WindowOffset >= WindowSize) || (CurrentCluster >= ClusterEnd)) {
-            continue;
-        }
-
-        Status = FatpFatCacheWriteClusterEntry(Volume,
-                                               CurrentCluster,
-                                               Volume->ClusterEnd,
-                                               NULL);
+        Hint = PreviousCluster + 1;
+    }
 
-        if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
-        }
+    RunSize = FatpFindFreeClusterRun(Volume,
+                                     Hint,
+                                     ClusterCount,
+                                     &AllocatedCluster);
 
-        //
-        // Mark a cluster as allocated now that it's been written in stone.
-        //
+    //
+    // If nothing was found, sadly return.
+    //
 
-        AllocatedCluster = CurrentCluster;
-        break;
+    if (RunSize == 0) {
+        AllocatedCluster = FAT_CLUSTER_FREE;
+        Status = STATUS_VOLUME_FULL;
+        goto AllocateClusterRunEnd;
     }
 
     //
-    // If nothing was found, sadly return.
+    // Take the run out of the bitmap before touching the FAT. If writing the
+    // chain fails, the clusters are leaked until the next mount rather than
+    // handed out twice.
     //
 
-    if (AllocatedCluster == FAT_CLUSTER_FREE) {
-        Status = STATUS_VOLUME_FULL;
-        goto AllocateClusterEnd;
+    FatpMarkClusterRun(Volume, AllocatedCluster, RunSize, FALSE);
+    Status = FatpFatCacheWriteClusterRun(Volume,
+                                         AllocatedCluster,
+                                         RunSize,
+                                         Volume->ClusterEnd);
+
+    if (!KSUCCESS(Status)) {
+        AllocatedCluster = FAT_CLUSTER_FREE;
+        RunSize = 0;
+        goto AllocateClusterRunEnd;
     }
 
+    LastCluster = AllocatedCluster + RunSize - 1;
+
     //
     // Update the FS information block saving the new free space and last block
     // allocated.
@@ -1475,7 +1408,7 @@ Return Value:
 
         if (InformationIoBuffer == NULL) {
             Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
 
         InformationBlock = Volume->InformationByteOffset >> BlockShift;
@@ -1487,21 +1420,24 @@ Return Value:
                                InformationIoBuffer);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
 
         Information = FatMapIoBuffer(InformationIoBuffer);
         if (Information == NULL) {
             Status = STATUS_INSUFFICIENT_RESOURCES;
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
 
-        Information->LastClusterAllocated = AllocatedCluster;
+        Information->LastClusterAllocated = LastCluster;
+
+        ASSERT(Information->FreeClusters >= RunSize);
 
-        ASSERT(Information->FreeClusters != 0);
+        if (Information->FreeClusters >= RunSize) {
+            Information->FreeClusters -= RunSize;
 
-        if (Information->FreeClusters != 0) {
-            Information->FreeClusters -= 1;
+        } else {
+            Information->FreeClusters = 0;
         }
 
         Status = FatWriteDevice(Volume->Device.DeviceToken,
@@ -1512,43 +1448,64 @@ Return Value:
                                 InformationIoBuffer);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
     }
 
-    Volume->ClusterSearchStart = AllocatedCluster;
+    //
+    // A file growing past its first cluster is likely being appended to.
+    // Leave a gap after it before the next search start so other new files
+    // land elsewhere, and this file can keep growing contiguously into the
+    // gap. The gap isn't reserved on disk; it's simply searched last.
+    //
+
+    SearchStart = LastCluster;
+    if (Hint != FAT_CLUSTER_FREE) {
+        Preallocation = FAT_APPEND_PREALLOCATION_SIZE >> Volume->ClusterShift;
+        if ((Preallocation < TotalClusters) &&
+            (SearchStart < TotalClusters - Preallocation)) {
+
+            SearchStart += Preallocation;
+        }
+    }
+
+    Volume->ClusterSearchStart = SearchStart;
 
     //
     // Lookup the previous block and update it.
     //
 
-    if ((PreviousCluster != 0) && (PreviousCluster < ClusterCount)) {
+    if ((PreviousCluster != 0) && (PreviousCluster < TotalClusters)) {
         Status = FatpFatCacheWriteClusterEntry(Volume,
                                                PreviousCluster,
                                                AllocatedCluster,
                                                NULL);
 
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
     }
 
     if (Flush != FALSE) {
         Status = FatpFatCacheFlush(Volume, 0);
         if (!KSUCCESS(Status)) {
-            goto AllocateClusterEnd;
+            goto AllocateClusterRunEnd;
         }
     }
 
     Status = STATUS_SUCCESS;
 
-AllocateClusterEnd:
+AllocateClusterRunEnd:
     FatReleaseLock(Volume->Lock);
     if (InformationIoBuffer != NULL) {
         FatFreeIoBuffer(InformationIoBuffer);
     }
 
     *NewCluster = AllocatedCluster;
+    if (AllocatedCount != NULL) {
+        *AllocatedCount = RunSize;
+    }
+
     return Status;
 }
 
@@ -1641,6 +1598,7 @@ Return Value:
             goto FreeClusterChainEnd;
         }
 
+        FatpMarkClusterRun(Volume, Cluster, 1, TRUE);
         ClusterCount += 1;
         if (NextCluster >= TotalClusters) {
             break;
@@ -1714,6 +1672,41 @@ Return Value:
     return Status;
 }
 
+VOID
+FatpDestroyFreeClusterBitmap (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine destroys the free cluster bitmap for the given volume, if one
+    was built.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    if (Volume->FreeClusterBitmap != NULL) {
+        FatFreeNonPagedMemory(Volume->Device.DeviceToken,
+                              Volume->FreeClusterBitmap);
+
+        Volume->FreeClusterBitmap = NULL;
+        Volume->FreeClusterCount = 0;
+    }
+
+    return;
+}
+
 KSTATUS
 FatpIsDirectoryEmpty (
     PFAT_VOLUME Volume,
@@ -1939,9 +1932,11 @@ Return Value:
     FAT_DIRECTORY_ENTRY DirectoryEntry;
     ULONG EntriesRead;
     ULONG EntriesWritten;
+    ULONGLONG FirstEntryOffset;
     BOOL LocalEntryErased;
     KSTATUS Status;
 
+    FirstEntryOffset = EntryOffset;
     LocalEntryErased = FALSE;
 
     //
@@ -2005,7 +2000,8 @@ Return Value:
     Status = FatpPerformLongEntryMaintenance(Directory,
                                              EntryOffset,
                                              Checksum,
-                                             (ULONG)-1);
+                                             (ULONG)-1,
+                                             &FirstEntryOffset);
 
     if ((Directory->FatFlags & FAT_DIRECTORY_FLAG_DIRTY) == 0) {
         LocalEntryErased = TRUE;
@@ -2029,11 +2025,23 @@ Return Value:
 EraseDirectoryEntryEnd:
 
     //
-    // Unset the mapping if the directory entry was erased.
+    // Unset the mapping if the directory entry was erased. Update the
+    // directory index with the freed entries, or throw it out if only some of
+    // them may have made it out.
     //
 
     if (LocalEntryErased != FALSE) {
         FatpUnsetFileMapping(Directory->File->Volume, Cluster);
+        if (KSUCCESS(Status)) {
+            FatpDirectoryIndexRemoveEntry(Directory->File->Volume,
+                                          Directory->File->FirstCluster,
+                                          (ULONG)FirstEntryOffset,
+                                          (ULONG)EntryOffset);
+
+        } else {
+            FatpInvalidateDirectoryIndex(Directory->File->Volume,
+                                         Directory->File->FirstCluster);
+        }
     }
 
     *EntryErased = LocalEntryErased;
@@ -2299,7 +2307,8 @@ Return Value:
     Status = FatpPerformLongEntryMaintenance(DirectoryContext,
                                              EntryOffset,
                                              OriginalChecksum,
-                                             NewChecksum);
+                                             NewChecksum,
+                                             NULL);
 
     if (!KSUCCESS(Status)) {
         goto AllocateClusterForEmptyFileEnd;
@@ -2340,7 +2349,8 @@ FatpPerformLongEntryMaintenance (
     PFAT_DIRECTORY_CONTEXT Directory,
     ULONGLONG EntryOffset,
     UCHAR Checksum,
-    ULONG NewChecksum
+    ULONG NewChecksum,
+    PULONGLONG FirstEntryOffset
     )
 
 /*++
@@ -2364,6 +2374,10 @@ Routine Description:
     NewChecksum - Supplies the new checksum to set in the long entries. If this
         is -1, then the directory entries will be marked erased.
 
+    FirstEntryOffset - Supplies an optional pointer that receives the
+        directory offset of the first entry modified. This is the short entry
+        offset if no long entries were modified.
+
 Return Value:
 
     Status code.
@@ -2375,6 +2389,7 @@ Return Value:
     FAT_DIRECTORY_ENTRY DirectoryEntry;
     ULONG EntriesRead;
     ULONG EntriesWritten;
+    ULONGLONG FirstModifiedOffset;
     PFAT_LONG_DIRECTORY_ENTRY LongEntry;
     UCHAR NextSequence;
     UCHAR Sequence;
@@ -2387,6 +2402,7 @@ Return Value:
     // first entry erased.
     //
 
+    FirstModifiedOffset = EntryOffset;
     NextSequence = 1;
     while (EntryOffset > DIRECTORY_CONTENTS_OFFSET) {
         EntryOffset -= 1;
@@ -2452,6 +2468,8 @@ Return Value:
 
             ASSERT(EntriesWritten == 1);
 
+            FirstModifiedOffset = EntryOffset;
+
             //
             // Stop if that was the last one.
             //
@@ -2470,6 +2488,10 @@ Return Value:
     Status = STATUS_SUCCESS;
 
 PerformLongEntryMaintenanceEnd:
+    if (FirstEntryOffset != NULL) {
+        *FirstEntryOffset = FirstModifiedOffset;
+    }
+
     return Status;
 }
 
@@ -3542,6 +3564,13 @@ Return Value:
     DirectoryContextInitialized = FALSE;
     FatVolume = Volume;
     Cluster = ((ULONG)(Entry->ClusterHigh) << 16) | Entry->ClusterLow;
+
+    //
+    // The cluster may have belonged to a directory that was deleted. Throw
+    // out any index left behind for it.
+    //
+
+    FatpInvalidateDirectoryIndex(FatVolume, Cluster);
     Status = FatOpenFileId(Volume,
                            Cluster,
                            IO_ACCESS_READ | IO_ACCESS_WRITE,
@@ -4059,3 +4088,259 @@ Return Value:
     return Status;
 }
 
+KSTATUS
+FatpCreateFreeClusterBitmap (
+    PFAT_VOLUME Volume
+    )
+
+/*++
+
+Routine Description:
+
+    This routine builds the bitmap of free clusters by scanning the FAT. This
+    routine assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+Return Value:
+
+    Status code.
+
+--*/
+
+{
+
+    PULONG Bitmap;
+    ULONG BitmapSize;
+    ULONG FreeCount;
+    KSTATUS Status;
+
+    ASSERT(Volume->FreeClusterBitmap == NULL);
+
+    BitmapSize = ALIGN_RANGE_UP(Volume->ClusterCount, FAT_FREE_BITMAP_BITS) /
+                 BITS_PER_BYTE;
+
+    Bitmap = FatAllocateNonPagedMemory(Volume->Device.DeviceToken, BitmapSize);
+    if (Bitmap == NULL) {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Bitmap, BitmapSize);
+    Status = FatpFatCacheScanFreeClusters(Volume, Bitmap, &FreeCount);
+    if (!KSUCCESS(Status)) {
+        FatFreeNonPagedMemory(Volume->Device.DeviceToken, Bitmap);
+        return Status;
+    }
+
+    Volume->FreeClusterBitmap = Bitmap;
+    Volume->FreeClusterCount = FreeCount;
+    return STATUS_SUCCESS;
+}
+
+ULONG
+FatpFindFreeClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG Hint,
+    ULONG ClusterCount,
+    PULONG RunStart
+    )
+
+/*++
+
+Routine Description:
+
+    This routine searches the free cluster bitmap for a run of free clusters.
+    If the hint cluster is free, the run starting there is returned.
+    Otherwise the first run of the desired size found after the search start
+    is returned, or the longest run if no run is big enough. This routine
+    assumes the volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    Hint - Supplies an optional cluster to try first. Supply FAT_CLUSTER_FREE
+        if there is no preference.
+
+    ClusterCount - Supplies the desired number of clusters.
+
+    RunStart - Supplies a pointer where the first cluster of the run will be
+        returned.
+
+Return Value:
+
+    Returns the number of clusters in the run found, which is no more than the
+    desired count. Returns 0 if there are no free clusters.
+
+--*/
+
+{
+
+    PULONG Bitmap;
+    ULONG BestLength;
+    ULONG BestStart;
+    ULONG Cluster;
+    ULONG End;
+    ULONG Length;
+    ULONG Pass;
+    ULONG RunEnd;
+    ULONG SearchStart;
+    ULONG TotalClusters;
+
+    Bitmap = Volume->FreeClusterBitmap;
+    TotalClusters = Volume->ClusterCount;
+    *RunStart = FAT_CLUSTER_FREE;
+    if (Volume->FreeClusterCount == 0) {
+        return 0;
+    }
+
+    if (ClusterCount > Volume->FreeClusterCount) {
+        ClusterCount = Volume->FreeClusterCount;
+    }
+
+    if ((Hint >= FAT_CLUSTER_BEGIN) &&
+        (Hint < TotalClusters) &&
+        (FAT_FREE_BITMAP_TEST(Bitmap, Hint) != FALSE)) {
+
+        RunEnd = Hint + 1;
+        while ((RunEnd < TotalClusters) &&
+               (RunEnd - Hint < ClusterCount) &&
+               (FAT_FREE_BITMAP_TEST(Bitmap, RunEnd) != FALSE)) {
+
+            RunEnd += 1;
+        }
+
+        *RunStart = Hint;
+        return RunEnd - Hint;
+    }
+
+    //
+    // Search from just after the search start to the end of the volume, then
+    // wrap around and search from the beginning up to the search start.
+    //
+
+    BestLength = 0;
+    BestStart = FAT_CLUSTER_FREE;
+    SearchStart = Volume->ClusterSearchStart + 1;
+    if (SearchStart >= TotalClusters) {
+        SearchStart = FAT_CLUSTER_BEGIN;
+    }
+
+    Cluster = SearchStart;
+    End = TotalClusters;
+    for (Pass = 0; Pass < 2; Pass += 1) {
+        while (Cluster < End) {
+
+            //
+            // Skip whole words of allocated clusters quickly.
+            //
+
+            if (((Cluster % FAT_FREE_BITMAP_BITS) == 0) &&
+                (Bitmap[Cluster / FAT_FREE_BITMAP_BITS] == 0)) {
+
+                Cluster += FAT_FREE_BITMAP_BITS;
+                continue;
+            }
+
+            if (FAT_FREE_BITMAP_TEST(Bitmap, Cluster) == FALSE) {
+                Cluster += 1;
+                continue;
+            }
+
+            RunEnd = Cluster + 1;
+            while ((RunEnd < End) &&
+                   (RunEnd - Cluster < ClusterCount) &&
+                   (FAT_FREE_BITMAP_TEST(Bitmap, RunEnd) != FALSE)) {
+
+                RunEnd += 1;
+            }
+
+            Length = RunEnd - Cluster;
+            if (Length >= ClusterCount) {
+                *RunStart = Cluster;
+                return Length;
+            }
+
+            if (Length > BestLength) {
+                BestLength = Length;
+                BestStart = Cluster;
+            }
+
+            Cluster = RunEnd;
+        }
+
+        Cluster = FAT_CLUSTER_BEGIN;
+        End = SearchStart;
+    }
+
+    *RunStart = BestStart;
+    return BestLength;
+}
+
+VOID
+FatpMarkClusterRun (
+    PFAT_VOLUME Volume,
+    ULONG FirstCluster,
+    ULONG ClusterCount,
+    BOOL Free
+    )
+
+/*++
+
+Routine Description:
+
+    This routine marks a run of clusters as free or allocated in the free
+    cluster bitmap, if the bitmap has been built. This routine assumes the
+    volume lock is held.
+
+Arguments:
+
+    Volume - Supplies a pointer to the FAT volume structure.
+
+    FirstCluster - Supplies the first cluster of the run.
+
+    ClusterCount - Supplies the number of clusters in the run.
+
+    Free - Supplies a boolean indicating whether to mark the clusters free
+        (TRUE) or allocated (FALSE).
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    PULONG Bitmap;
+    ULONG Cluster;
+    ULONG EndCluster;
+
+    Bitmap = Volume->FreeClusterBitmap;
+    if (Bitmap == NULL) {
+        return;
+    }
+
+    ASSERT(FirstCluster + ClusterCount <= Volume->ClusterCount);
+
+    EndCluster = FirstCluster + ClusterCount;
+    for (Cluster = FirstCluster; Cluster < EndCluster; Cluster += 1) {
+        if (Free != FALSE) {
+            if (FAT_FREE_BITMAP_TEST(Bitmap, Cluster) == FALSE) {
+                FAT_FREE_BITMAP_SET(Bitmap, Cluster);
+                Volume->FreeClusterCount += 1;
+            }
+
+        } else {
+            if (FAT_FREE_BITMAP_TEST(Bitmap, Cluster) != FALSE) {
+                FAT_FREE_BITMAP_CLEAR(Bitmap, Cluster);
+                Volume->FreeClusterCount -= 1;
+            }
+        }
+    }
+
+    return;
+}
+
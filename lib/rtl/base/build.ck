@@ -57,6 +57,7 @@ function build() {
         "crc32.c",
         "heap.c",
         "heapprof.c",
+        "lz.c",
         "math.c",
         "print.c",
         "rbtree.c",
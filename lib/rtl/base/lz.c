@@ -0,0 +1,564 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    lz.c
+
+Abstract:
+
+    This module implements a small LZ77-class compressor and decompressor.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Any
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#include "rtlp.h"
+
+//
+// --------------------------------------------------------------------- Macros
+//
+
+//
+// This macro reads a possibly unaligned little endian 32-bit value.
+//
+
+#define RTL_LZ_READ32(_Bytes)               \
+    ((ULONG)(_Bytes)[0] |                   \
+     ((ULONG)(_Bytes)[1] << 8) |            \
+     ((ULONG)(_Bytes)[2] << 16) |           \
+     ((ULONG)(_Bytes)[3] << 24))
+
+//
+// This macro hashes four bytes of input down to a hash table index.
+//
+
+#define RTL_LZ_HASH(_Value) \
+    (((_Value) * 2654435761U) >> (32 - RTL_LZ_HASH_SHIFT))
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+//
+// Define the log2 of the hash table size.
+//
+
+#define RTL_LZ_HASH_SHIFT 12
+
+//
+// Define the shortest match worth encoding.
+//
+
+#define RTL_LZ_MIN_MATCH 4
+
+//
+// Define the number of bytes at the end of the input that are always emitted
+// as literals. This keeps the match search from reading past the end.
+//
+
+#define RTL_LZ_LAST_LITERALS 5
+
+//
+// Define the largest distance back a match can reach.
+//
+
+#define RTL_LZ_MAX_OFFSET 0xFFFF
+
+//
+// Define the token layout. The high nibble holds the literal length and the
+// low nibble the match length beyond the minimum. A nibble of all ones means
+// more length bytes follow, each added in until one is less than 255.
+//
+
+#define RTL_LZ_TOKEN_LITERAL_SHIFT 4
+#define RTL_LZ_TOKEN_MASK 0x0F
+#define RTL_LZ_LENGTH_CONTINUE 0xFF
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+BOOL
+RtlpLzWriteLength (
+    PUCHAR *Output,
+    PUCHAR OutputEnd,
+    ULONG Length
+    );
+
+BOOL
+RtlpLzReadLength (
+    PCUCHAR *Input,
+    PCUCHAR InputEnd,
+    PULONG Length
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+RTL_API
+ULONG
+RtlLzCompress (
+    PCVOID Source,
+    ULONG SourceSize,
+    PVOID Destination,
+    ULONG DestinationSize,
+    PULONG HashTable
+    )
+
+/*++
+
+Routine Description:
+
+    This routine compresses a buffer with a small, fast LZ77-class compressor.
+    The output is a series of sequences, each a token byte holding a literal
+    length and a match length, the literal bytes, and a two byte match offset.
+    It favors speed over ratio, and suits data like memory pages that must be
+    compressed quickly in constrained environments.
+
+Arguments:
+
+    Source - Supplies a pointer to the data to compress.
+
+    SourceSize - Supplies the size of the data to compress, in bytes.
+
+    Destination - Supplies a pointer where the compressed data will be
+        written.
+
+    DestinationSize - Supplies the size of the destination buffer, in bytes.
+
+    HashTable - Supplies a pointer to scratch space for the compressor, which
+        must hold RTL_LZ_HASH_TABLE_SIZE entries.
+
+Return Value:
+
+    Returns the size of the compressed data, in bytes.
+
+    0 if the compressed data does not fit in the destination buffer.
+
+--*/
+
+{
+
+    ULONG Anchor;
+    ULONG Candidate;
+    ULONG Hash;
+    PCUCHAR Input;
+    ULONG LiteralLength;
+    ULONG MatchLength;
+    ULONG MatchLimit;
+    ULONG Offset;
+    PUCHAR Output;
+    PUCHAR OutputEnd;
+    ULONG Position;
+    ULONG SearchLimit;
+    PUCHAR Token;
+    ULONG Value;
+
+    ASSERT((1 << RTL_LZ_HASH_SHIFT) == RTL_LZ_HASH_TABLE_SIZE);
+
+    Input = Source;
+    Output = Destination;
+    OutputEnd = Output + DestinationSize;
+    Anchor = 0;
+    Position = 0;
+
+    //
+    // Offsets in the table are stored plus one so that a zeroed table reads
+    // as empty.
+    //
+
+    RtlZeroMemory(HashTable, RTL_LZ_HASH_TABLE_SIZE * sizeof(ULONG));
+    if (SourceSize > RTL_LZ_LAST_LITERALS + RTL_LZ_MIN_MATCH) {
+        MatchLimit = SourceSize - RTL_LZ_LAST_LITERALS;
+        SearchLimit = MatchLimit - RTL_LZ_MIN_MATCH;
+        while (Position <= SearchLimit) {
+            Value = RTL_LZ_READ32(Input + Position);
+            Hash = RTL_LZ_HASH(Value);
+            Candidate = HashTable[Hash];
+            HashTable[Hash] = Position + 1;
+            if ((Candidate == 0) ||
+                (Position - (Candidate - 1) > RTL_LZ_MAX_OFFSET) ||
+                (RTL_LZ_READ32(Input + Candidate - 1) != Value)) {
+
+                Position += 1;
+                continue;
+            }
+
+            Candidate -= 1;
+
+            //
+            // Grow the match backwards into any pending literals, then
+            // forwards as far as it goes.
+            //
+
+            while ((Position > Anchor) && (Candidate > 0) &&
+                   (Input[Position - 1] == Input[Candidate - 1])) {
+
+                Position -= 1;
+                Candidate -= 1;
+            }
+
+            MatchLength = RTL_LZ_MIN_MATCH;
+            while ((Position + MatchLength < MatchLimit) &&
+                   (Input[Position + MatchLength] ==
+                    Input[Candidate + MatchLength])) {
+
+                MatchLength += 1;
+            }
+
+            //
+            // Emit the token, the literals leading up to the match, and the
+            // match itself.
+            //
+
+            LiteralLength = Position - Anchor;
+            if (Output >= OutputEnd) {
+                return 0;
+            }
+
+            Token = Output;
+            Output += 1;
+            *Token = 0;
+            if (LiteralLength >= RTL_LZ_TOKEN_MASK) {
+                *Token = RTL_LZ_TOKEN_MASK << RTL_LZ_TOKEN_LITERAL_SHIFT;
+                if (RtlpLzWriteLength(&Output,
+                                      OutputEnd,
+                                      LiteralLength - RTL_LZ_TOKEN_MASK) ==
+                    FALSE) {
+
+                    return 0;
+                }
+
+            } else {
+                *Token = LiteralLength << RTL_LZ_TOKEN_LITERAL_SHIFT;
+            }
+
+            if ((UINTN)(OutputEnd - Output) < LiteralLength + sizeof(USHORT)) {
+                return 0;
+            }
+
+            RtlCopyMemory(Output, Input + Anchor, LiteralLength);
+            Output += LiteralLength;
+            Offset = Position - Candidate;
+            Output[0] = (UCHAR)Offset;
+            Output[1] = (UCHAR)(Offset >> 8);
+            Output += sizeof(USHORT);
+            MatchLength -= RTL_LZ_MIN_MATCH;
+            if (MatchLength >= RTL_LZ_TOKEN_MASK) {
+                *Token |= RTL_LZ_TOKEN_MASK;
+                if (RtlpLzWriteLength(&Output,
+                                      OutputEnd,
+                                      MatchLength - RTL_LZ_TOKEN_MASK) ==
+                    FALSE) {
+
+                    return 0;
+                }
+
+            } else {
+                *Token |= MatchLength;
+            }
+
+            Position += MatchLength + RTL_LZ_MIN_MATCH;
+            Anchor = Position;
+        }
+    }
+
+    //
+    // Finish with a sequence of only the remaining literals.
+    //
+
+    LiteralLength = SourceSize - Anchor;
+    if (Output >= OutputEnd) {
+        return 0;
+    }
+
+    Token = Output;
+    Output += 1;
+    if (LiteralLength >= RTL_LZ_TOKEN_MASK) {
+        *Token = RTL_LZ_TOKEN_MASK << RTL_LZ_TOKEN_LITERAL_SHIFT;
+        if (RtlpLzWriteLength(&Output,
+                              OutputEnd,
+                              LiteralLength - RTL_LZ_TOKEN_MASK) == FALSE) {
+
+            return 0;
+        }
+
+    } else {
+        *Token = LiteralLength << RTL_LZ_TOKEN_LITERAL_SHIFT;
+    }
+
+    if ((UINTN)(OutputEnd - Output) < LiteralLength) {
+        return 0;
+    }
+
+    RtlCopyMemory(Output, Input + Anchor, LiteralLength);
+    Output += LiteralLength;
+    return Output - (PUCHAR)Destination;
+}
+
+RTL_API
+BOOL
+RtlLzDecompress (
+    PCVOID Source,
+    ULONG SourceSize,
+    PVOID Destination,
+    ULONG DestinationSize,
+    PULONG DecompressedSize
+    )
+
+/*++
+
+Routine Description:
+
+    This routine decompresses data produced by the LZ compressor.
+
+Arguments:
+
+    Source - Supplies a pointer to the compressed data.
+
+    SourceSize - Supplies the size of the compressed data, in bytes.
+
+    Destination - Supplies a pointer where the decompressed data will be
+        written.
+
+    DestinationSize - Supplies the size of the destination buffer, in bytes.
+
+    DecompressedSize - Supplies a pointer where the number of decompressed
+        bytes will be returned.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the compressed data is corrupt or does not fit in the
+    destination buffer.
+
+--*/
+
+{
+
+    PCUCHAR Input;
+    PCUCHAR InputEnd;
+    ULONG Length;
+    PUCHAR Match;
+    ULONG Offset;
+    PUCHAR Output;
+    PUCHAR OutputEnd;
+    UCHAR Token;
+
+    Input = Source;
+    InputEnd = Input + SourceSize;
+    Output = Destination;
+    OutputEnd = Output + DestinationSize;
+    *DecompressedSize = 0;
+    while (Input < InputEnd) {
+        Token = *Input;
+        Input += 1;
+        Length = Token >> RTL_LZ_TOKEN_LITERAL_SHIFT;
+        if (Length == RTL_LZ_TOKEN_MASK) {
+            if (RtlpLzReadLength(&Input, InputEnd, &Length) == FALSE) {
+                return FALSE;
+            }
+
+            Length += RTL_LZ_TOKEN_MASK;
+        }
+
+        if (((UINTN)(InputEnd - Input) < Length) ||
+            ((UINTN)(OutputEnd - Output) < Length)) {
+
+            return FALSE;
+        }
+
+        RtlCopyMemory(Output, Input, Length);
+        Input += Length;
+        Output += Length;
+
+        //
+        // The final sequence has only literals.
+        //
+
+        if (Input == InputEnd) {
+            break;
+        }
+
+        if ((UINTN)(InputEnd - Input) < sizeof(USHORT)) {
+            return FALSE;
+        }
+
+        Offset = Input[0] | ((ULONG)Input[1] << 8);
+        Input += sizeof(USHORT);
+        if ((Offset == 0) || (Offset > (UINTN)(Output - (PUCHAR)Destination))) {
+            return FALSE;
+        }
+
+        Length = Token & RTL_LZ_TOKEN_MASK;
+        if (Length == RTL_LZ_TOKEN_MASK) {
+            if (RtlpLzReadLength(&Input, InputEnd, &Length) == FALSE) {
+                return FALSE;
+            }
+
+            Length += RTL_LZ_TOKEN_MASK;
+        }
+
+        Length += RTL_LZ_MIN_MATCH;
+        if ((UINTN)(OutputEnd - Output) < Length) {
+            return FALSE;
+        }
+
+        //
+        // Copy a byte at a time, since the match may overlap the output it is
+        // producing.
+        //
+
+        Match = Output - Offset;
+        while (Length != 0) {
+            *Output = *Match;
+            Output += 1;
+            Match += 1;
+            Length -= 1;
+        }
+    }
+
+    *DecompressedSize = Output - (PUCHAR)Destination;
+    return TRUE;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+BOOL
+RtlpLzWriteLength (
+    PUCHAR *Output,
+    PUCHAR OutputEnd,
+    ULONG Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the extra bytes of a length that overflowed its token
+    nibble.
+
+Arguments:
+
+    Output - Supplies a pointer to the output pointer, which is advanced.
+
+    OutputEnd - Supplies the end of the output buffer.
+
+    Length - Supplies the length remaining beyond the nibble.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the output buffer is too small.
+
+--*/
+
+{
+
+    PUCHAR Current;
+
+    Current = *Output;
+    while (Length >= RTL_LZ_LENGTH_CONTINUE) {
+        if (Current >= OutputEnd) {
+            return FALSE;
+        }
+
+        *Current = RTL_LZ_LENGTH_CONTINUE;
+        Current += 1;
+        Length -= RTL_LZ_LENGTH_CONTINUE;
+    }
+
+    if (Current >= OutputEnd) {
+        return FALSE;
+    }
+
+    *Current = (UCHAR)Length;
+    *Output = Current + 1;
+    return TRUE;
+}
+
+BOOL
+RtlpLzReadLength (
+    PCUCHAR *Input,
+    PCUCHAR InputEnd,
+    PULONG Length
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads the extra bytes of a length that overflowed its token
+    nibble.
+
+Arguments:
+
+    Input - Supplies a pointer to the input pointer, which is advanced.
+
+    InputEnd - Supplies the end of the input buffer.
+
+    Length - Supplies a pointer where the length beyond the nibble is
+        returned.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE if the input ends in the middle of the length.
+
+--*/
+
+{
+
+    UCHAR Byte;
+    PCUCHAR Current;
+    ULONG Total;
+
+    Current = *Input;
+    Total = 0;
+    do {
+        if (Current >= InputEnd) {
+            return FALSE;
+        }
+
+        Byte = *Current;
+        Current += 1;
+        Total += Byte;
+
+    } while (Byte == RTL_LZ_LENGTH_CONTINUE);
+
+    *Input = Current;
+    *Length = Total;
+    return TRUE;
+}
+
@@ -75,6 +75,12 @@ Module Name:
 #define FORMAT_HEX_CAPITAL 'X'
 #define FORMAT_LONGLONG_START 'I'
 
+//
+// Define the number of padding characters written out in a single run.
+//
+
+#define PRINT_FORMAT_PADDING_CHUNK 32
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
@@ -120,6 +126,13 @@ RtlpStringFormatWriteCharacter (
     PPRINT_FORMAT_CONTEXT Context
     );
 
+BOOL
+RtlpStringFormatWriteString (
+    PCSTR String,
+    ULONG Size,
+    PPRINT_FORMAT_CONTEXT Context
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -233,6 +246,7 @@ Return Value:
 
     RtlZeroMemory(&Context, sizeof(PRINT_FORMAT_CONTEXT));
     Context.WriteCharacter = RtlpStringFormatWriteCharacter;
+    Context.WriteString = RtlpStringFormatWriteString;
     Context.Context = Destination;
     if (DestinationSize != 0) {
         Context.Limit = DestinationSize - 1;
@@ -289,6 +303,7 @@ Return Value:
     va_list ArgumentListCopy;
     ULONG Index;
     BOOL Result;
+    ULONG Span;
 
     ASSERT((Context != NULL) && (Context->WriteCharacter != NULL) &&
            (Context->CharactersWritten == 0) &&
@@ -299,7 +314,8 @@ Return Value:
     }
 
     //
-    // Copy each character to the destination, handling formats along the way.
+    // Copy each run of literal characters to the destination, handling formats
+    // along the way.
     //
 
     Result = TRUE;
@@ -317,12 +333,19 @@ Return Value:
             }
 
         } else {
-            Result = RtlpFormatWriteCharacter(Context, Format[Index]);
+            Span = 1;
+            while ((Format[Index + Span] != STRING_TERMINATOR) &&
+                   (Format[Index + Span] != CONVERSION_CHARACTER)) {
+
+                Span += 1;
+            }
+
+            Result = RtlpFormatWriteString(Context, Format + Index, Span);
             if (Result == FALSE) {
                 goto FormatEnd;
             }
 
-            Index += 1;
+            Index += Span;
         }
     }
 
@@ -375,7 +398,6 @@ Return Value:
 
 {
 
-    ULONG PaddingIndex;
     ULONG PaddingLength;
     BOOL Result;
     ULONG StringLength;
@@ -404,51 +426,33 @@ Return Value:
         PaddingLength = FieldWidth - StringLength;
     }
 
-    PaddingIndex = PaddingLength;
-
     //
     // Pad left, if required.
     //
 
     if (LeftJustified == FALSE) {
-        while (PaddingIndex > 0) {
-            Result = RtlpFormatWriteCharacter(Context, ' ');
-            if (Result == FALSE) {
-                return FALSE;
-            }
-
-            PaddingIndex -= 1;
+        Result = RtlpFormatWritePadding(Context, ' ', PaddingLength);
+        if (Result == FALSE) {
+            return FALSE;
         }
+
+        PaddingLength = 0;
     }
 
     //
     // Copy the string.
     //
 
-    while (StringLength != 0) {
-        Result = RtlpFormatWriteCharacter(Context, *String);
-        if (Result == FALSE) {
-            return FALSE;
-        }
-
-        String += 1;
-        StringLength -= 1;
+    Result = RtlpFormatWriteString(Context, String, StringLength);
+    if (Result == FALSE) {
+        return FALSE;
     }
 
     //
     // Pad right, if required.
     //
 
-    while (PaddingIndex > 0) {
-        Result = RtlpFormatWriteCharacter(Context, ' ');
-        if (Result == FALSE) {
-            return FALSE;
-        }
-
-        PaddingIndex -= 1;
-    }
-
-    return TRUE;
+    return RtlpFormatWritePadding(Context, ' ', PaddingLength);
 }
 
 ULONG
@@ -489,17 +493,13 @@ Return Value:
 
     UCHAR Character;
     ULONG FieldCount;
-    ULONG FieldIndex;
     ULONG IntegerLength;
     CHAR LocalBuffer[MAX_INTEGER_STRING_SIZE];
-    ULONG LocalIndex;
     BOOL Negative;
     ULONGLONG NextInteger;
     LONG Precision;
     ULONG PrecisionCount;
-    ULONG PrecisionIndex;
-    UCHAR Prefix[4];
-    ULONG PrefixIndex;
+    CHAR Prefix[4];
     ULONG PrefixSize;
     ULONGLONG Remainder;
     BOOL Result;
@@ -679,11 +679,9 @@ Return Value:
         Character = ' ';
         if (Properties->PrintLeadingZeroes != FALSE) {
             Character = '0';
-            for (PrefixIndex = 0; PrefixIndex < PrefixSize; PrefixIndex += 1) {
-                Result = RtlpFormatWriteCharacter(Context, Prefix[PrefixIndex]);
-                if (Result == FALSE) {
-                    return FALSE;
-                }
+            Result = RtlpFormatWriteString(Context, Prefix, PrefixSize);
+            if (Result == FALSE) {
+                return FALSE;
             }
 
             //
@@ -693,11 +691,9 @@ Return Value:
             PrefixSize = 0;
         }
 
-        for (FieldIndex = 0; FieldIndex < FieldCount; FieldIndex += 1) {
-            Result = RtlpFormatWriteCharacter(Context, Character);
-            if (Result == FALSE) {
-                return FALSE;
-            }
+        Result = RtlpFormatWritePadding(Context, Character, FieldCount);
+        if (Result == FALSE) {
+            return FALSE;
         }
 
         FieldCount = 0;
@@ -708,28 +704,19 @@ Return Value:
     // followed by the integer itself.
     //
 
-    for (PrefixIndex = 0; PrefixIndex < PrefixSize; PrefixIndex += 1) {
-        Result = RtlpFormatWriteCharacter(Context, Prefix[PrefixIndex]);
-        if (Result == FALSE) {
-            return FALSE;
-        }
+    Result = RtlpFormatWriteString(Context, Prefix, PrefixSize);
+    if (Result == FALSE) {
+        return FALSE;
     }
 
-    for (PrecisionIndex = 0;
-         PrecisionIndex < PrecisionCount;
-         PrecisionIndex += 1) {
-
-        Result = RtlpFormatWriteCharacter(Context, '0');
-        if (Result == FALSE) {
-            return FALSE;
-        }
+    Result = RtlpFormatWritePadding(Context, '0', PrecisionCount);
+    if (Result == FALSE) {
+        return FALSE;
     }
 
-    for (LocalIndex = 0; LocalIndex < IntegerLength; LocalIndex += 1) {
-        Result = RtlpFormatWriteCharacter(Context, LocalBuffer[LocalIndex]);
-        if (Result == FALSE) {
-            return FALSE;
-        }
+    Result = RtlpFormatWriteString(Context, LocalBuffer, IntegerLength);
+    if (Result == FALSE) {
+        return FALSE;
     }
 
     //
@@ -737,14 +724,7 @@ Return Value:
     // They must be spaces, as there can't be leading zeroes on the end.
     //
 
-    for (FieldIndex = 0; FieldIndex < FieldCount; FieldIndex += 1) {
-        Result = RtlpFormatWriteCharacter(Context, ' ');
-        if (Result == FALSE) {
-            return FALSE;
-        }
-    }
-
-    return TRUE;
+    return RtlpFormatWritePadding(Context, ' ', FieldCount);
 }
 
 BOOL
@@ -786,6 +766,130 @@ Return Value:
     return TRUE;
 }
 
+BOOL
+RtlpFormatWriteString (
+    PPRINT_FORMAT_CONTEXT Context,
+    PCSTR String,
+    ULONG Size
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes a run of characters to the print format destination.
+    If the destination supports it, the run is handed over in a single call.
+
+Arguments:
+
+    Context - Supplies a pointer to the print format context.
+
+    String - Supplies a pointer to the characters to write. This does not
+        need to be null terminated.
+
+    Size - Supplies the number of characters to write.
+
+Return Value:
+
+    TRUE if the characters were written.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    BOOL Result;
+
+    if (Size == 0) {
+        return TRUE;
+    }
+
+    if (Context->WriteString != NULL) {
+        Result = Context->WriteString(String, Size, Context);
+        if (Result == FALSE) {
+            return FALSE;
+        }
+
+        Context->CharactersWritten += Size;
+        return TRUE;
+    }
+
+    while (Size != 0) {
+        Result = RtlpFormatWriteCharacter(Context, *String);
+        if (Result == FALSE) {
+            return FALSE;
+        }
+
+        String += 1;
+        Size -= 1;
+    }
+
+    return TRUE;
+}
+
+BOOL
+RtlpFormatWritePadding (
+    PPRINT_FORMAT_CONTEXT Context,
+    CHAR Character,
+    ULONG Count
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the same character to the print format destination
+    several times over.
+
+Arguments:
+
+    Context - Supplies a pointer to the print format context.
+
+    Character - Supplies the character to repeat.
+
+    Count - Supplies the number of times to write the character.
+
+Return Value:
+
+    TRUE if the characters were written.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    CHAR Padding[PRINT_FORMAT_PADDING_CHUNK];
+    BOOL Result;
+    ULONG Size;
+
+    if (Count == 0) {
+        return TRUE;
+    }
+
+    Size = Count;
+    if (Size > PRINT_FORMAT_PADDING_CHUNK) {
+        Size = PRINT_FORMAT_PADDING_CHUNK;
+    }
+
+    RtlSetMemory(Padding, Character, Size);
+    while (Count != 0) {
+        if (Size > Count) {
+            Size = Count;
+        }
+
+        Result = RtlpFormatWriteString(Context, Padding, Size);
+        if (Result == FALSE) {
+            return FALSE;
+        }
+
+        Count -= Size;
+    }
+
+    return TRUE;
+}
+
 //
 // --------------------------------------------------------- Internal Functions
 //
@@ -2019,3 +2123,50 @@ Return Value:
     return TRUE;
 }
 
+BOOL
+RtlpStringFormatWriteString (
+    PCSTR String,
+    ULONG Size,
+    PPRINT_FORMAT_CONTEXT Context
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes a run of characters to the string during a
+    printf-style formatting operation.
+
+Arguments:
+
+    String - Supplies a pointer to the characters to be written.
+
+    Size - Supplies the number of characters to write.
+
+    Context - Supplies a pointer to the printf-context.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on failure.
+
+--*/
+
+{
+
+    PSTR Destination;
+    ULONG Written;
+
+    Destination = Context->Context;
+    Written = Context->CharactersWritten;
+    if ((Destination != NULL) && (Written < Context->Limit)) {
+        if (Size > Context->Limit - Written) {
+            Size = Context->Limit - Written;
+        }
+
+        RtlCopyMemory(Destination + Written, String, Size);
+    }
+
+    return TRUE;
+}
@@ -45,10 +45,130 @@ Module Name:
 
 #define LOCAL_TIME_TO_SYSTEM_TIME_RETRY_MAX 4
 
+//
+// Define the window of years around the current conversion that gets
+// expanded into the transition table, and the interval at which that window
+// is scanned for changes. The interval must be short enough not to step over
+// any period the rules evaluate to, which can be as short as an hour.
+//
+
+#define TIME_ZONE_TRANSITION_PAST_YEARS 1
+#define TIME_ZONE_TRANSITION_FUTURE_YEARS 4
+#define TIME_ZONE_TRANSITION_SCAN_INTERVAL SECONDS_PER_HOUR
+
+//
+// Define the number of conversions that evaluate the rules before the
+// transition table is built. Building the table costs about as much as tens
+// of thousands of rule evaluations, so processes that only convert a handful
+// of times never pay for it.
+//
+
+#define TIME_ZONE_TRANSITION_BUILD_THRESHOLD 1024
+
+//
+// Define how much of the window is scanned between drops of the time zone
+// lock while the table is being built, so that other conversions are never
+// held up for more than a small slice of the build.
+//
+
+#define TIME_ZONE_TRANSITION_BUILD_SLICE SECONDS_PER_DAY
+
+#define TIME_ZONE_TRANSITION_INITIAL_CAPACITY 64
+
+//
+// Define the number of slots a transition table can be published in. Readers
+// count themselves against a slot rather than against the table, since slots
+// are never freed. A table that has been unpublished stays in its slot until
+// the slot's readers drain.
+//
+
+#define TIME_ZONE_TRANSITION_SLOT_COUNT 4
+#define TIME_ZONE_TRANSITION_NO_SLOT ((ULONG)-1)
+
 //
 // ------------------------------------------------------ Data Type Definitions
 //
 
+/*++
+
+Structure Description:
+
+    This structure describes a single instant at which the local time rules
+    in effect change.
+
+Members:
+
+    Time - Stores the system time, in seconds, at which this transition takes
+        effect.
+
+    GmtOffset - Stores the total offset from GMT in seconds, including any
+        daylight saving, in effect from this transition onward.
+
+    IsDaylightSaving - Stores a boolean indicating whether daylight saving is
+        in effect from this transition onward.
+
+    TimeZone - Stores a pointer to the cached name of the time zone in effect
+        from this transition onward.
+
+--*/
+
+typedef struct _TIME_ZONE_TRANSITION {
+    LONGLONG Time;
+    LONG GmtOffset;
+    LONG IsDaylightSaving;
+    PCSTR TimeZone;
+} TIME_ZONE_TRANSITION, *PTIME_ZONE_TRANSITION;
+
+/*++
+
+Structure Description:
+
+    This structure describes the table of transitions for the current time
+    zone over a window of years. Once published, a table is never modified,
+    so it can be read without holding the time zone lock.
+
+Members:
+
+    End - Stores the system time, in seconds, where the window ends. The
+        window begins at the time of the first transition.
+
+    Count - Stores the number of valid transitions in the array.
+
+    Capacity - Stores the number of elements allocated for the array.
+
+    Transitions - Stores the array of transitions, sorted by time.
+
+--*/
+
+typedef struct _TIME_ZONE_TRANSITION_TABLE {
+    LONGLONG End;
+    ULONG Count;
+    ULONG Capacity;
+    TIME_ZONE_TRANSITION Transitions[ANYSIZE_ARRAY];
+} TIME_ZONE_TRANSITION_TABLE, *PTIME_ZONE_TRANSITION_TABLE;
+
+/*++
+
+Structure Description:
+
+    This structure describes a slot that a transition table is published in.
+
+Members:
+
+    Table - Stores a pointer to the table held in this slot, or NULL if the
+        slot is free. This is only changed with the time zone lock held.
+
+    ReferenceCount - Stores the number of lock-free readers counted against
+        this slot. The table in a slot that is not current is only freed
+        when this count is zero.
+
+--*/
+
+typedef struct _TIME_ZONE_TRANSITION_SLOT {
+    PTIME_ZONE_TRANSITION_TABLE Table;
+    volatile ULONG ReferenceCount;
+} TIME_ZONE_TRANSITION_SLOT, *PTIME_ZONE_TRANSITION_SLOT;
+
 //
 // ----------------------------------------------- Internal Function Prototypes
 //
@@ -148,6 +268,51 @@ RtlpTimeZoneCacheString (
     PCSTR String
     );
 
+KSTATUS
+RtlpSystemTimeToLocalCalendarTime (
+    PSYSTEM_TIME SystemTime,
+    PCALENDAR_TIME CalendarTime
+    );
+
+BOOL
+RtlpLookupTimeZoneTransition (
+    PSYSTEM_TIME SystemTime,
+    PCALENDAR_TIME CalendarTime
+    );
+
+VOID
+RtlpBuildTimeZoneTransitions (
+    LONGLONG Seconds,
+    ULONG Generation
+    );
+
+KSTATUS
+RtlpEvaluateTimeZoneTransition (
+    LONGLONG Seconds,
+    PTIME_ZONE_TRANSITION Transition
+    );
+
+BOOL
+RtlpAddTimeZoneTransition (
+    PTIME_ZONE_TRANSITION_TABLE *Table,
+    PTIME_ZONE_TRANSITION Transition
+    );
+
+BOOL
+RtlpPublishTimeZoneTransitions (
+    PTIME_ZONE_TRANSITION_TABLE Table
+    );
+
+VOID
+RtlpResetTimeZoneTransitions (
+    VOID
+    );
+
+VOID
+RtlpFreeUnusedTimeZoneTransitions (
+    VOID
+    );
+
 //
 // -------------------------------------------------------------------- Globals
 //
@@ -248,6 +413,23 @@ LONG RtlDaylightTimeZoneOffset;
 PSTR *RtlTimeZoneNameCache;
 ULONG RtlTimeZoneNameCacheSize;
 
+//
+// Store the slots transition tables are published in, and the index of the
+// slot holding the table for the current time zone, which conversions
+// consult without the lock. The generation changes whenever the time zone or
+// its data does, so a build that drops the lock partway through can tell when
+// its table has gone stale. The remaining variables are protected by the time
+// zone lock.
+//
+
+TIME_ZONE_TRANSITION_SLOT
+    RtlTimeZoneTransitionSlots[TIME_ZONE_TRANSITION_SLOT_COUNT];
+
+volatile ULONG RtlTimeZoneTransitionSlot = TIME_ZONE_TRANSITION_NO_SLOT;
+ULONG RtlTimeZoneGeneration;
+BOOL RtlTimeZoneTransitionsAttempted;
+ULONG RtlTimeZoneSlowConversions;
+
 //
 // ------------------------------------------------------------------ Functions
 //
@@ -805,6 +987,10 @@ Return Value:
         RtlpSetTimeZoneNames();
     }
 
+    if (KSUCCESS(Status)) {
+        RtlpResetTimeZoneTransitions();
+    }
+
 SetTimeZoneDataEnd:
     RtlReleaseTimeZoneLock();
     return Status;
@@ -1072,6 +1258,8 @@ Return Value:
         if (!KSUCCESS(Status)) {
             goto SelectTimeZoneEnd;
         }
+
+        RtlpResetTimeZoneTransitions();
     }
 
     Status = STATUS_SUCCESS;
@@ -1112,585 +1300,306 @@ Return Value:
 
 {
 
-    PTIME_ZONE_RULE CurrentRules[2];
-    LONG DaysInMonth;
-    PTIME_ZONE_RULE EffectiveRule;
-    ULONG EntryIndex;
-    PCSTR Format;
-    CALENDAR_TIME GmtTime;
-    PTIME_ZONE_HEADER Header;
-    LONG Leap;
-    LONG LocalStandardTime;
-    PTIME_ZONE_OCCASION Occasion;
-    BOOL RuleApplies;
-    LONG RuleMonthDay;
+    BOOL Build;
+    ULONG Generation;
     KSTATUS Status;
-    LONG Time;
-    LONG Weekday;
-    PTIME_ZONE Zone;
-    PTIME_ZONE_ENTRY ZoneEntries;
-    CHAR ZoneNameBuffer[TIME_ZONE_NAME_MAX];
 
-    EffectiveRule = NULL;
-    Format = NULL;
-    Status = RtlSystemTimeToGmtCalendarTime(SystemTime, CalendarTime);
-    if (!KSUCCESS(Status)) {
-        return Status;
+    //
+    // Most conversions land inside the precomputed window of transitions,
+    // which can be searched without the lock.
+    //
+
+    if (RtlpLookupTimeZoneTransition(SystemTime, CalendarTime) != FALSE) {
+        return STATUS_SUCCESS;
     }
 
-    RtlCopyMemory(&GmtTime, CalendarTime, sizeof(CALENDAR_TIME));
+    Build = FALSE;
+    Generation = 0;
     RtlAcquireTimeZoneLock();
-    Header = RtlTimeZoneData;
-    if (Header == NULL) {
-        goto SystemTimeToLocalCalendarTimeEnd;
-    }
+    if ((RtlTimeZoneTransitionSlot == TIME_ZONE_TRANSITION_NO_SLOT) &&
+        (RtlTimeZoneTransitionsAttempted == FALSE) &&
+        (RtlTimeZoneData != NULL)) {
 
-    //
-    // Get a pointer to the current time zone and the beginning of its zone
-    // entries.
-    //
+        RtlTimeZoneSlowConversions += 1;
+        if (RtlTimeZoneSlowConversions >=
+            TIME_ZONE_TRANSITION_BUILD_THRESHOLD) {
 
-    Zone = (PVOID)Header + Header->ZoneOffset;
-    Zone += RtlTimeZoneIndex;
-    ZoneEntries = (PVOID)Header + Header->ZoneEntryOffset;
-    ZoneEntries += Zone->EntryIndex;
+            RtlTimeZoneTransitionsAttempted = TRUE;
+            Generation = RtlTimeZoneGeneration;
+            Build = TRUE;
+        }
+    }
+
+    Status = RtlpSystemTimeToLocalCalendarTime(SystemTime, CalendarTime);
+    RtlReleaseTimeZoneLock();
 
     //
-    // Find the current zone entry.
+    // Build the table after dropping the lock. The build only holds the lock
+    // for a slice of the scan at a time, so other conversions are not stuck
+    // behind it.
     //
 
-    for (EntryIndex = 0; EntryIndex < Zone->EntryCount; EntryIndex += 1) {
-        if (ZoneEntries[EntryIndex].Until > SystemTime->Seconds) {
-            break;
-        }
+    if (Build != FALSE) {
+        RtlpBuildTimeZoneTransitions(SystemTime->Seconds, Generation);
     }
 
-    if (EntryIndex == Zone->EntryCount) {
-        if (Zone->EntryCount == 0) {
-            Status = STATUS_FILE_CORRUPT;
-            goto SystemTimeToLocalCalendarTimeEnd;
-        }
+    return Status;
+}
 
-        EntryIndex = Zone->EntryCount - 1;
-    }
+RTL_API
+KSTATUS
+RtlLocalCalendarTimeToSystemTime (
+    PCALENDAR_TIME CalendarTime,
+    PSYSTEM_TIME SystemTime
+    )
 
-    Format = RtlpTimeZoneGetString(Header, ZoneEntries[EntryIndex].Format);
+/*++
 
-    //
-    // Compute the local time with the GMT offset for the current zone entry.
-    //
+Routine Description:
 
-    CalendarTime->GmtOffset = ZoneEntries[EntryIndex].GmtOffset +
-                              ZoneEntries[EntryIndex].Save;
+    This routine converts the given calendar time, assumed to be a local date
+    and time, into its corresponding system time. On success, this routine will
+    update the supplied calendar time to fill out all fields. The GMT offset
+    of the supplied calendar time will be ignored in favor or the local time
+    zone's GMT offset.
 
-    CalendarTime->Second += CalendarTime->GmtOffset;
-    RtlpNormalizeCalendarTime(CalendarTime);
-    CalendarTime->IsDaylightSaving = FALSE;
-    if (ZoneEntries[EntryIndex].Save != 0) {
-        CalendarTime->IsDaylightSaving = TRUE;
-    }
+Arguments:
 
-    //
-    // If this timezone has no daylight saving rules, there's no need to go
-    // digging through rules.
-    //
+    CalendarTime - Supplies a pointer to the local calendar time to convert.
 
-    if (ZoneEntries[EntryIndex].Rules == -1) {
-        RtlpTimeZonePerformSubstitution(ZoneNameBuffer,
-                                        sizeof(ZoneNameBuffer),
-                                        Format,
-                                        NULL);
+    SystemTime - Supplies a pointer where the system time will be returned.
 
-        CalendarTime->TimeZone = RtlpTimeZoneCacheString(ZoneNameBuffer);
-        Status = STATUS_SUCCESS;
-        goto SystemTimeToLocalCalendarTimeEnd;
-    }
+Return Value:
 
-    //
-    // Figure out the two rules (or at least one) that apply here.
-    //
+    STATUS_SUCCESS on success.
 
-    RtlpFindTimeZoneRules(Header,
-                          ZoneEntries,
-                          EntryIndex,
-                          CalendarTime->Year,
-                          CalendarTime->Month,
-                          CurrentRules);
+    STATUS_OUT_OF_BOUNDS if the given local calendar time is too funky.
 
-    LocalStandardTime = (CalendarTime->Hour * SECONDS_PER_HOUR) +
-                        (CalendarTime->Minute * SECONDS_PER_MINUTE) +
-                        CalendarTime->Second;
+--*/
+
+{
+
+    PTIME_ZONE_RULE CurrentRules[2];
+    LONG Delta;
+    LONG EntryIndex;
+    PCALENDAR_TIME FirstLocalTime;
+    CALENDAR_TIME GmtCalendarTime;
+    PTIME_ZONE_HEADER Header;
+    CALENDAR_TIME LocalTimeBuffer[2];
+    BOOL LockHeld;
+    ULONG RetryCount;
+    LONG Save;
+    PCALENDAR_TIME SecondLocalTime;
+    KSTATUS Status;
+    PCALENDAR_TIME TemporaryLocalTime;
+    PTIME_ZONE Zone;
+    PTIME_ZONE_ENTRY ZoneEntries;
+
+    LockHeld = FALSE;
 
     //
-    // Apply the previous rule if there is one.
+    // Standardize the given calendar time's daylight saving value by setting
+    // all postive values to TRUE.
     //
 
-    if (CurrentRules[1] != NULL) {
-        EffectiveRule = CurrentRules[1];
-        if (CurrentRules[1]->Save != 0) {
-            CalendarTime->Second += CurrentRules[1]->Save;
-            RtlpNormalizeCalendarTime(CalendarTime);
-        }
+    if (CalendarTime->IsDaylightSaving > 0) {
+        CalendarTime->IsDaylightSaving = TRUE;
     }
 
     //
-    // If there is no first rule to test, this is done.
+    // First make a copy of the calendar time, treat the copy as GMT time and
+    // convert it to a GMT system time.
     //
 
-    if (CurrentRules[0] == NULL) {
+    RtlCopyMemory(&GmtCalendarTime, CalendarTime, sizeof(CALENDAR_TIME));
+    Status = RtlGmtCalendarTimeToSystemTime(&GmtCalendarTime, SystemTime);
+    if (!KSUCCESS(Status)) {
+        goto LocalCalendarTimeToSystemTimeEnd;
+    }
 
-        ASSERT(CurrentRules[1] == NULL);
+    //
+    // Now convert the UTC system time into a local time. This will get a local
+    // GMT offset for the UTC month, date, and time.
+    //
 
-        Status = STATUS_SUCCESS;
-        goto SystemTimeToLocalCalendarTimeEnd;
+    FirstLocalTime = &(LocalTimeBuffer[0]);
+    Status = RtlSystemTimeToLocalCalendarTime(SystemTime, FirstLocalTime);
+    if (!KSUCCESS(Status)) {
+        goto LocalCalendarTimeToSystemTimeEnd;
     }
 
+    ASSERT(FirstLocalTime->IsDaylightSaving >= 0);
+
     //
-    // Figure out if the first rule applies, and apply it if so.
+    // Get the system time back into the correct time zone by subtracting the
+    // GMT offset.
     //
 
-    RuleApplies = FALSE;
-    RuleMonthDay = 31;
-    Occasion = &(CurrentRules[0]->On);
-
-    //
-    // If the current rule is not this month, the rule definitely applies,
-    // either as a previous month of this year, or a month in last year.
-    //
-
-    if (CurrentRules[0]->Month != CalendarTime->Month) {
-        RuleApplies = TRUE;
-
-    //
-    // Calculating the day of the month this rule applies on is easy if it's
-    // spelled out.
-    //
-
-    } else if (Occasion->Type == TimeZoneOccasionMonthDate) {
-        RuleMonthDay = CurrentRules[0]->On.MonthDay;
+    SystemTime->Seconds -= FirstLocalTime->GmtOffset;
 
     //
-    // The day of the month this rule applies on depends on the day of the
-    // week. Start by calculating the day of the week for the first of the
-    // month.
+    // Loop attempting to land in the correct time zone.
     //
 
-    } else {
-        Status = RtlpCalculateWeekdayForMonth(CalendarTime->Year,
-                                              CalendarTime->Month,
-                                              &Weekday);
-
+    SecondLocalTime = &(LocalTimeBuffer[1]);
+    RetryCount = 0;
+    while (RetryCount < LOCAL_TIME_TO_SYSTEM_TIME_RETRY_MAX) {
+        Status = RtlSystemTimeToLocalCalendarTime(SystemTime, SecondLocalTime);
         if (!KSUCCESS(Status)) {
-            goto SystemTimeToLocalCalendarTimeEnd;
-        }
-
-        Leap = 0;
-        if (IS_LEAP_YEAR(CalendarTime->Year)) {
-            Leap = 1;
+            goto LocalCalendarTimeToSystemTimeEnd;
         }
 
-        DaysInMonth = RtlDaysPerMonth[Leap][CalendarTime->Month];
-        RuleMonthDay = 1;
+        ASSERT(SecondLocalTime->IsDaylightSaving >= 0);
 
         //
-        // Make the day of the month line up with the first instance of the
-        // weekday in the rule.
+        // Look to see if the GMT offsets are different. A difference indicates
+        // that a time zone change is being straddled.
         //
 
-        if (Occasion->Weekday >= Weekday) {
-            RuleMonthDay += Occasion->Weekday - Weekday;
+        if (FirstLocalTime->GmtOffset != SecondLocalTime->GmtOffset) {
 
-        } else {
-            RuleMonthDay += DAYS_PER_WEEK - (Weekday - Occasion->Weekday);
-        }
+            //
+            // If the given calendar time differs in savings from the second
+            // local time, then either the calendar time didn't apply the
+            // savings and the GMT offset jump just did or the calendar time
+            // had applied the savings and the GMT offset jump just corretly
+            // reversed that. Use the UTC system time that has been calculated.
+            //
 
-        switch (Occasion->Type) {
+            if ((CalendarTime->IsDaylightSaving >= 0) &&
+                (CalendarTime->IsDaylightSaving !=
+                 SecondLocalTime->IsDaylightSaving)) {
 
-        //
-        // Add a week as many times as possible.
-        //
+                Status = STATUS_SUCCESS;
+                goto LocalCalendarTimeToSystemTimeEnd;
 
-        case TimeZoneOccasionLastWeekday:
-            while (RuleMonthDay + DAYS_PER_WEEK <= DaysInMonth) {
-                RuleMonthDay += DAYS_PER_WEEK;
-            }
+            //
+            // If the given calendar time's savings is specified and matches
+            // with the second local time, then adjust the time by the
+            // difference in GMT offsets. The assumption is that the caller
+            // already handled the savings and this needs to correct back in
+            // order to honor that. Do the same thing is the savings was
+            // unknown. The caller wasn't sure and nothing can be certain yet.
+            //
 
-            break;
+            } else {
+                Delta = FirstLocalTime->GmtOffset - SecondLocalTime->GmtOffset;
+                SystemTime->Seconds += Delta;
+            }
 
         //
-        // Add a week as long as it's less than the required minimum month day.
-        // If that pushes it over the month, then the occasion doesn't exist.
+        // If the GMT offsets are equal there is some good news and some bad
+        // news. Handle it below.
         //
 
-        case TimeZoneOccasionGreaterOrEqualWeekday:
-            while (RuleMonthDay < Occasion->MonthDay) {
-                RuleMonthDay += DAYS_PER_WEEK;
-            }
+        } else {
 
-            if (RuleMonthDay > DaysInMonth) {
-                RuleMonthDay = 31;
-            }
+            ASSERT(FirstLocalTime->IsDaylightSaving ==
+                   SecondLocalTime->IsDaylightSaving);
 
-            break;
+            //
+            // Good news. If the supplied time has an unknown daylight savings
+            // or it agrees with the daylight savings of the two times, then
+            // everything is all set.
+            //
 
-        //
-        // If the first instance of that weekday is already too far, then the
-        // occasion doesn't exist. Otherwise, keep adding weeks as long as it's
-        // still under the limit.
-        //
+            if ((CalendarTime->IsDaylightSaving < 0) ||
+                (CalendarTime->IsDaylightSaving ==
+                 SecondLocalTime->IsDaylightSaving)) {
 
-        case TimeZoneOccasionLessOrEqualWeekday:
-            if (RuleMonthDay > Occasion->MonthDay) {
-                RuleMonthDay = 31;
+                Status = STATUS_SUCCESS;
+                goto LocalCalendarTimeToSystemTimeEnd;
 
-            } else {
-                while (RuleMonthDay + DAYS_PER_WEEK <
-                       Occasion->MonthDay) {
+            //
+            // The bad news is that the user applied savings, one way or
+            // another, and the time needs to be adjusted. It gets worse. There
+            // is no way to figure out how much the savings should be for the
+            // given calendar without parsing the rules. Break out and do that.
+            //
 
-                    RuleMonthDay += DAYS_PER_WEEK;
-                }
+            } else {
+                break;
             }
+        }
 
-            break;
-
-        default:
-
-            ASSERT(FALSE);
+        //
+        // Swap the local time buffers and retry.
+        //
 
-            Status = STATUS_FILE_CORRUPT;
-            goto SystemTimeToLocalCalendarTimeEnd;
-        }
+        TemporaryLocalTime = FirstLocalTime;
+        FirstLocalTime = SecondLocalTime;
+        SecondLocalTime = TemporaryLocalTime;
+        RetryCount += 1;
     }
 
     //
-    // If the day of the month is after the rule occasion, the rule definitely
-    // applies. If the day of the month is equal to the day the rule applies,
-    // check the time of day.
+    // If the maximum retries have occurred, then bail out now. The system time
+    // is as accurate as it's going to get.
     //
 
-    if (RuleApplies == FALSE) {
-        if (CalendarTime->Day > RuleMonthDay) {
-            RuleApplies = TRUE;
-
-        } else if (CalendarTime->Day == RuleMonthDay) {
-            switch (CurrentRules[0]->AtLens) {
-            case TimeZoneLensLocalTime:
-                Time = (CalendarTime->Hour * SECONDS_PER_HOUR) +
-                       (CalendarTime->Minute * SECONDS_PER_MINUTE) +
-                       CalendarTime->Second;
+    if (RetryCount == LOCAL_TIME_TO_SYSTEM_TIME_RETRY_MAX) {
+        Status = STATUS_SUCCESS;
+        goto LocalCalendarTimeToSystemTimeEnd;
+    }
 
-                break;
+    //
+    // Now it's time to do it the hard way. The caller supplied a date that has
+    // no time savings, but a time that already incorporated savings for the
+    // year (or vice versa). As such, the current UTC system time is wrong! The
+    // savings rule for the year either needs to be added or subtracted
+    // depending on the disagreement. Go hunting for the rules that apply to
+    // the date and figure out how to modify the system time. If no rules
+    // apply, then consider savings and non-savings to be the same.
+    //
 
-            case TimeZoneLensLocalStandardTime:
-                Time = LocalStandardTime;
-                break;
+    RtlAcquireTimeZoneLock();
+    LockHeld = TRUE;
 
-            case TimeZoneLensUtc:
-                Time = (GmtTime.Hour * SECONDS_PER_HOUR) +
-                       (GmtTime.Minute * SECONDS_PER_MINUTE) +
-                       GmtTime.Second;
+    //
+    // If there is no time zone data, then everything must be in GMT. The
+    // system time is currently correct for that.
+    //
 
-                break;
+    Header = RtlTimeZoneData;
+    if (Header == NULL) {
+        Status = STATUS_SUCCESS;
+        goto LocalCalendarTimeToSystemTimeEnd;
+    }
 
-            default:
-                Time = SECONDS_PER_DAY;
-                break;
-            }
+    //
+    // Get a pointer to the current time zone and the beginning of its zone
+    // entries.
+    //
 
-            if (Time >= CurrentRules[0]->At) {
-                RuleApplies = TRUE;
-            }
-        }
-    }
+    Zone = (PVOID)Header + Header->ZoneOffset;
+    Zone += RtlTimeZoneIndex;
+    ZoneEntries = (PVOID)Header + Header->ZoneEntryOffset;
+    ZoneEntries += Zone->EntryIndex;
 
     //
-    // If after all that this rule applies, apply it and unapply the previous
-    // rule.
+    // Find the current zone entry.
     //
 
-    if (RuleApplies != FALSE) {
-        EffectiveRule = CurrentRules[0];
-        CalendarTime->Second += CurrentRules[0]->Save;
-        if (CurrentRules[1] != NULL) {
-            CalendarTime->Second -= CurrentRules[1]->Save;
+    for (EntryIndex = 0; EntryIndex < Zone->EntryCount; EntryIndex += 1) {
+        if (ZoneEntries[EntryIndex].Until > SystemTime->Seconds) {
+            break;
         }
-
-        RtlpNormalizeCalendarTime(CalendarTime);
     }
 
-SystemTimeToLocalCalendarTimeEnd:
-    if (EffectiveRule != NULL) {
-        if (EffectiveRule->Save != 0) {
-            CalendarTime->IsDaylightSaving = TRUE;
+    if (EntryIndex == Zone->EntryCount) {
+        if (Zone->EntryCount == 0) {
+            Status = STATUS_FILE_CORRUPT;
+            goto LocalCalendarTimeToSystemTimeEnd;
         }
 
-        CalendarTime->GmtOffset += EffectiveRule->Save;
-        RtlpTimeZonePerformSubstitution(ZoneNameBuffer,
-                                        sizeof(ZoneNameBuffer),
-                                        Format,
-                                        EffectiveRule);
-
-        CalendarTime->TimeZone = RtlpTimeZoneCacheString(ZoneNameBuffer);
+        EntryIndex = Zone->EntryCount - 1;
     }
 
-    RtlReleaseTimeZoneLock();
-    return Status;
-}
-
-RTL_API
-KSTATUS
-RtlLocalCalendarTimeToSystemTime (
-    PCALENDAR_TIME CalendarTime,
-    PSYSTEM_TIME SystemTime
-    )
-
-/*++
-
-Routine Description:
-
-    This routine converts the given calendar time, assumed to be a local date
-    and time, into its corresponding system time. On success, this routine will
-    update the supplied calendar time to fill out all fields. The GMT offset
-    of the supplied calendar time will be ignored in favor or the local time
-    zone's GMT offset.
-
-Arguments:
-
-    CalendarTime - Supplies a pointer to the local calendar time to convert.
-
-    SystemTime - Supplies a pointer where the system time will be returned.
-
-Return Value:
-
-    STATUS_SUCCESS on success.
-
-    STATUS_OUT_OF_BOUNDS if the given local calendar time is too funky.
-
---*/
-
-{
-
-    PTIME_ZONE_RULE CurrentRules[2];
-    LONG Delta;
-    LONG EntryIndex;
-    PCALENDAR_TIME FirstLocalTime;
-    CALENDAR_TIME GmtCalendarTime;
-    PTIME_ZONE_HEADER Header;
-    CALENDAR_TIME LocalTimeBuffer[2];
-    BOOL LockHeld;
-    ULONG RetryCount;
-    LONG Save;
-    PCALENDAR_TIME SecondLocalTime;
-    KSTATUS Status;
-    PCALENDAR_TIME TemporaryLocalTime;
-    PTIME_ZONE Zone;
-    PTIME_ZONE_ENTRY ZoneEntries;
-
-    LockHeld = FALSE;
-
-    //
-    // Standardize the given calendar time's daylight saving value by setting
-    // all postive values to TRUE.
-    //
-
-    if (CalendarTime->IsDaylightSaving > 0) {
-        CalendarTime->IsDaylightSaving = TRUE;
-    }
-
-    //
-    // First make a copy of the calendar time, treat the copy as GMT time and
-    // convert it to a GMT system time.
-    //
-
-    RtlCopyMemory(&GmtCalendarTime, CalendarTime, sizeof(CALENDAR_TIME));
-    Status = RtlGmtCalendarTimeToSystemTime(&GmtCalendarTime, SystemTime);
-    if (!KSUCCESS(Status)) {
-        goto LocalCalendarTimeToSystemTimeEnd;
-    }
-
-    //
-    // Now convert the UTC system time into a local time. This will get a local
-    // GMT offset for the UTC month, date, and time.
-    //
-
-    FirstLocalTime = &(LocalTimeBuffer[0]);
-    Status = RtlSystemTimeToLocalCalendarTime(SystemTime, FirstLocalTime);
-    if (!KSUCCESS(Status)) {
-        goto LocalCalendarTimeToSystemTimeEnd;
-    }
-
-    ASSERT(FirstLocalTime->IsDaylightSaving >= 0);
-
-    //
-    // Get the system time back into the correct time zone by subtracting the
-    // GMT offset.
-    //
-
-    SystemTime->Seconds -= FirstLocalTime->GmtOffset;
-
-    //
-    // Loop attempting to land in the correct time zone.
-    //
-
-    SecondLocalTime = &(LocalTimeBuffer[1]);
-    RetryCount = 0;
-    while (RetryCount < LOCAL_TIME_TO_SYSTEM_TIME_RETRY_MAX) {
-        Status = RtlSystemTimeToLocalCalendarTime(SystemTime, SecondLocalTime);
-        if (!KSUCCESS(Status)) {
-            goto LocalCalendarTimeToSystemTimeEnd;
-        }
-
-        ASSERT(SecondLocalTime->IsDaylightSaving >= 0);
-
-        //
-        // Look to see if the GMT offsets are different. A difference indicates
-        // that a time zone change is being straddled.
-        //
-
-        if (FirstLocalTime->GmtOffset != SecondLocalTime->GmtOffset) {
-
-            //
-            // If the given calendar time differs in savings from the second
-            // local time, then either the calendar time didn't apply the
-            // savings and the GMT offset jump just did or the calendar time
-            // had applied the savings and the GMT offset jump just corretly
-            // reversed that. Use the UTC system time that has been calculated.
-            //
-
-            if ((CalendarTime->IsDaylightSaving >= 0) &&
-                (CalendarTime->IsDaylightSaving !=
-                 SecondLocalTime->IsDaylightSaving)) {
-
-                Status = STATUS_SUCCESS;
-                goto LocalCalendarTimeToSystemTimeEnd;
-
-            //
-            // If the given calendar time's savings is specified and matches
-            // with the second local time, then adjust the time by the
-            // difference in GMT offsets. The assumption is that the caller
-            // already handled the savings and this needs to correct back in
-            // order to honor that. Do the same thing is the savings was
-            // unknown. The caller wasn't sure and nothing can be certain yet.
-            //
-
-            } else {
-                Delta = FirstLocalTime->GmtOffset - SecondLocalTime->GmtOffset;
-                SystemTime->Seconds += Delta;
-            }
-
-        //
-        // If the GMT offsets are equal there is some good news and some bad
-        // news. Handle it below.
-        //
-
-        } else {
-
-            ASSERT(FirstLocalTime->IsDaylightSaving ==
-                   SecondLocalTime->IsDaylightSaving);
-
-            //
-            // Good news. If the supplied time has an unknown daylight savings
-            // or it agrees with the daylight savings of the two times, then
-            // everything is all set.
-            //
-
-            if ((CalendarTime->IsDaylightSaving < 0) ||
-                (CalendarTime->IsDaylightSaving ==
-                 SecondLocalTime->IsDaylightSaving)) {
-
-                Status = STATUS_SUCCESS;
-                goto LocalCalendarTimeToSystemTimeEnd;
-
-            //
-            // The bad news is that the user applied savings, one way or
-            // another, and the time needs to be adjusted. It gets worse. There
-            // is no way to figure out how much the savings should be for the
-            // given calendar without parsing the rules. Break out and do that.
-            //
-
-            } else {
-                break;
-            }
-        }
-
-        //
-        // Swap the local time buffers and retry.
-        //
-
-        TemporaryLocalTime = FirstLocalTime;
-        FirstLocalTime = SecondLocalTime;
-        SecondLocalTime = TemporaryLocalTime;
-        RetryCount += 1;
-    }
-
-    //
-    // If the maximum retries have occurred, then bail out now. The system time
-    // is as accurate as it's going to get.
-    //
-
-    if (RetryCount == LOCAL_TIME_TO_SYSTEM_TIME_RETRY_MAX) {
-        Status = STATUS_SUCCESS;
-        goto LocalCalendarTimeToSystemTimeEnd;
-    }
-
-    //
-    // Now it's time to do it the hard way. The caller supplied a date that has
-    // no time savings, but a time that already incorporated savings for the
-    // year (or vice versa). As such, the current UTC system time is wrong! The
-    // savings rule for the year either needs to be added or subtracted
-    // depending on the disagreement. Go hunting for the rules that apply to
-    // the date and figure out how to modify the system time. If no rules
-    // apply, then consider savings and non-savings to be the same.
-    //
-
-    RtlAcquireTimeZoneLock();
-    LockHeld = TRUE;
-
-    //
-    // If there is no time zone data, then everything must be in GMT. The
-    // system time is currently correct for that.
-    //
-
-    Header = RtlTimeZoneData;
-    if (Header == NULL) {
-        Status = STATUS_SUCCESS;
-        goto LocalCalendarTimeToSystemTimeEnd;
-    }
-
-    //
-    // Get a pointer to the current time zone and the beginning of its zone
-    // entries.
-    //
-
-    Zone = (PVOID)Header + Header->ZoneOffset;
-    Zone += RtlTimeZoneIndex;
-    ZoneEntries = (PVOID)Header + Header->ZoneEntryOffset;
-    ZoneEntries += Zone->EntryIndex;
-
-    //
-    // Find the current zone entry.
-    //
-
-    for (EntryIndex = 0; EntryIndex < Zone->EntryCount; EntryIndex += 1) {
-        if (ZoneEntries[EntryIndex].Until > SystemTime->Seconds) {
-            break;
-        }
-    }
-
-    if (EntryIndex == Zone->EntryCount) {
-        if (Zone->EntryCount == 0) {
-            Status = STATUS_FILE_CORRUPT;
-            goto LocalCalendarTimeToSystemTimeEnd;
-        }
-
-        EntryIndex = Zone->EntryCount - 1;
-    }
-
-    //
-    // If this timezone has no daylight saving rules, there's no need to go
-    // digging through rules. Savings and non-saving times are equal, just exit
-    // now. The system time is correct.
-    //
+    //
+    // If this timezone has no daylight saving rules, there's no need to go
+    // digging through rules. Savings and non-saving times are equal, just exit
+    // now. The system time is correct.
+    //
 
     if (ZoneEntries[EntryIndex].Rules == -1) {
         Status = STATUS_SUCCESS;
@@ -2650,489 +2559,1377 @@ Return Value:
 
     None.
 
---*/
+--*/
+
+{
+
+    LONG EntryIndex;
+    BOOL FoundInRoundZero;
+    PTIME_ZONE_RULE LastRuleLastYear;
+    LONGLONG LastYearSeconds;
+    LONG OriginalYear;
+    PTIME_ZONE_RULE Rule;
+    ULONG RuleIndex;
+    PTIME_ZONE_RULE Rules;
+    PTIME_ZONE_ENTRY ZoneEntries;
+
+    FoundInRoundZero = FALSE;
+    LastRuleLastYear = NULL;
+    LastYearSeconds = 0;
+    OriginalYear = Year;
+    RecentRules[0] = NULL;
+    RecentRules[1] = NULL;
+    Rules = (PVOID)Header + Header->RuleOffset;
+    EntryIndex = CurrentEntry;
+    ZoneEntries = StartingEntry;
+
+    //
+    // Loop until all the current rules slots are filled.
+    //
+
+    while (EntryIndex >= 0) {
+        if (ZoneEntries[EntryIndex].Rules == -1) {
+            break;
+        }
+
+        //
+        // Loop through the rules looking for applicable ones.
+        //
+
+        for (RuleIndex = 0; RuleIndex < Header->RuleCount; RuleIndex += 1) {
+            Rule = Rules + RuleIndex;
+            if (Rule->Number != ZoneEntries[EntryIndex].Rules) {
+                continue;
+            }
+
+            //
+            // Keep track of the final rule in the previous year, assuming this
+            // same set of rules applies (which if it doesn't will get corrected
+            // later).
+            //
+
+            if ((Year - 1 >= Rule->From) &&
+                (Year - 1 <= Rule->To) &&
+                ((LastRuleLastYear == NULL) ||
+                 (Rule->Month > LastRuleLastYear->Month))) {
+
+                LastRuleLastYear = Rule;
+            }
+
+            //
+            // If the rule starts later than the current year or ends before the
+            // current year then it doesn't apply.
+            //
+
+            if ((Rule->From > Year) || (Rule->To < Year)) {
+                continue;
+            }
+
+            //
+            // This rule is in the current year. Skip it if it hasn't started
+            // yet.
+            //
+
+            if (Rule->Month > Month) {
+                continue;
+            }
+
+            //
+            // Place this rule in the recent list. Anything found in round
+            // zero trumps anything found in a subsequent round (more in the
+            // past).
+            //
+
+            if ((RecentRules[0] == NULL) ||
+                (((Year == OriginalYear) || (FoundInRoundZero == FALSE)) &&
+                 (RecentRules[0]->Month < Rule->Month))) {
+
+                RecentRules[1] = RecentRules[0];
+                RecentRules[0] = Rule;
+                if (Year == OriginalYear) {
+                    FoundInRoundZero = TRUE;
+                }
+
+            } else if ((RecentRules[1] == NULL) ||
+                       (RecentRules[1]->Month < Rule->Month)) {
+
+                RecentRules[1] = Rule;
+            }
+        }
+
+        //
+        // Break out if there's a first rule that clearly already applies.
+        // No need for rule one if this is the case.
+        //
+
+        if ((RecentRules[0] != NULL) &&
+            ((RecentRules[0]->Month < Month) || (FoundInRoundZero == FALSE))) {
+
+            RecentRules[1] = NULL;
+            break;
+        }
+
+        //
+        // If both recent rules were found, break out.
+        //
+
+        if (RecentRules[1] != NULL) {
+            break;
+        }
+
+        //
+        // Set the time back to the very end of last year and then find the
+        // applicable rules (which may mean going back an entry).
+        //
+
+        if (Year == OriginalYear) {
+            LastYearSeconds = ((LONGLONG)RtlpComputeDaysForYear(Year) *
+                               SECONDS_PER_DAY) - 1;
+
+            Year = OriginalYear - 1;
+            Month = MONTHS_PER_YEAR - 1;
+        }
+
+        //
+        // If last year was still in this zone entry, then use the last entry
+        // in this set of rules.
+        //
+
+        if ((EntryIndex == 0) ||
+            (LastYearSeconds > ZoneEntries[EntryIndex - 1].Until)) {
+
+            if (RecentRules[0] == NULL) {
+                RecentRules[0] = LastRuleLastYear;
+
+            } else if (RecentRules[1] == NULL) {
+
+                //
+                // It doesn't make sense to have only one rule apply in a year,
+                // as rules are supposed to turn daylight saving time on and
+                // back off.
+                //
+
+                ASSERT(RecentRules[0] != LastRuleLastYear);
+
+                RecentRules[1] = LastRuleLastYear;
+            }
+
+            break;
+        }
+
+        //
+        // Move to the previous zone entry, with a date set to the very end
+        // of last year.
+        //
+
+        EntryIndex -= 1;
+    }
+
+    return;
+}
+
+VOID
+RtlpSetTimeZoneNames (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sets up the time zone name strings for the current zone data.
+    This routine assumes the global time zone lock is already held.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    CHAR Buffer[TIME_ZONE_NAME_MAX];
+    PTIME_ZONE_RULE DaylightRule;
+    ULONG FirstLength;
+    PCSTR Format;
+    PTIME_ZONE_HEADER Header;
+    ULONG Length;
+    PTIME_ZONE_RULE Rule;
+    ULONG RuleIndex;
+    PTIME_ZONE_RULE Rules;
+    PSTR Slash;
+    PTIME_ZONE_RULE StandardRule;
+    PTIME_ZONE Zone;
+    PTIME_ZONE_ENTRY ZoneEntry;
+
+    RtlStandardTimeZoneName = "";
+    RtlDaylightTimeZoneName = "";
+    Header = RtlTimeZoneData;
+    Zone = (PVOID)Header + Header->ZoneOffset;
+    if (RtlTimeZoneIndex >= Header->ZoneCount) {
+        goto SetTimeZoneNamesEnd;
+    }
+
+    Zone += RtlTimeZoneIndex;
+    if (Zone->EntryCount == 0) {
+        goto SetTimeZoneNamesEnd;
+    }
+
+    ZoneEntry = (PVOID)Header + Header->ZoneEntryOffset;
+    ZoneEntry += Zone->EntryIndex + Zone->EntryCount - 1;
+    RtlStandardTimeZoneOffset = ZoneEntry->GmtOffset + ZoneEntry->Save;
+    RtlDaylightTimeZoneOffset = RtlStandardTimeZoneOffset;
+    Format = RtlpTimeZoneGetString(Header, ZoneEntry->Format);
+    if (Format == NULL) {
+        goto SetTimeZoneNamesEnd;
+    }
+
+    //
+    // If there's a slash in the format, then the slash separates the standard
+    // from the daylight times.
+    //
+
+    Length = RtlStringLength(Format) + 1;
+    Slash = RtlStringFindCharacter(Format, '/', Length);
+    if (Slash != NULL) {
+        FirstLength = (UINTN)Slash - (UINTN)Format + 1;
+        if (FirstLength > TIME_ZONE_NAME_MAX) {
+            FirstLength = TIME_ZONE_NAME_MAX;
+        }
+
+        RtlStringCopy(Buffer, Format, FirstLength);
+        RtlStandardTimeZoneName = RtlpTimeZoneCacheString(Buffer);
+        Slash += 1;
+        RtlDaylightTimeZoneName = RtlpTimeZoneCacheString(Slash);
+        goto SetTimeZoneNamesEnd;
+    }
+
+    //
+    // If there are no rules, then just copy the name in.
+    //
+
+    if (ZoneEntry->Rules == -1) {
+        RtlStandardTimeZoneName = RtlpTimeZoneCacheString(Format);
+        RtlDaylightTimeZoneName = RtlStandardTimeZoneName;
+        goto SetTimeZoneNamesEnd;
+    }
+
+    //
+    // Root through all the rules to find the standard and daylight letters.
+    //
+
+    DaylightRule = NULL;
+    StandardRule = NULL;
+    Rules = (PVOID)Header + Header->RuleOffset;
+    for (RuleIndex = 0; RuleIndex < Header->RuleCount; RuleIndex += 1) {
+        Rule = Rules + RuleIndex;
+        if (Rule->Number != ZoneEntry->Rules) {
+            continue;
+        }
+
+        if (Rule->Save == 0) {
+            if ((StandardRule == NULL) || (StandardRule->To < Rule->To)) {
+                StandardRule = Rule;
+            }
+
+        } else {
+            if ((DaylightRule == NULL) || (DaylightRule->To < Rule->To)) {
+                DaylightRule = Rule;
+            }
+        }
+    }
+
+    if (DaylightRule != NULL) {
+        RtlDaylightTimeZoneOffset += DaylightRule->Save;
+    }
+
+    RtlpTimeZonePerformSubstitution(Buffer,
+                                    TIME_ZONE_NAME_MAX,
+                                    Format,
+                                    StandardRule);
+
+    Buffer[TIME_ZONE_NAME_MAX - 1] = '\0';
+    RtlStandardTimeZoneName = RtlpTimeZoneCacheString(Buffer);
+    RtlpTimeZonePerformSubstitution(Buffer,
+                                    TIME_ZONE_NAME_MAX,
+                                    Format,
+                                    DaylightRule);
+
+    Buffer[TIME_ZONE_NAME_MAX - 1] = '\0';
+    RtlDaylightTimeZoneName = RtlpTimeZoneCacheString(Buffer);
+
+SetTimeZoneNamesEnd:
+    return;
+}
+
+VOID
+RtlpTimeZonePerformSubstitution (
+    PSTR Destination,
+    ULONG DestinationSize,
+    PCSTR Format,
+    PTIME_ZONE_RULE Rule
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes the given time zone format and letters into the
+    destination buffer. It's like a super limited version of printf. This
+    routine assumes the time zone lock is already held and that the given rule
+    is from the current time zone data.
+
+Arguments:
+
+    Destination - Supplies a pointer to the destination buffer.
+
+    DestinationSize - Supplies the size of the destination buffer in bytes.
+
+    Format - Supplies the format string.
+
+    Rule - Supplies the substitution rule.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG LetterIndex;
+    PCSTR Letters;
+    ULONG RemainingSize;
+    PSTR Result;
+
+    if (DestinationSize == 0) {
+        return;
+    }
+
+    Letters = NULL;
+    if (Rule != NULL) {
+        Letters = RtlpTimeZoneGetString(RtlTimeZoneData, Rule->Letters);
+    }
+
+    Result = Destination;
+    RemainingSize = DestinationSize - 1;
+    while (RemainingSize != 0) {
+
+        //
+        // If a %s is found, copy the letters string in.
+        //
+
+        if ((*Format == '%') && (*(Format + 1) == 's')) {
+            if (Letters != NULL) {
+                LetterIndex = 0;
+                while (RemainingSize != 0) {
+                    if (Letters[LetterIndex] == '\0') {
+                        break;
+                    }
+
+                    *Result = Letters[LetterIndex];
+                    LetterIndex += 1;
+                    Result += 1;
+                    RemainingSize -= 1;
+                }
+            }
+
+            Format += 2;
+
+        } else {
+            *Result = *Format;
+            if (*Format == '\0') {
+                break;
+            }
+
+            Format += 1;
+            Result += 1;
+            RemainingSize -= 1;
+        }
+    }
+
+    *Result = '\0';
+    return;
+}
+
+PCSTR
+RtlpTimeZoneCacheString (
+    PCSTR String
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns a cached string for the given string. This routine
+    assumes the time zone lock is already held.
+
+Arguments:
+
+    String - Supplies a pointer to the string to find the cached version of.
+
+Return Value:
+
+    Returns a pointer to the cached string on success.
+
+    NULL on allocation failure.
+
+--*/
+
+{
+
+    ULONG Index;
+    BOOL Match;
+    PSTR *NewBuffer;
+    ULONG NewCapacity;
+    PSTR NewString;
+    UINTN StringSize;
+
+    StringSize = RtlStringLength(String) + 1;
+
+    //
+    // There should never really be that many time zone names floating around
+    // (probably less than 6 at any time), so use a simple linear search of an
+    // array of strings.
+    //
+
+    for (Index = 0; Index < RtlTimeZoneNameCacheSize; Index += 1) {
+        if (RtlTimeZoneNameCache[Index] == NULL) {
+            break;
+        }
+
+        Match = RtlAreStringsEqual(RtlTimeZoneNameCache[Index],
+                                   String,
+                                   StringSize);
+
+        if (Match != FALSE) {
+            return RtlTimeZoneNameCache[Index];
+        }
+    }
+
+    //
+    // The string was not found. If the array is full, reallocate it.
+    //
+
+    if (Index == RtlTimeZoneNameCacheSize) {
+        if (Index == 0) {
+            NewCapacity = 8;
+
+        } else {
+            NewCapacity = Index * 2;
+        }
+
+        NewBuffer = RtlTimeZoneReallocate(RtlTimeZoneNameCache,
+                                          NewCapacity * sizeof(PSTR));
+
+        if (NewBuffer == NULL) {
+            return NULL;
+        }
+
+        RtlTimeZoneNameCache = NewBuffer;
+        RtlTimeZoneNameCacheSize = NewCapacity;
+        RtlZeroMemory(NewBuffer + Index, (NewCapacity - Index) * sizeof(PSTR));
+    }
+
+    NewString = RtlTimeZoneReallocate(NULL, StringSize);
+    if (NewString == NULL) {
+        return NULL;
+    }
+
+    RtlCopyMemory(NewString, String, StringSize);
+    RtlTimeZoneNameCache[Index] = NewString;
+    return NewString;
+}
+
+KSTATUS
+RtlpSystemTimeToLocalCalendarTime (
+    PSYSTEM_TIME SystemTime,
+    PCALENDAR_TIME CalendarTime
+    )
+
+/*++
+
+Routine Description:
+
+    This routine converts the given system time into calendar time in the
+    current local time zone by evaluating the zone entries and rules. This
+    routine assumes the time zone lock is already held.
+
+Arguments:
+
+    SystemTime - Supplies a pointer to the system time to convert.
+
+    CalendarTime - Supplies a pointer to the calendar time to initialize based
+        on the given system time.
+
+Return Value:
+
+    STATUS_SUCCESS on success.
+
+    STATUS_OUT_OF_BOUNDS if the given system time is too funky.
+
+--*/
+
+{
+
+    PTIME_ZONE_RULE CurrentRules[2];
+    LONG DaysInMonth;
+    PTIME_ZONE_RULE EffectiveRule;
+    ULONG EntryIndex;
+    PCSTR Format;
+    CALENDAR_TIME GmtTime;
+    PTIME_ZONE_HEADER Header;
+    LONG Leap;
+    LONG LocalStandardTime;
+    PTIME_ZONE_OCCASION Occasion;
+    BOOL RuleApplies;
+    LONG RuleMonthDay;
+    KSTATUS Status;
+    LONG Time;
+    LONG Weekday;
+    PTIME_ZONE Zone;
+    PTIME_ZONE_ENTRY ZoneEntries;
+    CHAR ZoneNameBuffer[TIME_ZONE_NAME_MAX];
+
+    EffectiveRule = NULL;
+    Format = NULL;
+    Status = RtlSystemTimeToGmtCalendarTime(SystemTime, CalendarTime);
+    if (!KSUCCESS(Status)) {
+        return Status;
+    }
+
+    RtlCopyMemory(&GmtTime, CalendarTime, sizeof(CALENDAR_TIME));
+    Header = RtlTimeZoneData;
+    if (Header == NULL) {
+        goto SystemTimeToLocalCalendarTimeEnd;
+    }
+
+    //
+    // Get a pointer to the current time zone and the beginning of its zone
+    // entries.
+    //
+
+    Zone = (PVOID)Header + Header->ZoneOffset;
+    Zone += RtlTimeZoneIndex;
+    ZoneEntries = (PVOID)Header + Header->ZoneEntryOffset;
+    ZoneEntries += Zone->EntryIndex;
+
+    //
+    // Find the current zone entry.
+    //
+
+    for (EntryIndex = 0; EntryIndex < Zone->EntryCount; EntryIndex += 1) {
+        if (ZoneEntries[EntryIndex].Until > SystemTime->Seconds) {
+            break;
+        }
+    }
+
+    if (EntryIndex == Zone->EntryCount) {
+        if (Zone->EntryCount == 0) {
+            Status = STATUS_FILE_CORRUPT;
+            goto SystemTimeToLocalCalendarTimeEnd;
+        }
+
+        EntryIndex = Zone->EntryCount - 1;
+    }
+
+    Format = RtlpTimeZoneGetString(Header, ZoneEntries[EntryIndex].Format);
+
+    //
+    // Compute the local time with the GMT offset for the current zone entry.
+    //
+
+    CalendarTime->GmtOffset = ZoneEntries[EntryIndex].GmtOffset +
+                              ZoneEntries[EntryIndex].Save;
+
+    CalendarTime->Second += CalendarTime->GmtOffset;
+    RtlpNormalizeCalendarTime(CalendarTime);
+    CalendarTime->IsDaylightSaving = FALSE;
+    if (ZoneEntries[EntryIndex].Save != 0) {
+        CalendarTime->IsDaylightSaving = TRUE;
+    }
+
+    //
+    // If this timezone has no daylight saving rules, there's no need to go
+    // digging through rules.
+    //
+
+    if (ZoneEntries[EntryIndex].Rules == -1) {
+        RtlpTimeZonePerformSubstitution(ZoneNameBuffer,
+                                        sizeof(ZoneNameBuffer),
+                                        Format,
+                                        NULL);
+
+        CalendarTime->TimeZone = RtlpTimeZoneCacheString(ZoneNameBuffer);
+        Status = STATUS_SUCCESS;
+        goto SystemTimeToLocalCalendarTimeEnd;
+    }
+
+    //
+    // Figure out the two rules (or at least one) that apply here.
+    //
+
+    RtlpFindTimeZoneRules(Header,
+                          ZoneEntries,
+                          EntryIndex,
+                          CalendarTime->Year,
+                          CalendarTime->Month,
+                          CurrentRules);
+
+    LocalStandardTime = (CalendarTime->Hour * SECONDS_PER_HOUR) +
+                        (CalendarTime->Minute * SECONDS_PER_MINUTE) +
+                        CalendarTime->Second;
+
+    //
+    // Apply the previous rule if there is one.
+    //
+
+    if (CurrentRules[1] != NULL) {
+        EffectiveRule = CurrentRules[1];
+        if (CurrentRules[1]->Save != 0) {
+            CalendarTime->Second += CurrentRules[1]->Save;
+            RtlpNormalizeCalendarTime(CalendarTime);
+        }
+    }
+
+    //
+    // If there is no first rule to test, this is done.
+    //
+
+    if (CurrentRules[0] == NULL) {
+
+        ASSERT(CurrentRules[1] == NULL);
+
+        Status = STATUS_SUCCESS;
+        goto SystemTimeToLocalCalendarTimeEnd;
+    }
+
+    //
+    // Figure out if the first rule applies, and apply it if so.
+    //
+
+    RuleApplies = FALSE;
+    RuleMonthDay = 31;
+    Occasion = &(CurrentRules[0]->On);
+
+    //
+    // If the current rule is not this month, the rule definitely applies,
+    // either as a previous month of this year, or a month in last year.
+    //
+
+    if (CurrentRules[0]->Month != CalendarTime->Month) {
+        RuleApplies = TRUE;
+
+    //
+    // Calculating the day of the month this rule applies on is easy if it's
+    // spelled out.
+    //
+
+    } else if (Occasion->Type == TimeZoneOccasionMonthDate) {
+        RuleMonthDay = CurrentRules[0]->On.MonthDay;
+
+    //
+    // The day of the month this rule applies on depends on the day of the
+    // week. Start by calculating the day of the week for the first of the
+    // month.
+    //
+
+    } else {
+        Status = RtlpCalculateWeekdayForMonth(CalendarTime->Year,
+                                              CalendarTime->Month,
+                                              &Weekday);
+
+        if (!KSUCCESS(Status)) {
+            goto SystemTimeToLocalCalendarTimeEnd;
+        }
+
+        Leap = 0;
+        if (IS_LEAP_YEAR(CalendarTime->Year)) {
+            Leap = 1;
+        }
+
+        DaysInMonth = RtlDaysPerMonth[Leap][CalendarTime->Month];
+        RuleMonthDay = 1;
+
+        //
+        // Make the day of the month line up with the first instance of the
+        // weekday in the rule.
+        //
+
+        if (Occasion->Weekday >= Weekday) {
+            RuleMonthDay += Occasion->Weekday - Weekday;
+
+        } else {
+            RuleMonthDay += DAYS_PER_WEEK - (Weekday - Occasion->Weekday);
+        }
+
+        switch (Occasion->Type) {
+
+        //
+        // Add a week as many times as possible.
+        //
+
+        case TimeZoneOccasionLastWeekday:
+            while (RuleMonthDay + DAYS_PER_WEEK <= DaysInMonth) {
+                RuleMonthDay += DAYS_PER_WEEK;
+            }
+
+            break;
+
+        //
+        // Add a week as long as it's less than the required minimum month day.
+        // If that pushes it over the month, then the occasion doesn't exist.
+        //
+
+        case TimeZoneOccasionGreaterOrEqualWeekday:
+            while (RuleMonthDay < Occasion->MonthDay) {
+                RuleMonthDay += DAYS_PER_WEEK;
+            }
+
+            if (RuleMonthDay > DaysInMonth) {
+                RuleMonthDay = 31;
+            }
+
+            break;
+
+        //
+        // If the first instance of that weekday is already too far, then the
+        // occasion doesn't exist. Otherwise, keep adding weeks as long as it's
+        // still under the limit.
+        //
+
+        case TimeZoneOccasionLessOrEqualWeekday:
+            if (RuleMonthDay > Occasion->MonthDay) {
+                RuleMonthDay = 31;
+
+            } else {
+                while (RuleMonthDay + DAYS_PER_WEEK <
+                       Occasion->MonthDay) {
+
+                    RuleMonthDay += DAYS_PER_WEEK;
+                }
+            }
+
+            break;
+
+        default:
+
+            ASSERT(FALSE);
+
+            Status = STATUS_FILE_CORRUPT;
+            goto SystemTimeToLocalCalendarTimeEnd;
+        }
+    }
+
+    //
+    // If the day of the month is after the rule occasion, the rule definitely
+    // applies. If the day of the month is equal to the day the rule applies,
+    // check the time of day.
+    //
+
+    if (RuleApplies == FALSE) {
+        if (CalendarTime->Day > RuleMonthDay) {
+            RuleApplies = TRUE;
+
+        } else if (CalendarTime->Day == RuleMonthDay) {
+            switch (CurrentRules[0]->AtLens) {
+            case TimeZoneLensLocalTime:
+                Time = (CalendarTime->Hour * SECONDS_PER_HOUR) +
+                       (CalendarTime->Minute * SECONDS_PER_MINUTE) +
+                       CalendarTime->Second;
+
+                break;
+
+            case TimeZoneLensLocalStandardTime:
+                Time = LocalStandardTime;
+                break;
+
+            case TimeZoneLensUtc:
+                Time = (GmtTime.Hour * SECONDS_PER_HOUR) +
+                       (GmtTime.Minute * SECONDS_PER_MINUTE) +
+                       GmtTime.Second;
 
-{
+                break;
 
-    LONG EntryIndex;
-    BOOL FoundInRoundZero;
-    PTIME_ZONE_RULE LastRuleLastYear;
-    LONGLONG LastYearSeconds;
-    LONG OriginalYear;
-    PTIME_ZONE_RULE Rule;
-    ULONG RuleIndex;
-    PTIME_ZONE_RULE Rules;
-    PTIME_ZONE_ENTRY ZoneEntries;
+            default:
+                Time = SECONDS_PER_DAY;
+                break;
+            }
 
-    FoundInRoundZero = FALSE;
-    LastRuleLastYear = NULL;
-    LastYearSeconds = 0;
-    OriginalYear = Year;
-    RecentRules[0] = NULL;
-    RecentRules[1] = NULL;
-    Rules = (PVOID)Header + Header->RuleOffset;
-    EntryIndex = CurrentEntry;
-    ZoneEntries = StartingEntry;
+            if (Time >= CurrentRules[0]->At) {
+                RuleApplies = TRUE;
+            }
+        }
+    }
 
     //
-    // Loop until all the current rules slots are filled.
+    // If after all that this rule applies, apply it and unapply the previous
+    // rule.
     //
 
-    while (EntryIndex >= 0) {
-        if (ZoneEntries[EntryIndex].Rules == -1) {
-            break;
+    if (RuleApplies != FALSE) {
+        EffectiveRule = CurrentRules[0];
+        CalendarTime->Second += CurrentRules[0]->Save;
+        if (CurrentRules[1] != NULL) {
+            CalendarTime->Second -= CurrentRules[1]->Save;
         }
 
-        //
-        // Loop through the rules looking for applicable ones.
-        //
-
-        for (RuleIndex = 0; RuleIndex < Header->RuleCount; RuleIndex += 1) {
-            Rule = Rules + RuleIndex;
-            if (Rule->Number != ZoneEntries[EntryIndex].Rules) {
-                continue;
-            }
+        RtlpNormalizeCalendarTime(CalendarTime);
+    }
 
-            //
-            // Keep track of the final rule in the previous year, assuming this
-            // same set of rules applies (which if it doesn't will get corrected
-            // later).
-            //
+SystemTimeToLocalCalendarTimeEnd:
+    if (EffectiveRule != NULL) {
+        if (EffectiveRule->Save != 0) {
+            CalendarTime->IsDaylightSaving = TRUE;
+        }
 
-            if ((Year - 1 >= Rule->From) &&
-                (Year - 1 <= Rule->To) &&
-                ((LastRuleLastYear == NULL) ||
-                 (Rule->Month > LastRuleLastYear->Month))) {
+        CalendarTime->GmtOffset += EffectiveRule->Save;
+        RtlpTimeZonePerformSubstitution(ZoneNameBuffer,
+                                        sizeof(ZoneNameBuffer),
+                                        Format,
+                                        EffectiveRule);
 
-                LastRuleLastYear = Rule;
-            }
+        CalendarTime->TimeZone = RtlpTimeZoneCacheString(ZoneNameBuffer);
+    }
 
-            //
-            // If the rule starts later than the current year or ends before the
-            // current year then it doesn't apply.
-            //
+    return Status;
+}
 
-            if ((Rule->From > Year) || (Rule->To < Year)) {
-                continue;
-            }
+BOOL
+RtlpLookupTimeZoneTransition (
+    PSYSTEM_TIME SystemTime,
+    PCALENDAR_TIME CalendarTime
+    )
 
-            //
-            // This rule is in the current year. Skip it if it hasn't started
-            // yet.
-            //
+/*++
 
-            if (Rule->Month > Month) {
-                continue;
-            }
+Routine Description:
 
-            //
-            // Place this rule in the recent list. Anything found in round
-            // zero trumps anything found in a subsequent round (more in the
-            // past).
-            //
+    This routine attempts to convert the given system time into local
+    calendar time using the precomputed transition table. This routine does
+    not acquire the time zone lock.
 
-            if ((RecentRules[0] == NULL) ||
-                (((Year == OriginalYear) || (FoundInRoundZero == FALSE)) &&
-                 (RecentRules[0]->Month < Rule->Month))) {
+Arguments:
 
-                RecentRules[1] = RecentRules[0];
-                RecentRules[0] = Rule;
-                if (Year == OriginalYear) {
-                    FoundInRoundZero = TRUE;
-                }
+    SystemTime - Supplies a pointer to the system time to convert.
 
-            } else if ((RecentRules[1] == NULL) ||
-                       (RecentRules[1]->Month < Rule->Month)) {
+    CalendarTime - Supplies a pointer to the calendar time to initialize based
+        on the given system time.
 
-                RecentRules[1] = Rule;
-            }
-        }
+Return Value:
 
-        //
-        // Break out if there's a first rule that clearly already applies.
-        // No need for rule one if this is the case.
-        //
+    TRUE if the conversion was completed.
 
-        if ((RecentRules[0] != NULL) &&
-            ((RecentRules[0]->Month < Month) || (FoundInRoundZero == FALSE))) {
+    FALSE if there is no table or the time falls outside its window. The
+    caller should fall back to evaluating the rules.
 
-            RecentRules[1] = NULL;
-            break;
-        }
+--*/
 
-        //
-        // If both recent rules were found, break out.
-        //
+{
 
-        if (RecentRules[1] != NULL) {
-            break;
-        }
+    ULONG High;
+    ULONG Index;
+    ULONG Low;
+    ULONG Middle;
+    BOOL Result;
+    LONGLONG Seconds;
+    PTIME_ZONE_TRANSITION_SLOT Slot;
+    KSTATUS Status;
+    PTIME_ZONE_TRANSITION_TABLE Table;
+    PTIME_ZONE_TRANSITION Transition;
 
-        //
-        // Set the time back to the very end of last year and then find the
-        // applicable rules (which may mean going back an entry).
-        //
+    Result = FALSE;
+    Seconds = SystemTime->Seconds;
 
-        if (Year == OriginalYear) {
-            LastYearSeconds = ((LONGLONG)RtlpComputeDaysForYear(Year) *
-                               SECONDS_PER_DAY) - 1;
+    //
+    // Count this reader against the current slot, and then make sure the slot
+    // is still current. A slot that was already unpublished may have had its
+    // table freed, so back out and look again in that case. Once the count is
+    // in place on a current slot, its table cannot be freed until the count
+    // is dropped.
+    //
 
-            Year = OriginalYear - 1;
-            Month = MONTHS_PER_YEAR - 1;
+    while (TRUE) {
+        Index = RtlTimeZoneTransitionSlot;
+        if (Index == TIME_ZONE_TRANSITION_NO_SLOT) {
+            return FALSE;
         }
 
-        //
-        // If last year was still in this zone entry, then use the last entry
-        // in this set of rules.
-        //
-
-        if ((EntryIndex == 0) ||
-            (LastYearSeconds > ZoneEntries[EntryIndex - 1].Until)) {
+        Slot = &(RtlTimeZoneTransitionSlots[Index]);
+        RtlAtomicAdd32(&(Slot->ReferenceCount), 1);
+        if (RtlTimeZoneTransitionSlot == Index) {
+            break;
+        }
 
-            if (RecentRules[0] == NULL) {
-                RecentRules[0] = LastRuleLastYear;
+        RtlAtomicAdd32(&(Slot->ReferenceCount), (ULONG)-1);
+    }
 
-            } else if (RecentRules[1] == NULL) {
+    Table = Slot->Table;
+    if ((Seconds < Table->Transitions[0].Time) ||
+        (Seconds >= Table->End)) {
 
-                //
-                // It doesn't make sense to have only one rule apply in a year,
-                // as rules are supposed to turn daylight saving time on and
-                // back off.
-                //
+        goto LookupTimeZoneTransitionEnd;
+    }
 
-                ASSERT(RecentRules[0] != LastRuleLastYear);
+    //
+    // Find the last transition at or before the given time.
+    //
 
-                RecentRules[1] = LastRuleLastYear;
-            }
+    Low = 0;
+    High = Table->Count;
+    while (High - Low > 1) {
+        Middle = Low + ((High - Low) / 2);
+        if (Table->Transitions[Middle].Time <= Seconds) {
+            Low = Middle;
 
-            break;
+        } else {
+            High = Middle;
         }
+    }
 
-        //
-        // Move to the previous zone entry, with a date set to the very end
-        // of last year.
-        //
-
-        EntryIndex -= 1;
+    Transition = &(Table->Transitions[Low]);
+    Status = RtlSystemTimeToGmtCalendarTime(SystemTime, CalendarTime);
+    if (!KSUCCESS(Status)) {
+        goto LookupTimeZoneTransitionEnd;
     }
 
-    return;
+    CalendarTime->GmtOffset = Transition->GmtOffset;
+    CalendarTime->Second += Transition->GmtOffset;
+    RtlpNormalizeCalendarTime(CalendarTime);
+    CalendarTime->IsDaylightSaving = Transition->IsDaylightSaving;
+    CalendarTime->TimeZone = Transition->TimeZone;
+    Result = TRUE;
+
+LookupTimeZoneTransitionEnd:
+    RtlAtomicAdd32(&(Slot->ReferenceCount), (ULONG)-1);
+    return Result;
 }
 
 VOID
-RtlpSetTimeZoneNames (
-    VOID
+RtlpBuildTimeZoneTransitions (
+    LONGLONG Seconds,
+    ULONG Generation
     )
 
 /*++
 
 Routine Description:
 
-    This routine sets up the time zone name strings for the current zone data.
-    This routine assumes the global time zone lock is already held.
+    This routine expands the current time zone's entries and rules into a
+    sorted table of transitions covering a window of years around the given
+    time, and publishes it for lock-free lookups. The window is scanned at a
+    fixed interval using the rule evaluation, and each change found is
+    bisected down to the second it takes effect. This routine must be called
+    without the time zone lock held. The lock is dropped periodically during
+    the build, and the build is abandoned if the time zone changes while the
+    lock is not held.
 
 Arguments:
 
-    None.
+    Seconds - Supplies the system time to center the window around.
+
+    Generation - Supplies the time zone generation the table is being built
+        for.
 
 Return Value:
 
-    None.
+    None. On failure no table is published, and conversions continue to
+    evaluate the rules.
 
 --*/
 
 {
 
-    CHAR Buffer[TIME_ZONE_NAME_MAX];
-    PTIME_ZONE_RULE DaylightRule;
-    ULONG FirstLength;
-    PCSTR Format;
-    PTIME_ZONE_HEADER Header;
-    ULONG Length;
-    PTIME_ZONE_RULE Rule;
-    ULONG RuleIndex;
-    PTIME_ZONE_RULE Rules;
-    PSTR Slash;
-    PTIME_ZONE_RULE StandardRule;
-    PTIME_ZONE Zone;
-    PTIME_ZONE_ENTRY ZoneEntry;
-
-    RtlStandardTimeZoneName = "";
-    RtlDaylightTimeZoneName = "";
-    Header = RtlTimeZoneData;
-    Zone = (PVOID)Header + Header->ZoneOffset;
-    if (RtlTimeZoneIndex >= Header->ZoneCount) {
-        goto SetTimeZoneNamesEnd;
-    }
+    TIME_ZONE_TRANSITION Current;
+    LONGLONG End;
+    CALENDAR_TIME GmtTime;
+    LONGLONG High;
+    TIME_ZONE_TRANSITION HighTransition;
+    LONGLONG Low;
+    LONGLONG Middle;
+    TIME_ZONE_TRANSITION MiddleTransition;
+    LONGLONG SliceEnd;
+    KSTATUS Status;
+    SYSTEM_TIME SystemTime;
+    PTIME_ZONE_TRANSITION_TABLE Table;
 
-    Zone += RtlTimeZoneIndex;
-    if (Zone->EntryCount == 0) {
-        goto SetTimeZoneNamesEnd;
+    Table = NULL;
+    SystemTime.Seconds = Seconds;
+    SystemTime.Nanoseconds = 0;
+    RtlAcquireTimeZoneLock();
+    if (RtlTimeZoneGeneration != Generation) {
+        goto BuildTimeZoneTransitionsEnd;
     }
 
-    ZoneEntry = (PVOID)Header + Header->ZoneEntryOffset;
-    ZoneEntry += Zone->EntryIndex + Zone->EntryCount - 1;
-    RtlStandardTimeZoneOffset = ZoneEntry->GmtOffset + ZoneEntry->Save;
-    RtlDaylightTimeZoneOffset = RtlStandardTimeZoneOffset;
-    Format = RtlpTimeZoneGetString(Header, ZoneEntry->Format);
-    if (Format == NULL) {
-        goto SetTimeZoneNamesEnd;
+    Status = RtlSystemTimeToGmtCalendarTime(&SystemTime, &GmtTime);
+    if (!KSUCCESS(Status)) {
+        goto BuildTimeZoneTransitionsEnd;
     }
 
-    //
-    // If there's a slash in the format, then the slash separates the standard
-    // from the daylight times.
-    //
+    Low = (LONGLONG)RtlpComputeDaysForYear(
+                            GmtTime.Year - TIME_ZONE_TRANSITION_PAST_YEARS) *
+          SECONDS_PER_DAY;
 
-    Length = RtlStringLength(Format) + 1;
-    Slash = RtlStringFindCharacter(Format, '/', Length);
-    if (Slash != NULL) {
-        FirstLength = (UINTN)Slash - (UINTN)Format + 1;
-        if (FirstLength > TIME_ZONE_NAME_MAX) {
-            FirstLength = TIME_ZONE_NAME_MAX;
-        }
+    End = (LONGLONG)RtlpComputeDaysForYear(
+                            GmtTime.Year + TIME_ZONE_TRANSITION_FUTURE_YEARS) *
+          SECONDS_PER_DAY;
 
-        RtlStringCopy(Buffer, Format, FirstLength);
-        RtlStandardTimeZoneName = RtlpTimeZoneCacheString(Buffer);
-        Slash += 1;
-        RtlDaylightTimeZoneName = RtlpTimeZoneCacheString(Slash);
-        goto SetTimeZoneNamesEnd;
+    Status = RtlpEvaluateTimeZoneTransition(Low, &Current);
+    if (!KSUCCESS(Status)) {
+        goto BuildTimeZoneTransitionsEnd;
     }
 
-    //
-    // If there are no rules, then just copy the name in.
-    //
-
-    if (ZoneEntry->Rules == -1) {
-        RtlStandardTimeZoneName = RtlpTimeZoneCacheString(Format);
-        RtlDaylightTimeZoneName = RtlStandardTimeZoneName;
-        goto SetTimeZoneNamesEnd;
+    if (RtlpAddTimeZoneTransition(&Table, &Current) == FALSE) {
+        goto BuildTimeZoneTransitionsEnd;
     }
 
-    //
-    // Root through all the rules to find the standard and daylight letters.
-    //
+    SliceEnd = Low + TIME_ZONE_TRANSITION_BUILD_SLICE;
+    while (Low < End) {
 
-    DaylightRule = NULL;
-    StandardRule = NULL;
-    Rules = (PVOID)Header + Header->RuleOffset;
-    for (RuleIndex = 0; RuleIndex < Header->RuleCount; RuleIndex += 1) {
-        Rule = Rules + RuleIndex;
-        if (Rule->Number != ZoneEntry->Rules) {
+        //
+        // Let other conversions in between slices of the scan. If the time
+        // zone changed in the meantime, the table is no longer any good.
+        //
+
+        if (Low >= SliceEnd) {
+            RtlReleaseTimeZoneLock();
+            RtlAcquireTimeZoneLock();
+            if (RtlTimeZoneGeneration != Generation) {
+                goto BuildTimeZoneTransitionsEnd;
+            }
+
+            SliceEnd = Low + TIME_ZONE_TRANSITION_BUILD_SLICE;
+        }
+
+        High = Low + TIME_ZONE_TRANSITION_SCAN_INTERVAL;
+        if (High > End) {
+            High = End;
+        }
+
+        Status = RtlpEvaluateTimeZoneTransition(High, &HighTransition);
+        if (!KSUCCESS(Status)) {
+            goto BuildTimeZoneTransitionsEnd;
+        }
+
+        if ((HighTransition.GmtOffset == Current.GmtOffset) &&
+            (HighTransition.IsDaylightSaving == Current.IsDaylightSaving) &&
+            (HighTransition.TimeZone == Current.TimeZone)) {
+
+            Low = High;
             continue;
         }
 
-        if (Rule->Save == 0) {
-            if ((StandardRule == NULL) || (StandardRule->To < Rule->To)) {
-                StandardRule = Rule;
+        //
+        // Something changed in this interval. Narrow it down to the first
+        // second that differs.
+        //
+
+        while (High - Low > 1) {
+            Middle = Low + ((High - Low) / 2);
+            Status = RtlpEvaluateTimeZoneTransition(Middle, &MiddleTransition);
+            if (!KSUCCESS(Status)) {
+                goto BuildTimeZoneTransitionsEnd;
             }
 
-        } else {
-            if ((DaylightRule == NULL) || (DaylightRule->To < Rule->To)) {
-                DaylightRule = Rule;
+            if ((MiddleTransition.GmtOffset == Current.GmtOffset) &&
+                (MiddleTransition.IsDaylightSaving ==
+                 Current.IsDaylightSaving) &&
+                (MiddleTransition.TimeZone == Current.TimeZone)) {
+
+                Low = Middle;
+
+            } else {
+                High = Middle;
+                RtlCopyMemory(&HighTransition,
+                              &MiddleTransition,
+                              sizeof(TIME_ZONE_TRANSITION));
             }
         }
-    }
 
-    if (DaylightRule != NULL) {
-        RtlDaylightTimeZoneOffset += DaylightRule->Save;
-    }
+        if (High >= End) {
+            break;
+        }
 
-    RtlpTimeZonePerformSubstitution(Buffer,
-                                    TIME_ZONE_NAME_MAX,
-                                    Format,
-                                    StandardRule);
+        if (RtlpAddTimeZoneTransition(&Table, &HighTransition) == FALSE) {
+            goto BuildTimeZoneTransitionsEnd;
+        }
 
-    Buffer[TIME_ZONE_NAME_MAX - 1] = '\0';
-    RtlStandardTimeZoneName = RtlpTimeZoneCacheString(Buffer);
-    RtlpTimeZonePerformSubstitution(Buffer,
-                                    TIME_ZONE_NAME_MAX,
-                                    Format,
-                                    DaylightRule);
+        RtlCopyMemory(&Current, &HighTransition, sizeof(TIME_ZONE_TRANSITION));
+        Low = High;
+    }
 
-    Buffer[TIME_ZONE_NAME_MAX - 1] = '\0';
-    RtlDaylightTimeZoneName = RtlpTimeZoneCacheString(Buffer);
+    Table->End = End;
+    if (RtlpPublishTimeZoneTransitions(Table) != FALSE) {
+        Table = NULL;
+    }
+
+BuildTimeZoneTransitionsEnd:
+    RtlReleaseTimeZoneLock();
+    if (Table != NULL) {
+        RtlTimeZoneReallocate(Table, 0);
+    }
 
-SetTimeZoneNamesEnd:
     return;
 }
 
-VOID
-RtlpTimeZonePerformSubstitution (
-    PSTR Destination,
-    ULONG DestinationSize,
-    PCSTR Format,
-    PTIME_ZONE_RULE Rule
+KSTATUS
+RtlpEvaluateTimeZoneTransition (
+    LONGLONG Seconds,
+    PTIME_ZONE_TRANSITION Transition
     )
 
 /*++
 
 Routine Description:
 
-    This routine writes the given time zone format and letters into the
-    destination buffer. It's like a super limited version of printf. This
-    routine assumes the time zone lock is already held and that the given rule
-    is from the current time zone data.
+    This routine evaluates the time zone rules in effect at the given time.
+    This routine assumes the time zone lock is already held.
 
 Arguments:
 
-    Destination - Supplies a pointer to the destination buffer.
-
-    DestinationSize - Supplies the size of the destination buffer in bytes.
-
-    Format - Supplies the format string.
+    Seconds - Supplies the system time to evaluate.
 
-    Rule - Supplies the substitution rule.
+    Transition - Supplies a pointer where the time and the offset, daylight
+        saving state, and time zone name in effect will be returned.
 
 Return Value:
 
-    None.
+    Status code.
 
 --*/
 
 {
 
-    ULONG LetterIndex;
-    PCSTR Letters;
-    ULONG RemainingSize;
-    PSTR Result;
+    CALENDAR_TIME CalendarTime;
+    KSTATUS Status;
+    SYSTEM_TIME SystemTime;
 
-    if (DestinationSize == 0) {
-        return;
+    SystemTime.Seconds = Seconds;
+    SystemTime.Nanoseconds = 0;
+    Status = RtlpSystemTimeToLocalCalendarTime(&SystemTime, &CalendarTime);
+    if (!KSUCCESS(Status)) {
+        return Status;
     }
 
-    Letters = NULL;
-    if (Rule != NULL) {
-        Letters = RtlpTimeZoneGetString(RtlTimeZoneData, Rule->Letters);
-    }
+    Transition->Time = Seconds;
+    Transition->GmtOffset = CalendarTime.GmtOffset;
+    Transition->IsDaylightSaving = CalendarTime.IsDaylightSaving;
+    Transition->TimeZone = CalendarTime.TimeZone;
+    return STATUS_SUCCESS;
+}
 
-    Result = Destination;
-    RemainingSize = DestinationSize - 1;
-    while (RemainingSize != 0) {
+BOOL
+RtlpAddTimeZoneTransition (
+    PTIME_ZONE_TRANSITION_TABLE *Table,
+    PTIME_ZONE_TRANSITION Transition
+    )
 
-        //
-        // If a %s is found, copy the letters string in.
-        //
+/*++
 
-        if ((*Format == '%') && (*(Format + 1) == 's')) {
-            if (Letters != NULL) {
-                LetterIndex = 0;
-                while (RemainingSize != 0) {
-                    if (Letters[LetterIndex] == '\0') {
-                        break;
-                    }
+Routine Description:
 
-                    *Result = Letters[LetterIndex];
-                    LetterIndex += 1;
-                    Result += 1;
-                    RemainingSize -= 1;
-                }
-            }
+    This routine appends a transition to a table that is being built,
+    allocating or expanding the table as needed.
 
-            Format += 2;
+Arguments:
+
+    Table - Supplies a pointer to the table being built. This may be updated
+        if the table needs to be reallocated. On failure, the original table
+        is left intact for the caller to free.
+
+    Transition - Supplies a pointer to the transition to append.
+
+Return Value:
+
+    TRUE on success.
+
+    FALSE on allocation failure.
+
+--*/
+
+{
+
+    ULONG Capacity;
+    PTIME_ZONE_TRANSITION_TABLE NewTable;
+    UINTN Size;
+
+    NewTable = *Table;
+    if ((NewTable == NULL) || (NewTable->Count == NewTable->Capacity)) {
+        if (NewTable == NULL) {
+            Capacity = TIME_ZONE_TRANSITION_INITIAL_CAPACITY;
 
         } else {
-            *Result = *Format;
-            if (*Format == '\0') {
-                break;
-            }
+            Capacity = NewTable->Capacity * 2;
+        }
 
-            Format += 1;
-            Result += 1;
-            RemainingSize -= 1;
+        Size = sizeof(TIME_ZONE_TRANSITION_TABLE) +
+               ((Capacity - ANYSIZE_ARRAY) * sizeof(TIME_ZONE_TRANSITION));
+
+        NewTable = RtlTimeZoneReallocate(*Table, Size);
+        if (NewTable == NULL) {
+            return FALSE;
+        }
+
+        if (*Table == NULL) {
+            NewTable->End = 0;
+            NewTable->Count = 0;
         }
+
+        NewTable->Capacity = Capacity;
+        *Table = NewTable;
     }
 
-    *Result = '\0';
-    return;
+    RtlCopyMemory(&(NewTable->Transitions[NewTable->Count]),
+                  Transition,
+                  sizeof(TIME_ZONE_TRANSITION));
+
+    NewTable->Count += 1;
+    return TRUE;
 }
 
-PCSTR
-RtlpTimeZoneCacheString (
-    PCSTR String
+BOOL
+RtlpPublishTimeZoneTransitions (
+    PTIME_ZONE_TRANSITION_TABLE Table
     )
 
 /*++
 
 Routine Description:
 
-    This routine returns a cached string for the given string. This routine
-    assumes the time zone lock is already held.
+    This routine publishes a newly built transition table for lock-free
+    lookups in the first free slot. This routine assumes the time zone lock is
+    already held.
 
 Arguments:
 
-    String - Supplies a pointer to the string to find the cached version of.
+    Table - Supplies a pointer to the completed table.
 
 Return Value:
 
-    Returns a pointer to the cached string on success.
+    TRUE if the table was published. The table now belongs to its slot.
 
-    NULL on allocation failure.
+    FALSE if there is no free slot to put it in. The caller still owns the
+    table.
 
 --*/
 
 {
 
     ULONG Index;
-    BOOL Match;
-    PSTR *NewBuffer;
-    ULONG NewCapacity;
-    PSTR NewString;
-    UINTN StringSize;
-
-    StringSize = RtlStringLength(String) + 1;
+    PTIME_ZONE_TRANSITION_SLOT Slot;
 
-    //
-    // There should never really be that many time zone names floating around
-    // (probably less than 6 at any time), so use a simple linear search of an
-    // array of strings.
-    //
+    ASSERT(RtlTimeZoneTransitionSlot == TIME_ZONE_TRANSITION_NO_SLOT);
 
-    for (Index = 0; Index < RtlTimeZoneNameCacheSize; Index += 1) {
-        if (RtlTimeZoneNameCache[Index] == NULL) {
-            break;
+    RtlpFreeUnusedTimeZoneTransitions();
+    for (Index = 0; Index < TIME_ZONE_TRANSITION_SLOT_COUNT; Index += 1) {
+        Slot = &(RtlTimeZoneTransitionSlots[Index]);
+        if (Slot->Table != NULL) {
+            continue;
         }
 
-        Match = RtlAreStringsEqual(RtlTimeZoneNameCache[Index],
-                                   String,
-                                   StringSize);
+        //
+        // The exchange is a full barrier, so readers that see the new slot
+        // index also see the table and its contents.
+        //
 
-        if (Match != FALSE) {
-            return RtlTimeZoneNameCache[Index];
-        }
+        Slot->Table = Table;
+        RtlAtomicExchange32((PULONG)&RtlTimeZoneTransitionSlot, Index);
+        return TRUE;
     }
 
-    //
-    // The string was not found. If the array is full, reallocate it.
-    //
+    return FALSE;
+}
 
-    if (Index == RtlTimeZoneNameCacheSize) {
-        if (Index == 0) {
-            NewCapacity = 8;
+VOID
+RtlpResetTimeZoneTransitions (
+    VOID
+    )
 
-        } else {
-            NewCapacity = Index * 2;
-        }
+/*++
 
-        NewBuffer = RtlTimeZoneReallocate(RtlTimeZoneNameCache,
-                                          NewCapacity * sizeof(PSTR));
+Routine Description:
 
-        if (NewBuffer == NULL) {
-            return NULL;
-        }
+    This routine unpublishes the transition table after the time zone has
+    changed. A new table will be built once enough conversions have been
+    done in the new zone. This routine assumes the time zone lock is already
+    held.
 
-        RtlTimeZoneNameCache = NewBuffer;
-        RtlTimeZoneNameCacheSize = NewCapacity;
-        RtlZeroMemory(NewBuffer + Index, (NewCapacity - Index) * sizeof(PSTR));
-    }
+Arguments:
 
-    NewString = RtlTimeZoneReallocate(NULL, StringSize);
-    if (NewString == NULL) {
-        return NULL;
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    RtlAtomicExchange32((PULONG)&RtlTimeZoneTransitionSlot,
+                        TIME_ZONE_TRANSITION_NO_SLOT);
+
+    RtlTimeZoneGeneration += 1;
+    RtlTimeZoneTransitionsAttempted = FALSE;
+    RtlTimeZoneSlowConversions = 0;
+    RtlpFreeUnusedTimeZoneTransitions();
+    return;
+}
+
+VOID
+RtlpFreeUnusedTimeZoneTransitions (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine frees the tables in any slots that are no longer current and
+    that have no lock-free readers counted against them. Tables that cannot
+    be freed yet are left for a later attempt. This routine assumes the time
+    zone lock is already held.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+    PTIME_ZONE_TRANSITION_SLOT Slot;
+    PTIME_ZONE_TRANSITION_TABLE Table;
+
+    //
+    // The current slot index was swapped before getting here. A reader that
+    // counts itself against a stale slot after this check will see that the
+    // slot is no longer current and back out without touching the table.
+    //
+
+    for (Index = 0; Index < TIME_ZONE_TRANSITION_SLOT_COUNT; Index += 1) {
+        Slot = &(RtlTimeZoneTransitionSlots[Index]);
+        if ((Index == RtlTimeZoneTransitionSlot) ||
+            (Slot->Table == NULL) ||
+            (Slot->ReferenceCount != 0)) {
+
+            continue;
+        }
+
+        Table = Slot->Table;
+        Slot->Table = NULL;
+        RtlTimeZoneReallocate(Table, 0);
     }
 
-    RtlCopyMemory(NewString, String, StringSize);
-    RtlTimeZoneNameCache[Index] = NewString;
-    return NewString;
+    return;
 }
 
@@ -335,6 +335,67 @@ Return Value:
 
 --*/
 
+BOOL
+RtlpFormatWriteString (
+    PPRINT_FORMAT_CONTEXT Context,
+    PCSTR String,
+    ULONG Size
+    );
+
+/*++
+
+Routine Description:
+
+    This routine writes a run of characters to the print format destination.
+    If the destination supports it, the run is handed over in a single call.
+
+Arguments:
+
+    Context - Supplies a pointer to the print format context.
+
+    String - Supplies a pointer to the characters to write. This does not
+        need to be null terminated.
+
+    Size - Supplies the number of characters to write.
+
+Return Value:
+
+    TRUE if the characters were written.
+
+    FALSE on failure.
+
+--*/
+
+BOOL
+RtlpFormatWritePadding (
+    PPRINT_FORMAT_CONTEXT Context,
+    CHAR Character,
+    ULONG Count
+    );
+
+/*++
+
+Routine Description:
+
+    This routine writes the same character to the print format destination
+    several times over.
+
+Arguments:
+
+    Context - Supplies a pointer to the print format context.
+
+    Character - Supplies the character to repeat.
+
+    Count - Supplies the number of times to write the character.
+
+Return Value:
+
+    TRUE if the characters were written.
+
+    FALSE on failure.
+
+--*/
+
 LONG
 RtlpGetDoubleBase10Exponent (
     double Value,
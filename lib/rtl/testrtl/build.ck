@@ -37,6 +37,7 @@ function build() {
         "fpstest.c",
         "fptest.c",
         "heaptest.c",
+        "lztest.c",
         "testrtl.c",
         "timetest.c"
     ];
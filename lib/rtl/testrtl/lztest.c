@@ -0,0 +1,299 @@
+/*++
+
+Copyright (c) 2026 Minoca Corp.
+
+    This file is licensed under the terms of the GNU General Public License
+    version 3. Alternative licensing terms are available. Contact
+    info@minocacorp.com for details. See the LICENSE file at the root of this
+    project for complete licensing information.
+
+Module Name:
+
+    lztest.c
+
+Abstract:
+
+    This module tests the LZ compressor in the runtime library.
+
+Author:
+
+    Minoca OS Contributors 19-Oct-2026
+
+Environment:
+
+    Test
+
+--*/
+
+//
+// ------------------------------------------------------------------- Includes
+//
+
+#define RTL_API
+
+#include <minoca/lib/types.h>
+#include <minoca/lib/status.h>
+#include <minoca/lib/rtl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// ---------------------------------------------------------------- Definitions
+//
+
+#define TEST_LZ_ITERATIONS 2000
+#define TEST_LZ_MAX_SIZE 0x11000
+
+//
+// Compressed data can grow a little beyond the input when nothing matches.
+//
+
+#define TEST_LZ_DESTINATION_SIZE (TEST_LZ_MAX_SIZE + (TEST_LZ_MAX_SIZE / 64))
+
+//
+// Define the ways test input is generated.
+//
+
+#define TEST_LZ_PATTERN_RANDOM 0
+#define TEST_LZ_PATTERN_ZERO 1
+#define TEST_LZ_PATTERN_REPEATING 2
+#define TEST_LZ_PATTERN_RUNS 3
+#define TEST_LZ_PATTERN_COUNT 4
+
+//
+// ------------------------------------------------------ Data Type Definitions
+//
+
+//
+// ----------------------------------------------- Internal Function Prototypes
+//
+
+VOID
+TestLzFillBuffer (
+    PUCHAR Buffer,
+    ULONG Size,
+    ULONG Pattern
+    );
+
+//
+// -------------------------------------------------------------------- Globals
+//
+
+ULONG TestLzHashTable[RTL_LZ_HASH_TABLE_SIZE];
+UCHAR TestLzSource[TEST_LZ_MAX_SIZE];
+UCHAR TestLzCompressed[TEST_LZ_DESTINATION_SIZE];
+UCHAR TestLzDecompressed[TEST_LZ_MAX_SIZE];
+
+//
+// ------------------------------------------------------------------ Functions
+//
+
+ULONG
+TestLz (
+    VOID
+    )
+
+/*++
+
+Routine Description:
+
+    This routine tests the LZ compressor and decompressor.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Returns the number of test failures.
+
+--*/
+
+{
+
+    ULONG CompressedSize;
+    ULONG DecompressedSize;
+    ULONG Failures;
+    ULONG Iteration;
+    ULONG Pattern;
+    ULONG Size;
+    BOOL Success;
+
+    Failures = 0;
+    for (Iteration = 0; Iteration < TEST_LZ_ITERATIONS; Iteration += 1) {
+
+        //
+        // Spend a good share of the iterations on tiny inputs, where the edge
+        // cases live.
+        //
+
+        if ((Iteration & 0x3) == 0) {
+            Size = rand() % 32;
+
+        } else {
+            Size = rand() % TEST_LZ_MAX_SIZE;
+        }
+
+        Pattern = rand() % TEST_LZ_PATTERN_COUNT;
+        TestLzFillBuffer(TestLzSource, Size, Pattern);
+        CompressedSize = RtlLzCompress(TestLzSource,
+                                       Size,
+                                       TestLzCompressed,
+                                       sizeof(TestLzCompressed),
+                                       TestLzHashTable);
+
+        if (CompressedSize == 0) {
+            printf("LzTest: Failed to compress %d bytes of pattern %d.\n",
+                   Size,
+                   Pattern);
+
+            Failures += 1;
+            continue;
+        }
+
+        Success = RtlLzDecompress(TestLzCompressed,
+                                  CompressedSize,
+                                  TestLzDecompressed,
+                                  sizeof(TestLzDecompressed),
+                                  &DecompressedSize);
+
+        if ((Success == FALSE) ||
+            (DecompressedSize != Size) ||
+            (memcmp(TestLzSource, TestLzDecompressed, Size) != 0)) {
+
+            printf("LzTest: Round trip of %d bytes of pattern %d failed. "
+                   "Decompressed %d bytes.\n",
+                   Size,
+                   Pattern,
+                   DecompressedSize);
+
+            Failures += 1;
+            continue;
+        }
+
+        //
+        // Compression into a buffer one byte too small must fail rather than
+        // overrun it, and so must decompression.
+        //
+
+        if (RtlLzCompress(TestLzSource,
+                          Size,
+                          TestLzCompressed,
+                          CompressedSize - 1,
+                          TestLzHashTable) != 0) {
+
+            printf("LzTest: Compression of %d bytes fit in %d bytes, expected "
+                   "%d.\n",
+                   Size,
+                   CompressedSize - 1,
+                   CompressedSize);
+
+            Failures += 1;
+        }
+
+        if ((Size != 0) &&
+            (RtlLzDecompress(TestLzCompressed,
+                             CompressedSize,
+                             TestLzDecompressed,
+                             Size - 1,
+                             &DecompressedSize) != FALSE)) {
+
+            printf("LzTest: Decompression of %d bytes fit in %d bytes.\n",
+                   Size,
+                   Size - 1);
+
+            Failures += 1;
+        }
+    }
+
+    //
+    // A page of zeros should shrink to almost nothing.
+    //
+
+    memset(TestLzSource, 0, 0x1000);
+    CompressedSize = RtlLzCompress(TestLzSource,
+                                   0x1000,
+                                   TestLzCompressed,
+                                   sizeof(TestLzCompressed),
+                                   TestLzHashTable);
+
+    if ((CompressedSize == 0) || (CompressedSize > 64)) {
+        printf("LzTest: Zero page compressed to %d bytes.\n", CompressedSize);
+        Failures += 1;
+    }
+
+    if (Failures != 0) {
+        printf("%d LZ test failures.\n", Failures);
+    }
+
+    return Failures;
+}
+
+//
+// --------------------------------------------------------- Internal Functions
+//
+
+VOID
+TestLzFillBuffer (
+    PUCHAR Buffer,
+    ULONG Size,
+    ULONG Pattern
+    )
+
+/*++
+
+Routine Description:
+
+    This routine fills a buffer with test data.
+
+Arguments:
+
+    Buffer - Supplies a pointer to the buffer to fill.
+
+    Size - Supplies the size of the buffer in bytes.
+
+    Pattern - Supplies the kind of data to generate. See TEST_LZ_PATTERN_*
+        definitions.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    ULONG Index;
+
+    for (Index = 0; Index < Size; Index += 1) {
+        switch (Pattern) {
+        case TEST_LZ_PATTERN_ZERO:
+            Buffer[Index] = 0;
+            break;
+
+        case TEST_LZ_PATTERN_REPEATING:
+            Buffer[Index] = (UCHAR)((Index % 7) * 3);
+            break;
+
+        case TEST_LZ_PATTERN_RUNS:
+            if ((Index == 0) || ((rand() & 0x3) == 0)) {
+                Buffer[Index] = (UCHAR)rand();
+
+            } else {
+                Buffer[Index] = Buffer[Index - 1];
+            }
+
+            break;
+
+        case TEST_LZ_PATTERN_RANDOM:
+        default:
+            Buffer[Index] = (UCHAR)rand();
+            break;
+        }
+    }
+
+    return;
+}
+
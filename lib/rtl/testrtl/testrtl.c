@@ -433,6 +433,11 @@ TestTime (
     VOID
     );
 
+ULONG
+TestLz (
+    VOID
+    );
+
 ULONG
 TestRedBlackTrees (
     BOOL Quiet
@@ -598,6 +603,7 @@ Return Value:
     TestsFailed += TestSoftFloatSingle();
     TestsFailed += TestSoftFloatDouble();
     TestsFailed += TestTime();
+    TestsFailed += TestLz();
     TestsFailed += TestHeaps(TRUE);
 
     //